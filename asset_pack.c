@@ -0,0 +1,227 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 asset_pack.c
+ * @brief	finds bundled files in a single mapped pack file
+ */
+#include "core/asset_pack.h"
+#include "core/image-cache/include/murmur.h"
+#include "core/log.h"
+#include "platform/resource_loader.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#define HEADER_SIZE 16
+#define ENTRY_SIZE 32
+
+typedef struct pack_entry_t {
+    uint64_t key;
+    uint32_t offset;
+    uint32_t size;
+    uint32_t full_size;
+    uint32_t url_offset;
+    uint32_t url_length;
+    uint32_t flags;
+} pack_entry;
+
+static bool m_open = false;
+static resource_view m_view;
+static uint32_t m_count = 0;
+
+// the mapping may not be aligned for wide reads, so fields are copied out
+static uint32_t read_u32(const unsigned char *p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint64_t entry_key(uint32_t index) {
+    uint64_t key;
+    memcpy(&key, m_view.data + HEADER_SIZE + (size_t) index * ENTRY_SIZE, sizeof(key));
+    return key;
+}
+
+static void read_entry(uint32_t index, pack_entry *entry) {
+    const unsigned char *p = m_view.data + HEADER_SIZE + (size_t) index * ENTRY_SIZE;
+    entry->key = entry_key(index);
+    entry->offset = read_u32(p + 8);
+    entry->size = read_u32(p + 12);
+    entry->full_size = read_u32(p + 16);
+    entry->url_offset = read_u32(p + 20);
+    entry->url_length = read_u32(p + 24);
+    entry->flags = read_u32(p + 28);
+}
+
+// whether the entry is for url, and lies inside the pack
+static bool entry_matches(uint32_t index, const char *url, size_t url_length, pack_entry *entry) {
+    read_entry(index, entry);
+    return entry->url_length == url_length &&
+           (unsigned long) entry->url_offset + url_length <= m_view.size &&
+           (unsigned long) entry->offset + entry->size <= m_view.size &&
+           !memcmp(m_view.data + entry->url_offset, url, url_length);
+}
+
+/**
+ * @name	asset_pack_open
+ * @brief	maps a pack file and checks its header, does nothing if a pack
+ *			is already open
+ * @param	url - (const char *) url of the pack in the bundle
+ * @retval	bool - (true | false) depending on whether a pack is open
+ */
+bool asset_pack_open(const char *url) {
+    if (m_open) {
+        return true;
+    }
+    if (!resource_loader_map_file(url, &m_view)) {
+        return false;
+    }
+
+    if (m_view.size < HEADER_SIZE || memcmp(m_view.data, "TLPK", 4) ||
+        read_u32(m_view.data + 4) != ASSET_PACK_VERSION) {
+        LOG("{pack} WARNING: %s is not a version %d asset pack", url, ASSET_PACK_VERSION);
+        resource_loader_unmap_file(&m_view);
+        return false;
+    }
+
+    m_count = read_u32(m_view.data + 8);
+    if (m_count > (m_view.size - HEADER_SIZE) / ENTRY_SIZE) {
+        LOG("{pack} WARNING: %s is truncated", url);
+        resource_loader_unmap_file(&m_view);
+        return false;
+    }
+
+    m_open = true;
+    LOG("{pack} Opened %s with %u files", url, (unsigned int) m_count);
+    return true;
+}
+
+/**
+ * @name	asset_pack_close
+ * @brief	unmaps the pack, blobs found in it are no longer valid
+ * @retval	NONE
+ */
+void asset_pack_close() {
+    if (m_open) {
+        resource_loader_unmap_file(&m_view);
+        m_open = false;
+        m_count = 0;
+    }
+}
+
+/**
+ * @name	asset_pack_find
+ * @brief	finds a file in the pack. keys are uniform hashes, so guessing
+ *			an entry's place from its key lands on or next to it
+ * @param	url - (const char *) url of the file
+ * @param	blob - (asset_pack_blob *) set to the file's bytes in the pack
+ * @retval	bool - (true | false) depending on whether the pack has the file
+ */
+bool asset_pack_find(const char *url, asset_pack_blob *blob) {
+    if (!m_open || !m_count) {
+        return false;
+    }
+
+    size_t url_length = strlen(url);
+    uint64_t hash[2];
+    MurmurHash3_x86_128(url, (int) url_length, 0, hash);
+    uint64_t key = hash[0];
+
+    // interpolation search for the first entry with a key at least key,
+    // which always lies in [lo, hi]
+    uint32_t lo = 0;
+    uint32_t hi = m_count - 1;
+    if (key > entry_key(hi)) {
+        return false;
+    }
+    while (lo < hi) {
+        uint64_t lo_key = entry_key(lo);
+        if (lo_key >= key) {
+            break;
+        }
+        if (hi - lo == 1) {
+            lo = hi;
+            break;
+        }
+
+        uint64_t hi_key = entry_key(hi);
+        uint32_t guess = lo + (uint32_t) ((double) (key - lo_key) / (double) (hi_key - lo_key) * (hi - lo));
+        if (guess <= lo) {
+            guess = lo + 1;
+        } else if (guess >= hi) {
+            guess = hi - 1;
+        }
+
+        if (entry_key(guess) < key) {
+            lo = guess + 1;
+        } else {
+            hi = guess;
+        }
+    }
+
+    // urls whose keys collide sit next to each other
+    uint32_t i;
+    for (i = lo; i < m_count && entry_key(i) == key; i++) {
+        pack_entry entry;
+        if (entry_matches(i, url, url_length, &entry)) {
+            blob->data = m_view.data + entry.offset;
+            blob->size = entry.size;
+            blob->compressed = (entry.flags & ASSET_PACK_DEFLATE) != 0;
+            blob->full_size = blob->compressed ? entry.full_size : entry.size;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @name	asset_pack_read
+ * @brief	copies a file out of the pack, inflating it if it is compressed
+ * @param	url - (const char *) url of the file
+ * @param	size - (unsigned long *) set to the file's size, may be NULL
+ * @retval	char* - NUL terminated contents for the caller to free, NULL if
+ *			the pack does not have the file or it could not be inflated
+ */
+char *asset_pack_read(const char *url, unsigned long *size) {
+    asset_pack_blob blob;
+    if (!asset_pack_find(url, &blob)) {
+        return NULL;
+    }
+
+    char *contents = (char *) malloc(blob.full_size + 1);
+    if (!contents) {
+        LOG("{pack} WARNING: Unable to allocate %lu bytes for %s", blob.full_size, url);
+        return NULL;
+    }
+
+    if (blob.compressed) {
+        uLongf inflated = blob.full_size;
+        if (uncompress((Bytef *) contents, &inflated, blob.data, blob.size) != Z_OK || inflated != blob.full_size) {
+            LOG("{pack} WARNING: Unable to inflate %s", url);
+            free(contents);
+            return NULL;
+        }
+    } else {
+        memcpy(contents, blob.data, blob.size);
+    }
+
+    contents[blob.full_size] = '\0';
+    if (size) {
+        *size = blob.full_size;
+    }
+    return contents;
+}
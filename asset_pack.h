@@ -0,0 +1,67 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+ 
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+ 
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef ASSET_PACK_H
+#define ASSET_PACK_H
+
+#include "core/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Asset packs
+ *
+ * A bundle may ship its resources in one pack file instead of thousands of
+ * small ones. The pack is mapped once when core starts and files are found
+ * in it by url without touching the filesystem. All numbers little endian:
+ *
+ *   header   "TLPK", u32 version, u32 entry count, u32 reserved
+ *   entries  32 bytes each, sorted by key:
+ *            u64 key         first 64 bits of MurmurHash3_x86_128(url, seed 0)
+ *            u32 offset      of the blob from the start of the pack, 16 aligned
+ *            u32 size        bytes stored
+ *            u32 full_size   bytes once inflated, size when not compressed
+ *            u32 url_offset  of the url from the start of the pack
+ *            u32 url_length
+ *            u32 flags       ASSET_PACK_DEFLATE when the blob is zlib deflated
+ *   urls and blobs follow, in any order
+ */
+
+#define ASSET_PACK_URL "resources.pack"
+#define ASSET_PACK_VERSION 1
+#define ASSET_PACK_DEFLATE 0x1
+
+typedef struct asset_pack_blob_t {
+	const unsigned char *data; // inside the mapping, valid until asset_pack_close
+	unsigned long size;
+	unsigned long full_size;
+	bool compressed;
+} asset_pack_blob;
+
+// maps the pack, false when the bundle has none or it is not a valid pack
+bool asset_pack_open(const char *url);
+void asset_pack_close();
+bool asset_pack_find(const char *url, asset_pack_blob *blob);
+// copies a file out of the pack, inflated and NUL terminated, NULL if the
+// pack does not have it
+char *asset_pack_read(const char *url, unsigned long *size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // ASSET_PACK_H
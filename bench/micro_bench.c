@@ -0,0 +1,531 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/* Microbenchmarks for the core data structures and kernels. Inputs come
+ * from fixed seeds, so every run does the same work, and each benchmark
+ * prints one line of JSON with its best time over the repeats and a check
+ * value. The check depends only on the results, so it must match between
+ * two builds for their times to be compared.
+ *
+ *   micro_bench [-r repeats] [-b name]
+ *
+ * -b runs only the benchmarks whose names contain name. Links like
+ * render_bench, without needing a gl context or a JS engine to be running.
+ */
+
+#include "core/geometry.h"
+#include "core/rgba.h"
+#include "core/object_pool.h"
+#include "core/timer.h"
+#include "core/texture_2d.h"
+#include "core/image_writer.h"
+#include "core/timestep/timestep_easing.h"
+#include "core/timestep/timestep_bench.h"
+#include "core/image-cache/include/image_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SEED 0x9e3779b9u
+
+typedef struct bench_result_t {
+    double ms; // of the timed part only
+    unsigned long long ops;
+    unsigned int check;
+} bench_result;
+
+typedef bool (*bench_fn)(bench_result *result);
+
+static unsigned int m_random = SEED;
+
+static unsigned int next_random() {
+    unsigned int r = m_random;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    m_random = r;
+    return r;
+}
+
+static float random_float(float min, float max) {
+    return min + (max - min) * (next_random() & 0xffffff) * (1.f / 0xffffff);
+}
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// 32 bit FNV-1a, over values rounded so last bit float differences between
+// scalar and SIMD paths don't change it
+static unsigned int check_int(unsigned int h, int value) {
+    for (int i = 0; i < 4; i++) {
+        h = (h ^ ((value >> (i * 8)) & 0xff)) * 16777619u;
+    }
+    return h;
+}
+
+static unsigned int check_float(unsigned int h, float value) {
+    return check_int(h, (int) (value * 1000 + (value < 0 ? -0.5f : 0.5f)));
+}
+
+//// geometry
+
+#define MATRIX_COUNT 1024
+#define MATRIX_PASSES 1000
+
+static void random_matrix(matrix_3x3 *m) {
+    matrix_3x3_identity(m);
+    matrix_3x3_translate(m, random_float(-500, 500), random_float(-500, 500));
+    matrix_3x3_rotate(m, random_float(-3.14f, 3.14f));
+    matrix_3x3_scale(m, random_float(0.5f, 2), random_float(0.5f, 2));
+}
+
+static bool bench_matrix_multiply(bench_result *result) {
+    matrix_3x3 *in = (matrix_3x3 *) malloc(sizeof(matrix_3x3) * MATRIX_COUNT);
+    matrix_3x3 *out = (matrix_3x3 *) malloc(sizeof(matrix_3x3) * MATRIX_COUNT);
+    if (!in || !out) {
+        free(in);
+        free(out);
+        return false;
+    }
+    for (int i = 0; i < MATRIX_COUNT; i++) {
+        random_matrix(&in[i]);
+    }
+
+    double start = now_ms();
+    for (int pass = 0; pass < MATRIX_PASSES; pass++) {
+        for (int i = 0; i < MATRIX_COUNT; i++) {
+            matrix_3x3_multiply_m_m_m(&in[i], &in[(i + pass + 1) & (MATRIX_COUNT - 1)], &out[i]);
+        }
+    }
+    result->ms = now_ms() - start;
+    result->ops = (unsigned long long) MATRIX_COUNT * MATRIX_PASSES;
+
+    for (int i = 0; i < MATRIX_COUNT; i++) {
+        result->check = check_float(result->check, out[i].m00 + out[i].m01 + out[i].m02);
+        result->check = check_float(result->check, out[i].m10 + out[i].m11 + out[i].m12);
+    }
+    free(in);
+    free(out);
+    return true;
+}
+
+static bool bench_matrix_transform_quads(bench_result *result) {
+    rect_2d *src = (rect_2d *) malloc(sizeof(rect_2d) * MATRIX_COUNT);
+    rect_2d *dest = (rect_2d *) malloc(sizeof(rect_2d) * MATRIX_COUNT);
+    textured_quad *quads = (textured_quad *) malloc(sizeof(textured_quad) * MATRIX_COUNT);
+    if (!src || !dest || !quads) {
+        free(src);
+        free(dest);
+        free(quads);
+        return false;
+    }
+    matrix_3x3 m;
+    random_matrix(&m);
+    for (int i = 0; i < MATRIX_COUNT; i++) {
+        rect_2d s = {random_float(0, 960), random_float(0, 960), random_float(8, 64), random_float(8, 64)};
+        rect_2d d = {random_float(-100, 1000), random_float(-100, 1000), s.width, s.height};
+        src[i] = s;
+        dest[i] = d;
+    }
+
+    double start = now_ms();
+    for (int pass = 0; pass < MATRIX_PASSES; pass++) {
+        matrix_3x3_transform_quads(&m, src, dest, MATRIX_COUNT, 1.f / 1024, 1.f / 1024, quads);
+    }
+    result->ms = now_ms() - start;
+    result->ops = (unsigned long long) MATRIX_COUNT * MATRIX_PASSES;
+
+    for (int i = 0; i < MATRIX_COUNT; i++) {
+        result->check = check_float(result->check, quads[i].dest.x1 + quads[i].dest.y3);
+        result->check = check_float(result->check, (quads[i].s_min + quads[i].t_max) * 1000);
+    }
+    free(src);
+    free(dest);
+    free(quads);
+    return true;
+}
+
+//// easing
+
+#define EASING_SAMPLES 100000
+
+static bool bench_easing(bench_result *result, unsigned int mode) {
+    unsigned int transitions = view_animation_transition_count();
+    double sum = 0;
+
+    double start = now_ms();
+    for (unsigned int transition = 1; transition < transitions; transition++) {
+        for (int i = 0; i <= EASING_SAMPLES; i++) {
+            sum += view_animation_ease(transition, (double) i / EASING_SAMPLES, mode);
+        }
+    }
+    result->ms = now_ms() - start;
+    result->ops = (unsigned long long) (transitions - 1) * (EASING_SAMPLES + 1);
+    result->check = check_float(result->check, (float) (sum / result->ops));
+    return true;
+}
+
+static bool bench_easing_exact(bench_result *result) {
+    return bench_easing(result, EASING_EXACT);
+}
+
+static bool bench_easing_float(bench_result *result) {
+    return bench_easing(result, EASING_FLOAT);
+}
+
+static bool bench_easing_lut(bench_result *result) {
+    return bench_easing(result, EASING_LUT);
+}
+
+//// rgba
+
+#define RGBA_PASSES 100000
+
+static const char *m_colors[] = {
+    "#fff", "#ff8800", "#10203040", "rgb(12, 34, 56)", "rgba(200, 100, 50, 0.5)",
+    "red", "cornflowerblue", "transparent"
+};
+
+static bool bench_rgba_parse(bench_result *result) {
+    int count = (int) (sizeof(m_colors) / sizeof(m_colors[0]));
+    uint32_t packed = 0;
+
+    double start = now_ms();
+    for (int pass = 0; pass < RGBA_PASSES; pass++) {
+        for (int i = 0; i < count; i++) {
+            rgba color;
+            rgba_parse(&color, m_colors[i]);
+            packed ^= rgba_to_packed(&color) + i;
+        }
+    }
+    result->ms = now_ms() - start;
+    result->ops = (unsigned long long) count * RGBA_PASSES;
+    result->check = check_int(result->check, (int) packed);
+    return true;
+}
+
+//// object pool
+
+#define POOL_OBJECTS 512
+#define POOL_PASSES 1000
+
+static bool bench_object_pool(bench_result *result) {
+    object_pool *pool = object_pool_init(64, 64);
+    void **objects = (void **) malloc(sizeof(void *) * POOL_OBJECTS);
+    int *order = (int *) malloc(sizeof(int) * POOL_OBJECTS);
+    if (!pool || !objects || !order) {
+        free(objects);
+        free(order);
+        if (pool) {
+            object_pool_destroy(pool);
+        }
+        return false;
+    }
+    // released in a scattered order, as objects with different lifetimes are
+    for (int i = 0; i < POOL_OBJECTS; i++) {
+        order[i] = i;
+    }
+    for (int i = POOL_OBJECTS - 1; i > 0; i--) {
+        int j = (int) (next_random() % (unsigned int) (i + 1));
+        int t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+
+    unsigned int got = 0;
+    double start = now_ms();
+    for (int pass = 0; pass < POOL_PASSES; pass++) {
+        for (int i = 0; i < POOL_OBJECTS; i++) {
+            objects[i] = object_pool_get(pool);
+            got += objects[i] != NULL;
+        }
+        for (int i = 0; i < POOL_OBJECTS; i++) {
+            object_pool_put(objects[order[i]]);
+        }
+    }
+    result->ms = now_ms() - start;
+    result->ops = (unsigned long long) POOL_OBJECTS * POOL_PASSES * 2;
+    result->check = check_int(result->check, (int) got);
+    result->check = check_int(result->check, (int) pool->high_water);
+
+    object_pool_destroy(pool);
+    free(objects);
+    free(order);
+    return true;
+}
+
+//// timers
+
+#define TIMER_COUNT 10000
+#define TIMER_TICKS 600
+#define TIMER_TICK_MS 16
+
+static unsigned int m_timer_fires = 0;
+
+static void count_fires(core_timer **timers, int count) {
+    m_timer_fires += count;
+}
+
+static void forget_timer(core_timer *timer) {
+}
+
+static bool bench_timers(bench_result *result) {
+    core_timer_handlers handlers = {count_fires, forget_timer};
+    core_timer_set_handlers(&handlers);
+    m_timer_fires = 0;
+
+    // a quarter repeat, the rest fire once over the first few seconds
+    for (int i = 0; i < TIMER_COUNT; i++) {
+        core_timer *timer = core_get_timer(NULL, 1 + (int) (next_random() % 5000), i % 4 == 0);
+        if (!timer) {
+            core_timer_clear_all();
+            core_timer_set_handlers(NULL);
+            return false;
+        }
+        core_timer_schedule(timer);
+    }
+
+    double start = now_ms();
+    for (int i = 0; i < TIMER_TICKS; i++) {
+        core_timer_tick(TIMER_TICK_MS);
+    }
+    result->ms = now_ms() - start;
+    result->ops = TIMER_TICKS;
+    result->check = check_int(result->check, (int) m_timer_fires);
+    result->check = check_int(result->check, core_timer_count());
+
+    core_timer_clear_all();
+    core_timer_set_handlers(NULL);
+    return true;
+}
+
+//// views
+
+#define SUBVIEW_COUNT 10000
+
+static bool bench_subviews(bench_result *result, bool sort) {
+    double add_ms, sort_ms;
+    if (!timestep_bench_subviews(SUBVIEW_COUNT, next_random(), &add_ms, &sort_ms)) {
+        return false;
+    }
+    result->ms = sort ? sort_ms : add_ms;
+    result->ops = SUBVIEW_COUNT;
+    result->check = check_int(result->check, SUBVIEW_COUNT);
+    return true;
+}
+
+static bool bench_subviews_add(bench_result *result) {
+    return bench_subviews(result, false);
+}
+
+static bool bench_subviews_sort(bench_result *result) {
+    return bench_subviews(result, true);
+}
+
+//// texture loading
+
+#define TEXTURE_SIZE 1024
+#define TEXTURE_LOADS 4
+
+static unsigned char *m_png = NULL;
+static long m_png_size = 0;
+
+/**
+ * @name	make_png
+ * @brief	encodes a generated image with soft edged, partly transparent
+ *			shapes once, for the texture loads to decode
+ * @retval	bool - false if it couldn't be written or read back
+ */
+static bool make_png() {
+    if (m_png) {
+        return true;
+    }
+
+    unsigned char *pixels = (unsigned char *) malloc(TEXTURE_SIZE * TEXTURE_SIZE * 4);
+    if (!pixels) {
+        return false;
+    }
+    for (int y = 0; y < TEXTURE_SIZE; y++) {
+        for (int x = 0; x < TEXTURE_SIZE; x++) {
+            unsigned char *p = &pixels[(y * TEXTURE_SIZE + x) * 4];
+            p[0] = (unsigned char) x;
+            p[1] = (unsigned char) y;
+            p[2] = (unsigned char) (x ^ y);
+            p[3] = (unsigned char) ((x / 64 + y / 64) & 1 ? 255 : (x + y) & 0xff);
+        }
+    }
+
+    const char *dir = getenv("TMPDIR");
+    dir = dir ? dir : "/tmp";
+    char name[64];
+    snprintf(name, sizeof(name), "micro_bench_%d.png", (int) getpid());
+    bool ok = write_png_to_file(dir, name, pixels, TEXTURE_SIZE, TEXTURE_SIZE, 4, NULL);
+    free(pixels);
+
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *f = ok ? fopen(path, "rb") : NULL;
+    if (f) {
+        fseek(f, 0, SEEK_END);
+        m_png_size = ftell(f);
+        fseek(f, 0, SEEK_SET);
+        m_png = (unsigned char *) malloc(m_png_size);
+        if (m_png && fread(m_png, 1, m_png_size, f) != (size_t) m_png_size) {
+            free(m_png);
+            m_png = NULL;
+        }
+        fclose(f);
+    }
+    unlink(path);
+    return m_png != NULL;
+}
+
+static bool bench_texture_load(bench_result *result, bool halfsize) {
+    if (!make_png()) {
+        return false;
+    }
+
+    double start = now_ms();
+    for (int i = 0; i < TEXTURE_LOADS; i++) {
+        int channels, width, height, original_width, original_height, scale, compression, pixel_type;
+        long size;
+        unsigned char *pixels = texture_2d_load_texture_packed("micro_bench.png", m_png, m_png_size, &channels,
+            &width, &height, &original_width, &original_height, &scale, &size, &compression, halfsize, &pixel_type);
+        if (!pixels) {
+            return false;
+        }
+        if (i == 0) {
+            result->check = check_int(result->check, width * 10000 + height);
+            for (long j = 0; j < size; j += 4099) {
+                result->check = check_int(result->check, pixels[j]);
+            }
+        }
+        free(pixels);
+    }
+    result->ms = now_ms() - start;
+    result->ops = TEXTURE_LOADS;
+    return true;
+}
+
+static bool bench_texture_load_full(bench_result *result) {
+    return bench_texture_load(result, false);
+}
+
+// less the full size time, this is what half-sizing costs or saves
+static bool bench_texture_load_half(bench_result *result) {
+    return bench_texture_load(result, true);
+}
+
+//// image cache
+
+#define CACHE_URLS 100000
+
+static bool bench_cache_filename(bench_result *result) {
+    char url[128];
+    double ms = 0;
+    for (int i = 0; i < CACHE_URLS; i++) {
+        snprintf(url, sizeof(url), "https://cdn.example.com/avatars/%u/%08x.png", next_random() % 1000, next_random());
+
+        double start = now_ms();
+        char *filename = image_cache_get_filename(url);
+        ms += now_ms() - start;
+
+        if (!filename) {
+            return false;
+        }
+        result->check = check_int(result->check, filename[strlen(filename) - 1]);
+        free(filename);
+    }
+    result->ms = ms;
+    result->ops = CACHE_URLS;
+    return true;
+}
+
+typedef struct bench_t {
+    const char *name;
+    bench_fn run;
+} bench;
+
+static const bench m_benches[] = {
+    {"matrix_multiply", bench_matrix_multiply},
+    {"matrix_transform_quads", bench_matrix_transform_quads},
+    {"easing_exact", bench_easing_exact},
+    {"easing_float", bench_easing_float},
+    {"easing_lut", bench_easing_lut},
+    {"rgba_parse", bench_rgba_parse},
+    {"object_pool", bench_object_pool},
+    {"timer_tick_10k", bench_timers},
+    {"subviews_add", bench_subviews_add},
+    {"subviews_sort", bench_subviews_sort},
+    {"texture_load_full", bench_texture_load_full},
+    {"texture_load_half", bench_texture_load_half},
+    {"cache_filename", bench_cache_filename}
+};
+
+int main(int argc, char **argv) {
+    int repeats = 5;
+    const char *filter = NULL;
+    int c;
+    while ((c = getopt(argc, argv, "r:b:")) != -1) {
+        switch (c) {
+        case 'r': repeats = atoi(optarg) > 0 ? atoi(optarg) : 1; break;
+        case 'b': filter = optarg; break;
+        default:
+            fprintf(stderr, "usage: micro_bench [-r repeats] [-b name]\n");
+            return 1;
+        }
+    }
+
+    rgba_init();
+
+    bool ok = true;
+    int count = (int) (sizeof(m_benches) / sizeof(m_benches[0]));
+    for (int i = 0; i < count; i++) {
+        const bench *b = &m_benches[i];
+        if (filter && !strstr(b->name, filter)) {
+            continue;
+        }
+
+        bench_result best;
+        memset(&best, 0, sizeof(best));
+        for (int r = 0; r < repeats; r++) {
+            // every repeat, and every benchmark whatever runs before it,
+            // sees the same inputs
+            bench_result result;
+            memset(&result, 0, sizeof(result));
+            result.check = 2166136261u;
+            m_random = SEED;
+            if (!b->run(&result)) {
+                fprintf(stderr, "micro_bench: %s failed\n", b->name);
+                ok = false;
+                break;
+            }
+            if (r == 0 || result.ms < best.ms) {
+                best = result;
+            }
+        }
+        if (best.ops) {
+            printf("{\"bench\":\"%s\",\"ops\":%llu,\"ms\":%.3f,\"nsPerOp\":%.2f,\"check\":\"%08x\"}\n",
+                   b->name, best.ops, best.ms, best.ms * 1000000.0 / best.ops, best.check);
+        }
+    }
+    free(m_png);
+    return ok ? 0 : 1;
+}
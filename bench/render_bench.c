@@ -0,0 +1,175 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/* Renders synthetic view trees off screen and prints one line of JSON per
+ * run, see timestep_bench.h, so builds can be compared without a device.
+ * Makes a headless GLES 2 context on an EGL pbuffer, which Mesa's software
+ * and surfaceless drivers provide on machines without a display.
+ *
+ *   render_bench [-s scene] [-n count] [-t textures] [-f frames] [-w warmup]
+ *                [-W width] [-H height] [-r seed] [-S]
+ *
+ * scene is sprites, nested, scroll or textures, or all to run each in turn.
+ * -S keeps the views still. Link with the engine, its JS bindings and a
+ * headless platform layer, and -lEGL -lGLESv2. On glibc allocations are
+ * counted by wrapping malloc, for the whole process, gl driver included.
+ */
+
+#include "core/core.h"
+#include "core/rgba.h"
+#include "core/jobs.h"
+#include "core/timestep/timestep_bench.h"
+#include <EGL/egl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __GLIBC__
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static unsigned long long m_allocs = 0;
+
+void *malloc(size_t size) {
+    __atomic_add_fetch(&m_allocs, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    __atomic_add_fetch(&m_allocs, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    __atomic_add_fetch(&m_allocs, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+static unsigned long long alloc_count() {
+    return __atomic_load_n(&m_allocs, __ATOMIC_RELAXED);
+}
+#endif
+
+/**
+ * @name	make_context
+ * @brief	creates a GLES 2 context on a pbuffer of the given size and makes
+ *			it current
+ * @param	width - (int) width of the pbuffer
+ * @param	height - (int) height of the pbuffer
+ * @retval	bool - false if there is no EGL display or config to use
+ */
+static bool make_context(int width, int height) {
+    EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+        fprintf(stderr, "render_bench: no EGL display\n");
+        return false;
+    }
+
+    const EGLint config_attribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint configs = 0;
+    if (!eglChooseConfig(display, config_attribs, &config, 1, &configs) || configs < 1) {
+        fprintf(stderr, "render_bench: no GLES 2 pbuffer config\n");
+        return false;
+    }
+
+    const EGLint surface_attribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+    const EGLint context_attribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+    eglBindAPI(EGL_OPENGL_ES_API);
+    EGLSurface surface = eglCreatePbufferSurface(display, config, surface_attribs);
+    EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+    if (surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(display, surface, surface, context)) {
+        fprintf(stderr, "render_bench: unable to make a context, EGL error 0x%x\n", eglGetError());
+        return false;
+    }
+    return true;
+}
+
+static void usage() {
+    fprintf(stderr, "usage: render_bench [-s sprites|nested|scroll|textures|all] [-n count] [-t textures]\n"
+                    "                    [-f frames] [-w warmup] [-W width] [-H height] [-r seed] [-S]\n");
+}
+
+static bool run(timestep_bench_options *opts) {
+    char *report = timestep_bench_run(opts);
+    if (!report) {
+        fprintf(stderr, "render_bench: %s scene failed\n", timestep_bench_scene_name(opts->scene));
+        return false;
+    }
+    printf("%s\n", report);
+    free(report);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    timestep_bench_options opts;
+    timestep_bench_default_options(&opts);
+#ifdef __GLIBC__
+    opts.alloc_count = alloc_count;
+#endif
+
+    bool all = false;
+    int c;
+    while ((c = getopt(argc, argv, "s:n:t:f:w:W:H:r:S")) != -1) {
+        switch (c) {
+        case 's':
+            all = !strcmp(optarg, "all");
+            opts.scene = all ? 0 : timestep_bench_find_scene(optarg);
+            if (opts.scene < 0) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'n': opts.count = (unsigned int) atoi(optarg); break;
+        case 't': opts.textures = (unsigned int) atoi(optarg); break;
+        case 'f': opts.frames = (unsigned int) atoi(optarg); break;
+        case 'w': opts.warmup = (unsigned int) atoi(optarg); break;
+        case 'W': opts.width = atoi(optarg); break;
+        case 'H': opts.height = atoi(optarg); break;
+        case 'r': opts.seed = (unsigned int) atoi(optarg); break;
+        case 'S': opts.animate = false; break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if (!make_context(opts.width, opts.height)) {
+        return 1;
+    }
+    rgba_init();
+    jobs_init(0);
+    core_init_gl(0);
+    core_on_screen_resize(opts.width, opts.height);
+
+    bool ok = true;
+    if (all) {
+        for (int scene = 0; scene < BENCH_SCENE_COUNT; scene++) {
+            opts.scene = scene;
+            ok = run(&opts) && ok;
+        }
+    } else {
+        ok = run(&opts);
+    }
+    return ok ? 0 : 1;
+}
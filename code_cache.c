@@ -0,0 +1,240 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 code_cache.c
+ * @brief	stores the engine's compiled form of a script on disk so later
+ *			launches can skip parsing and compiling it
+ */
+#include "core/code_cache.h"
+#include "core/core_js.h"
+#include "core/log.h"
+#include "core/platform/native.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CODE_CACHE_MAGIC 0x434a4c54 // "TLJC"
+#define CODE_CACHE_FORMAT 2
+
+typedef struct code_cache_header_t {
+    unsigned int magic;
+    unsigned int format;
+    unsigned long long key_hash;
+    unsigned long long source_hash;
+    unsigned long long source_size;
+    unsigned long long data_hash;
+    unsigned long long data_size;
+} code_cache_header;
+
+static unsigned long long hash_bytes(const unsigned char *p, size_t size) {
+    // 64 bit FNV-1a
+    unsigned long long h = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/**
+ * @name	cache_path
+ * @brief	finds the cache file for an entry
+ * @param	name - (const char *) name of the entry
+ * @param	path - (char *) receives the path
+ * @param	size - (size_t) size of path
+ * @retval	bool - false if there is nowhere to keep the cache
+ */
+static bool cache_path(const char *name, char *path, size_t size) {
+    const char *dir = get_storage_directory();
+    if (!dir || !*dir) {
+        return false;
+    }
+
+    int len = snprintf(path, size, "%s/%s.codecache", dir, name);
+    return len > 0 && (size_t) len < size;
+}
+
+static void fill_header(code_cache_header *header, const char *key, const char *source) {
+    size_t source_size = strlen(source);
+    memset(header, 0, sizeof(*header));
+    header->magic = CODE_CACHE_MAGIC;
+    header->format = CODE_CACHE_FORMAT;
+    header->key_hash = hash_bytes((const unsigned char *) key, strlen(key));
+    header->source_hash = hash_bytes((const unsigned char *) source, source_size);
+    header->source_size = source_size;
+}
+
+/**
+ * @name	code_cache_read
+ * @brief	reads a cached compiled form, removing the entry if it doesn't
+ *			match so the next successful compile writes a fresh one
+ * @param	name - (const char *) name of the entry
+ * @param	key - (const char *) whatever else the data depends on, such as
+ *			the engine or driver version
+ * @param	source - (const char *) source the data was compiled from
+ * @param	size - (unsigned long *) receives the size of the data
+ * @retval	void* - the data, for the caller to free, or NULL
+ */
+void *code_cache_read(const char *name, const char *key, const char *source, unsigned long *size) {
+    char path[1024];
+    if (!cache_path(name, path, sizeof(path))) {
+        return NULL;
+    }
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return NULL;
+    }
+
+    code_cache_header expected, header;
+    fill_header(&expected, key, source);
+
+    unsigned char *data = NULL;
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        header.magic != expected.magic || header.format != expected.format ||
+        header.key_hash != expected.key_hash || header.source_hash != expected.source_hash ||
+        header.source_size != expected.source_size) {
+        LOG("{codecache} Cache for %s is stale", name);
+        goto failed;
+    }
+
+    data = (unsigned char *) malloc(header.data_size ? header.data_size : 1);
+    if (!data) {
+        LOG("{codecache} WARNING: Unable to allocate %llu bytes for the cache of %s", header.data_size, name);
+        goto failed;
+    }
+    if (fread(data, 1, header.data_size, fp) != header.data_size ||
+        hash_bytes(data, header.data_size) != header.data_hash) {
+        LOG("{codecache} WARNING: Cache for %s is damaged", name);
+        goto failed;
+    }
+
+    fclose(fp);
+    *size = (unsigned long) header.data_size;
+    return data;
+
+failed:
+    free(data);
+    fclose(fp);
+    remove(path);
+    return NULL;
+}
+
+/**
+ * @name	code_cache_write
+ * @brief	writes a compiled form through a temporary file, so a partial
+ *			write is never read
+ * @param	name - (const char *) name of the entry
+ * @param	key - (const char *) whatever else the data depends on
+ * @param	source - (const char *) source the data was compiled from
+ * @param	data - (const void *) the compiled form
+ * @param	size - (unsigned long) size of the data
+ * @retval	bool - true if the entry was written
+ */
+bool code_cache_write(const char *name, const char *key, const char *source, const void *data, unsigned long size) {
+    char path[1024], tmp_path[1040];
+    if (!cache_path(name, path, sizeof(path))) {
+        return false;
+    }
+
+    code_cache_header header;
+    fill_header(&header, key, source);
+    header.data_hash = hash_bytes((const unsigned char *) data, size);
+    header.data_size = size;
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    FILE *fp = fopen(tmp_path, "wb");
+    if (!fp) {
+        LOG("{codecache} WARNING: Unable to open %s", tmp_path);
+        return false;
+    }
+
+    bool written = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+                   fwrite(data, 1, size, fp) == size;
+    written = !fclose(fp) && written;
+
+    if (!written || rename(tmp_path, path)) {
+        LOG("{codecache} WARNING: Unable to write the cache for %s", name);
+        remove(tmp_path);
+        return false;
+    }
+    LOG("{codecache} Wrote %lu bytes of compiled code for %s", size, name);
+    return true;
+}
+
+/**
+ * @name	code_cache_remove
+ * @brief	drops an entry the consumer found it can't use
+ * @param	name - (const char *) name of the entry
+ * @retval	NONE
+ */
+void code_cache_remove(const char *name) {
+    char path[1024];
+    if (cache_path(name, path, sizeof(path))) {
+        remove(path);
+    }
+}
+
+static const char *script_key() {
+    // a new build of the app may bring a new engine, whose data won't match
+    const char *version = get_app_version();
+    return version ? version : "";
+}
+
+/**
+ * @name	code_cache_eval
+ * @brief	runs a script from its cached compiled form
+ * @param	filename - (const char *) name of the script, for the cache path
+ * @param	source - (const char *) contents of the script
+ * @retval	bool - false if nothing was run, because there is no valid
+ *			cache for this source or the engine rejected it
+ */
+bool code_cache_eval(const char *filename, const char *source) {
+    unsigned long size;
+    unsigned char *data = (unsigned char *) code_cache_read(filename, script_key(), source, &size);
+    if (!data) {
+        return false;
+    }
+
+    bool ran = js_eval_code_cache(source, filename, data, size);
+    free(data);
+    if (ran) {
+        LOG("{codecache} Evaluated %s from its code cache", filename);
+    } else {
+        LOG("{codecache} The engine rejected the cache for %s", filename);
+        code_cache_remove(filename);
+    }
+    return ran;
+}
+
+/**
+ * @name	code_cache_save
+ * @brief	writes the compiled form of a script that ran successfully
+ * @param	filename - (const char *) name of the script, for the cache path
+ * @param	source - (const char *) contents of the script
+ * @retval	NONE
+ */
+void code_cache_save(const char *filename, const char *source) {
+    unsigned long size = 0;
+    unsigned char *data = js_compile_code_cache(source, filename, &size);
+    if (!data) {
+        // the engine has no serialized form
+        return;
+    }
+
+    code_cache_write(filename, script_key(), source, data, size);
+    free(data);
+}
@@ -0,0 +1,40 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef CODE_CACHE_H
+#define CODE_CACHE_H
+
+#include "core/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Compiled code kept in the storage directory between launches. An entry
+// is only read back for the same source and key.
+void *code_cache_read(const char *name, const char *key, const char *source, unsigned long *size);
+bool code_cache_write(const char *name, const char *key, const char *source, const void *data, unsigned long size);
+void code_cache_remove(const char *name);
+
+// Javascript, for engines that implement the code cache hooks in core_js.h,
+// keyed by the app version
+bool code_cache_eval(const char *filename, const char *source);
+void code_cache_save(const char *filename, const char *source);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
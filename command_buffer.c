@@ -0,0 +1,142 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 command_buffer.c
+ * @brief	runs canvas calls JS encoded into a float array
+ */
+#include "core/command_buffer.h"
+#include "core/tealeaf_context.h"
+#include "core/log.h"
+
+// draws of one image gathered into a single context_2d_drawImageRectsHandle
+#define MAX_IMAGE_RUN 64
+
+// floats after each op
+static const unsigned char m_arg_counts[CMD_OP_COUNT] = {
+    0, 0, 2, 1, 2, 6, 1, 1, 5, 0, 4, 8, 4, 9
+};
+
+static inline rect_2d read_rect(const float *args) {
+    rect_2d rect = {args[0], args[1], args[2], args[3]};
+    return rect;
+}
+
+/**
+ * @name	run_images
+ * @brief	draws the image command at i and the draws of the same image
+ *          straight after it in one call
+ * @param	ctx - (context_2d *) context to draw to
+ * @param	commands - (const float *) the buffer
+ * @param	i - (unsigned int) index of a whole CMD_DRAW_IMAGE command
+ * @param	length - (unsigned int) number of floats in commands
+ * @retval	unsigned int - index of the first command after the run
+ */
+static unsigned int run_images(context_2d *ctx, const float *commands, unsigned int i, unsigned int length) {
+    rect_2d src[MAX_IMAGE_RUN];
+    rect_2d dest[MAX_IMAGE_RUN];
+    const unsigned int size = 1 + m_arg_counts[CMD_DRAW_IMAGE];
+    float handle = commands[i + 1];
+
+    int count = 0;
+    while (count < MAX_IMAGE_RUN && i + size <= length &&
+           commands[i] == CMD_DRAW_IMAGE && commands[i + 1] == handle) {
+        src[count] = read_rect(commands + i + 2);
+        dest[count] = read_rect(commands + i + 6);
+        count++;
+        i += size;
+    }
+
+    context_2d_drawImageRectsHandle(ctx, (int) handle, src, dest, count);
+    return i;
+}
+
+/**
+ * @name	command_buffer_run
+ * @brief	makes the context_2d call of each command in the buffer, in order
+ * @param	ctx - (context_2d *) context to draw to
+ * @param	commands - (const float *) ops, each followed by its arguments
+ * @param	length - (unsigned int) number of floats in commands
+ * @retval	unsigned int - number of floats consumed
+ */
+unsigned int command_buffer_run(context_2d *ctx, const float *commands, unsigned int length) {
+    unsigned int i = 0;
+    while (i < length) {
+        float op = commands[i];
+        if (!(op >= 0 && op < CMD_OP_COUNT) || op != (int) op ||
+            i + 1 + m_arg_counts[(int) op] > length) {
+            LOG("{commands} WARNING: Malformed command at %u", i);
+            return i;
+        }
+
+        if (op == CMD_DRAW_IMAGE) {
+            i = run_images(ctx, commands, i, length);
+            continue;
+        }
+
+        const float *args = commands + i + 1;
+        i += 1 + m_arg_counts[(int) op];
+        switch ((int) op) {
+        case CMD_SAVE:
+            context_2d_save(ctx);
+            break;
+        case CMD_RESTORE:
+            context_2d_restore(ctx);
+            break;
+        case CMD_TRANSLATE:
+            context_2d_translate(ctx, args[0], args[1]);
+            break;
+        case CMD_ROTATE:
+            context_2d_rotate(ctx, args[0]);
+            break;
+        case CMD_SCALE:
+            context_2d_scale(ctx, args[0], args[1]);
+            break;
+        case CMD_SET_TRANSFORM:
+            context_2d_setTransform(ctx, args[0], args[1], args[2], args[3], args[4], args[5]);
+            break;
+        case CMD_GLOBAL_ALPHA:
+            context_2d_setGlobalAlpha(ctx, args[0]);
+            break;
+        case CMD_COMPOSITE:
+            context_2d_setGlobalCompositeOperation(ctx, (int) args[0]);
+            break;
+        case CMD_FILTER: {
+            rgba color = {args[0], args[1], args[2], args[3]};
+            context_2d_add_filter(ctx, &color);
+            context_2d_set_filter_type(ctx, (int) args[4]);
+            break;
+        }
+        case CMD_CLEAR_FILTERS:
+            context_2d_clear_filters(ctx);
+            break;
+        case CMD_CLIP:
+            context_2d_setClip(ctx, read_rect(args));
+            break;
+        case CMD_FILL_RECT: {
+            rect_2d rect = read_rect(args);
+            rgba color = {args[4], args[5], args[6], args[7]};
+            context_2d_fillRect(ctx, &rect, &color);
+            break;
+        }
+        case CMD_CLEAR_RECT: {
+            rect_2d rect = read_rect(args);
+            context_2d_clearRect(ctx, &rect);
+            break;
+        }
+        }
+    }
+    return i;
+}
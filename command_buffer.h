@@ -0,0 +1,59 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef COMMAND_BUFFER_H
+#define COMMAND_BUFFER_H
+
+#include "core/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct context_2d_t;
+
+// JS render functions can encode their canvas calls into a Float32Array and
+// hand it over in one call, instead of crossing the bridge for each call.
+// A command is its op followed by the op's arguments. Images are drawn by
+// texture_manager_intern_url handles, which a float holds exactly up to
+// 2^24, and runs of draws from the same image are drawn as one.
+// Keep in the order of commandOps in the JS context.
+enum command_ops {
+	CMD_SAVE,            // no arguments
+	CMD_RESTORE,         // no arguments
+	CMD_TRANSLATE,       // x, y
+	CMD_ROTATE,          // angle
+	CMD_SCALE,           // x, y
+	CMD_SET_TRANSFORM,   // m11, m12, m21, m22, dx, dy
+	CMD_GLOBAL_ALPHA,    // alpha
+	CMD_COMPOSITE,       // composite_mode
+	CMD_FILTER,          // r, g, b, a, filter_mode
+	CMD_CLEAR_FILTERS,   // no arguments
+	CMD_CLIP,            // x, y, width, height
+	CMD_FILL_RECT,       // x, y, width, height, r, g, b, a
+	CMD_CLEAR_RECT,      // x, y, width, height
+	CMD_DRAW_IMAGE,      // handle, sx, sy, sw, sh, dx, dy, dw, dh
+	CMD_OP_COUNT
+};
+
+// Runs the commands against ctx and returns the number of floats consumed,
+// less than length if a command was unknown or cut short
+unsigned int command_buffer_run(struct context_2d_t *ctx, const float *commands, unsigned int length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // COMMAND_BUFFER_H
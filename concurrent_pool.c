@@ -0,0 +1,318 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 concurrent_pool.c
+ * @brief
+ */
+#include "concurrent_pool.h"
+#include <stdlib.h>
+
+#include "log.h"
+
+// like object_pool, each object is preceded by a header padded to the
+// alignment malloc gives doubles. The header holds the pool while the
+// object is handed out and the next free object while it is not
+#define OBJECT_HEADER_SIZE sizeof(double)
+#define HEADER_NEXT(header) (*(void **)(header))
+
+typedef struct thread_cache_t {
+    unsigned int generation;
+    unsigned int count;
+    void *head;
+} thread_cache;
+
+static __thread thread_cache t_caches[CONCURRENT_POOL_MAX];
+
+// nonzero while a pool owns the cache slot
+static unsigned int m_slots[CONCURRENT_POOL_MAX];
+static unsigned int m_generation = 0;
+
+/**
+ * @name	get_cache
+ * @brief	gets the calling thread's cache for the pool, dropping whatever
+ *			a destroyed pool that had the same slot left in it
+ * @param	pool - (concurrent_pool *) pool to get the cache of
+ * @retval	thread_cache* - the calling thread's cache
+ */
+static thread_cache *get_cache(concurrent_pool *pool) {
+    thread_cache *cache = &t_caches[pool->slot];
+    if (cache->generation != pool->generation) {
+        cache->generation = pool->generation;
+        cache->count = 0;
+        cache->head = NULL;
+    }
+    return cache;
+}
+
+/**
+ * @name	push_chain
+ * @brief	adds a chain of free objects to the global freelist
+ * @param	pool - (concurrent_pool *) pool the objects belong to
+ * @param	first - (void *) header of the first object in the chain
+ * @param	last - (void *) header of the last object in the chain
+ * @retval	NONE
+ */
+static void push_chain(concurrent_pool *pool, void *first, void *last) {
+    // objects only leave the freelist all at once, so pushing has no ABA
+    void *head = __atomic_load_n(&pool->freelist, __ATOMIC_RELAXED);
+    do {
+        HEADER_NEXT(last) = head;
+    } while (!__atomic_compare_exchange_n(&pool->freelist, &head, first, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/**
+ * @name	add_slab
+ * @brief	allocates a slab of objects and chains them together
+ * @param	pool - (concurrent_pool *) pool to grow
+ * @param	count - (unsigned int) number of objects in the slab
+ * @param	last - (void **) set to the header of the last object
+ * @retval	void* - header of the first object, or NULL if out of memory
+ */
+static void *add_slab(concurrent_pool *pool, unsigned int count, void **last) {
+    // the first word of a slab links it to the others
+    char *slab = (char *) malloc(OBJECT_HEADER_SIZE + pool->item_size * count);
+    if (!slab) {
+        return NULL;
+    }
+
+    char *first = slab + OBJECT_HEADER_SIZE;
+    unsigned int i;
+    for (i = 0; i + 1 < count; ++i) {
+        HEADER_NEXT(first + pool->item_size * i) = first + pool->item_size * (i + 1);
+    }
+    *last = first + pool->item_size * (count - 1);
+    HEADER_NEXT(*last) = NULL;
+
+    void *slabs = __atomic_load_n(&pool->slabs, __ATOMIC_RELAXED);
+    do {
+        HEADER_NEXT(slab) = slabs;
+    } while (!__atomic_compare_exchange_n(&pool->slabs, &slabs, slab, true,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    return first;
+}
+
+/**
+ * @name	refill_cache
+ * @brief	fills an empty thread cache from the global freelist, growing the
+ *			pool by a slab when the freelist is empty too
+ * @param	pool - (concurrent_pool *) pool to take objects from
+ * @param	cache - (thread_cache *) the calling thread's empty cache
+ * @retval	bool - (true | false) depending on whether the cache was filled
+ */
+static bool refill_cache(concurrent_pool *pool, thread_cache *cache) {
+    void *head = __atomic_exchange_n(&pool->freelist, NULL, __ATOMIC_ACQUIRE);
+    if (!head) {
+        void *last;
+        head = add_slab(pool, pool->slab_items, &last);
+        if (!head) {
+            return false;
+        }
+        cache->head = head;
+        cache->count = pool->slab_items;
+        return true;
+    }
+
+    // keep up to cache_items and give the rest back for other threads
+    unsigned int count = 1;
+    void *last = head;
+    while (HEADER_NEXT(last) && count < pool->cache_items) {
+        last = HEADER_NEXT(last);
+        ++count;
+    }
+
+    void *rest = HEADER_NEXT(last);
+    HEADER_NEXT(last) = NULL;
+    if (rest) {
+        void *rest_last = rest;
+        while (HEADER_NEXT(rest_last)) {
+            rest_last = HEADER_NEXT(rest_last);
+        }
+        push_chain(pool, rest, rest_last);
+    }
+
+    cache->head = head;
+    cache->count = count;
+    return true;
+}
+
+/**
+ * @name	concurrent_pool_init
+ * @brief	initilizes a pool that may be used from several threads at once
+ * @param	slab_items - (unsigned int) objects allocated up front and each
+ *			time the pool grows, also how many a thread caches
+ * @param	item_size - (unsigned int) the size of each item in the pool
+ * @retval	concurrent_pool* - the pool, or NULL if CONCURRENT_POOL_MAX
+ *			pools are already alive
+ */
+concurrent_pool *concurrent_pool_init(unsigned int slab_items, size_t item_size) {
+    LOGFN("concurrent_pool_init");
+    unsigned int slot;
+    for (slot = 0; slot < CONCURRENT_POOL_MAX; ++slot) {
+        unsigned int expected = 0;
+        if (__atomic_compare_exchange_n(&m_slots[slot], &expected, 1, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    if (slot == CONCURRENT_POOL_MAX) {
+        LOG("{pool} WARNING: Unable to create more than %d concurrent pools", CONCURRENT_POOL_MAX);
+        return NULL;
+    }
+
+    concurrent_pool *pool = (concurrent_pool *) malloc(sizeof(concurrent_pool));
+    if (!pool) {
+        __atomic_store_n(&m_slots[slot], 0, __ATOMIC_RELEASE);
+        return NULL;
+    }
+    pool->item_size = OBJECT_HEADER_SIZE + (item_size + OBJECT_HEADER_SIZE - 1) / OBJECT_HEADER_SIZE * OBJECT_HEADER_SIZE;
+    pool->slab_items = slab_items ? slab_items : 1;
+    pool->cache_items = pool->slab_items;
+    pool->slot = slot;
+    pool->generation = __atomic_add_fetch(&m_generation, 1, __ATOMIC_RELAXED);
+    pool->freelist = NULL;
+    pool->slabs = NULL;
+    pool->live_count = 0;
+    pool->high_water = 0;
+
+    // the first slab goes to the freelist, whichever thread gets first takes it
+    if (slab_items) {
+        void *last;
+        void *first = add_slab(pool, slab_items, &last);
+        if (first) {
+            push_chain(pool, first, last);
+        } else {
+            LOG("{pool} WARNING: Unable to allocate %u objects of size %zu", slab_items, item_size);
+        }
+    }
+
+    LOGFN("end concurrent_pool_init");
+    return pool;
+}
+
+/**
+ * @name	concurrent_pool_get
+ * @brief	takes an object from the calling thread's cache for the pool
+ * @param	pool - (concurrent_pool *) pool to take an object from
+ * @retval	void* - the object, or NULL if the pool could not grow
+ */
+void *concurrent_pool_get(concurrent_pool *pool) {
+    thread_cache *cache = get_cache(pool);
+    if (!cache->head && !refill_cache(pool, cache)) {
+        LOG("{pool} WARNING: Unable to grow concurrent pool by %u objects", pool->slab_items);
+        return NULL;
+    }
+
+    char *header = (char *) cache->head;
+    cache->head = HEADER_NEXT(header);
+    --cache->count;
+    HEADER_NEXT(header) = pool;
+
+    unsigned int live = __atomic_add_fetch(&pool->live_count, 1, __ATOMIC_RELAXED);
+    unsigned int high = __atomic_load_n(&pool->high_water, __ATOMIC_RELAXED);
+    while (live > high && !__atomic_compare_exchange_n(&pool->high_water, &high, live, true,
+                                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        // high now holds the latest high water mark
+    }
+
+    return header + OBJECT_HEADER_SIZE;
+}
+
+/**
+ * @name	concurrent_pool_put
+ * @brief	puts the object into the calling thread's cache for its pool,
+ *			it does not have to be the thread that took the object
+ * @param	obj - (void *) object to be put back into its pool
+ * @retval	NONE
+ */
+void concurrent_pool_put(void *obj) {
+    char *header = (char *) obj - OBJECT_HEADER_SIZE;
+    concurrent_pool *pool = (concurrent_pool *) HEADER_NEXT(header);
+    thread_cache *cache = get_cache(pool);
+
+    HEADER_NEXT(header) = cache->head;
+    cache->head = header;
+    __atomic_sub_fetch(&pool->live_count, 1, __ATOMIC_RELAXED);
+
+    // a thread that only frees, like the renderer freeing loader objects,
+    // passes what it does not need to the freelist in batches
+    if (++cache->count > pool->cache_items * 2) {
+        void *last = cache->head;
+        unsigned int i;
+        for (i = 1; i < pool->cache_items; ++i) {
+            last = HEADER_NEXT(last);
+        }
+
+        void *surplus = HEADER_NEXT(last);
+        HEADER_NEXT(last) = NULL;
+        void *surplus_last = surplus;
+        while (HEADER_NEXT(surplus_last)) {
+            surplus_last = HEADER_NEXT(surplus_last);
+        }
+        push_chain(pool, surplus, surplus_last);
+        cache->count = pool->cache_items;
+    }
+}
+
+/**
+ * @name	concurrent_pool_flush
+ * @brief	gives every object in the calling thread's cache back to the pool
+ * @param	pool - (concurrent_pool *) pool to flush the cache of
+ * @retval	NONE
+ */
+void concurrent_pool_flush(concurrent_pool *pool) {
+    thread_cache *cache = get_cache(pool);
+    if (!cache->head) {
+        return;
+    }
+
+    void *last = cache->head;
+    while (HEADER_NEXT(last)) {
+        last = HEADER_NEXT(last);
+    }
+    push_chain(pool, cache->head, last);
+    cache->head = NULL;
+    cache->count = 0;
+}
+
+/**
+ * @name	concurrent_pool_destroy
+ * @brief	destroys the pool along with every object in it, caches other
+ *			threads still have for it are dropped the next time they
+ *			use the slot
+ * @param	pool - (concurrent_pool *) the pool to destroy
+ * @retval	NONE
+ */
+void concurrent_pool_destroy(concurrent_pool *pool) {
+    LOGFN("concurrent_pool_destroy");
+    void *slab = __atomic_load_n(&pool->slabs, __ATOMIC_ACQUIRE);
+    while (slab) {
+        void *next = HEADER_NEXT(slab);
+        free(slab);
+        slab = next;
+    }
+
+    // the calling thread may create a new pool in this slot right away
+    thread_cache *cache = &t_caches[pool->slot];
+    cache->generation = 0;
+    cache->count = 0;
+    cache->head = NULL;
+
+    __atomic_store_n(&m_slots[pool->slot], 0, __ATOMIC_RELEASE);
+    free(pool);
+    LOGFN("end concurrent_pool_destroy");
+}
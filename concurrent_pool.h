@@ -0,0 +1,70 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+ 
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+ 
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef CONCURRENT_POOL_H
+#define CONCURRENT_POOL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdlib.h>
+#include "core/types.h"
+
+// most concurrent pools alive at once, each one owns a cache slot per thread
+#define CONCURRENT_POOL_MAX 16
+
+// An object_pool that objects may be taken from on one thread and put back
+// on another. Each thread keeps a small cache of free objects per pool, and
+// caches that grow past cache_items hand the surplus to a lock-free global
+// freelist that the other threads refill from.
+typedef struct concurrent_pool_t {
+	size_t item_size;
+	unsigned int slab_items;
+	unsigned int cache_items;
+
+	// which per-thread cache slot the pool uses, and a generation that
+	// tells a thread whether its slot still belongs to this pool
+	unsigned int slot;
+	unsigned int generation;
+
+	// free objects no thread cache holds, linked through their headers
+	void *freelist;
+	// slabs, linked through their first word
+	void *slabs;
+
+	unsigned int live_count;
+	unsigned int high_water;
+} concurrent_pool;
+
+#define CONCURRENT_POOL_INIT(type, size) concurrent_pool_init(size, sizeof(type))
+#define CONCURRENT_POOL_GET(type, pool) (type *) concurrent_pool_get(pool)
+#define CONCURRENT_POOL_RELEASE(obj) concurrent_pool_put(obj)
+#define CONCURRENT_POOL_DESTROY(pool) concurrent_pool_destroy(pool)
+
+concurrent_pool *concurrent_pool_init(unsigned int slab_items, size_t item_size);
+void *concurrent_pool_get(concurrent_pool *pool);
+void concurrent_pool_put(void *obj);
+// hands the calling thread's cached objects back to the pool, worker
+// threads call this before they exit so their objects are not stranded
+void concurrent_pool_flush(concurrent_pool *pool);
+// no other thread may use the pool while it is destroyed
+void concurrent_pool_destroy(concurrent_pool *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CONCURRENT_POOL_H
@@ -25,36 +25,121 @@
 #include "core/tealeaf_canvas.h"
 #include "core/tealeaf_context.h"
 #include "core/tealeaf_shaders.h"
+#include "core/draw_textures.h"
+#include "core/gl_state.h"
 #include "core/url_loader.h"
+#include "core/code_cache.h"
 #include "core/log.h"
 #include "core/events.h"
+#include "core/frame_arena.h"
+#include "core/jobs.h"
+#include "core/http_client.h"
+#include "core/socket_buffer.h"
+#include "core/sfx.h"
+#include "core/local_storage_cache.h"
+#include "core/device_profile.h"
+#include "core/quality_governor.h"
+#include "core/memory_pressure.h"
+#include "core/profiler.h"
+#include "core/frame_timing.h"
+#include "core/gpu_timing.h"
+#include "core/gl_trace.h"
+#include "core/input_replay.h"
+#include "core/perf_stats.h"
+#include "core/load_stats.h"
+#include "core/text_cache.h"
+#include "core/glyph_atlas.h"
+#include "core/image-cache/include/image_cache.h"
+#include "core/asset_pack.h"
 #include "core/core_js.h"
 #include "core/platform/resource_loader.h"
 #include "core/platform/sound_manager.h"
 #include "core/timer.h"
 #include "core/platform/native.h"
+#include "core/platform/threads.h"
 #include "platform/http.h"
 #include "platform/device.h"
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
 
 #define MIN_SIZE_TO_HALFSIZE 480
 
 gl_error *gl_errors_hash = NULL;
 static int m_framebuffer_name = -1;
+// monotonic time of the last core_tick and the time since the one before,
+// both in milliseconds, see core_get_tick_dt
+static double m_last_tick_time = -1;
+static double m_tick_dt = 0;
+
+// whether this tick draws the screen, decided by the first draw of the tick
+enum frame_states { FRAME_UNDECIDED, FRAME_DRAW, FRAME_SKIP };
+static bool m_skip_idle_frames = false;
+static bool m_frame_dirty = true;
+static int m_frame_state = FRAME_UNDECIDED;
+
+// damage is collected for the next frame, then taken as the drawn frame's
+// damage when the frame decides to draw
+#define FRAME_DAMAGE_RECTS 4
+// past this share of the screen a partial redraw isn't worth the passes
+#define FRAME_DAMAGE_MAX_COVERAGE 0.5
+static bool m_partial_redraw = false;
+static bool m_damage_full = true;
+static rect_2d m_damage[FRAME_DAMAGE_RECTS];
+static int m_damage_count = 0;
+static bool m_frame_full = true;
+static rect_2d m_frame_damage[FRAME_DAMAGE_RECTS];
+static int m_frame_damage_count = 0;
+static bool m_frame_cleared = false;
+
+#define JS_BUNDLE "native.js"
+
+// the bundle is read on a worker thread started by core_init, while the
+// platform brings up GL and draws the splash; the first core_init_js waits
+// for it and later ones read it again
+static ThreadsThread m_bundle_thread = THREADS_INVALID_THREAD;
+static char *m_bundle = NULL;
+
+static void read_bundle(void *unused) {
+    // the platform's loader may need the thread attached, e.g. to a JVM
+    native_enter_thread();
+    m_bundle = core_load_url(JS_BUNDLE);
+    native_leave_thread();
+}
+
+/**
+ * @name	take_bundle
+ * @brief	gets the contents of the javascript bundle, waiting for the read
+ *			started by core_init if there is one
+ * @retval	char* - contents of the bundle, for the caller to free, or NULL
+ */
+static char *take_bundle() {
+    if (m_bundle_thread == THREADS_INVALID_THREAD) {
+        return core_load_url(JS_BUNDLE);
+    }
+
+    threads_join_thread(&m_bundle_thread);
+    m_bundle_thread = THREADS_INVALID_THREAD;
+    char *contents = m_bundle;
+    m_bundle = NULL;
+    return contents;
+}
 
 /**
  * @name	run_file
- * @brief	reads and runs javascript found in the given file
- * @param	filename - (const char*) filename of the file to run
+ * @brief	runs javascript read from the given file
+ * @param	filename - (const char*) filename the contents came from
+ * @param	contents - (char*) contents of the file, freed here, or NULL if it couldn't be read
  * @retval	bool - (true | false) depending on whether running the file was successful
  */
-static inline bool run_file(const char *filename) {
-    char *contents = core_load_url(filename);
-
+static inline bool run_file(const char *filename, char *contents) {
     if (contents) {
-        eval_str(contents);
-
-        LOG("{core} Evaluated JavaScript from %s", filename);
+        if (!code_cache_eval(filename, contents)) {
+            eval_str(contents);
+            LOG("{core} Evaluated JavaScript from %s", filename);
+            code_cache_save(filename, contents);
+        }
 
         free(contents);
         return true;
@@ -64,6 +149,75 @@ static inline bool run_file(const char *filename) {
     }
 }
 
+// adapters from each subsystem to the memory pressure callbacks
+
+static long image_cache_usage(void *data) {
+    return (long) image_cache_memory_bytes();
+}
+
+static long image_cache_reclaim(long bytes, bool critical, void *data) {
+    return (long) image_cache_trim_memory(critical ? image_cache_memory_bytes() : (size_t) bytes);
+}
+
+static long canvas_backup_usage(void *data) {
+    return texture_manager_canvas_backup_bytes(texture_manager_get());
+}
+
+static long canvas_backup_reclaim(long bytes, bool critical, void *data) {
+    return texture_manager_drop_canvas_backups(texture_manager_get());
+}
+
+static long text_cache_usage(void *data) {
+    return text_cache_bytes();
+}
+
+static long text_cache_reclaim(long bytes, bool critical, void *data) {
+    return text_cache_trim(bytes);
+}
+
+static long glyph_atlas_usage(void *data) {
+    return glyph_atlas_bytes();
+}
+
+static long glyph_atlas_reclaim(long bytes, bool critical, void *data) {
+    // pages can't be freed one by one, the glyphs on the screen are drawn
+    // into fresh pages again
+    long freed = glyph_atlas_bytes();
+    glyph_atlas_clear();
+    return freed;
+}
+
+static long sfx_usage(void *data) {
+    return sfx_bytes();
+}
+
+static long sfx_reclaim(long bytes, bool critical, void *data) {
+    return sfx_trim(bytes);
+}
+
+static long textures_reclaim(long bytes, bool critical, void *data) {
+    if (critical) {
+        texture_manager_memory_critical();
+        return 0;
+    }
+    return texture_manager_reclaim(texture_manager_get(), bytes);
+}
+
+/**
+ * @name	register_reclaimers
+ * @brief	registers everything that can give memory back on a warning
+ * @retval	NONE
+ */
+static void register_reclaimers() {
+    memory_pressure_clear();
+    memory_pressure_register("image cache", MEMORY_PRIORITY_CACHE, image_cache_usage, image_cache_reclaim, NULL);
+    memory_pressure_register("canvas backups", MEMORY_PRIORITY_CACHE, canvas_backup_usage, canvas_backup_reclaim, NULL);
+    memory_pressure_register("text cache", MEMORY_PRIORITY_DERIVED, text_cache_usage, text_cache_reclaim, NULL);
+    memory_pressure_register("glyph atlas", MEMORY_PRIORITY_DERIVED, glyph_atlas_usage, glyph_atlas_reclaim, NULL);
+    memory_pressure_register("sounds", MEMORY_PRIORITY_ASSETS, sfx_usage, sfx_reclaim, NULL);
+    memory_pressure_register("textures", MEMORY_PRIORITY_TEXTURES, NULL, textures_reclaim, NULL);
+}
+
 /**
  * @name	core_init
  * @brief	initilizes the config object with given options
@@ -92,6 +246,8 @@ void core_init(const char *entry_point,
                bool remote_loading,
                const char *splash,
                const char *simulate_id) {
+    // from here on logging never waits on the console
+    log_start_async();
     config_set_remote_loading(remote_loading);
     config_set_entry_point(entry_point);
     config_set_tcp_host(tcp_host);
@@ -107,8 +263,28 @@ void core_init(const char *entry_point,
     rgba_init();
     // make checks for halfsized images
     resource_loader_initialize(source_dir);
+    // bundles without a pack read their files one by one
+    asset_pack_open(ASSET_PACK_URL);
+    jobs_init(0);
+    local_storage_cache_init();
+    http_client_init();
+    sfx_init(0, 0);
+    register_reclaimers();
+
+    // reading the bundle is the slowest part of startup that needs no GL
+    if (m_bundle_thread == THREADS_INVALID_THREAD) {
+        m_bundle_thread = threads_create_thread(read_bundle, NULL);
+        if (m_bundle_thread == THREADS_INVALID_THREAD) {
+            LOG("{core} WARNING: Unable to start reading %s early", JS_BUNDLE);
+        }
+    }
 
-    if (width <= MIN_SIZE_TO_HALFSIZE || height <= MIN_SIZE_TO_HALFSIZE) {
+    // what earlier launches learned sets the texture formats and budget
+    // before the splash is queued
+    device_profile_load();
+
+    if (width <= MIN_SIZE_TO_HALFSIZE || height <= MIN_SIZE_TO_HALFSIZE ||
+        device_profile_prefers_halfsize()) {
         set_halfsized_textures(true);
     } else {
         set_halfsized_textures(false);
@@ -128,7 +304,15 @@ void core_init(const char *entry_point,
 void core_init_gl(int framebuffer_name) {
     LOG("{core} Initializing OpenGL");
 
+    // a new gl context starts from default state
+    gl_state_reset();
+    gpu_timing_init();
     tealeaf_shaders_init();
+    texture_2d_detect_npot();
+    texture_2d_detect_compression();
+    texture_manager_detect_async_upload();
+    device_profile_detect_gl();
+    draw_textures_init(DRAW_TEXTURES_MULTI_TEXTURE | DRAW_TEXTURES_VBO);
     m_framebuffer_name = framebuffer_name;
 
     // If frame buffer id was invalid,
@@ -149,9 +333,11 @@ void core_init_gl(int framebuffer_name) {
  */
 bool core_init_js(const char *uri, const char *version) {
     core_timer_clear_all();
+    // events queued for an earlier js context
+    core_events_clear();
 
     init_js(uri, version);
-    return run_file("native.js");
+    return run_file(JS_BUNDLE, take_bundle());
 }
 
 /**
@@ -205,21 +391,86 @@ void calculate_size(texture_2d *tex, bool rotate) {
     size.height = ratio * tex->originalHeight * scale;
 }
 
+/**
+ * @name	core_get_tick_dt
+ * @brief	gets the time between the last two core ticks from a monotonic
+ *			clock, with sub-millisecond precision
+ * @retval	double - elapsed time in milliseconds
+ */
+double core_get_tick_dt() {
+    return m_tick_dt;
+}
+
 /**
  * @name	core_tick
  * @brief	moves the game forward by a single tick, defined by a time delta of
  *			last tick to this tick
  * @param	dt - (long) elapsed time from last tick to this tick in milliseconds
  * @retval	NONE
+ *
+ * Runs on the platform's GL thread. The view tree is rendered from inside
+ * js_tick, through timestep_view_wrap_render, and the walk calls back into
+ * js for views with their own render, so the frame can't be recorded here
+ * and replayed on another thread while js moves on to the next one.
  */
 void core_tick(long dt) {
+    PROFILE_ZONE("core_tick");
+    // a recording being played decides how far the game moves on
+    dt = input_replay_tick(dt);
+    // batches flushed since the last tick belong to the previous frame
+    draw_textures_end_frame();
+
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+        double now = ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+        m_tick_dt = m_last_tick_time < 0 ? dt : now - m_last_tick_time;
+        m_last_tick_time = now;
+    } else {
+        m_tick_dt = dt;
+    }
+    frame_timing_begin(m_tick_dt);
+    gpu_timing_begin_frame(frame_timing_frame());
+
+    m_frame_state = m_skip_idle_frames || m_partial_redraw ? FRAME_UNDECIDED : FRAME_DRAW;
+    m_frame_full = true;
+    m_frame_cleared = false;
+    tealeaf_canvas_begin_frame(m_tick_dt);
+    device_profile_tick(m_tick_dt);
+    quality_governor_tick(m_tick_dt);
+    perf_stats_tick(m_tick_dt);
+    load_stats_tick(m_tick_dt);
+    // a memory warning takes from the caches before the textures, between
+    // frames so nothing queued to draw loses its glyphs
+    memory_pressure_tick();
+    frame_timing_mark(FRAME_PHASE_OTHER);
+
     if (js_ready) {
+        core_flush_events();
         core_timer_tick(dt);
+        frame_timing_mark(FRAME_PHASE_EVENTS);
         js_tick(dt);
+        frame_timing_mark(FRAME_PHASE_JS);
     }
+    // what js batched on its sockets this tick goes out together
+    socket_buffer_flush();
+    frame_timing_mark(FRAME_PHASE_OTHER);
+
+    // a scaled scene that js didn't resolve before drawing its UI
+    frame_timing_render_begin();
+    tealeaf_canvas_resolve_scene();
+    frame_timing_render_end();
 
     // Tick the texture manager (load pending textures)
     texture_manager_tick(texture_manager_get());
+    frame_timing_mark(FRAME_PHASE_TEXTURES);
+
+    // Hand finished canvas read backs to the encode jobs
+    context_2d_poll_saves();
+    jobs_run_completions();
+    http_client_run_completions();
+    socket_buffer_dispatch();
+    local_storage_cache_tick(dt);
+    frame_timing_mark(FRAME_PHASE_COMPLETIONS);
     /*
      * we need to wait 2 frames before removing the preloader after we get the
      * core_hide_preloader call from JS.  Only on the second frame after the
@@ -227,6 +478,9 @@ void core_tick(long dt) {
      */
 
     if (show_preload || preload_hide_frame_count < 2) {
+        // the splash is drawn every frame
+        core_invalidate_frame();
+
         //if we've gotten the core_hide_preloader cb, start counting frames
         if (!show_preload) {
             preload_hide_frame_count++;
@@ -278,10 +532,209 @@ void core_tick(long dt) {
         }
     }
 
-    // check the gl error and send it to java to be logged
-    if (js_ready) {
+    // check the gl error and send it to java to be logged, every few frames
+    // as asking may stall until the driver catches up
+    if (js_ready && gl_trace_error_check_due()) {
         core_check_gl_error();
     }
+
+    // over whatever the frame drew, splash included
+    perf_overlay_draw();
+    gpu_timing_end_frame();
+    gl_trace_end_frame();
+    frame_timing_end();
+    // nothing allocated for this frame outlives it
+    frame_arena_reset();
+}
+
+/**
+ * @name	core_set_skip_idle_frames
+ * @brief	turns skipping frames in which nothing changed on or off
+ * @param	skip - (bool) whether idle frames are skipped
+ * @retval	NONE
+ */
+void core_set_skip_idle_frames(bool skip) {
+    m_skip_idle_frames = skip;
+    m_frame_dirty = true;
+}
+
+/**
+ * @name	core_invalidate_frame
+ * @brief	notes that the screen needs drawing, this frame if nothing was
+ *          drawn yet and the next one otherwise
+ * @retval	NONE
+ */
+void core_invalidate_frame() {
+    m_frame_dirty = true;
+    m_damage_full = true;
+}
+
+static inline float rect_area(const rect_2d *r) {
+    return r->width * r->height;
+}
+
+static inline rect_2d rect_union(const rect_2d *a, const rect_2d *b) {
+    float x = fminf(a->x, b->x);
+    float y = fminf(a->y, b->y);
+    rect_2d r = {x, y, fmaxf(a->x + a->width, b->x + b->width) - x, fmaxf(a->y + a->height, b->y + b->height) - y};
+    return r;
+}
+
+static inline bool rects_touch(const rect_2d *a, const rect_2d *b) {
+    return a->x <= b->x + b->width && b->x <= a->x + a->width &&
+           a->y <= b->y + b->height && b->y <= a->y + a->height;
+}
+
+static double damage_coverage() {
+    int width = config_get_screen_width();
+    int height = config_get_screen_height();
+    if (width <= 0 || height <= 0) {
+        return 1;
+    }
+
+    double area = 0;
+    for (int i = 0; i < m_damage_count; i++) {
+        area += rect_area(&m_damage[i]);
+    }
+    return area / ((double) width * height);
+}
+
+/**
+ * @name	core_set_partial_redraw
+ * @brief	turns redrawing only the damaged parts of the screen on or off,
+ *          which also skips idle frames
+ * @param	partial - (bool) whether frames may be redrawn in part
+ * @retval	NONE
+ */
+void core_set_partial_redraw(bool partial) {
+    m_partial_redraw = partial;
+    core_invalidate_frame();
+}
+
+bool core_partial_redraw() {
+    return m_partial_redraw;
+}
+
+/**
+ * @name	core_damage_rect
+ * @brief	notes a rect of the screen, in points, that needs redrawing.
+ *          Rects that touch are merged, and past FRAME_DAMAGE_RECTS the
+ *          pair that grows least is
+ * @param	rect - (rect_2d) damaged rect
+ * @retval	NONE
+ */
+void core_damage_rect(rect_2d rect) {
+    if (!m_partial_redraw) {
+        core_invalidate_frame();
+        return;
+    }
+    if (rect.width <= 0 || rect.height <= 0) {
+        return;
+    }
+
+    m_frame_dirty = true;
+    if (m_damage_full) {
+        return;
+    }
+
+    // whole pixels, with a pixel to spare for filtering at the edges
+    float x = floorf(rect.x) - 1;
+    float y = floorf(rect.y) - 1;
+    rect.width = ceilf(rect.x + rect.width) + 1 - x;
+    rect.height = ceilf(rect.y + rect.height) + 1 - y;
+    rect.x = x;
+    rect.y = y;
+
+    for (;;) {
+        int merge = -1;
+        for (int i = 0; i < m_damage_count; i++) {
+            if (rects_touch(&rect, &m_damage[i])) {
+                merge = i;
+                break;
+            }
+        }
+
+        if (merge < 0 && m_damage_count == FRAME_DAMAGE_RECTS) {
+            float best = 0;
+            for (int i = 0; i < m_damage_count; i++) {
+                rect_2d u = rect_union(&rect, &m_damage[i]);
+                float growth = rect_area(&u) - rect_area(&m_damage[i]);
+                if (merge < 0 || growth < best) {
+                    merge = i;
+                    best = growth;
+                }
+            }
+        }
+        if (merge < 0) {
+            break;
+        }
+
+        // the union may reach rects it didn't touch before
+        rect = rect_union(&rect, &m_damage[merge]);
+        m_damage[merge] = m_damage[--m_damage_count];
+    }
+
+    m_damage[m_damage_count++] = rect;
+}
+
+/**
+ * @name	core_get_frame_damage
+ * @brief	finds what the frame being drawn has to redraw
+ * @param	rects - (const rect_2d **) receives the damaged rects, in points
+ * @param	count - (int *) receives the number of rects
+ * @retval	bool - false if the whole screen is redrawn
+ */
+bool core_get_frame_damage(const rect_2d **rects, int *count) {
+    if (m_frame_state != FRAME_DRAW || m_frame_full) {
+        return false;
+    }
+
+    *rects = m_frame_damage;
+    *count = m_frame_damage_count;
+    return true;
+}
+
+/**
+ * @name	core_frame_take_clear
+ * @brief	with partial redraw the view tree render clears the screen
+ *          itself, the first render of a tick does it
+ * @retval	bool - true the first time it's called in a tick
+ */
+bool core_frame_take_clear() {
+    bool clear = !m_frame_cleared;
+    m_frame_cleared = true;
+    return clear;
+}
+
+/**
+ * @name	core_frame_should_draw
+ * @brief	called before drawing to the screen. The first call of a tick
+ *          decides whether the tick draws at all
+ * @retval	bool - false if nothing changed and the screen can be left alone
+ */
+bool core_frame_should_draw() {
+    if (m_frame_state == FRAME_UNDECIDED) {
+        m_frame_state = m_frame_dirty ? FRAME_DRAW : FRAME_SKIP;
+        m_frame_dirty = false;
+
+        if (m_frame_state == FRAME_DRAW) {
+            m_frame_full = !m_partial_redraw || m_damage_full || damage_coverage() > FRAME_DAMAGE_MAX_COVERAGE;
+            m_frame_damage_count = m_damage_count;
+            memcpy(m_frame_damage, m_damage, sizeof(rect_2d) * m_damage_count);
+            m_damage_full = false;
+            m_damage_count = 0;
+        }
+    }
+    return m_frame_state == FRAME_DRAW;
+}
+
+/**
+ * @name	core_frame_drawn
+ * @brief	tells the platform, after core_tick, whether to swap buffers
+ * @retval	bool - false if the tick skipped drawing the screen
+ */
+bool core_frame_drawn() {
+    return m_frame_state != FRAME_SKIP;
 }
 
 /**
@@ -304,6 +757,17 @@ void core_on_screen_resize(int width, int height) {
     tealeaf_canvas_resize(width, height);
 }
 
+/**
+ * @name	core_on_pause
+ * @brief	called by the platform before the app goes to the background,
+ *			writes what must not be lost if it is killed there
+ * @retval	NONE
+ */
+void core_on_pause() {
+    local_storage_cache_flush(true);
+    device_profile_save();
+}
+
 /**
  * @name	core_destroy
  * @brief	destroys the running js and the texture manager
@@ -311,8 +775,18 @@ void core_on_screen_resize(int width, int height) {
  */
 void core_destroy() {
     destroy_js();
+    http_client_shutdown();
+    jobs_shutdown();
+    local_storage_cache_destroy();
+    sfx_shutdown();
+    device_profile_save();
+    memory_pressure_clear();
     texture_manager_destroy(texture_manager_get());
     sound_manager_halt();
+    asset_pack_close();
+    frame_arena_shutdown();
+    // the last lines before a reset or exit
+    log_flush();
 }
 
 /**
@@ -18,12 +18,14 @@
 
 #include "core/list.h"
 #include "core/texture_2d.h"
+#include "core/geometry.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 extern int use_halfsized_textures;
+extern int use_16bit_textures;
 
 void core_init(const char *entry_point,
                const char *tcp_host,
@@ -42,10 +44,32 @@ bool core_check_gl_error();
 void core_init_gl(int framebuffer_name);
 void core_hide_preloader();
 void core_on_screen_resize(int width, int height);
+void core_on_pause();
 void core_run();
 void core_destroy();
 void core_reset();
 void core_tick(long dt);
+double core_get_tick_dt();
+
+// Idle frames: with skipping on, a frame where nothing was invalidated
+// doesn't clear or render the screen, and core_frame_drawn tells the
+// platform to skip the swap. Native changes invalidate on their own; the
+// bindings must call core_invalidate_frame when they write view properties
+// or draw to the onscreen context outside the view tree
+void core_set_skip_idle_frames(bool skip);
+void core_invalidate_frame();
+bool core_frame_should_draw();
+bool core_frame_drawn();
+
+// Partial redraw: on top of idle frames, changes that report the screen
+// rects they touch let the next frame redraw only those rects. The platform
+// must preserve the back buffer, and can pass the rects from
+// core_get_frame_damage to a swap with damage
+void core_set_partial_redraw(bool partial);
+bool core_partial_redraw();
+void core_damage_rect(rect_2d rect);
+bool core_get_frame_damage(const rect_2d **rects, int *count);
+bool core_frame_take_clear();
 
 #ifdef __cplusplus
 }
@@ -36,9 +36,19 @@ bool destroy_js();
 void eval_str(const char *str);
 void js_tick(long dt);
 void js_dispatch_event(const char *evt);
+// Dispatches count json event strings to javascript with one entry into js,
+// in the order they were queued
+void js_dispatch_events(const char **evts, int count);
 void js_on_pause();
 void js_on_resume();
 
+// Code cache: js_compile_code_cache compiles source without running it and
+// returns its serialized form in a malloc'd buffer, or NULL if the engine
+// has none. js_eval_code_cache runs source from that data, returning false
+// with nothing run if the engine rejects it
+unsigned char *js_compile_code_cache(const char *source, const char *filename, unsigned long *size);
+bool js_eval_code_cache(const char *source, const char *filename, const unsigned char *data, unsigned long size);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,230 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 device_profile.c
+ * @brief	remembers device capabilities between launches
+ */
+#include "core/device_profile.h"
+#include "core/code_cache.h"
+#include "core/image_loader.h"
+#include "core/texture_2d.h"
+#include "core/texture_manager.h"
+#include "core/log.h"
+#include "core/platform/native.h"
+#include "platform/device.h"
+#include "platform/gl.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// kept next to the code caches, whose file format checks the key for us
+#define PROFILE_NAME "device"
+#define PROFILE_FORMAT "device profile 1"
+
+// frames skipped while startup settles, then frames averaged for the tier
+#define TIER_WARMUP_FRAMES 120
+#define TIER_SAMPLE_FRAMES 300
+// longer frames are pauses or loads, not drawing
+#define TIER_MAX_FRAME_MS 250
+#define TIER_HIGH_MS 18
+#define TIER_MID_MS 34
+
+static device_profile m_profile;
+static bool m_loaded = false;
+static bool m_dirty = false;
+// the texture limit the launch started with, saved again if it moved
+static long long m_start_budget = 0;
+static int m_tier_frames = 0;
+static double m_tier_total = 0;
+
+static unsigned long long hash_string(unsigned long long h, const char *s) {
+    // 64 bit FNV-1a
+    for (; s && *s; s++) {
+        h ^= (unsigned char) *s;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+/**
+ * @name	profile_key
+ * @brief	builds the key the profile is valid for, the device and the app
+ *			version, so a new build measures again
+ * @param	key - (char *) receives the key
+ * @param	size - (size_t) size of key
+ * @retval	NONE
+ */
+static void profile_key(char *key, size_t size) {
+    const char *info = device_info();
+    const char *version = get_app_version();
+    snprintf(key, size, "%s|%s", info ? info : "", version ? version : "");
+}
+
+/**
+ * @name	device_profile_load
+ * @brief	reads the profile the first time and applies it before anything
+ *			is loaded, again after a reset made a new texture manager
+ * @retval	NONE
+ */
+void device_profile_load() {
+    if (!m_loaded) {
+        m_loaded = true;
+        memset(&m_profile, 0, sizeof(m_profile));
+
+        char key[512];
+        profile_key(key, sizeof(key));
+        unsigned long size = 0;
+        void *data = code_cache_read(PROFILE_NAME, key, PROFILE_FORMAT, &size);
+        if (data && size == sizeof(m_profile)) {
+            memcpy(&m_profile, data, sizeof(m_profile));
+        } else if (data) {
+            code_cache_remove(PROFILE_NAME);
+        }
+        free(data);
+    }
+
+    if (m_profile.flags & DEVICE_PROFILE_HAS_GL) {
+        // textures queued before gl is up, like the splash, decode in the
+        // right format and padding
+        image_loader_set_compression_support(m_profile.compression);
+        texture_2d_set_npot_supported(m_profile.npot);
+    }
+
+    texture_manager *manager = texture_manager_get();
+    if (m_profile.texture_budget > 0) {
+        texture_manager_set_max_memory(manager, (long) m_profile.texture_budget);
+    }
+    m_start_budget = manager->max_texture_bytes;
+
+    LOG("{profile} Loaded flags %u, max texture %d, budget %lld, tier %d",
+        m_profile.flags, m_profile.max_texture_size, m_profile.texture_budget, m_profile.fill_rate_tier);
+}
+
+/**
+ * @name	device_profile_get
+ * @brief	gets what is known about the device
+ * @retval	const device_profile* - the profile
+ */
+const device_profile *device_profile_get() {
+    return &m_profile;
+}
+
+/**
+ * @name	device_profile_prefers_halfsize
+ * @brief	gets whether earlier launches found the device too slow to fill
+ *			the screen with full sized textures
+ * @retval	bool - true to start half sized
+ */
+bool device_profile_prefers_halfsize() {
+    return (m_profile.flags & DEVICE_PROFILE_HAS_TIER) && m_profile.fill_rate_tier == DEVICE_TIER_LOW;
+}
+
+/**
+ * @name	device_profile_detect_gl
+ * @brief	records the capabilities texture_2d detected for the current gl
+ *			context
+ * @retval	NONE
+ */
+void device_profile_detect_gl() {
+    unsigned long long h = 14695981039346656037ULL;
+    h = hash_string(h, (const char *) glGetString(GL_RENDERER));
+    h = hash_string(h, (const char *) glGetString(GL_VERSION));
+    h = hash_string(h, (const char *) glGetString(GL_EXTENSIONS));
+
+    GLint max_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+
+    int npot = texture_2d_npot_supported();
+    unsigned int compression = image_loader_get_compression_support();
+
+    if (!(m_profile.flags & DEVICE_PROFILE_HAS_GL) || m_profile.gl_hash != h ||
+        m_profile.max_texture_size != max_size || m_profile.npot != npot ||
+        m_profile.compression != compression) {
+        if ((m_profile.flags & DEVICE_PROFILE_HAS_GL) && m_profile.gl_hash != h) {
+            // a new driver may draw at a different speed
+            m_profile.flags &= ~DEVICE_PROFILE_HAS_TIER;
+            m_profile.fill_rate_tier = DEVICE_TIER_UNKNOWN;
+        }
+        m_profile.flags |= DEVICE_PROFILE_HAS_GL;
+        m_profile.gl_hash = h;
+        m_profile.max_texture_size = max_size;
+        m_profile.npot = npot;
+        m_profile.compression = compression;
+        m_dirty = true;
+    }
+}
+
+/**
+ * @name	device_profile_tick
+ * @brief	averages frame times after startup into a fill rate tier, then
+ *			saves the profile once
+ * @param	dt - (double) milliseconds since the last tick
+ * @retval	NONE
+ */
+void device_profile_tick(double dt) {
+    if (!m_loaded || (m_profile.flags & DEVICE_PROFILE_HAS_TIER) || dt <= 0 || dt > TIER_MAX_FRAME_MS) {
+        return;
+    }
+
+    if (++m_tier_frames <= TIER_WARMUP_FRAMES) {
+        return;
+    }
+    m_tier_total += dt;
+
+    if (m_tier_frames == TIER_WARMUP_FRAMES + TIER_SAMPLE_FRAMES) {
+        double average = m_tier_total / TIER_SAMPLE_FRAMES;
+        if (average <= TIER_HIGH_MS) {
+            m_profile.fill_rate_tier = DEVICE_TIER_HIGH;
+        } else if (average <= TIER_MID_MS) {
+            m_profile.fill_rate_tier = DEVICE_TIER_MID;
+        } else {
+            m_profile.fill_rate_tier = DEVICE_TIER_LOW;
+        }
+        m_profile.flags |= DEVICE_PROFILE_HAS_TIER;
+        m_dirty = true;
+        LOG("{profile} Average frame %.1fms, tier %d", average, m_profile.fill_rate_tier);
+        device_profile_save();
+    }
+}
+
+/**
+ * @name	device_profile_save
+ * @brief	writes the profile, with the texture limit the texture manager
+ *			settled on, if anything changed since it was read
+ * @retval	NONE
+ */
+void device_profile_save() {
+    if (!m_loaded) {
+        return;
+    }
+
+    long long budget = texture_manager_get()->max_texture_bytes;
+    if (budget != m_start_budget) {
+        m_profile.texture_budget = budget;
+        m_start_budget = budget;
+        m_dirty = true;
+    }
+
+    if (!m_dirty) {
+        return;
+    }
+
+    char key[512];
+    profile_key(key, sizeof(key));
+    if (code_cache_write(PROFILE_NAME, key, PROFILE_FORMAT, &m_profile, sizeof(m_profile))) {
+        m_dirty = false;
+    }
+}
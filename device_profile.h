@@ -0,0 +1,68 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef DEVICE_PROFILE_H
+#define DEVICE_PROFILE_H
+
+#include "core/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// What earlier launches learned about the device, kept in the storage
+// directory so startup can configure textures up front instead of finding
+// out through hitches and memory warnings. Main thread only.
+
+#define DEVICE_PROFILE_HAS_GL 0x1
+#define DEVICE_PROFILE_HAS_TIER 0x2
+
+enum device_profile_tiers {
+	DEVICE_TIER_UNKNOWN,
+	DEVICE_TIER_LOW,
+	DEVICE_TIER_MID,
+	DEVICE_TIER_HIGH
+};
+
+typedef struct device_profile_t {
+	unsigned int flags;
+	// renderer, version and extensions, to notice a driver update
+	unsigned long long gl_hash;
+	int max_texture_size;
+	int npot;
+	unsigned int compression; // IMAGE_COMPRESSION_* families
+	// the texture manager's limit when the last launch ended, zero if unknown
+	long long texture_budget;
+	int fill_rate_tier;
+} device_profile;
+
+// reads the profile and applies what it knows to the image loader and the
+// texture manager, called by core_init
+void device_profile_load();
+const device_profile *device_profile_get();
+// whether the profile says to start with half sized textures
+bool device_profile_prefers_halfsize();
+// records the gl capabilities after core_init_gl detected them
+void device_profile_detect_gl();
+// samples frame times until the fill rate tier is known, called by core_tick
+void device_profile_tick(double dt);
+// writes the profile if anything changed
+void device_profile_save();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // DEVICE_PROFILE_H
@@ -0,0 +1,385 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 display_list.c
+ * @brief	records context_2d calls so they can be replayed without the
+ *			code that made them
+ */
+#include "core/display_list.h"
+#include "core/tealeaf_context.h"
+#include "core/frame_arena.h"
+#include "core/log.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define MIN_LIST_CAPACITY 256
+
+enum display_ops {
+    OP_SAVE,
+    OP_RESTORE,
+    OP_TRANSLATE,
+    OP_ROTATE,
+    OP_SCALE,
+    OP_ALPHA,
+    OP_COMPOSITE,
+    OP_FILTER,
+    OP_CLIP,
+    OP_FILL_RECT,
+    OP_IMAGE,
+    OP_IMAGE_HANDLE
+};
+
+// every op starts with a header, size covers the header and its payload.
+// payloads are copied in and out with memcpy, so the buffer needs no alignment
+typedef struct op_header_t {
+    unsigned int type;
+    unsigned int size;
+} op_header;
+
+typedef struct op_floats_t {
+    float a;
+    float b;
+} op_floats;
+
+typedef struct op_filter_t {
+    rgba color;
+    int filter_type;
+} op_filter;
+
+typedef struct op_fill_rect_t {
+    rect_2d rect;
+    rgba color;
+} op_fill_rect;
+
+// followed by count source rects, count destination rects and, for
+// OP_IMAGE, the nul terminated url
+typedef struct op_image_t {
+    int count;
+    int handle;
+} op_image;
+
+/**
+ * @name	append_op
+ * @brief	reserves room for an op at the end of the list
+ * @param	list - (display_list *) list to append to
+ * @param	type - (unsigned int) op type
+ * @param	payload - (size_t) bytes following the header
+ * @retval	unsigned char* - where the payload goes, or NULL if the list
+ *			could not grow, which leaves it unreplayable
+ */
+static unsigned char *append_op(display_list *list, unsigned int type, size_t payload) {
+    if (!list->replayable) {
+        return NULL;
+    }
+
+    size_t size = sizeof(op_header) + payload;
+    if (list->size + size > list->capacity) {
+        size_t capacity = list->capacity ? list->capacity : MIN_LIST_CAPACITY;
+        while (capacity < list->size + size) {
+            capacity *= 2;
+        }
+        unsigned char *ops = (unsigned char *) realloc(list->ops, capacity);
+        if (!ops) {
+            LOG("{displaylist} WARNING: Unable to grow a display list to %u bytes", (unsigned int) capacity);
+            list->replayable = false;
+            return NULL;
+        }
+        list->ops = ops;
+        list->capacity = capacity;
+    }
+
+    op_header header = {type, (unsigned int) size};
+    memcpy(list->ops + list->size, &header, sizeof(header));
+    unsigned char *p = list->ops + list->size + sizeof(header);
+    list->size += size;
+    list->op_count++;
+    return p;
+}
+
+static void append_floats(display_list *list, unsigned int type, float a, float b) {
+    op_floats op = {a, b};
+    unsigned char *p = append_op(list, type, sizeof(op));
+    if (p) {
+        memcpy(p, &op, sizeof(op));
+    }
+}
+
+display_list *display_list_new() {
+    display_list *list = (display_list *) calloc(1, sizeof(display_list));
+    if (list) {
+        list->replayable = true;
+    }
+    return list;
+}
+
+void display_list_delete(display_list *list) {
+    if (list) {
+        free(list->ops);
+        free(list);
+    }
+}
+
+/**
+ * @name	display_list_reset
+ * @brief	empties the list so it can be recorded again, keeping its buffer
+ * @param	list - (display_list *) list to reset
+ * @retval	NONE
+ */
+void display_list_reset(display_list *list) {
+    list->size = 0;
+    list->op_count = 0;
+    list->recorded = false;
+    list->replayable = true;
+}
+
+/**
+ * @name	display_list_begin
+ * @brief	starts recording ctx's calls into the list, replacing anything
+ *			recorded before
+ * @param	list - (display_list *) list to record into
+ * @param	ctx - (context_2d *) context whose calls are recorded
+ * @retval	NONE
+ */
+void display_list_begin(display_list *list, context_2d *ctx) {
+    display_list_reset(list);
+    list->base_alpha = context_2d_getGlobalAlpha(ctx);
+    ctx->recording = list;
+}
+
+/**
+ * @name	display_list_end
+ * @brief	stops recording ctx's calls
+ * @param	ctx - (context_2d *) context being recorded
+ * @retval	NONE
+ */
+void display_list_end(context_2d *ctx) {
+    if (ctx->recording) {
+        ctx->recording->recorded = true;
+    }
+    ctx->recording = NULL;
+}
+
+/**
+ * @name	display_list_replay
+ * @brief	makes the recorded calls on ctx again, on top of its current state
+ * @param	list - (const display_list *) list to replay
+ * @param	ctx - (context_2d *) context to draw to
+ * @retval	bool - false if the list can't be replayed and the original
+ *			calls have to be made instead
+ */
+bool display_list_replay(const display_list *list, context_2d *ctx) {
+    if (!list->recorded || !list->replayable) {
+        return false;
+    }
+
+    float base_alpha = context_2d_getGlobalAlpha(ctx);
+    const unsigned char *p = list->ops;
+    const unsigned char *end = list->ops + list->size;
+    while (p < end) {
+        op_header header;
+        memcpy(&header, p, sizeof(header));
+        const unsigned char *payload = p + sizeof(header);
+        p += header.size;
+
+        switch (header.type) {
+        case OP_SAVE:
+            context_2d_save(ctx);
+            break;
+        case OP_RESTORE:
+            context_2d_restore(ctx);
+            break;
+        case OP_TRANSLATE:
+        case OP_ROTATE:
+        case OP_SCALE:
+        case OP_ALPHA: {
+            op_floats op;
+            memcpy(&op, payload, sizeof(op));
+            if (header.type == OP_TRANSLATE) {
+                context_2d_translate(ctx, op.a, op.b);
+            } else if (header.type == OP_ROTATE) {
+                context_2d_rotate(ctx, op.a);
+            } else if (header.type == OP_SCALE) {
+                context_2d_scale(ctx, op.a, op.b);
+            } else {
+                context_2d_setGlobalAlpha(ctx, base_alpha * op.a);
+            }
+            break;
+        }
+        case OP_COMPOSITE: {
+            int composite_op;
+            memcpy(&composite_op, payload, sizeof(composite_op));
+            context_2d_setGlobalCompositeOperation(ctx, composite_op);
+            break;
+        }
+        case OP_FILTER: {
+            op_filter op;
+            memcpy(&op, payload, sizeof(op));
+            context_2d_add_filter(ctx, &op.color);
+            context_2d_set_filter_type(ctx, op.filter_type);
+            break;
+        }
+        case OP_CLIP: {
+            rect_2d clip;
+            memcpy(&clip, payload, sizeof(clip));
+            context_2d_setClip(ctx, clip);
+            break;
+        }
+        case OP_FILL_RECT: {
+            op_fill_rect op;
+            memcpy(&op, payload, sizeof(op));
+            context_2d_fillRect(ctx, &op.rect, &op.color);
+            break;
+        }
+        case OP_IMAGE:
+        case OP_IMAGE_HANDLE: {
+            op_image op;
+            memcpy(&op, payload, sizeof(op));
+            // the rects follow the fixed part; copy them out, they may be unaligned
+            size_t rects_size = sizeof(rect_2d) * op.count;
+            rect_2d one[2];
+            rect_2d *rects = op.count == 1 ? one : (rect_2d *) frame_arena_alloc(rects_size * 2);
+            if (!rects) {
+                LOG("{displaylist} WARNING: Unable to replay a draw of %d images", op.count);
+                break;
+            }
+            memcpy(rects, payload + sizeof(op), rects_size * 2);
+
+            if (header.type == OP_IMAGE) {
+                const char *url = (const char *) (payload + sizeof(op) + rects_size * 2);
+                context_2d_drawImageRects(ctx, url, rects, rects + op.count, op.count);
+            } else {
+                context_2d_drawImageRectsHandle(ctx, op.handle, rects, rects + op.count, op.count);
+            }
+            break;
+        }
+        }
+    }
+    return true;
+}
+
+/**
+ * @name	display_list_equals
+ * @brief	compares two recordings, e.g. to find out whether a render that
+ *			was recorded again changed
+ * @param	a - (const display_list *) first list
+ * @param	b - (const display_list *) second list
+ * @retval	bool - true if both make the same calls
+ */
+bool display_list_equals(const display_list *a, const display_list *b) {
+    return a->replayable == b->replayable && a->size == b->size &&
+           a->base_alpha == b->base_alpha && !memcmp(a->ops, b->ops, a->size);
+}
+
+void display_list_record_save(display_list *list) {
+    append_op(list, OP_SAVE, 0);
+}
+
+void display_list_record_restore(display_list *list) {
+    append_op(list, OP_RESTORE, 0);
+}
+
+void display_list_record_translate(display_list *list, float x, float y) {
+    append_floats(list, OP_TRANSLATE, x, y);
+}
+
+void display_list_record_rotate(display_list *list, float angle) {
+    append_floats(list, OP_ROTATE, angle, 0);
+}
+
+void display_list_record_scale(display_list *list, float x, float y) {
+    append_floats(list, OP_SCALE, x, y);
+}
+
+void display_list_record_alpha(display_list *list, float alpha) {
+    // with nothing visible when recording began, there's no ratio to keep
+    if (!list->base_alpha) {
+        display_list_record_unsupported(list, "globalAlpha");
+        return;
+    }
+    append_floats(list, OP_ALPHA, alpha / list->base_alpha, 0);
+}
+
+void display_list_record_composite(display_list *list, int composite_op) {
+    unsigned char *p = append_op(list, OP_COMPOSITE, sizeof(composite_op));
+    if (p) {
+        memcpy(p, &composite_op, sizeof(composite_op));
+    }
+}
+
+void display_list_record_filter(display_list *list, const rgba *color, int filter_type) {
+    op_filter op = {*color, filter_type};
+    unsigned char *p = append_op(list, OP_FILTER, sizeof(op));
+    if (p) {
+        memcpy(p, &op, sizeof(op));
+    }
+}
+
+void display_list_record_clip(display_list *list, rect_2d clip) {
+    unsigned char *p = append_op(list, OP_CLIP, sizeof(clip));
+    if (p) {
+        memcpy(p, &clip, sizeof(clip));
+    }
+}
+
+void display_list_record_fill_rect(display_list *list, const rect_2d *rect, const rgba *color) {
+    op_fill_rect op = {*rect, *color};
+    unsigned char *p = append_op(list, OP_FILL_RECT, sizeof(op));
+    if (p) {
+        memcpy(p, &op, sizeof(op));
+    }
+}
+
+static void record_image(display_list *list, unsigned int type, const char *url, int handle, const rect_2d *src_rects, const rect_2d *dest_rects, int count) {
+    if (count <= 0) {
+        return;
+    }
+
+    op_image op = {count, handle};
+    size_t rects_size = sizeof(rect_2d) * count;
+    size_t url_size = url ? strlen(url) + 1 : 0;
+    unsigned char *p = append_op(list, type, sizeof(op) + rects_size * 2 + url_size);
+    if (p) {
+        memcpy(p, &op, sizeof(op));
+        memcpy(p + sizeof(op), src_rects, rects_size);
+        memcpy(p + sizeof(op) + rects_size, dest_rects, rects_size);
+        if (url) {
+            memcpy(p + sizeof(op) + rects_size * 2, url, url_size);
+        }
+    }
+}
+
+void display_list_record_image(display_list *list, const char *url, const rect_2d *src_rects, const rect_2d *dest_rects, int count) {
+    record_image(list, OP_IMAGE, url, -1, src_rects, dest_rects, count);
+}
+
+void display_list_record_image_handle(display_list *list, int handle, const rect_2d *src_rects, const rect_2d *dest_rects, int count) {
+    record_image(list, OP_IMAGE_HANDLE, NULL, handle, src_rects, dest_rects, count);
+}
+
+/**
+ * @name	display_list_record_unsupported
+ * @brief	marks the list as unreplayable after a call it can't hold, such
+ *			as an absolute transform or a read back
+ * @param	list - (display_list *) list being recorded
+ * @param	call - (const char *) name of the call, for the log
+ * @retval	NONE
+ */
+void display_list_record_unsupported(display_list *list, const char *call) {
+    if (list->replayable) {
+        LOG("{displaylist} %s can't be recorded, the list won't be replayed", call);
+        list->replayable = false;
+    }
+}
@@ -0,0 +1,72 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef DISPLAY_LIST_H
+#define DISPLAY_LIST_H
+
+#include "core/types.h"
+#include "core/geometry.h"
+#include "core/rgba.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct context_2d_t;
+
+// A compact binary recording of context_2d calls. Transforms are recorded
+// relative to the matrix the recording started with, so a list replays
+// correctly under any parent transform.
+typedef struct display_list_t {
+	unsigned char *ops;
+	size_t size;
+	size_t capacity;
+	unsigned int op_count;
+	float base_alpha; // global alpha when recording began, alphas are kept relative to it
+	bool recorded; // a recording has finished since the last reset
+	bool replayable; // false once a call that can't be recorded was made
+} display_list;
+
+display_list *display_list_new();
+void display_list_delete(display_list *list);
+void display_list_reset(display_list *list);
+
+// context_2d calls on ctx are recorded into list, and still drawn, until
+// display_list_end
+void display_list_begin(display_list *list, struct context_2d_t *ctx);
+void display_list_end(struct context_2d_t *ctx);
+bool display_list_replay(const display_list *list, struct context_2d_t *ctx);
+bool display_list_equals(const display_list *a, const display_list *b);
+
+// called by context_2d while recording
+void display_list_record_save(display_list *list);
+void display_list_record_restore(display_list *list);
+void display_list_record_translate(display_list *list, float x, float y);
+void display_list_record_rotate(display_list *list, float angle);
+void display_list_record_scale(display_list *list, float x, float y);
+void display_list_record_alpha(display_list *list, float alpha);
+void display_list_record_composite(display_list *list, int composite_op);
+void display_list_record_filter(display_list *list, const rgba *color, int filter_type);
+void display_list_record_clip(display_list *list, rect_2d clip);
+void display_list_record_fill_rect(display_list *list, const rect_2d *rect, const rgba *color);
+void display_list_record_image(display_list *list, const char *url, const rect_2d *src_rects, const rect_2d *dest_rects, int count);
+void display_list_record_image_handle(display_list *list, int handle, const rect_2d *src_rects, const rect_2d *dest_rects, int count);
+void display_list_record_unsupported(display_list *list, const char *call);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
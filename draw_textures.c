@@ -18,45 +18,618 @@
  * @brief
  */
 #include "core/draw_textures.h"
-#include <sys/time.h>
 #include "core/tealeaf_context.h"
 #include "core/tealeaf_shaders.h"
 #include "core/log.h"
 #include "core/graphics_utils.h"
+#include "core/gl_state.h"
+#include "core/profiler.h"
 #include "platform/gl.h"
 #include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 
-#define DRAW_TEXTURES_PROFILE 0
-#define MAX_BUFFER_SIZE 1024
+// quads per batch, each quad is 4 vertices drawn through the quad index buffer.
+// the buffer starts small and doubles up to the most quads 16 bit indices reach
+#define MIN_BUFFER_SIZE 512
+#define MAX_BUFFER_SIZE 16384
+// number of full batches the streaming vertex buffer holds before orphaning
+#define VBO_RING_BATCHES 4
 
 
 static int lastName = -1;
 static int bufSize = 0;
-static float lastOpacity = 1;
+// textures bound to units 0..batch_texture_count - 1 for the current batch
+static int batch_textures[MAX_BATCH_TEXTURE_UNITS];
+static unsigned int batch_texture_count = 0;
+static unsigned int batch_texture_units = 1;
+static int last_tex_index = -1;
 static int last_composite_op = 0;
-static int last_filter_type = 0;
-static rgba last_filter_color = {0, 0, 0, 0};
+static unsigned int last_shader = PRIMARY_SHADER;
+// every quad in the current batch covers what is under it completely
+static bool batch_opaque = true;
+// queue every draw so quads hidden behind opaque ones can be dropped
+static bool opaque_culling = false;
+static bool use_vbo = false;
+static bool use_instancing = false;
+static GLuint vertex_vbo = 0;
+static GLuint index_vbo = 0;
+static GLuint corner_vbo = 0;
+static int vbo_offset = 0;
+static int vbo_capacity = 0;
+static int vbo_ring_bytes = 0;
+static draw_textures_stats frame_stats;
+static draw_textures_stats last_frame_stats;
+// 1x1 opaque white texture, solid fills sample it so they batch with sprites
+static GLuint white_texture = 0;
+
+// pending point sprite strokes, drawn together while the brush stays the same
+static GLfloat *points = NULL;
+static int point_count = 0;
+static int point_capacity = 0;
+static int point_name = -1;
+static float point_size = 0;
+static float point_color[4];
+
+static void flush_points();
+
+// a single vertex, interleaved as UV, XY and then the premultiplied
+// draw / add colors so opacity and filter changes do not end a batch
+typedef struct draw_vertex_t {
+    float srcX;
+    float srcY;
+    float destX;
+    float destY;
+    float tex_index;
+    unsigned char color[4];
+    unsigned char add_color[4];
+} draw_vertex;
+
+// a quad, top left / top right / bottom right / bottom left
 typedef struct bufobj_t {
-    float srcX1;
-    float srcY1;
-    float destX1;
-    float destY1;
-    float srcX2;
-    float srcY2;
-    float destX2;
-    float destY2;
-    float srcX3;
-    float srcY3;
-    float destX3;
-    float destY3;
+    draw_vertex v1;
+    draw_vertex v2;
+    draw_vertex v3;
+    draw_vertex v4;
 } bufobj;
 
-static bufobj buffer[MAX_BUFFER_SIZE];
+// a quad drawn as an instance of the unit square: its top left corner, the
+// top and left edges and its source rect. less than half of a bufobj
+typedef struct draw_instance_t {
+    float origin[2];
+    float axes[4];
+    float tex_rect[4];
+    float tex_index;
+    unsigned char color[4];
+    unsigned char add_color[4];
+} draw_instance;
+
+// unit square corners of an instance, as a triangle strip
+static const GLfloat corner_coords[8] = {0, 0, 1, 0, 0, 1, 1, 1};
+
+static bufobj *buffer = NULL;
+static GLushort *indices = NULL;
+static draw_instance *instances = NULL;
+static int buffer_capacity = 0;
+
+/**
+ * @name	resize_buffer
+ * @brief	grows the quad buffer and its index buffer, or the instance
+ *			buffer when drawing instanced, to the given size
+ * @param	capacity - (int) number of quads to hold
+ * @retval	bool - (true | false) depending on whether the buffer was resized
+ */
+static bool resize_buffer(int capacity) {
+    if (use_instancing) {
+        draw_instance *new_instances = (draw_instance *) realloc(instances, capacity * sizeof(draw_instance));
+        if (!new_instances) {
+            LOG("{drawtex} WARNING: Unable to grow batch buffer to %d quads", capacity);
+            return false;
+        }
+        instances = new_instances;
+        buffer_capacity = capacity;
+        return true;
+    }
+
+    bufobj *new_buffer = (bufobj *) realloc(buffer, capacity * sizeof(bufobj));
+    if (!new_buffer) {
+        LOG("{drawtex} WARNING: Unable to grow batch buffer to %d quads", capacity);
+        return false;
+    }
+    buffer = new_buffer;
+
+    GLushort *new_indices = (GLushort *) realloc(indices, capacity * 6 * sizeof(GLushort));
+    if (!new_indices) {
+        LOG("{drawtex} WARNING: Unable to grow batch buffer to %d quads", capacity);
+        return false;
+    }
+    indices = new_indices;
+
+    // two triangles per quad, sharing the top left / bottom right corners
+    for (int i = buffer_capacity; i < capacity; i++) {
+        GLushort base = (GLushort)(i * 4);
+        GLushort *quad = indices + i * 6;
+        quad[0] = base + 3;
+        quad[1] = base + 2;
+        quad[2] = base;
+        quad[3] = base + 2;
+        quad[4] = base + 1;
+        quad[5] = base;
+    }
+
+    buffer_capacity = capacity;
+    return true;
+}
+
+static inline unsigned char color_to_byte(float c) {
+    if (c <= 0) {
+        return 0;
+    } else if (c >= 1) {
+        return 255;
+    }
+    return (unsigned char)(c * 255.f + 0.5f);
+}
+
+static inline void set_vertex(draw_vertex *v, float src_x, float src_y, float dest_x, float dest_y, float tex_index, const unsigned char *color, const unsigned char *add_color) {
+    v->srcX = src_x;
+    v->srcY = src_y;
+    v->destX = dest_x;
+    v->destY = dest_y;
+    v->tex_index = tex_index;
+    v->color[0] = color[0];
+    v->color[1] = color[1];
+    v->color[2] = color[2];
+    v->color[3] = color[3];
+    v->add_color[0] = add_color[0];
+    v->add_color[1] = add_color[1];
+    v->add_color[2] = add_color[2];
+    v->add_color[3] = add_color[3];
+}
+
+// quads come from affine transforms, so the bottom right corner is
+// origin + both axes and the instance can leave it out
+static inline void set_instance(draw_instance *o, const textured_quad *q, float tex_index, const unsigned char *color, const unsigned char *add_color) {
+    const rect_2d_vertices *v = &q->dest;
+    o->origin[0] = v->x1;
+    o->origin[1] = v->y1;
+    o->axes[0] = v->x2 - v->x1;
+    o->axes[1] = v->y2 - v->y1;
+    o->axes[2] = v->x4 - v->x1;
+    o->axes[3] = v->y4 - v->y1;
+    o->tex_rect[0] = q->s_min;
+    o->tex_rect[1] = q->t_min;
+    o->tex_rect[2] = q->s_max;
+    o->tex_rect[3] = q->t_max;
+    o->tex_index = tex_index;
+    memcpy(o->color, color, 4);
+    memcpy(o->add_color, add_color, 4);
+}
+
+/**
+ * @name	get_batch_texture_index
+ * @brief	finds the unit the given texture is bound to in the current batch
+ * @param	name - (int) gl texture id
+ * @retval	int - unit index, or -1 if the texture is not in the batch
+ */
+static inline int get_batch_texture_index(int name) {
+    for (unsigned int i = 0; i < batch_texture_count; i++) {
+        if (batch_textures[i] == name) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * @name	get_vertex_colors
+ * @brief	computes the per-vertex draw / add colors for the given opacity
+ *			and filter, returning the shader able to render them
+ * @param	opacity - (float) the global opacity to draw with
+ * @param	filter_color - (rgba*) the color object being used by the filter
+ * @param	filter_type - (int) the type of filter being used currently
+ * @param	color - (unsigned char *) out, premultiplied draw color
+ * @param	add_color - (unsigned char *) out, premultiplied add color
+ * @retval	unsigned int - shader used to draw the vertices
+ */
+static unsigned int get_vertex_colors(float opacity, rgba *filter_color, int filter_type, unsigned char *color, unsigned char *add_color) {
+    float r = opacity, g = opacity, b = opacity, a = opacity;
+    float add_r = 0, add_g = 0, add_b = 0;
+    unsigned int shader = PRIMARY_SHADER;
+
+    //TODO: implement filters using filter_type on views properly
+    if (!use_single_shader) {
+        if (filter_type == FILTER_LINEAR_ADD) {
+            add_r = filter_color->r * filter_color->a;
+            add_g = filter_color->g * filter_color->a;
+            add_b = filter_color->b * filter_color->a;
+            shader = LINEAR_ADD_SHADER;
+        } else if (filter_type == FILTER_MULTIPLY) {
+            r = opacity * (1 + (filter_color->r - 1) * filter_color->a);
+            g = opacity * (1 + (filter_color->g - 1) * filter_color->a);
+            b = opacity * (1 + (filter_color->b - 1) * filter_color->a);
+        } else if (filter_type == FILTER_TINT) {
+            float t = 1 - filter_color->a;
+            add_r = filter_color->r * filter_color->a;
+            add_g = filter_color->g * filter_color->a;
+            add_b = filter_color->b * filter_color->a;
+            r = g = b = opacity * t;
+            shader = LINEAR_ADD_SHADER;
+        }
+    }
+
+    color[0] = color_to_byte(r);
+    color[1] = color_to_byte(g);
+    color[2] = color_to_byte(b);
+    color[3] = color_to_byte(a);
+    add_color[0] = color_to_byte(add_r);
+    add_color[1] = color_to_byte(add_g);
+    add_color[2] = color_to_byte(add_b);
+    add_color[3] = 0;
+    return shader;
+}
+
+static void flush_batch(int reason);
+static void drain_queue();
+
+// a quad waiting to be batched, already transformed and colored
+typedef struct queued_quad_t {
+    int name;
+    int composite_op;
+    unsigned int shader;
+    textured_quad quad;
+    unsigned char color[4];
+    unsigned char add_color[4];
+    float min_x, min_y, max_x, max_y;
+    bool opaque; // source over with full alpha from an opaque texture
+    bool culled; // covered by an opaque quad drawn later
+    int next; // next quad in the same bucket while sorting
+} queued_quad;
+
+// quads sharing draw state that can be drawn together while sorting
+typedef struct queue_bucket_t {
+    int name;
+    int composite_op;
+    unsigned int shader;
+    float min_x, min_y, max_x, max_y;
+    int first;
+    int last;
+} queue_bucket;
+
+// how many buckets back a quad may move, bounds the sorting cost
+#define QUEUE_MAX_LOOKBACK 16
+// opaque rects kept while culling, the largest ones hide the most
+#define QUEUE_MAX_OCCLUDERS 8
+
+typedef struct occluder_t {
+    float min_x, min_y, max_x, max_y;
+    float area;
+} occluder;
+
+static queued_quad *queue = NULL;
+static queue_bucket *queue_buckets = NULL;
+static int queue_count = 0;
+static int queue_capacity = 0;
+static int queue_depth = 0;
+
+/**
+ * @name	batch_quad
+ * @brief	adds a quad to the current batch, flushing first if its state
+ *			cannot be drawn with the rest of the batch
+ * @param	ctx - (context_2d *) context drawn to, used for full canvas composites
+ * @param	item - (const queued_quad *) quad to draw
+ * @retval	NONE
+ */
+static void batch_quad(context_2d *ctx, const queued_quad *item) {
+    int name = item->name;
+    int composite_op = item->composite_op;
+    unsigned int shader = item->shader;
+    int tex_index = name == lastName ? last_tex_index : get_batch_texture_index(name);
+    int reason = -1;
+    if (bufSize > 0) {
+        if (composite_op != last_composite_op) {
+            reason = DRAW_TEXTURES_FLUSH_COMPOSITE;
+        } else if (shader != last_shader) {
+            reason = DRAW_TEXTURES_FLUSH_FILTER;
+        } else if (tex_index < 0 && batch_texture_count >= batch_texture_units) {
+            reason = DRAW_TEXTURES_FLUSH_TEXTURE;
+        }
+    }
+
+    if (reason < 0 && bufSize >= buffer_capacity &&
+        (buffer_capacity >= MAX_BUFFER_SIZE || !resize_buffer(buffer_capacity ? buffer_capacity * 2 : MIN_BUFFER_SIZE))) {
+        reason = DRAW_TEXTURES_FLUSH_FULL;
+    }
+
+    if (reason >= 0 || bufSize == 0) {
+        if (reason >= 0) {
+            flush_batch(reason);
+        }
+        last_composite_op = composite_op;
+        last_shader = shader;
+        batch_opaque = true;
+        tex_index = -1;
+
+        // no memory for even a single batch
+        if (bufSize >= buffer_capacity) {
+            return;
+        }
+    }
+
+    //if the composite operation is one which requires being
+    //applied to the full canvas, clear around the quad first; the
+    //batch is empty here, as each such quad is flushed alone
+    bool full_canvas = is_full_canvas_composite_operation(composite_op);
+    if (full_canvas) {
+        const rect_2d_vertices *d = &item->quad.dest;
+        float min_x = fminf(fminf(d->x1, d->x2), fminf(d->x3, d->x4));
+        float min_y = fminf(fminf(d->y1, d->y2), fminf(d->y3, d->y4));
+        rect_2d bounds = {min_x, min_y,
+                          fmaxf(fmaxf(d->x1, d->x2), fmaxf(d->x3, d->x4)) - min_x,
+                          fmaxf(fmaxf(d->y1, d->y2), fmaxf(d->y3, d->y4)) - min_y};
+        set_up_full_compositing(ctx, &bounds);
+    }
+
+    if (tex_index < 0) {
+        tex_index = batch_texture_count;
+        batch_textures[batch_texture_count++] = name;
+    }
+    batch_opaque = batch_opaque && item->opaque;
+    lastName = name;
+    last_tex_index = tex_index;
+
+    const textured_quad *q = &item->quad;
+    float t = (float)tex_index;
+    if (use_instancing) {
+        set_instance(instances + bufSize++, q, t, item->color, item->add_color);
+    } else {
+        bufobj *o = buffer + bufSize++;
+        const rect_2d_vertices *v = &q->dest;
+        set_vertex(&o->v1, q->s_min, q->t_min, v->x1, v->y1, t, item->color, item->add_color);
+        set_vertex(&o->v2, q->s_max, q->t_min, v->x2, v->y2, t, item->color, item->add_color);
+        set_vertex(&o->v3, q->s_max, q->t_max, v->x3, v->y3, t, item->color, item->add_color);
+        set_vertex(&o->v4, q->s_min, q->t_max, v->x4, v->y4, t, item->color, item->add_color);
+    }
+
+    if (full_canvas) {
+        flush_batch(DRAW_TEXTURES_FLUSH_COMPOSITE);
+    }
+}
+
+static inline bool is_opaque_composite_operation(int composite_op) {
+    return composite_op == 0 || composite_op == source_over;
+}
+
+static inline bool quad_is_axis_aligned(const rect_2d_vertices *v) {
+    return (v->x1 == v->x4 && v->x2 == v->x3 && v->y1 == v->y2 && v->y3 == v->y4) ||
+           (v->x1 == v->x2 && v->x3 == v->x4 && v->y1 == v->y4 && v->y2 == v->y3);
+}
+
+static inline bool queue_bounds_overlap(float min_x, float min_y, float max_x, float max_y, const queue_bucket *b) {
+    return min_x < b->max_x && b->min_x < max_x && min_y < b->max_y && b->min_y < max_y;
+}
+
+/**
+ * @name	queue_quad
+ * @brief	records a quad to be sorted by state when the queue drains
+ * @param	item - (const queued_quad *) quad to record
+ * @retval	NONE
+ */
+static void queue_quad(const queued_quad *item) {
+    if (queue_count >= queue_capacity) {
+        int capacity = queue_capacity ? queue_capacity * 2 : MIN_BUFFER_SIZE;
+        queued_quad *new_queue = (queued_quad *) realloc(queue, capacity * sizeof(queued_quad));
+        queue_bucket *new_buckets = new_queue ? (queue_bucket *) realloc(queue_buckets, capacity * sizeof(queue_bucket)) : NULL;
+        if (new_queue) {
+            queue = new_queue;
+        }
+        if (!new_buckets) {
+            LOG("{drawtex} WARNING: Unable to grow render queue to %d quads", capacity);
+            drain_queue();
+            batch_quad(NULL, item);
+            return;
+        }
+        queue_buckets = new_buckets;
+        queue_capacity = capacity;
+    }
+
+    queued_quad *q = queue + queue_count++;
+    *q = *item;
+
+    const rect_2d_vertices *v = &q->quad.dest;
+    q->min_x = fminf(fminf(v->x1, v->x2), fminf(v->x3, v->x4));
+    q->max_x = fmaxf(fmaxf(v->x1, v->x2), fmaxf(v->x3, v->x4));
+    q->min_y = fminf(fminf(v->y1, v->y2), fminf(v->y3, v->y4));
+    q->max_y = fmaxf(fmaxf(v->y1, v->y2), fmaxf(v->y3, v->y4));
+    q->culled = false;
+    q->next = -1;
+}
+
+/**
+ * @name	cull_occluded
+ * @brief	walks the queue front to back, marking quads that an opaque, axis
+ *			aligned quad queued after them covers completely. only pixel
+ *			centers inside a quad are drawn, so a quad within an occluder's
+ *			bounds has every one of its pixels painted over
+ * @retval	NONE
+ */
+static void cull_occluded() {
+    occluder occluders[QUEUE_MAX_OCCLUDERS];
+    int occluder_count = 0;
+
+    for (int i = queue_count - 1; i >= 0; i--) {
+        queued_quad *q = queue + i;
+
+        for (int o = 0; o < occluder_count; o++) {
+            const occluder *r = occluders + o;
+            if (q->min_x >= r->min_x && q->min_y >= r->min_y && q->max_x <= r->max_x && q->max_y <= r->max_y) {
+                q->culled = true;
+                frame_stats.culled_quads++;
+                break;
+            }
+        }
+
+        if (q->culled || !q->opaque || !quad_is_axis_aligned(&q->quad.dest)) {
+            continue;
+        }
+
+        // past the limit, replace the smallest occluder if this one is bigger
+        float area = (q->max_x - q->min_x) * (q->max_y - q->min_y);
+        int slot = occluder_count;
+        if (occluder_count < QUEUE_MAX_OCCLUDERS) {
+            occluder_count++;
+        } else {
+            slot = 0;
+            for (int o = 1; o < occluder_count; o++) {
+                if (occluders[o].area < occluders[slot].area) {
+                    slot = o;
+                }
+            }
+            if (occluders[slot].area >= area) {
+                continue;
+            }
+        }
+
+        occluder *r = occluders + slot;
+        r->min_x = q->min_x;
+        r->min_y = q->min_y;
+        r->max_x = q->max_x;
+        r->max_y = q->max_y;
+        r->area = area;
+    }
+}
+
+/**
+ * @name	drain_queue
+ * @brief	batches every queued quad, moving quads back next to earlier quads
+ *			with the same texture / blend state as long as they do not
+ *			overlap anything drawn in between, so overlapping quads keep
+ *			their order
+ * @retval	NONE
+ */
+static void drain_queue() {
+    int bucket_count = 0;
+
+    if (queue_count == 0) {
+        return;
+    }
+
+    if (opaque_culling) {
+        cull_occluded();
+    }
+
+    for (int i = 0; i < queue_count; i++) {
+        queued_quad *q = queue + i;
+        queue_bucket *target = NULL;
+
+        if (q->culled) {
+            continue;
+        }
+
+        for (int b = bucket_count - 1; b >= 0 && b >= bucket_count - QUEUE_MAX_LOOKBACK; b--) {
+            queue_bucket *bucket = queue_buckets + b;
+            if (bucket->name == q->name && bucket->composite_op == q->composite_op && bucket->shader == q->shader) {
+                target = bucket;
+                break;
+            }
+            if (queue_bounds_overlap(q->min_x, q->min_y, q->max_x, q->max_y, bucket)) {
+                break;
+            }
+        }
+
+        if (target) {
+            queue[target->last].next = i;
+            target->last = i;
+            target->min_x = fminf(target->min_x, q->min_x);
+            target->min_y = fminf(target->min_y, q->min_y);
+            target->max_x = fmaxf(target->max_x, q->max_x);
+            target->max_y = fmaxf(target->max_y, q->max_y);
+        } else {
+            target = queue_buckets + bucket_count++;
+            target->name = q->name;
+            target->composite_op = q->composite_op;
+            target->shader = q->shader;
+            target->min_x = q->min_x;
+            target->min_y = q->min_y;
+            target->max_x = q->max_x;
+            target->max_y = q->max_y;
+            target->first = target->last = i;
+        }
+    }
+
+    queue_count = 0;
+    for (int b = 0; b < bucket_count; b++) {
+        for (int i = queue_buckets[b].first; i >= 0; i = queue[i].next) {
+            batch_quad(NULL, queue + i);
+        }
+    }
+}
+
+/**
+ * @name	draw_textures_queue_begin
+ * @brief	starts deferring draws so they can be reordered by state. only
+ *			use for content whose draw order does not matter where items
+ *			do not overlap, such as particles or backgrounds. calls nest.
+ * @retval	NONE
+ */
+void draw_textures_queue_begin() {
+    queue_depth++;
+}
+
+/**
+ * @name	draw_textures_queue_end
+ * @brief	ends a draw_textures_queue_begin, batching the deferred draws once
+ *			the outermost call ends
+ * @retval	NONE
+ */
+void draw_textures_queue_end() {
+    // with opaque culling everything stays queued until the next flush
+    if (queue_depth > 0 && --queue_depth == 0 && !opaque_culling) {
+        drain_queue();
+    }
+}
+
+/**
+ * @name	draw_textures_set_opaque_culling
+ * @brief	turns queueing every draw on or off, so quads that opaque quads
+ *			drawn after them cover completely are dropped before they cost
+ *			fill rate. opaque quads are those drawn source over at full
+ *			alpha from an opaque texture, or filled at full alpha
+ * @param	enabled - (bool) whether to cull hidden quads
+ * @retval	NONE
+ */
+void draw_textures_set_opaque_culling(bool enabled) {
+    if (opaque_culling != enabled) {
+        draw_textures_flush();
+        opaque_culling = enabled;
+    }
+}
+
+/**
+ * @name	submit_quad
+ * @brief	queues a quad to be sorted, or batches it right away when
+ *			nothing is being queued
+ * @param	ctx - (context_2d *) context drawn to, used for full canvas composites
+ * @param	item - (const queued_quad *) quad to draw
+ * @retval	NONE
+ */
+static void submit_quad(context_2d *ctx, const queued_quad *item) {
+    if ((queue_depth > 0 || opaque_culling) && !is_full_canvas_composite_operation(item->composite_op)) {
+        queue_quad(item);
+    } else {
+        drain_queue();
+        batch_quad(ctx, item);
+    }
+}
+
 /**
  * @name	draw_textures_item
  * @brief	takes the given options and queues a texture to be drawn.
  *			this may also trigger a draw_textures_flush if options warranting
- *			a flush are found.
+ *			a flush are found. opacity and filter colors are sent per vertex,
+ *			and up to batch_texture_units textures are drawn per batch, so only
+ *			composite and shader changes or running out of units end a batch.
  * @param	model_view - (matrix_3x3) currently used modelview
  * @param	name - (int) gl texture id
  * @param	src_width - (int) width of the source texture
@@ -70,147 +643,533 @@ static bufobj buffer[MAX_BUFFER_SIZE];
  * @param	composite_op - (int) coposite operation to use for rendering
  * @param	filter_color - (rgba*) the color object being used by the filter
  * @param	filter_type - (int) the type of filter being used currently
+ * @param	opaque_texture - (bool) whether every texel in src is opaque
  * @retval	NONE
  */
-void draw_textures_item(context_2d *ctx, const matrix_3x3 *model_view, int name, int src_width, int src_height, int orig_width, int orig_height, rect_2d src, rect_2d dest, rect_2d clip, float opacity, int composite_op, rgba *filter_color, int filter_type) {
+void draw_textures_item(context_2d *ctx, const matrix_3x3 *model_view, int name, int src_width, int src_height, int orig_width, int orig_height, rect_2d src, rect_2d dest, rect_2d clip, float opacity, int composite_op, rgba *filter_color, int filter_type, bool opaque_texture) {
 
     //ignore this item if clip height is 0
     if (clip.height == 0 || clip.width == 0) {
         return;
     }
 
-    if (name != lastName || bufSize + 2 >= MAX_BUFFER_SIZE || lastOpacity != opacity || composite_op != last_composite_op  || !rgba_equals(&last_filter_color, filter_color) || last_filter_type != filter_type) {
-        // TODO: PERFORMANCE: could send opacity to GPU too by interleaving a buffered color array
-        draw_textures_flush();
-        lastName = name;
-        lastOpacity = opacity;
-        last_composite_op = composite_op;
-        last_filter_color.r = filter_color->r;
-        last_filter_color.g = filter_color->g;
-        last_filter_color.b = filter_color->b;
-        last_filter_color.a = filter_color->a;
-        last_filter_type = filter_type;
-    }
-
-    bufSize += 2;
-    bufobj *o = buffer + bufSize - 2;
-    bufobj *o2 = o + 1;
-    float sMin, tMin, sMax, tMax;
-    sMin = src.x / (float) src_width,
-    tMin = src.y / (float)src_height,
-    sMax = (src.x + src.width) / (float)src_width,
-    tMax = (src.y + src.height) / (float)src_height;
-
-    o->srcX1 = sMin;
-    o->srcY1 = tMax;
-    o->srcX2 = sMax;
-    o->srcY2 = tMax;
-    o->srcX3 = sMin;
-    o->srcY3 = tMin;
-    o2->srcX1 = sMax;
-    o2->srcY1 = tMax;
-    o2->srcX2 = sMax;
-    o2->srcY2 = tMin;
-    o2->srcX3 = sMin;
-    o2->srcY3 = tMin;
-    float x1, y1, x2, y2, x3, y3, x4, y4;
-    matrix_3x3_multiply(model_view, &dest, &x1, &y1, &x2, &y2, &x3, &y3, &x4, &y4);
-    o->destX1 = x4;
-    o->destY1 = y4;
-    o->destX2 = x3;
-    o->destY2 = y3;
-    o->destX3 =  x1;
-    o->destY3 = y1;
-    o2->destX1 = x3;
-    o2->destY1 = y3;
-    o2->destX2 = x2;
-    o2->destY2 = y2;
-    o2->destX3 = x1;
-    o2->destY3 = y1;
-
-    //if the last composite operation is one which requires
-    //being applied to the full canvas, do full canvas composite
-    //preparement
-    if (is_full_canvas_composite_operation(last_composite_op)) {
-        set_up_full_compositing(ctx, (int)x1, (int)y1, (int)(x2 - x1), (int)(y3 - y1), last_composite_op);
-        draw_textures_flush();
+    //fully transparent items draw nothing unless they clear the canvas
+    if (opacity <= 0 && !is_full_canvas_composite_operation(composite_op)) {
+        return;
     }
+
+    if (point_count > 0) {
+        flush_points();
+    }
+
+    queued_quad item;
+    item.name = name;
+    item.composite_op = composite_op;
+    item.shader = get_vertex_colors(opacity, filter_color, filter_type, item.color, item.add_color);
+    item.opaque = opaque_texture && is_opaque_composite_operation(composite_op) && item.color[3] == 255;
+    matrix_3x3_transform_quads(model_view, &src, &dest, 1, 1.f / src_width, 1.f / src_height, &item.quad);
+
+    submit_quad(ctx, &item);
 }
 
-#if DRAW_TEXTURES_PROFILE
-struct timeval lastFlush, prevTime, now;
-#endif
+/**
+ * @name	draw_textures_fill_rect
+ * @brief	queues a solid colored rectangle in the texture batch by drawing
+ *			the white texel tinted with the color, so fills do not end the
+ *			batch or need their own shader
+ * @param	ctx - (context_2d *) context drawn to, used for full canvas composites
+ * @param	model_view - (matrix_3x3) currently used modelview
+ * @param	rect - (rect_2d) rectangle to fill
+ * @param	clip - (rect_2d) current clipping rectangle
+ * @param	color - (const rgba *) color to fill with, not premultiplied
+ * @param	opacity - (float) the global opacity to draw with
+ * @param	composite_op - (int) composite operation to use for rendering
+ * @retval	NONE
+ */
+void draw_textures_fill_rect(context_2d *ctx, const matrix_3x3 *model_view, rect_2d rect, rect_2d clip, const rgba *color, float opacity, int composite_op) {
+    if (clip.height == 0 || clip.width == 0) {
+        return;
+    }
+
+    float alpha = color->a * opacity;
+    if (alpha <= 0 && !is_full_canvas_composite_operation(composite_op)) {
+        return;
+    }
+
+    if (point_count > 0) {
+        flush_points();
+    }
+
+    // sample the middle of the texel so filtering never reaches the edge
+    rect_2d src = {0.25f, 0.25f, 0.5f, 0.5f};
+    queued_quad item;
+    item.name = white_texture;
+    item.composite_op = composite_op;
+    item.shader = PRIMARY_SHADER;
+    item.color[0] = color_to_byte(alpha * color->r);
+    item.color[1] = color_to_byte(alpha * color->g);
+    item.color[2] = color_to_byte(alpha * color->b);
+    item.color[3] = color_to_byte(alpha);
+    item.add_color[0] = item.add_color[1] = item.add_color[2] = item.add_color[3] = 0;
+    item.opaque = is_opaque_composite_operation(composite_op) && item.color[3] == 255;
+    matrix_3x3_transform_quads(model_view, &src, &rect, 1, 1.f, 1.f, &item.quad);
+
+    submit_quad(ctx, &item);
+}
 
 /**
- * @name	draw_textures_flush
- * @brief	renders all the textures queued to draw
+ * @name	draw_textures_sdf_item
+ * @brief	queues part of a distance field texture, whose alpha is the
+ *			distance to a glyph's edge with 0.5 on it. the fill and outline
+ *			colors ride in the per-vertex colors, so text of any size,
+ *			color or outline batches with the rest of the sdf text.
+ * @param	ctx - (context_2d *) context drawn to, used for full canvas composites
+ * @param	model_view - (matrix_3x3) currently used modelview
+ * @param	name - (int) gl texture id
+ * @param	src_width - (int) width of the source texture
+ * @param	src_height - (int) height of the source texture
+ * @param	src - (rect_2d) source rectangle on the texture
+ * @param	dest - (rect_2d) destination rectangle to draw to
+ * @param	clip - (rect_2d) current clipping rectangle
+ * @param	opacity - (float) the global opacity to draw with
+ * @param	composite_op - (int) composite operation to use for rendering
+ * @param	fill - (const rgba *) text color, not premultiplied
+ * @param	outline - (const rgba *) outline color, drawn with the text's alpha
+ * @param	outline_width - (float) outline width as a distance, 0 to 0.5
  * @retval	NONE
  */
-void draw_textures_flush() {
-    if (bufSize <= 0) {
+void draw_textures_sdf_item(context_2d *ctx, const matrix_3x3 *model_view, int name, int src_width, int src_height, rect_2d src, rect_2d dest, rect_2d clip, float opacity, int composite_op, const rgba *fill, const rgba *outline, float outline_width) {
+    if (clip.height == 0 || clip.width == 0) {
         return;
     }
 
-    if (lastOpacity > 0) {
-        int stride = sizeof(float) * 4;
+    float alpha = fill->a * opacity;
+    if (alpha <= 0 && !is_full_canvas_composite_operation(composite_op)) {
+        return;
+    }
 
-        apply_composite_operation(last_composite_op);
+    if (point_count > 0) {
+        flush_points();
+    }
+
+    queued_quad item;
+    item.name = name;
+    item.composite_op = composite_op;
+    item.shader = SDF_SHADER;
+    item.color[0] = color_to_byte(alpha * fill->r);
+    item.color[1] = color_to_byte(alpha * fill->g);
+    item.color[2] = color_to_byte(alpha * fill->b);
+    item.color[3] = color_to_byte(alpha);
+    item.add_color[0] = color_to_byte(outline->r);
+    item.add_color[1] = color_to_byte(outline->g);
+    item.add_color[2] = color_to_byte(outline->b);
+    item.add_color[3] = color_to_byte(outline_width);
+    item.opaque = false;
+    matrix_3x3_transform_quads(model_view, &src, &dest, 1, 1.f / src_width, 1.f / src_height, &item.quad);
+
+    submit_quad(ctx, &item);
+}
+
+/**
+ * @name	flush_points
+ * @brief	draws the pending point sprite strokes
+ * @retval	NONE
+ */
+static void flush_points() {
+    if (point_count <= 0) {
+        return;
+    }
 
-        if (use_single_shader) {
-            tealeaf_shaders_bind(PRIMARY_SHADER);
-            GLTRACE(glUniform4f(global_shaders[current_shader].draw_color, lastOpacity, lastOpacity, lastOpacity, lastOpacity));
+    tealeaf_shader *shader = &global_shaders[DRAWING_SHADER];
+    tealeaf_shaders_bind(DRAWING_SHADER);
+    gl_state_bind_texture(0, point_name);
+    gl_state_blend_func(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    GLTRACE(glUniform1f(shader->point_size, point_size));
+    GLTRACE(glUniform4f(shader->draw_color, point_color[0], point_color[1], point_color[2], point_color[3]));
+    GLTRACE(glVertexAttribPointer(shader->vertex_coords, 2, GL_FLOAT, GL_FALSE, 0, points));
+    GLTRACE(glDrawArrays(GL_POINTS, 0, point_count));
+    tealeaf_shaders_bind(PRIMARY_SHADER);
+
+    point_count = 0;
+}
+
+/**
+ * @name	clip_segment
+ * @brief	clips the parametric segment p(t) = (x1, y1) + t * (dx, dy) to the
+ *			given bounds (Liang-Barsky)
+ * @param	t0 - (float *) in / out, start of the visible range
+ * @param	t1 - (float *) in / out, end of the visible range
+ * @retval	bool - false if no part of the segment is within the bounds
+ */
+static bool clip_segment(float x1, float y1, float dx, float dy, float min_x, float min_y, float max_x, float max_y, float *t0, float *t1) {
+    float p[4] = {-dx, dx, -dy, dy};
+    float q[4] = {x1 - min_x, max_x - x1, y1 - min_y, max_y - y1};
+
+    for (int i = 0; i < 4; i++) {
+        if (p[i] == 0) {
+            if (q[i] < 0) {
+                return false;
+            }
         } else {
-            //TODO: implement filters using filter_type on views properly
-            if (last_filter_type == FILTER_NONE) {
-                tealeaf_shaders_bind(PRIMARY_SHADER);
-                GLTRACE(glUniform4f(global_shaders[current_shader].draw_color, lastOpacity, lastOpacity, lastOpacity, lastOpacity));
-            } else if (last_filter_type == FILTER_LINEAR_ADD) {
-                float r = last_filter_color.r * last_filter_color.a;
-                float g = last_filter_color.g * last_filter_color.a;
-                float b = last_filter_color.b * last_filter_color.a;
-                tealeaf_shaders_bind(LINEAR_ADD_SHADER);
-                GLTRACE(glUniform4f(global_shaders[current_shader].add_color, r, g, b, 0));
-                GLTRACE(glUniform4f(global_shaders[current_shader].draw_color, lastOpacity, lastOpacity, lastOpacity, lastOpacity));
-            } else if (last_filter_type == FILTER_MULTIPLY) {
-                float r = 1 + (last_filter_color.r - 1) * last_filter_color.a;
-                float g = 1 + (last_filter_color.g - 1) * last_filter_color.a;
-                float b = 1 + (last_filter_color.b - 1) * last_filter_color.a;
-                tealeaf_shaders_bind(PRIMARY_SHADER);
-                GLTRACE(glUniform4f(global_shaders[current_shader].draw_color, r * lastOpacity, g * lastOpacity, b * lastOpacity, lastOpacity));
-            } else if (last_filter_type == FILTER_TINT) {
-                float a = last_filter_color.a;
-                float t = 1 - a;
-                float r = last_filter_color.r * a;
-                float g = last_filter_color.g * a;
-                float b = last_filter_color.b * a;
-                tealeaf_shaders_bind(LINEAR_ADD_SHADER);
-                GLTRACE(glUniform4f(global_shaders[current_shader].add_color, r, g, b, 0));
-                GLTRACE(glUniform4f(global_shaders[current_shader].draw_color, lastOpacity * t, lastOpacity * t, lastOpacity * t, lastOpacity));
+            float t = q[i] / p[i];
+            if (p[i] < 0) {
+                if (t > *t0) {
+                    *t0 = t;
+                }
+            } else if (t < *t1) {
+                *t1 = t;
             }
+        }
+    }
+
+    return *t0 <= *t1;
+}
 
+/**
+ * @name	draw_textures_point_sprites
+ * @brief	adds point sprites spaced along a line to the pending stroke.
+ *			consecutive segments with the same texture, size and color are
+ *			drawn together when the stroke next has to be flushed, which is
+ *			on the next draw_textures_flush or when anything else is drawn
+ * @param	name - (int) gl texture id of the brush
+ * @param	size - (float) point sprite size
+ * @param	step_size - (float) distance between drawn point sprites
+ * @param	color - (const rgba *) color to draw with, not premultiplied
+ * @param	opacity - (float) the global opacity to draw with
+ * @param	x1, y1, x2, y2 - (float) line to draw along, in framebuffer pixels
+ * @param	width, height - (int) size of the canvas, points whose sprite
+ *			lands completely outside of it are not generated
+ * @retval	NONE
+ */
+void draw_textures_point_sprites(int name, float size, float step_size, const rgba *color, float opacity, float x1, float y1, float x2, float y2, int width, int height) {
+    float alpha = color->a * opacity;
+    float r = alpha * color->r, g = alpha * color->g, b = alpha * color->b;
+
+    // pending sprites and quads are drawn in the order they were requested
+    drain_queue();
+    flush_batch(DRAW_TEXTURES_FLUSH_EXTERNAL);
+
+    if (point_count > 0 && (name != point_name || size != point_size ||
+            r != point_color[0] || g != point_color[1] || b != point_color[2] || alpha != point_color[3])) {
+        flush_points();
+    }
+
+    point_name = name;
+    point_size = size;
+    point_color[0] = r;
+    point_color[1] = g;
+    point_color[2] = b;
+    point_color[3] = alpha;
+
+    float dx = x2 - x1, dy = y2 - y1;
+    int count = step_size > 0 ? (int) ceilf(sqrtf(dx * dx + dy * dy) / step_size) : 1;
+    if (count < 1) {
+        count = 1;
+    }
+
+    // only generate the steps whose sprite can touch the canvas, keeping
+    // them at the same positions an unclipped line would put them at
+    float half = size / 2;
+    float t0 = 0, t1 = 1;
+    if (!clip_segment(x1, y1, dx, dy, -half, -half, width + half, height + half, &t0, &t1)) {
+        return;
+    }
+
+    int first = (int) ceilf(t0 * count);
+    int last = (int) floorf(t1 * count);
+    if (last >= count) {
+        last = count - 1;
+    }
+    if (first > last) {
+        return;
+    }
+
+    int needed = point_count + (last - first + 1);
+    if (needed > point_capacity) {
+        int capacity = point_capacity ? point_capacity : 64;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+
+        GLfloat *new_points = (GLfloat *) realloc(points, capacity * 2 * sizeof(GLfloat));
+        if (!new_points) {
+            LOG("{drawtex} WARNING: Unable to grow point sprite buffer to %d points", capacity);
+            return;
         }
+        points = new_points;
+        point_capacity = capacity;
+    }
+
+    for (int i = first; i <= last; i++) {
+        float t = (float) i / (float) count;
+        points[2 * point_count + 0] = x1 + dx * t;
+        points[2 * point_count + 1] = y1 + dy * t;
+        point_count++;
+    }
+}
+
+/**
+ * @name	stream_to_ring
+ * @brief	copies a batch into the ring buffer vbo, orphaning it once full
+ *			so the driver never has to wait on a draw still reading old data.
+ *			leaves the ring buffer bound
+ * @param	data - (const void *) batch to copy
+ * @param	bytes - (int) size of the batch
+ * @param	item_size - (int) bytes per quad, sizes the ring
+ * @retval	const char* - offset of the batch in the vbo, as a pointer
+ */
+static const char *stream_to_ring(const void *data, int bytes, int item_size) {
+    int ring_bytes = VBO_RING_BATCHES * buffer_capacity * item_size;
+    GLTRACE(glBindBuffer(GL_ARRAY_BUFFER, vertex_vbo));
+    if (vbo_ring_bytes != ring_bytes || vbo_offset + bytes > ring_bytes) {
+        GLTRACE(glBufferData(GL_ARRAY_BUFFER, ring_bytes, NULL, GL_STREAM_DRAW));
+        vbo_ring_bytes = ring_bytes;
+        vbo_offset = 0;
+    }
+    GLTRACE(glBufferSubData(GL_ARRAY_BUFFER, vbo_offset, bytes, data));
+    const char *offset = (const char *)(size_t) vbo_offset;
+    vbo_offset += bytes;
+    return offset;
+}
 
-        GLTRACE(glActiveTexture(GL_TEXTURE0));
-        GLTRACE(glBindTexture(GL_TEXTURE_2D, lastName));
-        GLTRACE(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
-        GLTRACE(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-        GLTRACE(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
-        GLTRACE(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
-        GLTRACE(glVertexAttribPointer(global_shaders[current_shader].vertex_coords, 2, GL_FLOAT, GL_FALSE, stride, ((float *) buffer) + 2));
-        //TexCoord0, XY (Also called ST. Also called UV), FLOAT.
-        GLTRACE(glVertexAttribPointer(global_shaders[current_shader].tex_coords, 2, GL_FLOAT, GL_FALSE, stride, buffer));
-#if DRAW_TEXTURES_PROFILE
-        gettimeofday(&prevTime, NULL);
+/**
+ * @name	draw_quads
+ * @brief	draws the batch from its expanded quad vertices
+ * @param	shader - (tealeaf_shader *) bound batching shader
+ * @param	vertices - (const char *) quad buffer, or its offset in the vbo
+ * @param	elements - (const GLushort *) quad indices, or NULL from the vbo
+ * @retval	NONE
+ */
+static void draw_quads(tealeaf_shader *shader, const char *vertices, const GLushort *elements) {
+    int stride = sizeof(draw_vertex);
+    GLTRACE(glVertexAttribPointer(shader->vertex_coords, 2, GL_FLOAT, GL_FALSE, stride, vertices + offsetof(draw_vertex, destX)));
+    //TexCoord0, XY (Also called ST. Also called UV), FLOAT.
+    GLTRACE(glVertexAttribPointer(shader->tex_coords, 2, GL_FLOAT, GL_FALSE, stride, vertices + offsetof(draw_vertex, srcX)));
+    GLTRACE(glVertexAttribPointer(shader->vertex_color, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, vertices + offsetof(draw_vertex, color)));
+    GLTRACE(glVertexAttribPointer(shader->tex_index, 1, GL_FLOAT, GL_FALSE, stride, vertices + offsetof(draw_vertex, tex_index)));
+
+    if (shader->vertex_add_color >= 0) {
+        GLTRACE(glVertexAttribPointer(shader->vertex_add_color, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, vertices + offsetof(draw_vertex, add_color)));
+    }
+
+    GLTRACE(glDrawElements(GL_TRIANGLES, 6 * bufSize, GL_UNSIGNED_SHORT, elements));
+}
+
+#if defined(GL_ES_VERSION_3_0)
+/**
+ * @name	draw_instances
+ * @brief	draws the batch as instances of the unit square
+ * @param	shader - (tealeaf_shader *) bound instanced batching shader
+ * @retval	NONE
+ */
+static void draw_instances(tealeaf_shader *shader) {
+    int stride = sizeof(draw_instance);
+    const char *data = (const char *) instances;
+    const char *corners = (const char *) corner_coords;
+
+    if (use_vbo) {
+        GLTRACE(glBindBuffer(GL_ARRAY_BUFFER, corner_vbo));
+        corners = NULL;
+    }
+    GLTRACE(glVertexAttribPointer(shader->vertex_coords, 2, GL_FLOAT, GL_FALSE, 0, corners));
+
+    if (use_vbo) {
+        data = stream_to_ring(instances, bufSize * stride, stride);
+    }
+
+    int per_instance[6] = {shader->dest_origin, shader->dest_axes, shader->tex_coords,
+                           shader->vertex_color, shader->tex_index, shader->vertex_add_color};
+    GLTRACE(glVertexAttribPointer(shader->dest_origin, 2, GL_FLOAT, GL_FALSE, stride, data + offsetof(draw_instance, origin)));
+    GLTRACE(glVertexAttribPointer(shader->dest_axes, 4, GL_FLOAT, GL_FALSE, stride, data + offsetof(draw_instance, axes)));
+    GLTRACE(glVertexAttribPointer(shader->tex_coords, 4, GL_FLOAT, GL_FALSE, stride, data + offsetof(draw_instance, tex_rect)));
+    GLTRACE(glVertexAttribPointer(shader->vertex_color, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, data + offsetof(draw_instance, color)));
+    GLTRACE(glVertexAttribPointer(shader->tex_index, 1, GL_FLOAT, GL_FALSE, stride, data + offsetof(draw_instance, tex_index)));
+    if (shader->vertex_add_color >= 0) {
+        GLTRACE(glVertexAttribPointer(shader->vertex_add_color, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride, data + offsetof(draw_instance, add_color)));
+    }
+
+    for (int i = 0; i < 6; i++) {
+        if (per_instance[i] >= 0) {
+            GLTRACE(glVertexAttribDivisor(per_instance[i], 1));
+        }
+    }
+
+    GLTRACE(glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, bufSize));
+
+    // the other programs read these attribute slots per vertex
+    for (int i = 0; i < 6; i++) {
+        if (per_instance[i] >= 0) {
+            GLTRACE(glVertexAttribDivisor(per_instance[i], 0));
+        }
+    }
+}
 #endif
-        GLTRACE(glDrawArrays(GL_TRIANGLES, 0, 3 * bufSize));
-#if DRAW_TEXTURES_PROFILE
-        gettimeofday(&now, NULL);
-        LOG("{drawtex} Flush: %d %d %ld %ld\n", bufSize / 2, lastName,
-            (now.tv_usec - prevTime.tv_usec),
-            (now.tv_usec - lastFlush.tv_usec));
-        lastFlush = now;
+
+/**
+ * @name	flush_batch
+ * @brief	renders all the textures queued to draw
+ * @param	reason - (int) DRAW_TEXTURES_FLUSH_* reason the batch ended
+ * @retval	NONE
+ */
+static void flush_batch(int reason) {
+    if (bufSize <= 0) {
+        return;
+    }
+
+    frame_stats.flushes++;
+    frame_stats.quads += bufSize;
+    frame_stats.flush_reasons[reason]++;
+    if ((unsigned int)bufSize > frame_stats.max_quads_per_flush) {
+        frame_stats.max_quads_per_flush = bufSize;
+    }
+
+    const char *vertices = (const char *) buffer;
+    const GLushort *elements = indices;
+    tealeaf_shader *shader;
+
+    if (batch_opaque) {
+        // nothing shows through, blending would only cost fill rate
+        gl_state_disable_blend();
+    } else {
+        apply_composite_operation(last_composite_op);
+    }
+
+    tealeaf_shaders_bind(last_shader);
+    shader = &global_shaders[current_shader];
+
+    // sampler state was set per texture when queued. bind in reverse so
+    // texture unit 0 is left active for everyone else
+    for (int i = batch_texture_count - 1; i >= 0; i--) {
+        gl_state_bind_texture(i, batch_textures[i]);
+    }
+
+#if defined(GL_ES_VERSION_3_0)
+    if (use_instancing) {
+        draw_instances(shader);
+    } else
 #endif
+    {
+        if (use_vbo) {
+            GLTRACE(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_vbo));
+            if (vbo_capacity != buffer_capacity) {
+                // the quad buffer grew, so grow the gpu copy of the indices with it
+                GLTRACE(glBufferData(GL_ELEMENT_ARRAY_BUFFER, buffer_capacity * 6 * sizeof(GLushort), indices, GL_STATIC_DRAW));
+                vbo_capacity = buffer_capacity;
+            }
+            vertices = stream_to_ring(buffer, bufSize * sizeof(bufobj), sizeof(bufobj));
+            elements = NULL;
+        }
+
+        draw_quads(shader, vertices, elements);
+    }
+
+    if (use_vbo) {
+        // the rest of the renderer draws from client side arrays
+        GLTRACE(glBindBuffer(GL_ARRAY_BUFFER, 0));
+        GLTRACE(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
     }
 
     bufSize = 0;
+    batch_texture_count = 0;
+    lastName = -1;
+    last_tex_index = -1;
+}
+
+/**
+ * @name	draw_textures_flush
+ * @brief	renders all the textures queued to draw
+ * @retval	NONE
+ */
+void draw_textures_flush() {
+    PROFILE_ZONE("draw_textures_flush");
+    drain_queue();
+    flush_batch(DRAW_TEXTURES_FLUSH_EXTERNAL);
+    flush_points();
+}
+
+/**
+ * @name	draw_textures_end_frame
+ * @brief	closes the batch statistics of the current frame, see
+ *			draw_textures_get_stats
+ * @retval	NONE
+ */
+void draw_textures_end_frame() {
+    last_frame_stats = frame_stats;
+    memset(&frame_stats, 0, sizeof(frame_stats));
+}
+
+/**
+ * @name	draw_textures_get_stats
+ * @brief	gets the batch statistics of the last completed frame
+ * @retval	const draw_textures_stats* - statistics of the last frame
+ */
+const draw_textures_stats *draw_textures_get_stats() {
+    return &last_frame_stats;
+}
+
+/**
+ * @name	draw_textures_init
+ * @brief	sets up texture batching, must be called after tealeaf_shaders_init
+ * @param	flags - (int) DRAW_TEXTURES_* options to batch with
+ * @retval	NONE
+ */
+void draw_textures_init(int flags) {
+    draw_textures_flush();
+
+    if (flags & DRAW_TEXTURES_MULTI_TEXTURE) {
+        batch_texture_units = tealeaf_shaders_get_texture_units();
+    } else {
+        batch_texture_units = 1;
+    }
+
+    // the shaders decide whether quads go out as instances, batches
+    // collected the other way are dropped with their buffer
+    bool instanced = tealeaf_shaders_instanced();
+    if (instanced != use_instancing) {
+        free(buffer);
+        free(indices);
+        free(instances);
+        buffer = NULL;
+        indices = NULL;
+        instances = NULL;
+        buffer_capacity = 0;
+        use_instancing = instanced;
+    }
+
+    if (!buffer_capacity && !resize_buffer(MIN_BUFFER_SIZE)) {
+        return;
+    }
+
+    // any old buffers went away with the previous gl context, the
+    // first flush sizes the new ones
+    use_vbo = (flags & DRAW_TEXTURES_VBO) != 0;
+    vbo_offset = 0;
+    vbo_capacity = 0;
+    vbo_ring_bytes = 0;
+    vertex_vbo = 0;
+    index_vbo = 0;
+    corner_vbo = 0;
+
+    if (use_vbo) {
+        GLTRACE(glGenBuffers(1, &vertex_vbo));
+        GLTRACE(glGenBuffers(1, &index_vbo));
+    }
+    if (use_vbo && use_instancing) {
+        GLTRACE(glGenBuffers(1, &corner_vbo));
+        GLTRACE(glBindBuffer(GL_ARRAY_BUFFER, corner_vbo));
+        GLTRACE(glBufferData(GL_ARRAY_BUFFER, sizeof(corner_coords), corner_coords, GL_STATIC_DRAW));
+        GLTRACE(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    }
+
+    static const unsigned char white[4] = {255, 255, 255, 255};
+    GLTRACE(glGenTextures(1, &white_texture));
+    gl_state_bind_texture(0, white_texture);
+    GLTRACE(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+    GLTRACE(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+    GLTRACE(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    GLTRACE(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    GLTRACE(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, white));
+
+    LOG("{drawtex} Batching up to %u textures per draw%s%s", batch_texture_units,
+        use_instancing ? " as instances" : "", use_vbo ? " from a streaming vbo" : "");
 }
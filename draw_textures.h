@@ -24,9 +24,39 @@
 extern "C" {
 #endif
 
+// draw_textures_init options
+#define DRAW_TEXTURES_MULTI_TEXTURE 0x1	// batch textures across texture units
+#define DRAW_TEXTURES_VBO 0x2			// stream vertices through a ring buffer vbo
+
+// why a batch was drawn, see draw_textures_stats
+enum draw_textures_flush_reason {
+    DRAW_TEXTURES_FLUSH_TEXTURE,	// ran out of texture units
+    DRAW_TEXTURES_FLUSH_COMPOSITE,	// composite operation changed
+    DRAW_TEXTURES_FLUSH_FILTER,		// filter type needed another shader
+    DRAW_TEXTURES_FLUSH_FULL,		// batch buffer is at its maximum size
+    DRAW_TEXTURES_FLUSH_EXTERNAL,	// draw_textures_flush, e.g. scissor or clearRect
+    DRAW_TEXTURES_FLUSH_REASON_COUNT
+};
+
+typedef struct draw_textures_stats_t {
+    unsigned int flushes;
+    unsigned int quads;
+    unsigned int max_quads_per_flush;
+    unsigned int culled_quads; // hidden behind opaque quads, see draw_textures_set_opaque_culling
+    unsigned int flush_reasons[DRAW_TEXTURES_FLUSH_REASON_COUNT];
+} draw_textures_stats;
+
 void draw_textures_flush();
-void draw_textures_item(context_2d *ctx, const matrix_3x3 *model_view, int name, int src_width, int src_height, int orig_width, int orig_height, rect_2d src, rect_2d dest, rect_2d clip, float opacity, int composite_op, rgba *filter_color, int filter_type);
-void draw_textures_init();
+void draw_textures_end_frame();
+void draw_textures_queue_begin();
+void draw_textures_queue_end();
+void draw_textures_set_opaque_culling(bool enabled);
+const draw_textures_stats *draw_textures_get_stats();
+void draw_textures_item(context_2d *ctx, const matrix_3x3 *model_view, int name, int src_width, int src_height, int orig_width, int orig_height, rect_2d src, rect_2d dest, rect_2d clip, float opacity, int composite_op, rgba *filter_color, int filter_type, bool opaque_texture);
+void draw_textures_sdf_item(context_2d *ctx, const matrix_3x3 *model_view, int name, int src_width, int src_height, rect_2d src, rect_2d dest, rect_2d clip, float opacity, int composite_op, const rgba *fill, const rgba *outline, float outline_width);
+void draw_textures_fill_rect(context_2d *ctx, const matrix_3x3 *model_view, rect_2d rect, rect_2d clip, const rgba *color, float opacity, int composite_op);
+void draw_textures_point_sprites(int name, float size, float step_size, const rgba *color, float opacity, float x1, float y1, float x2, float y2, int width, int height);
+void draw_textures_init(int flags);
 
 #ifdef __cplusplus
 }
@@ -22,21 +22,159 @@
 #include "timestep/timestep_events.h"
 #include "core/types.h"
 #include "core/core_js.h"
+#include "core/input_replay.h"
+#include "core/log.h"
+#include <stdlib.h>
+#include <string.h>
+
+// events are queued from any thread and handed to js together on the next
+// tick. Producers push onto a lock-free stack, the tick takes the whole
+// stack at once and reverses it back into arrival order
+typedef struct queued_event_t {
+    struct queued_event_t *next;
+    char event[];
+} queued_event;
+
+static queued_event *m_queued_events = NULL;
+
+// flush buffers, only touched by the thread running core_tick
+static queued_event **m_flush_nodes = NULL;
+static const char **m_flush_events = NULL;
+static int m_flush_capacity = 0;
 
 /**
  * @name	core_dispatch_event
- * @brief	dispatches the given event to javascript
+ * @brief	queues the given event for javascript, see core_flush_events
  * @param	event - (const char *) holds the json event string to be sent to javascript
  * @retval	NONE
  */
 void core_dispatch_event(const char *event) {
     //NO useful events are generated before js is ready
     //therefore only push events when js is ready
-    if (js_ready) {
-        js_dispatch_event(event);
+    if (!js_ready || !input_replay_accepts_live_event(event)) {
+        return;
+    }
+    core_dispatch_replayed_event(event);
+}
+
+/**
+ * @name	core_dispatch_replayed_event
+ * @brief	queues an event whatever input_replay is doing
+ * @param	event - (const char *) holds the json event string to be sent to javascript
+ * @retval	NONE
+ */
+void core_dispatch_replayed_event(const char *event) {
+    if (!js_ready) {
+        return;
+    }
+
+    size_t len = strlen(event);
+    queued_event *node = (queued_event *) malloc(sizeof(queued_event) + len + 1);
+    if (!node) {
+        LOG("{events} WARNING: Unable to queue an event of %d bytes", (int) len);
+        return;
+    }
+    memcpy(node->event, event, len + 1);
+
+    node->next = __atomic_load_n(&m_queued_events, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&m_queued_events, &node->next, node, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        // node->next now holds the current head, try again on top of it
+    }
+}
+
+/**
+ * @name	core_flush_events
+ * @brief	dispatches every queued event to javascript in one call, oldest
+ *          first. Events queued by the handlers wait for the next flush
+ * @retval	NONE
+ */
+void core_flush_events() {
+    queued_event *node = __atomic_exchange_n(&m_queued_events, NULL, __ATOMIC_ACQUIRE);
+    if (!node) {
+        return;
+    }
+
+    // the stack is newest first
+    queued_event *ordered = NULL;
+    int count = 0;
+    while (node) {
+        queued_event *next = node->next;
+        node->next = ordered;
+        ordered = node;
+        node = next;
+        count++;
+    }
+
+    if (count > m_flush_capacity) {
+        int capacity = m_flush_capacity ? m_flush_capacity : 64;
+        while (capacity < count) {
+            capacity *= 2;
+        }
+        queued_event **nodes = (queued_event **) realloc(m_flush_nodes, sizeof(queued_event *) * capacity);
+        if (nodes) {
+            m_flush_nodes = nodes;
+        }
+        const char **events = (const char **) realloc(m_flush_events, sizeof(const char *) * capacity);
+        if (events) {
+            m_flush_events = events;
+        }
+        if (nodes && events) {
+            m_flush_capacity = capacity;
+        }
+    }
+
+    while (ordered) {
+        if (!m_flush_capacity) {
+            // without room for a batch, fall back to one call per event
+            queued_event *next = ordered->next;
+            input_replay_record_event(ordered->event);
+            if (js_ready) {
+                js_dispatch_event(ordered->event);
+            }
+            free(ordered);
+            ordered = next;
+            continue;
+        }
+
+        int batch = 0;
+        while (ordered && batch < m_flush_capacity) {
+            input_replay_record_event(ordered->event);
+            m_flush_nodes[batch] = ordered;
+            m_flush_events[batch] = ordered->event;
+            ordered = ordered->next;
+            batch++;
+        }
+
+        if (js_ready) {
+            js_dispatch_events(m_flush_events, batch);
+        }
+        for (int i = 0; i < batch; i++) {
+            free(m_flush_nodes[i]);
+        }
     }
 }
 
+/**
+ * @name	core_events_clear
+ * @brief	drops every queued event and the flush buffers, for when js goes away
+ * @retval	NONE
+ */
+void core_events_clear() {
+    queued_event *node = __atomic_exchange_n(&m_queued_events, NULL, __ATOMIC_ACQUIRE);
+    while (node) {
+        queued_event *next = node->next;
+        free(node);
+        node = next;
+    }
+
+    free(m_flush_nodes);
+    free(m_flush_events);
+    m_flush_nodes = NULL;
+    m_flush_events = NULL;
+    m_flush_capacity = 0;
+}
+
 /**
  * @name	core_dispatch_input_event
  * @brief	dispatches an input event
@@ -21,7 +21,12 @@ extern "C" {
 #endif
 
 void core_dispatch_event(const char *event);
+// queues a recorded event while input_replay plays, which drops live ones
+void core_dispatch_replayed_event(const char *event);
 void core_dispatch_input_event(int id, int type, int x, int y);
+// hands every event queued since the last flush to js in one call
+void core_flush_events();
+void core_events_clear();
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,134 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 frame_arena.c
+ * @brief	bump allocator for allocations that last one frame
+ */
+#include "core/frame_arena.h"
+#include "core/log.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define FRAME_ARENA_MIN_CHUNK (64 * 1024)
+// allocations keep the alignment malloc gives doubles and vectors
+#define FRAME_ARENA_ALIGN 16
+
+// chunks are chained newest first. after a frame that needed more than one,
+// the reset replaces them with a single chunk big enough for all of them
+typedef struct arena_chunk_t {
+    struct arena_chunk_t *next;
+    size_t size;
+    size_t used;
+    // keeps data aligned after the header
+    double data[];
+} arena_chunk;
+
+static arena_chunk *m_chunks = NULL;
+static size_t m_used = 0;
+static size_t m_high_water = 0;
+
+static arena_chunk *new_chunk(size_t size, arena_chunk *next) {
+    arena_chunk *chunk = (arena_chunk *) malloc(sizeof(arena_chunk) + size);
+    if (!chunk) {
+        LOG("{arena} WARNING: Unable to allocate a %u byte frame arena chunk", (unsigned int) size);
+        return NULL;
+    }
+    chunk->next = next;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+/**
+ * @name	frame_arena_alloc
+ * @brief	allocates memory that is released when the current frame ends
+ * @param	size - (size_t) bytes to allocate
+ * @retval	void* - the memory, or NULL if there is none
+ */
+void *frame_arena_alloc(size_t size) {
+    size = (size + FRAME_ARENA_ALIGN - 1) & ~((size_t) FRAME_ARENA_ALIGN - 1);
+    arena_chunk *chunk = m_chunks;
+    if (!chunk || chunk->used + size > chunk->size) {
+        size_t chunk_size = chunk ? chunk->size * 2 : FRAME_ARENA_MIN_CHUNK;
+        while (chunk_size < size) {
+            chunk_size *= 2;
+        }
+        chunk = new_chunk(chunk_size, m_chunks);
+        if (!chunk) {
+            return NULL;
+        }
+        m_chunks = chunk;
+    }
+
+    void *p = (unsigned char *) chunk->data + chunk->used;
+    chunk->used += size;
+    m_used += size;
+    return p;
+}
+
+char *frame_arena_strdup(const char *str) {
+    size_t len = strlen(str) + 1;
+    char *copy = (char *) frame_arena_alloc(len);
+    if (copy) {
+        memcpy(copy, str, len);
+    }
+    return copy;
+}
+
+/**
+ * @name	frame_arena_reset
+ * @brief	releases everything allocated this frame. a frame that spilled
+ *			into several chunks leaves one chunk as big as all of them, so
+ *			the next frame like it needs no malloc
+ * @retval	NONE
+ */
+void frame_arena_reset() {
+    if (m_used > m_high_water) {
+        m_high_water = m_used;
+    }
+    m_used = 0;
+
+    if (m_chunks && m_chunks->next) {
+        size_t total = 0;
+        while (m_chunks) {
+            arena_chunk *next = m_chunks->next;
+            total += m_chunks->size;
+            free(m_chunks);
+            m_chunks = next;
+        }
+        m_chunks = new_chunk(total, NULL);
+    } else if (m_chunks) {
+        m_chunks->used = 0;
+    }
+}
+
+size_t frame_arena_used() {
+    return m_used;
+}
+
+size_t frame_arena_high_water() {
+    return m_high_water > m_used ? m_high_water : m_used;
+}
+
+void frame_arena_shutdown() {
+    while (m_chunks) {
+        arena_chunk *next = m_chunks->next;
+        free(m_chunks);
+        m_chunks = next;
+    }
+    m_used = 0;
+    m_high_water = 0;
+}
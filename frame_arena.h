@@ -0,0 +1,43 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+ 
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+ 
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <stddef.h>
+#include "core/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// A bump allocator for data that only lives until the end of the current
+// core_tick, such as event strings or scratch arrays. Allocations are
+// never freed one by one; core_tick resets the arena once the frame is
+// done. Main thread only, and pointers must not be kept across ticks.
+void *frame_arena_alloc(size_t size);
+char *frame_arena_strdup(const char *str);
+// called by core_tick, everything allocated this frame is released
+void frame_arena_reset();
+// bytes handed out this frame and the most handed out in one frame
+size_t frame_arena_used();
+size_t frame_arena_high_water();
+void frame_arena_shutdown();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FRAME_ARENA_H
@@ -0,0 +1,294 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 frame_timing.c
+ * @brief	breaks each frame's time down by phase and catches slow frames
+ */
+#include "core/frame_timing.h"
+#include "core/log.h"
+#include "core/profiler.h"
+#include "core/deps/jansson/jansson.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// frames kept for the percentiles, and slow frames kept for their breakdown
+#define HISTORY_FRAMES 240
+#define MAX_JANK_FRAMES 16
+
+typedef struct frame_times_t {
+    unsigned int frame;
+    double interval;
+    double total;
+    double phases[FRAME_PHASE_COUNT];
+    bool gpu_timed;
+    double gpu_on_screen;
+    double gpu_offscreen;
+} frame_times;
+
+static const char *m_phase_names[FRAME_PHASE_COUNT] = {
+    "events", "js", "render", "textures", "completions", "other"
+};
+// tracks in the platform's tracer, in microseconds
+static const char *m_counter_names[FRAME_PHASE_COUNT] = {
+    "frame.events", "frame.js", "frame.render", "frame.textures", "frame.completions", "frame.other"
+};
+
+// what percentiles can be found for besides the phases
+#define TICK_TOTAL -1
+#define GPU_TOTAL -2
+
+static frame_times m_history[HISTORY_FRAMES];
+static unsigned int m_history_count = 0;
+static frame_times m_janks[MAX_JANK_FRAMES];
+static unsigned int m_jank_count = 0; // ever seen, the last MAX_JANK_FRAMES kept
+static unsigned int m_frame = 0;
+static double m_budget = 1000.0 / 60;
+
+static frame_times m_current;
+static double m_frame_start = 0;
+static double m_last_mark = 0;
+// render time inside the phase running since the last mark
+static double m_nested = 0;
+static double m_render_start = 0;
+static int m_render_depth = 0;
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/**
+ * @name	frame_timing_begin
+ * @brief	starts timing a frame
+ * @param	interval_ms - (double) time since the last frame began
+ * @retval	NONE
+ */
+void frame_timing_begin(double interval_ms) {
+    memset(&m_current, 0, sizeof(m_current));
+    m_current.frame = ++m_frame;
+    m_current.interval = interval_ms;
+    m_frame_start = now_ms();
+    m_last_mark = m_frame_start;
+    m_nested = 0;
+    m_render_depth = 0;
+}
+
+/**
+ * @name	frame_timing_mark
+ * @brief	ends a phase, crediting it the time since the last mark that
+ *			nested renders didn't take
+ * @param	phase - (int) one of frame_phases
+ * @retval	NONE
+ */
+void frame_timing_mark(int phase) {
+    double now = now_ms();
+    double elapsed = now - m_last_mark - m_nested;
+    m_current.phases[phase] += elapsed > 0 ? elapsed : 0;
+    m_last_mark = now;
+    m_nested = 0;
+}
+
+void frame_timing_render_begin() {
+    if (m_render_depth++ == 0) {
+        m_render_start = now_ms();
+    }
+}
+
+void frame_timing_render_end() {
+    if (m_render_depth > 0 && --m_render_depth == 0) {
+        double elapsed = now_ms() - m_render_start;
+        m_current.phases[FRAME_PHASE_RENDER] += elapsed;
+        m_nested += elapsed;
+    }
+}
+
+unsigned int frame_timing_frame() {
+    return m_frame;
+}
+
+static void set_gpu(frame_times *f, double on_screen_ms, double offscreen_ms) {
+    f->gpu_timed = true;
+    f->gpu_on_screen = on_screen_ms;
+    f->gpu_offscreen = offscreen_ms;
+}
+
+/**
+ * @name	frame_timing_gpu
+ * @brief	files the gpu time of a frame that has ended
+ * @param	frame - (unsigned int) number of the frame
+ * @param	on_screen_ms - (double) gpu time drawing to the screen
+ * @param	offscreen_ms - (double) gpu time drawing into canvases
+ * @retval	NONE
+ */
+void frame_timing_gpu(unsigned int frame, double on_screen_ms, double offscreen_ms) {
+    frame_times *f = &m_history[(frame - 1) % HISTORY_FRAMES];
+    if (f->frame == frame) {
+        set_gpu(f, on_screen_ms, offscreen_ms);
+    }
+    for (int i = 0; i < MAX_JANK_FRAMES; i++) {
+        if (m_janks[i].frame == frame) {
+            set_gpu(&m_janks[i], on_screen_ms, offscreen_ms);
+        }
+    }
+}
+
+/**
+ * @name	frame_timing_end
+ * @brief	counts what is left as other, files the frame and keeps its
+ *			breakdown if it ran over budget, and plots the phases in the
+ *			platform's tracer when zones are marked for it
+ * @retval	NONE
+ */
+void frame_timing_end() {
+    frame_timing_mark(FRAME_PHASE_OTHER);
+    m_current.total = m_last_mark - m_frame_start;
+
+    m_history[m_history_count % HISTORY_FRAMES] = m_current;
+    m_history_count++;
+
+    if (m_current.total > m_budget) {
+        m_janks[m_jank_count % MAX_JANK_FRAMES] = m_current;
+        m_jank_count++;
+    }
+
+    if (profiler_system_trace_enabled()) {
+        for (int i = 0; i < FRAME_PHASE_COUNT; i++) {
+            profiler_counter(m_counter_names[i], (long long) (m_current.phases[i] * 1000));
+        }
+        profiler_counter("frame.total", (long long) (m_current.total * 1000));
+    }
+}
+
+/**
+ * @name	frame_timing_set_budget
+ * @brief	sets how long a tick may take before it counts as jank
+ * @param	budget_ms - (double) budget in milliseconds
+ * @retval	NONE
+ */
+CEXPORT void frame_timing_set_budget(double budget_ms) {
+    if (budget_ms > 0) {
+        m_budget = budget_ms;
+    }
+}
+
+CEXPORT void frame_timing_reset() {
+    m_history_count = 0;
+    m_jank_count = 0;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+// nearest rank percentile of sorted values
+static double percentile(const double *sorted, unsigned int count, int p) {
+    unsigned int rank = (count * p + 99) / 100;
+    return sorted[rank ? rank - 1 : 0];
+}
+
+/**
+ * @name	percentiles
+ * @brief	finds the p50, p95 and p99 of a phase over the frames kept
+ * @param	phase - (int) one of frame_phases, TICK_TOTAL or GPU_TOTAL
+ * @retval	json_t* - object of the percentiles
+ */
+static json_t *percentiles(int phase) {
+    static double values[HISTORY_FRAMES];
+    unsigned int kept = m_history_count < HISTORY_FRAMES ? m_history_count : HISTORY_FRAMES;
+    unsigned int count = 0;
+    for (unsigned int i = 0; i < kept; i++) {
+        const frame_times *f = &m_history[i];
+        if (phase == GPU_TOTAL) {
+            if (f->gpu_timed) {
+                values[count++] = f->gpu_on_screen + f->gpu_offscreen;
+            }
+        } else {
+            values[count++] = phase == TICK_TOTAL ? f->total : f->phases[phase];
+        }
+    }
+    qsort(values, count, sizeof(double), compare_doubles);
+
+    json_t *object = json_object();
+    if (count) {
+        json_object_set_new(object, "p50", json_real(percentile(values, count, 50)));
+        json_object_set_new(object, "p95", json_real(percentile(values, count, 95)));
+        json_object_set_new(object, "p99", json_real(percentile(values, count, 99)));
+    }
+    return object;
+}
+
+static json_t *frame_json(const frame_times *f) {
+    json_t *object = json_object();
+    json_object_set_new(object, "frame", json_integer(f->frame));
+    json_object_set_new(object, "interval", json_real(f->interval));
+    json_object_set_new(object, "total", json_real(f->total));
+    for (int i = 0; i < FRAME_PHASE_COUNT; i++) {
+        json_object_set_new(object, m_phase_names[i], json_real(f->phases[i]));
+    }
+    if (f->gpu_timed) {
+        json_object_set_new(object, "gpuOnScreen", json_real(f->gpu_on_screen));
+        json_object_set_new(object, "gpuOffscreen", json_real(f->gpu_offscreen));
+    }
+    return object;
+}
+
+/**
+ * @name	frame_timing_report
+ * @brief	describes the recent frames as JSON: the budget, how many frames
+ *			and janks were seen, percentiles of the tick, each phase and the
+ *			gpu time of the frames that have it, and
+ *			the breakdown of the last slow frames, oldest first. Times are in
+ *			milliseconds
+ * @retval	char* - the report, freed by the caller, or NULL
+ */
+CEXPORT char *frame_timing_report() {
+    json_t *report = json_object();
+    json_object_set_new(report, "budget", json_real(m_budget));
+    json_object_set_new(report, "frames", json_integer(m_history_count));
+    json_object_set_new(report, "janks", json_integer(m_jank_count));
+    json_object_set_new(report, "total", percentiles(TICK_TOTAL));
+    json_object_set_new(report, "gpu", percentiles(GPU_TOTAL));
+    for (int i = 0; i < FRAME_PHASE_COUNT; i++) {
+        json_object_set_new(report, m_phase_names[i], percentiles(i));
+    }
+
+    json_t *janks = json_array();
+    unsigned int kept = m_jank_count < MAX_JANK_FRAMES ? m_jank_count : MAX_JANK_FRAMES;
+    for (unsigned int i = m_jank_count - kept; i < m_jank_count; i++) {
+        json_array_append_new(janks, frame_json(&m_janks[i % MAX_JANK_FRAMES]));
+    }
+    json_object_set_new(report, "slowFrames", janks);
+
+    char *str = json_dumps(report, JSON_COMPACT);
+    json_decref(report);
+    return str;
+}
+
+/**
+ * @name	frame_timing_log
+ * @brief	logs the report, for field telemetry
+ * @retval	NONE
+ */
+CEXPORT void frame_timing_log() {
+    char *report = frame_timing_report();
+    if (report) {
+        LOG("{frame} %s", report);
+        free(report);
+    }
+}
@@ -0,0 +1,68 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef FRAME_TIMING_H
+#define FRAME_TIMING_H
+
+#include "core/types.h"
+#include "core/util/detect.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Times each phase of every core_tick into a rolling buffer of recent frames,
+// for percentiles of each phase, and keeps the breakdown of the last few
+// frames whose tick ran over budget. Rendering happens inside the JS tick
+// and is counted apart from it. With gpu_timing enabled, frames also get
+// their gpu time a few frames later. Main thread only.
+
+enum frame_phases {
+	FRAME_PHASE_EVENTS,      // input events and timers
+	FRAME_PHASE_JS,          // the JS tick, less rendering
+	FRAME_PHASE_RENDER,      // view tree renders
+	FRAME_PHASE_TEXTURES,    // texture manager tick, mostly uploads
+	FRAME_PHASE_COMPLETIONS, // read backs, jobs, http and socket callbacks
+	FRAME_PHASE_OTHER,       // everything else core_tick does
+	FRAME_PHASE_COUNT
+};
+
+// called by core_tick around the frame, interval_ms is the time since the
+// last tick began
+void frame_timing_begin(double interval_ms);
+// ends the given phase, which ran since the last mark or the frame began
+void frame_timing_mark(int phase);
+void frame_timing_end();
+// around renders, which nest inside other phases
+void frame_timing_render_begin();
+void frame_timing_render_end();
+// number of the frame being timed
+unsigned int frame_timing_frame();
+// adds the gpu time gpu_timing measured for an earlier frame, if it is
+// still kept
+void frame_timing_gpu(unsigned int frame, double on_screen_ms, double offscreen_ms);
+
+// a tick longer than budget_ms is jank, 1000 / 60 unless set
+CEXPORT void frame_timing_set_budget(double budget_ms);
+// the breakdown as JSON, for the bindings and telemetry. Caller frees
+CEXPORT char *frame_timing_report();
+CEXPORT void frame_timing_log();
+CEXPORT void frame_timing_reset();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // FRAME_TIMING_H
@@ -18,6 +18,7 @@
  * @brief
  */
 #include "geometry.h"
+#include "core/util/detect.h"
 
 #include <stdlib.h>
 #include <math.h>
@@ -136,6 +137,222 @@ void matrix_3x3_multiply_m_f_f_f_f(const matrix_3x3 *a, float x, float y, float
 #endif
 }
 
+//Multiply matrix a by matrix b and output the product in dest, which may not
+//alias either input
+void matrix_3x3_multiply_m_m_m(const matrix_3x3 *a, const matrix_3x3 *b, matrix_3x3 *dest) {
+#ifdef MATRIX_3x3_ALLOW_SKEW
+    dest->m00 = a->m00 * b->m00 + a->m01 * b->m10 + a->m02 * b->m20;
+    dest->m01 = a->m00 * b->m01 + a->m01 * b->m11 + a->m02 * b->m21;
+    dest->m02 = a->m00 * b->m02 + a->m01 * b->m12 + a->m02 * b->m22;
+    dest->m10 = a->m10 * b->m00 + a->m11 * b->m10 + a->m12 * b->m20;
+    dest->m11 = a->m10 * b->m01 + a->m11 * b->m11 + a->m12 * b->m21;
+    dest->m12 = a->m10 * b->m02 + a->m11 * b->m12 + a->m12 * b->m22;
+    dest->m20 = a->m20 * b->m00 + a->m21 * b->m10 + a->m22 * b->m20;
+    dest->m21 = a->m20 * b->m01 + a->m21 * b->m11 + a->m22 * b->m21;
+    dest->m22 = a->m20 * b->m02 + a->m21 * b->m12 + a->m22 * b->m22;
+#else
+    matrix_3x3_type a_type = matrix_3x3_get_type(a);
+    matrix_3x3_type b_type = matrix_3x3_get_type(b);
+
+    if (a_type <= MATRIX_3x3_TRANSLATE) {
+        //a only moves b
+        *dest = *b;
+        dest->m02 += a->m02;
+        dest->m12 += a->m12;
+        return;
+    }
+
+    if (b_type <= MATRIX_3x3_TRANSLATE) {
+        //b only adds a translation run through a's linear part
+        *dest = *a;
+        dest->m02 += a->m00 * b->m02 + a->m01 * b->m12;
+        dest->m12 += a->m10 * b->m02 + a->m11 * b->m12;
+        return;
+    }
+
+    if (a_type == MATRIX_3x3_SCALE_TRANSLATE && b_type == MATRIX_3x3_SCALE_TRANSLATE) {
+        dest->m00 = a->m00 * b->m00;
+        dest->m01 = 0;
+        dest->m02 = a->m00 * b->m02 + a->m02;
+        dest->m10 = 0;
+        dest->m11 = a->m11 * b->m11;
+        dest->m12 = a->m11 * b->m12 + a->m12;
+        dest->m20 = 0;
+        dest->m21 = 0;
+        dest->m22 = 1;
+        return;
+    }
+
+    //without skew the bottom row is always 0 0 1
+    dest->m00 = a->m00 * b->m00 + a->m01 * b->m10;
+    dest->m01 = a->m00 * b->m01 + a->m01 * b->m11;
+    dest->m02 = a->m00 * b->m02 + a->m01 * b->m12 + a->m02;
+    dest->m10 = a->m10 * b->m00 + a->m11 * b->m10;
+    dest->m11 = a->m10 * b->m01 + a->m11 * b->m11;
+    dest->m12 = a->m10 * b->m02 + a->m11 * b->m12 + a->m12;
+    dest->m20 = 0;
+    dest->m21 = 0;
+    dest->m22 = 1;
+#endif
+}
+
+/**
+ * @name	transform_quads_translate
+ * @brief	matrix_3x3_transform_quads for a matrix that only translates, so
+ *			every dest rect stays axis aligned
+ * @param	a - (const matrix_3x3 *) translate-only matrix
+ * @param	src - (const rect_2d *) count source rects in texels
+ * @param	dest - (const rect_2d *) count destination rects
+ * @param	count - (int) number of quads
+ * @param	inv_tex_width - (float) 1 / texture width
+ * @param	inv_tex_height - (float) 1 / texture height
+ * @param	out - (textured_quad *) count transformed quads
+ * @retval	NONE
+ */
+static void transform_quads_translate(const matrix_3x3 *a, const rect_2d *src, const rect_2d *dest, int count, float inv_tex_width, float inv_tex_height, textured_quad *out) {
+    const float tx = a->m02, ty = a->m12;
+
+    for (int i = 0; i < count; i++) {
+        rect_2d_vertices *v = &out[i].dest;
+        const float left = dest[i].x + tx, top = dest[i].y + ty;
+        const float right = left + dest[i].width, bottom = top + dest[i].height;
+        v->x1 = left;
+        v->y1 = top;
+        v->x2 = right;
+        v->y2 = top;
+        v->x3 = right;
+        v->y3 = bottom;
+        v->x4 = left;
+        v->y4 = bottom;
+        out[i].s_min = src[i].x * inv_tex_width;
+        out[i].t_min = src[i].y * inv_tex_height;
+        out[i].s_max = (src[i].x + src[i].width) * inv_tex_width;
+        out[i].t_max = (src[i].y + src[i].height) * inv_tex_height;
+    }
+}
+
+#if !defined(MATRIX_3x3_ALLOW_SKEW) && defined(GC_HAS_NEON)
+#include <arm_neon.h>
+
+/**
+ * @name	matrix_3x3_transform_quads
+ * @brief	transforms the four corners of each dest rect by the given matrix
+ *			and computes the texture coordinates of each src rect, NEON version
+ * @param	a - (const matrix_3x3 *) matrix to transform by
+ * @param	src - (const rect_2d *) count source rects in texels
+ * @param	dest - (const rect_2d *) count destination rects
+ * @param	count - (int) number of quads
+ * @param	inv_tex_width - (float) 1 / texture width
+ * @param	inv_tex_height - (float) 1 / texture height
+ * @param	out - (textured_quad *) count transformed quads
+ * @retval	NONE
+ */
+void matrix_3x3_transform_quads(const matrix_3x3 *a, const rect_2d *src, const rect_2d *dest, int count, float inv_tex_width, float inv_tex_height, textured_quad *out) {
+    if (matrix_3x3_is_translate(a)) {
+        transform_quads_translate(a, src, dest, count, inv_tex_width, inv_tex_height, out);
+        return;
+    }
+
+    const float32x4_t tx = vdupq_n_f32(a->m02);
+    const float32x4_t ty = vdupq_n_f32(a->m12);
+    const float inv_size_values[4] = { inv_tex_width, inv_tex_height, inv_tex_width, inv_tex_height };
+    const float32x4_t inv_size = vld1q_f32(inv_size_values);
+
+    for (int i = 0; i < count; i++) {
+        const rect_2d *d = dest + i;
+        const rect_2d *s = src + i;
+        const float right = d->x + d->width, bottom = d->y + d->height;
+        const float dx_values[4] = { d->x, right, right, d->x };
+        const float dy_values[4] = { d->y, d->y, bottom, bottom };
+        const float uv_values[4] = { s->x, s->y, s->x + s->width, s->y + s->height };
+        const float32x4_t dx = vld1q_f32(dx_values);
+        const float32x4_t dy = vld1q_f32(dy_values);
+
+        float32x4_t x = vmlaq_n_f32(vmlaq_n_f32(tx, dx, a->m00), dy, a->m01);
+        float32x4_t y = vmlaq_n_f32(vmlaq_n_f32(ty, dx, a->m10), dy, a->m11);
+        float32x4x2_t xy = vzipq_f32(x, y);
+
+        vst1q_f32(&out[i].dest.x1, xy.val[0]);
+        vst1q_f32(&out[i].dest.x3, xy.val[1]);
+        vst1q_f32(&out[i].s_min, vmulq_f32(vld1q_f32(uv_values), inv_size));
+    }
+}
+
+#elif !defined(MATRIX_3x3_ALLOW_SKEW) && defined(GC_HAS_SSE)
+#include <emmintrin.h>
+
+/**
+ * @name	matrix_3x3_transform_quads
+ * @brief	transforms the four corners of each dest rect by the given matrix
+ *			and computes the texture coordinates of each src rect, SSE version
+ * @param	a - (const matrix_3x3 *) matrix to transform by
+ * @param	src - (const rect_2d *) count source rects in texels
+ * @param	dest - (const rect_2d *) count destination rects
+ * @param	count - (int) number of quads
+ * @param	inv_tex_width - (float) 1 / texture width
+ * @param	inv_tex_height - (float) 1 / texture height
+ * @param	out - (textured_quad *) count transformed quads
+ * @retval	NONE
+ */
+void matrix_3x3_transform_quads(const matrix_3x3 *a, const rect_2d *src, const rect_2d *dest, int count, float inv_tex_width, float inv_tex_height, textured_quad *out) {
+    if (matrix_3x3_is_translate(a)) {
+        transform_quads_translate(a, src, dest, count, inv_tex_width, inv_tex_height, out);
+        return;
+    }
+
+    const __m128 m00 = _mm_set1_ps(a->m00), m01 = _mm_set1_ps(a->m01), m02 = _mm_set1_ps(a->m02);
+    const __m128 m10 = _mm_set1_ps(a->m10), m11 = _mm_set1_ps(a->m11), m12 = _mm_set1_ps(a->m12);
+    const __m128 inv_size = _mm_setr_ps(inv_tex_width, inv_tex_height, inv_tex_width, inv_tex_height);
+
+    for (int i = 0; i < count; i++) {
+        const rect_2d *d = dest + i;
+        const rect_2d *s = src + i;
+        const float right = d->x + d->width, bottom = d->y + d->height;
+        const __m128 dx = _mm_setr_ps(d->x, right, right, d->x);
+        const __m128 dy = _mm_setr_ps(d->y, d->y, bottom, bottom);
+
+        __m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, m00), _mm_mul_ps(dy, m01)), m02);
+        __m128 y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, m10), _mm_mul_ps(dy, m11)), m12);
+
+        _mm_storeu_ps(&out[i].dest.x1, _mm_unpacklo_ps(x, y));
+        _mm_storeu_ps(&out[i].dest.x3, _mm_unpackhi_ps(x, y));
+        _mm_storeu_ps(&out[i].s_min, _mm_mul_ps(_mm_setr_ps(s->x, s->y, s->x + s->width, s->y + s->height), inv_size));
+    }
+}
+
+#else
+
+/**
+ * @name	matrix_3x3_transform_quads
+ * @brief	transforms the four corners of each dest rect by the given matrix
+ *			and computes the texture coordinates of each src rect
+ * @param	a - (const matrix_3x3 *) matrix to transform by
+ * @param	src - (const rect_2d *) count source rects in texels
+ * @param	dest - (const rect_2d *) count destination rects
+ * @param	count - (int) number of quads
+ * @param	inv_tex_width - (float) 1 / texture width
+ * @param	inv_tex_height - (float) 1 / texture height
+ * @param	out - (textured_quad *) count transformed quads
+ * @retval	NONE
+ */
+void matrix_3x3_transform_quads(const matrix_3x3 *a, const rect_2d *src, const rect_2d *dest, int count, float inv_tex_width, float inv_tex_height, textured_quad *out) {
+    if (matrix_3x3_is_translate(a)) {
+        transform_quads_translate(a, src, dest, count, inv_tex_width, inv_tex_height, out);
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        rect_2d_vertices *v = &out[i].dest;
+        matrix_3x3_multiply(a, dest + i, &v->x1, &v->y1, &v->x2, &v->y2, &v->x3, &v->y3, &v->x4, &v->y4);
+        out[i].s_min = src[i].x * inv_tex_width;
+        out[i].t_min = src[i].y * inv_tex_height;
+        out[i].s_max = (src[i].x + src[i].width) * inv_tex_width;
+        out[i].t_max = (src[i].y + src[i].height) * inv_tex_height;
+    }
+}
+
+#endif
+
 //4x4 Matrix Functions
 
 #define O(y,x) (y + (x<<2))
@@ -156,7 +156,7 @@ __attribute__((unused)) static inline bool rect_2d_equals(const rect_2d *a, cons
     matrix_3x3_multiply_m_f_f_f_f(m, x, y, x2, y2)
 
 #define matrix_3x3_multiply3(a, b, dest) \
-    maxtrix_3x3_multiply_m_m_m(a, b, dest)
+    matrix_3x3_multiply_m_m_m(a, b, dest)
 
 #define matrix_3x3_multiply10(a, r, rx1, ry1, rx2, ry2, rx3, ry3, rx4, ry5) \
     matrix_3x3_multiply_m_r_f_f_f_f_f_f_f_f(a, r, rx1, ry1, rx2, ry2, rx3, ry3, rx4, ry5)
@@ -184,7 +184,36 @@ __attribute__((unused)) static void inline matrix_3x3_identity(matrix_3x3 *a) {
 	a->m22 = 1;
 }
 
+// without skew the bottom row is always 0 0 1, so the matrix is really an
+// affine 2x3; these classify it so callers can take the cheapest path
+typedef enum matrix_3x3_type_t {
+	MATRIX_3x3_IDENTITY,
+	MATRIX_3x3_TRANSLATE,
+	MATRIX_3x3_SCALE_TRANSLATE,
+	MATRIX_3x3_GENERAL
+} matrix_3x3_type;
+
+__attribute__((unused)) static inline matrix_3x3_type matrix_3x3_get_type(const matrix_3x3 *a) {
+#ifdef MATRIX_3x3_ALLOW_SKEW
+	if (a->m20 != 0 || a->m21 != 0 || a->m22 != 1) {
+		return MATRIX_3x3_GENERAL;
+	}
+#endif
+	if (a->m01 != 0 || a->m10 != 0) {
+		return MATRIX_3x3_GENERAL;
+	}
+	if (a->m00 != 1 || a->m11 != 1) {
+		return MATRIX_3x3_SCALE_TRANSLATE;
+	}
+	return (a->m02 == 0 && a->m12 == 0) ? MATRIX_3x3_IDENTITY : MATRIX_3x3_TRANSLATE;
+}
+
+__attribute__((unused)) static inline bool matrix_3x3_is_translate(const matrix_3x3 *a) {
+	return matrix_3x3_get_type(a) <= MATRIX_3x3_TRANSLATE;
+}
+
 void matrix_3x3_multiply_m_f_f_f_f(const matrix_3x3 *a, float x, float y, float *x2, float *y2);
+void matrix_3x3_multiply_m_m_m(const matrix_3x3 *a, const matrix_3x3 *b, matrix_3x3 *dest);
 
 __attribute__((unused))static inline void matrix_3x3_multiply_m_r_f_f_f_f_f_f_f_f(const matrix_3x3 *a, const rect_2d *rect, float *rx1, float *ry1,float *rx2, float *ry2,float *rx3, float *ry3,float *rx4, float *ry4) {
 #ifdef MATRIX_3x3_ALLOW_SKEW
@@ -193,6 +222,15 @@ __attribute__((unused))static inline void matrix_3x3_multiply_m_r_f_f_f_f_f_f_f_
 	matrix_3x3_multiply(a, rect->x + rect->width, rect->y + rect->height, rx3, ry3);
 	matrix_3x3_multiply(a, rect->x, rect->y + rect->height, rx4, ry4);
 #else
+	if (matrix_3x3_is_translate(a)) {
+		//translate only, so the rectangle stays axis aligned
+		*rx1 = *rx4 = rect->x + a->m02;
+		*ry1 = *ry2 = rect->y + a->m12;
+		*rx2 = *rx3 = *rx1 + rect->width;
+		*ry3 = *ry4 = *ry1 + rect->height;
+		return;
+	}
+
 	//compute the location of the top left point of the rectangle
 	matrix_3x3_multiply(a, rect->x, rect->y, rx1, ry1);
 
@@ -221,5 +259,15 @@ __attribute__((unused)) static inline void matrix_3x3_multiply_m_r_r(const matri
 	matrix_3x3_multiply(matrix, in->x4, in->y4, &out->x3, &out->y3);
 }
 
+// a transformed destination rect and its texture coordinates
+typedef struct textured_quad_t {
+	rect_2d_vertices dest; // top left, top right, bottom right, bottom left
+	float s_min, t_min, s_max, t_max;
+} textured_quad;
+
+// transforms count dest rects by the matrix and scales the matching src
+// rects by the reciprocal texture size, using NEON / SSE when available
+void matrix_3x3_transform_quads(const matrix_3x3 *a, const rect_2d *src, const rect_2d *dest, int count, float inv_tex_width, float inv_tex_height, textured_quad *out);
+
 
 #endif // MATRIX_H
@@ -0,0 +1,308 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+ 
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+ 
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 gl_state.c
+ * @brief
+ */
+#include "core/gl_state.h"
+#include "platform/gl.h"
+
+// -1 means unknown, forcing the next call through to gl
+static int m_active_unit = -1;
+static int m_bound_textures[GL_STATE_MAX_TEXTURE_UNITS];
+static int m_program = -1;
+static int m_blend_enabled = -1;
+static int m_blend_sfactor = -1;
+static int m_blend_dfactor = -1;
+static int m_scissor_enabled = -1;
+static int m_scissor[4];
+static int m_stencil_enabled = -1;
+static int m_stencil_depth = -1;
+// GL_KEEP while testing, with color writes on
+static int m_stencil_op = -1;
+static int m_framebuffer = -1;
+// texture attached to the offscreen framebuffer, which is the only one we
+// attach textures to
+static int m_framebuffer_texture = -1;
+static int m_viewport[4] = {-1, -1, -1, -1};
+
+/**
+ * @name	gl_state_reset
+ * @brief	forgets all shadowed state, call when gl state was changed elsewhere
+ *			or the gl context was recreated
+ * @retval	NONE
+ */
+void gl_state_reset() {
+    m_active_unit = -1;
+    for (int i = 0; i < GL_STATE_MAX_TEXTURE_UNITS; i++) {
+        m_bound_textures[i] = -1;
+    }
+    m_program = -1;
+    m_blend_enabled = -1;
+    m_blend_sfactor = -1;
+    m_blend_dfactor = -1;
+    m_scissor_enabled = -1;
+    m_stencil_enabled = -1;
+    m_stencil_depth = -1;
+    m_stencil_op = -1;
+    m_framebuffer = -1;
+    m_framebuffer_texture = -1;
+    m_viewport[0] = -1;
+}
+
+/**
+ * @name	gl_state_bind_texture
+ * @brief	binds the given texture to the given texture unit, leaving that
+ *			unit active
+ * @param	unit - (unsigned int) texture unit to bind to
+ * @param	name - (int) gl texture id
+ * @retval	NONE
+ */
+void gl_state_bind_texture(unsigned int unit, int name) {
+    if (m_active_unit != (int)unit) {
+        GLTRACE(glActiveTexture(GL_TEXTURE0 + unit));
+        m_active_unit = unit;
+    }
+
+    if (unit >= GL_STATE_MAX_TEXTURE_UNITS) {
+        GLTRACE(glBindTexture(GL_TEXTURE_2D, name));
+    } else if (m_bound_textures[unit] != name) {
+        GLTRACE(glBindTexture(GL_TEXTURE_2D, name));
+        m_bound_textures[unit] = name;
+    }
+}
+
+/**
+ * @name	gl_state_texture_deleted
+ * @brief	drops a deleted texture from the shadowed bindings, gl unbinds it
+ *			and may hand the same name out again
+ * @param	name - (int) gl texture id that was deleted
+ * @retval	NONE
+ */
+void gl_state_texture_deleted(int name) {
+    for (int i = 0; i < GL_STATE_MAX_TEXTURE_UNITS; i++) {
+        if (m_bound_textures[i] == name) {
+            m_bound_textures[i] = 0;
+        }
+    }
+    if (m_framebuffer_texture == name) {
+        m_framebuffer_texture = -1;
+    }
+}
+
+/**
+ * @name	gl_state_use_program
+ * @brief	makes the given shader program current
+ * @param	program - (int) gl program id
+ * @retval	NONE
+ */
+void gl_state_use_program(int program) {
+    if (m_program != program) {
+        GLTRACE(glUseProgram(program));
+        m_program = program;
+    }
+}
+
+/**
+ * @name	gl_state_blend_func
+ * @brief	enables blending with the given blend factors
+ * @param	sfactor - (int) source blend factor
+ * @param	dfactor - (int) destination blend factor
+ * @retval	NONE
+ */
+void gl_state_blend_func(int sfactor, int dfactor) {
+    if (m_blend_enabled != 1) {
+        GLTRACE(glEnable(GL_BLEND));
+        m_blend_enabled = 1;
+    }
+
+    if (m_blend_sfactor != sfactor || m_blend_dfactor != dfactor) {
+        GLTRACE(glBlendFunc(sfactor, dfactor));
+        m_blend_sfactor = sfactor;
+        m_blend_dfactor = dfactor;
+    }
+}
+
+/**
+ * @name	gl_state_disable_blend
+ * @brief	disables blending, the next gl_state_blend_func enables it again
+ * @retval	NONE
+ */
+void gl_state_disable_blend() {
+    if (m_blend_enabled != 0) {
+        GLTRACE(glDisable(GL_BLEND));
+        m_blend_enabled = 0;
+    }
+}
+
+/**
+ * @name	gl_state_scissor_matches
+ * @brief	checks whether gl already has the given scissor state, so callers
+ *			can skip flushing pending draws when nothing would change
+ * @param	enabled - (bool) whether the scissor test should be enabled
+ * @param	x, y, width, height - (int) scissor box, ignored when disabled
+ * @retval	bool - true if the state is already current
+ */
+bool gl_state_scissor_matches(bool enabled, int x, int y, int width, int height) {
+    if (m_scissor_enabled != (enabled ? 1 : 0)) {
+        return false;
+    }
+
+    return !enabled || (m_scissor[0] == x && m_scissor[1] == y &&
+                        m_scissor[2] == width && m_scissor[3] == height);
+}
+
+/**
+ * @name	gl_state_scissor
+ * @brief	enables the scissor test with the given box, or disables it
+ * @param	enabled - (bool) whether to enable the scissor test
+ * @param	x, y, width, height - (int) scissor box, ignored when disabling
+ * @retval	NONE
+ */
+void gl_state_scissor(bool enabled, int x, int y, int width, int height) {
+    if (enabled) {
+        if (m_scissor_enabled != 1 || m_scissor[0] != x || m_scissor[1] != y ||
+                m_scissor[2] != width || m_scissor[3] != height) {
+            GLTRACE(glScissor(x, y, width, height));
+            m_scissor[0] = x;
+            m_scissor[1] = y;
+            m_scissor[2] = width;
+            m_scissor[3] = height;
+        }
+        if (m_scissor_enabled != 1) {
+            GLTRACE(glEnable(GL_SCISSOR_TEST));
+            m_scissor_enabled = 1;
+        }
+    } else if (m_scissor_enabled != 0) {
+        GLTRACE(glDisable(GL_SCISSOR_TEST));
+        m_scissor_enabled = 0;
+    }
+}
+
+/**
+ * @name	set_stencil
+ * @brief	sets the stencil test to pass where the buffer holds depth, and
+ *			what a passing draw does to it
+ * @param	depth - (int) stencil value to test for, 0 with GL_KEEP disables
+ *			the test
+ * @param	op - (int) stencil op on pass, color writes are off unless GL_KEEP
+ * @retval	NONE
+ */
+static void set_stencil(int depth, int op) {
+    int enabled = depth || op != GL_KEEP ? 1 : 0;
+    if (m_stencil_enabled != enabled) {
+        if (enabled) {
+            GLTRACE(glEnable(GL_STENCIL_TEST));
+        } else {
+            GLTRACE(glDisable(GL_STENCIL_TEST));
+        }
+        m_stencil_enabled = enabled;
+    }
+
+    if (enabled && m_stencil_depth != depth) {
+        GLTRACE(glStencilFunc(GL_EQUAL, depth, 0xff));
+        m_stencil_depth = depth;
+    }
+
+    if (m_stencil_op != op) {
+        if (m_stencil_op == -1 || (m_stencil_op == GL_KEEP) != (op == GL_KEEP)) {
+            GLboolean write = op == GL_KEEP ? GL_TRUE : GL_FALSE;
+            GLTRACE(glColorMask(write, write, write, write));
+        }
+        GLTRACE(glStencilOp(GL_KEEP, GL_KEEP, op));
+        m_stencil_op = op;
+    }
+}
+
+/**
+ * @name	gl_state_stencil_test
+ * @brief	limits drawing to where the stencil buffer holds the given
+ *			depth, with color writes on
+ * @param	depth - (int) stencil value to draw on, 0 disables the test
+ * @retval	NONE
+ */
+void gl_state_stencil_test(int depth) {
+    set_stencil(depth, GL_KEEP);
+}
+
+/**
+ * @name	gl_state_stencil_write
+ * @brief	turns color writes off and applies the given op to the stencil
+ *			buffer wherever a draw covers the given depth
+ * @param	depth - (int) stencil value the draw applies to
+ * @param	op - (int) GL_INCR or GL_DECR
+ * @retval	NONE
+ */
+void gl_state_stencil_write(int depth, int op) {
+    set_stencil(depth, op);
+}
+
+/**
+ * @name	gl_state_bind_framebuffer
+ * @brief	binds the given framebuffer
+ * @param	name - (int) gl framebuffer id
+ * @retval	bool - true if it wasn't bound already
+ */
+bool gl_state_bind_framebuffer(int name) {
+    if (m_framebuffer == name) {
+        return false;
+    }
+
+    GLTRACE(glBindFramebuffer(GL_FRAMEBUFFER, name));
+    m_framebuffer = name;
+    return true;
+}
+
+/**
+ * @name	gl_state_framebuffer_texture_matches
+ * @brief	checks whether the given texture is already attached to the
+ *			offscreen framebuffer
+ * @param	name - (int) gl texture id
+ * @retval	bool - true if it is attached
+ */
+bool gl_state_framebuffer_texture_matches(int name) {
+    return m_framebuffer_texture == name;
+}
+
+/**
+ * @name	gl_state_framebuffer_texture
+ * @brief	attaches the given texture as the bound framebuffer's color
+ *			buffer, the offscreen framebuffer must be bound
+ * @param	name - (int) gl texture id
+ * @retval	NONE
+ */
+void gl_state_framebuffer_texture(int name) {
+    if (m_framebuffer_texture != name) {
+        GLTRACE(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, name, 0));
+        m_framebuffer_texture = name;
+    }
+}
+
+/**
+ * @name	gl_state_viewport
+ * @brief	sets the viewport
+ * @param	x, y, width, height - (int) viewport box
+ * @retval	NONE
+ */
+void gl_state_viewport(int x, int y, int width, int height) {
+    if (m_viewport[0] != x || m_viewport[1] != y || m_viewport[2] != width || m_viewport[3] != height) {
+        GLTRACE(glViewport(x, y, width, height));
+        m_viewport[0] = x;
+        m_viewport[1] = y;
+        m_viewport[2] = width;
+        m_viewport[3] = height;
+    }
+}
@@ -0,0 +1,54 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+ 
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+ 
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include "core/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GL_STATE_MAX_TEXTURE_UNITS 16
+
+// Shadow copy of the GL state the renderer changes most often, so repeated
+// binds / program switches / blend funcs / scissors / stencil tests /
+// framebuffers / viewports never reach the driver. Anything
+// that changes this state behind our back (platform code, a new context)
+// must call gl_state_reset.
+void gl_state_reset();
+void gl_state_bind_texture(unsigned int unit, int name);
+void gl_state_texture_deleted(int name);
+void gl_state_use_program(int program);
+void gl_state_blend_func(int sfactor, int dfactor);
+void gl_state_disable_blend();
+bool gl_state_scissor_matches(bool enabled, int x, int y, int width, int height);
+void gl_state_scissor(bool enabled, int x, int y, int width, int height);
+// draws only where the stencil buffer holds depth, 0 turns the test off
+void gl_state_stencil_test(int depth);
+// turns color writes off and applies op to the stencil where it holds depth
+void gl_state_stencil_write(int depth, int op);
+// returns true when the binding actually changed
+bool gl_state_bind_framebuffer(int name);
+bool gl_state_framebuffer_texture_matches(int name);
+void gl_state_framebuffer_texture(int name);
+void gl_state_viewport(int x, int y, int width, int height);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GL_STATE_H
@@ -0,0 +1,218 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 gl_trace.c
+ * @brief	counts and checks the gl calls GLTRACE wraps
+ */
+#include "core/gl_trace.h"
+#include "core/log.h"
+#include "core/deps/jansson/jansson.h"
+#include "platform/gl.h"
+#include <string.h>
+
+// without tracing, what a missed error costs is a few frames of delay
+#define DEFAULT_ERROR_CHECK_FRAMES 30
+
+// entry points that change state or upload data, checked by
+// GL_TRACE_VALIDATE_STATE
+static const char *m_state_prefixes[] = {
+    "glBind", "glEnable", "glDisable", "glBlend", "glUseProgram", "glViewport",
+    "glScissor", "glColorMask", "glPixelStore", "glActiveTexture", "glTexParameter",
+    "glTexImage", "glTexSubImage", "glCompressedTex", "glFramebuffer", "glRenderbuffer",
+    "glBufferData", "glBufferSubData", "glVertexAttribPointer", "glUniform"
+};
+
+#ifdef ENABLE_GLTRACE
+// a tracing build checks every call until told otherwise
+static int m_mode = GL_TRACE_VALIDATE;
+static unsigned int m_sample_frames = 1;
+static bool m_validating = true;
+#else
+static int m_mode = GL_TRACE_OFF;
+static unsigned int m_sample_frames = 60;
+static bool m_validating = false;
+#endif
+static unsigned int m_frame = 0;
+static unsigned int m_error_check_frames = DEFAULT_ERROR_CHECK_FRAMES;
+static unsigned int m_frames_since_check = 0;
+static gl_trace_site *m_sites = NULL;
+
+/**
+ * @name	register_site
+ * @brief	names a call site after the entry point its command calls and
+ *			adds it to the sites reported
+ * @param	site - (gl_trace_site *) site calling for the first time
+ * @retval	NONE
+ */
+static void register_site(gl_trace_site *site) {
+    // the command may assign the result, the entry point is the call
+    const char *call = strchr(site->cmd, '(');
+    if (!call) {
+        call = site->cmd + strlen(site->cmd);
+    }
+    const char *start = call;
+    while (start > site->cmd && (start[-1] == '_' || (start[-1] >= 'a' && start[-1] <= 'z') ||
+                                 (start[-1] >= 'A' && start[-1] <= 'Z') || (start[-1] >= '0' && start[-1] <= '9'))) {
+        start--;
+    }
+    size_t length = call - start;
+    if (length >= sizeof(site->name)) {
+        length = sizeof(site->name) - 1;
+    }
+    memcpy(site->name, start, length);
+    site->name[length] = '\0';
+
+    site->state_change = false;
+    for (size_t i = 0; i < sizeof(m_state_prefixes) / sizeof(m_state_prefixes[0]); i++) {
+        if (!strncmp(site->name, m_state_prefixes[i], strlen(m_state_prefixes[i]))) {
+            site->state_change = true;
+            break;
+        }
+    }
+
+    site->registered = true;
+    site->next = m_sites;
+    m_sites = site;
+}
+
+/**
+ * @name	gl_trace_call
+ * @brief	counts a traced call and checks it for errors on sampled frames
+ * @param	site - (gl_trace_site *) the GLTRACE use that made the call
+ * @retval	NONE
+ */
+void gl_trace_call(gl_trace_site *site) {
+    if (m_mode == GL_TRACE_OFF) {
+        return;
+    }
+    if (!site->registered) {
+        register_site(site);
+    }
+    site->calls++;
+
+    if (m_validating && (m_mode == GL_TRACE_VALIDATE || site->state_change)) {
+        GLenum error = glGetError();
+        if (error != GL_NO_ERROR) {
+            LOG("{gl} TRACE: Error %d at %s in %s", (int) error, site->cmd, site->where);
+        }
+    }
+}
+
+/**
+ * @name	gl_trace_set_mode
+ * @brief	sets what traced calls do
+ * @param	mode - (int) one of gl_trace_modes
+ * @param	sample_frames - (unsigned int) validate one frame in this many,
+ *			0 keeps the last value
+ * @retval	NONE
+ */
+CEXPORT void gl_trace_set_mode(int mode, unsigned int sample_frames) {
+#ifndef ENABLE_GLTRACE
+    if (mode != GL_TRACE_OFF) {
+        LOG("{gl} WARNING: Built without ENABLE_GLTRACE, there are no calls to trace");
+    }
+#endif
+    m_mode = mode;
+    if (sample_frames) {
+        m_sample_frames = sample_frames;
+    }
+    m_frame = 0;
+    m_validating = mode >= GL_TRACE_VALIDATE;
+    if (m_validating) {
+        // errors from before tracing are not the traced calls'. A driver
+        // keeps one flag per error, so a few reads clear them all
+        for (int i = 0; i < 8 && glGetError() != GL_NO_ERROR; i++) {
+        }
+    }
+}
+
+/**
+ * @name	gl_trace_get_mode
+ * @brief	gets what traced calls do
+ * @retval	int - one of gl_trace_modes
+ */
+int gl_trace_get_mode() {
+    return m_mode;
+}
+
+/**
+ * @name	gl_trace_set_error_check_interval
+ * @brief	sets how often core_tick asks the driver for errors, each
+ *			glGetError may wait for the driver to catch up
+ * @param	frames - (unsigned int) frames between checks, at least 1
+ * @retval	NONE
+ */
+CEXPORT void gl_trace_set_error_check_interval(unsigned int frames) {
+    m_error_check_frames = frames ? frames : 1;
+}
+
+/**
+ * @name	gl_trace_error_check_due
+ * @brief	counts a frame towards the next error check
+ * @retval	bool - true if this frame should check
+ */
+bool gl_trace_error_check_due() {
+    if (++m_frames_since_check < m_error_check_frames) {
+        return false;
+    }
+    m_frames_since_check = 0;
+    return true;
+}
+
+/**
+ * @name	gl_trace_end_frame
+ * @brief	keeps the frame's counts for the report and picks whether the
+ *			next frame validates
+ * @retval	NONE
+ */
+void gl_trace_end_frame() {
+    if (m_mode == GL_TRACE_OFF) {
+        return;
+    }
+    for (gl_trace_site *site = m_sites; site; site = site->next) {
+        site->last_calls = site->calls;
+        site->calls = 0;
+    }
+    m_validating = m_mode >= GL_TRACE_VALIDATE && ++m_frame % m_sample_frames == 0;
+}
+
+/**
+ * @name	gl_trace_report
+ * @brief	describes the last frame's traced calls by entry point, sites
+ *			calling the same entry point added together
+ * @retval	char* - the report, freed by the caller, or NULL
+ */
+CEXPORT char *gl_trace_report() {
+    json_t *report = json_object();
+    json_t *calls = json_object();
+    json_int_t total = 0;
+    for (gl_trace_site *site = m_sites; site; site = site->next) {
+        if (!site->last_calls) {
+            continue;
+        }
+        json_t *count = json_object_get(calls, site->name);
+        json_int_t sum = (count ? json_integer_value(count) : 0) + site->last_calls;
+        json_object_set_new(calls, site->name, json_integer(sum));
+        total += site->last_calls;
+    }
+    json_object_set_new(report, "mode", json_integer(m_mode));
+    json_object_set_new(report, "total", json_integer(total));
+    json_object_set_new(report, "calls", calls);
+
+    char *str = json_dumps(report, JSON_COMPACT | JSON_SORT_KEYS);
+    json_decref(report);
+    return str;
+}
@@ -0,0 +1,78 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef GL_TRACE_H
+#define GL_TRACE_H
+
+#include "core/types.h"
+#include "core/util/detect.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// GLTRACE in platform/gl.h wraps the engine's gl calls. Built without
+// ENABLE_GLTRACE it is the bare call and the modes below have nothing to
+// count. Built with it, each call site registers itself on its first call,
+// and the mode decides what the call costs:
+// - GL_TRACE_OFF does nothing more
+// - GL_TRACE_COUNT counts calls per entry point, reported for the last frame
+// - GL_TRACE_VALIDATE also checks glGetError after every call, on one frame
+//   in sample_frames so the driver isn't synced every frame
+// - GL_TRACE_VALIDATE_STATE checks the same way after calls that change
+//   state or upload data only
+// A tracing build starts validating every call on every frame.
+// Apart from the traced calls, core_tick checks for gl errors once every few
+// frames, see gl_trace_set_error_check_interval. GL thread only.
+
+enum gl_trace_modes {
+	GL_TRACE_OFF,
+	GL_TRACE_COUNT,
+	GL_TRACE_VALIDATE,
+	GL_TRACE_VALIDATE_STATE
+};
+
+// one per GLTRACE use, static and zeroed but for cmd and where
+typedef struct gl_trace_site_t {
+	const char *cmd;
+	const char *where;
+	bool registered;
+	bool state_change;
+	char name[48];                // the entry point, from cmd
+	unsigned int calls;           // this frame
+	unsigned int last_calls;      // last frame
+	struct gl_trace_site_t *next;
+} gl_trace_site;
+
+// called by GLTRACE after the command
+void gl_trace_call(gl_trace_site *site);
+
+// sample_frames is how often GL_TRACE_VALIDATE checks, 1 for every frame
+CEXPORT void gl_trace_set_mode(int mode, unsigned int sample_frames);
+int gl_trace_get_mode();
+// frames between core_tick's error checks, 1 for every frame
+CEXPORT void gl_trace_set_error_check_interval(unsigned int frames);
+// counts the frame towards the next error check, true when it is due
+bool gl_trace_error_check_due();
+// called by core_tick at the end of the frame
+void gl_trace_end_frame();
+// the last frame's calls by entry point as JSON, with the total. Caller frees
+CEXPORT char *gl_trace_report();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GL_TRACE_H
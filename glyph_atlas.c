@@ -0,0 +1,532 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 glyph_atlas.c
+ * @brief	caches single glyphs from text_manager on canvas pages and lays
+ *			lines of text out from them, either as drawn or as distance
+ *			fields that scale to any size
+ */
+#include "core/glyph_atlas.h"
+#include "core/tealeaf_canvas.h"
+#include "core/texture_manager.h"
+#include "core/draw_textures.h"
+#include "core/graphics_utils.h"
+#include "core/gl_state.h"
+#include "core/log.h"
+#include "core/deps/uthash/uthash.h"
+#include "platform/text_manager.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GLYPH_PAGE_SIZE 512
+#define GLYPH_MAX_PAGES 4
+#define GLYPH_PADDING 1
+#define GLYPH_FONT_NAME_LENGTH 64
+// distance field glyphs are rasterized once at this size and scaled
+#define GLYPH_SDF_SIZE 48
+// how far from the edge, in reference pixels, distances are kept
+#define GLYPH_SDF_SPREAD 6
+
+// everything text_manager rasterizes a glyph from. Keys are compared as
+// bytes, so they are zeroed before being filled in
+typedef struct glyph_key_t {
+    char font_name[GLYPH_FONT_NAME_LENGTH];
+    char glyph[8]; // one utf-8 sequence
+    int size;
+    int text_style;
+    float stroke_width;
+    rgba color;
+} glyph_key;
+
+typedef struct glyph_t {
+    glyph_key key;
+    int page; // -1 for glyphs that draw nothing, such as spaces
+    rect_2d rect; // on the page
+    float advance;
+    UT_hash_handle hh;
+} glyph;
+
+// glyphs are packed on shelves, left to right and top to bottom
+typedef struct glyph_page_t {
+    context_2d *ctx;
+    int shelf_x;
+    int shelf_y;
+    int shelf_height;
+} glyph_page;
+
+// a set of glyphs and the pages they are on
+typedef struct glyph_set_t {
+    glyph *glyphs;
+    glyph_page pages[GLYPH_MAX_PAGES];
+    int page_count;
+    unsigned int generation; // changes whenever the set starts over
+} glyph_set;
+
+static glyph_set m_bitmap = {NULL, {{0}}, 0, 0};
+static glyph_set m_sdf = {NULL, {{0}}, 0, 0};
+
+static void clear_set(glyph_set *set) {
+    glyph *g, *tmp;
+    HASH_ITER(hh, set->glyphs, g, tmp) {
+        HASH_DEL(set->glyphs, g);
+        free(g);
+    }
+
+    for (int i = 0; i < set->page_count; i++) {
+        context_2d_release_scratch(set->pages[i].ctx);
+    }
+    set->page_count = 0;
+    set->generation++;
+}
+
+void glyph_atlas_clear() {
+    clear_set(&m_bitmap);
+    clear_set(&m_sdf);
+}
+
+long glyph_atlas_bytes() {
+    return (long) (m_bitmap.page_count + m_sdf.page_count) * GLYPH_PAGE_SIZE * GLYPH_PAGE_SIZE * 4;
+}
+
+/**
+ * @name	place_glyph
+ * @brief	finds room for a glyph on the last page, or a new one
+ * @param	set - (glyph_set *) set the glyph is added to
+ * @param	width - (int) glyph width, padding included
+ * @param	height - (int) glyph height, padding included
+ * @param	x - (int *) out, left of the room
+ * @param	y - (int *) out, top of the room
+ * @retval	int - page index, or -1 if every page is full
+ */
+static int place_glyph(glyph_set *set, int width, int height, int *x, int *y) {
+    glyph_page *page = set->page_count ? &set->pages[set->page_count - 1] : NULL;
+    if (page && page->shelf_x + width > GLYPH_PAGE_SIZE) {
+        page->shelf_y += page->shelf_height;
+        page->shelf_x = 0;
+        page->shelf_height = 0;
+    }
+
+    if (!page || page->shelf_y + height > GLYPH_PAGE_SIZE) {
+        if (set->page_count == GLYPH_MAX_PAGES) {
+            return -1;
+        }
+
+        context_2d *ctx = context_2d_acquire_scratch(tealeaf_canvas_get(), GLYPH_PAGE_SIZE, GLYPH_PAGE_SIZE);
+        if (!ctx) {
+            return -1;
+        }
+        page = &set->pages[set->page_count++];
+        page->ctx = ctx;
+        page->shelf_x = 0;
+        page->shelf_y = 0;
+        page->shelf_height = 0;
+    }
+
+    *x = page->shelf_x;
+    *y = page->shelf_y;
+    page->shelf_x += width;
+    if (height > page->shelf_height) {
+        page->shelf_height = height;
+    }
+    return (int) (page - set->pages);
+}
+
+/**
+ * @name	build_distance_field
+ * @brief	turns a glyph's coverage into distances to its edge, brute force
+ *			over the spread around each pixel; glyphs are built once
+ * @param	pixels - (unsigned char *) in / out, rgba rows of the glyph and
+ *			its spread. alpha is replaced by 0.5 plus the signed distance
+ *			over twice the spread, color by white
+ * @param	width - (int) width in pixels
+ * @param	height - (int) height in pixels
+ * @retval	bool - false if there was no memory for the coverage
+ */
+static bool build_distance_field(unsigned char *pixels, int width, int height) {
+    unsigned char *inside = (unsigned char *) malloc(width * height);
+    if (!inside) {
+        LOG("{glyphs} WARNING: Unable to allocate a %ix%i distance field", width, height);
+        return false;
+    }
+    for (int i = 0; i < width * height; i++) {
+        inside[i] = pixels[i * 4 + 3] >= 128;
+    }
+
+    const int spread = GLYPH_SDF_SPREAD;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            unsigned char in = inside[y * width + x];
+            int best = spread * spread * 2;
+            for (int dy = -spread; dy <= spread; dy++) {
+                int sy = y + dy;
+                for (int dx = -spread; dx <= spread; dx++) {
+                    int sx = x + dx;
+                    // outside the rect counts as outside the glyph
+                    unsigned char other = sx >= 0 && sy >= 0 && sx < width && sy < height ? inside[sy * width + sx] : 0;
+                    int d = dx * dx + dy * dy;
+                    if (other != in && d < best) {
+                        best = d;
+                    }
+                }
+            }
+
+            // the edge is half way between this pixel and the nearest
+            // one on its other side
+            float distance = sqrtf((float) best) - 0.5f;
+            float value = 0.5f + (in ? distance : -distance) / (2 * spread);
+            unsigned char *p = pixels + (y * width + x) * 4;
+            p[0] = p[1] = p[2] = 255;
+            p[3] = value <= 0 ? 0 : value >= 1 ? 255 : (unsigned char) (value * 255 + 0.5f);
+        }
+    }
+
+    free(inside);
+    return true;
+}
+
+/**
+ * @name	copy_sdf_glyph
+ * @brief	draws a glyph into a scratch layer, reads it back and uploads
+ *			its distance field onto a page
+ * @param	tex - (texture_2d *) glyph from text_manager
+ * @param	page - (texture_2d *) page texture
+ * @param	dest - (const rect_2d *) glyph and spread on the page
+ * @retval	bool - false if the glyph couldn't be copied
+ */
+static bool copy_sdf_glyph(texture_2d *tex, texture_2d *page, const rect_2d *dest) {
+    int width = (int) dest->width;
+    int height = (int) dest->height;
+    context_2d *scratch = context_2d_acquire_scratch(tealeaf_canvas_get(), width, height);
+    unsigned char *pixels = (unsigned char *) malloc(width * height * 4);
+    bool copied = false;
+    if (scratch && pixels) {
+        rect_2d src = {0, 0, (float) tex->originalWidth, (float) tex->originalHeight};
+        rect_2d at = {GLYPH_SDF_SPREAD, GLYPH_SDF_SPREAD, src.width, src.height};
+        context_2d_fillText(scratch, tex, &src, &at, 1);
+        draw_textures_flush();
+        // offscreen rows are stored top down, as they are sampled
+        GLTRACE(glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels));
+
+        if (build_distance_field(pixels, width, height)) {
+            gl_state_bind_texture(0, page->name);
+            GLTRACE(glTexSubImage2D(GL_TEXTURE_2D, 0, (int) dest->x, (int) dest->y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels));
+            copied = true;
+        }
+    }
+
+    free(pixels);
+    if (scratch) {
+        context_2d_release_scratch(scratch);
+    }
+    return copied;
+}
+
+/**
+ * @name	rasterize_glyph
+ * @brief	has text_manager draw one glyph and copies it onto a page. when
+ *			every page is full the set starts over, which is safe mid
+ *			string: binding a page flushes the quads already queued
+ * @param	set - (glyph_set *) set to add the glyph to
+ * @param	key - (const glyph_key *) glyph to draw
+ * @param	sdf - (bool) store the glyph as a distance field
+ * @retval	glyph* - the cached glyph, or NULL if it can't be cached
+ */
+static glyph *rasterize_glyph(glyph_set *set, const glyph_key *key, bool sdf) {
+    rgba color = key->color;
+    texture_2d *tex = text_manager_get_text(key->font_name, key->size, key->glyph, &color, 0, key->text_style, key->stroke_width);
+    if (tex && !tex->loaded) {
+        return NULL;
+    }
+
+    glyph *g = (glyph *) malloc(sizeof(glyph));
+    if (!g) {
+        LOG("{glyphs} WARNING: Unable to allocate a glyph");
+        return NULL;
+    }
+    g->key = *key;
+    g->page = -1;
+    g->advance = (float) text_manager_measure_text(key->font_name, key->size, key->glyph);
+
+    int margin = sdf ? GLYPH_SDF_SPREAD * 2 : 0;
+    int width = tex ? tex->originalWidth + margin : 0;
+    int height = tex ? tex->originalHeight + margin : 0;
+    if (width > margin && height > margin) {
+        if (width + GLYPH_PADDING > GLYPH_PAGE_SIZE || height + GLYPH_PADDING > GLYPH_PAGE_SIZE) {
+            free(g);
+            return NULL;
+        }
+
+        int x, y;
+        int page = place_glyph(set, width + GLYPH_PADDING, height + GLYPH_PADDING, &x, &y);
+        if (page < 0) {
+            clear_set(set);
+            page = place_glyph(set, width + GLYPH_PADDING, height + GLYPH_PADDING, &x, &y);
+        }
+        if (page < 0) {
+            free(g);
+            return NULL;
+        }
+
+        rect_2d dest = {(float) x, (float) y, (float) width, (float) height};
+        if (sdf) {
+            texture_2d *page_tex = texture_manager_get_texture(texture_manager_get(), set->pages[page].ctx->url);
+            if (!page_tex || !copy_sdf_glyph(tex, page_tex, &dest)) {
+                free(g);
+                return NULL;
+            }
+        } else {
+            rect_2d src = {0, 0, (float) width, (float) height};
+            context_2d_fillText(set->pages[page].ctx, tex, &src, &dest, 1);
+        }
+        g->page = page;
+        g->rect = dest;
+    }
+
+    HASH_ADD(hh, set->glyphs, key, sizeof(glyph_key), g);
+    return g;
+}
+
+// length of the utf-8 sequence starting with byte c
+static int sequence_length(unsigned char c) {
+    if (c >= 0xf0) {
+        return 4;
+    } else if (c >= 0xe0) {
+        return 3;
+    } else if (c >= 0xc0) {
+        return 2;
+    }
+    return 1;
+}
+
+/**
+ * @name	next_glyph
+ * @brief	finds or rasterizes the glyph text starts with
+ * @param	set - (glyph_set *) set to look the glyph up in
+ * @param	key - (glyph_key *) key with everything but the glyph filled in
+ * @param	text - (const char **) in / out, moved past the glyph
+ * @retval	glyph* - the glyph, or NULL if it can't be cached
+ */
+static glyph *next_glyph(glyph_set *set, glyph_key *key, const char **text) {
+    int length = sequence_length((unsigned char) **text);
+    memset(key->glyph, 0, sizeof(key->glyph));
+    for (int i = 0; i < length && (*text)[i]; i++) {
+        key->glyph[i] = (*text)[i];
+    }
+    *text += strlen(key->glyph);
+
+    glyph *g;
+    HASH_FIND(hh, set->glyphs, key, sizeof(glyph_key), g);
+    return g ? g : rasterize_glyph(set, key, set == &m_sdf);
+}
+
+static bool make_key(glyph_key *key, const char *font_name, int size, rgba *color, int text_style, float stroke_width) {
+    if (strlen(font_name) >= GLYPH_FONT_NAME_LENGTH) {
+        return false;
+    }
+
+    memset(key, 0, sizeof(glyph_key));
+    strcpy(key->font_name, font_name);
+    key->size = size;
+    key->text_style = text_style;
+    key->stroke_width = text_style == TEXT_STYLE_STROKE ? stroke_width : 0;
+    key->color = *color;
+    return true;
+}
+
+/**
+ * @name	measure_set
+ * @brief	adds up the advances of the text's glyphs in a set, caching any
+ *			that are missing
+ * @param	set - (glyph_set *) set to measure with
+ * @param	key - (glyph_key *) key with everything but the glyph filled in
+ * @param	text - (const char *) utf-8 text
+ * @retval	float - width of the text, or -1 if a glyph can't be cached
+ */
+static float measure_set(glyph_set *set, glyph_key *key, const char *text) {
+    float width = 0;
+    unsigned int resets = 0;
+    const char *start = text;
+    while (*text) {
+        unsigned int generation = set->generation;
+        glyph *g = next_glyph(set, key, &text);
+        if (!g) {
+            return -1;
+        }
+
+        // the atlas started over, glyphs measured so far may be gone
+        if (set->generation != generation) {
+            if (++resets > 1) {
+                LOG("{glyphs} WARNING: Text doesn't fit in the glyph atlas");
+                return -1;
+            }
+            width = 0;
+            text = start;
+            continue;
+        }
+        width += g->advance;
+    }
+    return width;
+}
+
+/**
+ * @name	glyph_atlas_fill_text
+ * @brief	draws a line of text glyph by glyph, advancing by each glyph's
+ *			measured width
+ * @param	ctx - (context_2d *) context to draw to
+ * @param	font_name - (const char *) font, as given to text_manager
+ * @param	size - (int) font size
+ * @param	text - (const char *) utf-8 text
+ * @param	color - (rgba *) text color
+ * @param	text_style - (int) TEXT_STYLE_FILL or TEXT_STYLE_STROKE
+ * @param	stroke_width - (float) stroke width for TEXT_STYLE_STROKE
+ * @param	x - (float) left of the text
+ * @param	y - (float) top of the text
+ * @param	alpha - (float) alpha to draw with
+ * @retval	bool - false if nothing was drawn and the text should be drawn
+ *			from text_manager_get_text instead
+ */
+bool glyph_atlas_fill_text(context_2d *ctx, const char *font_name, int size, const char *text, rgba *color, int text_style, float stroke_width, float x, float y, float alpha) {
+    glyph_key key;
+    if (!make_key(&key, font_name, size, color, text_style, stroke_width)) {
+        return false;
+    }
+
+    // cache every glyph first, so a page reset can't happen half way through
+    float width = glyph_atlas_measure_text(font_name, size, text, color, text_style, stroke_width);
+    if (width < 0) {
+        return false;
+    }
+
+    texture_manager *manager = texture_manager_get();
+    texture_2d *pages[GLYPH_MAX_PAGES];
+    for (int i = 0; i < m_bitmap.page_count; i++) {
+        pages[i] = texture_manager_get_texture(manager, m_bitmap.pages[i].ctx->url);
+    }
+
+    float pen = x;
+    while (*text) {
+        glyph *g = next_glyph(&m_bitmap, &key, &text);
+        if (!g) {
+            return false;
+        }
+
+        if (g->page >= 0 && pages[g->page]) {
+            rect_2d dest = {pen, y, g->rect.width, g->rect.height};
+            context_2d_fillText(ctx, pages[g->page], &g->rect, &dest, alpha);
+        }
+        pen += g->advance;
+    }
+    return true;
+}
+
+/**
+ * @name	glyph_atlas_measure_text
+ * @brief	adds up the advances of the text's glyphs, caching any that are
+ *			missing
+ * @retval	float - width of the text, or -1 if a glyph can't be cached
+ */
+float glyph_atlas_measure_text(const char *font_name, int size, const char *text, rgba *color, int text_style, float stroke_width) {
+    glyph_key key;
+    if (!make_key(&key, font_name, size, color, text_style, stroke_width)) {
+        return -1;
+    }
+    return measure_set(&m_bitmap, &key, text);
+}
+
+/**
+ * @name	glyph_atlas_fill_text_sdf
+ * @brief	draws a line of text from distance field glyphs, which are
+ *			rasterized once at GLYPH_SDF_SIZE and scaled to size, so a font
+ *			costs the same pages at every size, color and outline
+ * @param	ctx - (context_2d *) context to draw to
+ * @param	font_name - (const char *) font, as given to text_manager
+ * @param	size - (int) font size to draw at
+ * @param	text - (const char *) utf-8 text
+ * @param	style - (const glyph_sdf_style *) colors, outline and shadow
+ * @param	x - (float) left of the text
+ * @param	y - (float) top of the text
+ * @param	alpha - (float) alpha to draw with
+ * @retval	bool - false if nothing was drawn and the text should be drawn
+ *			another way
+ */
+bool glyph_atlas_fill_text_sdf(context_2d *ctx, const char *font_name, int size, const char *text, const glyph_sdf_style *style, float x, float y, float alpha) {
+    glyph_key key;
+    rgba white = {1, 1, 1, 1};
+    if (!make_key(&key, font_name, GLYPH_SDF_SIZE, &white, TEXT_STYLE_FILL, 0)) {
+        return false;
+    }
+
+    // cache every glyph first, so a page reset can't happen half way through
+    if (measure_set(&m_sdf, &key, text) < 0) {
+        return false;
+    }
+
+    texture_manager *manager = texture_manager_get();
+    texture_2d *pages[GLYPH_MAX_PAGES];
+    for (int i = 0; i < m_sdf.page_count; i++) {
+        pages[i] = texture_manager_get_texture(manager, m_sdf.pages[i].ctx->url);
+    }
+
+    // outlines are given in pixels at size, distances are in spreads of
+    // reference pixels
+    float scale = (float) size / GLYPH_SDF_SIZE;
+    float outline_width = style->outline_width / scale / (2 * GLYPH_SDF_SPREAD);
+    if (outline_width < 0) {
+        outline_width = 0;
+    } else if (outline_width > 0.5f) {
+        outline_width = 0.5f;
+    }
+
+    // the shadow is the outlined text again, offset and in one color
+    bool shadow = style->shadow_color.a > 0 && (style->shadow_x || style->shadow_y);
+    for (int pass = shadow ? 0 : 1; pass < 2; pass++) {
+        const rgba *fill = pass ? &style->color : &style->shadow_color;
+        const rgba *outline = pass ? &style->outline_color : &style->shadow_color;
+        float pen = pass ? x : x + style->shadow_x;
+        float top = (pass ? y : y + style->shadow_y) - GLYPH_SDF_SPREAD * scale;
+        const char *p = text;
+        while (*p) {
+            glyph *g = next_glyph(&m_sdf, &key, &p);
+            if (!g) {
+                return false;
+            }
+
+            if (g->page >= 0 && pages[g->page]) {
+                rect_2d dest = {pen - GLYPH_SDF_SPREAD * scale, top, g->rect.width * scale, g->rect.height * scale};
+                context_2d_fillTextSDF(ctx, pages[g->page], &g->rect, &dest, fill, outline, outline_width, alpha);
+            }
+            pen += g->advance * scale;
+        }
+    }
+    return true;
+}
+
+/**
+ * @name	glyph_atlas_measure_text_sdf
+ * @brief	width glyph_atlas_fill_text_sdf would draw the text at
+ * @retval	float - width of the text, or -1 if a glyph can't be cached
+ */
+float glyph_atlas_measure_text_sdf(const char *font_name, int size, const char *text) {
+    glyph_key key;
+    rgba white = {1, 1, 1, 1};
+    if (!make_key(&key, font_name, GLYPH_SDF_SIZE, &white, TEXT_STYLE_FILL, 0)) {
+        return -1;
+    }
+
+    float width = measure_set(&m_sdf, &key, text);
+    return width < 0 ? -1 : width * size / GLYPH_SDF_SIZE;
+}
@@ -0,0 +1,61 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef GLYPH_ATLAS_H
+#define GLYPH_ATLAS_H
+
+#include "core/types.h"
+#include "core/rgba.h"
+#include "core/tealeaf_context.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Draws a line of text from glyphs rasterized once through text_manager and
+// kept on shared canvas pages, so strings that change every frame, such as
+// counters, cost quads instead of a rasterization and an upload. Returns
+// false when the text can't be drawn this way, e.g. a glyph is larger than a
+// page, and text_manager_get_text should be used instead
+bool glyph_atlas_fill_text(context_2d *ctx, const char *font_name, int size, const char *text, rgba *color, int text_style, float stroke_width, float x, float y, float alpha);
+// width glyph_atlas_fill_text would draw the text at, or -1 if it can't
+float glyph_atlas_measure_text(const char *font_name, int size, const char *text, rgba *color, int text_style, float stroke_width);
+
+// how glyph_atlas_fill_text_sdf draws text. Outline and shadow are shader
+// parameters, so changing them costs nothing
+typedef struct glyph_sdf_style_t {
+	rgba color;
+	rgba outline_color; // drawn with the text's alpha
+	float outline_width; // in pixels at the drawn size, 0 for none
+	rgba shadow_color;
+	float shadow_x; // shadow offset, no shadow when both are 0
+	float shadow_y;
+} glyph_sdf_style;
+
+// Draws a line of text from distance field glyphs, rasterized once per font
+// and scaled to any size with sharp edges. Returns false when the text can't
+// be drawn this way
+bool glyph_atlas_fill_text_sdf(context_2d *ctx, const char *font_name, int size, const char *text, const glyph_sdf_style *style, float x, float y, float alpha);
+float glyph_atlas_measure_text_sdf(const char *font_name, int size, const char *text);
+// frees every page, glyphs are rasterized again as they are drawn
+void glyph_atlas_clear();
+// bytes of the pages glyph_atlas_clear would free
+long glyph_atlas_bytes();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,218 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 gpu_timing.c
+ * @brief	times the gpu side of frames without waiting on it
+ */
+#include "core/gpu_timing.h"
+#include "core/frame_timing.h"
+#include "core/tealeaf_canvas.h"
+#include "core/tealeaf_context.h"
+#include "core/log.h"
+#include "platform/gl.h"
+#include <string.h>
+
+#if defined(GL_ES) && defined(GL_EXT_disjoint_timer_query)
+#define GPU_TIMER_QUERIES
+#endif
+
+// frames whose queries may still be in flight, and segments timed a frame
+#define MAX_PENDING_FRAMES 4
+#define MAX_SEGMENTS 32
+
+typedef struct timed_frame_t {
+    bool pending;
+    bool overflowed; // ran out of segments, so the total would be short
+    unsigned int frame;
+    int count;
+    unsigned int queries[MAX_SEGMENTS];
+    bool on_screen[MAX_SEGMENTS];
+} timed_frame;
+
+static bool m_supported = false;
+static bool m_enabled = false;
+static timed_frame m_frames[MAX_PENDING_FRAMES];
+// the frame being timed, NULL between frames or when every slot is pending
+static timed_frame *m_current = NULL;
+static bool m_segment_open = false;
+
+/**
+ * @name	gpu_timing_init
+ * @brief	checks the new context for timer queries and makes the query
+ *			objects, forgetting those of any old context
+ * @retval	NONE
+ */
+void gpu_timing_init() {
+    memset(m_frames, 0, sizeof(m_frames));
+    m_current = NULL;
+    m_segment_open = false;
+    m_supported = false;
+
+#ifdef GPU_TIMER_QUERIES
+    const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+    m_supported = extensions && strstr(extensions, "GL_EXT_disjoint_timer_query");
+    if (m_supported) {
+        for (int i = 0; i < MAX_PENDING_FRAMES; i++) {
+            GLTRACE(glGenQueriesEXT(MAX_SEGMENTS, m_frames[i].queries));
+        }
+    }
+#endif
+    LOG("{gpu} Timer queries %s", m_supported ? "supported" : "unsupported");
+}
+
+/**
+ * @name	gpu_timing_enable
+ * @brief	starts or stops timing frames, taking effect on the next frame
+ * @param	enabled - (bool) true to time
+ * @retval	NONE
+ */
+CEXPORT void gpu_timing_enable(bool enabled) {
+    m_enabled = enabled;
+}
+
+CEXPORT bool gpu_timing_active() {
+    return m_enabled && m_supported;
+}
+
+static void begin_segment(bool on_screen) {
+#ifdef GPU_TIMER_QUERIES
+    if (m_current->count == MAX_SEGMENTS) {
+        m_current->overflowed = true;
+        return;
+    }
+    int i = m_current->count++;
+    m_current->on_screen[i] = on_screen;
+    GLTRACE(glBeginQueryEXT(GL_TIME_ELAPSED_EXT, m_current->queries[i]));
+    m_segment_open = true;
+#endif
+}
+
+static void end_segment() {
+#ifdef GPU_TIMER_QUERIES
+    if (m_segment_open) {
+        GLTRACE(glEndQueryEXT(GL_TIME_ELAPSED_EXT));
+        m_segment_open = false;
+    }
+#endif
+}
+
+/**
+ * @name	collect
+ * @brief	hands frame_timing the frames whose queries have all finished,
+ *			dropping every pending frame if the gpu timer was disjoint
+ * @retval	NONE
+ */
+static void collect() {
+#ifdef GPU_TIMER_QUERIES
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+
+    for (int i = 0; i < MAX_PENDING_FRAMES; i++) {
+        timed_frame *f = &m_frames[i];
+        if (!f->pending) {
+            continue;
+        }
+        if (disjoint) {
+            // a power or clock change made the results meaningless
+            f->pending = false;
+            continue;
+        }
+
+        // queries finish in order, so the last says whether all have
+        GLuint available = f->count ? 0 : 1;
+        if (f->count) {
+            glGetQueryObjectuivEXT(f->queries[f->count - 1], GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+        }
+        if (!available) {
+            continue;
+        }
+
+        double ms[2] = {0, 0};
+        for (int s = 0; s < f->count; s++) {
+            GLuint64 ns = 0;
+            glGetQueryObjectui64vEXT(f->queries[s], GL_QUERY_RESULT_EXT, &ns);
+            ms[f->on_screen[s] ? 0 : 1] += ns / 1000000.0;
+        }
+        if (!f->overflowed) {
+            frame_timing_gpu(f->frame, ms[0], ms[1]);
+        }
+        f->pending = false;
+    }
+#endif
+}
+
+/**
+ * @name	gpu_timing_begin_frame
+ * @brief	collects finished frames and starts timing a new one in a free
+ *			slot, skipping the frame if there is none
+ * @param	frame - (unsigned int) frame_timing's number for the frame
+ * @retval	NONE
+ */
+void gpu_timing_begin_frame(unsigned int frame) {
+    if (!m_supported) {
+        return;
+    }
+    collect();
+    m_current = NULL;
+    if (!m_enabled) {
+        return;
+    }
+
+    for (int i = 0; i < MAX_PENDING_FRAMES; i++) {
+        if (!m_frames[i].pending) {
+            m_current = &m_frames[i];
+            break;
+        }
+    }
+    if (!m_current) {
+        return;
+    }
+
+    m_current->frame = frame;
+    m_current->count = 0;
+    m_current->overflowed = false;
+    // whatever is bound carries on into this frame, the screen until told
+    tealeaf_canvas *canvas = tealeaf_canvas_get();
+    begin_segment(!canvas->active_ctx || canvas->active_ctx->on_screen);
+}
+
+/**
+ * @name	gpu_timing_segment
+ * @brief	starts a new segment for the newly bound context
+ * @param	on_screen - (bool) whether the context draws to the screen
+ * @retval	NONE
+ */
+void gpu_timing_segment(bool on_screen) {
+    if (!m_current) {
+        return;
+    }
+    end_segment();
+    begin_segment(on_screen);
+}
+
+/**
+ * @name	gpu_timing_end_frame
+ * @brief	ends the frame's last segment, leaving its queries to finish
+ * @retval	NONE
+ */
+void gpu_timing_end_frame() {
+    if (!m_current) {
+        return;
+    }
+    end_segment();
+    m_current->pending = true;
+    m_current = NULL;
+}
@@ -0,0 +1,49 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef GPU_TIMING_H
+#define GPU_TIMING_H
+
+#include "core/types.h"
+#include "core/util/detect.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Times the gpu work of each frame with EXT_disjoint_timer_query, where the
+// driver has it, and hands the result to frame_timing a few frames later,
+// once the queries are available, so reading them never stalls. Elapsed
+// time queries can't nest, so a frame is timed as a run of segments, a new
+// one each time the bound context changes, and split into what was drawn
+// on screen and into offscreen canvases. Off until enabled. GL thread only.
+
+// called by core_init_gl for each new context
+void gpu_timing_init();
+CEXPORT void gpu_timing_enable(bool enabled);
+// true once enabled on a driver that can time
+CEXPORT bool gpu_timing_active();
+
+// called by core_tick around the frame, frame is frame_timing's number
+void gpu_timing_begin_frame(unsigned int frame);
+void gpu_timing_end_frame();
+// called when another context is bound, after its draws were flushed
+void gpu_timing_segment(bool on_screen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GPU_TIMING_H
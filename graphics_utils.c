@@ -1,5 +1,6 @@
 #include "core/graphics_utils.h"
 #include "core/geometry.h"
+#include "core/gl_state.h"
 #include "log.h"
 #include <stdlib.h>
 
@@ -60,23 +61,13 @@ void apply_composite_operation(int composite_op) {
         break;
     }
 
-    glEnable(GL_BLEND);
-    glBlendFunc(sfactor, dfactor);
+    gl_state_blend_func(sfactor, dfactor);
 }
 
-//redraw read pixels
-//apply the blendfunc
-void set_up_full_compositing(context_2d *ctx, int x, int y, int width, int height, int composite_op) {
-    //clear the 4 rect's around the area
-    LOG("SETUP %i %i %i %i", x, y, ctx->width, height);
-    rect_2d top_rect = {0, 0, ctx->width, y};
-    rect_2d left_rect = {0, 0, x, ctx->height};
-    rect_2d bot_rect = {0, y + height, ctx->width, ctx->height - (y + height)};
-    rect_2d right_rect = {x + width, 0, ctx->width - (x + width), ctx->height};
-    context_2d_clearRect(ctx, &top_rect);
-    context_2d_clearRect(ctx, &left_rect);
-    context_2d_clearRect(ctx, &bot_rect);
-    context_2d_clearRect(ctx, &right_rect);
+//full canvas operations leave nothing outside what is drawn
+//the blendfunc takes care of the area inside it
+void set_up_full_compositing(context_2d *ctx, const rect_2d *bounds) {
+    context_2d_clear_outside(ctx, bounds);
 }
 
 bool is_full_canvas_composite_operation(int composite_op) {
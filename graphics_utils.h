@@ -6,7 +6,7 @@
 #include "core/texture_2d.h"
 
 void apply_composite_operation(int composite_op);
-void set_up_full_compositing(context_2d *ctx, int x, int y, int width, int height, int composite_op);
+void set_up_full_compositing(context_2d *ctx, const rect_2d *bounds);
 bool is_full_canvas_composite_operation(int composite_op);
 
 #endif
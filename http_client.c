@@ -0,0 +1,755 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 http_client.c
+ * @brief	shared native http engine over curl multi
+ */
+#include "core/http_client.h"
+#include "core/events.h"
+#include "core/log.h"
+#include "core/deps/jansson/jansson.h"
+#include "core/platform/threads.h"
+#include "curl/curl.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define MAX_ACTIVE_REQUESTS 16 /* requests on the multi handle at once, the rest wait */
+#define MAX_HOST_CONNECTIONS 6 /* connections curl may open to a single host */
+#define MAX_IDLE_HANDLES 8 /* easy handles kept for reuse */
+#define DEFAULT_TIMEOUT_MS 30000
+#define DNS_CACHE_TIME 300 /* seconds a resolved host is reused */
+#define KEEPALIVE_IDLE_TIME 30 /* seconds idle before the first keepalive probe */
+#define KEEPALIVE_INTERVAL 15 /* seconds between keepalive probes */
+
+// curl_multi_poll and curl_multi_wakeup arrived in libcurl 7.68
+#if LIBCURL_VERSION_NUM >= 0x074400
+#define HTTP_MULTI_POLL
+#endif
+
+typedef struct http_buffer_t {
+    char *bytes; // NUL terminated when not NULL
+    unsigned long size;
+    unsigned long capacity;
+} http_buffer;
+
+typedef struct http_request_t {
+    int id;
+    char *url;
+    char *method;
+    char *body;
+    unsigned long body_size;
+    struct curl_slist *headers;
+    long timeout_ms;
+    http_data_cb on_data;
+    http_done_cb on_done;
+    void *data;
+    CURL *handle;
+    http_buffer response_body;
+    http_buffer response_headers;
+    http_response response;
+    bool cancelled;
+    // http_client_get waits for finished on m_sync_cond rather than on_done
+    bool sync;
+    bool finished;
+    struct http_request_t *next;
+} http_request;
+
+// a list that is appended to at the tail and taken from the head
+typedef struct http_queue_t {
+    http_request *head;
+    http_request *tail;
+} http_queue;
+
+// m_lock guards the queues, the cancelled flags and m_running. Only the
+// http thread touches curl handles
+static pthread_mutex_t m_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t m_wake_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t m_sync_cond = PTHREAD_COND_INITIALIZER;
+static http_queue m_queued = {NULL, NULL};
+static http_queue m_active = {NULL, NULL};
+static http_queue m_finished = {NULL, NULL};
+static int m_active_count = 0;
+static bool m_cancel_pending = false;
+static bool m_running = false;
+static int m_next_id = 0;
+
+static ThreadsThread m_thread = THREADS_INVALID_THREAD;
+static CURLM *m_multi_handle = NULL;
+static CURLSH *m_share_handle = NULL;
+static CURL *m_idle_handles[MAX_IDLE_HANDLES];
+static int m_idle_count = 0;
+
+// the share is used from several threads, so curl locks each kind of data
+// it holds. Connections are left out, curl can not share them between
+// threads safely, each multi handle keeps its own
+static pthread_mutex_t m_share_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t m_share_locks[CURL_LOCK_DATA_LAST];
+static int m_share_refs = 0;
+
+static void queue_push(http_queue *queue, http_request *request) {
+    request->next = NULL;
+    if (queue->tail) {
+        queue->tail->next = request;
+    } else {
+        queue->head = request;
+    }
+    queue->tail = request;
+}
+
+static http_request *queue_pop(http_queue *queue) {
+    http_request *request = queue->head;
+    if (request) {
+        queue->head = request->next;
+        if (!queue->head) {
+            queue->tail = NULL;
+        }
+        request->next = NULL;
+    }
+    return request;
+}
+
+static void queue_remove(http_queue *queue, http_request *request) {
+    http_request *prev = NULL;
+    http_request *cur = queue->head;
+    while (cur && cur != request) {
+        prev = cur;
+        cur = cur->next;
+    }
+    if (!cur) {
+        return;
+    }
+
+    if (prev) {
+        prev->next = cur->next;
+    } else {
+        queue->head = cur->next;
+    }
+    if (queue->tail == cur) {
+        queue->tail = prev;
+    }
+    cur->next = NULL;
+}
+
+static bool buffer_append(http_buffer *buffer, const char *bytes, unsigned long size) {
+    if (buffer->size + size + 1 > buffer->capacity) {
+        unsigned long capacity = buffer->capacity ? buffer->capacity : 1024;
+        while (buffer->size + size + 1 > capacity) {
+            capacity *= 2;
+        }
+        char *grown = (char *) realloc(buffer->bytes, capacity);
+        if (!grown) {
+            return false;
+        }
+        buffer->bytes = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->bytes + buffer->size, bytes, size);
+    buffer->size += size;
+    buffer->bytes[buffer->size] = '\0';
+    return true;
+}
+
+static void free_request(http_request *request) {
+    free(request->url);
+    free(request->method);
+    free(request->body);
+    curl_slist_free_all(request->headers);
+    free(request->response_body.bytes);
+    free(request->response_headers.bytes);
+    free(request);
+}
+
+static void share_lock(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr) {
+    pthread_mutex_lock(&m_share_locks[data]);
+}
+
+static void share_unlock(CURL *handle, curl_lock_data data, void *userptr) {
+    pthread_mutex_unlock(&m_share_locks[data]);
+}
+
+/**
+ * @name	http_client_acquire_share
+ * @brief	hands out the share of resolved hosts and TLS sessions, making it
+ *			the first time
+ * @retval	void* - the CURLSH, or NULL if it could not be made
+ */
+void *http_client_acquire_share() {
+    pthread_mutex_lock(&m_share_mutex);
+    if (!m_share_handle) {
+        m_share_handle = curl_share_init();
+        if (m_share_handle) {
+            int i;
+            for (i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+                pthread_mutex_init(&m_share_locks[i], NULL);
+            }
+            curl_share_setopt(m_share_handle, CURLSHOPT_LOCKFUNC, share_lock);
+            curl_share_setopt(m_share_handle, CURLSHOPT_UNLOCKFUNC, share_unlock);
+            curl_share_setopt(m_share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+            curl_share_setopt(m_share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        }
+    }
+    if (m_share_handle) {
+        m_share_refs++;
+    }
+    void *share = m_share_handle;
+    pthread_mutex_unlock(&m_share_mutex);
+    return share;
+}
+
+/**
+ * @name	http_client_release_share
+ * @brief	frees the share once its last user, and their handles, are done
+ * @param	share - (void *) from http_client_acquire_share
+ * @retval	NONE
+ */
+void http_client_release_share(void *share) {
+    if (!share) {
+        return;
+    }
+
+    pthread_mutex_lock(&m_share_mutex);
+    if (--m_share_refs == 0) {
+        curl_share_cleanup(m_share_handle);
+        m_share_handle = NULL;
+        int i;
+        for (i = 0; i < CURL_LOCK_DATA_LAST; i++) {
+            pthread_mutex_destroy(&m_share_locks[i]);
+        }
+    }
+    pthread_mutex_unlock(&m_share_mutex);
+}
+
+static size_t write_body(char *ptr, size_t size, size_t nmemb, void *userdata) {
+    http_request *request = (http_request *) userdata;
+    size_t bytes = size * nmemb;
+    if (request->on_data) {
+        request->on_data(ptr, (unsigned long) bytes, request->data);
+    } else if (!buffer_append(&request->response_body, ptr, (unsigned long) bytes)) {
+        // curl fails the request when less than it wrote is taken
+        return 0;
+    }
+    return bytes;
+}
+
+static size_t write_header(char *ptr, size_t size, size_t nmemb, void *userdata) {
+    http_request *request = (http_request *) userdata;
+    size_t bytes = size * nmemb;
+    if (!buffer_append(&request->response_headers, ptr, (unsigned long) bytes)) {
+        return 0;
+    }
+    return bytes;
+}
+
+static CURL *take_handle() {
+    if (m_idle_count > 0) {
+        return m_idle_handles[--m_idle_count];
+    }
+    return curl_easy_init();
+}
+
+static void recycle_handle(CURL *handle) {
+    if (m_idle_count < MAX_IDLE_HANDLES) {
+        curl_easy_reset(handle);
+        m_idle_handles[m_idle_count++] = handle;
+    } else {
+        curl_easy_cleanup(handle);
+    }
+}
+
+/**
+ * @name	start_request
+ * @brief	sets up an easy handle for the request and adds it to the multi
+ *			handle, called on the http thread
+ * @param	request - (http_request *) request to start
+ * @retval	bool - false if it could not be started
+ */
+static bool start_request(http_request *request) {
+    CURL *handle = take_handle();
+    if (!handle) {
+        return false;
+    }
+
+    curl_easy_setopt(handle, CURLOPT_URL, request->url);
+    curl_easy_setopt(handle, CURLOPT_PRIVATE, request);
+    curl_easy_setopt(handle, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 1L);
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, write_body);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, request);
+    curl_easy_setopt(handle, CURLOPT_HEADERFUNCTION, write_header);
+    curl_easy_setopt(handle, CURLOPT_HEADERDATA, request);
+    curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(handle, CURLOPT_TIMEOUT_MS, request->timeout_ms);
+    if (request->headers) {
+        curl_easy_setopt(handle, CURLOPT_HTTPHEADER, request->headers);
+    }
+
+    const char *method = request->method ? request->method : "GET";
+    if (request->body) {
+        curl_easy_setopt(handle, CURLOPT_POSTFIELDS, request->body);
+        curl_easy_setopt(handle, CURLOPT_POSTFIELDSIZE, (long) request->body_size);
+        if (strcasecmp(method, "POST") != 0) {
+            curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, method);
+        }
+    } else if (strcasecmp(method, "HEAD") == 0) {
+        curl_easy_setopt(handle, CURLOPT_NOBODY, 1L);
+    } else if (strcasecmp(method, "GET") != 0) {
+        curl_easy_setopt(handle, CURLOPT_CUSTOMREQUEST, method);
+    }
+
+    // every encoding this libcurl can inflate, gzip and br among them
+    curl_easy_setopt(handle, CURLOPT_ACCEPT_ENCODING, "");
+#ifdef CURL_HTTP_VERSION_2TLS
+    curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+    // wait for a connection that can multiplex rather than open another
+    curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L);
+#endif
+
+    // curl_easy_reset drops the share, so hand it back every time
+    if (m_share_handle) {
+        curl_easy_setopt(handle, CURLOPT_SHARE, m_share_handle);
+    }
+    curl_easy_setopt(handle, CURLOPT_DNS_CACHE_TIMEOUT, (long) DNS_CACHE_TIME);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPIDLE, (long) KEEPALIVE_IDLE_TIME);
+    curl_easy_setopt(handle, CURLOPT_TCP_KEEPINTVL, (long) KEEPALIVE_INTERVAL);
+
+    if (curl_multi_add_handle(m_multi_handle, handle) != CURLM_OK) {
+        recycle_handle(handle);
+        return false;
+    }
+    request->handle = handle;
+    return true;
+}
+
+/**
+ * @name	finish_request
+ * @brief	fills in the response and hands the request to its waiter or to
+ *			the completions, called on the http thread with m_lock held
+ * @param	request - (http_request *) active or never started request
+ * @param	result - (CURLcode) how the transfer ended
+ * @retval	NONE
+ */
+static void finish_request(http_request *request, CURLcode result) {
+    http_response *response = &request->response;
+    response->id = request->id;
+    if (request->handle) {
+        curl_easy_getinfo(request->handle, CURLINFO_RESPONSE_CODE, &response->status);
+        curl_multi_remove_handle(m_multi_handle, request->handle);
+        recycle_handle(request->handle);
+        request->handle = NULL;
+        queue_remove(&m_active, request);
+        m_active_count--;
+    }
+    response->cancelled = request->cancelled;
+    response->failed = request->cancelled || result != CURLE_OK;
+    response->body = request->response_body.bytes;
+    response->size = request->response_body.size;
+    response->headers = request->response_headers.bytes;
+
+    if (request->sync) {
+        request->finished = true;
+        pthread_cond_broadcast(&m_sync_cond);
+    } else {
+        queue_push(&m_finished, request);
+    }
+}
+
+static void http_client_run(void *param) {
+    int still_running = 0;
+
+    pthread_mutex_lock(&m_lock);
+    while (m_running || m_queued.head || m_active.head) {
+        if (!m_running) {
+            http_request *request;
+            for (request = m_queued.head; request; request = request->next) {
+                request->cancelled = true;
+            }
+            for (request = m_active.head; request; request = request->next) {
+                request->cancelled = true;
+            }
+            m_cancel_pending = true;
+        }
+
+        if (m_cancel_pending) {
+            m_cancel_pending = false;
+            http_request *request = m_active.head;
+            while (request) {
+                http_request *next = request->next;
+                if (request->cancelled) {
+                    finish_request(request, CURLE_ABORTED_BY_CALLBACK);
+                }
+                request = next;
+            }
+        }
+
+        while (m_active_count < MAX_ACTIVE_REQUESTS && m_queued.head) {
+            http_request *request = queue_pop(&m_queued);
+            if (request->cancelled) {
+                finish_request(request, CURLE_ABORTED_BY_CALLBACK);
+            } else if (start_request(request)) {
+                queue_push(&m_active, request);
+                m_active_count++;
+            } else {
+                LOG("{http} WARNING: Unable to start a request for %s", request->url);
+                finish_request(request, CURLE_FAILED_INIT);
+            }
+        }
+
+        if (!m_active.head) {
+            if (m_running && !m_queued.head) {
+                pthread_cond_wait(&m_wake_cond, &m_lock);
+            }
+            continue;
+        }
+        pthread_mutex_unlock(&m_lock);
+
+        // the callbacks run in here, without m_lock
+        curl_multi_perform(m_multi_handle, &still_running);
+
+        pthread_mutex_lock(&m_lock);
+        CURLMsg *msg;
+        int msgs_left;
+        while ((msg = curl_multi_info_read(m_multi_handle, &msgs_left))) {
+            if (msg->msg == CURLMSG_DONE) {
+                http_request *request = NULL;
+                curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **) &request);
+                finish_request(request, msg->data.result);
+            }
+        }
+        if (!still_running || m_cancel_pending || !m_running || (m_queued.head && m_active_count < MAX_ACTIVE_REQUESTS)) {
+            continue;
+        }
+        pthread_mutex_unlock(&m_lock);
+
+#ifdef HTTP_MULTI_POLL
+        curl_multi_poll(m_multi_handle, NULL, 0, 1000, NULL);
+#else
+        // no wakeup before 7.68, so new requests wait for this at most
+        curl_multi_wait(m_multi_handle, NULL, 0, 100, NULL);
+#endif
+        pthread_mutex_lock(&m_lock);
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    while (m_idle_count > 0) {
+        curl_easy_cleanup(m_idle_handles[--m_idle_count]);
+    }
+}
+
+static void wake() {
+    pthread_cond_signal(&m_wake_cond);
+#ifdef HTTP_MULTI_POLL
+    curl_multi_wakeup(m_multi_handle);
+#endif
+}
+
+/**
+ * @name	http_client_init
+ * @brief	starts the http thread
+ * @retval	NONE
+ */
+void http_client_init() {
+    if (m_running) {
+        return;
+    }
+
+    curl_global_init(CURL_GLOBAL_ALL);
+    m_multi_handle = curl_multi_init();
+    if (!m_multi_handle) {
+        LOG("{http} WARNING: Unable to create the multi handle");
+        return;
+    }
+#ifdef CURLPIPE_MULTIPLEX
+    curl_multi_setopt(m_multi_handle, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+    curl_multi_setopt(m_multi_handle, CURLMOPT_MAX_HOST_CONNECTIONS, (long) MAX_HOST_CONNECTIONS);
+    http_client_acquire_share();
+
+    m_running = true;
+    m_thread = threads_create_thread_with_priority(http_client_run, NULL,
+                                                   THREADS_PRIORITY_UTILITY, THREADS_AFFINITY_EFFICIENCY);
+    if (m_thread == THREADS_INVALID_THREAD) {
+        LOG("{http} WARNING: Unable to start the http thread");
+        m_running = false;
+        http_client_release_share(m_share_handle);
+        curl_multi_cleanup(m_multi_handle);
+        m_multi_handle = NULL;
+    }
+}
+
+static http_request *make_request(const char *url, const http_options *options) {
+    http_request *request = (http_request *) calloc(1, sizeof(http_request));
+    if (!request) {
+        return NULL;
+    }
+
+    request->url = strdup(url);
+    request->timeout_ms = DEFAULT_TIMEOUT_MS;
+    bool ok = request->url != NULL;
+    if (options) {
+        if (options->method) {
+            request->method = strdup(options->method);
+            ok = ok && request->method;
+        }
+        if (options->body) {
+            request->body = (char *) malloc(options->body_size + 1);
+            ok = ok && request->body;
+            if (request->body) {
+                memcpy(request->body, options->body, options->body_size);
+                request->body[options->body_size] = '\0';
+                request->body_size = options->body_size;
+            }
+        }
+        int i;
+        for (i = 0; ok && i < options->header_count; i++) {
+            struct curl_slist *headers = curl_slist_append(request->headers, options->headers[i]);
+            ok = headers != NULL;
+            if (headers) {
+                request->headers = headers;
+            }
+        }
+        if (options->timeout_ms > 0) {
+            request->timeout_ms = options->timeout_ms;
+        }
+        request->on_data = options->on_data;
+        request->on_done = options->on_done;
+        request->data = options->data;
+    }
+
+    if (!ok) {
+        free_request(request);
+        return NULL;
+    }
+    return request;
+}
+
+/**
+ * @name	http_client_request
+ * @brief	queues a request for the http thread
+ * @param	url - (const char *) url to request
+ * @param	options - (const http_options *) method, body, headers and
+ *			callbacks, NULL for a plain GET
+ * @retval	int - id to cancel the request with, 0 if it was not queued
+ */
+int http_client_request(const char *url, const http_options *options) {
+    http_request *request = make_request(url, options);
+    if (!request) {
+        LOG("{http} WARNING: Unable to queue a request for %s", url);
+        return 0;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    if (!m_running) {
+        pthread_mutex_unlock(&m_lock);
+        free_request(request);
+        return 0;
+    }
+    request->id = ++m_next_id;
+    int id = request->id;
+    queue_push(&m_queued, request);
+    wake();
+    pthread_mutex_unlock(&m_lock);
+    return id;
+}
+
+/**
+ * @name	http_client_cancel
+ * @brief	stops a queued or running request
+ * @param	id - (int) id from http_client_request
+ * @retval	NONE
+ */
+void http_client_cancel(int id) {
+    pthread_mutex_lock(&m_lock);
+    http_request *request;
+    for (request = m_queued.head; request; request = request->next) {
+        if (request->id == id) {
+            // dropped when the http thread next starts requests
+            request->cancelled = true;
+            wake();
+            break;
+        }
+    }
+    for (request = m_active.head; request; request = request->next) {
+        if (request->id == id) {
+            request->cancelled = true;
+            m_cancel_pending = true;
+            wake();
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m_lock);
+}
+
+/**
+ * @name	http_client_get
+ * @brief	requests a url and waits for its body
+ * @param	url - (const char *) url to request
+ * @param	status - (long *) out, the http status, may be NULL
+ * @retval	char* - the body, NULL on failure
+ */
+char *http_client_get(const char *url, long *status) {
+    http_request *request = make_request(url, NULL);
+    if (!request) {
+        return NULL;
+    }
+    request->sync = true;
+
+    pthread_mutex_lock(&m_lock);
+    if (!m_running) {
+        pthread_mutex_unlock(&m_lock);
+        free_request(request);
+        return NULL;
+    }
+    request->id = ++m_next_id;
+    queue_push(&m_queued, request);
+    wake();
+    while (!request->finished) {
+        pthread_cond_wait(&m_sync_cond, &m_lock);
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    char *body = NULL;
+    if (!request->response.failed) {
+        // an empty body still comes back as a string
+        body = request->response_body.bytes ? request->response_body.bytes : strdup("");
+        request->response_body.bytes = NULL;
+    }
+    if (status) {
+        *status = request->response.status;
+    }
+    free_request(request);
+    return body;
+}
+
+/**
+ * @name	http_client_run_completions
+ * @brief	runs on_done for the requests that finished since the last call
+ * @retval	NONE
+ */
+void http_client_run_completions() {
+    pthread_mutex_lock(&m_lock);
+    http_request *request = m_finished.head;
+    m_finished.head = m_finished.tail = NULL;
+    pthread_mutex_unlock(&m_lock);
+
+    while (request) {
+        http_request *next = request->next;
+        if (request->on_done) {
+            request->on_done(&request->response, request->data);
+        }
+        free_request(request);
+        request = next;
+    }
+}
+
+/**
+ * @name	http_client_shutdown
+ * @brief	cancels the outstanding requests and stops the http thread
+ * @retval	NONE
+ */
+void http_client_shutdown() {
+    pthread_mutex_lock(&m_lock);
+    if (!m_running) {
+        pthread_mutex_unlock(&m_lock);
+        return;
+    }
+    m_running = false;
+    wake();
+    pthread_mutex_unlock(&m_lock);
+
+    threads_join_thread(&m_thread);
+    m_thread = THREADS_INVALID_THREAD;
+    http_client_run_completions();
+
+    curl_multi_cleanup(m_multi_handle);
+    m_multi_handle = NULL;
+    http_client_release_share(m_share_handle);
+}
+
+static void dispatch_xhr_event(const http_response *response, void *data) {
+    json_t *event = json_object();
+    if (!event) {
+        LOG("{http} WARNING: Unable to report xhr %d", (int) (intptr_t) data);
+        return;
+    }
+
+    // json_string refuses bodies that are not utf-8
+    json_t *text = response->body ? json_string(response->body) : json_string("");
+    json_object_set_new(event, "id", json_integer((int) (intptr_t) data));
+    json_object_set_new(event, "status", json_integer(response->status));
+    json_object_set_new(event, "failed", json_boolean(response->failed || !text));
+    json_object_set_new(event, "response", text ? text : json_string(""));
+    json_object_set_new(event, "headers", json_string(response->headers ? response->headers : ""));
+    json_object_set_new(event, "name", json_string("xhr"));
+    json_object_set_new(event, "priority", json_integer(0));
+
+    char *event_str = json_dumps(event, JSON_COMPACT);
+    json_decref(event);
+    if (event_str) {
+        core_dispatch_event(event_str);
+        free(event_str);
+    }
+}
+
+/**
+ * @name	http_client_xhr_send
+ * @brief	sends a js XMLHttpRequest through the engine, the xhr event
+ *			carries req->id. Synchronous requests are sent asynchronously too
+ * @param	req - (xhr *) request from js
+ * @retval	NONE
+ */
+void http_client_xhr_send(xhr *req) {
+    int count = HASH_COUNT(req->request_headers);
+    char **lines = count ? (char **) calloc(count, sizeof(char *)) : NULL;
+    int header_count = 0;
+    request_header *header, *tmp;
+    HASH_ITER(hh, req->request_headers, header, tmp) {
+        if (!lines) {
+            break;
+        }
+        size_t len = strlen(header->header) + strlen(header->value) + 3;
+        lines[header_count] = (char *) malloc(len);
+        if (lines[header_count]) {
+            snprintf(lines[header_count], len, "%s: %s", header->header, header->value);
+            header_count++;
+        }
+    }
+
+    http_options options = {0};
+    options.method = req->method;
+    options.body = req->data;
+    options.body_size = req->data ? strlen(req->data) : 0;
+    options.headers = (const char *const *) lines;
+    options.header_count = header_count;
+    options.on_done = dispatch_xhr_event;
+    options.data = (void *) (intptr_t) req->id;
+
+    if (!http_client_request(req->url, &options)) {
+        http_response response = {0};
+        response.failed = true;
+        dispatch_xhr_event(&response, options.data);
+    }
+
+    int i;
+    for (i = 0; i < header_count; i++) {
+        free(lines[i]);
+    }
+    free(lines);
+}
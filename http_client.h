@@ -0,0 +1,83 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+ 
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+ 
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef HTTP_CLIENT_H
+#define HTTP_CLIENT_H
+
+#include "core/types.h"
+#include "core/platform/xhr.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// One native HTTP engine for the requests core and the platforms make. A
+// single thread drives every request over one curl multi handle, so
+// connections are kept alive and reused, HTTP/2 streams are multiplexed over
+// them and compressed responses are inflated by curl.
+
+typedef struct http_response_t {
+	int id;
+	long status; // 0 when no response arrived
+	bool failed;
+	bool cancelled;
+	char *body; // NUL terminated, NULL when streamed to on_data
+	unsigned long size;
+	char *headers; // the raw response header lines
+} http_response;
+
+// runs on the http thread with each piece of the body as it arrives
+typedef void (*http_data_cb)(const char *bytes, unsigned long size, void *data);
+// runs on the main thread, the response is freed once it returns
+typedef void (*http_done_cb)(const http_response *response, void *data);
+
+typedef struct http_options_t {
+	const char *method; // NULL for GET
+	const char *body;
+	unsigned long body_size;
+	const char *const *headers; // "Name: value" lines
+	int header_count;
+	long timeout_ms; // 0 for the default
+	http_data_cb on_data; // may be NULL
+	http_done_cb on_done; // may be NULL
+	void *data;
+} http_options;
+
+void http_client_init();
+// queues a request, returns its id or 0 if it could not be queued
+int http_client_request(const char *url, const http_options *options);
+// the request's on_done still runs, with cancelled set
+void http_client_cancel(int id);
+// blocks until the body arrives, for platforms' http_get. Not for the main
+// thread. NULL on failure, the caller frees it
+char *http_client_get(const char *url, long *status);
+// sends a js XMLHttpRequest and reports it with an xhr event
+void http_client_xhr_send(xhr *req);
+// called by core_tick, runs the on_done of finished requests
+void http_client_run_completions();
+// cancels what is left, runs its completions and stops the thread
+void http_client_shutdown();
+
+// a curl share handle, set up for use from several threads, holding the
+// resolved hosts and TLS sessions, for other curl users such as image-cache.
+// Released as many times as it is acquired
+void *http_client_acquire_share();
+void http_client_release_share(void *share);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // HTTP_CLIENT_H
@@ -17,6 +17,8 @@
 #define IMAGE_CACHE_H_
 
 #include "uthash/uthash.h"
+#include <stddef.h>
+#include <stdbool.h>
 
 struct image_data {
 	char *bytes;
@@ -24,26 +26,57 @@ struct image_data {
 	char *url;
 };
 
-struct etag_data {
-	char *url;
-	char *etag;
-	UT_hash_handle hh;
-};
-
 typedef void (*image_cache_cb)(struct image_data *);
 
+// Loads with a higher priority are requested first, newest first within a priority
+enum image_cache_priorities {
+	IMAGE_CACHE_PRIORITY_PREFETCH = -2, // see image_cache_prefetch
+	IMAGE_CACHE_PRIORITY_LOW = -1,
+	IMAGE_CACHE_PRIORITY_NORMAL = 0,
+	IMAGE_CACHE_PRIORITY_HIGH = 1
+};
+
 // The callback provided to this function is when a url provided to image_cache_load has finished loading
 // It is called as soon as possible if the image is cached on disk and called a second time if the cache 
 // discovers a newer image on the server.
+// max_requests caps how many requests are in flight at once, 0 for the default.  The cache
+// adapts within that cap to observed latency and throughput.
 #if __cplusplus
 extern "C" {
 #endif
 
-void image_cache_init(const char *path, image_cache_cb);
+void image_cache_init(const char *path, image_cache_cb, int max_requests);
 void image_cache_destroy();
 void image_cache_remove(const char *url);
+
+// Caps the bytes of images kept on disk, least recently used go first, 0 for the default
+void image_cache_set_max_bytes(size_t max_bytes);
+
+// Caps the bytes of recently served images kept in memory, 0 turns it off
+void image_cache_set_memory_max_bytes(size_t max_bytes);
+// Bytes of images kept in memory, and frees the least recently used until at least bytes are
+// freed, returning how many were
+size_t image_cache_memory_bytes();
+size_t image_cache_trim_memory(size_t bytes);
 void image_cache_load(const char *url);
 
+// Loads of a url already queued or in flight are merged into the one request, keeping the
+// higher priority.  A cancelled load gets no callback from the server, unless its request
+// had already finished; images on disk may still be reported.
+void image_cache_load_with_priority(const char *url, int priority);
+void image_cache_set_priority(const char *url, int priority);
+void image_cache_cancel(const char *url);
+
+// Downloads url to disk without a callback, if it is not there already.  Prefetches only start
+// while no other load is queued or in flight and the network is unmetered.  A load of the same
+// url merges with the prefetch and gets the image as usual
+void image_cache_prefetch(const char *url);
+// Whether the network costs the user, as the platform sees it.  Metered until told otherwise
+void image_cache_set_network_metered(bool metered);
+
+// Name the image for url is kept under in the cache directory, for tools and benchmarks.  Caller frees
+char *image_cache_get_filename(const char *url);
+
 #if __cplusplus
 } //extern C
 #endif
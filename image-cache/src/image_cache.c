@@ -21,6 +21,7 @@
 #include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <dirent.h>
 #include <sys/mman.h>
 
@@ -31,6 +32,7 @@
 #endif
 
 #include <errno.h>
+#include <stdint.h>
 
 #include "curl/curl.h"
 
@@ -62,15 +64,60 @@ pthread_t threads_create_thread(ThreadsThreadProc proc, void *arg) {
 void threads_join_thread(ThreadsThread *thread) {
     pthread_join(*thread, 0);
 }
+#define threads_create_thread_with_priority(proc, arg, priority, affinity) threads_create_thread(proc, arg)
+#define WORK_ITEM_ALLOC() (struct work_item *) malloc(sizeof(struct work_item))
+#define WORK_ITEM_FREE(item) free(item)
+#define LOAD_ITEM_ALLOC() (struct load_item *) malloc(sizeof(struct load_item))
+#define LOAD_ITEM_FREE(item) free(item)
+// memory isn't counted stand-alone
+#define TAG_MALLOC(tag, size) malloc(size)
+#define TAG_FREE(ptr) free(ptr)
+// nor are loads
+#define load_stats_record(stage, ns) ((void)(ns))
+#define load_stats_add(counter, n) ((void)0)
 #else
 #include "core/log.h"
 #include "core/platform/threads.h"
+#include "core/concurrent_pool.h"
+#include "core/http_client.h"
+#include "core/memory_tags.h"
+#include "core/load_stats.h"
+// work items are made on the request and worker threads and freed on the
+// worker and save threads, and load items are made on the caller's thread
+// and freed on the request thread, so both come from concurrent pools
+#define WORK_ITEM_POOL_SLAB 32
+#define LOAD_ITEM_POOL_SLAB 32
+static concurrent_pool *m_work_item_pool = 0;
+static concurrent_pool *m_load_item_pool = 0;
+#define WORK_ITEM_ALLOC() CONCURRENT_POOL_GET(struct work_item, m_work_item_pool)
+#define WORK_ITEM_FREE(item) CONCURRENT_POOL_RELEASE(item)
+#define LOAD_ITEM_ALLOC() CONCURRENT_POOL_GET(struct load_item, m_load_item_pool)
+#define LOAD_ITEM_FREE(item) CONCURRENT_POOL_RELEASE(item)
 #endif // IMGCACHE_STANDALONE
 
-#define MAX_REQUESTS 4 /* max parallel requests */
-#define CACHE_MAX_SIZE 300 /* max image cache files to keep */
-#define DB_MAX_SIZE (CACHE_MAX_SIZE*2) /* max etag entries in database */
+#define DEFAULT_MAX_REQUESTS 8 /* max parallel requests unless image_cache_init says otherwise */
+#define MIN_REQUESTS 2 /* the adaptive limit never drops below this */
+#define MAX_REQUESTS_LIMIT 32 /* hard ceiling on the configured max */
+#define MAX_REQUESTS_PER_HOST 6 /* connections curl may open to a single host */
+#define CONCURRENCY_WINDOW 8 /* completed requests between adjustments of the limit */
+#define DNS_CACHE_TIME 300 /* seconds a resolved host is reused */
+#define KEEPALIVE_IDLE_TIME 30 /* seconds idle before the first keepalive probe */
+#define KEEPALIVE_INTERVAL 15 /* seconds between keepalive probes */
+
+// curl_multi_poll and curl_multi_wakeup arrived in libcurl 7.68
+#if LIBCURL_VERSION_NUM >= 0x074400
+#define IMGCACHE_MULTI_POLL
+#endif
+// sharing the connection cache arrived in libcurl 7.57
+#if LIBCURL_VERSION_NUM >= 0x073900
+#define IMGCACHE_SHARE_CONNECT
+#endif
+#define CACHE_MAX_BYTES (32 * 1024 * 1024) /* default budget for the cached files */
 #define CACHE_MAX_TIME (60 * 60 * 24 * 2) /* 2 days in seconds */
+#define DEFAULT_FRESH_TIME (60 * 10) /* seconds an image stays fresh when the server does not say */
+#define PARTIAL_MIN_BYTES (64 * 1024) /* shorter downloads start over rather than resume */
+#define PARTIAL_MAX_TIME (60 * 60 * 24) /* seconds a partial download is kept */
+#define PREFETCH_MAX_REQUESTS 2 /* prefetches in flight at once */
 
 // If these change, clean_cache() needs to be rewritten
 #define FILENAME_SEED 0
@@ -90,25 +137,51 @@ struct data {
 
 struct load_item {
     char *url;
-    volatile struct load_item *next;
+    int priority;
+    bool in_flight; // handed to a request, no longer in the queue
+    bool cancelled; // in flight but no longer wanted
+    double queued; // seconds, when the load was asked for
+    struct load_item *next;
+    struct load_item *prev;
+    UT_hash_handle hh; // m_load_index, by url
 };
 
 struct request {
     CURL *handle;
     char *etag;
+    struct curl_slist *headers;
     struct data image;
     struct data header;
-    volatile struct load_item *load_item;
+    struct load_item *load_item;
+    size_t resume_from; // bytes of image read back from a partial download
+    char *validator; // the partial download's ETag or Last-Modified, for If-Range
 };
 
 struct work_item {
     struct image_data image;
     bool tried_server;
     bool request_failed;
+    bool prefetch; // nobody waits on it, it only goes to disk
+    char *validator; // set when the bytes are a partial download
     volatile struct work_item *next;
 };
 
+// Observations the request thread adapts its concurrency to
+struct concurrency {
+    int limit; // requests allowed in flight
+    int max; // configured ceiling for limit
+    int completed; // requests finished this window
+    int failed; // of those, how many failed to reach the server
+    bool saturated; // whether requests waited on the limit this window
+    double latency; // summed request seconds this window
+    double bytes; // bytes downloaded this window
+    double window_start;
+    double last_latency; // average request seconds of the previous window
+    double last_throughput; // bytes per second of the previous window
+};
+
 static void (*m_image_load_callback)(struct image_data *);
+static int m_max_requests = DEFAULT_MAX_REQUESTS;
 
 // Request thread variables
 static ThreadsThread m_request_thread;
@@ -116,7 +189,13 @@ static pthread_mutex_t m_request_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t m_request_cond = PTHREAD_COND_INITIALIZER;
 // To modify these variables you must hold the request_mutex lock
 static volatile bool m_request_thread_running = true;
-static volatile struct load_item *m_load_items = 0;
+static struct load_item *m_load_items = 0; // queued loads, highest priority first
+static struct load_item *m_load_index = 0; // queued and in flight loads by url
+static bool m_cancel_pending = false; // an in flight load was cancelled
+static bool m_network_metered = true; // until the platform says otherwise, prefetches wait
+#ifdef IMGCACHE_MULTI_POLL
+static CURLM *m_multi_handle = 0; // woken when loads are queued
+#endif
 
 // Worker thread variables
 static ThreadsThread m_worker_thread;
@@ -126,10 +205,19 @@ static pthread_cond_t m_worker_cond = PTHREAD_COND_INITIALIZER;
 static volatile bool m_worker_thread_running = true;
 static volatile struct work_item *m_work_items = 0;
 
+// Save thread variables
+static ThreadsThread m_save_thread;
+static pthread_mutex_t m_save_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t m_save_cond = PTHREAD_COND_INITIALIZER;
+// To modify these variables you must hold the save_mutex lock
+static volatile bool m_save_thread_running = true;
+static volatile struct work_item *m_save_items = 0;
+
 // Local function declarations
-static pthread_mutex_t m_file_io_mutex = PTHREAD_MUTEX_INITIALIZER;
 static void image_cache_run(void* args);
 static void worker_run(void *args);
+static void save_run(void *args);
+static void queue_save_item(volatile struct work_item *item);
 
 // Simple macros for manipulating the work/request lists
 // ex. load_items is the head of the load items list and load_items_tail is the end of the list
@@ -137,29 +225,66 @@ static void worker_run(void *args);
 #define LIST_PUSH(head, item) item->next = head; head = item;
 #define LIST_POP(head, item) item = head; if (head) { head = item->next; }
 
-static pthread_mutex_t m_etag_mutex = PTHREAD_MUTEX_INITIALIZER;
-static struct etag_data *m_etag_cache = 0;
-static const char *ETAG_FILE = ".etags";
-static char *m_file_cache_path;
+// Load queue, these must be called with the request_mutex lock held
 
-// Expand file name into file path
-static char *get_full_path(const char *filename) {
-    size_t length = strlen(filename) + 1 + strlen(m_file_cache_path) + 1;
-    char *file_path = (char *)malloc(length);
+static void load_queue_insert(struct load_item *item) {
+    // newest first within a priority, as the plain list used to be
+    struct load_item *prev = 0;
+    struct load_item *next = m_load_items;
+    while (next && next->priority > item->priority) {
+        prev = next;
+        next = next->next;
+    }
 
-    snprintf(file_path, length, "%s/%s", m_file_cache_path, filename);
+    item->prev = prev;
+    item->next = next;
+    if (next) {
+        next->prev = item;
+    }
+    if (prev) {
+        prev->next = item;
+    } else {
+        m_load_items = item;
+    }
+}
 
-    return file_path;
+static void load_queue_remove(struct load_item *item) {
+    if (item->prev) {
+        item->prev->next = item->next;
+    } else {
+        m_load_items = item->next;
+    }
+    if (item->next) {
+        item->next->prev = item->prev;
+    }
+    item->next = item->prev = 0;
 }
 
-static volatile struct work_item *alloc_work_item(const char *url, char *bytes, size_t size, bool request_failed, bool tried_server) {
-    struct work_item *item = (struct work_item *)malloc(sizeof(struct work_item));
+static struct load_item *load_queue_pop() {
+    struct load_item *item = m_load_items;
+    if (item) {
+        load_queue_remove(item);
+        item->in_flight = true;
+    }
+    return item;
+}
+
+static void free_load_item(struct load_item *item) {
+    HASH_DEL(m_load_index, item);
+    free(item->url);
+    LOAD_ITEM_FREE(item);
+}
+
+static volatile struct work_item *alloc_work_item(const char *url, char *bytes, size_t size, bool request_failed, bool tried_server, bool prefetch) {
+    struct work_item *item = WORK_ITEM_ALLOC();
 
     item->image.url = strdup(url);
     item->image.bytes = bytes;
     item->image.size = size;
     item->request_failed = request_failed;
     item->tried_server = tried_server;
+    item->prefetch = prefetch;
+    item->validator = 0;
 
     return item;
 }
@@ -168,12 +293,13 @@ static void free_work_item(volatile struct work_item *item) {
     if (item) {
         free(item->image.url);
         free(item->image.bytes);
-        free((void*)item);
+        free(item->validator);
+        WORK_ITEM_FREE((void*)item);
     }
 }
 
-static void queue_work_item(const char *url, char *bytes, size_t size, bool request_failed, bool tried_server) {
-    volatile struct work_item *item = alloc_work_item(url, bytes, size, request_failed, tried_server);
+static void queue_work_item(const char *url, char *bytes, size_t size, bool request_failed, bool tried_server, bool prefetch) {
+    volatile struct work_item *item = alloc_work_item(url, bytes, size, request_failed, tried_server, prefetch);
 
     // add the work item to the work list
     pthread_mutex_lock(&m_worker_mutex);
@@ -183,374 +309,852 @@ static void queue_work_item(const char *url, char *bytes, size_t size, bool requ
 }
 
 
-// Safely walk string looking for a token, without reading off end of buffer
-static int safe_strtoklen(const char *f, char token, const char *end) {
-    int count = 0;
-
-    while (f < end) {
-        char ch = *f;
+static void clear_work_items() {
+    volatile struct work_item *item = m_work_items;
+    volatile struct work_item *prev;
 
-        // If we found the token,
-        if (ch == token) {
-            break;
-        }
+    while (item) {
+        prev = item;
+        item = item->next;
 
-        ++count;
-        ++f;
+        free_work_item(item);
     }
+}
 
-    return count;
+static const char *HEX_CONV = "0123456789ABCDEF";
+
+static void hash_url(const char *url, unsigned char hash[FILENAME_HASH_BYTES]) {
+    MurmurHash3_x86_128(url, (int)strlen(url), FILENAME_SEED, hash);
 }
 
-// Safely duplicates a string without a terminating nul character at end
-static char *safe_strdup(const char *f, int len) {
-    char *s = malloc(len + 1);
+static char *get_filename_from_hash(const unsigned char hash[FILENAME_HASH_BYTES]) {
+    char *filename = malloc(FILENAME_PREFIX_BYTES + FILENAME_HASH_BYTES*2+1);
+
+    memcpy(filename, FILENAME_PREFIX, FILENAME_PREFIX_BYTES);
 
-    memcpy(s, f, len);
-    s[len] = '\0';
+    int i;
+    for (i = 0; i < FILENAME_HASH_BYTES; ++i) {
+        filename[FILENAME_PREFIX_BYTES+i*2+0] = HEX_CONV[hash[i] & 15];
+        filename[FILENAME_PREFIX_BYTES+i*2+1] = HEX_CONV[hash[i] >> 4];
+    }
+    filename[FILENAME_LENGTH] = '\0';
 
-    return s;
+    return filename;
 }
 
-// Precondition: url and etag have been strdup()
-// Call with m_etag_mutex held
-static struct etag_data *etag_add(char *url, char *etag) {
-    struct etag_data *data = (struct etag_data *)malloc(sizeof(struct etag_data));
+static char *get_filename_from_url(const char *url) {
+    unsigned char result[FILENAME_HASH_BYTES];
 
-    data->url = url;
-    data->etag = etag;
+    hash_url(url, result);
 
-    HASH_ADD_KEYPTR(hh, m_etag_cache, url, strlen(url), data);
+    return get_filename_from_hash(result);
+}
 
-    return data;
+char *image_cache_get_filename(const char *url) {
+    return get_filename_from_url(url);
 }
 
-// Parse etag data from in-memory image of the file without modifying it
-static void parse_etag_file_data(const char *f, int len) {
-    const char *end = f + len;
-    int etag_count = 0;
 
-    LOG("{image-cache} Parsing etags database of len=%d", len);
+//// Cache Index
 
-    pthread_mutex_lock(&m_etag_mutex);
+/*
+ * What is known about each cached file lives in one memory-mapped file, an
+ * open addressing hash table keyed by the url hash the file is named after.
+ * Opening it is a single mmap, every change is a write to one entry, and
+ * eviction picks from the entries without touching the directory.  Removed
+ * entries leave a tombstone, compacted away once there are too many.
+ *
+ * All of it must be accessed with the index_mutex lock held.
+ */
+
+#define INDEX_MAGIC 0x31434749 /* "IGC1" */
+#define INDEX_VERSION 1
+#define INDEX_SLOTS 1024 /* power of two */
+#define INDEX_MAX_ENTRIES (INDEX_SLOTS / 2) /* keeps probe runs short */
+#define INDEX_MAX_TOMBSTONES (INDEX_SLOTS / 4) /* compact beyond this */
+#define INDEX_ETAG_BYTES 72 /* longer etags are not kept */
 
-    // While there is data to read,
-    while (f < end) {
-        // Find URL length
-        const char *url = f;
-        int url_len = safe_strtoklen(url, ' ', end);
+enum index_entry_states {INDEX_ENTRY_EMPTY, INDEX_ENTRY_USED, INDEX_ENTRY_REMOVED};
+
+struct index_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;
+    uint32_t reserved;
+};
+
+struct index_entry {
+    unsigned char hash[FILENAME_HASH_BYTES];
+    int64_t size; // bytes of the cached file
+    int64_t atime; // when the file was last stored or served
+    int64_t validated; // when the server last confirmed the file, 0 for never
+    int64_t max_age; // seconds after validated the file stays fresh
+    uint32_t state;
+    uint32_t etag_len;
+    char etag[INDEX_ETAG_BYTES];
+};
+
+static pthread_mutex_t m_index_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct index_header *m_index = 0;
+static struct index_entry *m_index_entries = 0;
+static size_t m_index_map_size = 0;
+static int m_index_used = 0;
+static int m_index_removed = 0;
+static size_t m_index_bytes = 0; // sum of the sizes of the used entries
+static size_t m_cache_max_bytes = CACHE_MAX_BYTES;
+static const char *INDEX_FILE = ".index";
+static const char *ETAG_FILE = ".etags"; // the text database the index replaced
+static const char *TEMP_FILE = ".download"; // images are written here, then renamed into place
+static const char *PARTIAL_SUFFIX = ".part"; // added to the file name of a partial download
+static char *m_file_cache_path;
 
-        // If URL is missing,
-        if (url_len <= 0) {
-            DLOG("{image-cache} Stopping early because url was missing");
+// Expand file name into file path
+static char *get_full_path(const char *filename) {
+    size_t length = strlen(filename) + 1 + strlen(m_file_cache_path) + 1;
+    char *file_path = (char *)malloc(length);
+
+    snprintf(file_path, length, "%s/%s", m_file_cache_path, filename);
+
+    return file_path;
+}
+
+static uint32_t index_slot(const unsigned char *hash) {
+    uint32_t h;
+    memcpy(&h, hash, sizeof(h));
+    return h & (INDEX_SLOTS - 1);
+}
+
+static struct index_entry *index_find(const unsigned char *hash) {
+    uint32_t slot = index_slot(hash);
+    int probes;
+    for (probes = 0; probes < INDEX_SLOTS; probes++, slot = (slot + 1) & (INDEX_SLOTS - 1)) {
+        struct index_entry *entry = &m_index_entries[slot];
+        if (entry->state == INDEX_ENTRY_EMPTY) {
             break;
         }
+        if (entry->state == INDEX_ENTRY_USED && !memcmp(entry->hash, hash, FILENAME_HASH_BYTES)) {
+            return entry;
+        }
+    }
+    return 0;
+}
 
-        // Find ETAG length
-        const char *etag = url + url_len + 1;
-        int etag_len = safe_strtoklen(etag, '\n', end);
+static struct index_entry *index_find_url(const char *url) {
+    unsigned char hash[FILENAME_HASH_BYTES];
+    if (!m_index) {
+        return 0;
+    }
+    hash_url(url, hash);
+    return index_find(hash);
+}
 
-        // If ETAG is missing,
-        if (etag_len <= 0) {
-            DLOG("{image-cache} Stopping early because etag was missing");
-            break;
+// Places an entry for a hash that is not in the index, reusing the first tombstone on the way
+static struct index_entry *index_place(const unsigned char *hash) {
+    uint32_t slot = index_slot(hash);
+    int probes;
+    for (probes = 0; probes < INDEX_SLOTS; probes++, slot = (slot + 1) & (INDEX_SLOTS - 1)) {
+        struct index_entry *entry = &m_index_entries[slot];
+        if (entry->state != INDEX_ENTRY_USED) {
+            if (entry->state == INDEX_ENTRY_REMOVED) {
+                m_index_removed--;
+            }
+            memset(entry, 0, sizeof(struct index_entry));
+            memcpy(entry->hash, hash, FILENAME_HASH_BYTES);
+            entry->state = INDEX_ENTRY_USED;
+            m_index_used++;
+            return entry;
         }
+    }
+    return 0;
+}
 
-        // Duplicate string without a terminating nul
-        char *url_cstr = safe_strdup(url, url_len);
-        char *etag_cstr = safe_strdup(etag, etag_len);
+// Rebuilds the table without its tombstones
+static void index_compact() {
+    struct index_entry *used = (struct index_entry *) malloc(m_index_used * sizeof(struct index_entry) + 1);
+    if (!used) {
+        return;
+    }
 
-        DLOG("{image-cache} Adding etag url='%s' : etag='%s'", url_cstr, etag_cstr);
+    int count = 0, i;
+    for (i = 0; i < INDEX_SLOTS; i++) {
+        if (m_index_entries[i].state == INDEX_ENTRY_USED) {
+            used[count++] = m_index_entries[i];
+        }
+    }
 
-        etag_add(url_cstr, etag_cstr);
-        ++etag_count;
+    DLOG("{image-cache} Compacting index, %d entries and %d tombstones", count, m_index_removed);
 
-        // Stop processing after a reasonable amount of etags because this takes
-        // a wild amount of time after a long game session
-        if (etag_count > DB_MAX_SIZE) {
-            DLOG("{image-cache} Stopping early because etag count exceeded maximum database size");
-            break;
+    memset(m_index_entries, 0, INDEX_SLOTS * sizeof(struct index_entry));
+    m_index_used = 0;
+    m_index_removed = 0;
+    for (i = 0; i < count; i++) {
+        *index_place(used[i].hash) = used[i];
+    }
+    free(used);
+}
+
+static void index_remove(struct index_entry *entry) {
+    m_index_bytes -= (size_t) entry->size;
+    entry->state = INDEX_ENTRY_REMOVED;
+    m_index_used--;
+    m_index_removed++;
+}
+
+// Deletes the cached file of an entry along with the entry
+static void index_evict(struct index_entry *entry, const char *reason) {
+    char *filename = get_filename_from_hash(entry->hash);
+    char *path = get_full_path(filename);
+
+    // readers that already mapped the file keep their pages
+    remove(path);
+    DLOG("{image-cache} Removed cache file %s (%s)", path, reason);
+
+    free(filename);
+    free(path);
+    index_remove(entry);
+}
+
+// Evicts least recently used files until the cache fits its budgets
+static void index_trim(int max_entries) {
+    while (m_index_used > 0 && (m_index_bytes > m_cache_max_bytes || m_index_used > max_entries)) {
+        struct index_entry *oldest = 0;
+        int i;
+        for (i = 0; i < INDEX_SLOTS; i++) {
+            struct index_entry *entry = &m_index_entries[i];
+            if (entry->state == INDEX_ENTRY_USED && (!oldest || entry->atime < oldest->atime)) {
+                oldest = entry;
+            }
         }
+        index_evict(oldest, "ran out of room");
+    }
+}
 
-        // Set read pointer to next etag
-        f = etag + etag_len + 1;
+// Gets the entry for a url, making an empty one if there is none
+static struct index_entry *index_get(const char *url) {
+    unsigned char hash[FILENAME_HASH_BYTES];
+    if (!m_index) {
+        return 0;
     }
+    hash_url(url, hash);
+
+    struct index_entry *entry = index_find(hash);
+    if (!entry) {
+        // make room first so the new entry cannot be the one evicted
+        index_trim(INDEX_MAX_ENTRIES - 1);
+        if (m_index_removed > INDEX_MAX_TOMBSTONES) {
+            index_compact();
+        }
+        entry = index_place(hash);
+        entry->atime = time(0);
+    }
+    return entry;
+}
 
-    pthread_mutex_unlock(&m_etag_mutex);
+static void index_set_etag(struct index_entry *entry, const char *etag) {
+    size_t len = etag ? strlen(etag) : 0;
+    if (len > INDEX_ETAG_BYTES) {
+        DLOG("{image-cache} Not keeping an etag of %d bytes", (int)len);
+        len = 0;
+    }
+    memcpy(entry->etag, etag, len);
+    entry->etag_len = (uint32_t) len;
+}
 
-    DLOG("{image-cache} Parsed %d etags from database", etag_count);
+static bool is_partial_filename(const char *filename) {
+    return strlen(filename) == FILENAME_LENGTH + strlen(PARTIAL_SUFFIX) &&
+           !strcmp(filename + FILENAME_LENGTH, PARTIAL_SUFFIX);
 }
 
-/*
- * url -> etag mappings are stored in a file.  Each line looks like
- *     http://example.com/foo.png 383761229c544a77af3df6dd1cc5c01d
- */
-static void read_etags_from_cache() {
+// Removes every cached file, for an index that is missing or unreadable
+static void purge_cache_files() {
+    DIR *dir = opendir(m_file_cache_path);
+    if (!dir) {
+        LOG("{image-cache} WARNING: Unable to open directory to purge cache errno=%d", errno);
+        return;
+    }
+
+    struct dirent *entry = 0;
+    while ((entry = readdir(dir))) {
+        const char *filename = entry->d_name;
+
+        if (filename[0] == FILENAME_PREFIX[0] &&
+                filename[1] == FILENAME_PREFIX[1] &&
+                (strlen(filename) == FILENAME_LENGTH || is_partial_filename(filename))) {
+            char *path = get_full_path(filename);
+            remove(path);
+            free(path);
+        }
+    }
+    closedir(dir);
+
     char *path = get_full_path(ETAG_FILE);
+    remove(path);
+    free(path);
 
-    // Open the file
-    int fd = open(path, O_RDONLY);
+    path = get_full_path(TEMP_FILE);
+    remove(path);
+    free(path);
+}
+
+// Maps the index, starting it over if it is missing or from another version
+static void open_index() {
+    char *path = get_full_path(INDEX_FILE);
+    size_t map_size = sizeof(struct index_header) + INDEX_SLOTS * sizeof(struct index_entry);
 
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
     if (fd == -1) {
-        DLOG("{image-cache} WARNING: read_etags_from_cache open failed errno=%d for %s", errno, path);
-    } else {
-        off_t len = lseek(fd, 0, SEEK_END);
+        LOG("{image-cache} WARNING: Unable to open index errno=%d for %s", errno, path);
+        free(path);
+        return;
+    }
 
-#ifndef __ANDROID__
-        // These are BSD/iOS-only
-        fcntl(fd, F_NOCACHE, 1);
-        fcntl(fd, F_RDAHEAD, 1);
-#endif
+    off_t len = lseek(fd, 0, SEEK_END);
+    bool fresh = len != (off_t) map_size;
+    if (fresh && ftruncate(fd, (off_t) map_size) != 0) {
+        LOG("{image-cache} WARNING: Unable to size index errno=%d for %s", errno, path);
+        close(fd);
+        free(path);
+        return;
+    }
 
-        if (len > 0) {
-            void *raw = mmap(0, (size_t)len, PROT_READ, MAP_PRIVATE, fd, 0);
+    void *raw = mmap(0, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    free(path);
 
-            if (raw == MAP_FAILED) {
-                LOG("{image-cache} WARNING: read_etags_from_cache mmap failed errno=%d for %s len=%d", errno, path, (int)len);
-            } else {
-                parse_etag_file_data(raw, (int)len);
+    if (raw == MAP_FAILED) {
+        LOG("{image-cache} WARNING: Unable to map index errno=%d", errno);
+        return;
+    }
 
-                munmap(raw, (size_t)len);
-            }
-        } else {
-            DLOG("{image-cache} WARNING: read_etags_from_cache file length 0 errno=%d for %s len=%d", errno, path, (int)len);
+    struct index_header *header = (struct index_header *) raw;
+    if (fresh || header->magic != INDEX_MAGIC || header->version != INDEX_VERSION || header->slots != INDEX_SLOTS) {
+        LOG("{image-cache} Starting a new cache index");
+
+        // files from before the index cannot be accounted for
+        purge_cache_files();
+        memset(raw, 0, map_size);
+        header->magic = INDEX_MAGIC;
+        header->version = INDEX_VERSION;
+        header->slots = INDEX_SLOTS;
+    }
+
+    pthread_mutex_lock(&m_index_mutex);
+    m_index = header;
+    m_index_entries = (struct index_entry *) (header + 1);
+    m_index_map_size = map_size;
+
+    // the counts are not stored, so a write cut short by a crash cannot leave them wrong
+    m_index_used = m_index_removed = 0;
+    m_index_bytes = 0;
+    int i;
+    for (i = 0; i < INDEX_SLOTS; i++) {
+        struct index_entry *entry = &m_index_entries[i];
+        if (entry->state == INDEX_ENTRY_USED) {
+            m_index_used++;
+            m_index_bytes += (size_t) entry->size;
+        } else if (entry->state == INDEX_ENTRY_REMOVED) {
+            m_index_removed++;
         }
+    }
+    pthread_mutex_unlock(&m_index_mutex);
 
-        close(fd);
+    DLOG("{image-cache} Opened index with %d entries, %zu bytes", m_index_used, m_index_bytes);
+}
+
+static void close_index() {
+    pthread_mutex_lock(&m_index_mutex);
+    if (m_index) {
+        msync(m_index, m_index_map_size, MS_SYNC);
+        munmap(m_index, m_index_map_size);
+        m_index = 0;
+        m_index_entries = 0;
     }
+    pthread_mutex_unlock(&m_index_mutex);
+}
 
+// NOTE: the file for the url needs to be removed along with this
+static void index_remove_url(const char *url) {
+    pthread_mutex_lock(&m_index_mutex);
+    struct index_entry *entry = index_find_url(url);
+    if (entry) {
+        DLOG("{image-cache} Found image in index to remove: %s", url);
+        index_remove(entry);
+    }
+    pthread_mutex_unlock(&m_index_mutex);
+}
+
+// Returns strdup version, be sure to free!
+static char *get_etag_for_url(const char *url) {
+    char *etag = 0;
+
+    pthread_mutex_lock(&m_index_mutex);
+    struct index_entry *entry = index_find_url(url);
+    if (entry && entry->etag_len > 0) {
+        DLOG("{image-cache} Found image etag in index: %s", url);
+        etag = malloc(entry->etag_len + 1);
+        memcpy(etag, entry->etag, entry->etag_len);
+        etag[entry->etag_len] = '\0';
+    } else {
+        DLOG("{image-cache} Did not find image etag in index: %s", url);
+    }
+    pthread_mutex_unlock(&m_index_mutex);
+
+    return etag;
+}
+
+// Whether the image was validated recently enough to skip asking the server again
+static bool is_image_fresh(const char *url) {
+    bool fresh = false;
+
+    pthread_mutex_lock(&m_index_mutex);
+    struct index_entry *entry = index_find_url(url);
+    if (entry && entry->validated > 0) {
+        int64_t now = time(0);
+        fresh = now >= entry->validated && now - entry->validated < entry->max_age;
+    }
+    pthread_mutex_unlock(&m_index_mutex);
+
+    return fresh;
+}
+
+static bool image_exists_in_cache(const char *url) {
+    char *filename = get_filename_from_url(url);
+    char *path = get_full_path(filename);
+
+    bool exists = access(path, F_OK) != -1;
+
+    free(filename);
     free(path);
+
+    return exists;
 }
 
-static void write_etags_to_cache() {
-    char *path = get_full_path(ETAG_FILE);
+struct response_headers {
+    char *etag; // points into the header buffer
+    long max_age; // seconds the response stays fresh
+};
 
-    DLOG("{image-cache} Writing etag cache");
+// Picks the etag and freshness lifetime out of the headers, modifying them
+static void parse_response_headers(char *headers, struct response_headers *response) {
+    long max_age = -1;
+    time_t expires = -1, date = -1;
+    bool no_cache = false;
 
-    FILE *f = fopen(path, "w");
-    int etag_count = 0;
+    response->etag = 0;
+    response->max_age = DEFAULT_FRESH_TIME;
+    if (!headers) {
+        return;
+    }
 
-    if (!f) {
-        LOG("{image-cache} ERROR: Unable to open-write etags cache file %s errno=%d", path, errno);
-    } else {
-        struct etag_data *data = 0;
-        struct etag_data *tmp = 0;
-
-        pthread_mutex_lock(&m_etag_mutex);
-        HASH_ITER(hh, m_etag_cache, data, tmp) {
-            if (data->etag && data->url) {
-                //DLOG("{image-cache} Wrote etag='%s' for url='%s'", data->etag, data->url);
-
-                fwrite(data->url, 1, strlen(data->url), f);
-                fwrite(" ", 1, 1, f);
-                fwrite(data->etag, 1, strlen(data->etag), f);
-                fwrite("\n", 1, 1, f);
-
-                // If etag count exceeds the database maximum,
-                if (++etag_count > DB_MAX_SIZE) {
-                    // Stop here
-                    break;
-                }
-            } else {
-                DLOG("{image-cache} Skipped writing etag='%s' for url='%s'", data->etag ? data->etag : "(null)", data->url ? data->url : "(null)");
+    char *tok = strtok(headers, "\n");
+
+    // HTTP/2 sends header names in lower case
+    while (tok != 0) {
+        if (!strncasecmp("ETag:", tok, 5)) {
+            // the rest of the headers are still wanted, so do not strtok this one
+            char *open = strchr(tok, '"');
+            char *close = open ? strchr(open + 1, '"') : 0;
+            if (close) {
+                *close = '\0';
+                response->etag = open + 1;
+            }
+        } else if (!strncasecmp("Cache-Control:", tok, 14)) {
+            const char *value = tok + 14;
+            const char *age = strstr(value, "max-age=");
+            if (age) {
+                max_age = strtol(age + 8, 0, 10);
             }
+            if (strstr(value, "no-cache") || strstr(value, "no-store")) {
+                no_cache = true;
+            }
+        } else if (!strncasecmp("Expires:", tok, 8)) {
+            expires = curl_getdate(tok + 8, 0);
+        } else if (!strncasecmp("Date:", tok, 5)) {
+            date = curl_getdate(tok + 5, 0);
         }
-        pthread_mutex_unlock(&m_etag_mutex);
 
-        fclose(f);
+        tok = strtok(0, "\n");
     }
 
-    free(path);
+    // max-age wins over Expires, which is relative to the server's clock when it can be
+    if (no_cache) {
+        response->max_age = 0;
+    } else if (max_age >= 0) {
+        response->max_age = max_age;
+    } else if (expires != -1) {
+        long lifetime = (long)(expires - (date != -1 ? date : time(0)));
+        response->max_age = lifetime > 0 ? lifetime : 0;
+    }
 }
 
-static void free_etag_data(struct etag_data *data) {
-    free(data->url);
-    free(data->etag);
-    free(data);
-}
 
-static void clear_cache() {
-    struct etag_data *data = 0;
-    struct etag_data *tmp = 0;
+//// Memory Cache
+
+/*
+ * Recently served images are kept in memory, compressed, so a url loaded
+ * again in the same session skips the disk. Entries are kept in use order
+ * in the hash, least recently used first, and dropped once the byte
+ * budget is exceeded.
+ */
+
+#define MEMORY_CACHE_MAX_BYTES (4 * 1024 * 1024)
+
+struct memory_entry {
+    char *url;
+    char *bytes;
+    size_t size;
+    UT_hash_handle hh;
+};
+
+static pthread_mutex_t m_memory_mutex = PTHREAD_MUTEX_INITIALIZER;
+// To modify these variables you must hold the memory_mutex lock
+static struct memory_entry *m_memory_cache = 0;
+static size_t m_memory_bytes = 0;
+static size_t m_memory_max_bytes = MEMORY_CACHE_MAX_BYTES;
+
+static void memory_cache_drop(struct memory_entry *entry) {
+    HASH_DEL(m_memory_cache, entry);
+    m_memory_bytes -= entry->size;
+    free(entry->url);
+    TAG_FREE(entry->bytes);
+    TAG_FREE(entry);
+}
 
-    pthread_mutex_lock(&m_etag_mutex);
-    HASH_ITER(hh, m_etag_cache, data, tmp) {
-        free_etag_data(data);
+static void memory_cache_trim() {
+    while (m_memory_cache && m_memory_bytes > m_memory_max_bytes) {
+        memory_cache_drop(m_memory_cache);
     }
-    pthread_mutex_unlock(&m_etag_mutex);
 }
 
-static void clear_work_items() {
-    volatile struct work_item *item = m_work_items;
-    volatile struct work_item *prev;
+static void memory_cache_remove(const char *url) {
+    struct memory_entry *entry;
 
-    while (item) {
-        prev = item;
-        item = item->next;
+    pthread_mutex_lock(&m_memory_mutex);
+    HASH_FIND_STR(m_memory_cache, url, entry);
+    if (entry) {
+        memory_cache_drop(entry);
+    }
+    pthread_mutex_unlock(&m_memory_mutex);
+}
 
-        free_work_item(item);
+static void memory_cache_put(const char *url, const char *bytes, size_t size) {
+    memory_cache_remove(url);
+
+    pthread_mutex_lock(&m_memory_mutex);
+    if (size > 0 && size <= m_memory_max_bytes) {
+        struct memory_entry *entry = (struct memory_entry *) TAG_MALLOC(MEMORY_TAG_IMAGE_CACHE, sizeof(struct memory_entry));
+        char *copy = (char *) TAG_MALLOC(MEMORY_TAG_IMAGE_CACHE, size);
+        char *url_copy = strdup(url);
+
+        if (entry && copy && url_copy) {
+            memcpy(copy, bytes, size);
+            entry->url = url_copy;
+            entry->bytes = copy;
+            entry->size = size;
+            HASH_ADD_KEYPTR(hh, m_memory_cache, entry->url, strlen(entry->url), entry);
+            m_memory_bytes += size;
+            memory_cache_trim();
+        } else {
+            TAG_FREE(entry);
+            TAG_FREE(copy);
+            free(url_copy);
+        }
     }
+    pthread_mutex_unlock(&m_memory_mutex);
 }
 
-static const char *HEX_CONV = "0123456789ABCDEF";
+static bool memory_cache_contains(const char *url) {
+    struct memory_entry *entry;
 
-static char *get_filename_from_url(const char *url) {
-    unsigned char result[FILENAME_HASH_BYTES];
+    pthread_mutex_lock(&m_memory_mutex);
+    HASH_FIND_STR(m_memory_cache, url, entry);
+    pthread_mutex_unlock(&m_memory_mutex);
 
-    MurmurHash3_x86_128(url, (int)strlen(url), 0, result);
+    return entry != 0;
+}
 
-    char *filename = malloc(FILENAME_PREFIX_BYTES + FILENAME_HASH_BYTES*2+1);
+// Runs the load callback from memory, returns false if the url is not there
+static bool callback_memory_image(char *url) {
+    struct memory_entry *entry;
 
-    memcpy(filename, FILENAME_PREFIX, FILENAME_PREFIX_BYTES);
+    pthread_mutex_lock(&m_memory_mutex);
+    HASH_FIND_STR(m_memory_cache, url, entry);
+    if (entry) {
+        // move to the back, it is now the most recently used
+        HASH_DEL(m_memory_cache, entry);
+        HASH_ADD_KEYPTR(hh, m_memory_cache, entry->url, strlen(entry->url), entry);
 
-    int i;
-    for (i = 0; i < FILENAME_HASH_BYTES; ++i) {
-        filename[FILENAME_PREFIX_BYTES+i*2+0] = HEX_CONV[result[i] & 15];
-        filename[FILENAME_PREFIX_BYTES+i*2+1] = HEX_CONV[result[i] >> 4];
+        DLOG("{image-cache} Serving image from memory: %s bytes=%d", url, (int)entry->size);
+
+        struct image_data image;
+        image.url = url;
+        image.bytes = entry->bytes;
+        image.size = entry->size;
+        m_image_load_callback(&image);
+        load_stats_add(LOAD_COUNT_MEMORY_HITS, 1);
     }
-    filename[FILENAME_LENGTH] = '\0';
+    pthread_mutex_unlock(&m_memory_mutex);
 
-    return filename;
+    return entry != 0;
 }
 
-#define DC 0
-static const unsigned char FROM_HEX[256] = {
-    DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, // 0-15
-    DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, // 16-31
-    DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, // 32-47
-    0 , 1 , 2 , 3 , 4 , 5 , 6 , 7 , 8 , 9 , DC, DC, DC, DC, DC, DC, // 48-63
-    DC, 10, 11, 12, 13, 14, 15, DC, DC, DC, DC, DC, DC, DC, DC, DC, // 64-79
-    DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, // 128-
-    DC, 10, 11, 12, 13, 14, 15, DC, DC, DC, DC, DC, DC, DC, DC, DC, // 64-79
-    DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, // 128-
-    DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, // 128-
-    DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, // Extended
-    DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, // ASCII
-    DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, // Extended
-    DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, // ASCII
-    DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, // Extended
-    DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, // ASCII
-    DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC, DC
+static void memory_cache_clear() {
+    pthread_mutex_lock(&m_memory_mutex);
+    while (m_memory_cache) {
+        memory_cache_drop(m_memory_cache);
+    }
+    pthread_mutex_unlock(&m_memory_mutex);
+}
+
+
+//// Partial Downloads
+
+/*
+ * A download cut short by the network, a cancel or shutdown is kept beside
+ * the cached file once it is long enough to be worth resuming, headed by the
+ * strong ETag or Last-Modified date it came with. The next request for the
+ * url asks for the rest with Range, and If-Range has the server send the
+ * whole image instead if it changed. The save thread writes them, the
+ * request thread reads and removes them. The header is written first and
+ * the bytes are a prefix of the image, so a write cut short still leaves a
+ * usable file.
+ */
+
+#define PARTIAL_MAGIC 0x31504749 /* "IGP1" */
+#define PARTIAL_VALIDATOR_BYTES 120
+
+struct partial_header {
+    uint32_t magic;
+    uint32_t validator_len;
+    char validator[PARTIAL_VALIDATOR_BYTES];
 };
-#undef DC
 
-// NOTE: etag cache file needs to be written after this
-void kill_etag_for_url_hash(const char *url_hash_str) {
-    // This is fairly slow.  We need to trial-hash all of the etag database URLs
-    // and see which ones match the given URL hash string.
+// What the headers of the last response say about ranges
+struct range_headers {
+    char validator[PARTIAL_VALIDATOR_BYTES]; // strong ETag, else Last-Modified, empty for none
+    bool ranges; // false if the server said it takes none
+    long start; // first byte of a 206 body, -1 if not said
+};
 
-    if (strlen(url_hash_str) != FILENAME_HASH_BYTES*2) {
-        LOG("{image-cache} ERROR: Internal consistency failure");
-        return;
-    }
+static char *get_partial_path(const char *url) {
+    char *filename = get_filename_from_url(url);
+    size_t length = strlen(filename) + strlen(PARTIAL_SUFFIX) + 1;
+    char *partial = (char *) malloc(length);
+    snprintf(partial, length, "%s%s", filename, PARTIAL_SUFFIX);
 
-    unsigned char url_hash[FILENAME_HASH_BYTES];
+    char *path = get_full_path(partial);
+    free(partial);
+    free(filename);
+    return path;
+}
 
-    // Reverse encoding:
+static void remove_partial(const char *url) {
+    char *path = get_partial_path(url);
+    remove(path);
+    free(path);
+}
 
-    int ii;
-    for (ii = 0; ii < FILENAME_HASH_BYTES; ++ii) {
-        unsigned char lo = FROM_HEX[(unsigned char)url_hash_str[0]];
-        unsigned char hi = FROM_HEX[(unsigned char)url_hash_str[1]];
+// Reads back a partial download into image, false if there is none worth resuming
+static bool read_partial(const char *url, struct data *image, char **validator) {
+    char *path = get_partial_path(url);
+    FILE *f = fopen(path, "rb");
+    free(path);
+    if (!f) {
+        return false;
+    }
 
-        url_hash[ii] = (hi << 4) | lo;
-        url_hash_str += 2;
+    struct partial_header header;
+    long size = 0;
+    bool ok = fread(&header, sizeof(header), 1, f) == 1 && header.magic == PARTIAL_MAGIC &&
+              header.validator_len > 0 && header.validator_len < PARTIAL_VALIDATOR_BYTES;
+    if (ok && fseek(f, 0, SEEK_END) == 0) {
+        size = ftell(f) - (long) sizeof(header);
     }
+    ok = ok && size >= PARTIAL_MIN_BYTES;
 
-    unsigned char data_hash[FILENAME_HASH_BYTES];
+    char *bytes = ok ? (char *) malloc(size) : 0;
+    ok = bytes && fseek(f, (long) sizeof(header), SEEK_SET) == 0 && fread(bytes, 1, size, f) == (size_t) size;
+    fclose(f);
 
-    struct etag_data *data = 0;
-    struct etag_data *tmp = 0;
+    if (!ok) {
+        free(bytes);
+        remove_partial(url);
+        return false;
+    }
 
-    pthread_mutex_lock(&m_etag_mutex);
-    HASH_ITER(hh, m_etag_cache, data, tmp) {
-        if (data && data->url) {
-            MurmurHash3_x86_128(data->url, (int)strlen(data->url), 0, data_hash);
+    *validator = (char *) malloc(header.validator_len + 1);
+    memcpy(*validator, header.validator, header.validator_len);
+    (*validator)[header.validator_len] = '\0';
+    image->bytes = bytes;
+    image->size = (size_t) size;
+    return true;
+}
 
-            // If they match,
-            if (0 == memcmp(data_hash, url_hash, FILENAME_HASH_BYTES)) {
-                DLOG("{image-cache} kill_etag_for_url_hash found matching URL to kill: %s", data->url);
-                HASH_DEL(m_etag_cache, data);
-                free_etag_data(data);
-                break;
-            }
-        }
+// Writes a partial download for the next request to resume, on the save thread
+static void save_partial(struct image_data *image, const char *validator) {
+    char *path = get_partial_path(image->url);
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        LOG("{image-cache} WARNING: Unable to open to save file %s errno=%d", path, errno);
+        free(path);
+        return;
     }
-    pthread_mutex_unlock(&m_etag_mutex);
+
+    struct partial_header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = PARTIAL_MAGIC;
+    header.validator_len = (uint32_t) strlen(validator);
+    memcpy(header.validator, validator, header.validator_len);
+
+    bool success = fwrite(&header, sizeof(header), 1, f) == 1 &&
+                   fwrite(image->bytes, 1, image->size, f) == image->size;
+    if (fclose(f) != 0 || !success) {
+        LOG("{image-cache} WARNING: Unable to save partial download %s errno=%d", path, errno);
+        remove(path);
+    } else {
+        DLOG("{image-cache} Saved partial download: %s bytes=%d", image->url, (int)image->size);
+    }
+    free(path);
 }
 
-// NOTE: etag cache file needs to be written after this
-void kill_etag_for_url(const char *url) {
-    struct etag_data *data = 0;
+// Removes partial downloads nobody came back for
+static void clean_partial_files() {
+    DIR *dir = opendir(m_file_cache_path);
+    if (!dir) {
+        return;
+    }
 
-    pthread_mutex_lock(&m_etag_mutex);
-    HASH_FIND_STR(m_etag_cache, url, data);
+    time_t now = time(0);
+    struct dirent *entry = 0;
+    while ((entry = readdir(dir))) {
+        if (!is_partial_filename(entry->d_name)) {
+            continue;
+        }
 
-    if (data) {
-        DLOG("{image-cache} Found image etag in cache to kill: %s", url);
+        char *path = get_full_path(entry->d_name);
+        struct stat st;
+        if (stat(path, &st) == 0 && now - st.st_mtime > PARTIAL_MAX_TIME) {
+            remove(path);
+        }
+        free(path);
+    }
+    closedir(dir);
+}
 
-        free(data->etag);
-        data->etag = 0;
-    } else {
-        DLOG("{image-cache} Did not find image etag in cache to kill: %s", url);
+// Copies a header value, less surrounding whitespace
+static void copy_header_value(const char *value, const char *end, char *out, size_t size) {
+    while (value < end && (*value == ' ' || *value == '\t')) {
+        value++;
+    }
+    while (end > value && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) {
+        end--;
     }
 
-    pthread_mutex_unlock(&m_etag_mutex);
+    size_t length = (size_t) (end - value);
+    if (length >= size) {
+        // too long to keep, and a cut validator would never match
+        length = 0;
+    }
+    memcpy(out, value, length);
+    out[length] = '\0';
 }
 
-// Returns strdup version, be sure to free!
-char *get_etag_for_url(const char *url) {
-    char *etag = 0;
-    struct etag_data *data = 0;
+// Reads the headers of the last response, those before it were redirects
+static void parse_range_headers(const char *headers, struct range_headers *range) {
+    char etag[PARTIAL_VALIDATOR_BYTES];
+    char modified[PARTIAL_VALIDATOR_BYTES];
 
-    pthread_mutex_lock(&m_etag_mutex);
-    HASH_FIND_STR(m_etag_cache, url, data);
+    etag[0] = modified[0] = '\0';
+    range->ranges = true;
+    range->start = -1;
 
-    if (data) {
-        DLOG("{image-cache} Found image etag in cache: %s", url);
-        etag = data->etag;
-    } else {
-        DLOG("{image-cache} Did not find image etag in cache: %s", url);
-    }
-    etag = etag ? strdup(etag) : 0;
-    pthread_mutex_unlock(&m_etag_mutex);
+    const char *line = headers;
+    while (line && *line) {
+        const char *end = strchr(line, '\n');
+        if (!end) {
+            end = line + strlen(line);
+        }
 
-    return etag;
-}
+        if (!strncasecmp("HTTP/", line, 5)) {
+            etag[0] = modified[0] = '\0';
+            range->ranges = true;
+            range->start = -1;
+        } else if (!strncasecmp("ETag:", line, 5)) {
+            // weak etags cannot be used with If-Range
+            copy_header_value(line + 5, end, etag, sizeof(etag));
+            if (!strncmp(etag, "W/", 2)) {
+                etag[0] = '\0';
+            }
+        } else if (!strncasecmp("Last-Modified:", line, 14)) {
+            copy_header_value(line + 14, end, modified, sizeof(modified));
+        } else if (!strncasecmp("Accept-Ranges:", line, 14)) {
+            char value[16];
+            copy_header_value(line + 14, end, value, sizeof(value));
+            range->ranges = strcasecmp(value, "none") != 0;
+        } else if (!strncasecmp("Content-Range:", line, 14)) {
+            const char *bytes = strstr(line + 14, "bytes ");
+            if (bytes && bytes < end) {
+                range->start = strtol(bytes + 6, 0, 10);
+            }
+        }
 
-static bool image_exists_in_cache(const char *url) {
-    char *filename = get_filename_from_url(url);
-    char *path = get_full_path(filename);
+        line = *end ? end + 1 : 0;
+    }
 
-    bool exists = access(path, F_OK) != -1;
+    strcpy(range->validator, etag[0] ? etag : modified);
+}
 
-    free(filename);
-    free(path);
+// Drops the bytes read back from a partial download unless the response
+// carried on from them, false if the body is some other part of the image
+static bool join_partial(struct request *request, long code, const struct range_headers *range) {
+    if (!request->resume_from) {
+        return true;
+    }
+    if (code == 206) {
+        return range->start == (long) request->resume_from;
+    }
 
-    return exists;
+    // the whole image again, or an error
+    size_t size = request->image.size - request->resume_from;
+    if (request->image.bytes) {
+        memmove(request->image.bytes, request->image.bytes + request->resume_from, size);
+    }
+    request->image.size = size;
+    request->resume_from = 0;
+    return true;
 }
 
-static char *code_from_header_line(char *line) {
-    char *code = 0;
-    char *tok = strtok(line, "\"");
-    if (tok) {
-        code = strtok(0, "\"");
+// Hands what a failed request downloaded to the save thread, or frees it
+static void keep_partial(struct request *request, const struct range_headers *range) {
+    // with no response at all the partial file on disk is still the latest
+    const char *validator = request->header.size > 0 ? range->validator : request->validator;
+    bool grew = request->image.size > request->resume_from;
+
+    if (grew && range->ranges && validator && validator[0] && request->image.size >= PARTIAL_MIN_BYTES) {
+        volatile struct work_item *item = alloc_work_item(request->load_item->url, request->image.bytes,
+                                                          request->image.size, true, true, true);
+        item->validator = strdup(validator);
+        queue_save_item(item);
+    } else {
+        free(request->image.bytes);
     }
-    return code;
+    request->image.bytes = 0;
+    request->image.size = 0;
 }
 
-static char *parse_response_headers(char *headers) {
-    char *tok = strtok(headers, "\n");
-
-    while (tok != 0) {
-        if (!strncmp("ETag", tok, 4)) {
-            return code_from_header_line(tok);
-        }
+// Keeps what a request dropped before it finished downloaded
+static void abandon_request(struct request *request) {
+    long code = 0;
+    curl_easy_getinfo(request->handle, CURLINFO_RESPONSE_CODE, &code);
 
-        tok = strtok(0, "\n");
+    struct range_headers range;
+    parse_range_headers(request->header.bytes, &range);
+    if (join_partial(request, code, &range)) {
+        keep_partial(request, &range);
+    } else {
+        free(request->image.bytes);
+        request->image.bytes = 0;
     }
-
-    return 0;
 }
 
 
@@ -575,10 +1179,118 @@ static size_t write_data(void *contents, size_t size, size_t nmemb, void *userp)
     return real_size;
 }
 
+static double get_time_seconds() {
+    struct timeval now;
+    gettimeofday(&now, 0);
+    return now.tv_sec + now.tv_usec / 1000000.0;
+}
+
+static void concurrency_init(struct concurrency *c, int max) {
+    memset(c, 0, sizeof(struct concurrency));
+    c->max = max;
+
+    // start at the middle and let the observations move it
+    c->limit = max / 2 < MIN_REQUESTS ? MIN_REQUESTS : max / 2;
+    if (c->limit > max) {
+        c->limit = max;
+    }
+    c->window_start = get_time_seconds();
+}
+
+// Records a finished request and, once a window is full, moves the limit
+static void concurrency_record(struct concurrency *c, CURL *handle, CURLcode result) {
+    double seconds = 0, bytes = 0;
+    curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME, &seconds);
+#if LIBCURL_VERSION_NUM >= 0x073700
+    curl_off_t size = 0;
+    curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &size);
+    bytes = (double) size;
+#else
+    curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD, &bytes);
+#endif
+
+    c->completed++;
+    c->latency += seconds;
+    c->bytes += bytes;
+
+    // error statuses such as 404 reached the server fine, they say nothing of the network
+    if (result != CURLE_OK && result != CURLE_HTTP_RETURNED_ERROR) {
+        c->failed++;
+    }
+
+    if (c->completed < CONCURRENCY_WINDOW) {
+        return;
+    }
+
+    double now = get_time_seconds();
+    double elapsed = now - c->window_start;
+    double latency = c->latency / c->completed;
+    double throughput = elapsed > 0 ? c->bytes / elapsed : 0;
+    int limit = c->limit;
+
+    if (c->failed * 2 > c->completed) {
+        // mostly timeouts and refused connections, back off hard
+        limit /= 2;
+    } else if (c->last_latency > 0 && latency > c->last_latency * 1.5 && throughput <= c->last_throughput) {
+        // requests got slower without getting more done, the link is full
+        limit--;
+    } else if (c->saturated && throughput >= c->last_throughput) {
+        // requests were waiting and the last step up did not hurt
+        limit++;
+    }
+
+    if (limit < MIN_REQUESTS) {
+        limit = MIN_REQUESTS;
+    }
+    if (limit > c->max) {
+        limit = c->max;
+    }
+    if (limit != c->limit) {
+        DLOG("{image-cache} Loader thread: Concurrency %d -> %d (latency %.3fs, %.0f bytes/s)", c->limit, limit, latency, throughput);
+        c->limit = limit;
+    }
+
+    c->last_latency = latency;
+    c->last_throughput = throughput;
+    c->completed = 0;
+    c->failed = 0;
+    c->saturated = false;
+    c->latency = 0;
+    c->bytes = 0;
+    c->window_start = now;
+}
+
+// Whether the load at the head of the queue may start, call with the
+// request_mutex lock held. Prefetches wait until nothing else is queued or
+// in flight and the network is unmetered, and then only a few go at once
+static bool can_start_request(struct request **request_pool, int request_count, int limit) {
+    if (!m_load_items || request_count >= limit) {
+        return false;
+    }
+    if (m_load_items->priority > IMAGE_CACHE_PRIORITY_PREFETCH) {
+        return true;
+    }
+    if (m_network_metered || request_count >= PREFETCH_MAX_REQUESTS) {
+        return false;
+    }
+
+    int i;
+    for (i = 0; i < request_count; i++) {
+        if (request_pool[i]->load_item->priority > IMAGE_CACHE_PRIORITY_PREFETCH) {
+            return false;
+        }
+    }
+    return true;
+}
+
 static void image_cache_run(void *args) {
-    struct request *request_pool[MAX_REQUESTS];
+    struct concurrency concurrency;
+    concurrency_init(&concurrency, m_max_requests);
+    struct request **request_pool = (struct request **) malloc(concurrency.max * sizeof(struct request *));
+#ifndef IMGCACHE_MULTI_POLL
     struct timeval timeout;
     long curl_timeo;
+#endif
     int i;
 
     // number of requests currently being processed
@@ -586,22 +1298,50 @@ static void image_cache_run(void *args) {
 
     CURLM *multi_handle = curl_multi_init();
 
-    // Enable pipelining for speed
+    // Multiplex over HTTP/2 where this libcurl can, otherwise fall back to pipelining
+#ifdef CURLPIPE_MULTIPLEX
+    curl_multi_setopt(multi_handle, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#else
     curl_multi_setopt(multi_handle, CURLMOPT_PIPELINING, 1L);
+#endif
+
+    // Spread over hosts rather than opening every connection to one of them
+    curl_multi_setopt(multi_handle, CURLMOPT_MAX_HOST_CONNECTIONS, (long) MAX_REQUESTS_PER_HOST);
+
+#ifdef IMGCACHE_STANDALONE
+    // Resolved hosts, TLS sessions and connections outlive the handle that
+    // made them. Only this thread uses the handles, so no lock is needed.
+    CURLSH *share_handle = curl_share_init();
+    curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+#ifdef IMGCACHE_SHARE_CONNECT
+    curl_share_setopt(share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+#endif
+#else
+    // Resolved hosts and TLS sessions are shared with the http client, which
+    // talks to the same servers. The multi handle keeps the connections
+    CURLSH *share_handle = (CURLSH *) http_client_acquire_share();
+#endif
 
     // number of multi requests still running
     int still_running;
 
+#ifdef IMGCACHE_MULTI_POLL
+    pthread_mutex_lock(&m_request_mutex);
+    m_multi_handle = multi_handle;
+    pthread_mutex_unlock(&m_request_mutex);
+#else
     // file descriptor variables for selecting over multi requests
     fd_set fdread;
     fd_set fdwrite;
     fd_set fdexcep;
     int maxfd = -1;
+#endif
 
     DLOG("{image-cache} Loader thread: Starting");
 
     // init the handle pool and free handles
-    for (i = 0; i < MAX_REQUESTS; i++) {
+    for (i = 0; i < concurrency.max; i++) {
         request_pool[i] = (struct request*) malloc(sizeof(struct request));
         request_pool[i]->handle = curl_easy_init();
     }
@@ -609,14 +1349,40 @@ static void image_cache_run(void *args) {
     pthread_mutex_lock(&m_request_mutex);
     while (m_request_thread_running) {
         // while there are free handles start up new requests
-        while (request_count < MAX_REQUESTS) {
-            volatile struct load_item *load_item;
-            LIST_POP(m_load_items, load_item);
+        // drop in flight loads that were cancelled while the lock was released
+        if (m_cancel_pending) {
+            m_cancel_pending = false;
+            for (i = request_count - 1; i >= 0; i--) {
+                struct request *request = request_pool[i];
+                if (request->load_item->cancelled) {
+                    DLOG("{image-cache} Loader thread: Cancelled %s", request->load_item->url);
+                    curl_multi_remove_handle(multi_handle, request->handle);
+                    abandon_request(request);
+                    free(request->etag);
+                    free(request->validator);
+                    curl_slist_free_all(request->headers);
+                    free(request->header.bytes);
+                    free_load_item(request->load_item);
+
+                    request_pool[i] = request_pool[request_count - 1];
+                    request_pool[request_count - 1] = request;
+                    request_count--;
+                }
+            }
+        }
 
-            // If nothing to load,
-            if (!load_item) {
-                break;
+        while (can_start_request(request_pool, request_count, concurrency.limit)) {
+            struct load_item *load_item = load_queue_pop();
+
+            // Do not ask the server again while the copy on disk is fresh, checked
+            // here since loads may be queued before the etag database is read
+            if (image_exists_in_cache(load_item->url) && is_image_fresh(load_item->url)) {
+                DLOG("{image-cache} Loader thread: Image is fresh, skipping revalidation: %s", load_item->url);
+                load_stats_add(LOAD_COUNT_FRESH, 1);
+                free_load_item(load_item);
+                continue;
             }
+            load_stats_record(LOAD_STAGE_QUEUE, (long long) ((get_time_seconds() - load_item->queued) * 1e9));
 
             DLOG("{image-cache} Loader thread: Queuing up %s", load_item->url);
 
@@ -629,6 +1395,9 @@ static void image_cache_run(void *args) {
             request->header.bytes = 0;
             request->header.size = 0;
             request->header.is_image = false;
+            request->headers = 0;
+            request->resume_from = 0;
+            request->validator = 0;
 
             // the load item for this request is stored for use after the request finishes
             request->load_item = load_item;
@@ -660,13 +1429,32 @@ static void image_cache_run(void *args) {
                 char *etag_header_str = malloc(header_str_len);
                 snprintf(etag_header_str, header_str_len, FORMAT, request->etag);
 
-                struct curl_slist *headers = curl_slist_append(0, etag_header_str);
-
-                curl_easy_setopt(request->handle, CURLOPT_HTTPHEADER, headers);
+                request->headers = curl_slist_append(request->headers, etag_header_str);
 
                 free(etag_header_str);
             }
 
+            // pick up where a download cut short left off, the server sends
+            // the whole image instead if it no longer matches
+            if (read_partial(load_item->url, &request->image, &request->validator)) {
+                DLOG("{image-cache} Loader thread: Resuming %s from %zu bytes", load_item->url, request->image.size);
+                request->resume_from = request->image.size;
+
+                char range_header[64];
+                snprintf(range_header, sizeof(range_header), "Range: bytes=%zu-", request->resume_from);
+                request->headers = curl_slist_append(request->headers, range_header);
+
+                size_t if_range_len = strlen("If-Range: ") + strlen(request->validator) + 1;
+                char *if_range_header = malloc(if_range_len);
+                snprintf(if_range_header, if_range_len, "If-Range: %s", request->validator);
+                request->headers = curl_slist_append(request->headers, if_range_header);
+                free(if_range_header);
+            }
+
+            if (request->headers) {
+                curl_easy_setopt(request->handle, CURLOPT_HTTPHEADER, request->headers);
+            }
+
 #ifdef IMGCACHE_VERBOSE
             curl_easy_setopt(request->handle, CURLOPT_VERBOSE, 1L);
 #else
@@ -689,6 +1477,21 @@ static void image_cache_run(void *args) {
             // Follow redirects to work with Facebook API et al
             curl_easy_setopt(request->handle, CURLOPT_FOLLOWLOCATION, 1L);
 
+            // curl_easy_reset drops the share, so hand it back every time
+            curl_easy_setopt(request->handle, CURLOPT_SHARE, share_handle);
+            curl_easy_setopt(request->handle, CURLOPT_DNS_CACHE_TIMEOUT, (long) DNS_CACHE_TIME);
+
+            // Keep idle connections to the CDN alive through mobile NATs
+            curl_easy_setopt(request->handle, CURLOPT_TCP_KEEPALIVE, 1L);
+            curl_easy_setopt(request->handle, CURLOPT_TCP_KEEPIDLE, (long) KEEPALIVE_IDLE_TIME);
+            curl_easy_setopt(request->handle, CURLOPT_TCP_KEEPINTVL, (long) KEEPALIVE_INTERVAL);
+
+#ifdef CURLPIPE_MULTIPLEX
+            // Ask for HTTP/2 over TLS and wait to share a connection rather than open another
+            curl_easy_setopt(request->handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+            curl_easy_setopt(request->handle, CURLOPT_PIPEWAIT, 1L);
+#endif
+
             /* Setting this one to avoid freeze issue with iOS when internet is slow
              * By default the DNS resolution uses signals to implement the timeout logic
              * but this is not thread-safe: the signal could be executed on another thread
@@ -712,6 +1515,10 @@ static void image_cache_run(void *args) {
             request_count++;
         }
 
+        if (request_count >= concurrency.limit && m_load_items) {
+            concurrency.saturated = true;
+        }
+
         // if no requests are currently being processed sleep until signaled
         if (0 >= request_count) {
             pthread_cond_wait(&m_request_cond, &m_request_mutex);
@@ -727,6 +1534,24 @@ static void image_cache_run(void *args) {
 
         DLOG("{image-cache} Loader thread: Performing. still running = %d, request count = %d", still_running, request_count);
 
+#ifdef IMGCACHE_MULTI_POLL
+        // sleep on the transfers until one finishes, or image_cache_load wakes
+        // us with new work while there is room to start it
+        bool new_work = false;
+        do {
+            if (curl_multi_poll(multi_handle, NULL, 0, 1000, NULL) != CURLM_OK) {
+                LOG("{image-cache} WARNING: curl_multi_poll failed");
+            }
+
+            if (curl_multi_perform(multi_handle, &still_running) != CURLM_OK) {
+                LOG("{image-cache} WARNING: curl_multi_perform failed");
+            }
+
+            pthread_mutex_lock(&m_request_mutex);
+            new_work = !m_request_thread_running || m_cancel_pending || can_start_request(request_pool, request_count, concurrency.limit);
+            pthread_mutex_unlock(&m_request_mutex);
+        } while (still_running == request_count && !new_work);
+#else
         // loop until at least one request finishes processing
         do {
             FD_ZERO(&fdread);
@@ -758,11 +1583,10 @@ static void image_cache_run(void *args) {
                 break;
             }
         } while (still_running == request_count);
+#endif
 
         DLOG("{image-cache} Loader thread: Completed at least one.  Still running = %d, request count = %d", still_running, request_count);
 
-        bool update_etag_cache = false;
-
         // at least one request has finished
         CURLMsg *msg; /* for picking up messages with the transfer status */
         int msgs_left; /* how many messages are left */
@@ -779,56 +1603,95 @@ static void image_cache_run(void *args) {
                 }
 
                 struct request *request = request_pool[idx];
-                if (msg->data.result == CURLE_OK) {
+                concurrency_record(&concurrency, request->handle, msg->data.result);
+
+                double seconds = 0;
+                curl_easy_getinfo(request->handle, CURLINFO_TOTAL_TIME, &seconds);
+                load_stats_record(LOAD_STAGE_FETCH, (long long) (seconds * 1e9));
+
+                pthread_mutex_lock(&m_request_mutex);
+                bool prefetch = request->load_item->priority <= IMAGE_CACHE_PRIORITY_PREFETCH;
+                pthread_mutex_unlock(&m_request_mutex);
+
+                // before parse_response_headers cuts the headers up
+                long code = 0;
+                curl_easy_getinfo(request->handle, CURLINFO_RESPONSE_CODE, &code);
+                struct range_headers range;
+                parse_range_headers(request->header.bytes, &range);
+                CURLcode result = msg->data.result;
+                if (!join_partial(request, code, &range)) {
+                    LOG("{image-cache} WARNING: Server resumed %s from the wrong place", request->load_item->url);
+                    free(request->image.bytes);
+                    request->image.bytes = 0;
+                    request->image.size = 0;
+                    remove_partial(request->load_item->url);
+                    result = CURLE_HTTP_RETURNED_ERROR;
+                }
+
+                if (result == CURLE_OK) {
                     DLOG("{image-cache} Loader thread: Finished request: %s with result %d and image size %zu", request->load_item->url, msg->data.result, request->image.size);
-                    struct etag_data *etag_data = 0;
 
-                    // Check to see if this url already has etag data
+                    // both a new image and a 304 say how long the image now stays fresh
+                    struct response_headers response;
+                    parse_response_headers(request->header.bytes, &response);
+
+                    // Check to see if this url already has an index entry
                     // if it doesnt create it now
-                    pthread_mutex_lock(&m_etag_mutex);
-                    HASH_FIND_STR(m_etag_cache, request->load_item->url, etag_data);
-                    if (!etag_data) {
-                        etag_data = etag_add(strdup(request->load_item->url), request->etag ? strdup(request->etag) : 0);
-                    } else {
-                        DLOG("{image-cache} Loader thread: Loaded existing etag data for %s", request->load_item->url);
+                    pthread_mutex_lock(&m_index_mutex);
+                    struct index_entry *entry = index_get(request->load_item->url);
+                    if (entry) {
+                        entry->validated = time(0);
+                        entry->max_age = response.max_age;
+
+                        // a new image comes with its own etag, or none
+                        if (request->image.size > 0) {
+                            index_set_etag(entry, response.etag);
+                        }
                     }
-                    pthread_mutex_unlock(&m_etag_mutex);
+                    pthread_mutex_unlock(&m_index_mutex);
 
                     // if we got an image back from the server send the image data to the worker thread for processing
                     if (request->image.size > 0) {
-                        char *etag = parse_response_headers(request->header.bytes);
-
-                        DLOG("{image-cache} Loader thread: Got an updated image for %s (%zd bytes) etag=%d", request->load_item->url, request->image.size, etag ? 1 : 0);
-
-                        queue_work_item(request->load_item->url, request->image.bytes, request->image.size, false, true);
-
-                        // If something changed,
-                        if (etag_data->etag || etag) {
-                            update_etag_cache = true;
-                        }
+                        DLOG("{image-cache} Loader thread: Got an updated image for %s (%zd bytes) etag=%d", request->load_item->url, request->image.size, response.etag ? 1 : 0);
+                        load_stats_add(LOAD_COUNT_DOWNLOADS, 1);
+                        load_stats_add(LOAD_COUNT_BYTES_DOWNLOADED, (long long) (request->image.size - request->resume_from));
 
-                        // Update etag
-                        free(etag_data->etag);
-                        etag_data->etag = etag ? strdup(etag) : 0;
+                        queue_work_item(request->load_item->url, request->image.bytes, request->image.size, false, true, prefetch);
                     } else {
-                        queue_work_item(request->load_item->url, 0, 0, false, true);
+                        queue_work_item(request->load_item->url, 0, 0, false, true, prefetch);
+                        load_stats_add(LOAD_COUNT_NOT_MODIFIED, 1);
 
                         free(request->image.bytes);
                         DLOG("{image-cache} Loader thread: Did not get an image from server for %s", request->load_item->url);
                     }
+
+                    // the image or the copy on disk is now the latest
+                    remove_partial(request->load_item->url);
                 } else {
-                    DLOG("{image-cache} Loader thread: WARNING: CURL returned fail response code %d while requesting %s", msg->data.result, request->load_item->url);
+                    DLOG("{image-cache} Loader thread: WARNING: CURL returned fail response code %d while requesting %s", result, request->load_item->url);
 
-                    // free any bytes acquired during the request
-                    free(request->image.bytes);
+                    if (result == CURLE_HTTP_RETURNED_ERROR) {
+                        // the server answered, what came before is no use
+                        free(request->image.bytes);
+                        if (request->resume_from) {
+                            remove_partial(request->load_item->url);
+                        }
+                    } else {
+                        // the network dropped, keep what arrived to resume from
+                        keep_partial(request, &range);
+                    }
+                    load_stats_add(LOAD_COUNT_FETCH_ERRORS, 1);
 
-                    queue_work_item(request->load_item->url, 0, 0, true, true);
+                    queue_work_item(request->load_item->url, 0, 0, true, true, prefetch);
                 }
 
                 free(request->etag);
+                free(request->validator);
+                curl_slist_free_all(request->headers);
                 free(request->header.bytes);
-                free(request->load_item->url);
-                free((void*)request->load_item);
+                pthread_mutex_lock(&m_request_mutex);
+                free_load_item(request->load_item);
+                pthread_mutex_unlock(&m_request_mutex);
                 curl_multi_remove_handle(multi_handle, request->handle);
 
                 // move this request to the end of the request pool so it can be freed
@@ -840,30 +1703,51 @@ static void image_cache_run(void *args) {
             }
         }
 
-        if (update_etag_cache) {
-            // save all etags to a file
-            write_etags_to_cache();
-        }
-
         pthread_mutex_lock(&m_request_mutex);
     }
 
+#ifdef IMGCACHE_MULTI_POLL
+    m_multi_handle = 0;
+#endif
     pthread_mutex_unlock(&m_request_mutex);
 
+    // the save thread outlives this one, so what is in flight can be resumed next launch
+    for (i = 0; i < request_count; i++) {
+        struct request *request = request_pool[i];
+        curl_multi_remove_handle(multi_handle, request->handle);
+        abandon_request(request);
+        free(request->etag);
+        free(request->validator);
+        curl_slist_free_all(request->headers);
+        free(request->header.bytes);
+    }
+
     DLOG("{image-cache} Loader thread: Good night!");
 
     curl_multi_cleanup(multi_handle);
 
-    for (i = 0; i < MAX_REQUESTS; i++) {
+    for (i = 0; i < concurrency.max; i++) {
         curl_easy_cleanup(request_pool[i]->handle);
         free(request_pool[i]);
     }
+    free(request_pool);
+
+    // the share can only go once no handle uses it
+#ifdef IMGCACHE_STANDALONE
+    curl_share_cleanup(share_handle);
+#else
+    http_client_release_share(share_handle);
+#endif
 }
 
 
 //// Worker Thread
 
 static void callback_cached_image(char *url, bool report_error) {
+    if (callback_memory_image(url)) {
+        return;
+    }
+
     char *filename = get_filename_from_url(url);
     char *path = get_full_path(filename);
 
@@ -872,9 +1756,9 @@ static void callback_cached_image(char *url, bool report_error) {
     image.bytes = 0;
     image.size = 0;
 
-    pthread_mutex_lock(&m_file_io_mutex);
-
-    // Open the file
+    // Files are only ever replaced by rename, so no lock is needed: a
+    // mapping always sees one complete version of the image
+    double start = get_time_seconds();
     int fd = open(path, O_RDONLY);
 
     bool success = false;
@@ -897,6 +1781,7 @@ static void callback_cached_image(char *url, bool report_error) {
                 LOG("{image-cache} WARNING: callback_cached_image failed errno=%d for %s len=%d", errno, path, (int)len);
             } else {
                 DLOG("{image-cache} Reading cached image data: %s bytes=%d", url, (int)len);
+                madvise(raw, (size_t)len, MADV_SEQUENTIAL);
 
                 image.bytes = raw;
                 image.size = (size_t)len;
@@ -909,18 +1794,33 @@ static void callback_cached_image(char *url, bool report_error) {
         close(fd);
     }
 
+    if (success) {
+        load_stats_record(LOAD_STAGE_DISK_READ, (long long) ((get_time_seconds() - start) * 1e9));
+        load_stats_add(LOAD_COUNT_DISK_HITS, 1);
+    }
+
     // If it is time to run the callback,
     if (success || report_error) {
         m_image_load_callback(&image);
     }
 
+    // Served files are the last to be evicted
+    if (success) {
+        memory_cache_put(url, image.bytes, image.size);
+
+        pthread_mutex_lock(&m_index_mutex);
+        struct index_entry *entry = index_find_url(url);
+        if (entry) {
+            entry->atime = time(0);
+        }
+        pthread_mutex_unlock(&m_index_mutex);
+    }
+
     // If successfully mapped,
     if (success) {
         munmap(image.bytes, image.size);
     }
 
-    pthread_mutex_unlock(&m_file_io_mutex);
-
     free(filename);
     free(path);
 }
@@ -930,102 +1830,161 @@ static bool save_image(struct image_data *image) {
     char *filename = get_filename_from_url(image->url);
     char *path = get_full_path(filename);
 
-    pthread_mutex_lock(&m_file_io_mutex);
+    // Write beside the cached file and rename over it, so readers never see
+    // a partial image. Only the save thread saves, one temp file will do.
+    char *temp_path = get_full_path(TEMP_FILE);
 
-    FILE *f = fopen(path, "wb");
+    FILE *f = fopen(temp_path, "wb");
     if (!f) {
-        LOG("{image-cache} WARNING: Unable to open to save file %s errno=%d", path, errno);
+        LOG("{image-cache} WARNING: Unable to open to save file %s errno=%d", temp_path, errno);
         success = false;
     } else {
         size_t bytes_written = fwrite(image->bytes, 1, image->size, f);
 
-        if (bytes_written != image->size) {
+        if (fclose(f) != 0 || bytes_written != image->size) {
             success = false;
             LOG("{image-cache} ERROR: Wrote %zu but expected %zu bytes for %s errno=%d", bytes_written, image->size, path, errno);
-
-            bool removed = remove(path);
-            if (!removed) {
-                LOG("{image-cache} ERROR: Failed to remove file %s errno=%d", path, errno);
-            }
+        } else if (rename(temp_path, path) != 0) {
+            success = false;
+            LOG("{image-cache} ERROR: Failed to move saved file to %s errno=%d", path, errno);
         } else {
             DLOG("{image-cache} Saved updated image to cache: %s bytes=%d", image->url, (int)image->size);
         }
-        fclose(f);
+
+        if (!success && remove(temp_path) != 0) {
+            LOG("{image-cache} ERROR: Failed to remove file %s errno=%d", temp_path, errno);
+        }
     }
+    free(temp_path);
 
-    pthread_mutex_unlock(&m_file_io_mutex);
+    // the old copy no longer matches the etag the server just sent
+    if (!success) {
+        remove(path);
+    }
+
+    // Account for the file, then make room for it
+    pthread_mutex_lock(&m_index_mutex);
+    if (success) {
+        struct index_entry *entry = index_get(image->url);
+        if (entry) {
+            m_index_bytes = m_index_bytes - (size_t) entry->size + image->size;
+            entry->size = (int64_t) image->size;
+            entry->atime = time(0);
+            index_trim(INDEX_MAX_ENTRIES);
+        }
+    } else {
+        struct index_entry *entry = index_find_url(image->url);
+        if (entry) {
+            index_remove(entry);
+        }
+    }
+    pthread_mutex_unlock(&m_index_mutex);
 
     free(filename);
     free(path);
     return success;
 }
 
-// Expunge old files from cache
-static void clean_cache() {
-    DIR *dir = opendir(m_file_cache_path);
-    if (!dir) {
-        LOG("{image-cache} WARNING: Unable to open directory to clean cache errno=%d", errno);
+// Hands a delivered image to the save thread, which then owns the item
+static void queue_save_item(volatile struct work_item *item) {
+    volatile struct work_item *queued;
+
+    pthread_mutex_lock(&m_save_mutex);
+
+    // only the newest bytes for a url are worth writing
+    for (queued = m_save_items; queued; queued = queued->next) {
+        if (!strcmp(queued->image.url, item->image.url) && !queued->validator == !item->validator) {
+            char *bytes = queued->image.bytes;
+            char *validator = queued->validator;
+            queued->image.bytes = item->image.bytes;
+            queued->image.size = item->image.size;
+            queued->validator = item->validator;
+            item->image.bytes = bytes;
+            item->validator = validator;
+            break;
+        }
+    }
+
+    if (queued) {
+        free_work_item(item);
     } else {
-        struct dirent *entry = 0;
+        LIST_PUSH(m_save_items, item);
+        pthread_cond_signal(&m_save_cond);
+    }
 
-        time_t now;
-        time(&now);
+    pthread_mutex_unlock(&m_save_mutex);
+}
 
-        int count = 0;
-        bool update_cache = false;
+static void save_run(void *args) {
+    volatile struct work_item *local_items = 0;
+    volatile struct work_item *item;
 
-        while ((entry = readdir(dir))) {
-            const char *filename = entry->d_name;
+    pthread_mutex_lock(&m_save_mutex);
 
-            if (filename[0] == FILENAME_PREFIX[0] &&
-                    filename[1] == FILENAME_PREFIX[1] &&
-                    strlen(filename) == FILENAME_LENGTH) {
+    // Keep going until asked to stop and nothing is left to write
+    while (m_save_thread_running || m_save_items) {
+        if (!m_save_items) {
+            pthread_cond_wait(&m_save_cond, &m_save_mutex);
+            continue;
+        }
 
-                char *path = get_full_path(filename);
+        // Write everything queued so far in one go
+        local_items = m_save_items;
+        m_save_items = 0;
 
-                if (count >= CACHE_MAX_SIZE) {
-                    remove(path);
-                    kill_etag_for_url_hash(filename + FILENAME_PREFIX_BYTES);
-                    update_cache = true;
-                    DLOG("{image-cache} Removed cache file %s (ran out of room)", path);
-                } else {
-                    struct stat attrib;
-                    if (0 == stat(path, &attrib)) {
-                        int delta = (int)difftime(now, attrib.st_atime);
-
-                        if (delta > CACHE_MAX_TIME) {
-                            remove(path);
-                            kill_etag_for_url_hash(filename + FILENAME_PREFIX_BYTES);
-                            update_cache = true;
-                            DLOG("{image-cache} Removed cache file %s (file too old %d)", path, delta);
-                        } else {
-                            ++count;
-                        }
-                    }
-                }
+        pthread_mutex_unlock(&m_save_mutex);
 
-                free(path);
+        while (local_items) {
+            LIST_POP(local_items, item);
+
+            if (item->validator) {
+                save_partial((struct image_data *)&item->image, item->validator);
+            } else if (!save_image((struct image_data *)&item->image)) {
+                memory_cache_remove(item->image.url);
             }
-        }
 
-        if (update_cache) {
-            write_etags_to_cache();
+            free_work_item(item);
         }
 
-        closedir(dir);
+        pthread_mutex_lock(&m_save_mutex);
+    }
+
+    pthread_mutex_unlock(&m_save_mutex);
+}
+
+// Expunge old files from cache, and any beyond the budgets
+static void clean_cache() {
+    int64_t now = time(0);
+    int i;
+
+    pthread_mutex_lock(&m_index_mutex);
+    if (m_index) {
+        for (i = 0; i < INDEX_SLOTS; i++) {
+            struct index_entry *entry = &m_index_entries[i];
+            if (entry->state == INDEX_ENTRY_USED && now - entry->atime > CACHE_MAX_TIME) {
+                index_evict(entry, "file too old");
+            }
+        }
+        index_trim(INDEX_MAX_ENTRIES);
+        index_compact();
     }
+    pthread_mutex_unlock(&m_index_mutex);
+
+    clean_partial_files();
 }
 
 // worker thread
 static void worker_run(void *args) {
     // Run these off a side thread to avoid blocking startup:
 
-    read_etags_from_cache();
+    open_index();
 
     clean_cache();
 
     // Start request thread after cache is fixed up
-    m_request_thread = threads_create_thread(image_cache_run, 0);
+    // mostly waits on the network, so it stays off the fast cores
+    m_request_thread = threads_create_thread_with_priority(image_cache_run, 0,
+                                                           THREADS_PRIORITY_UTILITY, THREADS_AFFINITY_EFFICIENCY);
 
     // Local work item list
     volatile struct work_item *local_items = 0;
@@ -1057,7 +2016,13 @@ static void worker_run(void *args) {
 
             // if no image bytes were provided try loading the image from disk
             // otherwise save the image
-            if (0 == image->bytes) {
+            if (item->prefetch) {
+                // nobody asked for it yet, so it only goes to disk
+                if (image->bytes) {
+                    queue_save_item(item);
+                    item = 0;
+                }
+            } else if (0 == image->bytes) {
                 // If server response came back,
                 if (item->tried_server) {
                     // If image was not in cache either,
@@ -1073,10 +2038,13 @@ static void worker_run(void *args) {
                 }
             } else {
                 m_image_load_callback(image);
-
-                save_image(image);
+                memory_cache_put(image->url, image->bytes, image->size);
 
                 LOG("{image-cache} Updated: %s (bytes = %d)", image->url, (int)image->size);
+
+                // Delivery never waits on storage, the save thread writes it out
+                queue_save_item(item);
+                item = 0;
             }
 
             free_work_item(item);
@@ -1091,9 +2059,16 @@ static void worker_run(void *args) {
 
 //// API
 
-void image_cache_init(const char *path, image_cache_cb load_callback) {
+void image_cache_init(const char *path, image_cache_cb load_callback, int max_requests) {
     LOG("{image-cache} Initializing");
 
+    if (max_requests <= 0) {
+        max_requests = DEFAULT_MAX_REQUESTS;
+    } else if (max_requests > MAX_REQUESTS_LIMIT) {
+        max_requests = MAX_REQUESTS_LIMIT;
+    }
+    m_max_requests = max_requests;
+
     curl_global_init(CURL_GLOBAL_ALL);
 
     m_file_cache_path = strdup(path); // intentional leak
@@ -1102,7 +2077,18 @@ void image_cache_init(const char *path, image_cache_cb load_callback) {
     m_request_thread_running = true;
     m_worker_thread_running = true;
 
-    m_worker_thread = threads_create_thread(worker_run, 0);
+    m_save_thread_running = true;
+
+#ifndef IMGCACHE_STANDALONE
+    m_work_item_pool = CONCURRENT_POOL_INIT(struct work_item, WORK_ITEM_POOL_SLAB);
+    m_load_item_pool = CONCURRENT_POOL_INIT(struct load_item, LOAD_ITEM_POOL_SLAB);
+#endif
+
+    m_worker_thread = threads_create_thread_with_priority(worker_run, 0,
+                                                          THREADS_PRIORITY_UTILITY, THREADS_AFFINITY_ANY);
+    // writes files nobody waits on
+    m_save_thread = threads_create_thread_with_priority(save_run, 0,
+                                                        THREADS_PRIORITY_BACKGROUND, THREADS_AFFINITY_EFFICIENCY);
 }
 
 void image_cache_destroy() {
@@ -1111,6 +2097,11 @@ void image_cache_destroy() {
     pthread_mutex_lock(&m_request_mutex);
     m_request_thread_running = false;
     pthread_cond_signal(&m_request_cond);
+#ifdef IMGCACHE_MULTI_POLL
+    if (m_multi_handle) {
+        curl_multi_wakeup(m_multi_handle);
+    }
+#endif
     pthread_mutex_unlock(&m_request_mutex);
 
     pthread_mutex_lock(&m_worker_mutex);
@@ -1122,16 +2113,66 @@ void image_cache_destroy() {
     threads_join_thread(&m_worker_thread);
     threads_join_thread(&m_request_thread);
 
-    clear_cache();
+    // Let the save thread finish writing what was delivered
+    pthread_mutex_lock(&m_save_mutex);
+    m_save_thread_running = false;
+    pthread_cond_signal(&m_save_cond);
+    pthread_mutex_unlock(&m_save_mutex);
+    threads_join_thread(&m_save_thread);
+
+    close_index();
+    memory_cache_clear();
     clear_work_items();
+#ifndef IMGCACHE_STANDALONE
+    CONCURRENT_POOL_DESTROY(m_work_item_pool);
+    CONCURRENT_POOL_DESTROY(m_load_item_pool);
+    m_work_item_pool = 0;
+    m_load_item_pool = 0;
+#endif
     free(m_file_cache_path);
 
     LOG("{image-cache} ...Good night.");
 }
 
+void image_cache_set_max_bytes(size_t max_bytes) {
+    pthread_mutex_lock(&m_index_mutex);
+    m_cache_max_bytes = max_bytes > 0 ? max_bytes : CACHE_MAX_BYTES;
+    if (m_index) {
+        index_trim(INDEX_MAX_ENTRIES);
+    }
+    pthread_mutex_unlock(&m_index_mutex);
+}
+
+void image_cache_set_memory_max_bytes(size_t max_bytes) {
+    pthread_mutex_lock(&m_memory_mutex);
+    m_memory_max_bytes = max_bytes;
+    memory_cache_trim();
+    pthread_mutex_unlock(&m_memory_mutex);
+}
+
+size_t image_cache_memory_bytes() {
+    pthread_mutex_lock(&m_memory_mutex);
+    size_t bytes = m_memory_bytes;
+    pthread_mutex_unlock(&m_memory_mutex);
+    return bytes;
+}
+
+size_t image_cache_trim_memory(size_t bytes) {
+    size_t freed = 0;
+    pthread_mutex_lock(&m_memory_mutex);
+    while (m_memory_cache && freed < bytes) {
+        freed += m_memory_cache->size;
+        memory_cache_drop(m_memory_cache);
+    }
+    pthread_mutex_unlock(&m_memory_mutex);
+    return freed;
+}
+
 void image_cache_remove(const char *url) {
     DLOG("{image-cache} Removing image from cache: %s", url);
 
+    memory_cache_remove(url);
+
     if (image_exists_in_cache(url)) {
         char *filename = get_filename_from_url(url);
         if (filename) {
@@ -1140,11 +2181,8 @@ void image_cache_remove(const char *url) {
                 // Remove file from disk
                 remove(path);
 
-                // Also remove its etag so if we request it we do not expect it to be there
-                kill_etag_for_url(url);
-
-                // And update the etag database now
-                write_etags_to_cache();
+                // Also remove its entry so if we request it we do not expect it to be there
+                index_remove_url(url);
 
                 free(path);
             }
@@ -1153,23 +2191,124 @@ void image_cache_remove(const char *url) {
     }
 }
 
+// Gets the request thread to look at the queue, call with the request_mutex lock held
+static void wake_request_thread() {
+    pthread_cond_signal(&m_request_cond);
+#ifdef IMGCACHE_MULTI_POLL
+    // the request thread may be polling its transfers rather than waiting on the condition
+    if (m_multi_handle) {
+        curl_multi_wakeup(m_multi_handle);
+    }
+#endif
+}
+
 void image_cache_load(const char *url) {
-    // If image is already in cache,
-    if (image_exists_in_cache(url)) {
-        DLOG("{image-cache} Image exists in cache so attempt to return that: %s", url);
-        queue_work_item(url, 0, 0, true, false);
+    image_cache_load_with_priority(url, IMAGE_CACHE_PRIORITY_NORMAL);
+}
+
+void image_cache_load_with_priority(const char *url, int priority) {
+    struct load_item *load_item;
+
+    pthread_mutex_lock(&m_request_mutex);
+    HASH_FIND_STR(m_load_index, url, load_item);
+    if (load_item) {
+        // already on its way, its one response will serve this load too
+        if (!load_item->in_flight && priority > load_item->priority) {
+            load_queue_remove(load_item);
+            load_item->priority = priority;
+            load_queue_insert(load_item);
+        } else if (priority > load_item->priority) {
+            // a prefetch in flight now delivers its image
+            load_item->priority = priority;
+        }
+        load_item->cancelled = false;
+        pthread_mutex_unlock(&m_request_mutex);
+
+        DLOG("{image-cache} Already loading: %s", url);
+        return;
     }
+    pthread_mutex_unlock(&m_request_mutex);
 
-    // TODO: Do not request from server again within a certain amount of time
+    if (priority <= IMAGE_CACHE_PRIORITY_PREFETCH) {
+        // a prefetch only fills the disk
+        if (image_exists_in_cache(url)) {
+            return;
+        }
+    } else if (memory_cache_contains(url) || image_exists_in_cache(url)) {
+        // If image is already in cache,
+        DLOG("{image-cache} Image exists in cache so attempt to return that: %s", url);
+        queue_work_item(url, 0, 0, true, false, false);
+    }
 
-    // But also load it from the server again in case it has changed
-    volatile struct load_item *load_item = (struct load_item *)malloc(sizeof(struct load_item));
+    // But also load it from the server again in case it has changed, unless
+    // the request thread finds it was validated recently
+    load_item = LOAD_ITEM_ALLOC();
+    memset(load_item, 0, sizeof(struct load_item));
     load_item->url = strdup(url);
+    load_item->priority = priority;
+    load_item->queued = get_time_seconds();
 
     DLOG("{image-cache} Async loading: %s", url);
 
     pthread_mutex_lock(&m_request_mutex);
-    LIST_PUSH(m_load_items, load_item);
-    pthread_cond_signal(&m_request_cond);
+    struct load_item *existing;
+    HASH_FIND_STR(m_load_index, url, existing);
+    if (existing) {
+        // lost a race with another load of the same url
+        free(load_item->url);
+        LOAD_ITEM_FREE(load_item);
+    } else {
+        HASH_ADD_KEYPTR(hh, m_load_index, load_item->url, strlen(load_item->url), load_item);
+        load_queue_insert(load_item);
+        wake_request_thread();
+    }
+    pthread_mutex_unlock(&m_request_mutex);
+}
+
+void image_cache_prefetch(const char *url) {
+    image_cache_load_with_priority(url, IMAGE_CACHE_PRIORITY_PREFETCH);
+}
+
+void image_cache_set_network_metered(bool metered) {
+    pthread_mutex_lock(&m_request_mutex);
+    if (m_network_metered != metered) {
+        DLOG("{image-cache} Network is %s", metered ? "metered" : "unmetered");
+        m_network_metered = metered;
+        wake_request_thread();
+    }
+    pthread_mutex_unlock(&m_request_mutex);
+}
+
+void image_cache_set_priority(const char *url, int priority) {
+    struct load_item *load_item;
+
+    pthread_mutex_lock(&m_request_mutex);
+    HASH_FIND_STR(m_load_index, url, load_item);
+    if (load_item && !load_item->in_flight && load_item->priority != priority) {
+        load_queue_remove(load_item);
+        load_item->priority = priority;
+        load_queue_insert(load_item);
+    }
+    pthread_mutex_unlock(&m_request_mutex);
+}
+
+void image_cache_cancel(const char *url) {
+    struct load_item *load_item;
+
+    pthread_mutex_lock(&m_request_mutex);
+    HASH_FIND_STR(m_load_index, url, load_item);
+    if (load_item) {
+        DLOG("{image-cache} Cancelling: %s", url);
+
+        if (load_item->in_flight) {
+            // only the request thread may touch its transfers
+            load_item->cancelled = true;
+            m_cancel_pending = true;
+            wake_request_thread();
+        } else {
+            load_queue_remove(load_item);
+            free_load_item(load_item);
+        }
+    }
     pthread_mutex_unlock(&m_request_mutex);
 }
@@ -0,0 +1,420 @@
+/*
+ * Load benchmark for the image cache.
+ *
+ * Serves made up images from a local HTTP server that adds latency, caps
+ * bandwidth, fails a share of requests and answers a share of revalidations
+ * with 304, then loads every url through image_cache_load and reports
+ * throughput, time to the first callback and callback latency percentiles.
+ * The first pass starts with an empty cache, later passes start the cache
+ * again on the same directory so they measure revalidation and disk reads.
+ *
+ *   make bench && ./imagecache-bench -n 2000 -l 80 -b 256 -e 0.02 -r 0.8
+ */
+#define _GNU_SOURCE // strcasestr
+#include "image_cache.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_URL 128
+#define CHUNK_BYTES 16384
+// how long the cache has to stay quiet before a finished pass is reported
+#define SETTLE_MS 200
+#define PASS_TIMEOUT_S 600
+
+typedef struct options_t {
+    int urls;
+    int passes;
+    int max_requests; // 0 for the cache's default
+    int latency_ms;
+    int bandwidth_kb; // per response, 0 for unlimited
+    double error_rate;
+    double not_modified_rate; // of requests carrying If-None-Match
+    int min_bytes;
+    int max_bytes;
+    int max_age; // Cache-Control max-age sent with every image
+    const char *dir;
+} options;
+
+static options m_options = {1000, 2, 0, 50, 0, 0.0, 1.0, 2048, 65536, 0, NULL};
+
+// server side counts, read between passes
+static int m_port = 0;
+static char *m_payload = NULL;
+static int m_served = 0;
+static int m_not_modified = 0;
+static int m_errors = 0;
+static int m_in_flight = 0;
+static long long m_bytes_sent = 0;
+
+// client side, one slot per url
+static pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char (*m_urls)[MAX_URL] = NULL;
+static double *m_requested = NULL;
+static double *m_first_callback = NULL;
+static int m_called_back = 0; // urls with at least one callback
+static int m_callbacks = 0;
+static int m_failures = 0;
+static long long m_bytes_received = 0;
+static double m_last_callback = 0;
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_seconds(double s) {
+    if (s > 0) {
+        usleep((useconds_t)(s * 1e6));
+    }
+}
+
+// a repeatable number in [0, 1) for the request, so every run rolls the same
+static double roll(unsigned int a, unsigned int b) {
+    unsigned int h = a * 2654435761u ^ (b + 0x9e3779b9u + (a << 6) + (a >> 2));
+    h ^= h >> 16;
+    h *= 0x85ebca6bu;
+    h ^= h >> 13;
+    return (h & 0xffffff) / (double) 0x1000000;
+}
+
+static int payload_size(int index) {
+    int range = m_options.max_bytes - m_options.min_bytes;
+    return m_options.min_bytes + (int)(roll(index, 0) * (range + 1));
+}
+
+
+//// Server
+
+static bool send_all(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = send(fd, data, size, 0);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+// sends the body in chunks, sleeping to keep under the bandwidth cap
+static bool send_body(int fd, int size) {
+    double start = now_seconds();
+    double rate = m_options.bandwidth_kb * 1024.0;
+    int sent = 0;
+    while (sent < size) {
+        int chunk = size - sent < CHUNK_BYTES ? size - sent : CHUNK_BYTES;
+        if (!send_all(fd, m_payload + sent, chunk)) {
+            return false;
+        }
+        sent += chunk;
+        if (rate > 0) {
+            sleep_seconds(start + sent / rate - now_seconds());
+        }
+    }
+    return true;
+}
+
+// answers one request, false if the connection should be closed
+static bool handle_request(int fd, char *request) {
+    int index = -1;
+    if (sscanf(request, "GET /img/%d", &index) != 1 || index < 0) {
+        const char *bad = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+        return send_all(fd, bad, strlen(bad));
+    }
+
+    unsigned int request_no = __atomic_add_fetch(&m_served, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&m_in_flight, 1, __ATOMIC_RELAXED);
+    sleep_seconds(m_options.latency_ms / 1000.0);
+
+    char header[512];
+    bool ok;
+    int size = payload_size(index);
+    if (roll(index, request_no) < m_options.error_rate) {
+        __atomic_add_fetch(&m_errors, 1, __ATOMIC_RELAXED);
+        snprintf(header, sizeof(header), "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n");
+        ok = send_all(fd, header, strlen(header));
+    } else if (strcasestr(request, "\nIf-None-Match:") && roll(request_no, index) < m_options.not_modified_rate) {
+        __atomic_add_fetch(&m_not_modified, 1, __ATOMIC_RELAXED);
+        snprintf(header, sizeof(header), "HTTP/1.1 304 Not Modified\r\nETag: \"%d-%d\"\r\n"
+                 "Cache-Control: max-age=%d\r\n\r\n", index, size, m_options.max_age);
+        ok = send_all(fd, header, strlen(header));
+    } else {
+        snprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Type: image/png\r\nContent-Length: %d\r\n"
+                 "ETag: \"%d-%d\"\r\nCache-Control: max-age=%d\r\n\r\n", size, index, size, m_options.max_age);
+        ok = send_all(fd, header, strlen(header)) && send_body(fd, size);
+        if (ok) {
+            __atomic_add_fetch(&m_bytes_sent, size, __ATOMIC_RELAXED);
+        }
+    }
+
+    __atomic_sub_fetch(&m_in_flight, 1, __ATOMIC_RELAXED);
+    return ok;
+}
+
+// serves requests on a kept alive connection until the client closes it
+static void *serve_connection(void *arg) {
+    int fd = (int)(intptr_t) arg;
+    char buffer[8192];
+    size_t have = 0;
+
+    for (;;) {
+        char *end;
+        buffer[have] = '\0';
+        while (!(end = strstr(buffer, "\r\n\r\n"))) {
+            if (have >= sizeof(buffer) - 1) {
+                goto done;
+            }
+            ssize_t n = recv(fd, buffer + have, sizeof(buffer) - 1 - have, 0);
+            if (n <= 0) {
+                goto done;
+            }
+            have += n;
+            buffer[have] = '\0';
+        }
+
+        size_t length = end + 4 - buffer;
+        end[2] = '\0';
+        if (!handle_request(fd, buffer)) {
+            goto done;
+        }
+        memmove(buffer, buffer + length, have - length);
+        have -= length;
+    }
+
+done:
+    close(fd);
+    return NULL;
+}
+
+static void *accept_connections(void *arg) {
+    int listener = (int)(intptr_t) arg;
+    for (;;) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, serve_connection, (void *)(intptr_t) fd)) {
+            close(fd);
+        } else {
+            pthread_detach(thread);
+        }
+    }
+    return NULL;
+}
+
+static bool start_server() {
+    m_payload = (char *) malloc(m_options.max_bytes);
+    if (!m_payload) {
+        return false;
+    }
+    // bytes that don't compress, like a real image
+    for (int i = 0; i < m_options.max_bytes; i++) {
+        m_payload[i] = (char)(roll(i, 1) * 256);
+    }
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    socklen_t length = sizeof(address);
+    if (listener < 0 || bind(listener, (struct sockaddr *) &address, sizeof(address)) ||
+        listen(listener, 128) || getsockname(listener, (struct sockaddr *) &address, &length)) {
+        perror("bench: server");
+        return false;
+    }
+    m_port = ntohs(address.sin_port);
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, accept_connections, (void *)(intptr_t) listener)) {
+        return false;
+    }
+    pthread_detach(thread);
+    return true;
+}
+
+
+//// Client
+
+static int find_url(const char *url) {
+    int index = -1;
+    const char *path = url ? strstr(url, "/img/") : NULL;
+    if (path && sscanf(path, "/img/%d", &index) == 1 && index >= 0 && index < m_options.urls) {
+        return index;
+    }
+    return -1;
+}
+
+static void on_image_loaded(struct image_data *data) {
+    double now = now_seconds();
+    int index = find_url(data ? data->url : NULL);
+
+    pthread_mutex_lock(&m_mutex);
+    m_callbacks++;
+    m_last_callback = now;
+    if (!data || !data->bytes) {
+        m_failures++;
+    } else {
+        m_bytes_received += data->size;
+    }
+    if (index >= 0 && m_first_callback[index] == 0) {
+        m_first_callback[index] = now;
+        m_called_back++;
+    }
+    pthread_mutex_unlock(&m_mutex);
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const double *sorted, int count, double p) {
+    int i = (int)(p * (count - 1) + 0.5);
+    return count ? sorted[i] : 0;
+}
+
+// loads every url once and waits for the cache and the server to go quiet
+static void run_pass(int pass) {
+    int served = m_served, not_modified = m_not_modified, errors = m_errors;
+    long long bytes_sent = m_bytes_sent;
+
+    memset(m_first_callback, 0, m_options.urls * sizeof(double));
+    m_called_back = m_callbacks = m_failures = 0;
+    m_bytes_received = 0;
+    m_last_callback = 0;
+
+    image_cache_init(m_options.dir, on_image_loaded, m_options.max_requests);
+
+    double start = now_seconds();
+    for (int i = 0; i < m_options.urls; i++) {
+        m_requested[i] = now_seconds();
+        image_cache_load(m_urls[i]);
+    }
+    double queued = now_seconds();
+
+    for (;;) {
+        usleep(10000);
+        double now = now_seconds();
+        pthread_mutex_lock(&m_mutex);
+        bool quiet = m_called_back == m_options.urls && now - m_last_callback > SETTLE_MS / 1000.0;
+        pthread_mutex_unlock(&m_mutex);
+        if ((quiet && __atomic_load_n(&m_in_flight, __ATOMIC_RELAXED) == 0) || now - start > PASS_TIMEOUT_S) {
+            break;
+        }
+    }
+
+    image_cache_destroy();
+
+    double *latencies = (double *) malloc(m_options.urls * sizeof(double));
+    int count = 0;
+    double first = 0;
+    for (int i = 0; i < m_options.urls; i++) {
+        if (m_first_callback[i] > 0) {
+            latencies[count++] = (m_first_callback[i] - m_requested[i]) * 1000;
+            if (first == 0 || m_first_callback[i] < first) {
+                first = m_first_callback[i];
+            }
+        }
+    }
+    qsort(latencies, count, sizeof(double), compare_doubles);
+
+    double elapsed = (m_last_callback > start ? m_last_callback : now_seconds()) - start;
+    printf("pass %d (%s cache)\n", pass, pass == 1 ? "cold" : "warm");
+    printf("  urls %d, called back %d, callbacks %d, failed %d\n",
+           m_options.urls, m_called_back, m_callbacks, m_failures);
+    printf("  server: requests %d, 304 %d, errors %d, sent %.2f MB\n",
+           m_served - served, m_not_modified - not_modified, m_errors - errors,
+           (m_bytes_sent - bytes_sent) / 1048576.0);
+    printf("  queueing %.1f ms, first callback %.1f ms, all %.1f ms\n",
+           (queued - start) * 1000, first > 0 ? (first - start) * 1000 : 0, elapsed * 1000);
+    printf("  throughput %.1f urls/s, %.2f MB/s delivered\n",
+           elapsed > 0 ? m_called_back / elapsed : 0, elapsed > 0 ? m_bytes_received / 1048576.0 / elapsed : 0);
+    printf("  latency ms p50 %.1f, p95 %.1f, p99 %.1f, max %.1f\n",
+           percentile(latencies, count, 0.5), percentile(latencies, count, 0.95),
+           percentile(latencies, count, 0.99), count ? latencies[count - 1] : 0);
+    free(latencies);
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "usage: %s [-n urls] [-p passes] [-c max requests] [-l latency ms]\n"
+            "       [-b bandwidth KB/s per response] [-e error rate] [-r 304 rate]\n"
+            "       [-s min bytes] [-S max bytes] [-a max-age s] [-d cache dir]\n", name);
+}
+
+int main(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "n:p:c:l:b:e:r:s:S:a:d:h")) != -1) {
+        switch (opt) {
+        case 'n': m_options.urls = atoi(optarg); break;
+        case 'p': m_options.passes = atoi(optarg); break;
+        case 'c': m_options.max_requests = atoi(optarg); break;
+        case 'l': m_options.latency_ms = atoi(optarg); break;
+        case 'b': m_options.bandwidth_kb = atoi(optarg); break;
+        case 'e': m_options.error_rate = atof(optarg); break;
+        case 'r': m_options.not_modified_rate = atof(optarg); break;
+        case 's': m_options.min_bytes = atoi(optarg); break;
+        case 'S': m_options.max_bytes = atoi(optarg); break;
+        case 'a': m_options.max_age = atoi(optarg); break;
+        case 'd': m_options.dir = optarg; break;
+        default: usage(argv[0]); return 1;
+        }
+    }
+    if (m_options.urls <= 0 || m_options.passes <= 0 || m_options.min_bytes <= 0 ||
+        m_options.max_bytes < m_options.min_bytes) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    static char dir[] = "/tmp/imagecache-bench-XXXXXX";
+    if (!m_options.dir) {
+        m_options.dir = mkdtemp(dir);
+        if (!m_options.dir) {
+            perror("bench: cache dir");
+            return 1;
+        }
+    }
+
+    // a client closing a connection early is not an error
+    signal(SIGPIPE, SIG_IGN);
+    if (!start_server()) {
+        return 1;
+    }
+
+    m_urls = (char (*)[MAX_URL]) malloc(m_options.urls * MAX_URL);
+    m_requested = (double *) malloc(m_options.urls * sizeof(double));
+    m_first_callback = (double *) malloc(m_options.urls * sizeof(double));
+    for (int i = 0; i < m_options.urls; i++) {
+        snprintf(m_urls[i], MAX_URL, "http://127.0.0.1:%d/img/%d", m_port, i);
+    }
+
+    printf("%d urls of %d-%d bytes, latency %d ms, bandwidth %d KB/s, errors %.0f%%, 304 %.0f%%, cache %s\n",
+           m_options.urls, m_options.min_bytes, m_options.max_bytes, m_options.latency_ms,
+           m_options.bandwidth_kb, m_options.error_rate * 100, m_options.not_modified_rate * 100, m_options.dir);
+
+    for (int pass = 1; pass <= m_options.passes; pass++) {
+        run_pass(pass);
+    }
+
+    free(m_urls);
+    free(m_requested);
+    free(m_first_callback);
+    return 0;
+}
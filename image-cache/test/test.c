@@ -29,7 +29,7 @@ int main(void) {
     m_got_response = 0;
 
     // Use test folder for cache
-    image_cache_init("test", on_image_loaded);
+    image_cache_init("test", on_image_loaded, 0);
 
     image_cache_load("http://unresolvableserverkfsdjghsdkj.com/imageneverloaded.png");
     image_cache_load("https://unresolvableserverkfsdjghsdkj.com/imageneverloaded.png");
@@ -14,13 +14,27 @@
  */
 
 #include "core/image_loader.h"
+#include "core/types.h"
+#include "core/util/detect.h"
 #include "log.h"
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
 
 #include "core/deps/turbojpeg/turbojpeg.h"
+#include "core/deps/turbojpeg/jpeglib.h"
+
+// libwebp comes from the platform build, it is not part of core/deps
+#ifdef ENABLE_WEBP
+#include <webp/decode.h>
+#endif
 
 #define TEXTURE_LOAD_ERROR 0
 
+static const unsigned char KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+static const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
 
 //// Conversion from Base64
 
@@ -47,6 +61,96 @@ static const unsigned char FROM_BASE64[256] = {
 
 #undef DC
 
+/*
+ * SIMD kernel for ReadBase64.  It decodes whole vectors of complete groups
+ * of four characters and returns how many characters it consumed; anything
+ * outside the alphabet decodes as zero, the same as FROM_BASE64.
+ */
+
+#if defined(GC_HAS_NEON)
+#include <arm_neon.h>
+
+// Maps base64 characters to their 6 bit values
+static inline uint8x16_t base64_values(uint8x16_t c) {
+    uint8x16_t upper = vandq_u8(vcgeq_u8(c, vdupq_n_u8('A')), vcleq_u8(c, vdupq_n_u8('Z')));
+    uint8x16_t lower = vandq_u8(vcgeq_u8(c, vdupq_n_u8('a')), vcleq_u8(c, vdupq_n_u8('z')));
+    uint8x16_t digit = vandq_u8(vcgeq_u8(c, vdupq_n_u8('0')), vcleq_u8(c, vdupq_n_u8('9')));
+    uint8x16_t v = vandq_u8(upper, vsubq_u8(c, vdupq_n_u8('A')));
+    v = vorrq_u8(v, vandq_u8(lower, vsubq_u8(c, vdupq_n_u8('a' - 26))));
+    v = vorrq_u8(v, vandq_u8(digit, vaddq_u8(c, vdupq_n_u8(52 - '0'))));
+    v = vorrq_u8(v, vandq_u8(vceqq_u8(c, vdupq_n_u8('+')), vdupq_n_u8(62)));
+    v = vorrq_u8(v, vandq_u8(vceqq_u8(c, vdupq_n_u8('/')), vdupq_n_u8(63)));
+    return v;
+}
+
+static int base64_decode_simd(const unsigned char *in, int chars, unsigned char *out) {
+    int done = 0;
+    for (; done + 64 <= chars; done += 64, in += 64, out += 48) {
+        uint8x16x4_t s = vld4q_u8(in);
+        uint8x16_t a = base64_values(s.val[0]);
+        uint8x16_t b = base64_values(s.val[1]);
+        uint8x16_t c = base64_values(s.val[2]);
+        uint8x16_t d = base64_values(s.val[3]);
+
+        uint8x16x3_t o;
+        o.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+        o.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(c, 2));
+        o.val[2] = vorrq_u8(vshlq_n_u8(c, 6), d);
+        vst3q_u8(out, o);
+    }
+    return done;
+}
+
+#elif defined(GC_HAS_SSE)
+#include <emmintrin.h>
+
+// Selects the bytes of c within [lo, hi], signed compares leave 128-255 out
+static inline __m128i base64_range(__m128i c, char lo, char hi) {
+    return _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8(lo - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8(hi + 1)));
+}
+
+// Maps base64 characters to their 6 bit values
+static inline __m128i base64_values(__m128i c) {
+    __m128i v = _mm_and_si128(base64_range(c, 'A', 'Z'), _mm_sub_epi8(c, _mm_set1_epi8('A')));
+    v = _mm_or_si128(v, _mm_and_si128(base64_range(c, 'a', 'z'), _mm_sub_epi8(c, _mm_set1_epi8('a' - 26))));
+    v = _mm_or_si128(v, _mm_and_si128(base64_range(c, '0', '9'), _mm_add_epi8(c, _mm_set1_epi8(52 - '0'))));
+    v = _mm_or_si128(v, _mm_and_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('+')), _mm_set1_epi8(62)));
+    v = _mm_or_si128(v, _mm_and_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('/')), _mm_set1_epi8(63)));
+    return v;
+}
+
+static int base64_decode_simd(const unsigned char *in, int chars, unsigned char *out) {
+    int done = 0;
+    for (; done + 16 <= chars; done += 16, in += 16, out += 12) {
+        // one group of four values per 32 bit lane, first character lowest
+        __m128i u = base64_values(_mm_loadu_si128((const __m128i *) in));
+
+        // pack each lane's 24 bits into its low three bytes, in output order
+        __m128i o = _mm_and_si128(_mm_slli_epi32(u, 2), _mm_set1_epi32(0xfc));
+        o = _mm_or_si128(o, _mm_and_si128(_mm_srli_epi32(u, 12), _mm_set1_epi32(0x03)));
+        o = _mm_or_si128(o, _mm_and_si128(_mm_slli_epi32(u, 4), _mm_set1_epi32(0xf000)));
+        o = _mm_or_si128(o, _mm_and_si128(_mm_srli_epi32(u, 10), _mm_set1_epi32(0x0f00)));
+        o = _mm_or_si128(o, _mm_and_si128(_mm_slli_epi32(u, 6), _mm_set1_epi32(0xc00000)));
+        o = _mm_or_si128(o, _mm_and_si128(_mm_srli_epi32(u, 8), _mm_set1_epi32(0x3f0000)));
+
+        unsigned char lanes[16];
+        _mm_storeu_si128((__m128i *) lanes, o);
+        memcpy(out, lanes, 3);
+        memcpy(out + 3, lanes + 4, 3);
+        memcpy(out + 6, lanes + 8, 3);
+        memcpy(out + 9, lanes + 12, 3);
+    }
+    return done;
+}
+
+#else
+
+static int base64_decode_simd(const unsigned char *in, int chars, unsigned char *out) {
+    return 0;
+}
+
+#endif
+
 
 static int GetBinaryLengthFromBase64Length(const char *encoded_buffer, int bytes) {
     if (bytes <= 0) {
@@ -89,8 +193,11 @@ static int ReadBase64(const char *encoded_buffer, int encoded_bytes, void *decod
 
     unsigned char a, b, c, d;
 
-    int ii, jj, end;
-    for (ii = 0, jj = 0, end = encoded_bytes - 3; ii < end; ii += 4, jj += 3) {
+    // the vector kernel only takes complete groups, as the loop below does
+    int ii = base64_decode_simd(from, encoded_bytes & ~3, to);
+    int jj = (ii / 4) * 3;
+    int end;
+    for (end = encoded_bytes - 3; ii < end; ii += 4, jj += 3) {
         a = FROM_BASE64[from[ii]];
         b = FROM_BASE64[from[ii+1]];
         c = FROM_BASE64[from[ii+2]];
@@ -126,6 +233,633 @@ unsigned short readShort(unsigned char *bits) {
     return (bits[0] << 8) + bits[1];
 }
 
+//// Compressed texture formats
+
+typedef struct compressed_format_t {
+    int gl_format;
+    int family;
+    int block_width;
+    int block_height;
+    int block_bytes;
+    int min_blocks; // pvrtc levels take at least 2x2 blocks
+    int channels;
+} compressed_format;
+
+static const compressed_format COMPRESSED_FORMATS[] = {
+    { 0x8D64, IMAGE_COMPRESSION_ETC1, 4, 4, 8, 1, 3 },   // GL_ETC1_RGB8_OES
+    { 0x9270, IMAGE_COMPRESSION_ETC2, 4, 4, 8, 1, 1 },   // GL_COMPRESSED_R11_EAC
+    { 0x9271, IMAGE_COMPRESSION_ETC2, 4, 4, 8, 1, 1 },   // GL_COMPRESSED_SIGNED_R11_EAC
+    { 0x9272, IMAGE_COMPRESSION_ETC2, 4, 4, 16, 1, 2 },  // GL_COMPRESSED_RG11_EAC
+    { 0x9273, IMAGE_COMPRESSION_ETC2, 4, 4, 16, 1, 2 },  // GL_COMPRESSED_SIGNED_RG11_EAC
+    { 0x9274, IMAGE_COMPRESSION_ETC2, 4, 4, 8, 1, 3 },   // GL_COMPRESSED_RGB8_ETC2
+    { 0x9275, IMAGE_COMPRESSION_ETC2, 4, 4, 8, 1, 3 },   // GL_COMPRESSED_SRGB8_ETC2
+    { 0x9276, IMAGE_COMPRESSION_ETC2, 4, 4, 8, 1, 4 },   // GL_COMPRESSED_RGB8_PUNCHTHROUGH_ALPHA1_ETC2
+    { 0x9277, IMAGE_COMPRESSION_ETC2, 4, 4, 8, 1, 4 },   // GL_COMPRESSED_SRGB8_PUNCHTHROUGH_ALPHA1_ETC2
+    { 0x9278, IMAGE_COMPRESSION_ETC2, 4, 4, 16, 1, 4 },  // GL_COMPRESSED_RGBA8_ETC2_EAC
+    { 0x9279, IMAGE_COMPRESSION_ETC2, 4, 4, 16, 1, 4 },  // GL_COMPRESSED_SRGB8_ALPHA8_ETC2_EAC
+    { 0x8C00, IMAGE_COMPRESSION_PVRTC, 4, 4, 8, 2, 3 },  // GL_COMPRESSED_RGB_PVRTC_4BPPV1_IMG
+    { 0x8C01, IMAGE_COMPRESSION_PVRTC, 8, 4, 8, 2, 3 },  // GL_COMPRESSED_RGB_PVRTC_2BPPV1_IMG
+    { 0x8C02, IMAGE_COMPRESSION_PVRTC, 4, 4, 8, 2, 4 },  // GL_COMPRESSED_RGBA_PVRTC_4BPPV1_IMG
+    { 0x8C03, IMAGE_COMPRESSION_PVRTC, 8, 4, 8, 2, 4 },  // GL_COMPRESSED_RGBA_PVRTC_2BPPV1_IMG
+};
+
+#define COMPRESSED_FORMAT_COUNT (int)(sizeof(COMPRESSED_FORMATS) / sizeof(COMPRESSED_FORMATS[0]))
+
+// ASTC block footprints, GL_COMPRESSED_RGBA_ASTC_4x4_KHR onwards in order
+static const unsigned char ASTC_BLOCKS[14][2] = {
+    {4, 4}, {5, 4}, {5, 5}, {6, 5}, {6, 6}, {8, 5}, {8, 6},
+    {8, 8}, {10, 5}, {10, 6}, {10, 8}, {10, 10}, {12, 10}, {12, 12}
+};
+
+#define GL_COMPRESSED_RGBA_ASTC_4x4 0x93B0
+#define GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4 0x93D0
+
+// families the gl context can sample from, ETC1 is assumed until told otherwise
+static unsigned int m_compression_support = IMAGE_COMPRESSION_ETC1;
+
+/**
+ * @name	image_loader_set_compression_support
+ * @brief	sets which compressed formats container images may use
+ * @param	families - (unsigned int) IMAGE_COMPRESSION_* flags
+ * @retval	NONE
+ */
+void image_loader_set_compression_support(unsigned int families) {
+    m_compression_support = families;
+}
+
+/**
+ * @name	image_loader_get_compression_support
+ * @brief	gets which compressed formats container images may use
+ * @retval	unsigned int - IMAGE_COMPRESSION_* flags
+ */
+unsigned int image_loader_get_compression_support() {
+    return m_compression_support;
+}
+
+static bool get_compressed_format(int gl_format, compressed_format *out) {
+    int i;
+    for (i = 0; i < COMPRESSED_FORMAT_COUNT; i++) {
+        if (COMPRESSED_FORMATS[i].gl_format == gl_format) {
+            *out = COMPRESSED_FORMATS[i];
+            return true;
+        }
+    }
+
+    int astc = gl_format - GL_COMPRESSED_RGBA_ASTC_4x4;
+    if (astc < 0 || astc >= 14) {
+        astc = gl_format - GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4;
+    }
+    if (astc >= 0 && astc < 14) {
+        out->gl_format = gl_format;
+        out->family = IMAGE_COMPRESSION_ASTC;
+        out->block_width = ASTC_BLOCKS[astc][0];
+        out->block_height = ASTC_BLOCKS[astc][1];
+        out->block_bytes = 16;
+        out->min_blocks = 1;
+        out->channels = 4;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @name	image_loader_compressed_level_size
+ * @brief	gets the bytes one mip level of a compressed texture takes
+ * @param	gl_format - (int) gl compressed internal format
+ * @param	width - (int) width of the level
+ * @param	height - (int) height of the level
+ * @retval	long - size of the level, 0 for formats not known here
+ */
+long image_loader_compressed_level_size(int gl_format, int width, int height) {
+    compressed_format format;
+    if (!get_compressed_format(gl_format, &format)) {
+        return 0;
+    }
+
+    long blocks_x = (width + format.block_width - 1) / format.block_width;
+    long blocks_y = (height + format.block_height - 1) / format.block_height;
+    if (blocks_x < format.min_blocks) {
+        blocks_x = format.min_blocks;
+    }
+    if (blocks_y < format.min_blocks) {
+        blocks_y = format.min_blocks;
+    }
+
+    return blocks_x * blocks_y * format.block_bytes;
+}
+
+static unsigned int read_u32(const unsigned char *bits, bool swap) {
+    if (swap) {
+        return ((unsigned int) bits[0] << 24) | ((unsigned int) bits[1] << 16) | ((unsigned int) bits[2] << 8) | bits[3];
+    }
+    return ((unsigned int) bits[3] << 24) | ((unsigned int) bits[2] << 16) | ((unsigned int) bits[1] << 8) | bits[0];
+}
+
+static unsigned long long read_u64(const unsigned char *bits) {
+    return (unsigned long long) read_u32(bits, false) | ((unsigned long long) read_u32(bits + 4, false) << 32);
+}
+
+// maps KTX2 vulkan formats to gl ones, 0 if not a compressed format we take
+static int gl_format_from_vk(unsigned int vk_format) {
+    if (vk_format >= 147 && vk_format <= 156) {
+        // VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK .. VK_FORMAT_EAC_R11G11_SNORM_BLOCK
+        static const int ETC2[] = { 0x9274, 0x9275, 0x9276, 0x9277, 0x9278, 0x9279, 0x9270, 0x9271, 0x9272, 0x9273 };
+        return ETC2[vk_format - 147];
+    } else if (vk_format >= 157 && vk_format <= 184) {
+        // VK_FORMAT_ASTC_4x4_UNORM_BLOCK .. VK_FORMAT_ASTC_12x12_SRGB_BLOCK, unorm and srgb alternate
+        int astc = (vk_format - 157) / 2;
+        return ((vk_format - 157) & 1 ? GL_COMPRESSED_SRGB8_ALPHA8_ASTC_4x4 : GL_COMPRESSED_RGBA_ASTC_4x4) + astc;
+    } else if (vk_format == 1000054000) {
+        return 0x8C03; // VK_FORMAT_PVRTC1_2BPP_UNORM_BLOCK_IMG
+    } else if (vk_format == 1000054001) {
+        return 0x8C02; // VK_FORMAT_PVRTC1_4BPP_UNORM_BLOCK_IMG
+    }
+    return 0;
+}
+
+// checks a container's format can be uploaded here and fills in its details
+static bool accept_compressed_format(int gl_format, compressed_format *format) {
+    if (!get_compressed_format(gl_format, format)) {
+        LOG("{resources} WARNING: Unsupported compressed texture format 0x%X", gl_format);
+        return false;
+    }
+    if (!(m_compression_support & format->family)) {
+        LOG("{resources} WARNING: Compressed texture format 0x%X is not supported by this device", gl_format);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @name	load_ktx_from_memory
+ * @brief	reads a 2D compressed texture out of a KTX container, keeping
+ *			every mip level packed one after another
+ * @param	bits - (unsigned char *) the container
+ * @param	bits_length - (long) size of the container
+ * @param	width - (int *) width of the base level
+ * @param	height - (int *) height of the base level
+ * @param	channels - (int *) channels of the format
+ * @param	size - (long *) bytes of all levels
+ * @param	compression_type - (int *) gl internal format
+ * @retval	unsigned char* - the levels, NULL on failure
+ */
+static unsigned char *load_ktx_from_memory(unsigned char *bits, long bits_length, int *width, int *height, int *channels, long *size, int *compression_type) {
+    if (bits_length < 64) {
+        return NULL;
+    }
+
+    const unsigned int endianness = read_u32(bits + 12, false);
+    const bool swap = endianness == 0x01020304;
+    if (!swap && endianness != 0x04030201) {
+        return NULL;
+    }
+
+    const unsigned int gl_type = read_u32(bits + 16, swap);
+    const int gl_format = (int) read_u32(bits + 28, swap);
+    const int w = (int) read_u32(bits + 36, swap);
+    const int h = (int) read_u32(bits + 40, swap);
+    const unsigned int depth = read_u32(bits + 44, swap);
+    const unsigned int array_elements = read_u32(bits + 48, swap);
+    const unsigned int faces = read_u32(bits + 52, swap);
+    unsigned int levels = read_u32(bits + 56, swap);
+    const unsigned int key_value_bytes = read_u32(bits + 60, swap);
+
+    if (gl_type != 0 || depth > 1 || array_elements > 1 || faces != 1 || w <= 0 || h <= 0) {
+        LOG("{resources} WARNING: Only compressed 2D KTX textures can be loaded");
+        return NULL;
+    }
+
+    compressed_format format;
+    if (!accept_compressed_format(gl_format, &format)) {
+        return NULL;
+    }
+    if (levels == 0) {
+        levels = 1;
+    }
+
+    // find how much room the levels take before copying them out
+    long total = 0;
+    long offset = 64 + (long) key_value_bytes;
+    unsigned int i;
+    for (i = 0; i < levels; i++) {
+        if (offset + 4 > bits_length) {
+            return NULL;
+        }
+        long level_size = (long) read_u32(bits + offset, swap);
+        if (level_size <= 0 || offset + 4 + level_size > bits_length) {
+            return NULL;
+        }
+        total += level_size;
+        offset += 4 + ((level_size + 3) & ~3);
+    }
+
+    unsigned char *data = (unsigned char *) malloc(total);
+    if (!data) {
+        return NULL;
+    }
+
+    long written = 0;
+    offset = 64 + (long) key_value_bytes;
+    for (i = 0; i < levels; i++) {
+        long level_size = (long) read_u32(bits + offset, swap);
+        memcpy(data + written, bits + offset + 4, level_size);
+        written += level_size;
+        offset += 4 + ((level_size + 3) & ~3);
+    }
+
+    *width = w;
+    *height = h;
+    *channels = format.channels;
+    *size = total;
+    *compression_type = gl_format;
+    return data;
+}
+
+/**
+ * @name	load_ktx2_from_memory
+ * @brief	reads a 2D compressed texture out of a KTX2 container without
+ *			supercompression, keeping every mip level packed largest first
+ * @param	bits - (unsigned char *) the container
+ * @param	bits_length - (long) size of the container
+ * @param	width - (int *) width of the base level
+ * @param	height - (int *) height of the base level
+ * @param	channels - (int *) channels of the format
+ * @param	size - (long *) bytes of all levels
+ * @param	compression_type - (int *) gl internal format
+ * @retval	unsigned char* - the levels, NULL on failure
+ */
+static unsigned char *load_ktx2_from_memory(unsigned char *bits, long bits_length, int *width, int *height, int *channels, long *size, int *compression_type) {
+    if (bits_length < 80) {
+        return NULL;
+    }
+
+    const unsigned int vk_format = read_u32(bits + 12, false);
+    const int w = (int) read_u32(bits + 20, false);
+    const int h = (int) read_u32(bits + 24, false);
+    const unsigned int depth = read_u32(bits + 28, false);
+    const unsigned int layers = read_u32(bits + 32, false);
+    const unsigned int faces = read_u32(bits + 36, false);
+    unsigned int levels = read_u32(bits + 40, false);
+    const unsigned int supercompression = read_u32(bits + 44, false);
+
+    if (depth > 1 || layers > 1 || faces != 1 || w <= 0 || h <= 0) {
+        LOG("{resources} WARNING: Only 2D KTX2 textures can be loaded");
+        return NULL;
+    }
+    if (supercompression != 0) {
+        LOG("{resources} WARNING: Supercompressed KTX2 textures are not supported");
+        return NULL;
+    }
+
+    const int gl_format = gl_format_from_vk(vk_format);
+    compressed_format format;
+    if (!gl_format) {
+        LOG("{resources} WARNING: Unsupported KTX2 format %u", vk_format);
+        return NULL;
+    }
+    if (!accept_compressed_format(gl_format, &format)) {
+        return NULL;
+    }
+    if (levels == 0) {
+        levels = 1;
+    }
+    if (80 + (long) levels * 24 > bits_length) {
+        return NULL;
+    }
+
+    long total = 0;
+    unsigned int i;
+    for (i = 0; i < levels; i++) {
+        const unsigned char *entry = bits + 80 + i * 24;
+        unsigned long long level_offset = read_u64(entry);
+        unsigned long long level_size = read_u64(entry + 8);
+        if (level_size == 0 || level_offset + level_size > (unsigned long long) bits_length) {
+            return NULL;
+        }
+        total += (long) level_size;
+    }
+
+    unsigned char *data = (unsigned char *) malloc(total);
+    if (!data) {
+        return NULL;
+    }
+
+    long written = 0;
+    for (i = 0; i < levels; i++) {
+        const unsigned char *entry = bits + 80 + i * 24;
+        long level_offset = (long) read_u64(entry);
+        long level_size = (long) read_u64(entry + 8);
+        memcpy(data + written, bits + level_offset, level_size);
+        written += level_size;
+    }
+
+    *width = w;
+    *height = h;
+    *channels = format.channels;
+    *size = total;
+    *compression_type = gl_format;
+    return data;
+}
+
+/**
+ * @name	image_loader_sniff_format
+ * @brief	tells the container of an image file from its first bytes
+ * @param	bits - (const unsigned char *) start of the file
+ * @param	bits_length - (long) bytes available
+ * @retval	int - IMAGE_FORMAT_*, IMAGE_FORMAT_UNKNOWN if not recognised
+ */
+int image_loader_sniff_format(const unsigned char *bits, long bits_length) {
+    if (bits_length < 8) {
+        return IMAGE_FORMAT_UNKNOWN;
+    }
+    if (!png_sig_cmp((png_bytep) bits, 0, 8)) {
+        return IMAGE_FORMAT_PNG;
+    }
+    if (!strncmp("PKM 10", (const char *) bits, 6)) {
+        return IMAGE_FORMAT_PKM;
+    }
+    if (bits[0] == 0xFF && bits[1] == 0xD8) {
+        return IMAGE_FORMAT_JPEG;
+    }
+    if (bits_length >= 12 && !memcmp(bits, KTX_IDENTIFIER, 12)) {
+        return IMAGE_FORMAT_KTX;
+    }
+    if (bits_length >= 12 && !memcmp(bits, KTX2_IDENTIFIER, 12)) {
+        return IMAGE_FORMAT_KTX2;
+    }
+    if (bits_length >= 12 && !memcmp(bits, "RIFF", 4) && !memcmp(bits + 8, "WEBP", 4)) {
+        return IMAGE_FORMAT_WEBP;
+    }
+    return IMAGE_FORMAT_UNKNOWN;
+}
+
+// reads width, height and decoded channels from the chunks before the image data
+static bool probe_png(const unsigned char *bits, long bits_length, image_info *info) {
+    // signature, then IHDR: length, type, width, height, depth, color type
+    if (bits_length < 8 + 8 + 13 || memcmp(bits + 12, "IHDR", 4)) {
+        return false;
+    }
+    info->width = (int) read_u32(bits + 16, true);
+    info->height = (int) read_u32(bits + 20, true);
+
+    const int color_type = bits[25];
+    switch (color_type) {
+    case PNG_COLOR_TYPE_GRAY: info->channels = 1; break;
+    case PNG_COLOR_TYPE_GRAY_ALPHA: info->channels = 2; break;
+    case PNG_COLOR_TYPE_RGB: info->channels = 3; break;
+    case PNG_COLOR_TYPE_RGB_ALPHA: info->channels = 4; break;
+    case PNG_COLOR_TYPE_PALETTE: {
+        // expanding the palette adds alpha when there is a tRNS chunk
+        info->channels = 3;
+        long offset = 8;
+        while (offset + 8 <= bits_length) {
+            const unsigned char *chunk = bits + offset;
+            if (!memcmp(chunk + 4, "tRNS", 4)) {
+                info->channels = 4;
+                break;
+            }
+            if (!memcmp(chunk + 4, "IDAT", 4)) {
+                break;
+            }
+            offset += 12 + (long) read_u32(chunk, true);
+        }
+        break;
+    }
+    default:
+        return false;
+    }
+    return true;
+}
+
+// finds the start of frame marker, JPEG images always decode to RGB
+static bool probe_jpeg(const unsigned char *bits, long bits_length, image_info *info) {
+    long offset = 2;
+    while (offset + 4 <= bits_length) {
+        if (bits[offset] != 0xFF) {
+            return false;
+        }
+        const unsigned char marker = bits[offset + 1];
+        if (marker == 0xFF) {
+            // fill byte
+            offset++;
+            continue;
+        }
+        if (marker == 0xD9 || marker == 0xDA) {
+            // end of image or start of scan before any frame
+            return false;
+        }
+
+        const long length = (bits[offset + 2] << 8) | bits[offset + 3];
+        const bool is_sof = marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC;
+        if (is_sof) {
+            if (offset + 9 > bits_length) {
+                return false;
+            }
+            info->height = (bits[offset + 5] << 8) | bits[offset + 6];
+            info->width = (bits[offset + 7] << 8) | bits[offset + 8];
+            info->channels = 3;
+            return true;
+        }
+        offset += 2 + length;
+    }
+    return false;
+}
+
+// reads the first chunk, lossy images decode to RGB, lossless and extended
+// ones to RGBA when they say they use alpha
+static bool probe_webp(const unsigned char *bits, long bits_length, image_info *info) {
+    if (bits_length < 30) {
+        return false;
+    }
+    const unsigned char *chunk = bits + 12;
+    const unsigned char *data = chunk + 8;
+    if (!memcmp(chunk, "VP8 ", 4)) {
+        // frame tag, then the start code and 14 bit sizes
+        if (data[3] != 0x9D || data[4] != 0x01 || data[5] != 0x2A) {
+            return false;
+        }
+        info->width = (data[6] | (data[7] << 8)) & 0x3FFF;
+        info->height = (data[8] | (data[9] << 8)) & 0x3FFF;
+        info->channels = 3;
+        return true;
+    }
+    if (!memcmp(chunk, "VP8L", 4)) {
+        // signature, then sizes less one in 14 bits each and the alpha bit
+        if (data[0] != 0x2F) {
+            return false;
+        }
+        const unsigned int header = read_u32(data + 1, false);
+        info->width = (int) (header & 0x3FFF) + 1;
+        info->height = (int) ((header >> 14) & 0x3FFF) + 1;
+        info->channels = (header >> 28) & 1 ? 4 : 3;
+        return true;
+    }
+    if (!memcmp(chunk, "VP8X", 4)) {
+        // flags, then the canvas size less one in 24 bits each
+        if (data[0] & 0x02) {
+            // animations are not decoded
+            return false;
+        }
+        info->width = (int) (data[4] | (data[5] << 8) | (data[6] << 16)) + 1;
+        info->height = (int) (data[7] | (data[8] << 8) | (data[9] << 16)) + 1;
+        info->channels = data[0] & 0x10 ? 4 : 3;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @name	image_loader_probe
+ * @brief	reads the size of an image from its header without decoding it,
+ *			so memory can be set aside before the pixels exist
+ * @param	bits - (const unsigned char *) the file, or at least its header
+ * @param	bits_length - (long) bytes available
+ * @param	info - (image_info *) filled in with what the file holds
+ * @retval	bool - false if the format is unknown or the header is cut short
+ */
+bool image_loader_probe(const unsigned char *bits, long bits_length, image_info *info) {
+    memset(info, 0, sizeof(image_info));
+    info->format = image_loader_sniff_format(bits, bits_length);
+
+    bool found = false;
+    switch (info->format) {
+    case IMAGE_FORMAT_PNG:
+        found = probe_png(bits, bits_length, info);
+        break;
+    case IMAGE_FORMAT_JPEG:
+        found = probe_jpeg(bits, bits_length, info);
+        break;
+    case IMAGE_FORMAT_WEBP:
+        found = probe_webp(bits, bits_length, info);
+        break;
+    case IMAGE_FORMAT_PKM:
+        // the same fields load_image_from_memory reads
+        if (bits_length >= 16) {
+            info->width = readShort((unsigned char *) bits + 8);
+            info->height = readShort((unsigned char *) bits + 10);
+            info->channels = 3;
+            info->compression_type = 0x8D64; // GL_ETC1_RGB8_OES
+            found = true;
+        }
+        break;
+    case IMAGE_FORMAT_KTX:
+        if (bits_length >= 64) {
+            const unsigned int endianness = read_u32(bits + 12, false);
+            const bool swap = endianness == 0x01020304;
+            // only compressed KTX textures load, those have no gl type
+            if ((swap || endianness == 0x04030201) && read_u32(bits + 16, swap) == 0) {
+                info->compression_type = (int) read_u32(bits + 28, swap);
+                info->width = (int) read_u32(bits + 36, swap);
+                info->height = (int) read_u32(bits + 40, swap);
+                found = true;
+            }
+        }
+        break;
+    case IMAGE_FORMAT_KTX2:
+        if (bits_length >= 48) {
+            info->compression_type = gl_format_from_vk(read_u32(bits + 12, false));
+            info->width = (int) read_u32(bits + 20, false);
+            info->height = (int) read_u32(bits + 24, false);
+            found = true;
+        }
+        break;
+    }
+
+    if (!found || info->width <= 0 || info->height <= 0) {
+        return false;
+    }
+
+    compressed_format format;
+    if (info->compression_type && get_compressed_format(info->compression_type, &format)) {
+        info->channels = format.channels;
+        info->size = image_loader_compressed_level_size(info->compression_type, info->width, info->height);
+    } else {
+        info->size = (long) info->width * info->height * info->channels;
+    }
+    return true;
+}
+
+/*
+ * Platform decoders
+ *
+ * One per format, set by the platform before loading starts and only read
+ * afterwards.  Compressed containers are uploaded as they are and never
+ * offered to them.
+ */
+
+#define IMAGE_FORMAT_COUNT (IMAGE_FORMAT_WEBP + 1)
+
+typedef struct platform_decoder_t {
+    image_platform_accepts_cb accepts;
+    image_platform_decode_cb decode;
+    void *data;
+} platform_decoder;
+
+static platform_decoder m_platform_decoders[IMAGE_FORMAT_COUNT];
+
+/**
+ * @name	image_loader_set_platform_decoder
+ * @brief	sets the decoder tried before the bundled one for a format
+ * @param	format - (int) IMAGE_FORMAT_* it decodes
+ * @param	accepts - (image_platform_accepts_cb) capability check, NULL to
+ *			take every file of the format
+ * @param	decode - (image_platform_decode_cb) decodes a file, NULL to go
+ *			back to the bundled decoder
+ * @param	data - (void *) passed to both callbacks
+ * @retval	NONE
+ */
+void image_loader_set_platform_decoder(int format, image_platform_accepts_cb accepts, image_platform_decode_cb decode, void *data) {
+    if (format <= IMAGE_FORMAT_UNKNOWN || format >= IMAGE_FORMAT_COUNT) {
+        return;
+    }
+    platform_decoder *p = &m_platform_decoders[format];
+    p->accepts = decode ? accepts : NULL;
+    p->decode = decode;
+    p->data = decode ? data : NULL;
+}
+
+// gets the platform decoder that takes the file, with its header in info
+static platform_decoder *find_platform_decoder(const unsigned char *bits, long bits_length, image_info *info) {
+    const int format = image_loader_sniff_format(bits, bits_length);
+    if (format == IMAGE_FORMAT_UNKNOWN || !m_platform_decoders[format].decode) {
+        return NULL;
+    }
+    if (!image_loader_probe(bits, bits_length, info) || info->compression_type) {
+        return NULL;
+    }
+
+    platform_decoder *p = &m_platform_decoders[format];
+    if (p->accepts && !p->accepts(info, p->data)) {
+        return NULL;
+    }
+    return p;
+}
+
+// runs a platform decoder, dropping what doesn't come back at full size or
+// at the size divided by scale
+static unsigned char *decode_with_platform(platform_decoder *p, const unsigned char *bits, long bits_length,
+        const image_info *info, int scale, int *width, int *height) {
+    int w = 0, h = 0;
+    unsigned char *pixels = p->decode(bits, bits_length, info, scale, &w, &h, p->data);
+    if (!pixels) {
+        return NULL;
+    }
+
+    const bool full = w == info->width && h == info->height;
+    const bool scaled = scale > 1 && w == (info->width + scale - 1) / scale && h == (info->height + scale - 1) / scale;
+    if (!full && !scaled) {
+        LOG("{resources} WARNING: Platform decoder gave %dx%d for a %dx%d image, using the bundled one",
+            w, h, info->width, info->height);
+        free(pixels);
+        return NULL;
+    }
+
+    *width = w;
+    *height = h;
+    return pixels;
+}
+
 unsigned char *load_image_from_memory(unsigned char *bits, long bits_length, int *width, int *height, int *channels, long *size, int *compression_type) {
     unsigned char *data = NULL;
     *size = 0;
@@ -133,17 +867,17 @@ unsigned char *load_image_from_memory(unsigned char *bits, long bits_length, int
 
     // must have at least 8 bytes be read
     if (bits_length >= 8) {
-        /* Test if it is a png first */
-        unsigned char header[8];
-        memcpy(header, bits, 8);
-        int is_png = !png_sig_cmp(header, 0, 8);
-        int is_pkm = !is_png && !strncmp("PKM 10", (char*) header, 6);
-        int is_jpg = !is_png && !is_pkm && header[0] == 0xFF && header[1] == 0xD8;
-
-        if (is_png) {
+        const int format = image_loader_sniff_format(bits, bits_length);
+
+        image_info info;
+        platform_decoder *platform = find_platform_decoder(bits, bits_length, &info);
+        if (platform && (data = decode_with_platform(platform, bits, bits_length, &info, 1, width, height))) {
+            *channels = info.channels;
+            *size = (*channels) * (*width) * (*height);
+        } else if (format == IMAGE_FORMAT_PNG) {
             data = load_png_from_memory(bits, bits_length, width, height, channels);
             *size = (*channels) * (*width) * (*height);
-        } else if (is_pkm) {
+        } else if (format == IMAGE_FORMAT_PKM) {
             // ETC HEADER LAYOUT -> 16 bytes total
             // tag -> "PKM 10" 6 bytes
             // format -> 2 bytes
@@ -160,9 +894,16 @@ unsigned char *load_image_from_memory(unsigned char *bits, long bits_length, int
                 data = (unsigned char*) malloc(*size);
                 memcpy(data, bits + 16, *size);
             }
-        } else if (is_jpg) {
+        } else if (format == IMAGE_FORMAT_JPEG) {
             data = load_jpg_from_memory(bits, bits_length, width, height, channels);
             *size = (*channels) * (*width) * (*height);
+        } else if (format == IMAGE_FORMAT_KTX) {
+            data = load_ktx_from_memory(bits, bits_length, width, height, channels, size, compression_type);
+        } else if (format == IMAGE_FORMAT_KTX2) {
+            data = load_ktx2_from_memory(bits, bits_length, width, height, channels, size, compression_type);
+        } else if (format == IMAGE_FORMAT_WEBP) {
+            data = load_webp_from_memory(bits, bits_length, width, height, channels);
+            *size = data ? (*channels) * (*width) * (*height) : 0;
         } else {
             LOG("Unknown image type, skipping load");
         }
@@ -331,3 +1072,475 @@ unsigned char *load_jpg_from_memory(unsigned char *bits, long bits_length, int *
     *channels = 3;
     return buffer;
 }
+
+/**
+ * @name	load_webp_from_memory
+ * @brief	decodes a lossy or lossless WebP file, RGBA if it has alpha and
+ *			RGB otherwise
+ * @param	bits - (unsigned char *) file contents
+ * @param	bits_length - (long) size of the file
+ * @param	width - (int *) image width
+ * @param	height - (int *) image height
+ * @param	channels - (int *) 3 or 4
+ * @retval	unsigned char * - the pixels, NULL if the file is corrupt,
+ *			animated or WebP support is not built in
+ */
+#ifdef ENABLE_WEBP
+unsigned char *load_webp_from_memory(unsigned char *bits, long bits_length, int *width, int *height, int *channels) {
+    WebPBitstreamFeatures features;
+    if (WebPGetFeatures(bits, (size_t) bits_length, &features) != VP8_STATUS_OK || features.has_animation) {
+        LOG("{resources} WebP image is corrupted or animated");
+        return NULL;
+    }
+
+    const int w = features.width;
+    const int h = features.height;
+    const int c = features.has_alpha ? 4 : 3;
+    const size_t size = (size_t) w * h * c;
+    // decode into our own buffer, callers free it with free() rather than WebPFree()
+    unsigned char *buffer = (unsigned char *) malloc(size);
+    if (!buffer) {
+        return NULL;
+    }
+
+    uint8_t *decoded = c == 4 ?
+                       WebPDecodeRGBAInto(bits, (size_t) bits_length, buffer, size, w * c) :
+                       WebPDecodeRGBInto(bits, (size_t) bits_length, buffer, size, w * c);
+    if (!decoded) {
+        LOG("{resources} WebP image is corrupted");
+        free(buffer);
+        return NULL;
+    }
+
+    *width = w;
+    *height = h;
+    *channels = c;
+    return buffer;
+}
+#else
+unsigned char *load_webp_from_memory(unsigned char *bits, long bits_length, int *width, int *height, int *channels) {
+    LOG("{resources} Built without ENABLE_WEBP, skipping WebP image");
+    return NULL;
+}
+#endif
+
+/*
+ * Row decoders
+ *
+ * The load_*_from_memory functions decode a whole image into one buffer
+ * that the texture loader then copies again to pad or half-size it.  A row
+ * decoder hands the rows out as they are decoded instead, so they can be
+ * written straight into the texture's pixels.  Interlaced PNG files need
+ * every pass before a row is final and are left to load_png_from_memory.
+ * WebP files are fed to an incremental decoder a slice at a time, only as
+ * far as the rows asked for.  A platform decoder decodes the whole file
+ * when the decoder starts and hands out rows of that, falling back to the
+ * bundled decoder if it fails.
+ */
+
+#define DECODER_PNG 1
+#define DECODER_JPG 2
+#define DECODER_WEBP 3
+#define DECODER_PLATFORM 4
+
+// bytes of a WebP file handed to the decoder at a time
+#define WEBP_FEED_BYTES (32 * 1024)
+
+struct image_decoder_t {
+    int type;
+    int width;
+    int height;
+    int channels;
+    int rows_read;
+    bool started;
+    jmp_buf jbuf;
+    const unsigned char *bits;
+    long bits_length;
+
+    // the file's header and the pixels of a platform decoder
+    image_info info;
+    platform_decoder *platform;
+    unsigned char *platform_pixels;
+
+    png_structp png_ptr;
+    png_infop info_ptr;
+    struct bounded_buffer buff;
+
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+
+#ifdef ENABLE_WEBP
+    WebPDecoderConfig webp_config;
+    WebPIDecoder *webp_idec;
+    const unsigned char *webp_bits;
+    long webp_length;
+    long webp_fed;
+#endif
+};
+
+static void jpeg_decoder_error_exit(j_common_ptr cinfo) {
+    char msg[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, msg);
+    LOG("{resources} JPEG image is corrupted.  Error=%s", msg);
+
+    image_decoder *decoder = (image_decoder *) cinfo->client_data;
+    longjmp(decoder->jbuf, 1);
+}
+
+static bool open_png_decoder(image_decoder *decoder, unsigned char *bits, long bits_length) {
+    decoder->png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, &decoder->jbuf, readpng2_error_handler, NULL);
+    if (!decoder->png_ptr) {
+        return false;
+    }
+
+    decoder->info_ptr = png_create_info_struct(decoder->png_ptr);
+    if (!decoder->info_ptr) {
+        return false;
+    }
+
+    if (setjmp(decoder->jbuf)) {
+        return false;
+    }
+
+    // the signature was checked by image_decoder_open
+    decoder->buff.pos = bits + 8;
+    decoder->buff.end = bits + bits_length;
+    png_set_read_fn(decoder->png_ptr, &decoder->buff, png_image_bytes_read);
+    png_set_sig_bytes(decoder->png_ptr, 8);
+    png_read_info(decoder->png_ptr, decoder->info_ptr);
+
+    int bit_depth, color_type, interlace_type;
+    png_uint_32 twidth, theight;
+    png_get_IHDR(decoder->png_ptr, decoder->info_ptr, &twidth, &theight, &bit_depth, &color_type,
+                 &interlace_type, NULL, NULL);
+    if (interlace_type != PNG_INTERLACE_NONE) {
+        return false;
+    }
+
+    // the same conversions as load_png_from_memory, with rows one byte per channel
+    if (color_type & PNG_COLOR_TYPE_PALETTE) {
+        png_set_palette_to_rgb(decoder->png_ptr);
+    }
+    if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8) {
+        png_set_expand_gray_1_2_4_to_8(decoder->png_ptr);
+    }
+    if (bit_depth == 16) {
+        png_set_strip_16(decoder->png_ptr);
+    }
+    png_read_update_info(decoder->png_ptr, decoder->info_ptr);
+
+    decoder->width = twidth;
+    decoder->height = theight;
+    decoder->channels = (int)png_get_channels(decoder->png_ptr, decoder->info_ptr);
+    return true;
+}
+
+static bool open_jpg_decoder(image_decoder *decoder, unsigned char *bits, long bits_length) {
+    decoder->cinfo.err = jpeg_std_error(&decoder->jerr);
+    decoder->jerr.error_exit = jpeg_decoder_error_exit;
+    decoder->cinfo.client_data = decoder;
+    jpeg_create_decompress(&decoder->cinfo);
+    decoder->type = DECODER_JPG;
+
+    if (setjmp(decoder->jbuf)) {
+        return false;
+    }
+
+    jpeg_mem_src(&decoder->cinfo, bits, (unsigned long) bits_length);
+    jpeg_read_header(&decoder->cinfo, TRUE);
+
+    // match the flags load_jpg_from_memory passes to turbojpeg
+    decoder->cinfo.out_color_space = JCS_RGB;
+    decoder->cinfo.dct_method = JDCT_IFAST;
+
+    // the output size is only known once image_decoder_start picks a scale
+    decoder->width = decoder->cinfo.image_width;
+    decoder->height = decoder->cinfo.image_height;
+    decoder->channels = 3;
+    return true;
+}
+
+#ifdef ENABLE_WEBP
+static bool open_webp_decoder(image_decoder *decoder, const unsigned char *bits, long bits_length) {
+    decoder->type = DECODER_WEBP;
+    if (!WebPInitDecoderConfig(&decoder->webp_config)) {
+        return false;
+    }
+    if (WebPGetFeatures(bits, (size_t) bits_length, &decoder->webp_config.input) != VP8_STATUS_OK ||
+        decoder->webp_config.input.has_animation) {
+        return false;
+    }
+
+    decoder->webp_bits = bits;
+    decoder->webp_length = bits_length;
+    decoder->width = decoder->webp_config.input.width;
+    decoder->height = decoder->webp_config.input.height;
+    decoder->channels = decoder->webp_config.input.has_alpha ? 4 : 3;
+    return true;
+}
+
+static bool start_webp_decoder(image_decoder *decoder, int scale) {
+    WebPDecoderConfig *config = &decoder->webp_config;
+    if (scale > 1) {
+        // rounds up like JPEG scaling, which fill_texture_rows expects
+        config->options.use_scaling = 1;
+        config->options.scaled_width = (decoder->width + scale - 1) / scale;
+        config->options.scaled_height = (decoder->height + scale - 1) / scale;
+        decoder->width = config->options.scaled_width;
+        decoder->height = config->options.scaled_height;
+    }
+    config->output.colorspace = decoder->channels == 4 ? MODE_RGBA : MODE_RGB;
+
+    decoder->webp_idec = WebPIDecode(NULL, 0, config);
+    return decoder->webp_idec != NULL;
+}
+
+// feeds the decoder until the rows are decoded, then copies them out
+static bool read_webp_rows(image_decoder *decoder, unsigned char *rows, long stride, int count) {
+    const int needed = decoder->rows_read + count;
+    int last_y = 0, width = 0, height = 0, row_stride = 0;
+    uint8_t *pixels = WebPIDecGetRGB(decoder->webp_idec, &last_y, &width, &height, &row_stride);
+    while (!pixels || last_y < needed) {
+        if (decoder->webp_fed >= decoder->webp_length) {
+            return false;
+        }
+        decoder->webp_fed += WEBP_FEED_BYTES;
+        if (decoder->webp_fed > decoder->webp_length) {
+            decoder->webp_fed = decoder->webp_length;
+        }
+
+        // the file stays in memory, so the decoder reads it in place
+        VP8StatusCode status = WebPIUpdate(decoder->webp_idec, decoder->webp_bits, (size_t) decoder->webp_fed);
+        if (status != VP8_STATUS_OK && status != VP8_STATUS_SUSPENDED) {
+            LOG("{resources} WebP image is corrupted.  Error=%d", (int) status);
+            return false;
+        }
+        pixels = WebPIDecGetRGB(decoder->webp_idec, &last_y, &width, &height, &row_stride);
+    }
+
+    const size_t row_bytes = (size_t) decoder->width * decoder->channels;
+    const uint8_t *row = pixels + (long) decoder->rows_read * row_stride;
+    int i;
+    for (i = 0; i < count; i++, rows += stride, row += row_stride) {
+        memcpy(rows, row, row_bytes);
+    }
+    return true;
+}
+#endif
+
+// opens the bundled decoder for the file held by the decoder
+static bool open_bundled_decoder(image_decoder *decoder, int format) {
+    if (format == IMAGE_FORMAT_PNG) {
+        decoder->type = DECODER_PNG;
+        return open_png_decoder(decoder, (unsigned char *) decoder->bits, decoder->bits_length);
+    } else if (format == IMAGE_FORMAT_JPEG) {
+        return open_jpg_decoder(decoder, (unsigned char *) decoder->bits, decoder->bits_length);
+#ifdef ENABLE_WEBP
+    } else if (format == IMAGE_FORMAT_WEBP) {
+        return open_webp_decoder(decoder, decoder->bits, decoder->bits_length);
+#endif
+    }
+    return false;
+}
+
+// decodes with the platform decoder, or opens the bundled one in its place
+// when that fails
+static bool start_platform_decoder(image_decoder *decoder, int scale) {
+    int w = 0, h = 0;
+    decoder->platform_pixels = decode_with_platform(decoder->platform, decoder->bits, decoder->bits_length,
+                               &decoder->info, scale, &w, &h);
+    if (decoder->platform_pixels) {
+        decoder->width = w;
+        decoder->height = h;
+        return true;
+    }
+
+    decoder->type = 0;
+    if (!open_bundled_decoder(decoder, decoder->info.format)) {
+        return false;
+    }
+    // the caller already sized the texture from the header
+    return decoder->width == decoder->info.width && decoder->height == decoder->info.height &&
+           decoder->channels == decoder->info.channels;
+}
+
+/**
+ * @name	image_decoder_open
+ * @brief	starts decoding a PNG, JPEG or WebP file row by row, or any file
+ *			a platform decoder takes
+ * @param	bits - (const unsigned char *) file contents, kept until the decoder is closed
+ * @param	bits_length - (long) size of the file
+ * @param	width - (int *) image width
+ * @param	height - (int *) image height
+ * @param	channels - (int *) bytes per pixel of the decoded rows
+ * @retval	image_decoder * - decoder to start and read the rows from, NULL
+ *			when the file has to be loaded with load_image_from_memory instead
+ */
+image_decoder *image_decoder_open(const unsigned char *bits, long bits_length, int *width, int *height, int *channels) {
+    if (bits_length < 8) {
+        return NULL;
+    }
+
+    image_info info;
+    platform_decoder *platform = find_platform_decoder(bits, bits_length, &info);
+    const int format = image_loader_sniff_format(bits, bits_length);
+#ifdef ENABLE_WEBP
+    if (!platform && format != IMAGE_FORMAT_PNG && format != IMAGE_FORMAT_JPEG && format != IMAGE_FORMAT_WEBP) {
+#else
+    if (!platform && format != IMAGE_FORMAT_PNG && format != IMAGE_FORMAT_JPEG) {
+#endif
+        return NULL;
+    }
+
+    image_decoder *decoder = (image_decoder *) calloc(1, sizeof(image_decoder));
+    if (!decoder) {
+        return NULL;
+    }
+    decoder->bits = bits;
+    decoder->bits_length = bits_length;
+
+    bool opened;
+    if (platform) {
+        // decoded when started, once the scale is known
+        decoder->type = DECODER_PLATFORM;
+        decoder->info = info;
+        decoder->platform = platform;
+        decoder->width = info.width;
+        decoder->height = info.height;
+        decoder->channels = info.channels;
+        opened = true;
+    } else {
+        opened = open_bundled_decoder(decoder, format);
+    }
+
+    if (!opened || decoder->width <= 0 || decoder->height <= 0) {
+        image_decoder_close(decoder);
+        return NULL;
+    }
+
+    *width = decoder->width;
+    *height = decoder->height;
+    *channels = decoder->channels;
+    return decoder;
+}
+
+/**
+ * @name	image_decoder_start
+ * @brief	picks the size to decode at, JPEG and WebP files can be scaled
+ *			down while decoding, far cheaper than averaging full-size rows
+ *			afterwards
+ * @param	decoder - (image_decoder *) decoder from image_decoder_open
+ * @param	scale - (int) 1, 2, 4 or 8 to divide the size by, rounding up,
+ *			PNG files always decode at full size
+ * @param	width - (int *) width of the rows that will be read
+ * @param	height - (int *) number of rows that will be read
+ * @retval	bool - false if the file is corrupt
+ */
+bool image_decoder_start(image_decoder *decoder, int scale, int *width, int *height) {
+    if (!decoder->started && decoder->type == DECODER_PLATFORM && !start_platform_decoder(decoder, scale)) {
+        return false;
+    }
+    if (!decoder->started && decoder->type == DECODER_JPG) {
+        if (setjmp(decoder->jbuf)) {
+            return false;
+        }
+
+        decoder->cinfo.scale_num = 1;
+        decoder->cinfo.scale_denom = scale;
+        jpeg_start_decompress(&decoder->cinfo);
+        decoder->width = decoder->cinfo.output_width;
+        decoder->height = decoder->cinfo.output_height;
+    }
+#ifdef ENABLE_WEBP
+    if (!decoder->started && decoder->type == DECODER_WEBP && !start_webp_decoder(decoder, scale)) {
+        return false;
+    }
+#endif
+
+    decoder->started = true;
+    *width = decoder->width;
+    *height = decoder->height;
+    return true;
+}
+
+/**
+ * @name	image_decoder_read_rows
+ * @brief	decodes the next rows of the image
+ * @param	decoder - (image_decoder *) decoder from image_decoder_open
+ * @param	rows - (unsigned char *) where the first row goes
+ * @param	stride - (long) bytes from one row to the next in rows
+ * @param	count - (int) number of rows to decode
+ * @retval	bool - false if the file is corrupt or has fewer rows left
+ */
+bool image_decoder_read_rows(image_decoder *decoder, unsigned char *rows, long stride, int count) {
+    if (!decoder->started || decoder->rows_read + count > decoder->height) {
+        return false;
+    }
+
+    if (decoder->type == DECODER_PLATFORM) {
+        const long row_bytes = (long) decoder->width * decoder->channels;
+        const unsigned char *row = decoder->platform_pixels + decoder->rows_read * row_bytes;
+        int i;
+        for (i = 0; i < count; i++, rows += stride, row += row_bytes) {
+            memcpy(rows, row, row_bytes);
+        }
+        decoder->rows_read += count;
+        return true;
+    }
+
+#ifdef ENABLE_WEBP
+    if (decoder->type == DECODER_WEBP) {
+        if (!read_webp_rows(decoder, rows, stride, count)) {
+            decoder->rows_read = decoder->height;
+            return false;
+        }
+        decoder->rows_read += count;
+        return true;
+    }
+#endif
+
+    if (setjmp(decoder->jbuf)) {
+        // the decoder cannot pick up after an error
+        decoder->rows_read = decoder->height;
+        return false;
+    }
+
+    int i;
+    for (i = 0; i < count; i++, rows += stride) {
+        if (decoder->type == DECODER_PNG) {
+            png_read_row(decoder->png_ptr, rows, NULL);
+        } else {
+            // jpeg_mem_src never suspends, so a row always comes back
+            JSAMPROW row = rows;
+            if (jpeg_read_scanlines(&decoder->cinfo, &row, 1) != 1) {
+                decoder->rows_read = decoder->height;
+                return false;
+            }
+        }
+        decoder->rows_read++;
+    }
+    return true;
+}
+
+/**
+ * @name	image_decoder_close
+ * @brief	frees a decoder, whether or not every row was read
+ * @param	decoder - (image_decoder *) decoder from image_decoder_open
+ * @retval	NONE
+ */
+void image_decoder_close(image_decoder *decoder) {
+    if (decoder->type == DECODER_PNG) {
+        png_destroy_read_struct(&decoder->png_ptr, decoder->info_ptr ? &decoder->info_ptr : NULL, NULL);
+    } else if (decoder->type == DECODER_JPG) {
+        jpeg_destroy_decompress(&decoder->cinfo);
+#ifdef ENABLE_WEBP
+    } else if (decoder->type == DECODER_WEBP) {
+        if (decoder->webp_idec) {
+            WebPIDelete(decoder->webp_idec);
+        }
+        WebPFreeDecBuffer(&decoder->webp_config.output);
+#endif
+    }
+    free(decoder->platform_pixels);
+    free(decoder);
+}
@@ -23,14 +23,71 @@
 #include "core/deps/png/pngstruct.h"
 #endif
 
+// families of compressed formats a gl context can sample from
+#define IMAGE_COMPRESSION_ETC1 0x1
+#define IMAGE_COMPRESSION_ETC2 0x2
+#define IMAGE_COMPRESSION_ASTC 0x4
+#define IMAGE_COMPRESSION_PVRTC 0x8
+
+#include "core/types.h"
+
+// containers image_loader_sniff_format tells apart
+enum image_formats {
+	IMAGE_FORMAT_UNKNOWN,
+	IMAGE_FORMAT_PNG,
+	IMAGE_FORMAT_JPEG,
+	IMAGE_FORMAT_PKM,
+	IMAGE_FORMAT_KTX,
+	IMAGE_FORMAT_KTX2,
+	IMAGE_FORMAT_WEBP // decodes only when built with ENABLE_WEBP
+};
+
+// what an image file holds, read from its header by image_loader_probe
+typedef struct image_info_t {
+	int format; // IMAGE_FORMAT_*
+	int width;
+	int height;
+	int channels; // of the decoded pixels, or of the compressed format
+	int compression_type; // gl format of compressed files, zero otherwise
+	long size; // bytes of the base level once loaded, before padding or half-sizing
+} image_info;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// decodes an image row by row, see image_decoder_open
+typedef struct image_decoder_t image_decoder;
+
+// A platform can register a decoder of its own per format, like ImageIO or
+// a hardware JPEG decoder, tried before the bundled one for every file it
+// accepts. Register before textures start loading, the callbacks are then
+// called from the decode threads.
+// whether the platform decoder takes the file, from what its header holds
+typedef bool (*image_platform_accepts_cb)(const image_info *info, void *data);
+// decodes the whole file into pixels from malloc, rows packed, with
+// info->channels bytes per pixel. With scale above 1 it may decode at the
+// size divided by scale, rounding up, or at full size. NULL leaves the file
+// to the bundled decoder
+typedef unsigned char *(*image_platform_decode_cb)(const unsigned char *bits, long bits_length, const image_info *info,
+		int scale, int *width, int *height, void *data);
+
+void image_loader_set_compression_support(unsigned int families);
+unsigned int image_loader_get_compression_support();
+// a NULL decode removes the format's platform decoder, accepts may be NULL to take every file
+void image_loader_set_platform_decoder(int format, image_platform_accepts_cb accepts, image_platform_decode_cb decode, void *data);
+int image_loader_sniff_format(const unsigned char *bits, long bits_length);
+bool image_loader_probe(const unsigned char *bits, long bits_length, image_info *info);
+long image_loader_compressed_level_size(int gl_format, int width, int height);
 unsigned char *load_image_from_base64(const char *base64image, int *width, int *height, int *channels);
 unsigned char *load_image_from_memory(unsigned char *bits, long bits_length, int *width, int *height, int *channels, long *size, int *compression_type);
 unsigned char *load_png_from_memory(unsigned char *bits, long bits_length, int *width, int *height, int *channels);
 unsigned char *load_jpg_from_memory(unsigned char *bits, long bits_length, int *width, int *height, int *channels);
+unsigned char *load_webp_from_memory(unsigned char *bits, long bits_length, int *width, int *height, int *channels);
+image_decoder *image_decoder_open(const unsigned char *bits, long bits_length, int *width, int *height, int *channels);
+bool image_decoder_start(image_decoder *decoder, int scale, int *width, int *height);
+bool image_decoder_read_rows(image_decoder *decoder, unsigned char *rows, long stride, int count);
+void image_decoder_close(image_decoder *decoder);
 //png helper func
 void png_image_bytes_read(png_structp png_ptr, png_bytep data, png_size_t length);
 
@@ -5,6 +5,13 @@
 #include "platform/log.h"
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include "core/deps/turbojpeg/jpeglib.h"
+#include "core/deps/turbojpeg/jerror.h"
+#include "core/util/detect.h"
 
 /*
 	A base64 encoder NOT using OpenSSL (by a very snarky Chris Taylor)
@@ -32,20 +39,100 @@ size_t GetBase64LengthFromBinaryLength(size_t bytes) {
 
 static const char *TO_BASE64 = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
+/*
+ * SIMD kernel for WriteBase64.  It encodes as many whole vectors of input
+ * as fit and returns how many input bytes it consumed, always a multiple of
+ * three; the scalar loop finishes the rest with identical output.
+ */
+
+#if defined(GC_HAS_NEON)
+#include <arm_neon.h>
+
+// Maps 6 bit values to their base64 characters
+static inline uint8x16_t base64_chars(uint8x16_t i) {
+    uint8x16_t c = vaddq_u8(i, vdupq_n_u8('A'));
+    c = vaddq_u8(c, vandq_u8(vcgeq_u8(i, vdupq_n_u8(26)), vdupq_n_u8('a' - 'A' - 26)));
+    c = vaddq_u8(c, vandq_u8(vcgeq_u8(i, vdupq_n_u8(52)), vdupq_n_u8((unsigned char) ('0' - 'a' - 26))));
+    c = vaddq_u8(c, vandq_u8(vcgeq_u8(i, vdupq_n_u8(62)), vdupq_n_u8((unsigned char) ('+' - '0' - 10))));
+    c = vaddq_u8(c, vandq_u8(vcgeq_u8(i, vdupq_n_u8(63)), vdupq_n_u8('/' - '+' - 1)));
+    return c;
+}
+
+static size_t base64_encode_simd(const unsigned char *in, size_t bytes, char *out) {
+    const uint8x16_t mask = vdupq_n_u8(0x3f);
+    size_t done = 0;
+    for (; done + 48 <= bytes; done += 48, in += 48, out += 64) {
+        uint8x16x3_t s = vld3q_u8(in);
+        uint8x16x4_t d;
+        d.val[0] = base64_chars(vshrq_n_u8(s.val[0], 2));
+        d.val[1] = base64_chars(vandq_u8(vorrq_u8(vshlq_n_u8(s.val[0], 4), vshrq_n_u8(s.val[1], 4)), mask));
+        d.val[2] = base64_chars(vandq_u8(vorrq_u8(vshlq_n_u8(s.val[1], 2), vshrq_n_u8(s.val[2], 6)), mask));
+        d.val[3] = base64_chars(vandq_u8(s.val[2], mask));
+        vst4q_u8((uint8_t *) out, d);
+    }
+    return done;
+}
+
+#elif defined(GC_HAS_SSE)
+#include <emmintrin.h>
+
+// Maps 6 bit values to their base64 characters
+static inline __m128i base64_chars(__m128i i) {
+    __m128i c = _mm_add_epi8(i, _mm_set1_epi8('A'));
+    c = _mm_add_epi8(c, _mm_and_si128(_mm_cmpgt_epi8(i, _mm_set1_epi8(25)), _mm_set1_epi8('a' - 'A' - 26)));
+    c = _mm_add_epi8(c, _mm_and_si128(_mm_cmpgt_epi8(i, _mm_set1_epi8(51)), _mm_set1_epi8('0' - 'a' - 26)));
+    c = _mm_add_epi8(c, _mm_and_si128(_mm_cmpgt_epi8(i, _mm_set1_epi8(61)), _mm_set1_epi8('+' - '0' - 10)));
+    c = _mm_add_epi8(c, _mm_and_si128(_mm_cmpgt_epi8(i, _mm_set1_epi8(62)), _mm_set1_epi8('/' - '+' - 1)));
+    return c;
+}
+
+static size_t base64_encode_simd(const unsigned char *in, size_t bytes, char *out) {
+    size_t done = 0;
+    // 16 bytes are loaded for every 12 encoded
+    for (; done + 16 <= bytes; done += 12, in += 12, out += 16) {
+        __m128i x = _mm_loadu_si128((const __m128i *) in);
+
+        // one group of three bytes per 32 bit lane, in its low bytes
+        __m128i u = _mm_unpacklo_epi64(
+            _mm_unpacklo_epi32(x, _mm_srli_si128(x, 3)),
+            _mm_unpacklo_epi32(_mm_srli_si128(x, 6), _mm_srli_si128(x, 9)));
+
+        // move each 6 bit value into its own byte, first character lowest
+        __m128i i = _mm_and_si128(_mm_srli_epi32(u, 2), _mm_set1_epi32(0x3f));
+        i = _mm_or_si128(i, _mm_and_si128(_mm_slli_epi32(u, 12), _mm_set1_epi32(0x3000)));
+        i = _mm_or_si128(i, _mm_and_si128(_mm_srli_epi32(u, 4), _mm_set1_epi32(0x0f00)));
+        i = _mm_or_si128(i, _mm_and_si128(_mm_slli_epi32(u, 10), _mm_set1_epi32(0x3c0000)));
+        i = _mm_or_si128(i, _mm_and_si128(_mm_srli_epi32(u, 6), _mm_set1_epi32(0x030000)));
+        i = _mm_or_si128(i, _mm_and_si128(_mm_slli_epi32(u, 8), _mm_set1_epi32(0x3f000000)));
+
+        _mm_storeu_si128((__m128i *) out, base64_chars(i));
+    }
+    return done;
+}
+
+#else
+
+static size_t base64_encode_simd(const unsigned char *in, size_t bytes, char *out) {
+    return 0;
+}
+
+#endif
+
 void WriteBase64(const void *buffer, size_t bytes, char *encoded_buffer) {
     const unsigned char *data = (const unsigned char *)buffer;
 
-    size_t ii, jj, end;
-    for (ii = 0, jj = 0, end = bytes - 2; ii < end; ii += 3, jj += 4) {
+    size_t ii = base64_encode_simd(data, bytes, encoded_buffer);
+    size_t jj = (ii / 3) * 4;
+    for (; ii + 2 < bytes; ii += 3, jj += 4) {
         encoded_buffer[jj] = TO_BASE64[data[ii] >> 2];
         encoded_buffer[jj+1] = TO_BASE64[((data[ii] << 4) | (data[ii+1] >> 4)) & 0x3f];
         encoded_buffer[jj+2] = TO_BASE64[((data[ii+1] << 2) | (data[ii+2] >> 6)) & 0x3f];
         encoded_buffer[jj+3] = TO_BASE64[data[ii+2] & 0x3f];
     }
 
-    switch (ii - end) {
+    switch (bytes - ii) {
     default:
-    case 2: // Nothing to write
+    case 0: // Nothing to write
         break;
 
     case 1: // Need to write final 1 byte
@@ -55,7 +142,7 @@ void WriteBase64(const void *buffer, size_t bytes, char *encoded_buffer) {
         encoded_buffer[jj+3] = '=';
         break;
 
-    case 0: // Need to write final 2 bytes
+    case 2: // Need to write final 2 bytes
         encoded_buffer[jj] = TO_BASE64[data[bytes-2] >> 2];
         encoded_buffer[jj+1] = TO_BASE64[((data[bytes-2] << 4) | (data[bytes-1] >> 4)) & 0x3f];
         encoded_buffer[jj+2] = TO_BASE64[(data[bytes-1] << 2) & 0x3f];
@@ -64,7 +151,178 @@ void WriteBase64(const void *buffer, size_t bytes, char *encoded_buffer) {
     }
 }
 
+/*
+ * Incremental base64 output for the encoders below.  Bytes are encoded as
+ * they arrive, whole groups of three straight into the result string and
+ * the 0-2 left over carried to the next write, so the encoded image never
+ * has to be gathered in a buffer of its own first.
+ */
+
+typedef struct base64_stream_t {
+    char *out;
+    size_t used;        // characters written
+    size_t capacity;    // characters out can hold, terminator excluded
+    unsigned char carry[3];
+    size_t carry_len;
+    bool failed;
+} base64_stream;
+
+static void base64_stream_init(base64_stream *stream, size_t expected_bytes) {
+    stream->out = NULL;
+    stream->used = 0;
+    stream->capacity = 0;
+    stream->carry_len = 0;
+    stream->failed = false;
+
+    // the sizes of the encoded images are not known ahead, start from an estimate
+    size_t capacity = GetBase64LengthFromBinaryLength(expected_bytes);
+    if (capacity < 4096) {
+        capacity = 4096;
+    }
+    stream->out = (char *) malloc(capacity + 1);
+    if (stream->out) {
+        stream->capacity = capacity;
+    } else {
+        stream->failed = true;
+    }
+}
+
+static bool base64_stream_reserve(base64_stream *stream, size_t chars) {
+    if (stream->used + chars <= stream->capacity) {
+        return true;
+    }
+
+    size_t capacity = stream->capacity * 2;
+    while (capacity < stream->used + chars) {
+        capacity *= 2;
+    }
+
+    char *out = (char *) realloc(stream->out, capacity + 1);
+    if (!out) {
+        stream->failed = true;
+        return false;
+    }
+    stream->out = out;
+    stream->capacity = capacity;
+    return true;
+}
+
+static void base64_stream_write(base64_stream *stream, const unsigned char *data, size_t length) {
+    if (stream->failed) {
+        return;
+    }
+
+    // complete the group left over from the last write
+    if (stream->carry_len > 0) {
+        while (stream->carry_len < 3 && length > 0) {
+            stream->carry[stream->carry_len++] = *data++;
+            --length;
+        }
+        if (stream->carry_len < 3) {
+            return;
+        }
+        if (!base64_stream_reserve(stream, 4)) {
+            return;
+        }
+        WriteBase64(stream->carry, 3, stream->out + stream->used);
+        stream->used += 4;
+        stream->carry_len = 0;
+    }
+
+    size_t whole = length - length % 3;
+    if (whole > 0) {
+        if (!base64_stream_reserve(stream, (whole / 3) * 4)) {
+            return;
+        }
+        WriteBase64(data, whole, stream->out + stream->used);
+        stream->used += (whole / 3) * 4;
+    }
+
+    memcpy(stream->carry, data + whole, length - whole);
+    stream->carry_len = length - whole;
+}
+
+// Pads out the last group and returns the terminated string, or NULL on failure
+static char *base64_stream_finish(base64_stream *stream) {
+    if (!stream->failed && stream->carry_len > 0 && base64_stream_reserve(stream, 4)) {
+        WriteBase64(stream->carry, stream->carry_len, stream->out + stream->used);
+        stream->used += 4;
+    }
+
+    if (stream->failed || stream->used == 0) {
+        free(stream->out);
+        return NULL;
+    }
+
+    stream->out[stream->used] = '\0';
+
+    // give back what the estimate over-reserved
+    char *out = (char *) realloc(stream->out, stream->used + 1);
+    return out ? out : stream->out;
+}
+
+static const image_write_options DEFAULT_WRITE_OPTIONS = {IMAGE_WRITE_PROFILE_DEFAULT, 90, JPEG_SUBSAMPLING_444};
+
+static const image_write_options *get_write_options(const image_write_options *options) {
+    return options ? options : &DEFAULT_WRITE_OPTIONS;
+}
+
+static int get_jpeg_quality(const image_write_options *options) {
+    int quality = options->jpeg_quality;
+    if (quality <= 0) {
+        return DEFAULT_WRITE_OPTIONS.jpeg_quality;
+    }
+    return quality > 100 ? 100 : quality;
+}
+
+#ifdef PNG_WRITE_CUSTOMIZE_COMPRESSION_SUPPORTED
+
+static void set_png_zlib_levels(png_structp png_ptr, int level, int mem_level) {
+    png_set_compression_level(png_ptr, level);
+    png_set_compression_mem_level(png_ptr, mem_level);
+}
+
+#else
+
+// The bundled libpng is built without the setters, so fill in the fields
+// they would; png_write_IHDR keeps them as long as the flags are set
+#ifndef PNG_FLAG_ZLIB_CUSTOM_LEVEL
+#define PNG_FLAG_ZLIB_CUSTOM_LEVEL 0x0002
+#define PNG_FLAG_ZLIB_CUSTOM_MEM_LEVEL 0x0004
+#endif
+
+static void set_png_zlib_levels(png_structp png_ptr, int level, int mem_level) {
+    png_ptr->zlib_level = level;
+    png_ptr->zlib_mem_level = mem_level;
+    png_ptr->flags |= PNG_FLAG_ZLIB_CUSTOM_LEVEL | PNG_FLAG_ZLIB_CUSTOM_MEM_LEVEL;
+}
+
+#endif
+
+// Applies the compression profile to a png write struct
+static void set_png_profile(png_structp png_ptr, const image_write_options *options) {
+    switch (options->profile) {
+    case IMAGE_WRITE_PROFILE_FAST:
+        // sub is the cheapest filter that still helps natural images
+        set_png_zlib_levels(png_ptr, 1, 8);
+        png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_FILTER_SUB);
+        break;
+
+    case IMAGE_WRITE_PROFILE_SMALL:
+        set_png_zlib_levels(png_ptr, 9, 9);
+        png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_ALL_FILTERS);
+        break;
+
+    default:
+        break;
+    }
+}
+
 char *write_image_to_base64(const char *image_type, unsigned char * data, int width, int height, int channels) {
+    return write_image_to_base64_with_options(image_type, data, width, height, channels, NULL);
+}
+
+char *write_image_to_base64_with_options(const char *image_type, unsigned char * data, int width, int height, int channels, const image_write_options *options) {
     int file_type = -1;
     char *base64 = NULL;
 
@@ -78,9 +336,9 @@ char *write_image_to_base64(const char *image_type, unsigned char * data, int wi
     }
 
     if (file_type == IMAGE_TYPE_PNG) {
-        base64 = write_png_to_base64(data, width, height, channels);
+        base64 = write_png_to_base64(data, width, height, channels, options);
     } else if (file_type == IMAGE_TYPE_JPEG) {
-        base64 = write_jpeg_to_base64(data, width, height, channels);
+        base64 = write_jpeg_to_base64(data, width, height, channels, options);
     } else {
         LOG("WARNING: Unsupported image type for base64: %s", image_type);
     }
@@ -90,35 +348,27 @@ char *write_image_to_base64(const char *image_type, unsigned char * data, int wi
 
 //png helper funcs for writing to memory
 
-/* structure to store PNG image bytes */
-struct mem_encode {
-    char *buffer;
-    size_t size;
-};
+static void png_write_data_func(png_structp png_ptr, png_bytep data, png_size_t length) {
+    base64_stream *stream = (base64_stream *) png_get_io_ptr(png_ptr);
+    base64_stream_write(stream, data, length);
 
-void png_write_data_func(png_structp png_ptr, png_bytep data, png_size_t length) {
-    /* with libpng15 next line causes pointer deference error; use libpng12 */
-    struct mem_encode* p=(struct mem_encode*)png_get_io_ptr(png_ptr); /* was png_ptr->io_ptr */
-    size_t nsize = p->size + length;
-
-    /* allocate or grow buffer */
-    if(p->buffer)
-        p->buffer = realloc(p->buffer, nsize);
-    else
-        p->buffer = malloc(nsize);
-
-    if(!p->buffer)
+    if (stream->failed) {
         png_error(png_ptr, "Write Error");
+    }
+}
 
-    /* copy new bytes to end of buffer */
-    memcpy(p->buffer + p->size, data, length);
-    p->size += length;
+static void png_flush_data_func(png_structp png_ptr) {
 }
 
-char *write_png_to_base64(unsigned char * data, int width, int height, int channels) {
-    struct mem_encode state;
-    state.buffer = NULL;
-    state.size = 0;
+char *write_png_to_base64(unsigned char * data, int width, int height, int channels, const image_write_options *options) {
+    base64_stream stream;
+    volatile bool did_write = false;
+
+    // assume the usual 4:1 compression of the raw rows
+    base64_stream_init(&stream, (size_t) width * height * channels / 4);
+    if (stream.failed) {
+        goto png_create_write_struct_failed;
+    }
 
     png_structp png_ptr = png_create_write_struct (PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     if (png_ptr == NULL) {
@@ -130,17 +380,24 @@ char *write_png_to_base64(unsigned char * data, int width, int height, int chann
         goto png_create_info_struct_failed;
     }
 
+    png_byte ** volatile row_pointers = NULL;
+
     // Set up error handling
 
     if (setjmp (png_jmpbuf (png_ptr))) {
+        free (row_pointers);
         goto png_failure;
     }
 
     // Set image attributes
     png_set_IHDR (png_ptr, info_ptr, width, height, 8, channels == 3 ? PNG_COLOR_TYPE_RGB : PNG_COLOR_TYPE_RGBA , PNG_INTERLACE_NONE,
                   PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    set_png_profile(png_ptr, get_write_options(options));
 
-    png_byte **row_pointers = (png_byte **) malloc(height * sizeof (png_byte *));
+    row_pointers = (png_byte **) malloc(height * sizeof (png_byte *));
+    if (!row_pointers) {
+        goto png_failure;
+    }
 
     int i = 0;
     int rowbytes = channels * width;
@@ -148,12 +405,14 @@ char *write_png_to_base64(unsigned char * data, int width, int height, int chann
         row_pointers[i] = (unsigned char*)(data + i * rowbytes);
     }
 
-    // Write the image data to fp
+    // Encode the image data to base64 as libpng hands it out
 
-    png_set_write_fn(png_ptr, &state, png_write_data_func, NULL);
+    png_set_write_fn(png_ptr, &stream, png_write_data_func, png_flush_data_func);
     png_set_rows (png_ptr, info_ptr, row_pointers);
     png_write_png (png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, NULL);
 
+    did_write = true;
+
     // Only free the pointer to the row pointers as row pointers point
     // image data that does not belong to this function
     free (row_pointers);
@@ -163,54 +422,138 @@ png_create_info_struct_failed:
     png_destroy_write_struct (&png_ptr, &info_ptr);
 png_create_write_struct_failed:
 
-    if (state.buffer == NULL) {
-        return NULL;
-    } else {
-        const size_t b64size = GetBase64LengthFromBinaryLength(state.size);
-        char *base64 = malloc(b64size + 1);
+    if (!did_write) {
+        stream.failed = true;
+    }
+    return base64_stream_finish(&stream);
+}
+
+//jpeg helper funcs for writing to memory
+
+#define JPEG_OUTPUT_CHUNK 16384
+
+/* libjpeg destination handing its output to a base64 stream a chunk at a time */
+struct jpeg_base64_destination {
+    struct jpeg_destination_mgr pub;
+    base64_stream *stream;
+    JOCTET buffer[JPEG_OUTPUT_CHUNK];
+};
+
+struct jpeg_base64_error {
+    struct jpeg_error_mgr pub;
+    jmp_buf jbuf;
+};
 
-        WriteBase64(state.buffer, state.size, base64);
-        base64[b64size] = '\0';
+static void jpeg_base64_init_destination(j_compress_ptr cinfo) {
+    struct jpeg_base64_destination *dest = (struct jpeg_base64_destination *) cinfo->dest;
+    dest->pub.next_output_byte = dest->buffer;
+    dest->pub.free_in_buffer = JPEG_OUTPUT_CHUNK;
+}
 
-        free(state.buffer);
-        return base64;
+static boolean jpeg_base64_empty_output_buffer(j_compress_ptr cinfo) {
+    struct jpeg_base64_destination *dest = (struct jpeg_base64_destination *) cinfo->dest;
+    base64_stream_write(dest->stream, dest->buffer, JPEG_OUTPUT_CHUNK);
+    if (dest->stream->failed) {
+        ERREXIT(cinfo, JERR_FILE_WRITE);
     }
+
+    dest->pub.next_output_byte = dest->buffer;
+    dest->pub.free_in_buffer = JPEG_OUTPUT_CHUNK;
+    return TRUE;
 }
 
-char *write_jpeg_to_base64(unsigned char * data, int width, int height, int channels) {
-    char *base64 = 0;
+static void jpeg_base64_term_destination(j_compress_ptr cinfo) {
+    struct jpeg_base64_destination *dest = (struct jpeg_base64_destination *) cinfo->dest;
+    base64_stream_write(dest->stream, dest->buffer, JPEG_OUTPUT_CHUNK - dest->pub.free_in_buffer);
+}
 
-    tjhandle _jpegCompressor = tjInitCompress();
+static void jpeg_base64_error_exit(j_common_ptr cinfo) {
+    char msg[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, msg);
+    LOG("WARNING: Unable to compress base64 JPEG: %s", msg);
 
-    unsigned char *buffer = 0;
-    unsigned long buffer_size = 0;
+    struct jpeg_base64_error *err = (struct jpeg_base64_error *) cinfo->err;
+    longjmp(err->jbuf, 1);
+}
 
-    int retval = tjCompress2(_jpegCompressor, buffer, width, 0, height,
-                             channels == 3 ? TJPF_RGB : TJPF_RGBA,
-                             &buffer, &buffer_size, TJSAMP_444, 90,
-                             TJFLAG_FASTDCT);
+char *write_jpeg_to_base64(unsigned char * data, int width, int height, int channels, const image_write_options *options) {
+    base64_stream stream;
+    options = get_write_options(options);
 
-    // If failure,
-    if (retval != 0 || !buffer) {
+    // assume the usual 10:1 compression at quality 90
+    base64_stream_init(&stream, (size_t) width * height * channels / 10);
+    if (stream.failed) {
         LOG("WARNING: Unable to compress %d x %d base64 JPEG", width, height);
-    } else {
-        const size_t b64size = GetBase64LengthFromBinaryLength(buffer_size);
-        char *base64 = malloc(b64size + 1);
+        return NULL;
+    }
 
-        WriteBase64(buffer, buffer_size, base64);
-        base64[b64size] = '\0';
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_base64_error jerr;
+    struct jpeg_base64_destination *dest = (struct jpeg_base64_destination *) malloc(sizeof(struct jpeg_base64_destination));
+    if (!dest) {
+        LOG("WARNING: Unable to compress %d x %d base64 JPEG", width, height);
+        stream.failed = true;
+        return base64_stream_finish(&stream);
+    }
+
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = jpeg_base64_error_exit;
+    jpeg_create_compress(&cinfo);
+
+    if (setjmp(jerr.jbuf)) {
+        jpeg_destroy_compress(&cinfo);
+        free(dest);
+        stream.failed = true;
+        return base64_stream_finish(&stream);
     }
 
-    if (buffer) {
-        tjFree(buffer);
+    dest->pub.init_destination = jpeg_base64_init_destination;
+    dest->pub.empty_output_buffer = jpeg_base64_empty_output_buffer;
+    dest->pub.term_destination = jpeg_base64_term_destination;
+    dest->stream = &stream;
+    cinfo.dest = &dest->pub;
+
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = channels;
+    cinfo.in_color_space = channels == 3 ? JCS_RGB : JCS_EXT_RGBA;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, get_jpeg_quality(options), TRUE);
+    cinfo.dct_method = JDCT_IFAST;
+
+    // libjpeg subsamples chroma by giving luma the larger sampling factors
+    int i;
+    for (i = 0; i < cinfo.num_components; i++) {
+        cinfo.comp_info[i].h_samp_factor = 1;
+        cinfo.comp_info[i].v_samp_factor = 1;
+    }
+    if (options->jpeg_subsampling == JPEG_SUBSAMPLING_422) {
+        cinfo.comp_info[0].h_samp_factor = 2;
+    } else if (options->jpeg_subsampling == JPEG_SUBSAMPLING_420) {
+        cinfo.comp_info[0].h_samp_factor = 2;
+        cinfo.comp_info[0].v_samp_factor = 2;
     }
 
-    tjDestroy(_jpegCompressor);
+    jpeg_start_compress(&cinfo, TRUE);
 
-    return base64;
+    int rowbytes = channels * width;
+    while (cinfo.next_scanline < cinfo.image_height) {
+        JSAMPROW row = data + cinfo.next_scanline * rowbytes;
+        jpeg_write_scanlines(&cinfo, &row, 1);
+    }
+
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    free(dest);
+
+    return base64_stream_finish(&stream);
 }
 
 bool write_image_to_file(const char *path, const char *name, unsigned char * data, int width, int height, int channels) {
+    return write_image_to_file_with_options(path, name, data, width, height, channels, NULL);
+}
+
+bool write_image_to_file_with_options(const char *path, const char *name, unsigned char * data, int width, int height, int channels, const image_write_options *options) {
     int file_type = -1;
     bool did_write = false;
 
@@ -229,21 +572,22 @@ bool write_image_to_file(const char *path, const char *name, unsigned char * dat
 
     if (file_type == IMAGE_TYPE_PNG) {
 
-        did_write = write_png_to_file(path, name, data, width, height, channels);
+        did_write = write_png_to_file(path, name, data, width, height, channels, options);
 
     } else if (file_type == IMAGE_TYPE_JPEG) {
 
-        did_write = write_jpeg_to_file(path, name, data, width, height, channels);
+        did_write = write_jpeg_to_file(path, name, data, width, height, channels, options);
 
     }
     return did_write;
 }
 
-bool write_jpeg_to_file(const char *path, const char *name, unsigned char *data, int width, int height, int channels) {
+bool write_jpeg_to_file(const char *path, const char *name, unsigned char *data, int width, int height, int channels, const image_write_options *options) {
     bool did_write = false;
+    options = get_write_options(options);
 
     // append filename to path
-    size_t full_path_len = strlen(path) + strlen("/") + strlen(name);
+    size_t full_path_len = strlen(path) + strlen("/") + strlen(name) + 1;
     char *full_path = (char *)malloc(full_path_len);
     memset(full_path, 0, full_path_len);
     sprintf(full_path, "%s%s%s", path, "/", name);
@@ -258,9 +602,16 @@ bool write_jpeg_to_file(const char *path, const char *name, unsigned char *data,
         unsigned char *buffer = 0;
         unsigned long buffer_size = 0;
 
-        int retval = tjCompress2(_jpegCompressor, buffer, width, 0, height,
+        int subsampling = TJSAMP_444;
+        if (options->jpeg_subsampling == JPEG_SUBSAMPLING_422) {
+            subsampling = TJSAMP_422;
+        } else if (options->jpeg_subsampling == JPEG_SUBSAMPLING_420) {
+            subsampling = TJSAMP_420;
+        }
+
+        int retval = tjCompress2(_jpegCompressor, data, width, 0, height,
                                  channels == 3 ? TJPF_RGB : TJPF_RGBA,
-                                 &buffer, &buffer_size, TJSAMP_444, 90,
+                                 &buffer, &buffer_size, subsampling, get_jpeg_quality(options),
                                  TJFLAG_FASTDCT);
 
         // If failure,
@@ -284,11 +635,11 @@ bool write_jpeg_to_file(const char *path, const char *name, unsigned char *data,
     return did_write;
 }
 
-bool write_png_to_file(const char *path, const char *name, unsigned char *data, int width, int height, int channels) {
+bool write_png_to_file(const char *path, const char *name, unsigned char *data, int width, int height, int channels, const image_write_options *options) {
     bool did_write = false;
 
     // append path to filename
-    size_t full_path_len = strlen(path) + strlen("/") + strlen(name);
+    size_t full_path_len = strlen(path) + strlen("/") + strlen(name) + 1;
     char *full_path = (char *)malloc(full_path_len);
     memset(full_path, 0, full_path_len);
     sprintf(full_path, "%s%s%s", path, "/", name);
@@ -318,6 +669,7 @@ bool write_png_to_file(const char *path, const char *name, unsigned char *data,
 
     png_set_IHDR (png_ptr, info_ptr, width, height, 8, channels == 3 ? PNG_COLOR_TYPE_RGB : PNG_COLOR_TYPE_RGBA , PNG_INTERLACE_NONE,
                   PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    set_png_profile(png_ptr, get_write_options(options));
 
     png_byte **row_pointers = (png_byte **) malloc(height * sizeof (png_byte *));
     int i;
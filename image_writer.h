@@ -13,17 +13,35 @@
 
 enum IMAGE_TYPES {IMAGE_TYPE_JPEG, IMAGE_TYPE_PNG};
 
+// PNG compression profiles, trading encode time against file size
+enum IMAGE_WRITE_PROFILES {
+    IMAGE_WRITE_PROFILE_DEFAULT,    // libpng defaults
+    IMAGE_WRITE_PROFILE_FAST,       // zlib level 1 and a fixed filter, for screenshots
+    IMAGE_WRITE_PROFILE_SMALL       // zlib level 9 and every filter, for build time assets
+};
+
+enum JPEG_SUBSAMPLING {JPEG_SUBSAMPLING_444, JPEG_SUBSAMPLING_422, JPEG_SUBSAMPLING_420};
+
+typedef struct image_write_options_t {
+    int profile;            // IMAGE_WRITE_PROFILES, PNG only
+    int jpeg_quality;       // 1-100, 0 for the default of 90
+    int jpeg_subsampling;   // JPEG_SUBSAMPLING
+} image_write_options;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// options may be NULL for the defaults everywhere below
 bool write_image_to_file(const char *path, const char *name, unsigned char * data, int width, int height, int channels); 
-bool write_png_to_file(const char *path, const char *name, unsigned char * data, int width, int height, int channels);
-bool write_jpeg_to_file(const char *path, const char *name, unsigned char * data, int width, int height, int channels); 
+bool write_image_to_file_with_options(const char *path, const char *name, unsigned char * data, int width, int height, int channels, const image_write_options *options);
+bool write_png_to_file(const char *path, const char *name, unsigned char * data, int width, int height, int channels, const image_write_options *options);
+bool write_jpeg_to_file(const char *path, const char *name, unsigned char * data, int width, int height, int channels, const image_write_options *options);
 
 char *write_image_to_base64(const char *image_type, unsigned char *data, int width, int height, int channels); 
-char *write_png_to_base64(unsigned char * data, int width, int height, int channels);
-char *write_jpeg_to_base64(unsigned char * data, int width, int height, int channels); 
+char *write_image_to_base64_with_options(const char *image_type, unsigned char *data, int width, int height, int channels, const image_write_options *options);
+char *write_png_to_base64(unsigned char * data, int width, int height, int channels, const image_write_options *options);
+char *write_jpeg_to_base64(unsigned char * data, int width, int height, int channels, const image_write_options *options);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,312 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 input_replay.c
+ * @brief	records a session's input and plays it back frame for frame
+ */
+#include "core/input_replay.h"
+#include "core/events.h"
+#include "core/log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define REPLAY_MAGIC "TLRP"
+#define REPLAY_VERSION 1
+
+#define RECORD_TICK 'T'
+#define RECORD_INPUT 'I'
+#define RECORD_EVENT 'E'
+
+// longer events are dropped rather than held in memory
+#define MAX_EVENT_BYTES (64 * 1024)
+
+// events the engine dispatches for its own work, which happen again when
+// playing rather than being recorded
+static const char *m_engine_events[] = {
+    "imageLoaded", "imageError", "preloadProgress", "canvasFreed", "canvasSaved",
+    "urlLoaded", "xhr", "socketData", "spriteLoop", "spriteFinish", "particlesFinish"
+};
+
+static int m_state = INPUT_REPLAY_IDLE;
+static FILE *m_file = NULL;
+static double m_tick_start = 0;
+static unsigned int m_frames = 0;
+// what was read past the end of the last frame played
+static int m_next_record = EOF;
+
+static double replay_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void write_varint(unsigned long long value) {
+    while (value >= 0x80) {
+        fputc((int) (value & 0x7f) | 0x80, m_file);
+        value >>= 7;
+    }
+    fputc((int) value, m_file);
+}
+
+static void write_signed(long long value) {
+    write_varint(((unsigned long long) value << 1) ^ (unsigned long long) (value >> 63));
+}
+
+static bool read_varint(unsigned long long *value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = fgetc(m_file);
+        if (c == EOF) {
+            return false;
+        }
+        *value |= (unsigned long long) (c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool read_signed(long long *value) {
+    unsigned long long zigzag;
+    if (!read_varint(&zigzag)) {
+        return false;
+    }
+    *value = (long long) (zigzag >> 1) ^ -(long long) (zigzag & 1);
+    return true;
+}
+
+/**
+ * @name	is_engine_event
+ * @brief	checks an event's name against those the engine dispatches
+ * @param	event - (const char *) the event as JSON
+ * @retval	bool - true if the engine made it
+ */
+static bool is_engine_event(const char *event) {
+    const char *name = strstr(event, "\"name\":\"");
+    if (!name) {
+        return false;
+    }
+    name += strlen("\"name\":\"");
+    for (size_t i = 0; i < sizeof(m_engine_events) / sizeof(m_engine_events[0]); i++) {
+        size_t length = strlen(m_engine_events[i]);
+        if (!strncmp(name, m_engine_events[i], length) && name[length] == '"') {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool open_file(const char *path, const char *mode) {
+    input_replay_stop();
+    m_file = fopen(path, mode);
+    if (!m_file) {
+        LOG("{replay} WARNING: Unable to open %s", path);
+        return false;
+    }
+    m_frames = 0;
+    m_next_record = EOF;
+    return true;
+}
+
+/**
+ * @name	input_replay_record
+ * @brief	starts recording to a file, replacing it
+ * @param	path - (const char *) file to record to
+ * @retval	bool - false if it couldn't be opened
+ */
+CEXPORT bool input_replay_record(const char *path) {
+    if (!open_file(path, "wb")) {
+        return false;
+    }
+    fwrite(REPLAY_MAGIC, 1, 4, m_file);
+    fputc(REPLAY_VERSION, m_file);
+    LOG("{replay} Recording to %s", path);
+    __atomic_store_n(&m_state, INPUT_REPLAY_RECORDING, __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ * @name	input_replay_play
+ * @brief	starts playing a recording back
+ * @param	path - (const char *) file recorded by input_replay_record
+ * @retval	bool - false if it couldn't be opened or isn't a recording
+ */
+CEXPORT bool input_replay_play(const char *path) {
+    if (!open_file(path, "rb")) {
+        return false;
+    }
+    char magic[4];
+    if (fread(magic, 1, 4, m_file) != 4 || memcmp(magic, REPLAY_MAGIC, 4) || fgetc(m_file) != REPLAY_VERSION) {
+        LOG("{replay} WARNING: %s is not a recording this build can play", path);
+        fclose(m_file);
+        m_file = NULL;
+        return false;
+    }
+    m_next_record = fgetc(m_file);
+    LOG("{replay} Playing %s", path);
+    __atomic_store_n(&m_state, INPUT_REPLAY_PLAYING, __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ * @name	input_replay_stop
+ * @brief	stops recording or playing and closes the file
+ * @retval	NONE
+ */
+CEXPORT void input_replay_stop() {
+    int state = __atomic_exchange_n(&m_state, INPUT_REPLAY_IDLE, __ATOMIC_ACQ_REL);
+    if (m_file) {
+        fclose(m_file);
+        m_file = NULL;
+    }
+    if (state != INPUT_REPLAY_IDLE) {
+        LOG("{replay} Stopped %s after %u frames", state == INPUT_REPLAY_RECORDING ? "recording" : "playing", m_frames);
+    }
+}
+
+/**
+ * @name	input_replay_state
+ * @brief	gets whether a session is recorded or played
+ * @retval	int - one of input_replay_states
+ */
+int input_replay_state() {
+    return __atomic_load_n(&m_state, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * @name	play_frame
+ * @brief	queues the input and events recorded for the next frame
+ * @param	dt - (long *) receives the frame's dt
+ * @retval	bool - false at the end of the recording
+ */
+static bool play_frame(long *dt) {
+    unsigned long long value;
+    if (m_next_record != RECORD_TICK || !read_varint(&value)) {
+        return false;
+    }
+    *dt = (long) value;
+
+    for (;;) {
+        m_next_record = fgetc(m_file);
+        if (m_next_record == RECORD_INPUT) {
+            unsigned long long id, type;
+            long long x, y, offset;
+            if (!read_varint(&id) || !read_varint(&type) || !read_signed(&x) ||
+                !read_signed(&y) || !read_signed(&offset)) {
+                return false;
+            }
+            timestep_events_push_replayed((int) id, (int) type, (int) x, (int) y, m_tick_start + offset / 1000.0);
+        } else if (m_next_record == RECORD_EVENT) {
+            if (!read_varint(&value) || value > MAX_EVENT_BYTES) {
+                return false;
+            }
+            char *event = (char *) malloc(value + 1);
+            if (!event || fread(event, 1, value, m_file) != value) {
+                free(event);
+                return false;
+            }
+            event[value] = '\0';
+            core_dispatch_replayed_event(event);
+            free(event);
+        } else {
+            // the next frame, or the end
+            return true;
+        }
+    }
+}
+
+/**
+ * @name	input_replay_tick
+ * @brief	starts a frame in the recording, or plays the next one back
+ * @param	dt - (long) dt core_tick was given
+ * @retval	long - dt for the tick, the recorded one while playing
+ */
+long input_replay_tick(long dt) {
+    int state = input_replay_state();
+    if (state == INPUT_REPLAY_IDLE) {
+        return dt;
+    }
+
+    m_tick_start = replay_now();
+    if (state == INPUT_REPLAY_RECORDING) {
+        fputc(RECORD_TICK, m_file);
+        write_varint(dt > 0 ? (unsigned long long) dt : 0);
+        m_frames++;
+        return dt;
+    }
+
+    long played = dt;
+    if (!play_frame(&played)) {
+        input_replay_stop();
+        return dt;
+    }
+    m_frames++;
+    return played;
+}
+
+/**
+ * @name	input_replay_record_input
+ * @brief	records an input handed out this frame, with its time from the
+ *			start of the frame
+ * @param	event - (const input_event *) the input as it was pushed
+ * @retval	NONE
+ */
+void input_replay_record_input(const input_event *event) {
+    // nothing is recorded before the first frame starts
+    if (input_replay_state() != INPUT_REPLAY_RECORDING || !m_frames) {
+        return;
+    }
+    fputc(RECORD_INPUT, m_file);
+    write_varint((unsigned int) event->id);
+    write_varint((unsigned int) event->type);
+    write_signed(event->x);
+    write_signed(event->y);
+    write_signed((long long) ((event->timestamp - m_tick_start) * 1000));
+}
+
+/**
+ * @name	input_replay_record_event
+ * @brief	records an event dispatched this frame, if the platform sent it
+ * @param	event - (const char *) the event as JSON
+ * @retval	NONE
+ */
+void input_replay_record_event(const char *event) {
+    if (input_replay_state() != INPUT_REPLAY_RECORDING || !m_frames || is_engine_event(event)) {
+        return;
+    }
+    size_t length = strlen(event);
+    if (length > MAX_EVENT_BYTES) {
+        LOG("{replay} WARNING: Not recording an event of %d bytes", (int) length);
+        return;
+    }
+    fputc(RECORD_EVENT, m_file);
+    write_varint(length);
+    fwrite(event, 1, length, m_file);
+}
+
+/**
+ * @name	input_replay_accepts_live_event
+ * @brief	checks whether an event dispatched now should be queued, while
+ *			playing only the engine's own are
+ * @param	event - (const char *) the event as JSON
+ * @retval	bool - true to queue it
+ */
+bool input_replay_accepts_live_event(const char *event) {
+    return input_replay_state() != INPUT_REPLAY_PLAYING || is_engine_event(event);
+}
@@ -0,0 +1,68 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef INPUT_REPLAY_H
+#define INPUT_REPLAY_H
+
+#include "core/types.h"
+#include "core/util/detect.h"
+#include "core/timestep/timestep_events.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Records a session's input to a file and plays it back frame for frame,
+// to rerun a janky session under the profiler or on another build. Each
+// tick records the dt core_tick was given, the pointer input the tick
+// handed to js, and the events from the platform it dispatched. Events the
+// engine makes itself, like image loads and xhr responses, are not
+// recorded, as they happen again on their own.
+// Playing back, each tick takes its dt from the file, and the recorded
+// input and platform events are queued for the same tick. Live input and
+// platform events are dropped until the file ends, so start playing before
+// the game takes input, from the same build of the game and screen size.
+// The file is a run of frames: 'T' and the dt, then an 'I' for each input
+// and an 'E' for each event, numbers as varints. Tick thread only, except
+// input_replay_state.
+
+enum input_replay_states {
+	INPUT_REPLAY_IDLE,
+	INPUT_REPLAY_RECORDING,
+	INPUT_REPLAY_PLAYING
+};
+
+// starts on the next tick, false if the file can't be opened
+CEXPORT bool input_replay_record(const char *path);
+CEXPORT bool input_replay_play(const char *path);
+// closes the file, playing also stops on its own at the end
+CEXPORT void input_replay_stop();
+// any thread
+int input_replay_state();
+
+// called by core_tick first, returns the dt the tick goes on with
+long input_replay_tick(long dt);
+// called by timestep_events as it hands out each pushed input
+void input_replay_record_input(const input_event *event);
+// called by core_flush_events for each event it dispatches
+void input_replay_record_event(const char *event);
+// false for a platform event that arrives while playing
+bool input_replay_accepts_live_event(const char *event);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // INPUT_REPLAY_H
@@ -0,0 +1,331 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 jobs.c
+ * @brief	worker threads shared by background work
+ */
+#include "core/jobs.h"
+#include "core/concurrent_pool.h"
+#include "core/log.h"
+#include "core/platform/native.h"
+#include "core/platform/threads.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define JOB_POOL_SLAB 64
+
+typedef struct job_t {
+    job_proc run;
+    job_proc complete;
+    void *data;
+    int priority;
+    struct job_t *next;
+    struct job_t *prev;
+} job;
+
+// the owner takes jobs from the head, in the order they were submitted,
+// and thieves take them from the tail
+typedef struct worker_t {
+    pthread_mutex_t mutex;
+    job *head[JOB_PRIORITY_COUNT];
+    job *tail[JOB_PRIORITY_COUNT];
+    ThreadsThread thread;
+} worker;
+
+static worker m_workers[JOBS_MAX_WORKERS];
+static int m_worker_count = 0;
+static concurrent_pool *m_job_pool = NULL;
+static unsigned int m_next_worker = 0;
+
+// workers sleep on m_wake_cond while nothing is queued
+static pthread_mutex_t m_wake_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t m_wake_cond = PTHREAD_COND_INITIALIZER;
+static bool m_running = false;
+// jobs submitted to a queue and not yet taken from it
+static int m_queued = 0;
+
+// finished jobs waiting for their completion, newest first
+static job *m_completions = NULL;
+
+// index of the worker the calling thread is, -1 off the workers
+static __thread int t_worker = -1;
+
+static void push_job(worker *w, job *j) {
+    pthread_mutex_lock(&w->mutex);
+    j->next = NULL;
+    j->prev = w->tail[j->priority];
+    if (j->prev) {
+        j->prev->next = j;
+    } else {
+        w->head[j->priority] = j;
+    }
+    w->tail[j->priority] = j;
+    pthread_mutex_unlock(&w->mutex);
+}
+
+static job *pop_job(worker *w, int priority, bool steal) {
+    pthread_mutex_lock(&w->mutex);
+    job *j = steal ? w->tail[priority] : w->head[priority];
+    if (j) {
+        if (j->prev) {
+            j->prev->next = j->next;
+        } else {
+            w->head[priority] = j->next;
+        }
+        if (j->next) {
+            j->next->prev = j->prev;
+        } else {
+            w->tail[priority] = j->prev;
+        }
+    }
+    pthread_mutex_unlock(&w->mutex);
+    return j;
+}
+
+// the highest priority job on any queue, the worker's own queue first
+static job *find_job(int index) {
+    int priority;
+    for (priority = 0; priority < JOB_PRIORITY_COUNT; priority++) {
+        job *j = pop_job(&m_workers[index], priority, false);
+        int i;
+        for (i = 1; !j && i < m_worker_count; i++) {
+            j = pop_job(&m_workers[(index + i) % m_worker_count], priority, true);
+        }
+        if (j) {
+            __atomic_sub_fetch(&m_queued, 1, __ATOMIC_RELAXED);
+            return j;
+        }
+    }
+    return NULL;
+}
+
+static void queue_completion(job *j) {
+    j->next = __atomic_load_n(&m_completions, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&m_completions, &j->next, j, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        // j->next now holds the current head, try again on top of it
+    }
+}
+
+static void run_job(job *j) {
+    j->run(j->data);
+    if (j->complete) {
+        queue_completion(j);
+    } else {
+        CONCURRENT_POOL_RELEASE(j);
+    }
+}
+
+static void worker_run(void *param) {
+    t_worker = (int) (intptr_t) param;
+    // jobs may call into the platform, e.g. through a JVM
+    native_enter_thread();
+
+    while (true) {
+        job *j = find_job(t_worker);
+        if (j) {
+            run_job(j);
+            continue;
+        }
+
+        pthread_mutex_lock(&m_wake_mutex);
+        while (m_running && !__atomic_load_n(&m_queued, __ATOMIC_RELAXED)) {
+            pthread_cond_wait(&m_wake_cond, &m_wake_mutex);
+        }
+        bool done = !m_running && !__atomic_load_n(&m_queued, __ATOMIC_RELAXED);
+        pthread_mutex_unlock(&m_wake_mutex);
+        if (done) {
+            break;
+        }
+    }
+
+    native_leave_thread();
+    t_worker = -1;
+}
+
+/**
+ * @name	jobs_init
+ * @brief	starts the worker threads, does nothing if they are running
+ * @param	worker_count - (int) workers to start, 0 for one per core
+ *			besides the main thread
+ * @retval	NONE
+ */
+void jobs_init(int worker_count) {
+    if (m_running) {
+        return;
+    }
+
+    if (worker_count <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        worker_count = cores > 1 ? (int) cores - 1 : 1;
+    }
+    if (worker_count > JOBS_MAX_WORKERS) {
+        worker_count = JOBS_MAX_WORKERS;
+    }
+
+    m_job_pool = CONCURRENT_POOL_INIT(job, JOB_POOL_SLAB);
+    if (!m_job_pool) {
+        LOG("{jobs} WARNING: Unable to create the job pool, jobs run where they are submitted");
+        return;
+    }
+
+    int i;
+    for (i = 0; i < worker_count; i++) {
+        worker *w = &m_workers[i];
+        pthread_mutex_init(&w->mutex, NULL);
+        int priority;
+        for (priority = 0; priority < JOB_PRIORITY_COUNT; priority++) {
+            w->head[priority] = w->tail[priority] = NULL;
+        }
+    }
+
+    // workers look at each other's queues, so they are all set up first.
+    // a worker that fails to start still has its queue emptied by thieves
+    m_running = true;
+    m_worker_count = worker_count;
+    int started = 0;
+    for (i = 0; i < worker_count; i++) {
+        m_workers[i].thread = threads_create_thread_with_priority(worker_run, (void *) (intptr_t) i,
+                                                                  THREADS_PRIORITY_UTILITY, THREADS_AFFINITY_ANY);
+        if (m_workers[i].thread == THREADS_INVALID_THREAD) {
+            LOG("{jobs} WARNING: Unable to start job worker %d", i);
+        } else {
+            started++;
+        }
+    }
+
+    if (!started) {
+        for (i = 0; i < worker_count; i++) {
+            pthread_mutex_destroy(&m_workers[i].mutex);
+        }
+        m_worker_count = 0;
+    }
+
+    LOG("{jobs} Started %d of %d job workers", started, worker_count);
+}
+
+/**
+ * @name	jobs_submit
+ * @brief	queues a job for the workers
+ * @param	run - (job_proc) called with data on a worker
+ * @param	complete - (job_proc) called with data on the main thread once
+ *			run has returned, may be NULL
+ * @param	data - (void *) passed to run and complete
+ * @param	priority - (job_priority) which jobs the workers take first
+ * @retval	NONE
+ */
+void jobs_submit(job_proc run, job_proc complete, void *data, job_priority priority) {
+    job *j = m_job_pool ? CONCURRENT_POOL_GET(job, m_job_pool) : NULL;
+    if (!j) {
+        // without a job to queue the completion on, it can only run here too
+        run(data);
+        if (complete) {
+            complete(data);
+        }
+        return;
+    }
+
+    j->run = run;
+    j->complete = complete;
+    j->data = data;
+    j->priority = priority < JOB_PRIORITY_COUNT ? priority : JOB_PRIORITY_LOW;
+
+    if (!m_worker_count) {
+        run_job(j);
+        return;
+    }
+
+    // jobs a worker submits stay with it, the rest are spread round robin
+    int index = t_worker;
+    if (index < 0) {
+        index = __atomic_fetch_add(&m_next_worker, 1, __ATOMIC_RELAXED) % m_worker_count;
+    }
+    // counted before it is pushed so the count never drops below zero
+    __atomic_add_fetch(&m_queued, 1, __ATOMIC_RELAXED);
+    push_job(&m_workers[index], j);
+
+    pthread_mutex_lock(&m_wake_mutex);
+    pthread_cond_signal(&m_wake_cond);
+    pthread_mutex_unlock(&m_wake_mutex);
+}
+
+/**
+ * @name	jobs_run_completions
+ * @brief	runs the completions of the jobs that finished since the last
+ *			call, oldest first. main thread only
+ * @retval	NONE
+ */
+void jobs_run_completions() {
+    job *j = __atomic_exchange_n(&m_completions, NULL, __ATOMIC_ACQUIRE);
+
+    // the stack is newest first
+    job *ordered = NULL;
+    while (j) {
+        job *next = j->next;
+        j->next = ordered;
+        ordered = j;
+        j = next;
+    }
+
+    while (ordered) {
+        job *next = ordered->next;
+        ordered->complete(ordered->data);
+        CONCURRENT_POOL_RELEASE(ordered);
+        ordered = next;
+    }
+}
+
+/**
+ * @name	jobs_worker_count
+ * @brief	gets how many workers are running
+ * @retval	int - the number of workers
+ */
+int jobs_worker_count() {
+    return m_worker_count;
+}
+
+/**
+ * @name	jobs_shutdown
+ * @brief	lets the workers finish the queued jobs, joins them and runs the
+ *			remaining completions. main thread only
+ * @retval	NONE
+ */
+void jobs_shutdown() {
+    pthread_mutex_lock(&m_wake_mutex);
+    m_running = false;
+    pthread_cond_broadcast(&m_wake_cond);
+    pthread_mutex_unlock(&m_wake_mutex);
+
+    // a worker may still steal from any queue until they have all stopped
+    int i;
+    for (i = 0; i < m_worker_count; i++) {
+        if (m_workers[i].thread != THREADS_INVALID_THREAD) {
+            threads_join_thread(&m_workers[i].thread);
+        }
+    }
+    for (i = 0; i < m_worker_count; i++) {
+        pthread_mutex_destroy(&m_workers[i].mutex);
+    }
+    m_worker_count = 0;
+
+    jobs_run_completions();
+
+    if (m_job_pool) {
+        CONCURRENT_POOL_DESTROY(m_job_pool);
+        m_job_pool = NULL;
+    }
+}
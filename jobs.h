@@ -0,0 +1,58 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+ 
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+ 
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef JOBS_H
+#define JOBS_H
+
+#include "core/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define JOBS_MAX_WORKERS 8
+
+typedef void (*job_proc)(void *data);
+
+// workers take every queued high priority job before a normal one
+typedef enum job_priority_t {
+	JOB_PRIORITY_HIGH,
+	JOB_PRIORITY_NORMAL,
+	JOB_PRIORITY_LOW,
+	JOB_PRIORITY_COUNT
+} job_priority;
+
+// A fixed pool of worker threads shared by the subsystems that have work
+// to do off the main thread. Each worker has its own queue, a job submitted
+// from inside a job goes to the submitting worker's queue, and idle workers
+// steal from the others.
+
+// starts the workers, worker_count 0 means one per core besides the main thread
+void jobs_init(int worker_count);
+// runs run(data) on a worker, then complete(data) on the main thread the
+// next time it calls jobs_run_completions. complete may be NULL. Without
+// workers the job runs on the calling thread
+void jobs_submit(job_proc run, job_proc complete, void *data, job_priority priority);
+// called by core_tick, runs the completions of finished jobs in order
+void jobs_run_completions();
+int jobs_worker_count();
+// finishes the queued jobs and their completions, then stops the workers
+void jobs_shutdown();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // JOBS_H
@@ -0,0 +1,263 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 load_stats.c
+ * @brief	latency histograms and cache counters for the image load pipeline
+ */
+#include "core/load_stats.h"
+#include "core/profiler.h"
+#include "core/log.h"
+#include "core/deps/jansson/jansson.h"
+#include <string.h>
+
+static const char *m_stage_names[LOAD_STAGE_COUNT] = {
+    "queue", "fetch", "diskRead", "decode", "reformat", "upload", "total"
+};
+
+static const char *m_counter_names[LOAD_COUNTER_COUNT] = {
+    "requested", "resident", "failed", "memoryHits", "diskHits", "fresh",
+    "downloads", "notModified", "fetchErrors", "bytesDownloaded"
+};
+
+static load_stage_stats m_stages[LOAD_STAGE_COUNT];
+static long long m_counters[LOAD_COUNTER_COUNT];
+
+static double m_log_interval = 0; // seconds
+static double m_since_log = 0; // milliseconds
+// the counters as of the last summary, which logs what changed since
+static long long m_logged[LOAD_COUNTER_COUNT];
+
+/**
+ * @name	load_stats_record
+ * @brief	adds a time to a stage's histogram, from any thread
+ * @param	stage - (int) one of load_stages
+ * @param	ns - (long long) time the stage took in nanoseconds
+ * @retval	NONE
+ */
+void load_stats_record(int stage, long long ns) {
+    if (stage < 0 || stage >= LOAD_STAGE_COUNT) {
+        return;
+    }
+    unsigned long long us = ns > 0 ? (unsigned long long) ns / 1000 : 0;
+
+    int bucket = 0;
+    while (bucket < LOAD_STATS_BUCKETS - 1 && us >= (1ULL << bucket)) {
+        bucket++;
+    }
+
+    load_stage_stats *s = &m_stages[stage];
+    __atomic_add_fetch(&s->count, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s->total_us, us, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&s->buckets[bucket], 1, __ATOMIC_RELAXED);
+
+    unsigned long long max = __atomic_load_n(&s->max_us, __ATOMIC_RELAXED);
+    while (us > max && !__atomic_compare_exchange_n(&s->max_us, &max, us, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        // max now holds what another thread stored, try again if still larger
+    }
+}
+
+void load_stats_since(int stage, long long start) {
+    load_stats_record(stage, profiler_now() - start);
+}
+
+void load_stats_add(int counter, long long n) {
+    if (counter >= 0 && counter < LOAD_COUNTER_COUNT) {
+        __atomic_add_fetch(&m_counters[counter], n, __ATOMIC_RELAXED);
+    }
+}
+
+/**
+ * @name	load_stats_get_stage
+ * @brief	copies a stage's histogram, each field read on its own so a
+ *			copy taken while loads finish may be off by the last few
+ * @param	stage - (int) one of load_stages
+ * @param	stats - (load_stage_stats *) receives the copy
+ * @retval	NONE
+ */
+void load_stats_get_stage(int stage, load_stage_stats *stats) {
+    memset(stats, 0, sizeof(load_stage_stats));
+    if (stage < 0 || stage >= LOAD_STAGE_COUNT) {
+        return;
+    }
+
+    load_stage_stats *s = &m_stages[stage];
+    stats->count = __atomic_load_n(&s->count, __ATOMIC_RELAXED);
+    stats->total_us = __atomic_load_n(&s->total_us, __ATOMIC_RELAXED);
+    stats->max_us = __atomic_load_n(&s->max_us, __ATOMIC_RELAXED);
+    for (int i = 0; i < LOAD_STATS_BUCKETS; i++) {
+        stats->buckets[i] = __atomic_load_n(&s->buckets[i], __ATOMIC_RELAXED);
+    }
+}
+
+long long load_stats_get_counter(int counter) {
+    if (counter < 0 || counter >= LOAD_COUNTER_COUNT) {
+        return 0;
+    }
+    return __atomic_load_n(&m_counters[counter], __ATOMIC_RELAXED);
+}
+
+/**
+ * @name	load_stats_percentile
+ * @brief	finds the bucket a percentile of a stage's times falls in
+ * @param	stats - (const load_stage_stats *) from load_stats_get_stage
+ * @param	p - (int) percentile, 1 to 100
+ * @retval	double - upper bound of the bucket in milliseconds, the longest
+ *			time for the last bucket, 0 when nothing was recorded
+ */
+double load_stats_percentile(const load_stage_stats *stats, int p) {
+    unsigned long long total = 0;
+    for (int i = 0; i < LOAD_STATS_BUCKETS; i++) {
+        total += stats->buckets[i];
+    }
+    if (!total) {
+        return 0;
+    }
+
+    // nearest rank
+    unsigned long long rank = (total * p + 99) / 100;
+    unsigned long long seen = 0;
+    for (int i = 0; i < LOAD_STATS_BUCKETS - 1; i++) {
+        seen += stats->buckets[i];
+        if (seen >= rank) {
+            double bound = (1ULL << i) / 1000.0;
+            double max = stats->max_us / 1000.0;
+            return bound < max ? bound : max;
+        }
+    }
+    return stats->max_us / 1000.0;
+}
+
+CEXPORT void load_stats_reset() {
+    for (int i = 0; i < LOAD_STAGE_COUNT; i++) {
+        load_stage_stats *s = &m_stages[i];
+        __atomic_store_n(&s->count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&s->total_us, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&s->max_us, 0, __ATOMIC_RELAXED);
+        for (int j = 0; j < LOAD_STATS_BUCKETS; j++) {
+            __atomic_store_n(&s->buckets[j], 0, __ATOMIC_RELAXED);
+        }
+    }
+    for (int i = 0; i < LOAD_COUNTER_COUNT; i++) {
+        __atomic_store_n(&m_counters[i], 0, __ATOMIC_RELAXED);
+    }
+    memset(m_logged, 0, sizeof(m_logged));
+}
+
+CEXPORT void load_stats_set_log_interval(double seconds) {
+    m_log_interval = seconds > 0 ? seconds : 0;
+    m_since_log = 0;
+}
+
+/**
+ * @name	log_summary
+ * @brief	logs the counters' changes since the last summary and the
+ *			percentiles of the stages so far, when anything was loaded
+ * @retval	NONE
+ */
+static void log_summary() {
+    long long delta[LOAD_COUNTER_COUNT];
+    bool changed = false;
+    for (int i = 0; i < LOAD_COUNTER_COUNT; i++) {
+        long long value = load_stats_get_counter(i);
+        delta[i] = value - m_logged[i];
+        m_logged[i] = value;
+        changed = changed || delta[i] != 0;
+    }
+    if (!changed) {
+        return;
+    }
+
+    LOG("{loads} %lld loaded, %lld resident, %lld failed; cache %lld memory, %lld disk, %lld fresh; "
+        "server %lld downloads, %lld not modified, %lld errors, %lld bytes",
+        delta[LOAD_COUNT_REQUESTED], delta[LOAD_COUNT_RESIDENT], delta[LOAD_COUNT_FAILED],
+        delta[LOAD_COUNT_MEMORY_HITS], delta[LOAD_COUNT_DISK_HITS], delta[LOAD_COUNT_FRESH],
+        delta[LOAD_COUNT_DOWNLOADS], delta[LOAD_COUNT_NOT_MODIFIED], delta[LOAD_COUNT_FETCH_ERRORS],
+        delta[LOAD_COUNT_BYTES_DOWNLOADED]);
+
+    for (int i = 0; i < LOAD_STAGE_COUNT; i++) {
+        load_stage_stats s;
+        load_stats_get_stage(i, &s);
+        if (s.count) {
+            LOG("{loads} %s: %llu, p50 %.2fms, p95 %.2fms, max %.2fms", m_stage_names[i], s.count,
+                load_stats_percentile(&s, 50), load_stats_percentile(&s, 95), s.max_us / 1000.0);
+        }
+    }
+}
+
+/**
+ * @name	load_stats_tick
+ * @brief	logs a summary once the log interval has passed
+ * @param	dt - (double) milliseconds since the last tick
+ * @retval	NONE
+ */
+void load_stats_tick(double dt) {
+    if (m_log_interval <= 0) {
+        return;
+    }
+
+    m_since_log += dt;
+    if (m_since_log >= m_log_interval * 1000) {
+        m_since_log = 0;
+        log_summary();
+    }
+}
+
+/**
+ * @name	load_stats_report
+ * @brief	describes every stage, with times in milliseconds, and counter
+ *			as JSON, along with the image cache's hit rate
+ * @retval	char* - the report, freed by the caller, or NULL
+ */
+CEXPORT char *load_stats_report() {
+    json_t *report = json_object();
+
+    json_t *stages = json_object();
+    for (int i = 0; i < LOAD_STAGE_COUNT; i++) {
+        load_stage_stats s;
+        load_stats_get_stage(i, &s);
+
+        json_t *stage = json_object();
+        json_object_set_new(stage, "count", json_integer((json_int_t) s.count));
+        json_object_set_new(stage, "mean", json_real(s.count ? s.total_us / 1000.0 / s.count : 0));
+        json_object_set_new(stage, "p50", json_real(load_stats_percentile(&s, 50)));
+        json_object_set_new(stage, "p95", json_real(load_stats_percentile(&s, 95)));
+        json_object_set_new(stage, "p99", json_real(load_stats_percentile(&s, 99)));
+        json_object_set_new(stage, "max", json_real(s.max_us / 1000.0));
+
+        json_t *buckets = json_array();
+        for (int j = 0; j < LOAD_STATS_BUCKETS; j++) {
+            json_array_append_new(buckets, json_integer(s.buckets[j]));
+        }
+        json_object_set_new(stage, "buckets", buckets);
+        json_object_set_new(stages, m_stage_names[i], stage);
+    }
+    json_object_set_new(report, "stages", stages);
+
+    json_t *counters = json_object();
+    for (int i = 0; i < LOAD_COUNTER_COUNT; i++) {
+        json_object_set_new(counters, m_counter_names[i], json_integer(load_stats_get_counter(i)));
+    }
+    json_object_set_new(report, "counters", counters);
+
+    // served without a download, of everything the image cache served
+    long long hits = load_stats_get_counter(LOAD_COUNT_MEMORY_HITS) + load_stats_get_counter(LOAD_COUNT_DISK_HITS);
+    long long served = hits + load_stats_get_counter(LOAD_COUNT_DOWNLOADS);
+    json_object_set_new(report, "cacheHitRate", json_real(served ? (double) hits / served : 0));
+
+    char *str = json_dumps(report, JSON_COMPACT);
+    json_decref(report);
+    return str;
+}
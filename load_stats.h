@@ -0,0 +1,89 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef LOAD_STATS_H
+#define LOAD_STATS_H
+
+#include "core/types.h"
+#include "core/util/detect.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Times the stages images go through on their way to a texture into
+// histograms, and counts where the image cache found them. Buckets double in
+// width from a microsecond up, so percentiles are accurate to within a
+// factor of two, and recording is a few atomic adds from any thread. With a
+// log interval set, core_tick logs a summary of the loads since the last one.
+
+enum load_stages {
+	LOAD_STAGE_QUEUE,     // waiting for a decode worker or a request slot
+	LOAD_STAGE_FETCH,     // the request to the server, 304s included
+	LOAD_STAGE_DISK_READ, // opening a cached or bundled file, or reading it when it can't be mapped
+	LOAD_STAGE_DECODE,    // decoding into texture rows, padded or half sized
+	LOAD_STAGE_REFORMAT,  // packing to 16 bits a pixel
+	LOAD_STAGE_UPLOAD,    // creating the gl texture
+	LOAD_STAGE_TOTAL,     // texture_manager_load_texture to imageLoaded
+	LOAD_STAGE_COUNT
+};
+
+enum load_counters {
+	LOAD_COUNT_REQUESTED,        // textures loaded that weren't in the manager
+	LOAD_COUNT_RESIDENT,         // loads the manager already had the texture for
+	LOAD_COUNT_FAILED,           // textures reported as imageError
+	LOAD_COUNT_MEMORY_HITS,      // images the image cache served from memory
+	LOAD_COUNT_DISK_HITS,        // and from disk
+	LOAD_COUNT_FRESH,            // cached images not asked for again as still fresh
+	LOAD_COUNT_DOWNLOADS,        // images the server sent
+	LOAD_COUNT_NOT_MODIFIED,     // requests the server answered without an image
+	LOAD_COUNT_FETCH_ERRORS,     // requests that failed
+	LOAD_COUNT_BYTES_DOWNLOADED,
+	LOAD_COUNTER_COUNT
+};
+
+#define LOAD_STATS_BUCKETS 24
+
+typedef struct load_stage_stats_t {
+	unsigned long long count;
+	unsigned long long total_us;
+	unsigned long long max_us;
+	unsigned int buckets[LOAD_STATS_BUCKETS]; // bucket i holds times under 2^i us, the last all longer ones
+} load_stage_stats;
+
+// records a stage that took ns nanoseconds, as profiler_now measures
+void load_stats_record(int stage, long long ns);
+// records a stage that began at start, from profiler_now
+void load_stats_since(int stage, long long start);
+void load_stats_add(int counter, long long n);
+
+void load_stats_get_stage(int stage, load_stage_stats *stats);
+long long load_stats_get_counter(int counter);
+// the upper bound of the bucket holding the pth percentile, in milliseconds
+double load_stats_percentile(const load_stage_stats *stats, int p);
+
+CEXPORT void load_stats_reset();
+// seconds between summaries in the log, 0 for none, which is the default
+CEXPORT void load_stats_set_log_interval(double seconds);
+// called by core_tick
+void load_stats_tick(double dt);
+// every stage and counter as JSON, for the bindings. Caller frees
+CEXPORT char *load_stats_report();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LOAD_STATS_H
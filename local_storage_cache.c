@@ -0,0 +1,354 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 local_storage_cache.c
+ * @brief	write-behind cache in front of platform local storage
+ */
+#include "core/local_storage_cache.h"
+#include "core/jobs.h"
+#include "core/log.h"
+#include "core/deps/uthash/uthash.h"
+#include "core/platform/local_storage.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// how long a change may stay in memory only
+#define FLUSH_INTERVAL_MS 2000
+
+// a key that has been read or written. A NULL value means the platform
+// does not have the key, or will not once the entry is written
+typedef struct storage_entry_t {
+    char *key;
+    char *value;
+    bool dirty;
+    UT_hash_handle hh;
+} storage_entry;
+
+// a change copied out of the cache to be written without holding m_lock
+typedef struct storage_write_t {
+    char *key;
+    char *value;
+    struct storage_write_t *next;
+} storage_write;
+
+// guards the table and the clear counters, the main thread takes it too
+// so it is never held across a platform call
+static pthread_mutex_t m_lock = PTHREAD_MUTEX_INITIALIZER;
+// one flush at a time, so writes reach the platform in order
+static pthread_mutex_t m_flush_lock = PTHREAD_MUTEX_INITIALIZER;
+// serializes platform calls between a flush and the main thread's misses
+static pthread_mutex_t m_platform_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static storage_entry *m_entries = NULL;
+static int m_dirty_count = 0;
+// until the flushes catch up with a clear the platform still has the old
+// keys, so misses are answered with NULL
+static int m_clears_requested = 0;
+static int m_clears_applied = 0;
+static bool m_flush_queued = false;
+static long m_dirty_ms = 0;
+
+static void free_entry(storage_entry *entry) {
+    HASH_DEL(m_entries, entry);
+    free(entry->key);
+    free(entry->value);
+    free(entry);
+}
+
+static char *copy_string(const char *str) {
+    return str ? strdup(str) : NULL;
+}
+
+/**
+ * @name	take_writes
+ * @brief	copies the dirty entries out of the table and marks them clean,
+ *			called with m_lock held
+ * @retval	storage_write* - the changes, in no particular order
+ */
+static storage_write *take_writes() {
+    storage_write *writes = NULL;
+    storage_entry *entry, *tmp;
+    HASH_ITER(hh, m_entries, entry, tmp) {
+        if (!entry->dirty) {
+            continue;
+        }
+
+        storage_write *write = (storage_write *) malloc(sizeof(storage_write));
+        if (!write) {
+            // stays dirty for the next flush
+            continue;
+        }
+        write->key = strdup(entry->key);
+        write->value = copy_string(entry->value);
+        if (!write->key || (entry->value && !write->value)) {
+            free(write->key);
+            free(write->value);
+            free(write);
+            continue;
+        }
+        write->next = writes;
+        writes = write;
+        entry->dirty = false;
+        m_dirty_count--;
+    }
+    return writes;
+}
+
+static void flush_now() {
+    pthread_mutex_lock(&m_flush_lock);
+
+    pthread_mutex_lock(&m_lock);
+    int clears = m_clears_requested;
+    bool clear = clears != m_clears_applied;
+    storage_write *writes = take_writes();
+    pthread_mutex_unlock(&m_lock);
+
+    if (clear) {
+        pthread_mutex_lock(&m_platform_lock);
+        local_storage_clear();
+        pthread_mutex_unlock(&m_platform_lock);
+
+        pthread_mutex_lock(&m_lock);
+        m_clears_applied = clears;
+        pthread_mutex_unlock(&m_lock);
+    }
+
+    while (writes) {
+        storage_write *write = writes;
+        writes = write->next;
+
+        pthread_mutex_lock(&m_platform_lock);
+        if (write->value) {
+            local_storage_set_data(write->key, write->value);
+        } else {
+            local_storage_remove_data(write->key);
+        }
+        pthread_mutex_unlock(&m_platform_lock);
+
+        free(write->key);
+        free(write->value);
+        free(write);
+    }
+
+    pthread_mutex_unlock(&m_flush_lock);
+}
+
+static void flush_job(void *data) {
+    pthread_mutex_lock(&m_lock);
+    m_flush_queued = false;
+    pthread_mutex_unlock(&m_lock);
+
+    flush_now();
+}
+
+/**
+ * @name	set_entry
+ * @brief	stores a value for key to be written behind
+ * @param	key - (const char *) key
+ * @param	data - (const char *) value, NULL to remove the key
+ * @retval	NONE
+ */
+static void set_entry(const char *key, const char *data) {
+    char *value = copy_string(data);
+    if (data && !value) {
+        LOG("{storage} WARNING: Unable to store %s", key);
+        return;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    storage_entry *entry = NULL;
+    HASH_FIND_STR(m_entries, key, entry);
+    if (!entry) {
+        entry = (storage_entry *) calloc(1, sizeof(storage_entry));
+        if (entry) {
+            entry->key = strdup(key);
+        }
+        if (!entry || !entry->key) {
+            pthread_mutex_unlock(&m_lock);
+            LOG("{storage} WARNING: Unable to store %s", key);
+            free(entry);
+            free(value);
+            return;
+        }
+        HASH_ADD_KEYPTR(hh, m_entries, entry->key, strlen(entry->key), entry);
+    }
+
+    free(entry->value);
+    entry->value = value;
+    if (!entry->dirty) {
+        entry->dirty = true;
+        m_dirty_count++;
+    }
+    pthread_mutex_unlock(&m_lock);
+}
+
+/**
+ * @name	local_storage_cache_init
+ * @brief	starts with an empty cache
+ * @retval	NONE
+ */
+void local_storage_cache_init() {
+    m_dirty_ms = 0;
+}
+
+/**
+ * @name	local_storage_cache_get
+ * @brief	reads a key, from the platform the first time only
+ * @param	key - (const char *) key
+ * @retval	const char* - the value, or NULL if there is none
+ */
+const char *local_storage_cache_get(const char *key) {
+    pthread_mutex_lock(&m_lock);
+    storage_entry *entry = NULL;
+    HASH_FIND_STR(m_entries, key, entry);
+    bool cleared = m_clears_requested != m_clears_applied;
+    pthread_mutex_unlock(&m_lock);
+
+    // only the main thread adds or frees entries, so entry stays valid
+    if (entry) {
+        return entry->value;
+    }
+    if (cleared) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&m_platform_lock);
+    char *value = copy_string(local_storage_get_data(key));
+    pthread_mutex_unlock(&m_platform_lock);
+
+    entry = (storage_entry *) calloc(1, sizeof(storage_entry));
+    if (entry) {
+        entry->key = strdup(key);
+    }
+    if (!entry || !entry->key) {
+        // answered this once, without caching it
+        free(entry);
+        free(value);
+        return NULL;
+    }
+    entry->value = value;
+
+    pthread_mutex_lock(&m_lock);
+    HASH_ADD_KEYPTR(hh, m_entries, entry->key, strlen(entry->key), entry);
+    pthread_mutex_unlock(&m_lock);
+    return entry->value;
+}
+
+/**
+ * @name	local_storage_cache_set
+ * @brief	sets a key in memory, it is written to the platform later
+ * @param	key - (const char *) key
+ * @param	data - (const char *) value
+ * @retval	NONE
+ */
+void local_storage_cache_set(const char *key, const char *data) {
+    set_entry(key, data);
+}
+
+/**
+ * @name	local_storage_cache_remove
+ * @brief	removes a key in memory, it is removed from the platform later
+ * @param	key - (const char *) key
+ * @retval	NONE
+ */
+void local_storage_cache_remove(const char *key) {
+    set_entry(key, NULL);
+}
+
+/**
+ * @name	local_storage_cache_clear
+ * @brief	forgets every key, the platform is cleared by the next flush
+ *			before any later change is written
+ * @retval	NONE
+ */
+void local_storage_cache_clear() {
+    pthread_mutex_lock(&m_lock);
+    storage_entry *entry, *tmp;
+    HASH_ITER(hh, m_entries, entry, tmp) {
+        free_entry(entry);
+    }
+    m_dirty_count = 0;
+    m_clears_requested++;
+    pthread_mutex_unlock(&m_lock);
+}
+
+/**
+ * @name	local_storage_cache_flush
+ * @brief	writes the pending changes to the platform
+ * @param	wait - (bool) true to write them before returning, as when the
+ *			app is about to be paused
+ * @retval	NONE
+ */
+void local_storage_cache_flush(bool wait) {
+    m_dirty_ms = 0;
+    if (wait) {
+        flush_now();
+        return;
+    }
+
+    pthread_mutex_lock(&m_lock);
+    bool queue = !m_flush_queued && (m_dirty_count > 0 || m_clears_requested != m_clears_applied);
+    if (queue) {
+        m_flush_queued = true;
+    }
+    pthread_mutex_unlock(&m_lock);
+
+    if (queue) {
+        jobs_submit(flush_job, NULL, NULL, JOB_PRIORITY_LOW);
+    }
+}
+
+/**
+ * @name	local_storage_cache_tick
+ * @brief	flushes once changes have waited for the flush interval
+ * @param	dt - (long) ms since the last tick
+ * @retval	NONE
+ */
+void local_storage_cache_tick(long dt) {
+    pthread_mutex_lock(&m_lock);
+    bool pending = m_dirty_count > 0 || m_clears_requested != m_clears_applied;
+    pthread_mutex_unlock(&m_lock);
+
+    if (!pending) {
+        m_dirty_ms = 0;
+        return;
+    }
+
+    m_dirty_ms += dt;
+    if (m_dirty_ms >= FLUSH_INTERVAL_MS) {
+        local_storage_cache_flush(false);
+    }
+}
+
+/**
+ * @name	local_storage_cache_destroy
+ * @brief	writes the pending changes and frees the cache, called after
+ *			the job workers are stopped
+ * @retval	NONE
+ */
+void local_storage_cache_destroy() {
+    flush_now();
+
+    pthread_mutex_lock(&m_lock);
+    storage_entry *entry, *tmp;
+    HASH_ITER(hh, m_entries, entry, tmp) {
+        free_entry(entry);
+    }
+    m_dirty_count = 0;
+    m_flush_queued = false;
+    pthread_mutex_unlock(&m_lock);
+}
@@ -0,0 +1,49 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+ 
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+ 
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef LOCAL_STORAGE_CACHE_H
+#define LOCAL_STORAGE_CACHE_H
+
+#include "core/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Keeps local storage in memory in front of the platform. Reads are served
+// from memory once a key has been read, writes only touch memory and are
+// written behind on a job worker, coalesced per key, on a timer, when the
+// app pauses and on explicit flushes. All but the flushes are main thread
+// calls.
+
+void local_storage_cache_init();
+// valid until the key is next set, removed or cleared
+const char *local_storage_cache_get(const char *key);
+void local_storage_cache_set(const char *key, const char *data);
+void local_storage_cache_remove(const char *key);
+void local_storage_cache_clear();
+// writes the pending changes, on the calling thread when wait is true,
+// otherwise on a job worker
+void local_storage_cache_flush(bool wait);
+// called by core_tick, flushes changes older than the flush interval
+void local_storage_cache_tick(long dt);
+// writes the pending changes and frees the cache
+void local_storage_cache_destroy();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LOCAL_STORAGE_CACHE_H
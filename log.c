@@ -0,0 +1,237 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 log.c
+ * @brief	formats logs into a lock-free ring written out by a background
+ *			thread
+ */
+// the platform's LOG writes the lines out, taken before core/log.h
+// replaces it
+#include "platform/log.h"
+
+static void write_line(const char *line) {
+    LOG("%s", line);
+}
+
+#include "core/log.h"
+#include "core/types.h"
+#include "core/platform/threads.h"
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RING_SLOTS 256 /* power of two */
+#define RING_MASK (RING_SLOTS - 1)
+#define LINE_BYTES 512 /* longer lines are cut short */
+// how long the writer sleeps once the ring is empty
+#define DRAIN_SLEEP_US 10000
+
+// a slot holding seq == position is free for the producer claiming that
+// position, and seq == position + 1 holds a line for the writer
+typedef struct ring_slot_t {
+    unsigned long seq;
+    char line[LINE_BYTES];
+} ring_slot;
+
+static ring_slot m_ring[RING_SLOTS];
+static unsigned long m_head = 0; // next position producers claim
+static unsigned long m_tail = 0; // next position written out, under m_drain_mutex
+static unsigned int m_dropped = 0;
+static pthread_mutex_t m_drain_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static bool m_async = false;
+static bool m_running = false;
+static ThreadsThread m_thread = THREADS_INVALID_THREAD;
+
+/**
+ * @name	ring_push
+ * @brief	copies a line into the next free slot without taking a lock
+ * @param	line - (const char *) formatted line
+ * @retval	bool - false if the ring is full
+ */
+static bool ring_push(const char *line) {
+    unsigned long pos = __atomic_load_n(&m_head, __ATOMIC_RELAXED);
+    ring_slot *slot;
+    for (;;) {
+        slot = &m_ring[pos & RING_MASK];
+        unsigned long seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        long diff = (long) (seq - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&m_head, &pos, pos + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+            // pos now holds the head another producer moved on to
+        } else if (diff < 0) {
+            // the writer hasn't freed the slot from the last lap
+            return false;
+        } else {
+            pos = __atomic_load_n(&m_head, __ATOMIC_RELAXED);
+        }
+    }
+
+    snprintf(slot->line, LINE_BYTES, "%s", line);
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ * @name	ring_drain
+ * @brief	writes out the lines in the ring, in the order they were claimed,
+ *			up to the first one still being copied. with m_drain_mutex held
+ * @retval	int - number of lines written
+ */
+static int ring_drain() {
+    int written = 0;
+    for (;;) {
+        ring_slot *slot = &m_ring[m_tail & RING_MASK];
+        if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != m_tail + 1) {
+            break;
+        }
+        write_line(slot->line);
+        __atomic_store_n(&slot->seq, m_tail + RING_SLOTS, __ATOMIC_RELEASE);
+        m_tail++;
+        written++;
+    }
+
+    unsigned int dropped = __atomic_exchange_n(&m_dropped, 0, __ATOMIC_RELAXED);
+    if (dropped) {
+        char line[64];
+        snprintf(line, sizeof(line), "{log} WARNING: %u lines dropped, the ring was full", dropped);
+        write_line(line);
+    }
+    return written;
+}
+
+static void writer_run(void *param) {
+    while (__atomic_load_n(&m_running, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&m_drain_mutex);
+        int written = ring_drain();
+        pthread_mutex_unlock(&m_drain_mutex);
+        if (!written) {
+            usleep(DRAIN_SLEEP_US);
+        }
+    }
+}
+
+/**
+ * @name	log_write
+ * @brief	formats a line and queues it for the writer, or writes it
+ *			directly for errors and before log_start_async. a call site
+ *			over its rate counts the line as suppressed instead
+ * @param	site - (log_site *) the call site's static, may be NULL
+ * @param	level - (int) one of the LOG_LEVEL values
+ * @param	format - (const char *) printf format of the line
+ * @retval	NONE
+ */
+void log_write(log_site *site, int level, const char *format, ...) {
+    unsigned int suppressed = 0;
+    if (site) {
+        // sites logging from several threads at once may let a line or two
+        // past the rate, which is fine for a guard against spam
+        long now = (long) time(NULL);
+        if (__atomic_load_n(&site->second, __ATOMIC_RELAXED) != now) {
+            __atomic_store_n(&site->second, now, __ATOMIC_RELAXED);
+            __atomic_store_n(&site->count, 0, __ATOMIC_RELAXED);
+        }
+        if (__atomic_add_fetch(&site->count, 1, __ATOMIC_RELAXED) > LOG_SITE_PER_SECOND) {
+            __atomic_add_fetch(&site->suppressed, 1, __ATOMIC_RELAXED);
+            return;
+        }
+        suppressed = __atomic_exchange_n(&site->suppressed, 0, __ATOMIC_RELAXED);
+    }
+
+    char line[LINE_BYTES];
+    int len = 0;
+    if (suppressed) {
+        len = snprintf(line, sizeof(line), "(%u suppressed) ", suppressed);
+    }
+    va_list args;
+    va_start(args, format);
+    vsnprintf(line + len, sizeof(line) - len, format, args);
+    va_end(args);
+
+    if (__atomic_load_n(&m_async, __ATOMIC_ACQUIRE)) {
+        if (level < LOG_LEVEL_ERROR) {
+            if (!ring_push(line)) {
+                __atomic_add_fetch(&m_dropped, 1, __ATOMIC_RELAXED);
+            }
+            return;
+        }
+        // what came before the error is written before it
+        log_flush();
+    }
+    write_line(line);
+}
+
+/**
+ * @name	log_start_async
+ * @brief	starts the writer thread, and queues lines for it from then on
+ * @retval	NONE
+ */
+void log_start_async() {
+    if (__atomic_load_n(&m_running, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    pthread_mutex_lock(&m_drain_mutex);
+    // every slot starts free for its first lap
+    for (unsigned long i = 0; i < RING_SLOTS; i++) {
+        __atomic_store_n(&m_ring[i].seq, m_tail + i, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&m_head, m_tail, __ATOMIC_RELAXED);
+    __atomic_store_n(&m_running, true, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&m_drain_mutex);
+
+    // writing to the console is nobody's hurry
+    m_thread = threads_create_thread_with_priority(writer_run, NULL, THREADS_PRIORITY_BACKGROUND, THREADS_AFFINITY_EFFICIENCY);
+    if (m_thread == THREADS_INVALID_THREAD) {
+        __atomic_store_n(&m_running, false, __ATOMIC_RELEASE);
+        write_line("{log} WARNING: Unable to start the log writer, writing directly");
+        return;
+    }
+    __atomic_store_n(&m_async, true, __ATOMIC_RELEASE);
+}
+
+/**
+ * @name	log_stop_async
+ * @brief	stops the writer thread once it has written out the ring, lines
+ *			are written directly from then on
+ * @retval	NONE
+ */
+void log_stop_async() {
+    if (!__atomic_load_n(&m_running, __ATOMIC_ACQUIRE)) {
+        return;
+    }
+
+    __atomic_store_n(&m_async, false, __ATOMIC_RELEASE);
+    __atomic_store_n(&m_running, false, __ATOMIC_RELEASE);
+    threads_join_thread(&m_thread);
+    m_thread = THREADS_INVALID_THREAD;
+    log_flush();
+}
+
+/**
+ * @name	log_flush
+ * @brief	writes out what is in the ring on the calling thread
+ * @retval	NONE
+ */
+CEXPORT void log_flush() {
+    pthread_mutex_lock(&m_drain_mutex);
+    ring_drain();
+    pthread_mutex_unlock(&m_drain_mutex);
+}
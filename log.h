@@ -13,5 +13,96 @@
  * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
  */
 
-//no ifdefs because this just wraps platform/log.h, which has them
+#ifndef CORE_LOG_H
+#define CORE_LOG_H
+
+// platform/log.h writes a line to the console or logcat. Everything below
+// is built on it, so it is included first and its LOG and LOGFN replaced
 #include "platform/log.h"
+#include "core/util/detect.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Logs have a level and a category, and those below LOG_MIN_LEVEL or
+// outside LOG_CATEGORIES compile to nothing, arguments included. Both can
+// be set for the build; by default everything from info up is kept, so
+// LOGFN and LOG_DEBUG cost nothing. LOG is info in LOG_CAT_GENERAL.
+//
+// What is kept is formatted into a lock-free ring, once log_start_async
+// has run, and written out by a background thread, so the caller never
+// waits on the console. A full ring drops the line and says how many went
+// missing once it has room. Each call site logs at most LOG_SITE_PER_SECOND
+// lines a second, the rest are counted and reported when the site logs
+// again. Errors flush the ring and are written before returning.
+
+#define LOG_LEVEL_TRACE 0
+#define LOG_LEVEL_DEBUG 1
+#define LOG_LEVEL_INFO 2
+#define LOG_LEVEL_WARN 3
+#define LOG_LEVEL_ERROR 4
+
+#define LOG_CAT_GENERAL   0x01
+#define LOG_CAT_CALLS     0x02 // LOGFN
+#define LOG_CAT_TEXTURES  0x04
+#define LOG_CAT_RENDER    0x08
+#define LOG_CAT_VIEWS     0x10
+#define LOG_CAT_EVENTS    0x20
+#define LOG_CAT_POOLS     0x40
+#define LOG_CAT_NET       0x80
+#define LOG_CAT_ALL       0xff
+
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#endif
+#ifndef LOG_CATEGORIES
+#define LOG_CATEGORIES LOG_CAT_ALL
+#endif
+
+#define LOG_SITE_PER_SECOND 20
+
+// one per call site, static and zeroed
+typedef struct log_site_t {
+	long second;              // the second count is for
+	unsigned int count;       // lines logged in that second
+	unsigned int suppressed;  // lines dropped since the site last logged
+} log_site;
+
+void log_write(log_site *site, int level, const char *format, ...)
+#ifdef __GNUC__
+	__attribute__((format(printf, 3, 4)))
+#endif
+	;
+// starts the thread writing the ring out, lines before are written directly
+void log_start_async();
+// writes out what is in the ring before returning, then writes directly
+void log_stop_async();
+// writes out what is in the ring before returning
+CEXPORT void log_flush();
+
+#define LOG_ENABLED(level, category) ((level) >= LOG_MIN_LEVEL && ((category) & LOG_CATEGORIES))
+
+#define LOG_AT(level, category, ...) do { \
+		if (LOG_ENABLED(level, category)) { \
+			static log_site log_site_; \
+			log_write(&log_site_, level, __VA_ARGS__); \
+		} \
+	} while (0)
+
+#define LOG_TRACE(category, ...) LOG_AT(LOG_LEVEL_TRACE, category, __VA_ARGS__)
+#define LOG_DEBUG(category, ...) LOG_AT(LOG_LEVEL_DEBUG, category, __VA_ARGS__)
+#define LOG_INFO(category, ...) LOG_AT(LOG_LEVEL_INFO, category, __VA_ARGS__)
+#define LOG_WARN(category, ...) LOG_AT(LOG_LEVEL_WARN, category, __VA_ARGS__)
+#define LOG_ERROR(category, ...) LOG_AT(LOG_LEVEL_ERROR, category, __VA_ARGS__)
+
+#undef LOG
+#define LOG(...) LOG_AT(LOG_LEVEL_INFO, LOG_CAT_GENERAL, __VA_ARGS__)
+#undef LOGFN
+#define LOGFN(name) LOG_AT(LOG_LEVEL_TRACE, LOG_CAT_CALLS, "{fn} %s", name)
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CORE_LOG_H
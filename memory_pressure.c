@@ -0,0 +1,185 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 memory_pressure.c
+ * @brief	releases memory across subsystems in priority order
+ */
+#include "core/memory_pressure.h"
+#include "core/log.h"
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_RECLAIMERS 16
+// a warning asks for this share of what the reclaimers report holding, and
+// no less than the minimum
+#define WARNING_SHARE 2
+#define WARNING_MIN_BYTES (8 * 1024 * 1024)
+
+enum pending_warnings { WARNING_NONE, WARNING_LOW, WARNING_CRITICAL };
+
+typedef struct reclaimer_t {
+    int id;
+    const char *name;
+    int priority;
+    memory_usage_cb usage;
+    memory_reclaim_cb reclaim;
+    void *data;
+} reclaimer;
+
+// kept sorted by priority, registration order within a priority
+static reclaimer m_reclaimers[MAX_RECLAIMERS];
+static int m_count = 0;
+static int m_next_id = 1;
+static int m_pending = WARNING_NONE;
+
+/**
+ * @name	memory_pressure_register
+ * @brief	adds a reclaimer, asked after those of lower priority
+ * @param	name - (const char *) for the log, must outlive the registration
+ * @param	priority - (int) one of memory_pressure_priorities
+ * @param	usage - (memory_usage_cb) reports the bytes held, may be NULL
+ * @param	reclaim - (memory_reclaim_cb) frees memory
+ * @param	data - (void *) passed to both callbacks
+ * @retval	int - id of the registration, 0 if there is no room
+ */
+int memory_pressure_register(const char *name, int priority, memory_usage_cb usage, memory_reclaim_cb reclaim, void *data) {
+    if (m_count >= MAX_RECLAIMERS || !reclaim) {
+        LOG("{memory} WARNING: Unable to register %s", name);
+        return 0;
+    }
+
+    int i = m_count;
+    while (i > 0 && m_reclaimers[i - 1].priority > priority) {
+        m_reclaimers[i] = m_reclaimers[i - 1];
+        i--;
+    }
+
+    reclaimer *r = &m_reclaimers[i];
+    r->id = m_next_id++;
+    r->name = name;
+    r->priority = priority;
+    r->usage = usage;
+    r->reclaim = reclaim;
+    r->data = data;
+    m_count++;
+    return r->id;
+}
+
+/**
+ * @name	memory_pressure_unregister
+ * @brief	removes a reclaimer
+ * @param	id - (int) id memory_pressure_register returned
+ * @retval	NONE
+ */
+void memory_pressure_unregister(int id) {
+    for (int i = 0; i < m_count; i++) {
+        if (m_reclaimers[i].id == id) {
+            memmove(&m_reclaimers[i], &m_reclaimers[i + 1], (m_count - i - 1) * sizeof(reclaimer));
+            m_count--;
+            return;
+        }
+    }
+}
+
+/**
+ * @name	memory_pressure_clear
+ * @brief	removes every reclaimer
+ * @retval	NONE
+ */
+void memory_pressure_clear() {
+    m_count = 0;
+}
+
+/**
+ * @name	memory_pressure_usage
+ * @brief	adds up what the reclaimers report holding
+ * @retval	long - bytes
+ */
+long memory_pressure_usage() {
+    long total = 0;
+    for (int i = 0; i < m_count; i++) {
+        if (m_reclaimers[i].usage) {
+            total += m_reclaimers[i].usage(m_reclaimers[i].data);
+        }
+    }
+    return total;
+}
+
+/**
+ * @name	memory_pressure_reclaim
+ * @brief	asks the reclaimers, lowest priority first, for what is still
+ *			wanted until bytes have been freed
+ * @param	bytes - (long) bytes wanted, ignored when critical
+ * @param	critical - (bool) ask every reclaimer for everything
+ * @retval	long - bytes freed
+ */
+long memory_pressure_reclaim(long bytes, bool critical) {
+    long freed = 0;
+    for (int i = 0; i < m_count && (critical || freed < bytes); i++) {
+        reclaimer *r = &m_reclaimers[i];
+        long got = r->reclaim(critical ? LONG_MAX : bytes - freed, critical, r->data);
+        if (got > 0) {
+            LOG("{memory} %s gave back %ld bytes", r->name, got);
+            freed += got;
+        }
+    }
+    return freed;
+}
+
+/**
+ * @name	memory_pressure_warning
+ * @brief	notes a low memory warning from the platform
+ * @retval	NONE
+ */
+void memory_pressure_warning() {
+    int expected = WARNING_NONE;
+    __atomic_compare_exchange_n(&m_pending, &expected, WARNING_LOW, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+/**
+ * @name	memory_pressure_critical
+ * @brief	notes a critical memory warning from the platform
+ * @retval	NONE
+ */
+void memory_pressure_critical() {
+    __atomic_store_n(&m_pending, WARNING_CRITICAL, __ATOMIC_RELAXED);
+}
+
+/**
+ * @name	memory_pressure_tick
+ * @brief	reclaims for the warning that came in since the last tick
+ * @retval	NONE
+ */
+void memory_pressure_tick() {
+    int pending = __atomic_exchange_n(&m_pending, WARNING_NONE, __ATOMIC_RELAXED);
+    if (pending == WARNING_NONE) {
+        return;
+    }
+
+    if (pending == WARNING_CRITICAL) {
+        LOG("{memory} Critical warning, reclaiming everything");
+        memory_pressure_reclaim(0, true);
+        return;
+    }
+
+    long wanted = memory_pressure_usage() / WARNING_SHARE;
+    if (wanted < WARNING_MIN_BYTES) {
+        wanted = WARNING_MIN_BYTES;
+    }
+    long freed = memory_pressure_reclaim(wanted, false);
+    LOG("{memory} Warning, wanted %ld bytes and freed %ld", wanted, freed);
+}
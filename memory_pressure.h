@@ -0,0 +1,66 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef MEMORY_PRESSURE_H
+#define MEMORY_PRESSURE_H
+
+#include "core/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Subsystems holding memory they can give back register a reclaimer. On a
+// memory warning the reclaimers are asked, cheapest priority first, for
+// half of what they report holding, or a few megabytes if that is less, and
+// the asking stops once that much is freed. The texture manager reports
+// nothing, so it is only asked for what the caches couldn't give. A
+// critical warning asks every reclaimer for everything.
+// Registration and reclaiming are main thread only, warnings may come from
+// any thread and are handled on the next tick.
+
+// the order reclaimers are asked in, lowest first
+enum memory_pressure_priorities {
+	MEMORY_PRIORITY_CACHE,    // copies kept only to save a read or a copy
+	MEMORY_PRIORITY_DERIVED,  // rebuilt from other data by drawing again
+	MEMORY_PRIORITY_ASSETS,   // loaded or decoded again from disk
+	MEMORY_PRIORITY_TEXTURES  // the texture manager, last
+};
+
+// bytes the reclaimer could free now, counted towards what a warning asks for
+typedef long (*memory_usage_cb)(void *data);
+// frees at least bytes if it can, everything when critical, and returns
+// the bytes freed, or expected to be freed soon
+typedef long (*memory_reclaim_cb)(long bytes, bool critical, void *data);
+
+// returns an id for memory_pressure_unregister
+int memory_pressure_register(const char *name, int priority, memory_usage_cb usage, memory_reclaim_cb reclaim, void *data);
+void memory_pressure_unregister(int id);
+void memory_pressure_clear();
+
+// asks the reclaimers in order until bytes are freed, returning the total
+long memory_pressure_reclaim(long bytes, bool critical);
+long memory_pressure_usage();
+
+void memory_pressure_warning();
+void memory_pressure_critical();
+// handles a warning that came in since the last tick, called by core_tick
+void memory_pressure_tick();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MEMORY_PRESSURE_H
@@ -0,0 +1,202 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 memory_tags.c
+ * @brief	counts native memory by the subsystem holding it
+ */
+#include "core/memory_tags.h"
+#include <string.h>
+
+static const char *m_names[MEMORY_TAG_COUNT] = {
+    "views", "animations", "timers", "textures", "imageCache", "decode", "jsBridge"
+};
+
+#ifdef MEMORY_ACCOUNTING
+
+// keeps what follows it aligned as malloc would
+typedef union alloc_header_t {
+    struct {
+        size_t size;
+        int tag;
+    } info;
+    long double align;
+} alloc_header;
+
+typedef struct tag_counters_t {
+    long long bytes;
+    long long peak_bytes;
+    unsigned long long allocations;
+    unsigned int frame_allocations;
+    unsigned int last_frame_allocations;
+} tag_counters;
+
+static tag_counters m_counters[MEMORY_TAG_COUNT];
+
+/**
+ * @name	memory_tag_account
+ * @brief	adds bytes to what the tag holds, raising its peak
+ * @param	tag - (int) one of memory_tags
+ * @param	bytes - (long long) bytes allocated, negative for bytes freed
+ * @retval	NONE
+ */
+void memory_tag_account(int tag, long long bytes) {
+    tag_counters *c = &m_counters[tag];
+    long long held = __atomic_add_fetch(&c->bytes, bytes, __ATOMIC_RELAXED);
+    long long peak = __atomic_load_n(&c->peak_bytes, __ATOMIC_RELAXED);
+    while (held > peak && !__atomic_compare_exchange_n(&c->peak_bytes, &peak, held, true,
+                                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void *track(void *block, int tag, size_t size) {
+    if (!block) {
+        return NULL;
+    }
+    alloc_header *header = (alloc_header *) block;
+    header->info.size = size;
+    header->info.tag = tag;
+
+    tag_counters *c = &m_counters[tag];
+    __atomic_add_fetch(&c->allocations, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&c->frame_allocations, 1, __ATOMIC_RELAXED);
+    memory_tag_account(tag, (long long) size);
+    return header + 1;
+}
+
+/**
+ * @name	memory_tag_malloc
+ * @brief	allocates size bytes counted against tag
+ * @param	tag - (int) one of memory_tags
+ * @param	size - (size_t) bytes to allocate
+ * @retval	void* - the memory, to be freed with memory_tag_free, or NULL
+ */
+void *memory_tag_malloc(int tag, size_t size) {
+    if (size > (size_t) -1 - sizeof(alloc_header)) {
+        return NULL;
+    }
+    return track(malloc(sizeof(alloc_header) + size), tag, size);
+}
+
+/**
+ * @name	memory_tag_calloc
+ * @brief	allocates count zeroed elements counted against tag
+ * @param	tag - (int) one of memory_tags
+ * @param	count - (size_t) number of elements
+ * @param	size - (size_t) bytes per element
+ * @retval	void* - the memory, to be freed with memory_tag_free, or NULL
+ */
+void *memory_tag_calloc(int tag, size_t count, size_t size) {
+    if (size && count > ((size_t) -1 - sizeof(alloc_header)) / size) {
+        return NULL;
+    }
+    return track(calloc(1, sizeof(alloc_header) + count * size), tag, count * size);
+}
+
+/**
+ * @name	memory_tag_realloc
+ * @brief	resizes memory from the tagged allocators, keeping its first tag,
+ *			or allocates it counted against tag when ptr is NULL
+ * @param	tag - (int) one of memory_tags
+ * @param	ptr - (void *) memory to resize, or NULL
+ * @param	size - (size_t) new size in bytes
+ * @retval	void* - the memory, or NULL with ptr left as it was
+ */
+void *memory_tag_realloc(int tag, void *ptr, size_t size) {
+    if (!ptr) {
+        return memory_tag_malloc(tag, size);
+    }
+    if (size > (size_t) -1 - sizeof(alloc_header)) {
+        return NULL;
+    }
+
+    alloc_header *header = (alloc_header *) ptr - 1;
+    size_t old_size = header->info.size;
+    tag = header->info.tag;
+    header = (alloc_header *) realloc(header, sizeof(alloc_header) + size);
+    if (!header) {
+        return NULL;
+    }
+    header->info.size = size;
+
+    tag_counters *c = &m_counters[tag];
+    __atomic_add_fetch(&c->allocations, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&c->frame_allocations, 1, __ATOMIC_RELAXED);
+    memory_tag_account(tag, (long long) size - (long long) old_size);
+    return header + 1;
+}
+
+/**
+ * @name	memory_tag_free
+ * @brief	frees memory from the tagged allocators
+ * @param	ptr - (void *) memory to free, may be NULL
+ * @retval	NONE
+ */
+void memory_tag_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    alloc_header *header = (alloc_header *) ptr - 1;
+    memory_tag_account(header->info.tag, -(long long) header->info.size);
+    free(header);
+}
+
+#endif
+
+/**
+ * @name	memory_tag_name
+ * @brief	gets the name of a tag for reports
+ * @param	tag - (int) one of memory_tags
+ * @retval	const char* - the name
+ */
+const char *memory_tag_name(int tag) {
+    return tag >= 0 && tag < MEMORY_TAG_COUNT ? m_names[tag] : "unknown";
+}
+
+/**
+ * @name	memory_tags_get
+ * @brief	gets what a tag holds
+ * @param	tag - (int) one of memory_tags
+ * @param	stats - (memory_tag_stats *) receives the counters
+ * @retval	bool - false when built without counting, with stats zeroed
+ */
+bool memory_tags_get(int tag, memory_tag_stats *stats) {
+    memset(stats, 0, sizeof(memory_tag_stats));
+#ifdef MEMORY_ACCOUNTING
+    tag_counters *c = &m_counters[tag];
+    stats->bytes = __atomic_load_n(&c->bytes, __ATOMIC_RELAXED);
+    stats->peak_bytes = __atomic_load_n(&c->peak_bytes, __ATOMIC_RELAXED);
+    stats->allocations = __atomic_load_n(&c->allocations, __ATOMIC_RELAXED);
+    stats->frame_allocations = c->last_frame_allocations;
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @name	memory_tags_end_frame
+ * @brief	keeps the allocation counts of the frame that ended for
+ *			memory_tags_get and starts the next one's at zero
+ * @retval	NONE
+ */
+void memory_tags_end_frame() {
+#ifdef MEMORY_ACCOUNTING
+    for (int i = 0; i < MEMORY_TAG_COUNT; i++) {
+        tag_counters *c = &m_counters[i];
+        c->last_frame_allocations = __atomic_exchange_n(&c->frame_allocations, 0, __ATOMIC_RELAXED);
+    }
+#endif
+}
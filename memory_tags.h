@@ -0,0 +1,91 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef MEMORY_TAGS_H
+#define MEMORY_TAGS_H
+
+#include "core/types.h"
+#include "core/util/detect.h"
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Counts native memory by the subsystem holding it: the bytes held now and
+// at most, and the allocations made in all and in the last frame. Counting
+// is only built with MEMORY_ACCOUNTING defined, otherwise the macros below
+// are plain malloc and free and the counters stay at zero.
+// Memory from TAG_MALLOC, TAG_CALLOC and TAG_REALLOC carries a header with
+// its size and tag, so it must be released with TAG_FREE or TAG_REALLOC,
+// and nothing else may be. Buffers a library allocates, or that change
+// hands between subsystems, are counted with MEMORY_ACCOUNT instead, which
+// adds to the bytes but not the allocations. Any thread.
+
+enum memory_tags {
+	MEMORY_TAG_VIEWS,
+	MEMORY_TAG_ANIMATIONS,
+	MEMORY_TAG_TIMERS,
+	MEMORY_TAG_TEXTURES,    // texture records and pixels kept on the cpu
+	MEMORY_TAG_IMAGE_CACHE,
+	MEMORY_TAG_DECODE,      // decoded images waiting to be uploaded
+	MEMORY_TAG_JS_BRIDGE,   // for the bindings
+	MEMORY_TAG_COUNT
+};
+
+typedef struct memory_tag_stats_t {
+	long long bytes;
+	long long peak_bytes;
+	unsigned long long allocations;
+	unsigned int frame_allocations;  // in the last completed frame
+} memory_tag_stats;
+
+#ifdef MEMORY_ACCOUNTING
+
+void *memory_tag_malloc(int tag, size_t size);
+void *memory_tag_calloc(int tag, size_t count, size_t size);
+void *memory_tag_realloc(int tag, void *ptr, size_t size);
+void memory_tag_free(void *ptr);
+void memory_tag_account(int tag, long long bytes);
+
+#define TAG_MALLOC(tag, size) memory_tag_malloc(tag, size)
+#define TAG_CALLOC(tag, count, size) memory_tag_calloc(tag, count, size)
+#define TAG_REALLOC(tag, ptr, size) memory_tag_realloc(tag, ptr, size)
+#define TAG_FREE(ptr) memory_tag_free(ptr)
+// bytes is negative when the buffer is freed
+#define MEMORY_ACCOUNT(tag, bytes) memory_tag_account(tag, bytes)
+
+#else
+
+#define TAG_MALLOC(tag, size) malloc(size)
+#define TAG_CALLOC(tag, count, size) calloc(count, size)
+#define TAG_REALLOC(tag, ptr, size) realloc(ptr, size)
+#define TAG_FREE(ptr) free(ptr)
+#define MEMORY_ACCOUNT(tag, bytes) ((void) 0)
+
+#endif
+
+// the name used in reports
+const char *memory_tag_name(int tag);
+// false when built without MEMORY_ACCOUNTING
+bool memory_tags_get(int tag, memory_tag_stats *stats);
+// called by perf_stats_tick, starts counting the next frame's allocations
+void memory_tags_end_frame();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // MEMORY_TAGS_H
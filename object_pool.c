@@ -18,36 +18,128 @@
  * @brief
  */
 #include "object_pool.h"
+#include "memory_tags.h"
 #include <stdlib.h>
 #include <stdio.h>
 
 #include "log.h"
 
+// each object is preceded by a pointer to its pool, padded so objects in a
+// slab keep the alignment malloc gives doubles
+#define OBJECT_HEADER_SIZE sizeof(double)
+
+/**
+ * @name	add_slab
+ * @brief	allocates a slab of objects and adds them to the free items
+ * @param	pool - (object_pool *) pool to grow
+ * @param	count - (unsigned int) number of objects in the slab
+ * @retval	bool - (true | false) depending on whether the slab was added
+ */
+static bool add_slab(object_pool *pool, unsigned int count) {
+    void **slabs = (void **) realloc(pool->slabs, sizeof(void *) * (pool->slab_count + 1));
+    if (!slabs) {
+        return false;
+    }
+    pool->slabs = slabs;
+
+    // every object has a slot in items, so putting one back never grows it
+    unsigned int capacity = pool->max_size + count;
+    void **items = (void **) realloc(pool->items, sizeof(void *) * capacity);
+    if (!items) {
+        return false;
+    }
+    pool->items = items;
+
+    char *slab = (char *) malloc(pool->item_size * count);
+    if (!slab) {
+        return false;
+    }
+
+    pool->slabs[pool->slab_count++] = slab;
+    pool->max_size = capacity;
+    if (pool->memory_tag >= 0) {
+        MEMORY_ACCOUNT(pool->memory_tag, (long long) (pool->item_size * count));
+    }
+
+    // hand out the start of the slab first
+    unsigned int i;
+    for (i = count; i > 0; --i) {
+        pool->items[pool->avail_count++] = slab + pool->item_size * (i - 1);
+    }
+
+    return true;
+}
+
 /**
  * @name	object_pool_init
  * @brief	initilizes the object pool with the given size and item size
- * @param	initial_size - (unsigned int) initial size the pull should be (of items)
+ * @param	initial_size - (unsigned int) initial size the pull should be (of items),
+ *			the pool also grows by slabs of this many items
  * @param	item_size - (unsigned int) the size of each item in the pool
  * @retval	object_pool* - the object pool created after being initilized
  */
 object_pool *object_pool_init(unsigned int initial_size, size_t item_size) {
+    return object_pool_init_tagged(initial_size, item_size, -1);
+}
+
+/**
+ * @name	object_pool_init_tagged
+ * @brief	initilizes an object pool whose slabs are counted against a
+ *			memory tag
+ * @param	initial_size - (unsigned int) initial size of the pool in items,
+ *			and the number of items it grows by
+ * @param	item_size - (unsigned int) the size of each item in the pool
+ * @param	memory_tag - (int) one of memory_tags, or -1 for none
+ * @retval	object_pool* - the object pool created after being initilized
+ */
+object_pool *object_pool_init_tagged(unsigned int initial_size, size_t item_size, int memory_tag) {
     LOGFN("object_pool_init");
     object_pool *pool = (object_pool *) malloc(sizeof(object_pool));
-    pool->max_size = initial_size;
+    pool->max_size = 0;
     pool->avail_count = 0;
-    pool->items = (void **) malloc(sizeof(void *) * initial_size);
-    pool->item_size = item_size + sizeof(void *);
-    unsigned int i;
-
-    for (i = 0; i < initial_size; ++i) {
-        pool->items[i] = malloc(pool->item_size);
-        ++pool->avail_count;
+    pool->items = NULL;
+    pool->item_size = OBJECT_HEADER_SIZE + (item_size + OBJECT_HEADER_SIZE - 1) / OBJECT_HEADER_SIZE * OBJECT_HEADER_SIZE;
+    pool->slab_items = initial_size ? initial_size : 1;
+    pool->slab_count = 0;
+    pool->slabs = NULL;
+    pool->live_count = 0;
+    pool->high_water = 0;
+    pool->memory_tag = memory_tag;
+
+    if (initial_size && !add_slab(pool, initial_size)) {
+        LOG("{pool} WARNING: Unable to allocate %u objects of size %zu", initial_size, item_size);
     }
 
     LOGFN("end object_pool_init");
     return pool;
 }
 
+/**
+ * @name	object_pool_reserve
+ * @brief	makes sure at least count objects can be taken from the pool
+ *			without allocating, e.g. to warm a pool up at level load
+ * @param	pool - (object_pool *) pool to reserve objects in
+ * @param	count - (unsigned int) number of objects to have available
+ * @retval	bool - (true | false) depending on whether the objects were reserved
+ */
+bool object_pool_reserve(object_pool *pool, unsigned int count) {
+    if (pool->avail_count >= count) {
+        return true;
+    }
+
+    unsigned int needed = count - pool->avail_count;
+    if (needed < pool->slab_items) {
+        needed = pool->slab_items;
+    }
+
+    if (!add_slab(pool, needed)) {
+        LOG("{pool} WARNING: Unable to reserve %u objects", count);
+        return false;
+    }
+
+    return true;
+}
+
 /**
  * @name	object_pool_put
  * @brief	puts the given object into the object pool
@@ -58,54 +150,59 @@ void object_pool_put(void *obj) {
     LOGFN("object_pool_put");
     object_pool *pool = (object_pool *)((void **) obj)[-1];
 
-    if (pool->avail_count == pool->max_size) {
-        pool->max_size = pool->max_size == 0 ? 1 : pool->max_size * 2;
-        pool->items = (void **)realloc(pool->items, sizeof(void *) * pool->max_size);
-    }
-
-    pool->items[pool->avail_count] = (void **)obj - 1;
+    pool->items[pool->avail_count] = (char *) obj - OBJECT_HEADER_SIZE;
     pool->avail_count++;
+    pool->live_count--;
     LOGFN("end object_pool_put");
 }
 
 /**
  * @name	object_pool_get
- * @brief	___
- * @param	pool - (object_pool *)
- * @retval	void* -
+ * @brief	takes an object from the pool, growing it by a slab when empty
+ * @param	pool - (object_pool *) pool to take an object from
+ * @retval	void* - the object, or NULL if the pool could not grow
  */
 void *object_pool_get(object_pool *pool) {
     LOGFN("object_pool_get");
-    void **obj;
-
-    if (pool->avail_count) {
-        --pool->avail_count;
-        obj = (void **)pool->items[pool->avail_count];
-        //LOG("object_pool: reuse of size %d, %p", pool->item_size, (obj + 1));
-    } else {
-        obj = (void **) malloc(pool->item_size);
-        //LOG("object_pool: malloc of size %d, %p", pool->item_size, (obj + 1));
+
+    if (!pool->avail_count && !add_slab(pool, pool->slab_items)) {
+        LOG("{pool} WARNING: Unable to grow object pool by %u objects", pool->slab_items);
+        return NULL;
+    }
+
+    --pool->avail_count;
+    char *obj = (char *) pool->items[pool->avail_count];
+
+    // the pool pointer sits right before the object
+    ((void **)(obj + OBJECT_HEADER_SIZE))[-1] = (void *) pool;
+
+    if (++pool->live_count > pool->high_water) {
+        pool->high_water = pool->live_count;
     }
 
-    obj[0] = (void *) pool;
     LOGFN("end object_pool_get");
-    return (void *)(obj + 1);
+    return obj + OBJECT_HEADER_SIZE;
 }
 
 /**
  * @name	object_pool_destroy
- * @brief	destroys the given object pool
+ * @brief	destroys the given object pool, along with every object in it
  * @param	pool - (object_pool *) the object pool to destroy
  * @retval	NONE
  */
 void object_pool_destroy(object_pool *pool) {
     LOGFN("object_pool_destroy");
 
-    while (pool->avail_count) {
-        --pool->avail_count;
-        free(pool->items[pool->avail_count]);
+    if (pool->memory_tag >= 0) {
+        MEMORY_ACCOUNT(pool->memory_tag, -(long long) (pool->item_size * pool->max_size));
+    }
+
+    while (pool->slab_count) {
+        --pool->slab_count;
+        free(pool->slabs[pool->slab_count]);
     }
 
+    free(pool->slabs);
     free(pool->items);
     free(pool);
     LOGFN("end object_pool_destroy");
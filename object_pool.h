@@ -21,23 +21,39 @@ extern "C" {
 #endif
 
 #include <stdlib.h>
+#include "core/types.h"
 
 typedef struct object_pool_t {
 	unsigned int avail_count;
 	unsigned int max_size;
 	size_t item_size;
 	void **items;
+
+	// objects are allocated slab_items at a time in contiguous slabs
+	unsigned int slab_items;
+	unsigned int slab_count;
+	void **slabs;
+
+	// objects handed out now and the most ever handed out at once
+	unsigned int live_count;
+	unsigned int high_water;
+
+	// slabs are counted against this memory_tags tag, -1 for none
+	int memory_tag;
 } object_pool;
 
 #define OBJECT_POOL_INIT(type, size) object_pool_init(size, sizeof(type))
+#define OBJECT_POOL_INIT_TAGGED(type, size, tag) object_pool_init_tagged(size, sizeof(type), tag)
 #define OBJECT_POOL_GET(type, pool) (type *) object_pool_get(pool)
 #define OBJECT_POOL_RELEASE(obj) object_pool_put(obj)
 #define OBJECT_POOL_DESTROY(pool) object_pool_destroy(pool)
 
 object_pool *object_pool_init(unsigned int initial_size, size_t item_size);
+object_pool *object_pool_init_tagged(unsigned int initial_size, size_t item_size, int memory_tag);
 void object_pool_put(void *obj);
 void *object_pool_get(object_pool *pool);
 void object_pool_destroy(object_pool *pool);
+bool object_pool_reserve(object_pool *pool, unsigned int count);
 
 #ifdef __cplusplus
 }
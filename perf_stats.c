@@ -0,0 +1,288 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 perf_stats.c
+ * @brief	collects per frame counters and draws them over the screen
+ */
+#include "core/perf_stats.h"
+#include "core/core.h"
+#include "core/glyph_atlas.h"
+#include "core/tealeaf_canvas.h"
+#include "core/tealeaf_context.h"
+#include "core/texture_manager.h"
+#include "core/timer.h"
+#include "core/log.h"
+#include "core/profiler.h"
+#include "core/deps/jansson/jansson.h"
+#include "core/timestep/timestep_stats.h"
+#include "platform/text_manager.h"
+#include <stdio.h>
+#include <string.h>
+
+// ticks kept for the fps and the graph, one bar each
+#define HISTORY_FRAMES 120
+#define FPS_WINDOW_MS 1000.0
+
+// overlay layout in points at a scale of 1, scaled up on large screens
+#define OVERLAY_FONT "Helvetica"
+#define OVERLAY_MARGIN 8
+#define OVERLAY_PADDING 6
+#define OVERLAY_WIDTH 240
+#define OVERLAY_FONT_SIZE 12
+#define OVERLAY_LINE_HEIGHT 15
+#define OVERLAY_GRAPH_HEIGHT 40
+#define OVERLAY_REFERENCE_SIZE 360
+// the graph's height in milliseconds, and the frame times its colors change at
+#define GRAPH_MAX_MS 50.0
+#define GRAPH_TARGET_MS (1000.0 / 60)
+#define GRAPH_SLOW_MS (1000.0 / 30)
+
+static perf_stats m_stats;
+static double m_history[HISTORY_FRAMES];
+static unsigned int m_history_count = 0; // ever recorded, the last HISTORY_FRAMES kept
+static bool m_overlay = false;
+
+/**
+ * @name	perf_stats_tick
+ * @brief	records the tick and takes a new snapshot of every counter
+ * @param	frame_ms - (double) time since the last tick in milliseconds
+ * @retval	NONE
+ */
+void perf_stats_tick(double frame_ms) {
+    if (m_overlay) {
+        // the numbers change every tick even when nothing else does
+        core_invalidate_frame();
+    }
+
+    m_history[m_history_count++ % HISTORY_FRAMES] = frame_ms;
+    unsigned int kept = m_history_count < HISTORY_FRAMES ? m_history_count : HISTORY_FRAMES;
+
+    double window = 0, max = 0;
+    unsigned int frames = 0;
+    for (unsigned int i = 0; i < kept; i++) {
+        double ms = m_history[(m_history_count - 1 - i) % HISTORY_FRAMES];
+        if (window < FPS_WINDOW_MS) {
+            window += ms;
+            frames++;
+        }
+        if (ms > max) {
+            max = ms;
+        }
+    }
+
+    m_stats.fps = window > 0 ? frames * 1000.0 / window : 0;
+    m_stats.frame_ms = frame_ms;
+    m_stats.frame_ms_max = max;
+
+    const draw_textures_stats *draw = draw_textures_get_stats();
+    m_stats.draw_calls = draw->flushes;
+    memcpy(m_stats.flush_reasons, draw->flush_reasons, sizeof(m_stats.flush_reasons));
+    m_stats.quads = draw->quads;
+    m_stats.culled_quads = draw->culled_quads;
+
+    texture_manager *manager = texture_manager_get();
+    m_stats.textures = manager->tex_count;
+    m_stats.texture_bytes = manager->texture_bytes_used;
+    m_stats.max_texture_bytes = manager->max_texture_bytes;
+    m_stats.pending_loads = manager->textures_to_load;
+    m_stats.pending_load_bytes = manager->approx_bytes_to_load;
+
+    m_stats.animations = view_animation_active_count();
+    m_stats.timers = core_timer_count();
+    m_stats.views = timestep_view_count();
+
+    for (int i = 0; i < MEMORY_TAG_COUNT; i++) {
+        memory_tags_get(i, &m_stats.memory[i]);
+    }
+    memory_tags_end_frame();
+
+    if (profiler_system_trace_enabled()) {
+        profiler_counter("drawCalls", m_stats.draw_calls);
+        profiler_counter("quads", m_stats.quads);
+        profiler_counter("textureBytes", m_stats.texture_bytes);
+        profiler_counter("pendingLoads", m_stats.pending_loads);
+        profiler_counter("views", m_stats.views);
+    }
+}
+
+/**
+ * @name	perf_stats_get
+ * @brief	gets the snapshot taken at the start of this tick
+ * @retval	const perf_stats* - the snapshot
+ */
+const perf_stats *perf_stats_get() {
+    return &m_stats;
+}
+
+/**
+ * @name	perf_stats_report
+ * @brief	describes the snapshot as JSON, with times in milliseconds and
+ *			sizes in bytes
+ * @retval	char* - the report, freed by the caller, or NULL
+ */
+CEXPORT char *perf_stats_report() {
+    const perf_stats *s = &m_stats;
+    json_t *report = json_object();
+    json_object_set_new(report, "fps", json_real(s->fps));
+    json_object_set_new(report, "frameTime", json_real(s->frame_ms));
+    json_object_set_new(report, "maxFrameTime", json_real(s->frame_ms_max));
+    json_object_set_new(report, "drawCalls", json_integer(s->draw_calls));
+
+    json_t *reasons = json_object();
+    json_object_set_new(reasons, "texture", json_integer(s->flush_reasons[DRAW_TEXTURES_FLUSH_TEXTURE]));
+    json_object_set_new(reasons, "composite", json_integer(s->flush_reasons[DRAW_TEXTURES_FLUSH_COMPOSITE]));
+    json_object_set_new(reasons, "filter", json_integer(s->flush_reasons[DRAW_TEXTURES_FLUSH_FILTER]));
+    json_object_set_new(reasons, "full", json_integer(s->flush_reasons[DRAW_TEXTURES_FLUSH_FULL]));
+    json_object_set_new(reasons, "external", json_integer(s->flush_reasons[DRAW_TEXTURES_FLUSH_EXTERNAL]));
+    json_object_set_new(report, "flushReasons", reasons);
+
+    json_object_set_new(report, "quads", json_integer(s->quads));
+    json_object_set_new(report, "culledQuads", json_integer(s->culled_quads));
+    json_object_set_new(report, "textures", json_integer(s->textures));
+    json_object_set_new(report, "textureBytes", json_integer((json_int_t) s->texture_bytes));
+    json_object_set_new(report, "maxTextureBytes", json_integer((json_int_t) s->max_texture_bytes));
+    json_object_set_new(report, "pendingLoads", json_integer(s->pending_loads));
+    json_object_set_new(report, "pendingLoadBytes", json_integer((json_int_t) s->pending_load_bytes));
+    json_object_set_new(report, "animations", json_integer(s->animations));
+    json_object_set_new(report, "timers", json_integer(s->timers));
+    json_object_set_new(report, "views", json_integer(s->views));
+
+#ifdef MEMORY_ACCOUNTING
+    json_t *memory = json_object();
+    for (int i = 0; i < MEMORY_TAG_COUNT; i++) {
+        const memory_tag_stats *m = &s->memory[i];
+        json_t *tag = json_object();
+        json_object_set_new(tag, "bytes", json_integer(m->bytes));
+        json_object_set_new(tag, "peakBytes", json_integer(m->peak_bytes));
+        json_object_set_new(tag, "allocations", json_integer((json_int_t) m->allocations));
+        json_object_set_new(tag, "frameAllocations", json_integer(m->frame_allocations));
+        json_object_set_new(memory, memory_tag_name(i), tag);
+    }
+    json_object_set_new(report, "memory", memory);
+#endif
+
+    char *str = json_dumps(report, JSON_COMPACT);
+    json_decref(report);
+    return str;
+}
+
+/**
+ * @name	perf_overlay_set_enabled
+ * @brief	shows or hides the overlay
+ * @param	enabled - (bool) true to draw it every tick
+ * @retval	NONE
+ */
+CEXPORT void perf_overlay_set_enabled(bool enabled) {
+    if (m_overlay != enabled) {
+        m_overlay = enabled;
+        // takes the overlay off the screen, or puts it on before the next tick
+        core_invalidate_frame();
+    }
+}
+
+/**
+ * @name	perf_overlay_enabled
+ * @brief	gets whether the overlay shows
+ * @retval	bool - true if it is drawn every tick
+ */
+bool perf_overlay_enabled() {
+    return m_overlay;
+}
+
+static void overlay_line(context_2d *ctx, float x, float *y, float scale, rgba *color, const char *text) {
+    // the atlas draws changing numbers without rasterizing them again, a line
+    // it can't draw is left out rather than filling the text cache
+    glyph_atlas_fill_text(ctx, OVERLAY_FONT, (int) (OVERLAY_FONT_SIZE * scale), text, color, TEXT_STYLE_FILL, 0, x, *y, 1);
+    *y += OVERLAY_LINE_HEIGHT * scale;
+}
+
+/**
+ * @name	perf_overlay_draw
+ * @brief	draws the snapshot and a graph of the recent frame times in the
+ *			top left corner of the screen, if the overlay is on and the tick
+ *			draws
+ * @retval	NONE
+ */
+void perf_overlay_draw() {
+    if (!m_overlay || !core_frame_should_draw()) {
+        return;
+    }
+
+    tealeaf_canvas *canvas = tealeaf_canvas_get();
+    context_2d *ctx = context_2d_get_onscreen(canvas);
+    int short_side = canvas->framebuffer_width < canvas->framebuffer_height ? canvas->framebuffer_width : canvas->framebuffer_height;
+    float scale = short_side > OVERLAY_REFERENCE_SIZE ? (float) short_side / OVERLAY_REFERENCE_SIZE : 1;
+
+    const perf_stats *s = &m_stats;
+    const int lines = 6;
+    float left = OVERLAY_MARGIN * scale;
+    float top = OVERLAY_MARGIN * scale;
+    float pad = OVERLAY_PADDING * scale;
+    float width = OVERLAY_WIDTH * scale;
+    float graph_height = OVERLAY_GRAPH_HEIGHT * scale;
+    float height = pad * 3 + lines * OVERLAY_LINE_HEIGHT * scale + graph_height;
+
+    context_2d_save(ctx);
+    context_2d_loadIdentity(ctx);
+    context_2d_setGlobalAlpha(ctx, 1);
+    context_2d_setGlobalCompositeOperation(ctx, source_over);
+
+    rgba background = {0, 0, 0, 0.7f};
+    rect_2d panel = {left, top, width, height};
+    context_2d_fillRect(ctx, &panel, &background);
+
+    rgba white = {1, 1, 1, 1};
+    char text[128];
+    float x = left + pad;
+    float y = top + pad;
+    snprintf(text, sizeof(text), "%.0f fps  %.1f ms  max %.1f ms", s->fps, s->frame_ms, s->frame_ms_max);
+    overlay_line(ctx, x, &y, scale, &white, text);
+    snprintf(text, sizeof(text), "draws %u  quads %u  culled %u", s->draw_calls, s->quads, s->culled_quads);
+    overlay_line(ctx, x, &y, scale, &white, text);
+    snprintf(text, sizeof(text), "flush tex %u cmp %u flt %u full %u ext %u",
+             s->flush_reasons[DRAW_TEXTURES_FLUSH_TEXTURE], s->flush_reasons[DRAW_TEXTURES_FLUSH_COMPOSITE],
+             s->flush_reasons[DRAW_TEXTURES_FLUSH_FILTER], s->flush_reasons[DRAW_TEXTURES_FLUSH_FULL],
+             s->flush_reasons[DRAW_TEXTURES_FLUSH_EXTERNAL]);
+    overlay_line(ctx, x, &y, scale, &white, text);
+    snprintf(text, sizeof(text), "textures %d  %.1f / %.1f MB", s->textures,
+             s->texture_bytes / 1048576.0, s->max_texture_bytes / 1048576.0);
+    overlay_line(ctx, x, &y, scale, &white, text);
+    snprintf(text, sizeof(text), "loading %d  %.1f MB", s->pending_loads, s->pending_load_bytes / 1048576.0);
+    overlay_line(ctx, x, &y, scale, &white, text);
+    snprintf(text, sizeof(text), "anims %u  timers %d  views %u", s->animations, s->timers, s->views);
+    overlay_line(ctx, x, &y, scale, &white, text);
+
+    // oldest tick on the left, a line at the 60 fps frame time
+    float graph_width = width - pad * 2;
+    float graph_bottom = y + pad + graph_height;
+    float bar = graph_width / HISTORY_FRAMES;
+    unsigned int kept = m_history_count < HISTORY_FRAMES ? m_history_count : HISTORY_FRAMES;
+    rgba fast = {0.3f, 0.9f, 0.3f, 1};
+    rgba slow = {0.95f, 0.8f, 0.2f, 1};
+    rgba dropped = {0.95f, 0.25f, 0.2f, 1};
+    for (unsigned int i = 0; i < kept; i++) {
+        double ms = m_history[(m_history_count - kept + i) % HISTORY_FRAMES];
+        float h = (float) (ms < GRAPH_MAX_MS ? ms / GRAPH_MAX_MS : 1) * graph_height;
+        rect_2d r = {x + (HISTORY_FRAMES - kept + i) * bar, graph_bottom - h, bar, h};
+        context_2d_fillRect(ctx, &r, ms <= GRAPH_TARGET_MS ? &fast : ms <= GRAPH_SLOW_MS ? &slow : &dropped);
+    }
+    rgba target = {1, 1, 1, 0.5f};
+    rect_2d line = {x, graph_bottom - (float) (GRAPH_TARGET_MS / GRAPH_MAX_MS) * graph_height, graph_width, scale};
+    context_2d_fillRect(ctx, &line, &target);
+
+    context_2d_restore(ctx);
+    context_2d_flush(ctx);
+}
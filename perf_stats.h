@@ -0,0 +1,68 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef PERF_STATS_H
+#define PERF_STATS_H
+
+#include "core/types.h"
+#include "core/draw_textures.h"
+#include "core/memory_tags.h"
+#include "core/util/detect.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Gathers the counters a game watches while tuning into one snapshot per
+// tick, and draws them over the frame with the onscreen context when the
+// overlay is on. Draw counts are those of the last completed frame, which
+// include the overlay's own quads. The overlay redraws the screen every
+// tick, so idle frames are not skipped while it shows. Main thread only.
+
+typedef struct perf_stats_t {
+	double fps;                 // over about the last second of ticks
+	double frame_ms;            // time between the last two ticks
+	double frame_ms_max;        // longest of the ticks kept for the graph
+	unsigned int draw_calls;    // batches flushed
+	unsigned int flush_reasons[DRAW_TEXTURES_FLUSH_REASON_COUNT];
+	unsigned int quads;
+	unsigned int culled_quads;
+	int textures;
+	size_t texture_bytes;
+	size_t max_texture_bytes;
+	int pending_loads;
+	size_t pending_load_bytes;  // estimated
+	unsigned int animations;    // scheduled, so not paused
+	int timers;
+	unsigned int views;
+	memory_tag_stats memory[MEMORY_TAG_COUNT];  // zero without MEMORY_ACCOUNTING
+} perf_stats;
+
+// called by core_tick once the last frame's draws are counted
+void perf_stats_tick(double frame_ms);
+const perf_stats *perf_stats_get();
+// the snapshot as JSON, for the bindings. Caller frees
+CEXPORT char *perf_stats_report();
+
+CEXPORT void perf_overlay_set_enabled(bool enabled);
+bool perf_overlay_enabled();
+// called by core_tick last, draws the overlay if it is on
+void perf_overlay_draw();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PERF_STATS_H
@@ -18,16 +18,27 @@
 
 #define GL_GLEXT_PROTOTYPES
 
+// Define GL_USE_GLES3 to build against the GLES3 headers, which enables the
+// pixel buffer texture upload path on GLES3 contexts
 #ifdef ANDROID
 #define GL_ES
+#ifdef GL_USE_GLES3
+#include <GLES3/gl3.h>
+#else
 #include <GLES2/gl2.h>
+#endif
 #include <GLES2/gl2ext.h>
 #elif __APPLE__
 #include "TargetConditionals.h"
 #if TARGET_OS_IPHONE
 #define GL_ES
+#ifdef GL_USE_GLES3
+#include <OpenGLES/ES3/gl.h>
+#include <OpenGLES/ES3/glext.h>
+#else
 #include <OpenGLES/ES2/gl.h>
 #include <OpenGLES/ES2/glext.h>
+#endif
 #elif TARGET_IPHONE_SIMULATOR
 #define GL_ES
 #include <OpenGLES/ES2/gl.h>
@@ -53,20 +64,21 @@
 #endif
 
 //#define ENABLE_GLTRACE 1
-// Define ENABLE_GLTRACE to report errors in GL commands at the console (slow)
+// Define ENABLE_GLTRACE to count the wrapped gl calls and check them for
+// errors, at the cost of a call per command, see core/gl_trace.h for the
+// modes. Without it GLTRACE is the bare command
 #ifndef ENABLE_GLTRACE
 #define GLTRACE(cmd) cmd
 #else
+#include "core/gl_trace.h"
 
 #define GLTRACE_STRINGIZE(x) GLTRACE_STRINGIZE1(x)
 #define GLTRACE_STRINGIZE1(x) #x
 #define GLTRACE_FILELINE __FILE__ " at line " GLTRACE_STRINGIZE(__LINE__)
 
 #define GLTRACE(cmd) cmd; \
-	{	int gltrace_err = glGetError(); \
-		if (gltrace_err != 0) { \
-			LOG("{gl} TRACE: Error %d at " #cmd " in " GLTRACE_FILELINE, gltrace_err); \
-		} \
+	{	static gl_trace_site gltrace_site = {#cmd, GLTRACE_FILELINE}; \
+		gl_trace_call(&gltrace_site); \
 	}
 #endif
 
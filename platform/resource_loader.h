@@ -32,6 +32,15 @@ typedef struct resource_t {
 
 typedef struct resource_t *resource_p;
 
+// A read only view of a file's bytes, without copying them. Platforms map
+// bundled files with mmap, or on Android hand out AAsset_getBuffer of an
+// asset stored uncompressed, and keep what they need to release it in handle
+typedef struct resource_view_t {
+	const unsigned char *data;
+	unsigned long size;
+	void *handle;
+} resource_view;
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -40,6 +49,10 @@ void resource_loader_initialize(const char *path);
 void resource_loader_deinitialize();
 resource_p resource_loader_load_url(const char *url);
 unsigned char *resource_loader_read_file(const char *url, unsigned long *sz);
+// false when the file can't be mapped, e.g. compressed in the APK, then
+// resource_loader_read_file has to copy it. the view lasts until unmapped
+bool resource_loader_map_file(const char *url, resource_view *view);
+void resource_loader_unmap_file(resource_view *view);
 bool is_remote_resource(const char *url);
 void launch_remote_texture_load(const char *url);
 char *resource_loader_string_from_url(const char *url);
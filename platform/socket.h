@@ -21,6 +21,8 @@ extern "C" {
 #endif
 
 void socket_send(int id, const char *data);
+// sends size bytes as they are, the data is only read during the call
+void socket_send_binary(int id, const void *data, unsigned long size);
 void socket_close(int id);
 int socket_create(const char *host, int port);
 	
@@ -20,6 +20,14 @@
 extern "C" {
 #endif
 
+// decoded audio, interleaved 16 bit samples
+typedef struct sound_pcm_t {
+	short *samples;
+	unsigned long frames;
+	int channels;
+	int sample_rate;
+} sound_pcm;
+
 void sound_manager_load_sound(const char *url);
 void sound_manager_play_sound(const char *url, float volume, bool loop);
 void sound_manager_stop_sound(const char *url);
@@ -31,6 +39,21 @@ void sound_manager_play_background_music(const char *url, float volume, bool loo
 void sound_manager_stop_loading_sound();
 void sound_manager_halt();
 
+// The voice layer behind core/sfx.h. Voices are players created once and
+// reused, each plays one decoded sound at a time.
+
+// decodes a sound file, called on a job worker. samples is malloc'd and
+// freed by the caller
+bool sound_manager_decode_sound(const char *url, sound_pcm *pcm);
+// creates up to count voices, returns how many it could
+int sound_manager_create_voices(int count);
+void sound_manager_destroy_voices();
+// pcm stays valid until the voice is stopped or given another sound, so it
+// can be played without a copy. Starting a voice stops what it played
+void sound_manager_voice_play(int voice, const sound_pcm *pcm, float volume, bool loop);
+void sound_manager_voice_stop(int voice);
+void sound_manager_voice_set_volume(int voice, float volume);
+
 #ifdef __cplusplus
 }
 #endif
@@ -26,9 +26,34 @@ typedef void *ThreadsThread;
 
 #define THREADS_INVALID_THREAD (ThreadsThread)( 0 )
 
+// How urgent a thread's work is. Platforms map these to pthread priorities,
+// Android nice values (10, 5, 0 and -4) or iOS QoS classes (background,
+// utility, default and user initiated)
+typedef enum ThreadsPriority {
+	THREADS_PRIORITY_BACKGROUND, // bulk work nobody is waiting on
+	THREADS_PRIORITY_UTILITY,    // work a frame will want soon, e.g. loading
+	THREADS_PRIORITY_DEFAULT,
+	THREADS_PRIORITY_HIGH        // work the render thread is waiting on
+} ThreadsPriority;
+
+// Which cores a thread would rather run on. Only a hint, platforms without
+// heterogeneous cores or affinity control ignore it
+typedef enum ThreadsAffinity {
+	THREADS_AFFINITY_ANY,
+	THREADS_AFFINITY_EFFICIENCY, // the LITTLE cores of big.LITTLE
+	THREADS_AFFINITY_PERFORMANCE
+} ThreadsAffinity;
+
 // Start a thread
 CEXPORT ThreadsThread threads_create_thread(ThreadsThreadProc proc, void *param);
 
+// Start a thread with the given priority and affinity hint
+CEXPORT ThreadsThread threads_create_thread_with_priority(ThreadsThreadProc proc, void *param,
+                                                          ThreadsPriority priority, ThreadsAffinity affinity);
+
+// Change the priority and affinity hint of the calling thread
+CEXPORT void threads_set_current_priority(ThreadsPriority priority, ThreadsAffinity affinity);
+
 // Join the thread (MUST call this at some point for each started thread)
 CEXPORT void threads_join_thread(ThreadsThread *thread);
 
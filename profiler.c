@@ -0,0 +1,264 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 profiler.c
+ * @brief	records timed zones per thread for a Chrome trace
+ */
+#include "core/profiler.h"
+#include "core/log.h"
+#include "core/system_trace.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// events kept per thread, a power of two
+#define RING_SIZE 16384
+#define RING_MASK (RING_SIZE - 1)
+#define MAX_RINGS 32
+
+typedef struct profiler_event_t {
+    const profiler_zone *zone;
+    long long start;
+    long long end;
+} profiler_event;
+
+// written only by its thread, read by profiler_write_trace
+typedef struct profiler_ring_t {
+    profiler_event events[RING_SIZE];
+    unsigned int head; // events ever written
+    unsigned int base; // head when recording last started
+} profiler_ring;
+
+static profiler_ring *m_rings[MAX_RINGS];
+static int m_ring_count = 0;
+static pthread_mutex_t m_ring_mutex = PTHREAD_MUTEX_INITIALIZER;
+static __thread profiler_ring *t_ring = NULL;
+static __thread bool t_ring_failed = false;
+// what zones do, one load when neither
+#define ACTIVE_RECORDING 1
+#define ACTIVE_SYSTEM_TRACE 2
+static int m_active = 0;
+static long long m_start = 0;
+
+/**
+ * @name	profiler_now
+ * @brief	gets a monotonic time
+ * @retval	long long - nanoseconds
+ */
+long long profiler_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @name	thread_ring
+ * @brief	gets the calling thread's ring, making it on first use
+ * @retval	profiler_ring* - the ring, or NULL if there is no room for another
+ */
+static profiler_ring *thread_ring() {
+    if (t_ring || t_ring_failed) {
+        return t_ring;
+    }
+
+    profiler_ring *ring = (profiler_ring *) calloc(1, sizeof(profiler_ring));
+    pthread_mutex_lock(&m_ring_mutex);
+    if (ring && m_ring_count < MAX_RINGS) {
+        m_rings[m_ring_count] = ring;
+        __atomic_store_n(&m_ring_count, m_ring_count + 1, __ATOMIC_RELEASE);
+        t_ring = ring;
+    } else {
+        free(ring);
+        t_ring_failed = true;
+        LOG("{profiler} WARNING: No room to record another thread");
+    }
+    pthread_mutex_unlock(&m_ring_mutex);
+    return t_ring;
+}
+
+/**
+ * @name	profiler_start
+ * @brief	forgets what was recorded and starts recording
+ * @retval	NONE
+ */
+void profiler_start() {
+    m_start = profiler_now();
+    int count = __atomic_load_n(&m_ring_count, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count; i++) {
+        profiler_ring *ring = m_rings[i];
+        __atomic_store_n(&ring->base, __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+    }
+    __atomic_or_fetch(&m_active, ACTIVE_RECORDING, __ATOMIC_RELEASE);
+}
+
+/**
+ * @name	profiler_stop
+ * @brief	stops recording, keeping what was recorded
+ * @retval	NONE
+ */
+void profiler_stop() {
+    __atomic_and_fetch(&m_active, ~ACTIVE_RECORDING, __ATOMIC_RELEASE);
+}
+
+bool profiler_is_recording() {
+    return __atomic_load_n(&m_active, __ATOMIC_RELAXED) & ACTIVE_RECORDING;
+}
+
+/**
+ * @name	profiler_set_system_trace
+ * @brief	starts or stops marking zones for the platform's tracer. Zones
+ *			begun before are ended as they began
+ * @param	enabled - (bool) true to mark zones
+ * @retval	NONE
+ */
+void profiler_set_system_trace(bool enabled) {
+    if (enabled) {
+        __atomic_or_fetch(&m_active, ACTIVE_SYSTEM_TRACE, __ATOMIC_RELEASE);
+    } else {
+        __atomic_and_fetch(&m_active, ~ACTIVE_SYSTEM_TRACE, __ATOMIC_RELEASE);
+    }
+}
+
+bool profiler_system_trace_enabled() {
+    return __atomic_load_n(&m_active, __ATOMIC_RELAXED) & ACTIVE_SYSTEM_TRACE;
+}
+
+/**
+ * @name	profiler_counter
+ * @brief	sends a value to the platform's tracer while marking zones
+ * @param	name - (const char *) the counter's track
+ * @param	value - (long long) its value from now on
+ * @retval	NONE
+ */
+void profiler_counter(const char *name, long long value) {
+    if (__atomic_load_n(&m_active, __ATOMIC_RELAXED) & ACTIVE_SYSTEM_TRACE) {
+        system_trace_counter(name, value);
+    }
+}
+
+/**
+ * @name	profiler_scope_begin
+ * @brief	starts timing a zone, see PROFILE_ZONE
+ * @param	zone - (const profiler_zone *) the call site's zone
+ * @retval	profiler_scope - handed to profiler_scope_end
+ */
+profiler_scope profiler_scope_begin(const profiler_zone *zone) {
+    profiler_scope scope = {NULL, 0, 0};
+    int active = __atomic_load_n(&m_active, __ATOMIC_RELAXED);
+    if (active) {
+        if (active & ACTIVE_SYSTEM_TRACE) {
+            scope.trace_id = system_trace_begin(zone->name);
+        }
+        if (active & ACTIVE_RECORDING) {
+            scope.zone = zone;
+            scope.start = profiler_now();
+        }
+    }
+    return scope;
+}
+
+/**
+ * @name	profiler_scope_end
+ * @brief	records a zone started while recording, and ends its section
+ *			in the platform's tracer
+ * @param	scope - (profiler_scope *) from profiler_scope_begin
+ * @retval	NONE
+ */
+void profiler_scope_end(profiler_scope *scope) {
+    if (scope->trace_id) {
+        system_trace_end(scope->trace_id);
+    }
+    if (!scope->zone) {
+        return;
+    }
+
+    profiler_ring *ring = thread_ring();
+    if (!ring) {
+        return;
+    }
+
+    unsigned int head = ring->head;
+    profiler_event *event = &ring->events[head & RING_MASK];
+    event->zone = scope->zone;
+    event->start = scope->start;
+    event->end = profiler_now();
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// writes the name as a JSON string, names are code so only quotes and
+// backslashes are escaped
+static void write_name(FILE *file, const char *name) {
+    fputc('"', file);
+    for (; *name; name++) {
+        if (*name == '"' || *name == '\\') {
+            fputc('\\', file);
+        }
+        fputc(*name, file);
+    }
+    fputc('"', file);
+}
+
+/**
+ * @name	profiler_write_trace
+ * @brief	writes the recorded zones as Chrome trace complete events, one
+ *			trace thread per recording thread. Zones recorded while this
+ *			runs may come out torn, so stop first
+ * @param	path - (const char *) file to write
+ * @retval	bool - false if the file couldn't be written
+ */
+bool profiler_write_trace(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        LOG("{profiler} WARNING: Unable to write a trace to %s", path);
+        return false;
+    }
+
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", file);
+    bool first = true;
+    unsigned int written = 0;
+    int count = __atomic_load_n(&m_ring_count, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < count; i++) {
+        profiler_ring *ring = m_rings[i];
+        unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        unsigned int base = __atomic_load_n(&ring->base, __ATOMIC_RELAXED);
+        if (head - base > RING_SIZE) {
+            // the oldest were written over
+            base = head - RING_SIZE;
+        }
+
+        for (unsigned int e = base; e != head; e++) {
+            const profiler_event *event = &ring->events[e & RING_MASK];
+            if (event->start < m_start) {
+                continue;
+            }
+            fputs(first ? "\n{\"name\":" : ",\n{\"name\":", file);
+            write_name(file, event->zone->name);
+            fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    i + 1, (event->start - m_start) / 1000.0, (event->end - event->start) / 1000.0);
+            first = false;
+            written++;
+        }
+    }
+    fputs("\n]}\n", file);
+
+    bool ok = !ferror(file);
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    LOG("{profiler} Wrote %u zones to %s", written, path);
+    return ok;
+}
@@ -0,0 +1,86 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "core/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Times zones of code into a ring of events per thread, written without
+// locks, and writes them out as a Chrome trace event file that
+// chrome://tracing and Perfetto open. Zones are compiled in only with
+// ENABLE_PROFILER defined, and record only between profiler_start and
+// profiler_stop, costing one load otherwise. Each zone's name lives in a
+// static at the call site, so recording copies a pointer and two times.
+//
+//     void texture_manager_tick(texture_manager *manager) {
+//         PROFILE_ZONE("texture_manager_tick");
+//         ...
+//
+// A zone ends when the scope it was declared in does.
+//
+// With profiler_set_system_trace on, zones are also sent as begin and end
+// markers to the platform's tracer, ATrace or os_signpost, along with
+// counters, so they line up with the gpu and scheduler in its tools.
+
+typedef struct profiler_zone_t {
+	const char *name;
+} profiler_zone;
+
+typedef struct profiler_scope_t {
+	const profiler_zone *zone; // NULL when not recording
+	long long start;
+	unsigned long long trace_id; // of the system trace section, 0 for none
+} profiler_scope;
+
+// clears what was recorded and starts recording
+void profiler_start();
+void profiler_stop();
+bool profiler_is_recording();
+// writes what is still in the rings, best stopped first
+bool profiler_write_trace(const char *path);
+// monotonic nanoseconds
+long long profiler_now();
+
+// also marks zones for the platform's tracer, whether or not recording
+void profiler_set_system_trace(bool enabled);
+bool profiler_system_trace_enabled();
+// a value to plot in the platform's tracer, when marking zones for it
+void profiler_counter(const char *name, long long value);
+
+profiler_scope profiler_scope_begin(const profiler_zone *zone);
+void profiler_scope_end(profiler_scope *scope);
+
+#define PROFILER_CONCAT_(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_(a, b)
+
+#ifdef ENABLE_PROFILER
+#define PROFILE_ZONE(zone_name) \
+	static const profiler_zone PROFILER_CONCAT(profiler_zone_, __LINE__) = {zone_name}; \
+	profiler_scope PROFILER_CONCAT(profiler_scope_, __LINE__) __attribute__((cleanup(profiler_scope_end))) = \
+		profiler_scope_begin(&PROFILER_CONCAT(profiler_zone_, __LINE__))
+#else
+#define PROFILE_ZONE(zone_name) do {} while (0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // PROFILER_H
@@ -10,10 +10,55 @@ extern "C" {
 void qr_process(const unsigned char *raster, int width, int height, char result[512]);
 void qr_process_base64_image(const char *b64image, char text[512]);
 
+// A decoded code
+typedef struct qr_code_result_t {
+	unsigned char *payload; // payload_length bytes, NUL terminated
+	int payload_length;
+	int version;
+	int corners[8]; // x, y of each corner in the frame, clockwise from top left
+} qr_code_result;
+
+// Part of a frame, in pixels
+typedef struct qr_region_t {
+	int x, y;
+	int width, height;
+} qr_region;
+
+// Scans a luminance plane, such as the Y plane of an NV21 or YUV420 frame,
+// where it is, rows stride bytes apart. Only roi is scanned unless it is
+// NULL. Large regions are searched downscaled first and only the area around
+// codes found there is read at full resolution, so a code far too small to
+// be seen downscaled needs a tighter roi. Returns the number of codes,
+// free them with qr_free_results. NOT THREADSAFE, like qr_process
+int qr_process_luminance(const unsigned char *plane, int width, int height, int stride,
+						 const qr_region *roi, qr_code_result **codes);
+void qr_free_results(qr_code_result *codes, int count);
+
+// RGB or RGBA to luminance, out may be in
+void qr_rgba_to_luminance(const unsigned char *in, int pixels, int channels, unsigned char *out);
+
+// Called on the main thread with every code decoded from one frame. The
+// results are freed when it returns
+typedef void (*qr_scan_callback)(const qr_code_result *codes, int count, void *data);
+
+// Scans camera frames on a job worker. Only the latest frame is kept while
+// one is being scanned, older ones are dropped
+void qr_scanner_start(qr_scan_callback callback, void *data);
+// Limits scanning to a region of the frames, NULL for whole frames
+void qr_scanner_set_region(const qr_region *roi);
+// Copies a luminance frame for scanning, safe to call from the camera thread
+void qr_scanner_submit_frame(const unsigned char *luminance, int width, int height, int stride);
+void qr_scanner_stop();
+
 // Outputs RGB PNG image
 // Free the buffer with free() when done
 char *qr_generate_base64_image(const char *text, int *width, int *height);
 
+// Draws a QR code straight into a new texture, module_size pixels per
+// module with the quiet zone around it, and returns the texture's url for
+// drawing it like a canvas. GL thread only
+const char *qr_generate_texture(const char *text, int module_size, int *width, int *height);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,71 +1,337 @@
 #include <stdlib.h>
 #include <stdint.h>
+#include <pthread.h>
 
 #include "quirc/quirc.h"
 #include "libqrencode/qrencode.h"
 
 #include "core/image_loader.h"
 #include "core/image_writer.h"
+#include "core/jobs.h"
+#include "core/texture_manager.h"
+#include "core/gl_state.h"
+#include "core/util/detect.h"
+#include "platform/gl.h"
+#include "QRCodeProcessor.h"
+
+// Regions larger than this on a side are first scanned downscaled
+#define QR_COARSE_SIZE 640
 
 // NOT THREADSAFE
 static struct quirc *m_qr = 0;
 
-void qr_process(const unsigned char *buffer, int width, int height, char text[512]) {
-	unsigned char *image;
-	int w, h, num_codes, ii;
 
-	text[0] = 0;
+//// Luminance
 
-	if (!m_qr) {
-		m_qr = quirc_new();
-		if (!m_qr) {
-			LOG("{qr} ERROR: Unable to allocate new QR object!");
-			return;
+/*
+ * SIMD kernel for RGBA to luminance.  It converts whole vectors of pixels
+ * with the same weights as the scalar loop, (r + 2g + b) / 4, and returns
+ * how many pixels it converted.
+ */
+
+#if defined(GC_HAS_NEON)
+#include <arm_neon.h>
+
+static int rgba_to_luminance_simd(const unsigned char *in, int pixels, unsigned char *out) {
+	int done = 0;
+	for (; done + 16 <= pixels; done += 16, in += 64, out += 16) {
+		uint8x16x4_t px = vld4q_u8(in);
+		uint16x8_t lo = vaddl_u8(vget_low_u8(px.val[0]), vget_low_u8(px.val[2]));
+		uint16x8_t hi = vaddl_u8(vget_high_u8(px.val[0]), vget_high_u8(px.val[2]));
+		lo = vaddq_u16(lo, vshll_n_u8(vget_low_u8(px.val[1]), 1));
+		hi = vaddq_u16(hi, vshll_n_u8(vget_high_u8(px.val[1]), 1));
+		vst1q_u8(out, vcombine_u8(vshrn_n_u16(lo, 2), vshrn_n_u16(hi, 2)));
+	}
+	return done;
+}
+
+#elif defined(GC_HAS_SSE)
+#include <emmintrin.h>
+
+// Luminance of four pixels, one per 32 bit lane
+static inline __m128i rgba_luminance4(__m128i px) {
+	__m128i mask = _mm_set1_epi32(0xff);
+	__m128i r = _mm_and_si128(px, mask);
+	__m128i g = _mm_and_si128(_mm_srli_epi32(px, 8), mask);
+	__m128i b = _mm_and_si128(_mm_srli_epi32(px, 16), mask);
+	return _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(r, b), _mm_slli_epi32(g, 1)), 2);
+}
+
+static int rgba_to_luminance_simd(const unsigned char *in, int pixels, unsigned char *out) {
+	int done = 0;
+	for (; done + 16 <= pixels; done += 16, in += 64, out += 16) {
+		__m128i a = rgba_luminance4(_mm_loadu_si128((const __m128i *)in));
+		__m128i b = rgba_luminance4(_mm_loadu_si128((const __m128i *)(in + 16)));
+		__m128i c = rgba_luminance4(_mm_loadu_si128((const __m128i *)(in + 32)));
+		__m128i d = rgba_luminance4(_mm_loadu_si128((const __m128i *)(in + 48)));
+		__m128i y = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+		_mm_storeu_si128((__m128i *)out, y);
+	}
+	return done;
+}
+
+#else
+
+static int rgba_to_luminance_simd(const unsigned char *in, int pixels, unsigned char *out) {
+	return 0;
+}
+
+#endif
+
+// Converts in place, out may be in
+void qr_rgba_to_luminance(const unsigned char *in, int pixels, int channels, unsigned char *out) {
+	int ii = channels == 4 ? rgba_to_luminance_simd(in, pixels, out) : 0;
+
+	in += ii * channels;
+	out += ii;
+	for (; ii < pixels; ++ii) {
+		// Green is 2x as intense as other colors, assume RGB(A) or BGR(A) and ignore alpha (experimentally true)
+		int mag = (unsigned int)in[0] + ((unsigned int)in[1] << 1) + (unsigned int)in[2];
+		*out++ = (unsigned char)(mag >> 2);
+		in += channels;
+	}
+}
+
+
+//// Scanning
+
+struct qr_results {
+	qr_code_result *codes;
+	int count;
+	int capacity;
+};
+
+void qr_free_results(qr_code_result *codes, int count) {
+	int ii;
+	for (ii = 0; ii < count; ++ii) {
+		free(codes[ii].payload);
+	}
+	free(codes);
+}
+
+static bool has_payload(const struct qr_results *results, const struct quirc_data *data) {
+	int ii;
+	for (ii = 0; ii < results->count; ++ii) {
+		if (results->codes[ii].payload_length == data->payload_len &&
+			!memcmp(results->codes[ii].payload, data->payload, data->payload_len)) {
+			return true;
 		}
 	}
+	return false;
+}
 
-	// Resize workspace
-	if (quirc_resize(m_qr, width, height) < 0) {
-		LOG("{qr} ERROR: Unable to resize to w=%d h=%d", width, height);
+static void add_result(struct qr_results *results, const struct quirc_code *code, const struct quirc_data *data,
+					   int x, int y, int scale) {
+	int corner;
+
+	// A code found again by the full resolution pass
+	if (has_payload(results, data)) {
 		return;
 	}
 
-	image = quirc_begin(m_qr, &w, &h);
+	if (results->count == results->capacity) {
+		int capacity = results->capacity ? results->capacity * 2 : 4;
+		qr_code_result *codes = (qr_code_result *)realloc(results->codes, capacity * sizeof(qr_code_result));
+		if (!codes) {
+			return;
+		}
+		results->codes = codes;
+		results->capacity = capacity;
+	}
 
-	if (w != width || h != height) {
-		LOG("{qr} ERROR: Width and height do not match w=%d/%d h=%d/%d", w, width, h, height);
+	qr_code_result *result = &results->codes[results->count];
+	result->payload = (unsigned char *)malloc(data->payload_len + 1);
+	if (!result->payload) {
 		return;
 	}
+	memcpy(result->payload, data->payload, data->payload_len);
+	result->payload[data->payload_len] = 0;
+	result->payload_length = data->payload_len;
+	result->version = data->version;
+	for (corner = 0; corner < 4; ++corner) {
+		result->corners[corner * 2] = x + code->corners[corner].x * scale;
+		result->corners[corner * 2 + 1] = y + code->corners[corner].y * scale;
+	}
+	results->count++;
+}
 
-	// Copy image into place
-	memcpy(image, buffer, width * height);
+/*
+ * Reads a region of the plane straight into the quirc buffer, averaging
+ * scale x scale blocks, so the plane is never copied anywhere else.
+ */
+static bool load_region(struct quirc *q, const unsigned char *plane, int stride, const qr_region *region, int scale) {
+	int w, h, x, y, dx, dy;
+	int width = region->width / scale;
+	int height = region->height / scale;
 
-	quirc_end(m_qr);
+	if (width <= 0 || height <= 0 || quirc_resize(q, width, height) < 0) {
+		LOG("{qr} ERROR: Unable to resize to w=%d h=%d", width, height);
+		return false;
+	}
 
-	// Count number of codes
-	num_codes = quirc_count(m_qr);
+	unsigned char *image = quirc_begin(q, &w, &h);
+	const unsigned char *src = plane + region->y * stride + region->x;
+
+	if (scale == 1) {
+		for (y = 0; y < h; ++y) {
+			memcpy(image + y * w, src + y * stride, w);
+		}
+	} else {
+		int shift = 0;
+		while ((1 << shift) < scale * scale) {
+			++shift;
+		}
+		for (y = 0; y < h; ++y) {
+			const unsigned char *row = src + y * scale * stride;
+			for (x = 0; x < w; ++x) {
+				unsigned int sum = 0;
+				for (dy = 0; dy < scale; ++dy) {
+					const unsigned char *block = row + dy * stride + x * scale;
+					for (dx = 0; dx < scale; ++dx) {
+						sum += block[dx];
+					}
+				}
+				image[y * w + x] = (unsigned char)(sum >> shift);
+			}
+		}
+	}
+
+	quirc_end(q);
+	return true;
+}
+
+/*
+ * Decodes what quirc found in the loaded region. Codes it could not decode
+ * grow miss, in plane coordinates, and the return value is their count.
+ */
+static int decode_region(struct quirc *q, const qr_region *region, int scale, struct qr_results *results, qr_region *miss) {
+	int num_codes = quirc_count(q);
+	int misses = 0;
+	int ii, corner;
 
 	for (ii = 0; ii < num_codes; ++ii) {
 		struct quirc_code code;
 		struct quirc_data data;
 		quirc_decode_error_t err;
 
-		quirc_extract(m_qr, ii, &code);
+		quirc_extract(q, ii, &code);
 
 		err = quirc_decode(&code, &data);
-		if (err) {
-			LOG("{qr} ERROR: %s", quirc_strerror(err));
-		} else {
-			LOG("{qr} Decoded: %s", data.payload);
+		if (!err) {
+			add_result(results, &code, &data, region->x, region->y, scale);
+			continue;
+		}
+
+		// Too few pixels per cell, worth a look at full resolution
+		for (corner = 0; corner < 4; ++corner) {
+			int cx = region->x + code.corners[corner].x * scale;
+			int cy = region->y + code.corners[corner].y * scale;
+			if (!misses && !corner) {
+				miss->x = cx;
+				miss->y = cy;
+				miss->width = miss->height = 0;
+			}
+			if (cx < miss->x) { miss->width += miss->x - cx; miss->x = cx; }
+			if (cy < miss->y) { miss->height += miss->y - cy; miss->y = cy; }
+			if (cx > miss->x + miss->width) miss->width = cx - miss->x;
+			if (cy > miss->y + miss->height) miss->height = cy - miss->y;
+		}
+		++misses;
+	}
+	return misses;
+}
+
+/*
+ * Scans a luminance plane for every code in roi. Large regions are first
+ * scanned downscaled: nothing found there ends the scan, and only the area
+ * around codes too small to decode is scanned again at full resolution.
+ */
+static int scan_plane(struct quirc *q, const unsigned char *plane, int width, int height, int stride,
+					  const qr_region *roi, qr_code_result **codes) {
+	struct qr_results results = {0};
+	qr_region region = {0, 0, width, height};
+	int scale = 1;
+
+	*codes = 0;
+	if (roi) {
+		region = *roi;
+		if (region.x < 0) { region.width += region.x; region.x = 0; }
+		if (region.y < 0) { region.height += region.y; region.y = 0; }
+		if (region.x + region.width > width) region.width = width - region.x;
+		if (region.y + region.height > height) region.height = height - region.y;
+		if (region.width <= 0 || region.height <= 0) {
+			return 0;
+		}
+	}
+
+	while ((region.width > region.height ? region.width : region.height) / scale > QR_COARSE_SIZE) {
+		scale *= 2;
+	}
+
+	if (scale > 1) {
+		qr_region miss;
+		if (!load_region(q, plane, stride, &region, scale) || !quirc_count(q)) {
+			return 0;
+		}
+		if (!decode_region(q, &region, scale, &results, &miss)) {
+			*codes = results.codes;
+			return results.count;
+		}
+
+		// Pad by a quarter so the finder patterns are whole, then clamp
+		int pad_x = miss.width / 4 + scale;
+		int pad_y = miss.height / 4 + scale;
+		qr_region fine = {miss.x - pad_x, miss.y - pad_y, miss.width + 2 * pad_x, miss.height + 2 * pad_y};
+		if (fine.x < region.x) { fine.width -= region.x - fine.x; fine.x = region.x; }
+		if (fine.y < region.y) { fine.height -= region.y - fine.y; fine.y = region.y; }
+		if (fine.x + fine.width > region.x + region.width) fine.width = region.x + region.width - fine.x;
+		if (fine.y + fine.height > region.y + region.height) fine.height = region.y + region.height - fine.y;
+		region = fine;
+	}
 
-			strncpy(text, (const char*)data.payload, 512);
-			text[511] = 0;
+	if (load_region(q, plane, stride, &region, 1)) {
+		qr_region miss;
+		decode_region(q, &region, 1, &results, &miss);
+	}
+
+	*codes = results.codes;
+	return results.count;
+}
+
+int qr_process_luminance(const unsigned char *plane, int width, int height, int stride,
+						 const qr_region *roi, qr_code_result **codes) {
+	*codes = 0;
+	if (!plane || width <= 0 || height <= 0 || stride < width) {
+		return 0;
+	}
+
+	if (!m_qr) {
+		m_qr = quirc_new();
+		if (!m_qr) {
+			LOG("{qr} ERROR: Unable to allocate new QR object!");
+			return 0;
 		}
 	}
+
+	return scan_plane(m_qr, plane, width, height, stride, roi, codes);
+}
+
+void qr_process(const unsigned char *buffer, int width, int height, char text[512]) {
+	qr_code_result *codes;
+	int count = qr_process_luminance(buffer, width, height, width, 0, &codes);
+
+	text[0] = 0;
+	if (count > 0) {
+		LOG("{qr} Decoded: %s", codes[0].payload);
+
+		strncpy(text, (const char*)codes[0].payload, 512);
+		text[511] = 0;
+	}
+	qr_free_results(codes, count);
 }
 
 void qr_process_base64_image(const char *b64image, char text[512]) {
-	int width, height, channels, x, y;
+	int width, height, channels;
 	unsigned char *image = load_image_from_base64(b64image, &width, &height, &channels);
 
 	if (image) {
@@ -78,49 +344,13 @@ void qr_process_base64_image(const char *b64image, char text[512]) {
 	text[0] = 0;
 
 	if (image && width > 0 && height > 0 && channels > 0) {
-		if (channels == 1) {
-			LOG("{qr} QR processing provided monochrome luminance image");
-
-			qr_process((const unsigned char *)image, width, height, text);
-		} else if (channels == 3) {
-			LOG("{qr} Processing RGB/BGR input data to luminance raster");
-
-			// Convert to luminance
-			const unsigned char *input = (const unsigned char *)image;
-			unsigned char *output = image;
-			for (y = 0; y < height; ++y) {
-				for (x = 0; x < width; ++x) {
-					// Green is 2x as intense as other colors, assume RGB or BGR
-					int mag = (unsigned int)input[0] + ((unsigned int)input[1] << 1) + (unsigned int)input[2];
-					mag /= 4;
-					//if (mag < 0) mag = 0;
-					if (mag > 255) mag = 255;
-					*output++ = (unsigned char)mag;
-					input += 3;
-				}
-			}
+		if (channels == 3 || channels == 4) {
+			LOG("{qr} Processing %d channel input data to luminance raster", channels);
 
-			LOG("{qr} QR processing luminance image");
-
-			qr_process((const unsigned char *)image, width, height, text);
-		} else if (channels == 4) {
-			LOG("{qr} Processing RGBA-type input data to luminance raster");
-
-			// Convert to luminance
-			const unsigned char *input = (const unsigned char *)image;
-			unsigned char *output = image;
-			for (y = 0; y < height; ++y) {
-				for (x = 0; x < width; ++x) {
-					// Green is 2x as intense as other colors, assume RGBA or BGRA and ignore alpha (experimentally true)
-					int mag = (unsigned int)input[0] + ((unsigned int)input[1] << 1) + (unsigned int)input[2];
-					mag /= 4;
-					//if (mag < 0) mag = 0;
-					if (mag > 255) mag = 255;
-					*output++ = (unsigned char)mag;
-					input += 4;
-				}
-			}
+			qr_rgba_to_luminance(image, width * height, channels, image);
+		}
 
+		if (channels == 1 || channels == 3 || channels == 4) {
 			LOG("{qr} QR processing luminance image");
 
 			qr_process((const unsigned char *)image, width, height, text);
@@ -132,6 +362,201 @@ void qr_process_base64_image(const char *b64image, char text[512]) {
 	free(image);
 }
 
+
+//// Camera scanning
+
+// The scanner has its own quirc, used by one scan job at a time
+struct qr_frame {
+	unsigned char *pixels;
+	int width, height;
+	int capacity;
+	int x, y; // of the region it was cropped to
+};
+
+struct qr_scan {
+	qr_code_result *codes;
+	int count;
+};
+
+static pthread_mutex_t m_scan_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct quirc *m_scan_qr = 0;
+static struct qr_frame m_pending = {0};
+static struct qr_frame m_scanning = {0};
+static bool m_has_pending = false;
+static bool m_scan_busy = false;
+static bool m_scan_running = false;
+static bool m_has_region = false;
+static qr_region m_scan_region;
+static qr_scan_callback m_scan_callback = 0;
+static void *m_scan_data = 0;
+
+static void scan_frame(void *param);
+static void finish_scan(void *param);
+
+// Call with m_scan_lock held
+static void free_scanner() {
+	if (m_scan_qr) {
+		quirc_destroy(m_scan_qr);
+		m_scan_qr = 0;
+	}
+	free(m_pending.pixels);
+	free(m_scanning.pixels);
+	memset(&m_pending, 0, sizeof(m_pending));
+	memset(&m_scanning, 0, sizeof(m_scanning));
+	m_has_pending = false;
+}
+
+// Call with m_scan_lock held, hands the latest frame to a scan, which the
+// caller submits once it has unlocked
+static struct qr_scan *take_frame() {
+	struct qr_scan *scan = (struct qr_scan *)calloc(1, sizeof(struct qr_scan));
+	if (!scan) {
+		return 0;
+	}
+
+	struct qr_frame frame = m_scanning;
+	m_scanning = m_pending;
+	m_pending = frame;
+	m_has_pending = false;
+	m_scan_busy = true;
+	return scan;
+}
+
+static void scan_frame(void *param) {
+	struct qr_scan *scan = (struct qr_scan *)param;
+	int ii;
+
+	// m_scanning and m_scan_qr belong to this job until it finishes
+	if (!m_scan_qr) {
+		m_scan_qr = quirc_new();
+		if (!m_scan_qr) {
+			LOG("{qr} ERROR: Unable to allocate new QR object!");
+			return;
+		}
+	}
+
+	scan->count = scan_plane(m_scan_qr, m_scanning.pixels, m_scanning.width, m_scanning.height,
+							 m_scanning.width, 0, &scan->codes);
+
+	// Back to frame coordinates
+	for (ii = 0; ii < scan->count * 8; ++ii) {
+		scan->codes[ii / 8].corners[ii % 8] += ii % 2 ? m_scanning.y : m_scanning.x;
+	}
+}
+
+static void finish_scan(void *param) {
+	struct qr_scan *scan = (struct qr_scan *)param;
+
+	pthread_mutex_lock(&m_scan_lock);
+	m_scan_busy = false;
+	bool running = m_scan_running;
+	qr_scan_callback callback = m_scan_callback;
+	void *data = m_scan_data;
+	struct qr_scan *next = 0;
+	if (!running) {
+		free_scanner();
+	} else if (m_has_pending) {
+		next = take_frame();
+	}
+	pthread_mutex_unlock(&m_scan_lock);
+
+	if (running && callback && scan->count > 0) {
+		callback(scan->codes, scan->count, data);
+	}
+
+	qr_free_results(scan->codes, scan->count);
+	free(scan);
+
+	if (next) {
+		jobs_submit(scan_frame, finish_scan, next, JOB_PRIORITY_NORMAL);
+	}
+}
+
+void qr_scanner_start(qr_scan_callback callback, void *data) {
+	pthread_mutex_lock(&m_scan_lock);
+	m_scan_callback = callback;
+	m_scan_data = data;
+	m_scan_running = true;
+	pthread_mutex_unlock(&m_scan_lock);
+}
+
+void qr_scanner_set_region(const qr_region *roi) {
+	pthread_mutex_lock(&m_scan_lock);
+	m_has_region = roi != 0;
+	if (roi) {
+		m_scan_region = *roi;
+	}
+	pthread_mutex_unlock(&m_scan_lock);
+}
+
+void qr_scanner_submit_frame(const unsigned char *luminance, int width, int height, int stride) {
+	int y;
+
+	if (!luminance || width <= 0 || height <= 0 || stride < width) {
+		return;
+	}
+
+	pthread_mutex_lock(&m_scan_lock);
+	if (!m_scan_running) {
+		pthread_mutex_unlock(&m_scan_lock);
+		return;
+	}
+
+	// Only the region is copied, clamped to the frame
+	qr_region region = {0, 0, width, height};
+	if (m_has_region) {
+		region = m_scan_region;
+		if (region.x < 0) { region.width += region.x; region.x = 0; }
+		if (region.y < 0) { region.height += region.y; region.y = 0; }
+		if (region.x + region.width > width) region.width = width - region.x;
+		if (region.y + region.height > height) region.height = height - region.y;
+		if (region.width <= 0 || region.height <= 0) {
+			pthread_mutex_unlock(&m_scan_lock);
+			return;
+		}
+	}
+
+	// Replaces a frame still waiting, which is dropped
+	if (m_pending.capacity < region.width * region.height) {
+		unsigned char *pixels = (unsigned char *)realloc(m_pending.pixels, region.width * region.height);
+		if (!pixels) {
+			pthread_mutex_unlock(&m_scan_lock);
+			LOG("{qr} WARNING: Unable to hold a %dx%d frame", region.width, region.height);
+			return;
+		}
+		m_pending.pixels = pixels;
+		m_pending.capacity = region.width * region.height;
+	}
+	const unsigned char *src = luminance + region.y * stride + region.x;
+	for (y = 0; y < region.height; ++y) {
+		memcpy(m_pending.pixels + y * region.width, src + y * stride, region.width);
+	}
+	m_pending.width = region.width;
+	m_pending.height = region.height;
+	m_pending.x = region.x;
+	m_pending.y = region.y;
+	m_has_pending = true;
+
+	struct qr_scan *scan = m_scan_busy ? 0 : take_frame();
+	pthread_mutex_unlock(&m_scan_lock);
+
+	if (scan) {
+		jobs_submit(scan_frame, finish_scan, scan, JOB_PRIORITY_NORMAL);
+	}
+}
+
+void qr_scanner_stop() {
+	pthread_mutex_lock(&m_scan_lock);
+	m_scan_running = false;
+	m_scan_callback = 0;
+	m_scan_data = 0;
+	// A scan in flight frees the scanner when it finishes
+	if (!m_scan_busy) {
+		free_scanner();
+	}
+	pthread_mutex_unlock(&m_scan_lock);
+}
+
 char *qr_generate_base64_image(const char *text, int *width, int *height) {
 	int i, j, kk;
 
@@ -207,3 +632,77 @@ char *qr_generate_base64_image(const char *text, int *width, int *height) {
 	return b64image;
 }
 
+
+// Quiet zone the QR spec asks for around a code, in modules
+#define QR_QUIET_MODULES 4
+
+const char *qr_generate_texture(const char *text, int module_size, int *width, int *height) {
+	int x, y, row;
+
+	if (!text || !width || !height || module_size < 1) {
+		LOG("{qr} qr_generate_texture invalid input");
+		return 0;
+	}
+
+	QRcode *qr = QRcode_encodeString(text, 0, QR_ECLEVEL_H, QR_MODE_8, 1);
+	if (!qr) {
+		LOG("{qr} Unable to encode text %s", text);
+		return 0;
+	}
+
+	const int image_width = (qr->width + 2 * QR_QUIET_MODULES) * module_size;
+
+	// The texture is a power of two, the code sits in its top left corner
+	int tex_width = 1;
+	while (tex_width < image_width) {
+		tex_width <<= 1;
+	}
+	const int stride = 4 * tex_width;
+	unsigned char *pixels = (unsigned char *)malloc(stride * tex_width);
+	if (!pixels) {
+		LOG("{qr} Unable to allocate a %dx%d texture", tex_width, tex_width);
+		QRcode_free(qr);
+		return 0;
+	}
+
+	// Opaque white, then each dark module as a black square
+	memset(pixels, 0xff, stride * tex_width);
+	for (y = 0; y < qr->width; ++y) {
+		unsigned char *scanline = pixels + (QR_QUIET_MODULES + y) * module_size * stride;
+
+		for (x = 0; x < qr->width; ++x) {
+			if (qr->data[y * qr->width + x] & 0x1) {
+				unsigned char *module = scanline + 4 * (QR_QUIET_MODULES + x) * module_size;
+				int px;
+				for (px = 0; px < module_size; ++px) {
+					module[px * 4] = 0;
+					module[px * 4 + 1] = 0;
+					module[px * 4 + 2] = 0;
+				}
+			}
+		}
+
+		// The rest of the module's rows repeat its first
+		for (row = 1; row < module_size; ++row) {
+			memcpy(scanline + row * stride, scanline, 4 * image_width);
+		}
+	}
+
+	QRcode_free(qr);
+
+	texture_2d *tex = texture_manager_new_texture_from_data(texture_manager_get(), tex_width, tex_width, pixels);
+	free(pixels);
+	if (!tex) {
+		return 0;
+	}
+
+	// Modules stay crisp when the code is drawn scaled
+	gl_state_bind_texture(0, tex->name);
+	texture_2d_apply_sampler(&tex->sampler, GL_NEAREST, GL_NEAREST, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+
+	tex->originalWidth = image_width;
+	tex->originalHeight = image_width;
+	*width = image_width;
+	*height = image_width;
+	return tex->url;
+}
@@ -16,8 +16,10 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <math.h>
 #include "quirc_internal.h"
+#include "core/util/detect.h"
 
 /************************************************************************
  * Linear algebra routines
@@ -125,18 +127,35 @@ static void perspective_unmap(const double *c,
 
 typedef void (*span_func_t)(void *user_data, int y, int left, int right);
 
-static void flood_fill_seed(struct quirc *q, int x, int y, int from, int to,
-			    span_func_t func, void *user_data,
-			    int depth)
+/* A filled span whose neighbouring rows are still being seeded from. The
+ * stack visits spans in the same order as a recursive fill would, with
+ * the same depth limit, so regions come out the same.
+ */
+struct flood_fill_span {
+	int y;
+	int left;
+	int right;
+	int dir;	/* -1 seeding the row above, 1 the row below */
+	int next;	/* next column to seed from */
+};
+
+struct quirc_flood_fill_vars {
+	struct flood_fill_span	spans[FLOOD_FILL_MAX_DEPTH];
+};
+
+struct quirc_flood_fill_vars *quirc_flood_fill_vars_new(void)
+{
+	return malloc(sizeof(struct quirc_flood_fill_vars));
+}
+
+static void fill_span(struct quirc *q, struct flood_fill_span *span,
+		      int x, int y, int from, int to,
+		      span_func_t func, void *user_data)
 {
 	int left = x;
 	int right = x;
-	int i;
 	uint8_t *row = q->image + y * q->w;
 
-	if (depth >= FLOOD_FILL_MAX_DEPTH)
-		return;
-
 	while (left > 0 && row[left - 1] == from)
 		left--;
 
@@ -144,29 +163,62 @@ static void flood_fill_seed(struct quirc *q, int x, int y, int from, int to,
 		right++;
 
 	/* Fill the extent */
-	for (i = left; i <= right; i++)
-		row[i] = to;
+	memset(row + left, to, right - left + 1);
 
 	if (func)
 		func(user_data, y, left, right);
 
-	/* Seed new flood-fills */
-	if (y > 0) {
-		row = q->image + (y - 1) * q->w;
+	span->y = y;
+	span->left = left;
+	span->right = right;
+	span->dir = -1;
+	span->next = left;
+}
 
-		for (i = left; i <= right; i++)
-			if (row[i] == from)
-				flood_fill_seed(q, i, y - 1, from, to,
-						func, user_data, depth + 1);
-	}
+static void flood_fill_seed(struct quirc *q, int x, int y, int from, int to,
+			    span_func_t func, void *user_data,
+			    int depth)
+{
+	struct flood_fill_span *spans = q->flood_fill_vars->spans;
+	int top = depth;
 
-	if (y < q->h - 1) {
-		row = q->image + (y + 1) * q->w;
+	if (depth >= FLOOD_FILL_MAX_DEPTH)
+		return;
+
+	fill_span(q, &spans[top], x, y, from, to, func, user_data);
+
+	while (top >= depth) {
+		struct flood_fill_span *span = &spans[top];
+		int ny = span->y + span->dir;
+		const uint8_t *row;
+		int i;
+
+		/* Seed new flood-fills */
+		if (ny < 0 || ny >= q->h) {
+			i = span->right + 1;
+		} else {
+			row = q->image + ny * q->w;
+			for (i = span->next; i <= span->right; i++)
+				if (row[i] == from)
+					break;
+		}
+
+		if (i > span->right) {
+			if (span->dir < 0) {
+				span->dir = 1;
+				span->next = span->left;
+			} else {
+				top--;
+			}
+			continue;
+		}
 
-		for (i = left; i <= right; i++)
-			if (row[i] == from)
-				flood_fill_seed(q, i, y + 1, from, to,
-						func, user_data, depth + 1);
+		span->next = i + 1;
+		if (top + 1 < FLOOD_FILL_MAX_DEPTH) {
+			top++;
+			fill_span(q, &spans[top], i, ny, from, to,
+				  func, user_data);
+		}
 	}
 }
 
@@ -177,18 +229,149 @@ static void flood_fill_seed(struct quirc *q, int x, int y, int from, int to,
 #define THRESHOLD_S_DEN		8
 #define THRESHOLD_T		5
 
+/* floor(n / d) for 0 <= n < 2^31 as a multiply and a shift, with the
+ * multiplier rounded up so the result is exact (Granlund & Montgomery)
+ */
+struct divisor {
+	uint64_t	mul;
+	int		shift;
+};
+
+static void divisor_init(struct divisor *div, uint32_t d)
+{
+	int l = 0;
+
+	while (((uint64_t)1 << l) < d)
+		l++;
+
+	div->shift = 31 + l;
+	div->mul = (((uint64_t)1 << div->shift) + d - 1) / d;
+}
+
+static inline int divide(const struct divisor *div, int n)
+{
+	return (int)(((uint64_t)n * div->mul) >> div->shift);
+}
+
+/* SIMD kernel for the end of each row. A pixel is black when
+ * p < average * (100 - T) / d, which for whole numbers is the same as
+ * (p + 1) * d <= average * (100 - T), so no division is needed. It returns
+ * how many pixels it classified.
+ */
+
+#if defined(GC_HAS_NEON)
+#include <arm_neon.h>
+
+static int threshold_row_simd(uint8_t *row, const int *average, int w, int d)
+{
+	int x = 0;
+
+	for (; x + 16 <= w; x += 16) {
+		uint8x16_t p = vld1q_u8(row + x);
+		uint16x8_t lo = vaddq_u16(vmovl_u8(vget_low_u8(p)), vdupq_n_u16(1));
+		uint16x8_t hi = vaddq_u16(vmovl_u8(vget_high_u8(p)), vdupq_n_u16(1));
+		uint32x4_t black[4];
+		int i;
+
+		uint32x4_t px[4] = {
+			vmovl_u16(vget_low_u16(lo)), vmovl_u16(vget_high_u16(lo)),
+			vmovl_u16(vget_low_u16(hi)), vmovl_u16(vget_high_u16(hi))
+		};
+
+		for (i = 0; i < 4; i++) {
+			uint32x4_t avg = vreinterpretq_u32_s32(vld1q_s32(average + x + i * 4));
+			black[i] = vcleq_u32(vmulq_n_u32(px[i], d),
+					     vmulq_n_u32(avg, 100 - THRESHOLD_T));
+		}
+
+		uint8x16_t mask = vcombine_u8(
+			vmovn_u16(vcombine_u16(vmovn_u32(black[0]), vmovn_u32(black[1]))),
+			vmovn_u16(vcombine_u16(vmovn_u32(black[2]), vmovn_u32(black[3]))));
+		vst1q_u8(row + x, vandq_u8(mask, vdupq_n_u8(QUIRC_PIXEL_BLACK)));
+	}
+
+	return x;
+}
+
+#elif defined(GC_HAS_SSE)
+#include <emmintrin.h>
+
+/* 32 bit multiply, SSE2 only multiplies the even lanes */
+static inline __m128i mullo_epi32(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)),
+				  _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+/* All ones in the lanes whose pixel is white */
+static inline __m128i threshold_white(__m128i px, const int *average, __m128i d)
+{
+	__m128i avg = _mm_loadu_si128((const __m128i *)average);
+	__m128i scaled = _mm_sub_epi32(_mm_add_epi32(_mm_slli_epi32(avg, 6),
+						     _mm_slli_epi32(avg, 5)), avg);
+
+	return _mm_cmpgt_epi32(mullo_epi32(px, d), scaled);
+}
+
+static int threshold_row_simd(uint8_t *row, const int *average, int w, int d)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i dv = _mm_set1_epi32(d);
+	const __m128i black = _mm_set1_epi8(QUIRC_PIXEL_BLACK);
+	int x = 0;
+
+	/* average * 95 is formed from shifts */
+	if (100 - THRESHOLD_T != 95)
+		return 0;
+
+	for (; x + 16 <= w; x += 16) {
+		__m128i p = _mm_loadu_si128((const __m128i *)(row + x));
+		__m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(p, zero), one);
+		__m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(p, zero), one);
+
+		__m128i w0 = threshold_white(_mm_unpacklo_epi16(lo, zero), average + x, dv);
+		__m128i w1 = threshold_white(_mm_unpackhi_epi16(lo, zero), average + x + 4, dv);
+		__m128i w2 = threshold_white(_mm_unpacklo_epi16(hi, zero), average + x + 8, dv);
+		__m128i w3 = threshold_white(_mm_unpackhi_epi16(hi, zero), average + x + 12, dv);
+
+		__m128i white = _mm_packs_epi16(_mm_packs_epi32(w0, w1),
+						_mm_packs_epi32(w2, w3));
+		_mm_storeu_si128((__m128i *)(row + x), _mm_andnot_si128(white, black));
+	}
+
+	return x;
+}
+
+#else
+
+static int threshold_row_simd(uint8_t *row, const int *average, int w, int d)
+{
+	return 0;
+}
+
+#endif
+
 static void threshold(struct quirc *q)
 {
 	int x, y;
 	int avg_w = 0;
 	int avg_u = 0;
 	int threshold_s = q->w / THRESHOLD_S_DEN;
+	int *row_average = q->row_average;
 	uint8_t *row = q->image;
+	struct divisor div;
 
-	for (y = 0; y < q->h; y++) {
-		int row_average[q->w];
+	if (threshold_s < 1)
+		threshold_s = 1;
 
-		memset(row_average, 0, sizeof(row_average));
+	divisor_init(&div, threshold_s);
+
+	for (y = 0; y < q->h; y++) {
+		memset(row_average, 0, q->w * sizeof(int));
 
 		for (x = 0; x < q->w; x++) {
 			int w, u;
@@ -201,16 +384,15 @@ static void threshold(struct quirc *q)
 				u = x;
 			}
 
-			avg_w = (avg_w * (threshold_s - 1)) /
-				threshold_s + row[w];
-			avg_u = (avg_u * (threshold_s - 1)) /
-				threshold_s + row[u];
+			avg_w = divide(&div, avg_w * (threshold_s - 1)) + row[w];
+			avg_u = divide(&div, avg_u * (threshold_s - 1)) + row[u];
 
 			row_average[w] += avg_w;
 			row_average[u] += avg_u;
 		}
 
-		for (x = 0; x < q->w; x++) {
+		x = threshold_row_simd(row, row_average, q->w, 200 * threshold_s);
+		for (; x < q->w; x++) {
 			if (row[x] < row_average[x] *
 			    (100 - THRESHOLD_T) / (200 * threshold_s))
 				row[x] = QUIRC_PIXEL_BLACK;
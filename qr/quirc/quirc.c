@@ -39,17 +39,33 @@ void quirc_destroy(struct quirc *q)
 	if (q->image)
 		free(q->image);
 
+	free(q->row_average);
+	free(q->flood_fill_vars);
 	free(q);
 }
 
 int quirc_resize(struct quirc *q, int w, int h)
 {
 	uint8_t *new_image = realloc(q->image, w * h);
+	int *new_row_average;
 
 	if (!new_image)
 		return -1;
 
 	q->image = new_image;
+
+	new_row_average = realloc(q->row_average, w * sizeof(int));
+	if (!new_row_average)
+		return -1;
+
+	q->row_average = new_row_average;
+
+	if (!q->flood_fill_vars) {
+		q->flood_fill_vars = quirc_flood_fill_vars_new();
+		if (!q->flood_fill_vars)
+			return -1;
+	}
+
 	q->w = w;
 	q->h = h;
 
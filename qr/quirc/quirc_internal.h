@@ -64,11 +64,17 @@ struct quirc_grid {
 	double			c[QUIRC_PERSPECTIVE_PARAMS];
 };
 
+struct quirc_flood_fill_vars;
+
 struct quirc {
 	uint8_t			*image;
 	int			w;
 	int			h;
 
+	/* Scratch space for identification, sized by quirc_resize */
+	int			*row_average;
+	struct quirc_flood_fill_vars	*flood_fill_vars;
+
 	int			num_regions;
 	struct quirc_region	regions[QUIRC_MAX_REGIONS];
 
@@ -79,6 +85,9 @@ struct quirc {
 	struct quirc_grid	grids[QUIRC_MAX_GRIDS];
 };
 
+/* Allocates the flood fill's span stack, free it with free() */
+struct quirc_flood_fill_vars *quirc_flood_fill_vars_new(void);
+
 /************************************************************************
  * QR-code version information database
  */
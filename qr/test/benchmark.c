@@ -0,0 +1,131 @@
+/* Times quirc over a corpus of captured frames and prints what it found.
+ *
+ * Frames are binary PGM (P5) luminance images. For each one the output has
+ * a hash of quirc's working image after identification, then every code
+ * with its corners and payload or decode error, so the output of two builds
+ * can be diffed to check that an optimization changes nothing.
+ *
+ *   benchmark [-n repeats] frame.pgm...
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../quirc/quirc.h"
+
+static double now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static uint8_t *load_pgm(const char *path, int *w, int *h)
+{
+	FILE *f = fopen(path, "rb");
+	uint8_t *pixels = NULL;
+	int max;
+
+	if (!f)
+		return NULL;
+
+	if (fscanf(f, "P5 %d %d %d", w, h, &max) == 3 && max == 255 &&
+	    *w > 0 && *h > 0) {
+		fgetc(f);
+		pixels = malloc(*w * *h);
+		if (pixels && fread(pixels, 1, *w * *h, f) != (size_t)(*w * *h)) {
+			free(pixels);
+			pixels = NULL;
+		}
+	}
+
+	fclose(f);
+	return pixels;
+}
+
+static uint32_t hash_image(const uint8_t *image, int size)
+{
+	uint32_t hash = 2166136261u;
+	int i;
+
+	for (i = 0; i < size; i++)
+		hash = (hash ^ image[i]) * 16777619u;
+
+	return hash;
+}
+
+int main(int argc, char **argv)
+{
+	struct quirc *q = quirc_new();
+	double total = 0;
+	int repeats = 10;
+	int frames = 0;
+	int arg = 1;
+
+	if (arg + 1 < argc && !strcmp(argv[arg], "-n")) {
+		repeats = atoi(argv[arg + 1]);
+		arg += 2;
+	}
+
+	if (!q || arg >= argc || repeats < 1) {
+		fprintf(stderr, "usage: %s [-n repeats] frame.pgm...\n", argv[0]);
+		return 1;
+	}
+
+	for (; arg < argc; arg++) {
+		uint8_t *pixels, *image = NULL;
+		int w, h, r, i;
+		double start;
+
+		pixels = load_pgm(argv[arg], &w, &h);
+		if (!pixels || quirc_resize(q, w, h) < 0) {
+			fprintf(stderr, "%s: unable to load\n", argv[arg]);
+			free(pixels);
+			continue;
+		}
+
+		start = now_ms();
+		for (r = 0; r < repeats; r++) {
+			image = quirc_begin(q, NULL, NULL);
+			memcpy(image, pixels, w * h);
+			quirc_end(q);
+		}
+		total += now_ms() - start;
+		frames++;
+
+		printf("%s %dx%d image %08x codes %d\n", argv[arg], w, h,
+		       hash_image(image, w * h), quirc_count(q));
+
+		for (i = 0; i < quirc_count(q); i++) {
+			struct quirc_code code;
+			struct quirc_data data;
+			quirc_decode_error_t err;
+
+			quirc_extract(q, i, &code);
+			printf("  corners %d,%d %d,%d %d,%d %d,%d ",
+			       code.corners[0].x, code.corners[0].y,
+			       code.corners[1].x, code.corners[1].y,
+			       code.corners[2].x, code.corners[2].y,
+			       code.corners[3].x, code.corners[3].y);
+
+			err = quirc_decode(&code, &data);
+			if (err)
+				printf("error %s\n", quirc_strerror(err));
+			else
+				printf("payload %.*s\n", data.payload_len, data.payload);
+		}
+
+		free(pixels);
+	}
+
+	if (frames)
+		fprintf(stderr, "%d frames, %.3f ms per frame\n", frames,
+			total / (frames * repeats));
+
+	quirc_destroy(q);
+	return 0;
+}
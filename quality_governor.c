@@ -0,0 +1,225 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 quality_governor.c
+ * @brief	trades quality for frame time as the device slows down or heats up
+ */
+#include "core/quality_governor.h"
+#include "core/core.h"
+#include "core/device_profile.h"
+#include "core/tealeaf_canvas.h"
+#include "core/texture_manager.h"
+#include "core/log.h"
+#include "core/timestep/timestep_easing.h"
+#include "core/timestep/timestep_particles.h"
+
+// weight of each frame in the rolling average
+#define AVERAGE_WEIGHT (1.0 / 30)
+// longer frames are pauses or loads, not drawing
+#define MAX_FRAME_MS 250
+// the average must stay past these shares of the budget for the frame counts
+#define OVER_BUDGET 1.1
+#define UNDER_BUDGET 0.75
+#define STEP_DOWN_FRAMES 60
+#define STEP_UP_FRAMES 300
+#define STEP_UP_FRAMES_MAX 4800
+// frames after a change before the next one is considered
+#define SETTLE_FRAMES 90
+// a step up undone sooner than this doubles the wait for the next one, one
+// that lasts halves it again
+#define REVERT_WINDOW_FRAMES 600
+
+typedef struct quality_tier_t {
+    float min_scale; // dynamic resolution floor
+    bool halfsize;
+    float particles; // share of each emitter's capacity
+    unsigned int easing; // EASING_DEFAULT keeps the mode set before enabling
+    unsigned int lut_resolution;
+} quality_tier;
+
+static const quality_tier m_tiers[] = {
+    {1.0f, false, 1.0f, EASING_DEFAULT, 0},
+    {0.85f, false, 1.0f, EASING_FLOAT, 0},
+    {0.7f, false, 0.6f, EASING_LUT, 256},
+    {0.5f, true, 0.35f, EASING_LUT, 64}
+};
+#define TIER_COUNT ((int) (sizeof(m_tiers) / sizeof(m_tiers[0])))
+
+static double m_budget = 0;
+static int m_tier = 0;
+static int m_thermal = QUALITY_THERMAL_NOMINAL;
+static double m_average = 0;
+static int m_over_frames = 0;
+static int m_under_frames = 0;
+static int m_settle_frames = 0;
+static int m_step_up_frames = STEP_UP_FRAMES;
+// frames since the last step up, -1 once it has lasted the revert window
+static int m_since_step_up = -1;
+// what the game had before the governor took over
+static bool m_base_halfsize = false;
+static unsigned int m_base_easing = EASING_EXACT;
+static unsigned int m_base_lut_resolution = 0;
+
+/**
+ * @name	apply_tier
+ * @brief	sets every knob for the given tier
+ * @param	tier - (int) tier to apply
+ * @param	from - (int) tier applied before, or -1 to set everything
+ * @retval	NONE
+ */
+static void apply_tier(int tier, int from) {
+    const quality_tier *t = &m_tiers[tier];
+    LOG("{quality} Tier %d, average frame %.1fms", tier, m_average);
+
+    tealeaf_canvas_set_dynamic_resolution(t->min_scale, m_budget);
+    timestep_particles_set_quality(t->particles);
+    if (t->easing == EASING_DEFAULT) {
+        view_animation_set_default_easing(m_base_easing, m_base_lut_resolution);
+    } else {
+        view_animation_set_default_easing(t->easing, t->lut_resolution);
+    }
+
+    // switching reloads every texture, so only when this tier changes it
+    if (from < 0 || m_tiers[from].halfsize != t->halfsize) {
+        texture_manager_set_use_halfsized_textures(t->halfsize || m_base_halfsize);
+    }
+
+    m_tier = tier;
+    m_over_frames = 0;
+    m_under_frames = 0;
+    m_settle_frames = SETTLE_FRAMES;
+}
+
+/**
+ * @name	quality_governor_enable
+ * @brief	starts governing at the tier the device profile suggests, or
+ *			stops and puts tier 0 back
+ * @param	budget_ms - (double) frame time to keep to, 0 to turn off
+ * @retval	NONE
+ */
+void quality_governor_enable(double budget_ms) {
+    if (budget_ms <= 0) {
+        if (m_budget > 0) {
+            apply_tier(0, m_tier);
+            m_budget = 0;
+        }
+        return;
+    }
+
+    int from = -1;
+    if (m_budget > 0) {
+        from = m_tier;
+    } else {
+        m_base_halfsize = use_halfsized_textures;
+        m_base_easing = view_animation_get_default_easing(&m_base_lut_resolution);
+    }
+    m_budget = budget_ms;
+    m_average = budget_ms;
+    m_step_up_frames = STEP_UP_FRAMES;
+    m_since_step_up = -1;
+
+    int tier = 0;
+    const device_profile *profile = device_profile_get();
+    if (profile->flags & DEVICE_PROFILE_HAS_TIER) {
+        if (profile->fill_rate_tier == DEVICE_TIER_LOW) {
+            tier = 2;
+        } else if (profile->fill_rate_tier == DEVICE_TIER_MID) {
+            tier = 1;
+        }
+    }
+    int thermal = __atomic_load_n(&m_thermal, __ATOMIC_RELAXED);
+    apply_tier(tier > thermal ? tier : thermal, from);
+}
+
+/**
+ * @name	quality_governor_tick
+ * @brief	folds the frame into the rolling average and steps the tier when
+ *			it has stayed over or under budget long enough
+ * @param	frame_ms - (double) length of the last frame in milliseconds
+ * @retval	NONE
+ */
+void quality_governor_tick(double frame_ms) {
+    if (m_budget <= 0 || frame_ms <= 0 || frame_ms > MAX_FRAME_MS) {
+        return;
+    }
+
+    m_average += (frame_ms - m_average) * AVERAGE_WEIGHT;
+
+    if (m_since_step_up >= 0 && ++m_since_step_up >= REVERT_WINDOW_FRAMES) {
+        m_since_step_up = -1;
+        m_step_up_frames /= 2;
+        if (m_step_up_frames < STEP_UP_FRAMES) {
+            m_step_up_frames = STEP_UP_FRAMES;
+        }
+    }
+
+    int thermal = __atomic_load_n(&m_thermal, __ATOMIC_RELAXED);
+    int floor = thermal < TIER_COUNT ? thermal : TIER_COUNT - 1;
+    if (m_tier < floor) {
+        apply_tier(floor, m_tier);
+        return;
+    }
+
+    if (m_settle_frames > 0) {
+        m_settle_frames--;
+        return;
+    }
+
+    if (m_average > m_budget * OVER_BUDGET) {
+        m_under_frames = 0;
+        if (++m_over_frames >= STEP_DOWN_FRAMES && m_tier < TIER_COUNT - 1) {
+            if (m_since_step_up >= 0) {
+                // the last step up didn't hold
+                m_step_up_frames *= 2;
+                if (m_step_up_frames > STEP_UP_FRAMES_MAX) {
+                    m_step_up_frames = STEP_UP_FRAMES_MAX;
+                }
+                m_since_step_up = -1;
+            }
+            apply_tier(m_tier + 1, m_tier);
+        }
+    } else if (m_average < m_budget * UNDER_BUDGET) {
+        m_over_frames = 0;
+        if (++m_under_frames >= m_step_up_frames && m_tier > floor) {
+            apply_tier(m_tier - 1, m_tier);
+            m_since_step_up = 0;
+        }
+    } else {
+        m_over_frames = 0;
+        m_under_frames = 0;
+    }
+}
+
+/**
+ * @name	quality_governor_set_thermal_state
+ * @brief	sets the device's thermal state, applied on the next tick
+ * @param	state - (int) one of quality_thermal_states
+ * @retval	NONE
+ */
+void quality_governor_set_thermal_state(int state) {
+    state = state < QUALITY_THERMAL_NOMINAL ? QUALITY_THERMAL_NOMINAL :
+            state > QUALITY_THERMAL_CRITICAL ? QUALITY_THERMAL_CRITICAL : state;
+    __atomic_store_n(&m_thermal, state, __ATOMIC_RELAXED);
+}
+
+/**
+ * @name	quality_governor_get_tier
+ * @brief	gets the tier in use
+ * @retval	int - 0 for full quality, higher for less
+ */
+int quality_governor_get_tier() {
+    return m_tier;
+}
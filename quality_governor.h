@@ -0,0 +1,54 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef QUALITY_GOVERNOR_H
+#define QUALITY_GOVERNOR_H
+
+#include "core/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Steps through quality tiers from the rolling frame time and the device's
+// thermal state. Each tier lowers the dynamic resolution floor, particle
+// caps and easing precision further, and the last one half sizes textures.
+// Stepping down takes a short run of slow frames, stepping back up a long
+// run of fast ones, and a step up that is soon undone makes the next one
+// wait longer. Off until enabled. Main thread only, except
+// quality_governor_set_thermal_state.
+
+enum quality_thermal_states {
+	QUALITY_THERMAL_NOMINAL,
+	QUALITY_THERMAL_FAIR,
+	QUALITY_THERMAL_SERIOUS,
+	QUALITY_THERMAL_CRITICAL
+};
+
+// keeps frames under budget_ms, 0 turns the governor off and restores tier 0
+void quality_governor_enable(double budget_ms);
+// called by core_tick with the last frame's length
+void quality_governor_tick(double frame_ms);
+// from the platform's thermal notifications, any thread. A hotter state
+// keeps the governor at tier number state or past it
+void quality_governor_set_thermal_state(int state);
+// 0 is full quality
+int quality_governor_get_tier();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // QUALITY_GOVERNOR_H
@@ -218,48 +218,75 @@ bool rgba_equals(rgba *a, rgba *b) {
 }
 
 
+#define RGBA_CACHE_SIZE 64
+#define RGBA_CACHE_KEY_LEN 32
+
+typedef struct rgba_cache_entry_t {
+    char key[RGBA_CACHE_KEY_LEN];
+    rgba color;
+} rgba_cache_entry;
+
+// per thread so parsing never takes a lock; the same few color strings are
+// set over and over from JS, so a small direct mapped table catches them
+static __thread rgba_cache_entry t_cache[RGBA_CACHE_SIZE];
+
 /**
- * @name	rgba_parse
- * @brief	parses the given color string into the given rgba object
+ * @name	hex_digit
+ * @brief	converts one hex character to its value without a lookup
+ * @param	c - (char) character to convert
+ * @retval	int - 0 to 15, or -1 if c is not a hex digit
+ */
+static inline int hex_digit(char c) {
+    unsigned int d = (unsigned int)c - '0';
+    unsigned int h = ((unsigned int)c | 0x20) - 'a';
+    return d < 10 ? (int)d : (h < 6 ? (int)h + 10 : -1);
+}
+
+/**
+ * @name	hex_pair
+ * @brief	reads two hex characters the way strtol would on a two character
+ *			buffer, stopping at the first invalid one
+ * @param	hi - (char) first character
+ * @param	lo - (char) second character
+ * @retval	int - parsed value
+ */
+static inline int hex_pair(char hi, char lo) {
+    int h = hex_digit(hi);
+    int l;
+
+    if (h < 0) {
+        return 0;
+    }
+
+    l = hex_digit(lo);
+    return l < 0 ? h : (h << 4) | l;
+}
+
+/**
+ * @name	parse_color
+ * @brief	parses the given color string of length n into the given rgba
  * @param	color - (rgba *) rgba object which will hold the parsed color string
  * @param	src - (const char *) color string to be parsed
- * @retval	NONE
+ * @param	n - (size_t) length of src
+ * @retval	bool - false if src was malformed and color was left untouched
  */
-void rgba_parse(rgba *color, const char *src) {
+static bool parse_color(rgba *color, const char *src, size_t n) {
     int r = 0, g = 0, b = 0;
     float a = 1;
-    size_t n = strlen(src);
 
     if (src[0] == '#') {
-        char buf[3];
-        buf[2] = '\0';
-
         if (n == 4) {
-            buf[0] = src[1];
-            buf[1] = src[1];
-            r = (int)strtol(buf, NULL, 16);
-            buf[0] = src[2];
-            buf[1] = src[2];
-            g = (int)strtol(buf, NULL, 16);
-            buf[0] = src[3];
-            buf[1] = src[3];
-            b = (int)strtol(buf, NULL, 16);
+            r = hex_pair(src[1], src[1]);
+            g = hex_pair(src[2], src[2]);
+            b = hex_pair(src[3], src[3]);
         } else if (n >= 7) {
-            buf[0] = src[1];
-            buf[1] = src[2];
-            r = (int)strtol(buf, NULL, 16);
-            buf[0] = src[3];
-            buf[1] = src[4];
-            g = (int)strtol(buf, NULL, 16);
-            buf[0] = src[5];
-            buf[1] = src[6];
-            b = (int)strtol(buf, NULL, 16);
+            r = hex_pair(src[1], src[2]);
+            g = hex_pair(src[3], src[4]);
+            b = hex_pair(src[5], src[6]);
         }
 
         if (n == 9) {
-            buf[0] = src[7];
-            buf[1] = src[8];
-            a = strtol(buf, NULL, 16) / 255.0;
+            a = hex_pair(src[7], src[8]) / 255.0;
         }
     } else if (src[0] == 'r' && src[1] == 'g' && src[2] == 'b') {
         bool has_alpha = (src[3] == 'a');
@@ -267,7 +294,7 @@ void rgba_parse(rgba *color, const char *src) {
 
         while (src[i++] != '(') {
             if (i == n) {
-                return;
+                return false;
             }
         }
 
@@ -275,7 +302,7 @@ void rgba_parse(rgba *color, const char *src) {
 
         while (src[i++] != ',') {
             if (i == n) {
-                return;
+                return false;
             }
         }
 
@@ -283,7 +310,7 @@ void rgba_parse(rgba *color, const char *src) {
 
         while (src[i++] != ',') {
             if (i == n) {
-                return;
+                return false;
             }
         }
 
@@ -292,7 +319,7 @@ void rgba_parse(rgba *color, const char *src) {
         if (has_alpha) {
             while (src[i++] != ',') {
                 if (i == n) {
-                    return;
+                    return false;
                 }
             }
 
@@ -300,7 +327,7 @@ void rgba_parse(rgba *color, const char *src) {
         }
     } else {
         html_color *c;
-        HASH_FIND_STR(defaults, src, c);
+        HASH_FIND(hh, defaults, src, n, c);
 
         if (c) {
             r = c->color.r;
@@ -348,6 +375,74 @@ void rgba_parse(rgba *color, const char *src) {
     color->g = g / 255.0;
     color->b = b / 255.0;
     color->a = a;
+    return true;
+}
+
+/**
+ * @name	rgba_parse
+ * @brief	parses the given color string into the given rgba object
+ * @param	color - (rgba *) rgba object which will hold the parsed color string
+ * @param	src - (const char *) color string to be parsed
+ * @retval	NONE
+ */
+void rgba_parse(rgba *color, const char *src) {
+    // FNV-1a over the string while finding its length
+    unsigned int hash = 2166136261u;
+    size_t n = 0;
+
+    for (; src[n]; n++) {
+        hash = (hash ^ (unsigned char)src[n]) * 16777619u;
+    }
+
+    if (n >= RGBA_CACHE_KEY_LEN) {
+        parse_color(color, src, n);
+        return;
+    }
+
+    rgba_cache_entry *entry = &t_cache[hash & (RGBA_CACHE_SIZE - 1)];
+
+    if (entry->key[0] && !memcmp(entry->key, src, n + 1)) {
+        *color = entry->color;
+        return;
+    }
+
+    if (parse_color(color, src, n)) {
+        memcpy(entry->key, src, n + 1);
+        entry->color = *color;
+    }
+}
+
+/**
+ * @name	rgba_from_packed
+ * @brief	unpacks a 0xRRGGBBAA color, skipping string parsing entirely
+ * @param	color - (rgba *) rgba object which will hold the color
+ * @param	packed - (uint32_t) packed color
+ * @retval	NONE
+ */
+void rgba_from_packed(rgba *color, uint32_t packed) {
+    color->r = (packed >> 24) / 255.0f;
+    color->g = ((packed >> 16) & 0xff) / 255.0f;
+    color->b = ((packed >> 8) & 0xff) / 255.0f;
+    color->a = (packed & 0xff) / 255.0f;
+}
+
+/**
+ * @name	rgba_to_packed
+ * @brief	packs the given color as 0xRRGGBBAA, rounding each channel
+ * @param	color - (const rgba *) color to pack
+ * @retval	uint32_t - packed color
+ */
+uint32_t rgba_to_packed(const rgba *color) {
+    float channels[4] = { color->r, color->g, color->b, color->a };
+    uint32_t packed = 0;
+
+    for (int i = 0; i < 4; i++) {
+        float c = channels[i];
+        c = c < 0 ? 0 : (c > 1 ? 1 : c);
+        packed = (packed << 8) | (uint32_t)(c * 255.0f + 0.5f);
+    }
+
+    return packed;
 }
 
 /**
@@ -23,6 +23,7 @@ extern "C" {
 #endif
 
 #include "core/types.h"
+#include <stdint.h>
 
 	typedef struct rgba_t {
 		float r, g, b, a;
@@ -30,6 +31,9 @@ extern "C" {
 
 	void rgba_init();
 	void rgba_parse(rgba *color, const char *src);
+	// packed colors are 0xRRGGBBAA
+	void rgba_from_packed(rgba *color, uint32_t packed);
+	uint32_t rgba_to_packed(const rgba *color);
 	void rgba_print(rgba *color);
 	bool rgba_equals(rgba *a, rgba *b);
 	// returns length of string
@@ -0,0 +1,424 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 sfx.c
+ * @brief	decoded sound effect cache and voice pool
+ */
+#include "core/sfx.h"
+#include "core/jobs.h"
+#include "core/log.h"
+#include "core/deps/uthash/uthash.h"
+#include "platform/sound_manager.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// a voice handle is its index in the low bits and its generation above, so
+// a stolen voice's old handle no longer matches
+#define VOICE_INDEX_BITS 8
+#define VOICE_INDEX_MASK ((1 << VOICE_INDEX_BITS) - 1)
+
+typedef enum sound_state_t {
+    SOUND_UNLOADED,
+    SOUND_DECODING,
+    SOUND_READY,
+    SOUND_FAILED
+} sound_state;
+
+typedef struct sound_entry_t {
+    char *url;
+    sound_state state;
+    sound_pcm pcm;
+    long bytes;
+    double last_played;
+    UT_hash_handle hh;
+} sound_entry;
+
+typedef struct voice_slot_t {
+    sfx_sound sound; // 0 when free
+    unsigned int generation;
+    int priority;
+    bool loop;
+    double started;
+    double ends; // ms, for sounds that do not loop
+} voice_slot;
+
+typedef struct decode_job_t {
+    sfx_sound sound;
+    char *url;
+    sound_pcm pcm;
+    bool decoded;
+} decode_job;
+
+static sound_entry *m_sounds = NULL; // indexed by handle - 1
+static int m_sound_count = 0;
+static int m_sound_capacity = 0;
+static sound_entry *m_sounds_by_url = NULL;
+static voice_slot m_voices[SFX_MAX_VOICES];
+static int m_voice_count = 0;
+static long m_budget = SFX_DEFAULT_BUDGET;
+static long m_decoded_bytes = 0;
+static bool m_initialized = false;
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static sound_entry *get_sound(sfx_sound handle) {
+    return handle > 0 && handle <= m_sound_count ? &m_sounds[handle - 1] : NULL;
+}
+
+static voice_slot *get_voice(sfx_voice handle) {
+    int index = handle & VOICE_INDEX_MASK;
+    if (handle <= 0 || index >= m_voice_count) {
+        return NULL;
+    }
+    voice_slot *v = &m_voices[index];
+    return v->sound && (unsigned int) (handle >> VOICE_INDEX_BITS) == v->generation ? v : NULL;
+}
+
+// a voice whose sound has run out is free without the platform saying so
+static bool voice_busy(voice_slot *v, double now) {
+    if (v->sound && !v->loop && now >= v->ends) {
+        v->sound = 0;
+    }
+    return v->sound != 0;
+}
+
+static bool sound_playing(sfx_sound handle, double now) {
+    int i;
+    for (i = 0; i < m_voice_count; i++) {
+        if (voice_busy(&m_voices[i], now) && m_voices[i].sound == handle) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void free_pcm(sound_entry *s) {
+    free(s->pcm.samples);
+    memset(&s->pcm, 0, sizeof(s->pcm));
+    m_decoded_bytes -= s->bytes;
+    s->bytes = 0;
+    s->state = SOUND_UNLOADED;
+}
+
+/**
+ * @name	free_until
+ * @brief	frees the least recently played sounds that are not playing
+ *			until the decoded audio fits in limit bytes
+ * @param	limit - (long) bytes of decoded audio to keep at most
+ * @param	keep - (sfx_sound) sound never to free, 0 for none
+ * @retval	NONE
+ */
+static void free_until(long limit, sfx_sound keep) {
+    double now = now_ms();
+    while (m_decoded_bytes > limit) {
+        sound_entry *oldest = NULL;
+        int i;
+        for (i = 0; i < m_sound_count; i++) {
+            sound_entry *s = &m_sounds[i];
+            if (s->state == SOUND_READY && i + 1 != keep && (!oldest || s->last_played < oldest->last_played)
+                    && !sound_playing(i + 1, now)) {
+                oldest = s;
+            }
+        }
+        if (!oldest) {
+            break;
+        }
+        free_pcm(oldest);
+    }
+}
+
+static void decode_sound(void *data) {
+    decode_job *job = (decode_job *) data;
+    job->decoded = sound_manager_decode_sound(job->url, &job->pcm);
+}
+
+static void finish_decode(void *data) {
+    decode_job *job = (decode_job *) data;
+    sound_entry *s = get_sound(job->sound);
+
+    // unloaded or shut down while decoding
+    if (!s || s->state != SOUND_DECODING) {
+        free(job->pcm.samples);
+    } else if (!job->decoded || !job->pcm.samples) {
+        LOG("{sfx} WARNING: Unable to decode %s", job->url);
+        free(job->pcm.samples);
+        s->state = SOUND_FAILED;
+    } else {
+        s->pcm = job->pcm;
+        s->bytes = (long) (job->pcm.frames * job->pcm.channels * sizeof(short));
+        s->state = SOUND_READY;
+        s->last_played = now_ms();
+        m_decoded_bytes += s->bytes;
+        free_until(m_budget, job->sound);
+    }
+    free(job->url);
+    free(job);
+}
+
+static void start_decode(sfx_sound handle) {
+    sound_entry *s = get_sound(handle);
+    decode_job *job = (decode_job *) calloc(1, sizeof(decode_job));
+    if (job) {
+        job->url = strdup(s->url);
+    }
+    if (!job || !job->url) {
+        free(job);
+        s->state = SOUND_FAILED;
+        return;
+    }
+    job->sound = handle;
+    s->state = SOUND_DECODING;
+    jobs_submit(decode_sound, finish_decode, job, JOB_PRIORITY_HIGH);
+}
+
+/**
+ * @name	sfx_init
+ * @brief	creates the voices
+ * @param	voice_count - (int) voices to create, 0 for the default
+ * @param	budget - (long) bytes of decoded audio to keep, 0 for the default
+ * @retval	NONE
+ */
+void sfx_init(int voice_count, long budget) {
+    if (m_initialized) {
+        return;
+    }
+    if (voice_count <= 0) {
+        voice_count = SFX_DEFAULT_VOICES;
+    } else if (voice_count > SFX_MAX_VOICES) {
+        voice_count = SFX_MAX_VOICES;
+    }
+    m_budget = budget > 0 ? budget : SFX_DEFAULT_BUDGET;
+    memset(m_voices, 0, sizeof(m_voices));
+    m_voice_count = sound_manager_create_voices(voice_count);
+    m_initialized = true;
+}
+
+/**
+ * @name	sfx_load
+ * @brief	looks up a sound by url, decoding it the first time
+ * @param	url - (const char *) sound file
+ * @retval	sfx_sound - handle to play it with, 0 on failure
+ */
+sfx_sound sfx_load(const char *url) {
+    sound_entry *s = NULL;
+    HASH_FIND_STR(m_sounds_by_url, url, s);
+    if (s) {
+        sfx_sound handle = (sfx_sound) (s - m_sounds) + 1;
+        if (s->state == SOUND_UNLOADED) {
+            start_decode(handle);
+        }
+        return handle;
+    }
+
+    if (m_sound_count == m_sound_capacity) {
+        int capacity = m_sound_capacity ? m_sound_capacity * 2 : 32;
+        sound_entry *grown = (sound_entry *) realloc(m_sounds, capacity * sizeof(sound_entry));
+        if (!grown) {
+            return 0;
+        }
+        // the url table points into the array, so it is rebuilt
+        HASH_CLEAR(hh, m_sounds_by_url);
+        m_sounds = grown;
+        m_sound_capacity = capacity;
+        int i;
+        for (i = 0; i < m_sound_count; i++) {
+            HASH_ADD_KEYPTR(hh, m_sounds_by_url, m_sounds[i].url, strlen(m_sounds[i].url), &m_sounds[i]);
+        }
+    }
+
+    s = &m_sounds[m_sound_count];
+    memset(s, 0, sizeof(sound_entry));
+    s->url = strdup(url);
+    if (!s->url) {
+        return 0;
+    }
+    m_sound_count++;
+    HASH_ADD_KEYPTR(hh, m_sounds_by_url, s->url, strlen(s->url), s);
+
+    sfx_sound handle = m_sound_count;
+    start_decode(handle);
+    return handle;
+}
+
+bool sfx_is_ready(sfx_sound sound) {
+    sound_entry *s = get_sound(sound);
+    return s && s->state == SOUND_READY;
+}
+
+/**
+ * @name	take_voice
+ * @brief	finds a free voice, or the one playing the lowest priority and
+ *			then oldest sound, if that is not above priority
+ * @param	priority - (int) priority of the sound that wants a voice
+ * @param	now - (double) ms
+ * @retval	int - voice index, -1 if there is none to take
+ */
+static int take_voice(int priority, double now) {
+    int victim = -1;
+    int i;
+    for (i = 0; i < m_voice_count; i++) {
+        voice_slot *v = &m_voices[i];
+        if (!voice_busy(v, now)) {
+            return i;
+        }
+        if (v->priority > priority) {
+            continue;
+        }
+        if (victim < 0 || v->priority < m_voices[victim].priority
+                || (v->priority == m_voices[victim].priority && v->started < m_voices[victim].started)) {
+            victim = i;
+        }
+    }
+    return victim;
+}
+
+/**
+ * @name	sfx_play
+ * @brief	plays a decoded sound on a free or stolen voice
+ * @param	sound - (sfx_sound) from sfx_load
+ * @param	volume - (float) 0 to 1
+ * @param	loop - (bool) play until stopped
+ * @param	priority - (int) higher priorities keep their voices
+ * @retval	sfx_voice - the voice, 0 if it did not play
+ */
+sfx_voice sfx_play(sfx_sound sound, float volume, bool loop, int priority) {
+    sound_entry *s = get_sound(sound);
+    if (!s) {
+        return 0;
+    }
+    if (s->state != SOUND_READY) {
+        // dropped by the budget, it plays again once decoded again
+        if (s->state == SOUND_UNLOADED) {
+            start_decode(sound);
+        }
+        return 0;
+    }
+
+    double now = now_ms();
+    int index = take_voice(priority, now);
+    if (index < 0) {
+        return 0;
+    }
+
+    voice_slot *v = &m_voices[index];
+    v->sound = sound;
+    v->generation = v->generation % 0x7fffff + 1;
+    v->priority = priority;
+    v->loop = loop;
+    v->started = now;
+    v->ends = now + (s->pcm.sample_rate > 0 ? s->pcm.frames * 1000.0 / s->pcm.sample_rate : 0);
+    s->last_played = now;
+    sound_manager_voice_play(index, &s->pcm, volume, loop);
+
+    return (sfx_voice) ((v->generation << VOICE_INDEX_BITS) | index);
+}
+
+void sfx_stop(sfx_voice voice) {
+    voice_slot *v = get_voice(voice);
+    if (v) {
+        v->sound = 0;
+        sound_manager_voice_stop(voice & VOICE_INDEX_MASK);
+    }
+}
+
+void sfx_set_volume(sfx_voice voice, float volume) {
+    voice_slot *v = get_voice(voice);
+    if (v) {
+        sound_manager_voice_set_volume(voice & VOICE_INDEX_MASK, volume);
+    }
+}
+
+/**
+ * @name	sfx_unload
+ * @brief	stops a sound and frees its decoded audio
+ * @param	sound - (sfx_sound) from sfx_load
+ * @retval	NONE
+ */
+void sfx_unload(sfx_sound sound) {
+    sound_entry *s = get_sound(sound);
+    if (!s) {
+        return;
+    }
+
+    int i;
+    for (i = 0; i < m_voice_count; i++) {
+        if (m_voices[i].sound == sound) {
+            m_voices[i].sound = 0;
+            sound_manager_voice_stop(i);
+        }
+    }
+    if (s->state == SOUND_READY) {
+        free_pcm(s);
+    } else {
+        // a decode in flight is dropped when it finishes
+        s->state = SOUND_UNLOADED;
+    }
+}
+
+/**
+ * @name	sfx_bytes
+ * @brief	gets how much decoded audio is kept
+ * @retval	long - bytes
+ */
+long sfx_bytes() {
+    return m_decoded_bytes;
+}
+
+/**
+ * @name	sfx_trim
+ * @brief	frees the least recently played sounds that are not playing,
+ *			they decode again the next time they are loaded
+ * @param	bytes - (long) bytes wanted
+ * @retval	long - bytes freed
+ */
+long sfx_trim(long bytes) {
+    long start = m_decoded_bytes;
+    free_until(start > bytes ? start - bytes : 0, 0);
+    return start - m_decoded_bytes;
+}
+
+/**
+ * @name	sfx_shutdown
+ * @brief	stops the voices and frees every sound, called after the job
+ *			workers are stopped
+ * @retval	NONE
+ */
+void sfx_shutdown() {
+    if (!m_initialized) {
+        return;
+    }
+
+    sound_manager_destroy_voices();
+    memset(m_voices, 0, sizeof(m_voices));
+    m_voice_count = 0;
+
+    HASH_CLEAR(hh, m_sounds_by_url);
+    int i;
+    for (i = 0; i < m_sound_count; i++) {
+        free(m_sounds[i].pcm.samples);
+        free(m_sounds[i].url);
+    }
+    free(m_sounds);
+    m_sounds = NULL;
+    m_sound_count = m_sound_capacity = 0;
+    m_decoded_bytes = 0;
+    m_initialized = false;
+}
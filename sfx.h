@@ -0,0 +1,63 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+ 
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+ 
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef SFX_H
+#define SFX_H
+
+#include "core/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Short sound effects played from decoded memory on a fixed set of platform
+// voices. Sounds are decoded once on a job worker and kept within a memory
+// budget, least recently played first out. When every voice is busy a new
+// sound takes the voice of the lowest priority, then oldest, sound.
+// Main thread only.
+
+#define SFX_MAX_VOICES 32
+#define SFX_DEFAULT_VOICES 16
+#define SFX_DEFAULT_BUDGET (8 * 1024 * 1024)
+
+// 0 is never a sound or a playing voice
+typedef int sfx_sound;
+typedef int sfx_voice;
+
+// voice_count 0 and budget 0 take the defaults
+void sfx_init(int voice_count, long budget);
+// starts decoding url if it is not already, the handle is valid until
+// sfx_shutdown and plays once decoding is done
+sfx_sound sfx_load(const char *url);
+bool sfx_is_ready(sfx_sound sound);
+// returns the voice, 0 if the sound is not decoded or lost every voice to
+// higher priority sounds
+sfx_voice sfx_play(sfx_sound sound, float volume, bool loop, int priority);
+// stopping a voice that was stolen or has finished does nothing
+void sfx_stop(sfx_voice voice);
+void sfx_set_volume(sfx_voice voice, float volume);
+// stops the sound's voices and frees its decoded audio, the handle stays
+void sfx_unload(sfx_sound sound);
+// decoded audio kept, and frees sounds that are not playing, least
+// recently played first, until bytes are freed, returning how many were
+long sfx_bytes();
+long sfx_trim(long bytes);
+void sfx_shutdown();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SFX_H
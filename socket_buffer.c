@@ -0,0 +1,291 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 socket_buffer.c
+ * @brief	batched binary sends and receives for the platform sockets
+ */
+#include "core/socket_buffer.h"
+#include "core/events.h"
+#include "core/log.h"
+#include "core/deps/uthash/uthash.h"
+#include "core/platform/socket.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// batched sends go out early once they fill a typical packet
+#define SOCKET_BATCH_BYTES 1400
+
+typedef struct socket_data_t {
+    int id;
+    unsigned char *bytes;
+    unsigned long size;
+    unsigned long capacity;
+    // received data only, the size of each piece as it arrived
+    unsigned long *lengths;
+    int chunk_count;
+    int chunk_capacity;
+    // a socketData event went out for what is here
+    bool announced;
+    UT_hash_handle hh;
+} socket_data;
+
+typedef struct socket_notice_t {
+    int id;
+    int chunk_count;
+    unsigned long size;
+} socket_notice;
+
+// main thread only
+static socket_data *m_sending = NULL;
+// filled by the platform's threads, guarded by m_received_lock
+static socket_data *m_received = NULL;
+static pthread_mutex_t m_received_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static socket_data *get_data(socket_data **table, int id) {
+    socket_data *data = NULL;
+    HASH_FIND_INT(*table, &id, data);
+    if (!data) {
+        data = (socket_data *) calloc(1, sizeof(socket_data));
+        if (data) {
+            data->id = id;
+            HASH_ADD_INT(*table, id, data);
+        }
+    }
+    return data;
+}
+
+static void free_data(socket_data **table, socket_data *data) {
+    HASH_DEL(*table, data);
+    free(data->bytes);
+    free(data->lengths);
+    free(data);
+}
+
+static bool append_bytes(socket_data *data, const void *bytes, unsigned long size) {
+    if (data->size + size > data->capacity) {
+        unsigned long capacity = data->capacity ? data->capacity : SOCKET_BATCH_BYTES;
+        while (data->size + size > capacity) {
+            capacity *= 2;
+        }
+        unsigned char *grown = (unsigned char *) realloc(data->bytes, capacity);
+        if (!grown) {
+            return false;
+        }
+        data->bytes = grown;
+        data->capacity = capacity;
+    }
+    memcpy(data->bytes + data->size, bytes, size);
+    data->size += size;
+    return true;
+}
+
+static void send_pending(socket_data *data) {
+    if (data->size > 0) {
+        socket_send_binary(data->id, data->bytes, data->size);
+        data->size = 0;
+    }
+}
+
+/**
+ * @name	socket_buffer_send
+ * @brief	sends bytes on a socket now, or with the rest of the tick's
+ * @param	id - (int) socket
+ * @param	data - (const void *) bytes to send
+ * @param	size - (unsigned long) number of bytes
+ * @param	batch - (bool) true to hold them until the end of the tick
+ * @retval	NONE
+ */
+void socket_buffer_send(int id, const void *data, unsigned long size, bool batch) {
+    socket_data *pending = NULL;
+    HASH_FIND_INT(m_sending, &id, pending);
+
+    if (!batch) {
+        // keeps the order the bytes were sent in
+        if (pending) {
+            send_pending(pending);
+        }
+        socket_send_binary(id, data, size);
+        return;
+    }
+
+    if (!pending) {
+        pending = get_data(&m_sending, id);
+    }
+    if (!pending || !append_bytes(pending, data, size)) {
+        LOG("{socket} WARNING: Unable to batch %lu bytes for socket %d", size, id);
+        if (pending) {
+            send_pending(pending);
+        }
+        socket_send_binary(id, data, size);
+        return;
+    }
+    if (pending->size >= SOCKET_BATCH_BYTES) {
+        send_pending(pending);
+    }
+}
+
+/**
+ * @name	socket_buffer_flush
+ * @brief	sends everything batched this tick
+ * @retval	NONE
+ */
+void socket_buffer_flush() {
+    socket_data *data, *tmp;
+    HASH_ITER(hh, m_sending, data, tmp) {
+        send_pending(data);
+    }
+}
+
+/**
+ * @name	socket_buffer_received
+ * @brief	holds received bytes for the next socketData event
+ * @param	id - (int) socket that read them
+ * @param	data - (const void *) bytes read
+ * @param	size - (unsigned long) number of bytes
+ * @retval	NONE
+ */
+void socket_buffer_received(int id, const void *data, unsigned long size) {
+    if (size == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&m_received_lock);
+    socket_data *received = get_data(&m_received, id);
+    bool ok = received != NULL;
+    if (ok && received->chunk_count == received->chunk_capacity) {
+        int capacity = received->chunk_capacity ? received->chunk_capacity * 2 : 16;
+        unsigned long *grown = (unsigned long *) realloc(received->lengths, capacity * sizeof(unsigned long));
+        if (grown) {
+            received->lengths = grown;
+            received->chunk_capacity = capacity;
+        } else {
+            ok = false;
+        }
+    }
+    if (ok && append_bytes(received, data, size)) {
+        received->lengths[received->chunk_count++] = size;
+    } else {
+        ok = false;
+    }
+    pthread_mutex_unlock(&m_received_lock);
+
+    if (!ok) {
+        LOG("{socket} WARNING: Dropped %lu bytes received on socket %d", size, id);
+    }
+}
+
+/**
+ * @name	socket_buffer_dispatch
+ * @brief	tells js which sockets have data waiting, once per arrival
+ * @retval	NONE
+ */
+void socket_buffer_dispatch() {
+    pthread_mutex_lock(&m_received_lock);
+    unsigned int count = HASH_COUNT(m_received);
+    socket_notice *notices = count ? (socket_notice *) malloc(count * sizeof(socket_notice)) : NULL;
+    unsigned int notice_count = 0;
+    socket_data *data, *tmp;
+    HASH_ITER(hh, m_received, data, tmp) {
+        if (notices && data->size > 0 && !data->announced) {
+            data->announced = true;
+            notices[notice_count].id = data->id;
+            notices[notice_count].chunk_count = data->chunk_count;
+            notices[notice_count].size = data->size;
+            notice_count++;
+        }
+    }
+    pthread_mutex_unlock(&m_received_lock);
+
+    char event_str[160];
+    unsigned int i;
+    for (i = 0; i < notice_count; i++) {
+        snprintf(event_str, sizeof(event_str),
+                 "{\"id\":%d,\"chunks\":%d,\"bytes\":%lu,\"name\":\"socketData\",\"priority\":0}",
+                 notices[i].id, notices[i].chunk_count, notices[i].size);
+        core_dispatch_event(event_str);
+    }
+    free(notices);
+}
+
+/**
+ * @name	socket_buffer_take_received
+ * @brief	hands over the bytes a socket received, for js to wrap without
+ *			copying
+ * @param	id - (int) socket
+ * @param	size - (unsigned long *) out, number of bytes
+ * @param	lengths - (unsigned long **) out, size of each piece, may be NULL
+ * @param	chunk_count - (int *) out, number of pieces, may be NULL
+ * @retval	unsigned char* - the bytes, NULL if there were none
+ */
+unsigned char *socket_buffer_take_received(int id, unsigned long *size,
+                                           unsigned long **lengths, int *chunk_count) {
+    unsigned char *bytes = NULL;
+    *size = 0;
+    if (lengths) {
+        *lengths = NULL;
+    }
+    if (chunk_count) {
+        *chunk_count = 0;
+    }
+
+    pthread_mutex_lock(&m_received_lock);
+    socket_data *received = NULL;
+    HASH_FIND_INT(m_received, &id, received);
+    if (received && received->size > 0) {
+        bytes = received->bytes;
+        *size = received->size;
+        if (lengths) {
+            *lengths = received->lengths;
+            received->lengths = NULL;
+            received->chunk_capacity = 0;
+        }
+        if (chunk_count) {
+            *chunk_count = received->chunk_count;
+        }
+        received->bytes = NULL;
+        received->size = received->capacity = 0;
+        received->chunk_count = 0;
+        received->announced = false;
+    }
+    pthread_mutex_unlock(&m_received_lock);
+    return bytes;
+}
+
+/**
+ * @name	socket_buffer_close
+ * @brief	forgets what a socket has buffered either way and closes it
+ * @param	id - (int) socket
+ * @retval	NONE
+ */
+void socket_buffer_close(int id) {
+    socket_data *data = NULL;
+    HASH_FIND_INT(m_sending, &id, data);
+    if (data) {
+        free_data(&m_sending, data);
+    }
+
+    pthread_mutex_lock(&m_received_lock);
+    data = NULL;
+    HASH_FIND_INT(m_received, &id, data);
+    if (data) {
+        free_data(&m_received, data);
+    }
+    pthread_mutex_unlock(&m_received_lock);
+
+    socket_close(id);
+}
@@ -0,0 +1,51 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+ 
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+ 
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef SOCKET_BUFFER_H
+#define SOCKET_BUFFER_H
+
+#include "core/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Binary traffic for the platform sockets. Batched sends are held until the
+// end of the tick, or until a packet's worth is waiting, and go out as one
+// write. Received bytes are held until core_tick and announced with one
+// socketData event per socket, js then takes them all in a single buffer.
+
+// sends data on socket id. Unbatched sends are not copied, so they can
+// come straight from a js ArrayBuffer
+void socket_buffer_send(int id, const void *data, unsigned long size, bool batch);
+// called by core_tick, sends the batched data
+void socket_buffer_flush();
+// called by the platform, from any thread, with bytes read from socket id
+void socket_buffer_received(int id, const void *data, unsigned long size);
+// called by core_tick, dispatches socketData for the sockets that received
+void socket_buffer_dispatch();
+// hands over what socket id received since the last take, the caller frees
+// it. lengths, if not NULL, is set to a buffer the caller frees that holds
+// the size of each piece as it arrived, chunk_count of them
+unsigned char *socket_buffer_take_received(int id, unsigned long *size,
+                                           unsigned long **lengths, int *chunk_count);
+// drops what is buffered for the socket and closes it
+void socket_buffer_close(int id);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SOCKET_BUFFER_H
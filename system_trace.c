@@ -0,0 +1,154 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 system_trace.c
+ * @brief	forwards markers to ATrace or os_signpost
+ */
+#include "core/system_trace.h"
+#include "core/log.h"
+#include <pthread.h>
+
+#if defined(ANDROID)
+
+#include <dlfcn.h>
+#include <stdint.h>
+
+// looked up at run time, so the engine still loads on releases before
+// ATrace was in the ndk, and before counters were
+typedef void (*atrace_begin_section)(const char *name);
+typedef void (*atrace_end_section)(void);
+typedef void (*atrace_set_counter)(const char *name, int64_t value);
+typedef bool (*atrace_is_enabled)(void);
+
+static pthread_once_t m_once = PTHREAD_ONCE_INIT;
+static atrace_begin_section m_begin = NULL;
+static atrace_end_section m_end = NULL;
+static atrace_set_counter m_counter = NULL;
+static atrace_is_enabled m_enabled = NULL;
+
+static void load_atrace() {
+    void *lib = dlopen("libandroid.so", RTLD_NOW | RTLD_LOCAL);
+    if (!lib) {
+        LOG("{trace} WARNING: Unable to load libandroid for ATrace");
+        return;
+    }
+    m_begin = (atrace_begin_section) dlsym(lib, "ATrace_beginSection");
+    m_end = (atrace_end_section) dlsym(lib, "ATrace_endSection");
+    m_counter = (atrace_set_counter) dlsym(lib, "ATrace_setCounter");
+    m_enabled = (atrace_is_enabled) dlsym(lib, "ATrace_isEnabled");
+    if (!m_begin || !m_end) {
+        m_begin = NULL;
+        m_end = NULL;
+    }
+}
+
+unsigned long long system_trace_begin(const char *name) {
+    pthread_once(&m_once, load_atrace);
+    if (!m_begin) {
+        return 0;
+    }
+    // sections nest per thread, so the end needs no id
+    m_begin(name);
+    return 1;
+}
+
+void system_trace_end(unsigned long long id) {
+    if (id) {
+        m_end();
+    }
+}
+
+void system_trace_counter(const char *name, long long value) {
+    pthread_once(&m_once, load_atrace);
+    if (m_counter) {
+        m_counter(name, value);
+    }
+}
+
+bool system_trace_capturing() {
+    pthread_once(&m_once, load_atrace);
+    return m_enabled && m_enabled();
+}
+
+#elif defined(__APPLE__)
+
+#include <os/signpost.h>
+
+static pthread_once_t m_once = PTHREAD_ONCE_INIT;
+static os_log_t m_log = NULL;
+
+static void make_log() {
+    if (__builtin_available(iOS 12.0, macOS 10.14, tvOS 12.0, *)) {
+        m_log = os_log_create("tealeaf", "zones");
+    }
+}
+
+unsigned long long system_trace_begin(const char *name) {
+    pthread_once(&m_once, make_log);
+    if (__builtin_available(iOS 12.0, macOS 10.14, tvOS 12.0, *)) {
+        if (m_log && os_signpost_enabled(m_log)) {
+            // an id per section, as sections on different threads overlap
+            os_signpost_id_t id = os_signpost_id_generate(m_log);
+            os_signpost_interval_begin(m_log, id, "zone", "%{public}s", name);
+            return id;
+        }
+    }
+    return 0;
+}
+
+void system_trace_end(unsigned long long id) {
+    if (!id) {
+        return;
+    }
+    if (__builtin_available(iOS 12.0, macOS 10.14, tvOS 12.0, *)) {
+        os_signpost_interval_end(m_log, (os_signpost_id_t) id, "zone");
+    }
+}
+
+void system_trace_counter(const char *name, long long value) {
+    pthread_once(&m_once, make_log);
+    if (__builtin_available(iOS 12.0, macOS 10.14, tvOS 12.0, *)) {
+        if (m_log && os_signpost_enabled(m_log)) {
+            os_signpost_event_emit(m_log, OS_SIGNPOST_ID_EXCLUSIVE, "counter", "%{public}s %lld", name, value);
+        }
+    }
+}
+
+bool system_trace_capturing() {
+    pthread_once(&m_once, make_log);
+    if (__builtin_available(iOS 12.0, macOS 10.14, tvOS 12.0, *)) {
+        return m_log && os_signpost_enabled(m_log);
+    }
+    return false;
+}
+
+#else
+
+unsigned long long system_trace_begin(const char *name) {
+    return 0;
+}
+
+void system_trace_end(unsigned long long id) {
+}
+
+void system_trace_counter(const char *name, long long value) {
+}
+
+bool system_trace_capturing() {
+    return false;
+}
+
+#endif
@@ -0,0 +1,42 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef SYSTEM_TRACE_H
+#define SYSTEM_TRACE_H
+
+#include "core/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Markers for the platform's system tracer, so native work lines up with
+// the gpu, driver and scheduler in its tools: ATrace, seen by systrace and
+// Perfetto, on Android and os_signpost, seen by Instruments, on Apple
+// platforms. Elsewhere, or on releases without them, markers do nothing.
+// Used by the profiler, see profiler_set_system_trace. Any thread.
+
+// returns the id to end the section with, 0 if none began
+unsigned long long system_trace_begin(const char *name);
+void system_trace_end(unsigned long long id);
+void system_trace_counter(const char *name, long long value);
+// true while a tool is capturing, false if it can't be told
+bool system_trace_capturing();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SYSTEM_TRACE_H
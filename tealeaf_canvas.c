@@ -23,12 +23,52 @@
 #include "core/texture_manager.h"
 #include "core/tealeaf_context.h"
 #include "core/draw_textures.h"
+#include "core/gl_state.h"
+#include "core/gpu_timing.h"
 #include "core/config.h"
+#include "core/core.h"
 #include "core/log.h"
 #include "geometry.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 static tealeaf_canvas canvas;
 
+// dynamic resolution scales move in steps, and only after frames have
+// settled at the current one
+#define RESOLUTION_STEP 0.125f
+#define RESOLUTION_SETTLE_FRAMES 30
+// frames on budget before trying the next step up, doubled each time a step
+// up has to be undone
+#define RESOLUTION_MIN_PROBE_FRAMES 120
+#define RESOLUTION_MAX_PROBE_FRAMES 1920
+#define RESOLUTION_FRAME_SMOOTHING 0.1
+
+static float m_min_scale = 1;
+static double m_frame_budget = 1000.0 / 60;
+static float m_scene_scale = 1;
+static double m_frame_avg = 0;
+static int m_frames_at_scale = 0;
+static int m_probe_frames = RESOLUTION_MIN_PROBE_FRAMES;
+static bool m_probing = false;
+static char *m_scene_url = NULL;
+static bool m_scene_pending = false;
+
+// the offscreen framebuffer shares one stencil buffer between the textures
+// attached to it, sized to the last that needed it. Gl wants every
+// attachment the same size, so a texture of another size detaches it
+static GLuint m_stencil_buffer = 0;
+static int m_stencil_width = 0;
+static int m_stencil_height = 0;
+static bool m_stencil_attached = false;
+// backing size of the texture the bound framebuffer draws into, 0 for the
+// view framebuffer
+static int m_target_width = 0;
+static int m_target_height = 0;
+// of the view framebuffer, -1 until asked
+static int m_view_stencil_bits = -1;
+
 /**
  * @name	tealeaf_canvas_get
  * @brief
@@ -53,49 +93,139 @@ void tealeaf_canvas_init(int framebuffer_name) {
     GLTRACE(glGenFramebuffers(1, &offscreen_buffer_name));
     canvas.offscreen_framebuffer = offscreen_buffer_name;
     canvas.view_framebuffer = framebuffer_name;
+    m_stencil_buffer = 0;
+    m_stencil_width = m_stencil_height = 0;
+    m_stencil_attached = false;
+    m_view_stencil_bits = -1;
     canvas.onscreen_ctx = context_2d_init(&canvas, "onscreen", -1, true);
     canvas.onscreen_ctx->width = width;
     canvas.onscreen_ctx->height = height;
     canvas.active_ctx = 0;
+    canvas.render_scale = 1;
 
     // TODO: should_resize is not respected on iOS
 
     tealeaf_canvas_context_2d_bind(canvas.onscreen_ctx);
 }
 
+/**
+ * @name	set_target
+ * @brief	notes the texture the offscreen framebuffer now draws into,
+ *          detaching the stencil buffer if it is another size
+ * @param	tex - (texture_2d *) attached texture, NULL for the view framebuffer
+ * @retval	NONE
+ */
+static void set_target(texture_2d *tex) {
+    m_target_width = tex ? tex->width : 0;
+    m_target_height = tex ? tex->height : 0;
+    if (tex && m_stencil_attached && (m_stencil_width != tex->width || m_stencil_height != tex->height)) {
+        GLTRACE(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, 0));
+        m_stencil_attached = false;
+    }
+}
+
+/**
+ * @name	tealeaf_canvas_bind_stencil
+ * @brief	makes sure the bound framebuffer has a stencil buffer, giving the
+ *          offscreen one a buffer the size of its texture
+ * @retval	bool - false if clips can't use the stencil buffer
+ */
+bool tealeaf_canvas_bind_stencil() {
+    if (!m_target_width) {
+        if (m_view_stencil_bits < 0) {
+            GLint bits = 0;
+            glGetIntegerv(GL_STENCIL_BITS, &bits);
+            m_view_stencil_bits = bits;
+            if (!bits) {
+                LOG("{canvas} WARNING: No stencil buffer on screen, rotated clips clip to their bounds");
+            }
+        }
+        return m_view_stencil_bits > 0;
+    }
+
+    if (m_stencil_width != m_target_width || m_stencil_height != m_target_height) {
+        if (!m_stencil_buffer) {
+            GLTRACE(glGenRenderbuffers(1, &m_stencil_buffer));
+        }
+        GLTRACE(glBindRenderbuffer(GL_RENDERBUFFER, m_stencil_buffer));
+        GLTRACE(glRenderbufferStorage(GL_RENDERBUFFER, GL_STENCIL_INDEX8, m_target_width, m_target_height));
+        m_stencil_width = m_target_width;
+        m_stencil_height = m_target_height;
+    }
+
+    if (!m_stencil_attached) {
+        GLTRACE(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_stencil_buffer));
+        m_stencil_attached = true;
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            LOG("{canvas} WARNING: Unable to attach a %dx%d stencil buffer", m_target_width, m_target_height);
+            GLTRACE(glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_STENCIL_ATTACHMENT, GL_RENDERBUFFER, 0));
+            m_stencil_attached = false;
+        }
+    }
+    return m_stencil_attached;
+}
+
 /**
  * @name	tealeaf_canvas_bind_texture_buffer
  * @brief	binds the given context's texture backing to gl to draw to
  * @param	ctx - (context_2d *) pointer to the context to bind
- * @retval	NONE
+ * @retval	bool - true if the framebuffer or its texture changed
  */
-void tealeaf_canvas_bind_texture_buffer(context_2d *ctx) {
+bool tealeaf_canvas_bind_texture_buffer(context_2d *ctx) {
     texture_2d *tex = texture_manager_get_texture(texture_manager_get(), ctx->url);
 
     if (!tex) {
-        return;
+        return false;
     }
 
-    GLTRACE(glBindTexture(GL_TEXTURE_2D, tex->name));
-    GLTRACE(glFinish());
-    GLTRACE(glBindFramebuffer(GL_FRAMEBUFFER, canvas.offscreen_framebuffer));
-    GLTRACE(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex->name, 0));
+    // anything from here on may draw into the canvas
+    tex->canvas_dirty = true;
+
+    gl_state_bind_texture(0, tex->name);
+    bool changed = gl_state_bind_framebuffer(canvas.offscreen_framebuffer);
+    if (!gl_state_framebuffer_texture_matches(tex->name)) {
+        // only moving the attachment needs what was drawn before finished
+        GLTRACE(glFinish());
+        gl_state_framebuffer_texture(tex->name);
+        changed = true;
+    }
+    set_target(tex);
     canvas.framebuffer_width = tex->originalWidth;
     canvas.framebuffer_height = tex->originalHeight;
     canvas.framebuffer_offset_bottom = tex->height - tex->originalHeight;
+    return changed;
 }
 
 /**
  * @name	tealeaf_canvas_bind_render_buffer
  * @brief	bind's the render buffer and set's it's height / width to the given context's props
  * @param	ctx - (context_2d *) pointer to the context to use the width / height from
- * @retval	NONE
+ * @retval	bool - true if the framebuffer or its texture changed
  */
-void tealeaf_canvas_bind_render_buffer(context_2d *ctx) {
-    GLTRACE(glBindFramebuffer(GL_FRAMEBUFFER, canvas.view_framebuffer));
+bool tealeaf_canvas_bind_render_buffer(context_2d *ctx) {
+    texture_2d *scene = m_scene_pending ? texture_manager_get_texture(texture_manager_get(), m_scene_url) : NULL;
+
+    bool changed;
+    if (scene) {
+        // the scene keeps the onscreen sense, drawn into the corner of the
+        // texture the scaled viewport covers
+        scene->canvas_dirty = true;
+        changed = gl_state_bind_framebuffer(canvas.offscreen_framebuffer);
+        if (!gl_state_framebuffer_texture_matches(scene->name)) {
+            gl_state_framebuffer_texture(scene->name);
+            changed = true;
+        }
+        set_target(scene);
+        canvas.render_scale = m_scene_scale;
+    } else {
+        changed = gl_state_bind_framebuffer(canvas.view_framebuffer);
+        set_target(NULL);
+        canvas.render_scale = 1;
+    }
     canvas.framebuffer_width = ctx->width;
     canvas.framebuffer_height = ctx->height;
     canvas.framebuffer_offset_bottom = 0;
+    return changed;
 }
 
 /**
@@ -110,16 +240,20 @@ bool tealeaf_canvas_context_2d_bind(context_2d *ctx) {
 
         // Update active context after flushing
         canvas.active_ctx = ctx;
+        gpu_timing_segment(ctx->on_screen);
 
+        bool changed;
         if (ctx->on_screen) {
-            tealeaf_canvas_bind_render_buffer(ctx);
+            changed = tealeaf_canvas_bind_render_buffer(ctx);
         } else {
-            tealeaf_canvas_bind_texture_buffer(ctx);
+            changed = tealeaf_canvas_bind_texture_buffer(ctx);
         }
 
         tealeaf_context_update_viewport(ctx, false);
 
-        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        // the status query waits on the driver, so only ask about new
+        // framebuffer setups
+        if (changed && glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
             LOG("{canvas} WARNING: Failed to make complete framebuffer %i", glCheckFramebufferStatus(GL_FRAMEBUFFER));
         }
 
@@ -162,10 +296,182 @@ void tealeaf_canvas_resize(int w, int h) {
         context_2d_clear(ctx);
     }
 
-    GLTRACE(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
-    GLTRACE(glEnable(GL_BLEND));
+    gl_state_blend_func(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
     config_set_screen_width(w);
     config_set_screen_height(h);
     canvas.should_resize = true;
+    core_invalidate_frame();
+}
+
+/**
+ * @name	scene_texture
+ * @brief	finds the texture the scene is drawn into while scaled, making
+ *          one the size of the screen when there is none
+ * @retval	texture_2d* - the texture, or NULL if it can't be made
+ */
+static texture_2d *scene_texture() {
+    context_2d *ctx = canvas.onscreen_ctx;
+    texture_manager *manager = texture_manager_get();
+    texture_2d *tex = m_scene_url ? texture_manager_get_texture(manager, m_scene_url) : NULL;
+
+    if (tex && (tex->originalWidth != ctx->width || tex->originalHeight != ctx->height)) {
+        texture_manager_free_texture(manager, tex);
+        tex = NULL;
+    }
+
+    if (!tex && ctx->width > 0 && ctx->height > 0) {
+        tex = texture_manager_new_texture(manager, ctx->width, ctx->height);
+        free(m_scene_url);
+        m_scene_url = tex ? strdup(tex->url) : NULL;
+        if (!tex) {
+            LOG("{canvas} WARNING: Unable to make a %dx%d scene texture, drawing at full resolution", ctx->width, ctx->height);
+        }
+    }
+    return tex;
+}
+
+/**
+ * @name	update_resolution
+ * @brief	moves the scene scale down a step when frames run over budget,
+ *          and up a step after a while on budget
+ * @param	frame_ms - (double) length of the last frame in milliseconds
+ * @retval	NONE
+ */
+static void update_resolution(double frame_ms) {
+    if (frame_ms <= 0) {
+        return;
+    }
+
+    m_frame_avg = m_frame_avg > 0 ? m_frame_avg + (frame_ms - m_frame_avg) * RESOLUTION_FRAME_SMOOTHING : frame_ms;
+    if (++m_frames_at_scale < RESOLUTION_SETTLE_FRAMES) {
+        return;
+    }
+
+    if (m_frame_avg > m_frame_budget * 1.1 && m_scene_scale > m_min_scale) {
+        if (m_probing && m_probe_frames < RESOLUTION_MAX_PROBE_FRAMES) {
+            // the last step up didn't fit, wait longer before the next one
+            m_probe_frames *= 2;
+        }
+        m_scene_scale = fmaxf(m_min_scale, m_scene_scale - RESOLUTION_STEP);
+        m_probing = false;
+        m_frames_at_scale = 0;
+    } else if (m_frame_avg <= m_frame_budget * 1.05 && m_scene_scale < 1 && m_frames_at_scale >= m_probe_frames) {
+        // frames are paced by vsync, so the only way to find headroom is to try
+        m_scene_scale = fminf(1, m_scene_scale + RESOLUTION_STEP);
+        m_probing = true;
+        m_frames_at_scale = 0;
+    } else if (m_probing && m_frames_at_scale >= m_probe_frames) {
+        m_probing = false;
+        m_probe_frames = RESOLUTION_MIN_PROBE_FRAMES;
+    }
 }
 
+/**
+ * @name	tealeaf_canvas_set_dynamic_resolution
+ * @brief	lets the scene be drawn at a lower resolution when frames are slow
+ * @param	min_scale - (float) lowest resolution scale, 1 turns scaling off
+ * @param	budget_ms - (double) frame time to keep to, in milliseconds
+ * @retval	NONE
+ */
+void tealeaf_canvas_set_dynamic_resolution(float min_scale, double budget_ms) {
+    m_min_scale = min_scale < RESOLUTION_STEP ? RESOLUTION_STEP : min_scale > 1 ? 1 : min_scale;
+    if (budget_ms > 0) {
+        m_frame_budget = budget_ms;
+    }
+    m_frame_avg = 0;
+    m_frames_at_scale = 0;
+    m_probe_frames = RESOLUTION_MIN_PROBE_FRAMES;
+    m_probing = false;
+
+    if (m_min_scale >= 1) {
+        m_scene_scale = 1;
+        texture_2d *tex = m_scene_url ? texture_manager_get_texture(texture_manager_get(), m_scene_url) : NULL;
+        if (tex) {
+            texture_manager_free_texture(texture_manager_get(), tex);
+        }
+        free(m_scene_url);
+        m_scene_url = NULL;
+    }
+}
+
+/**
+ * @name	tealeaf_canvas_begin_frame
+ * @brief	picks the scene resolution for the coming frame and points the
+ *          onscreen context at the scene texture when it's scaled
+ * @param	frame_ms - (double) length of the last frame in milliseconds
+ * @retval	NONE
+ */
+void tealeaf_canvas_begin_frame(double frame_ms) {
+    if (m_min_scale >= 1) {
+        return;
+    }
+
+    float scale = m_scene_scale;
+    update_resolution(frame_ms);
+    if (m_scene_scale != scale) {
+        core_invalidate_frame();
+    }
+    m_scene_pending = m_scene_scale < 1 && scene_texture();
+
+    if (canvas.active_ctx == canvas.onscreen_ctx) {
+        tealeaf_canvas_context_2d_rebind(canvas.onscreen_ctx);
+    }
+}
+
+/**
+ * @name	tealeaf_canvas_resolve_scene
+ * @brief	stretches the scaled scene onto the screen, after which the
+ *          onscreen context draws at full resolution for the rest of the
+ *          frame. Does nothing when the scene isn't scaled
+ * @retval	NONE
+ */
+void tealeaf_canvas_resolve_scene() {
+    if (!m_scene_pending) {
+        return;
+    }
+    m_scene_pending = false;
+    if (!core_frame_drawn()) {
+        // an idle frame left the screen as it was
+        return;
+    }
+
+    context_2d *ctx = canvas.onscreen_ctx;
+    context_2d *active = canvas.active_ctx;
+    float scale = m_scene_scale;
+
+    // with m_scene_pending cleared this binds the screen itself
+    canvas.active_ctx = NULL;
+    context_2d_bind(ctx);
+    context_2d_clear(ctx);
+
+    // drawImage would try to load a missing canvas texture as a file
+    if (!texture_manager_get_texture(texture_manager_get(), m_scene_url)) {
+        return;
+    }
+
+    // the scene is upside down in texture sense, y = 0 is its bottom row
+    rect_2d src = {0, 0, ctx->width * scale, ctx->height * scale};
+    rect_2d dest = {0, 0, (float) ctx->width, (float) ctx->height};
+    context_2d_save(ctx);
+    context_2d_loadIdentity(ctx);
+    context_2d_translate(ctx, 0, ctx->height);
+    context_2d_scale(ctx, 1, -1);
+    context_2d_setGlobalAlpha(ctx, 1);
+    context_2d_setGlobalCompositeOperation(ctx, source_over);
+    context_2d_drawImage(ctx, 0, m_scene_url, &src, &dest);
+    context_2d_restore(ctx);
+    draw_textures_flush();
+
+    if (active && active != ctx) {
+        context_2d_bind(active);
+    }
+}
+
+/**
+ * @name	tealeaf_canvas_get_resolution_scale
+ * @brief	returns the resolution the scene is drawn at this frame
+ * @retval	float - scale of the scene, 1 when drawn straight to the screen
+ */
+float tealeaf_canvas_get_resolution_scale() {
+    return m_scene_pending ? m_scene_scale : 1;
+}
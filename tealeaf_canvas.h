@@ -31,21 +31,37 @@ typedef struct tealeaf_canvas_t {
 	bool on_screen;
 	context_2d_p onscreen_ctx;
 	context_2d_p active_ctx;
+	// pixels per point of the target the onscreen context draws into, below
+	// 1 while the scene is drawn at a reduced resolution
+	float render_scale;
 } tealeaf_canvas;
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-void tealeaf_canvas_bind_render_buffer(context_2d_p ctx);
-void tealeaf_canvas_bind_texture_buffer(context_2d_p ctx);
+bool tealeaf_canvas_bind_render_buffer(context_2d_p ctx);
+bool tealeaf_canvas_bind_texture_buffer(context_2d_p ctx);
 void tealeaf_canvas_resize(int w, int h);
 bool tealeaf_canvas_context_2d_bind(context_2d_p ctx);
 void tealeaf_canvas_context_2d_rebind(context_2d_p ctx);
+// gives the bound framebuffer a stencil buffer for rotated clips, false if
+// it can't have one
+bool tealeaf_canvas_bind_stencil();
 
 tealeaf_canvas *tealeaf_canvas_get();
 void tealeaf_canvas_init(int framebuffer_name);
 
+// Dynamic resolution: while frames run over budget_ms, the onscreen context
+// draws into a texture at a lower resolution, no lower than min_scale, that
+// is stretched onto the screen when the scene is resolved. A min_scale of 1
+// turns it off. Anything drawn after tealeaf_canvas_resolve_scene, such as
+// UI, is drawn at full resolution
+void tealeaf_canvas_set_dynamic_resolution(float min_scale, double budget_ms);
+void tealeaf_canvas_begin_frame(double frame_ms);
+void tealeaf_canvas_resolve_scene();
+float tealeaf_canvas_get_resolution_scale();
+
 #ifdef __cplusplus
 }
 #endif
@@ -26,14 +26,23 @@
 #include "core/geometry.h"
 #include "core/image_writer.h"
 #include "core/graphics_utils.h"
+#include "core/gl_state.h"
+#include "core/events.h"
+#include "core/display_list.h"
+#include "core/core.h"
+#include "core/jobs.h"
 #include <math.h>
+#include <pthread.h>
 #include <stdlib.h>
 
 #define GET_MODEL_VIEW_MATRIX(ctx) (&ctx->modelView[ctx->mvp])
 #define GET_CLIPPING_BOUNDS(ctx) (&ctx->clipStack[ctx->mvp])
 #define IS_SCISSOR_ENABLED(ctx) (GET_CLIPPING_BOUNDS(ctx)->width >= 0)
+// an 8 bit stencil buffer counts this many nested rotated clips
+#define MAX_STENCIL_DEPTH 255
+
+static const rgba m_stencil_color = {1, 1, 1, 1};
 
-static rect_2d last_scissor_rect;
 
 
 /**
@@ -67,7 +76,14 @@ void tealeaf_context_update_viewport(context_2d *ctx, bool force) {
     tealeaf_context_update_shader(ctx, PRIMARY_SHADER, force);
     tealeaf_context_update_shader(ctx, FILL_RECT_SHADER, force);
     tealeaf_context_update_shader(ctx, LINEAR_ADD_SHADER, force);
-    GLTRACE(glViewport(0, 0, ctx->backing_width, ctx->backing_height));
+    tealeaf_context_update_shader(ctx, SDF_SHADER, force);
+    if (ctx->on_screen && ctx->canvas->render_scale != 1) {
+        // a scaled scene maps the same points onto fewer pixels
+        float scale = ctx->canvas->render_scale;
+        gl_state_viewport(0, 0, (int) ceilf(ctx->backing_width * scale), (int) ceilf(ctx->backing_height * scale));
+    } else {
+        gl_state_viewport(0, 0, ctx->backing_width, ctx->backing_height);
+    }
 }
 
 /**
@@ -92,10 +108,12 @@ void print_model_view(context_2d *ctx, int i) {
  * @retval	NONE
  */
 void disable_scissor(context_2d *ctx) {
+    if (gl_state_scissor_matches(false, 0, 0, 0, 0)) {
+        return;
+    }
+
     draw_textures_flush();
-    last_scissor_rect.x = last_scissor_rect.y = 0;
-    last_scissor_rect.width = last_scissor_rect.height = -1;
-    GLTRACE(glDisable(GL_SCISSOR_TEST));
+    gl_state_scissor(false, 0, 0, 0, 0);
 }
 
 /**
@@ -106,18 +124,26 @@ void disable_scissor(context_2d *ctx) {
  */
 void enable_scissor(context_2d *ctx) {
     rect_2d *bounds = GET_CLIPPING_BOUNDS(ctx);
+    int x = (int) bounds->x, y = (int) bounds->y;
+    int width = (int) bounds->width, height = (int) bounds->height;
+
+    // clips are kept in points, the scissor box is in pixels
+    if (ctx->on_screen && ctx->canvas->render_scale != 1) {
+        float scale = ctx->canvas->render_scale;
+        x = (int) floorf(bounds->x * scale);
+        y = (int) floorf(bounds->y * scale);
+        width = (int) ceilf((bounds->x + bounds->width) * scale) - x;
+        height = (int) ceilf((bounds->y + bounds->height) * scale) - y;
+    }
 
-    if (rect_2d_equals(&last_scissor_rect, bounds)) {
+    // nested clips often land on the same pixel box; only a real change
+    // needs to break the batch
+    if (gl_state_scissor_matches(true, x, y, width, height)) {
         return;
     }
 
     draw_textures_flush();
-    last_scissor_rect.x = bounds->x;
-    last_scissor_rect.y = bounds->y;
-    last_scissor_rect.width = bounds->width;
-    last_scissor_rect.height = bounds->height;
-    GLTRACE(glScissor((int) bounds->x, (int) bounds->y, (int) bounds->width, (int) bounds->height));
-    GLTRACE(glEnable(GL_SCISSOR_TEST));
+    gl_state_scissor(true, x, y, width, height);
 }
 
 /**
@@ -132,6 +158,12 @@ void enable_scissor(context_2d *ctx) {
 context_2d *context_2d_init(tealeaf_canvas *canvas, const char *url, int dest_tex, bool on_screen) {
     context_2d *ctx = (context_2d *) malloc(sizeof(context_2d));
     ctx->mvp = 0;
+    ctx->stack_size = MODEL_VIEW_STACK_SIZE;
+    ctx->globalAlpha = (float *) malloc(sizeof(float) * ctx->stack_size);
+    ctx->globalCompositeOperation = (int *) malloc(sizeof(int) * ctx->stack_size);
+    ctx->modelView = (matrix_3x3 *) malloc(sizeof(matrix_3x3) * ctx->stack_size);
+    ctx->clipStack = (rect_2d *) malloc(sizeof(rect_2d) * ctx->stack_size);
+    ctx->stencilStack = (stencil_clip *) malloc(sizeof(stencil_clip) * ctx->stack_size);
     ctx->globalAlpha[0] = 1;
     ctx->globalCompositeOperation[0] = 0;
     ctx->destTex = dest_tex;
@@ -141,6 +173,7 @@ context_2d *context_2d_init(tealeaf_canvas *canvas, const char *url, int dest_te
     ctx->filter_color.b = 0.0;
     ctx->filter_color.a = 0.0;
     ctx->filter_type = FILTER_NONE;
+    ctx->recording = NULL;
 
     if (!on_screen) {
         texture_2d *tex = texture_manager_get_texture(texture_manager_get(), url);
@@ -166,6 +199,7 @@ context_2d *context_2d_init(tealeaf_canvas *canvas, const char *url, int dest_te
     ctx->clipStack[0].y = 0;
     ctx->clipStack[0].width = -1;
     ctx->clipStack[0].height = -1;
+    ctx->stencilStack[0].depth = 0;
     matrix_3x3_identity(&ctx->modelView[0]);
     context_2d_clear(ctx);
     return ctx;
@@ -219,6 +253,60 @@ unsigned char *context_2d_read_pixels(context_2d *ctx) {
     return buffer;
 }
 
+/**
+ * @name	bind_for_read
+ * @brief	makes ctx the bound context with everything drawn into it
+ *			submitted, ready for glReadPixels
+ * @param	ctx - (context_2d *) context to read from
+ * @retval	context_2d* - the context bound before, to hand to unbind_for_read
+ */
+static context_2d *bind_for_read(context_2d *ctx) {
+    context_2d *active = tealeaf_canvas_get()->active_ctx;
+    // switching flushes what was queued for the old context, anything queued
+    // for ctx itself needs flushing here
+    if (!tealeaf_canvas_context_2d_bind(ctx)) {
+        draw_textures_flush();
+    }
+    return active;
+}
+
+static void unbind_for_read(context_2d *ctx, context_2d *active) {
+    if (active && active != ctx) {
+        context_2d_bind(active);
+    }
+}
+
+// checks the rect lies within the context
+static bool read_rect_valid(context_2d *ctx, int x, int y, int width, int height) {
+    return width > 0 && height > 0 && x >= 0 && y >= 0 &&
+           x + width <= ctx->width && y + height <= ctx->height;
+}
+
+/**
+ * @name	context_2d_read_pixels_rect
+ * @brief	reads a rect of the context's pixels into the caller's memory,
+ *			leaving the bound context as it was
+ * @param	ctx - (context_2d *) context to read from
+ * @param	x, y, width, height - (int) rect in framebuffer pixels, the same
+ *			sense as context_2d_read_pixels
+ * @param	pixels - (unsigned char *) receives width * height RGBA pixels,
+ *			bottom row first
+ * @retval	bool - false if the rect isn't within the context
+ */
+bool context_2d_read_pixels_rect(context_2d *ctx, int x, int y, int width, int height, unsigned char *pixels) {
+    if (!pixels || !read_rect_valid(ctx, x, y, width, height)) {
+        return false;
+    }
+
+    context_2d *active = bind_for_read(ctx);
+    GLTRACE(glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels));
+    unbind_for_read(ctx, active);
+    return true;
+}
+
+// canvas saves happen mid-game, so favour encode time over size
+static const image_write_options SCREENSHOT_WRITE_OPTIONS = {IMAGE_WRITE_PROFILE_FAST, 0, JPEG_SUBSAMPLING_444};
+
 /**
    Saves the given context_2d's buffer to a file of the given filetype
 
@@ -240,11 +328,357 @@ char *context_2d_save_buffer_to_base64(context_2d *ctx, const char *image_type)
 //		buffer[i] = buffer[i + 2];
 //		buffer[i + 2] = r;
 //	}
-    char *buf = (char*)write_image_to_base64(image_type, buffer, ctx->width, ctx->height, 4);
+    char *buf = (char*)write_image_to_base64_with_options(image_type, buffer, ctx->width, ctx->height, 4, &SCREENSHOT_WRITE_OPTIONS);
     tealeaf_canvas_context_2d_bind(context_2d_get_onscreen());
     free(buffer);
     return buf;
 }
+
+/*
+ * Asynchronous saves
+ *
+ * context_2d_save_buffer_to_base64 reads the pixels back, encodes and base64
+ * encodes them all on the render thread.  The async variant encodes in a job
+ * and reports the result in a canvasSaved event.  With GLES3 the read back
+ * goes into a pixel pack buffer and is only mapped once its fence has
+ * passed, so the render thread does not wait on the gpu either.
+ */
+
+#define MAX_PENDING_SAVES 4
+
+enum save_states {
+    SAVE_FREE,
+    SAVE_READING,   // waiting on the fence of the pixel pack buffer
+    SAVE_ENCODING   // pixels handed to the encode job
+};
+
+typedef struct pending_save_t {
+    int state;
+    int id;
+    char image_type[8];
+    int width;
+    int height;
+    unsigned char *pixels;
+    GLuint buffer;
+    void *fence;
+} pending_save;
+
+static pending_save m_saves[MAX_PENDING_SAVES];
+static int m_next_save_id = 0;
+static pthread_mutex_t m_save_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#if defined(GL_ES_VERSION_3_0)
+// whether the context can read back into pixel pack buffers, checked on first use
+static bool pbo_readback_supported() {
+    static int supported = -1;
+    if (supported < 0) {
+        const char *version = (const char *) glGetString(GL_VERSION);
+        supported = version && strstr(version, "OpenGL ES 3");
+    }
+    return supported;
+}
+#endif
+
+static void dispatch_save_event(int id, const char *data) {
+    size_t event_len = 128 + (data ? strlen(data) : 0);
+    char *event_str = (char *) malloc(event_len);
+    if (!event_str) {
+        LOG("{context} WARNING: Unable to report save %d", id);
+        return;
+    }
+
+    if (data) {
+        snprintf(event_str, event_len, "{\"id\":%d,\"failed\":false,\"data\":\"%s\",\"name\":\"canvasSaved\",\"priority\":0}", id, data);
+    } else {
+        snprintf(event_str, event_len, "{\"id\":%d,\"failed\":true,\"name\":\"canvasSaved\",\"priority\":0}", id);
+    }
+    core_dispatch_event(event_str);
+    free(event_str);
+}
+
+// encode job, runs on a worker
+static void encode_save(void *param) {
+    pending_save *save = (pending_save *) param;
+    char *data = save->pixels ? write_image_to_base64_with_options(save->image_type, save->pixels, save->width, save->height, 4, &SCREENSHOT_WRITE_OPTIONS) : NULL;
+    free(save->pixels);
+    save->pixels = NULL;
+
+    dispatch_save_event(save->id, data);
+    free(data);
+}
+
+// the encode job's completion, on the render thread
+static void finish_save(void *param) {
+    pending_save *save = (pending_save *) param;
+    pthread_mutex_lock(&m_save_mutex);
+    save->state = SAVE_FREE;
+    pthread_mutex_unlock(&m_save_mutex);
+}
+
+static void start_encode(pending_save *save) {
+    save->state = SAVE_ENCODING;
+    jobs_submit(encode_save, finish_save, save, JOB_PRIORITY_LOW);
+}
+
+/**
+ * @name	context_2d_save_buffer_to_base64_async
+ * @brief	starts saving the context's pixels like
+ *			context_2d_save_buffer_to_base64 without blocking on the encode,
+ *			a canvasSaved event with the same id carries the result
+ * @param	ctx - (context_2d *) context to save
+ * @param	image_type - (const char *) "PNG" or "JPG"
+ * @retval	int - id of the save, 0 if too many saves are under way
+ */
+int context_2d_save_buffer_to_base64_async(context_2d *ctx, const char *image_type) {
+    pending_save *save = NULL;
+    int i;
+    pthread_mutex_lock(&m_save_mutex);
+    for (i = 0; i < MAX_PENDING_SAVES; i++) {
+        if (m_saves[i].state == SAVE_FREE) {
+            save = &m_saves[i];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&m_save_mutex);
+
+    if (!save) {
+        LOG("{context} WARNING: %d saves already under way, not saving", MAX_PENDING_SAVES);
+        return 0;
+    }
+
+    save->id = ++m_next_save_id;
+    strncpy(save->image_type, image_type, sizeof(save->image_type) - 1);
+    save->image_type[sizeof(save->image_type) - 1] = '\0';
+    save->width = ctx->width;
+    save->height = ctx->height;
+    save->pixels = NULL;
+
+    tealeaf_canvas_context_2d_bind(ctx);
+
+#if defined(GL_ES_VERSION_3_0)
+    if (pbo_readback_supported()) {
+        draw_textures_flush();
+        GLTRACE(glGenBuffers(1, &save->buffer));
+        GLTRACE(glBindBuffer(GL_PIXEL_PACK_BUFFER, save->buffer));
+        GLTRACE(glBufferData(GL_PIXEL_PACK_BUFFER, 4 * save->width * save->height, NULL, GL_STREAM_READ));
+        GLTRACE(glReadPixels(0, 0, save->width, save->height, GL_RGBA, GL_UNSIGNED_BYTE, (void *) 0));
+        GLTRACE(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+        save->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        save->state = SAVE_READING;
+        tealeaf_canvas_context_2d_bind(context_2d_get_onscreen());
+        return save->id;
+    }
+#endif
+
+    save->pixels = context_2d_read_pixels(ctx);
+    tealeaf_canvas_context_2d_bind(context_2d_get_onscreen());
+    start_encode(save);
+    return save->id;
+}
+
+static void poll_reads();
+
+/**
+ * @name	context_2d_poll_saves
+ * @brief	hands finished read backs to encode jobs and read callbacks,
+ *			called once a tick on the render thread
+ * @retval	NONE
+ */
+void context_2d_poll_saves() {
+    poll_reads();
+#if defined(GL_ES_VERSION_3_0)
+    int i;
+    for (i = 0; i < MAX_PENDING_SAVES; i++) {
+        pending_save *save = &m_saves[i];
+        pthread_mutex_lock(&m_save_mutex);
+        int state = save->state;
+        pthread_mutex_unlock(&m_save_mutex);
+
+        if (state == SAVE_READING) {
+            GLenum status = glClientWaitSync((GLsync) save->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+            if (status == GL_TIMEOUT_EXPIRED) {
+                continue;
+            }
+            glDeleteSync((GLsync) save->fence);
+            save->fence = NULL;
+
+            size_t size = 4 * save->width * save->height;
+            GLTRACE(glBindBuffer(GL_PIXEL_PACK_BUFFER, save->buffer));
+            void *mapping = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+            save->pixels = (unsigned char *) malloc(size);
+            if (mapping && save->pixels) {
+                memcpy(save->pixels, mapping, size);
+            } else {
+                LOG("{context} WARNING: Unable to read back save %d", save->id);
+                free(save->pixels);
+                save->pixels = NULL;
+            }
+            if (mapping) {
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+            GLTRACE(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+            GLTRACE(glDeleteBuffers(1, &save->buffer));
+            save->buffer = 0;
+
+            start_encode(save);
+        }
+    }
+#endif
+}
+
+/*
+ * Asynchronous reads
+ *
+ * context_2d_read_pixels_async reads a rect into a pixel pack buffer with
+ * GLES3 and hands it to the callback on a later tick, once its fence has
+ * passed, so neither the gpu nor the render thread waits. The buffers stay
+ * allocated for the next read. Without GLES3 the read is synchronous but
+ * the callback still comes on a later tick, so callers see one behaviour.
+ */
+
+#define MAX_PENDING_READS 8
+
+typedef struct pending_read_t {
+    bool busy;
+    int width;
+    int height;
+    context_2d_pixels_cb callback;
+    void *data;
+    unsigned char *pixels; // read synchronously, when there is no buffer
+    GLuint buffer;
+    size_t buffer_size;
+    void *fence;
+} pending_read;
+
+static pending_read m_reads[MAX_PENDING_READS];
+
+/**
+ * @name	context_2d_read_pixels_async
+ * @brief	starts reading a rect of the context's pixels, which are handed
+ *			to callback on the render thread a tick or more later
+ * @param	ctx - (context_2d *) context to read from
+ * @param	x, y, width, height - (int) rect in framebuffer pixels, as for
+ *			context_2d_read_pixels_rect
+ * @param	callback - (context_2d_pixels_cb) gets the pixels, or NULL if the
+ *			read failed
+ * @param	data - (void *) passed to callback
+ * @retval	bool - false if the rect isn't within the context or too many
+ *			reads are under way, callback is not called then
+ */
+bool context_2d_read_pixels_async(context_2d *ctx, int x, int y, int width, int height, context_2d_pixels_cb callback, void *data) {
+    if (!callback || !read_rect_valid(ctx, x, y, width, height)) {
+        return false;
+    }
+
+    pending_read *read = NULL;
+    for (int i = 0; i < MAX_PENDING_READS; i++) {
+        if (!m_reads[i].busy) {
+            read = &m_reads[i];
+            break;
+        }
+    }
+    if (!read) {
+        LOG("{context} WARNING: %d reads already under way, not reading", MAX_PENDING_READS);
+        return false;
+    }
+
+    size_t size = 4 * (size_t) width * height;
+    read->width = width;
+    read->height = height;
+    read->callback = callback;
+    read->data = data;
+    read->pixels = NULL;
+
+    context_2d *active = bind_for_read(ctx);
+#if defined(GL_ES_VERSION_3_0)
+    if (pbo_readback_supported()) {
+        if (!read->buffer) {
+            GLTRACE(glGenBuffers(1, &read->buffer));
+        }
+        GLTRACE(glBindBuffer(GL_PIXEL_PACK_BUFFER, read->buffer));
+        if (read->buffer_size < size) {
+            GLTRACE(glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ));
+            read->buffer_size = size;
+        }
+        GLTRACE(glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void *) 0));
+        GLTRACE(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+        read->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        read->busy = true;
+        unbind_for_read(ctx, active);
+        return true;
+    }
+#endif
+
+    read->pixels = (unsigned char *) malloc(size);
+    if (read->pixels) {
+        GLTRACE(glReadPixels(x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, read->pixels));
+    }
+    read->busy = true;
+    unbind_for_read(ctx, active);
+    return true;
+}
+
+/**
+ * @name	poll_reads
+ * @brief	hands the pixels of finished reads to their callbacks
+ * @retval	NONE
+ */
+static void poll_reads() {
+    for (int i = 0; i < MAX_PENDING_READS; i++) {
+        pending_read *read = &m_reads[i];
+        if (!read->busy) {
+            continue;
+        }
+
+        unsigned char *pixels = read->pixels;
+        void *mapping = NULL;
+#if defined(GL_ES_VERSION_3_0)
+        if (read->fence) {
+            GLenum status = glClientWaitSync((GLsync) read->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+            if (status == GL_TIMEOUT_EXPIRED) {
+                continue;
+            }
+            glDeleteSync((GLsync) read->fence);
+            read->fence = NULL;
+
+            GLTRACE(glBindBuffer(GL_PIXEL_PACK_BUFFER, read->buffer));
+            mapping = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 4 * (size_t) read->width * read->height, GL_MAP_READ_BIT);
+            pixels = (unsigned char *) mapping;
+            if (!mapping) {
+                LOG("{context} WARNING: Unable to map a pixel read");
+                GLTRACE(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+            }
+        }
+#endif
+
+        // the buffer is still mapped, so a read the callback starts takes
+        // another slot
+        read->callback(pixels, read->width, read->height, read->data);
+
+#if defined(GL_ES_VERSION_3_0)
+        if (mapping) {
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            GLTRACE(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+        }
+#endif
+        if (!mapping) {
+            free(pixels);
+        }
+        read->pixels = NULL;
+        read->busy = false;
+    }
+}
+
+static void free_context(context_2d *ctx) {
+    free(ctx->url);
+    free(ctx->globalAlpha);
+    free(ctx->globalCompositeOperation);
+    free(ctx->modelView);
+    free(ctx->clipStack);
+    free(ctx->stencilStack);
+    free(ctx);
+}
+
 /**
  * @name	context_2d_delete
  * @brief	frees the given context
@@ -258,8 +692,53 @@ void context_2d_delete(context_2d *ctx) {
         texture_manager_free_texture(texture_manager_get(), tex);
     }
 
-    free(ctx->url);
-    free(ctx);
+    free_context(ctx);
+}
+
+/**
+ * @name	context_2d_acquire_scratch
+ * @brief	creates a cleared offscreen context for temporary drawing, such
+ *			as an effect layer, backed by a pooled texture so borrowing one
+ *			usually allocates nothing in gl
+ * @param	canvas - (tealeaf_canvas *)
+ * @param	width - (int) width of the layer
+ * @param	height - (int) height of the layer
+ * @retval	context_2d* - the layer, handed back with context_2d_release_scratch,
+ *			or NULL if no texture could be had
+ */
+context_2d *context_2d_acquire_scratch(tealeaf_canvas *canvas, int width, int height) {
+    texture_2d *tex = texture_manager_acquire_render_texture(texture_manager_get(), width, height);
+    if (!tex) {
+        LOG("{context} WARNING: Unable to allocate a %ix%i scratch layer", width, height);
+        return NULL;
+    }
+
+    // context_2d_init clears whatever the pooled texture held
+    return context_2d_init(canvas, tex->url, tex->name, false);
+}
+
+/**
+ * @name	context_2d_release_scratch
+ * @brief	frees a context from context_2d_acquire_scratch, pooling its
+ *			texture for the next layer of the same size class
+ * @param	ctx - (context_2d *) layer to release
+ * @retval	NONE
+ */
+void context_2d_release_scratch(context_2d *ctx) {
+    // the texture may be drawn into by the next borrower, finish with it first
+    draw_textures_flush();
+    tealeaf_canvas *canvas = tealeaf_canvas_get();
+    if (canvas->active_ctx == ctx) {
+        canvas->active_ctx = NULL;
+    }
+
+    texture_manager *manager = texture_manager_get();
+    texture_2d *tex = texture_manager_get_texture(manager, ctx->url);
+    if (tex) {
+        texture_manager_release_render_texture(manager, tex);
+    }
+
+    free_context(ctx);
 }
 
 /**
@@ -303,6 +782,9 @@ void context_2d_resize(context_2d *ctx, int width, int height) {
  * @retval	NONE
  */
 void context_2d_setGlobalAlpha(context_2d *ctx, float alpha) {
+    if (ctx->recording) {
+        display_list_record_alpha(ctx->recording, alpha);
+    }
     ctx->globalAlpha[ctx->mvp] = alpha;
 }
 /**
@@ -328,10 +810,18 @@ void context_2d_bind(context_2d *ctx) {
         } else {
             disable_scissor(ctx);
         }
+
+        // offscreen contexts share a stencil buffer, so one left inside a
+        // rotated clip finds it as the last context to clip left it
+        int depth = ctx->stencilStack[ctx->mvp].depth;
+        gl_state_stencil_test(depth && tealeaf_canvas_bind_stencil() ? depth : 0);
     }
 }
 
 void context_2d_setGlobalCompositeOperation(context_2d *ctx, int composite_mode) {
+    if (ctx->recording) {
+        display_list_record_composite(ctx->recording, composite_mode);
+    }
     ctx->globalCompositeOperation[ctx->mvp] = composite_mode;
 }
 
@@ -353,6 +843,9 @@ void context_2d_add_filter(context_2d *ctx, rgba *color) {
     ctx->filter_color.g = color->g;
     ctx->filter_color.b = color->b;
     ctx->filter_color.a = color->a;
+    if (ctx->recording) {
+        display_list_record_filter(ctx->recording, &ctx->filter_color, ctx->filter_type);
+    }
 }
 
 /**
@@ -367,6 +860,9 @@ void context_2d_clear_filters(context_2d *ctx) {
     ctx->filter_color.g = 0.0;
     ctx->filter_color.b = 0.0;
     ctx->filter_color.a = 0.0;
+    if (ctx->recording) {
+        display_list_record_filter(ctx->recording, &ctx->filter_color, ctx->filter_type);
+    }
 }
 
 /**
@@ -378,17 +874,55 @@ void context_2d_clear_filters(context_2d *ctx) {
  */
 void context_2d_set_filter_type(context_2d *ctx, int filter_type) {
     ctx->filter_type = filter_type;
+    if (ctx->recording) {
+        display_list_record_filter(ctx->recording, &ctx->filter_color, ctx->filter_type);
+    }
+}
+
+/**
+ * @name	maps_to_rect
+ * @brief	tests whether the matrix maps rects onto axis aligned rects,
+ *          which the scissor box clips to exactly
+ * @param	m - (const matrix_3x3 *) model view matrix
+ * @retval	bool - true without rotation or skew, besides quarter turns
+ */
+static inline bool maps_to_rect(const matrix_3x3 *m) {
+    return (!m->m01 && !m->m10) || (!m->m00 && !m->m11);
+}
+
+/**
+ * @name	draw_stencil_clip
+ * @brief	counts a stack level's rotated clip into the stencil buffer
+ *          where its parent's clip is, or takes it out again
+ * @param	ctx - (context_2d *) bound context, scissored to the level's clip
+ * @param	level - (int) stack level holding the stencil clip
+ * @param	op - (int) GL_INCR to add the clip, GL_DECR to take it out
+ * @retval	NONE
+ */
+static void draw_stencil_clip(context_2d *ctx, int level, int op) {
+    stencil_clip *stencil = &ctx->stencilStack[level];
+    draw_textures_flush();
+    gl_state_stencil_write(op == GL_INCR ? stencil->depth - 1 : stencil->depth, op);
+    draw_textures_fill_rect(ctx, &stencil->model_view, stencil->rect, ctx->clipStack[level], &m_stencil_color, 1, 0);
+    draw_textures_flush();
 }
 
 /**
  * @name	context_2d_setClip
- * @brief	sets the clipping rectangle on the given context
+ * @brief	sets the clipping rectangle on the given context. The scissor
+ *			box takes the clip's bounds, and a clip under rotation or skew
+ *			is also drawn into the stencil buffer, when there is one
  * @param	ctx - (context_2d *) context to set the clipping rectangle on
  * @param	clip - (rect_2d) the clipping rectangle
- * @retval	NONE
+ * @retval	bool - false if the resulting clip has no area
  */
-void context_2d_setClip(context_2d *ctx, rect_2d clip) {
+bool context_2d_setClip(context_2d *ctx, rect_2d clip) {
+    if (ctx->recording) {
+        display_list_record_clip(ctx->recording, clip);
+    }
+
     matrix_3x3 *modelView = GET_MODEL_VIEW_MATRIX(ctx);
+    rect_2d local = clip;
 
 #ifdef MATRIX_3x3_ALLOW_SKEW
     // TODO: Can this be done more efficiently?
@@ -449,66 +983,80 @@ void context_2d_setClip(context_2d *ctx, rect_2d clip) {
     clip.width = clip_w - clip_x;
     clip.height = clip_h - clip_y;
 #else
-    float clip0x = clip.x, clip0y = clip.y;
-    float clip1x = clip0x + clip.width, clip1y = clip0y + clip.height;
-
-    // float x1, y1, x2, y2, x3, y3, x4, y4;
-    // x1 = clip0x * modelView->m00 + clip0y * modelView->m01 + modelView->m02;
-    // y1 = clip0x * modelView->m10 + clip0y * modelView->m11 + modelView->m12;
-    // x2 = clip1x * modelView->m00 + clip0y * modelView->m01 + modelView->m02;
-    // y2 = clip1x * modelView->m10 + clip0y * modelView->m11 + modelView->m12;
-    // x3 = clip1x * modelView->m00 + clip1y * modelView->m01 + modelView->m02;
-    // y3 = clip1x * modelView->m10 + clip1y * modelView->m11 + modelView->m12;
-    // x4 = clip0x * modelView->m00 + clip1y * modelView->m01 + modelView->m02;
-    // y4 = clip0x * modelView->m10 + clip1y * modelView->m11 + modelView->m12;
-
-    float m00 = modelView->m00, m01 = modelView->m01, m10 = modelView->m10, m11 = modelView->m11;
-    float a = clip0x * m00;
-    float b = clip1x * m10;
-    float c = clip0y * m11;
-    float d = clip0y * m01;
-    float e = clip1x * m00;
-    float f = clip1y * m01;
-    float g = clip0x * m10;
-    float h = clip1y * m11;
-
-    // If x1 < x2,
-    if ((clip0x < clip1x) ^ (m00 < 0)) {
-        // If x2 < x3,
-        if ((clip0y < clip1y) ^ (m01 < 0)) {
-            // (x1, y2) -> (x3, y4)
-            clip.x = a + d;
-            clip.y = b + c;
-            clip.width = e + f;
-            clip.height = g + h;
-        } else {
-            // (x4, y1) -> (x2, y3)
-            clip.x = a + f;
-            clip.y = g + c;
-            clip.width = e + d;
-            clip.height = b + h;
+    if (matrix_3x3_is_translate(modelView)) {
+        // Translate only, so just normalize and move the rect
+        if (clip.width < 0) {
+            clip.x += clip.width;
+            clip.width = -clip.width;
         }
+        if (clip.height < 0) {
+            clip.y += clip.height;
+            clip.height = -clip.height;
+        }
+        clip.x += modelView->m02;
+        clip.y += modelView->m12;
     } else {
-        // If x2 < x3,
-        if ((clip0y < clip1y) ^ (m01 < 0)) {
-            // (x2, y3) -> (x4, y1)
-            clip.x = e + d;
-            clip.y = b + h;
-            clip.width = a + f;
-            clip.height = g + c;
+        float clip0x = clip.x, clip0y = clip.y;
+        float clip1x = clip0x + clip.width, clip1y = clip0y + clip.height;
+
+        // float x1, y1, x2, y2, x3, y3, x4, y4;
+        // x1 = clip0x * modelView->m00 + clip0y * modelView->m01 + modelView->m02;
+        // y1 = clip0x * modelView->m10 + clip0y * modelView->m11 + modelView->m12;
+        // x2 = clip1x * modelView->m00 + clip0y * modelView->m01 + modelView->m02;
+        // y2 = clip1x * modelView->m10 + clip0y * modelView->m11 + modelView->m12;
+        // x3 = clip1x * modelView->m00 + clip1y * modelView->m01 + modelView->m02;
+        // y3 = clip1x * modelView->m10 + clip1y * modelView->m11 + modelView->m12;
+        // x4 = clip0x * modelView->m00 + clip1y * modelView->m01 + modelView->m02;
+        // y4 = clip0x * modelView->m10 + clip1y * modelView->m11 + modelView->m12;
+
+        float m00 = modelView->m00, m01 = modelView->m01, m10 = modelView->m10, m11 = modelView->m11;
+        float a = clip0x * m00;
+        float b = clip1x * m10;
+        float c = clip0y * m11;
+        float d = clip0y * m01;
+        float e = clip1x * m00;
+        float f = clip1y * m01;
+        float g = clip0x * m10;
+        float h = clip1y * m11;
+
+        // If x1 < x2,
+        if ((clip0x < clip1x) ^ (m00 < 0)) {
+            // If x2 < x3,
+            if ((clip0y < clip1y) ^ (m01 < 0)) {
+                // (x1, y2) -> (x3, y4)
+                clip.x = a + d;
+                clip.y = b + c;
+                clip.width = e + f;
+                clip.height = g + h;
+            } else {
+                // (x4, y1) -> (x2, y3)
+                clip.x = a + f;
+                clip.y = g + c;
+                clip.width = e + d;
+                clip.height = b + h;
+            }
         } else {
-            // (x3, y4) -> (x1, y2)
-            clip.x = e + f;
-            clip.y = g + h;
-            clip.width = a + d;
-            clip.height = b + c;
+            // If x2 < x3,
+            if ((clip0y < clip1y) ^ (m01 < 0)) {
+                // (x2, y3) -> (x4, y1)
+                clip.x = e + d;
+                clip.y = b + h;
+                clip.width = a + f;
+                clip.height = g + c;
+            } else {
+                // (x3, y4) -> (x1, y2)
+                clip.x = e + f;
+                clip.y = g + h;
+                clip.width = a + d;
+                clip.height = b + c;
+            }
         }
-    }
 
-    clip.width -= clip.x;
-    clip.height -= clip.y;
-    clip.x += modelView->m02;
-    clip.y += modelView->m12;
+        clip.width -= clip.x;
+        clip.height -= clip.y;
+        clip.x += modelView->m02;
+        clip.y += modelView->m12;
+    }
 #endif
 
     // Clip with screen bounds
@@ -581,12 +1129,88 @@ void context_2d_setClip(context_2d *ctx, rect_2d clip) {
         clip.width, clip.height
     };
 
-    if (rect_2d_equals(GET_CLIPPING_BOUNDS(ctx), &bounds)) {
-        return;
+    int level = ctx->mvp;
+    int parent_depth = level > 0 ? ctx->stencilStack[level - 1].depth : 0;
+    bool has_area = bounds.width > 0 && bounds.height > 0;
+    bool stencil = has_area && !maps_to_rect(modelView) && parent_depth < MAX_STENCIL_DEPTH;
+    bool replaces_stencil = ctx->stencilStack[level].depth != parent_depth;
+
+    if (!stencil && !replaces_stencil && rect_2d_equals(GET_CLIPPING_BOUNDS(ctx), &bounds)) {
+        return has_area;
+    }
+
+    // a clip set before at this level comes out under its own scissor box
+    if (replaces_stencil) {
+        context_2d_bind(ctx);
+        draw_stencil_clip(ctx, level, GL_DECR);
+        ctx->stencilStack[level].depth = parent_depth;
+        gl_state_stencil_test(parent_depth);
     }
 
     *GET_CLIPPING_BOUNDS(ctx) = bounds;
+
+    // nothing can be drawn; leave gl alone, the caller should skip drawing
+    if (!has_area) {
+        return false;
+    }
+
     enable_scissor(ctx);
+
+    if (stencil) {
+        context_2d_bind(ctx);
+        if (tealeaf_canvas_bind_stencil()) {
+            stencil_clip *s = &ctx->stencilStack[level];
+            if (!parent_depth) {
+                // whatever was left in the box from before isn't counted
+                draw_textures_flush();
+                GLTRACE(glClearStencil(0));
+                GLTRACE(glClear(GL_STENCIL_BUFFER_BIT));
+            }
+            s->depth = parent_depth + 1;
+            s->rect = local;
+            s->model_view = *modelView;
+            draw_stencil_clip(ctx, level, GL_INCR);
+            gl_state_stencil_test(s->depth);
+        }
+    }
+    return true;
+}
+
+/**
+ * @name	grow_stack
+ * @brief	doubles the depth of the given context's save / restore stacks
+ * @param	ctx - (context_2d *) context whose stacks are full
+ * @retval	bool - false if the stacks could not be grown
+ */
+static bool grow_stack(context_2d *ctx) {
+    int size = ctx->stack_size * 2;
+    float *alpha = (float *) realloc(ctx->globalAlpha, sizeof(float) * size);
+    if (alpha) {
+        ctx->globalAlpha = alpha;
+    }
+    int *composite = (int *) realloc(ctx->globalCompositeOperation, sizeof(int) * size);
+    if (composite) {
+        ctx->globalCompositeOperation = composite;
+    }
+    matrix_3x3 *model_view = (matrix_3x3 *) realloc(ctx->modelView, sizeof(matrix_3x3) * size);
+    if (model_view) {
+        ctx->modelView = model_view;
+    }
+    rect_2d *clip = (rect_2d *) realloc(ctx->clipStack, sizeof(rect_2d) * size);
+    if (clip) {
+        ctx->clipStack = clip;
+    }
+    stencil_clip *stencil = (stencil_clip *) realloc(ctx->stencilStack, sizeof(stencil_clip) * size);
+    if (stencil) {
+        ctx->stencilStack = stencil;
+    }
+
+    if (!alpha || !composite || !model_view || !clip || !stencil) {
+        return false;
+    }
+
+    ctx->stack_size = size;
+    return true;
 }
 
 /**
@@ -596,31 +1220,75 @@ void context_2d_setClip(context_2d *ctx, rect_2d clip) {
  * @retval	NONE
  */
 void context_2d_save(context_2d *ctx) {
+    if (ctx->recording) {
+        display_list_record_save(ctx->recording);
+    }
+
     int mvp = ctx->mvp + 1;
 
     // If stack size is not exceeded,
-    if (mvp >= MODEL_VIEW_STACK_SIZE) {
-        LOG("{context} WARNING: Stack size exceeded. View hierarchy may not exceed %d levels", MODEL_VIEW_STACK_SIZE);
+    if (mvp >= ctx->stack_size && !grow_stack(ctx)) {
+        LOG("{context} WARNING: Stack size exceeded. View hierarchy may not exceed %d levels", ctx->stack_size);
     } else {
         ctx->mvp = mvp;
         ctx->globalAlpha[mvp] = ctx->globalAlpha[mvp - 1];
         ctx->modelView[mvp] = ctx->modelView[mvp - 1];
         ctx->clipStack[mvp] = ctx->clipStack[mvp - 1];
+        ctx->stencilStack[mvp].depth = ctx->stencilStack[mvp - 1].depth;
+        ctx->globalCompositeOperation[mvp] = ctx->globalCompositeOperation[mvp - 1];
+    }
+}
+
+/**
+ * @name	context_2d_save_transform
+ * @brief	save's the context like context_2d_save, but loads the given
+ *          model view matrix into the new slot instead of copying the
+ *          current one into it
+ * @param	ctx - (context_2d *) context to save
+ * @param	model_view - (const matrix_3x3 *) model view for the new slot
+ * @retval	NONE
+ */
+void context_2d_save_transform(context_2d *ctx, const matrix_3x3 *model_view) {
+    if (ctx->recording) {
+        display_list_record_unsupported(ctx->recording, "save_transform");
+    }
+
+    int mvp = ctx->mvp + 1;
+
+    if (mvp >= ctx->stack_size && !grow_stack(ctx)) {
+        LOG("{context} WARNING: Stack size exceeded. View hierarchy may not exceed %d levels", ctx->stack_size);
+    } else {
+        ctx->mvp = mvp;
+        ctx->globalAlpha[mvp] = ctx->globalAlpha[mvp - 1];
+        ctx->modelView[mvp] = *model_view;
+        ctx->clipStack[mvp] = ctx->clipStack[mvp - 1];
+        ctx->stencilStack[mvp].depth = ctx->stencilStack[mvp - 1].depth;
         ctx->globalCompositeOperation[mvp] = ctx->globalCompositeOperation[mvp - 1];
     }
 }
 
 /**
  * @name	context_2d_restore
- * @brief	pop's off the global properties stacks and resets glScissors
+ * @brief	pop's off the global properties stacks and resets glScissors,
+ *          taking a rotated clip back out of the stencil buffer
  * @param	ctx - (context_2d *) context to restore
  * @retval	NONE
  */
 void context_2d_restore(context_2d *ctx) {
+    if (ctx->recording) {
+        display_list_record_restore(ctx->recording);
+    }
+
     int mvp = ctx->mvp - 1;
 
     // If stack still has items on it,
     if (mvp >= 0) {
+        if (ctx->stencilStack[mvp + 1].depth != ctx->stencilStack[mvp].depth) {
+            // while the popped clip's scissor box still covers it
+            context_2d_bind(ctx);
+            draw_stencil_clip(ctx, mvp + 1, GL_DECR);
+            gl_state_stencil_test(ctx->stencilStack[mvp].depth);
+        }
         ctx->mvp = mvp;
 
         if (!rect_2d_equals(&ctx->clipStack[mvp], &ctx->clipStack[mvp + 1])) {
@@ -641,12 +1309,90 @@ void context_2d_restore(context_2d *ctx) {
  * @retval	NONE
  */
 void context_2d_clear(context_2d *ctx) {
+    // with partial redraw the view tree render clears what it redraws
+    if (ctx->on_screen && (core_partial_redraw() || !core_frame_should_draw())) {
+        return;
+    }
+    if (ctx->recording) {
+        display_list_record_unsupported(ctx->recording, "clear");
+    }
+    context_2d_clear_clip(ctx);
+}
+
+/**
+ * @name	context_2d_clear_clip
+ * @brief	clears the given context inside its clip, or all of it if it
+ *          has none, whether or not the frame is drawn
+ * @param	ctx - (context_2d *) context to clear
+ * @retval	NONE
+ */
+void context_2d_clear_clip(context_2d *ctx) {
     draw_textures_flush();
     context_2d_bind(ctx);
     GLTRACE(glClearColor(0, 0, 0, 0));
     GLTRACE(glClear(GL_COLOR_BUFFER_BIT));
 }
 
+/**
+ * @name	context_2d_clear_outside
+ * @brief	clears everything inside the clip but outside the given rect,
+ *			with scissored clears that need no draw or shader switch, for
+ *			composite operations that apply to the whole canvas
+ * @param	ctx - (context_2d *) bound context to clear
+ * @param	keep - (const rect_2d *) area to leave alone, in the same space
+ *			as the model view matrices
+ * @retval	NONE
+ */
+void context_2d_clear_outside(context_2d *ctx, const rect_2d *keep) {
+    float scale = ctx->on_screen ? ctx->canvas->render_scale : 1;
+    float y = keep->y;
+    if (ctx->on_screen) {
+        // to frame buffer sense, like the clip stack
+        y = -y + ctx->canvas->framebuffer_height + ctx->canvas->framebuffer_offset_bottom - keep->height;
+    }
+
+    // rounded outwards, so the kept area's edge pixels are never cleared
+    int x0 = (int) floorf(keep->x * scale), y0 = (int) floorf(y * scale);
+    int x1 = (int) ceilf((keep->x + keep->width) * scale), y1 = (int) ceilf((y + keep->height) * scale);
+
+    // the strips stop at the clip, or at whatever the frame buffer holds
+    int bx0 = 0, by0 = 0, bx1 = 1 << 15, by1 = 1 << 15;
+    bool clipped = IS_SCISSOR_ENABLED(ctx);
+    if (clipped) {
+        rect_2d *bounds = GET_CLIPPING_BOUNDS(ctx);
+        bx0 = (int) floorf(bounds->x * scale);
+        by0 = (int) floorf(bounds->y * scale);
+        bx1 = (int) ceilf((bounds->x + bounds->width) * scale);
+        by1 = (int) ceilf((bounds->y + bounds->height) * scale);
+    }
+    x0 = x0 < bx0 ? bx0 : x0 > bx1 ? bx1 : x0;
+    x1 = x1 < x0 ? x0 : x1 > bx1 ? bx1 : x1;
+    y0 = y0 < by0 ? by0 : y0 > by1 ? by1 : y0;
+    y1 = y1 < y0 ? y0 : y1 > by1 ? by1 : y1;
+
+    int strips[4][4] = {
+        {bx0, by0, bx1 - bx0, y0 - by0},
+        {bx0, y1, bx1 - bx0, by1 - y1},
+        {bx0, y0, x0 - bx0, y1 - y0},
+        {x1, y0, bx1 - x1, y1 - y0}
+    };
+
+    draw_textures_flush();
+    GLTRACE(glClearColor(0, 0, 0, 0));
+    for (int i = 0; i < 4; i++) {
+        if (strips[i][2] > 0 && strips[i][3] > 0) {
+            gl_state_scissor(true, strips[i][0], strips[i][1], strips[i][2], strips[i][3]);
+            GLTRACE(glClear(GL_COLOR_BUFFER_BIT));
+        }
+    }
+
+    if (clipped) {
+        enable_scissor(ctx);
+    } else {
+        disable_scissor(ctx);
+    }
+}
+
 /**
  * @name	context_2d_loadIdentity
  * @brief	loads the identity matrix into the given context's model view matrix
@@ -654,6 +1400,9 @@ void context_2d_clear(context_2d *ctx) {
  * @retval	NONE
  */
 void context_2d_loadIdentity(context_2d *ctx) {
+    if (ctx->recording) {
+        display_list_record_unsupported(ctx->recording, "loadIdentity");
+    }
     matrix_3x3_identity(GET_MODEL_VIEW_MATRIX(ctx));
 }
 
@@ -665,6 +1414,9 @@ void context_2d_loadIdentity(context_2d *ctx) {
  * @retval	NONE
  */
 void context_2d_rotate(context_2d *ctx, float angle) {
+    if (ctx->recording) {
+        display_list_record_rotate(ctx->recording, angle);
+    }
     if (angle != 0) {
         matrix_3x3_rotate(GET_MODEL_VIEW_MATRIX(ctx), angle);
     }
@@ -679,6 +1431,9 @@ void context_2d_rotate(context_2d *ctx, float angle) {
  * @retval	NONE
  */
 void context_2d_translate(context_2d *ctx, float x, float y) {
+    if (ctx->recording) {
+        display_list_record_translate(ctx->recording, x, y);
+    }
     if (x != 0 || y != 0) {
         matrix_3x3_translate(GET_MODEL_VIEW_MATRIX(ctx), x, y);
     }
@@ -686,7 +1441,9 @@ void context_2d_translate(context_2d *ctx, float x, float y) {
 
 /**
  * @name	context_2d_draw_point_sprites
- * @brief	Draws pointsprites using the given options (in batch along a line)
+ * @brief	Draws pointsprites using the given options (in batch along a line).
+ *			the points are added to a stroke that is drawn once the brush
+ *			changes, something else is drawn or the context is flushed
  * @param	ctx - (context_2d *) context to draw to
  * @param	url - (const char *) name of the texture to draw from
  * @param	point_size - (float) point sprite size
@@ -699,7 +1456,9 @@ void context_2d_translate(context_2d *ctx, float x, float y) {
  * @retval	NONE
  */
 void context_2d_draw_point_sprites(context_2d *ctx, const char *url, float point_size, float step_size, rgba *color, float x1, float y1, float x2, float y2) {
-    draw_textures_flush();
+    if (ctx->recording) {
+        display_list_record_unsupported(ctx->recording, "point sprites");
+    }
     context_2d_bind(ctx);
     texture_2d *tex = texture_manager_load_texture(texture_manager_get(), url);
 
@@ -708,52 +1467,18 @@ void context_2d_draw_point_sprites(context_2d *ctx, const char *url, float point
         return;
     }
 
-    static GLfloat     *vertex_buffer = NULL;
-    static unsigned int vertex_max = 64;
-    tealeaf_shaders_bind(DRAWING_SHADER);
-    matrix_3x3_multiply_m_f_f_f_f(GET_MODEL_VIEW_MATRIX(ctx), x1, y1, &x1, &y1);
-    matrix_3x3_multiply_m_f_f_f_f(GET_MODEL_VIEW_MATRIX(ctx), x2, y2, &x2, &y2);
-
-    // Allocate vertex array buffer
-    if (vertex_buffer == NULL) {
-        vertex_buffer = malloc(vertex_max * 2 * sizeof(GLfloat));
-    }
-
-    // Add points to the buffer so there are drawing points every X pixels
-    unsigned int count = ceilf(sqrtf((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1)) / step_size);
-
-    if (count < 1) {
-        count = 1;
+    // point sprites sample the whole texture, which for a packed brush is the page
+    if (tex->atlas_page) {
+        LOG("{context} WARNING: Point sprite brush %s is in a texture atlas, not drawing", url);
+        return;
     }
 
-    unsigned int vertex_count = 0;
-    unsigned int i;
-
-    for (i = 0; i < count; ++i) {
-        if (vertex_count == vertex_max) {
-            vertex_max = 2 * vertex_max;
-            vertex_buffer = realloc(vertex_buffer, vertex_max * 2 * sizeof(GLfloat));
-        }
-
-        vertex_buffer[2 * vertex_count + 0] = x1 + (x2 - x1) * ((GLfloat)i / (GLfloat)count);
-        vertex_buffer[2 * vertex_count + 1] = y1 + (y2 - y1) * ((GLfloat)i / (GLfloat)count);
-        vertex_count += 1;
-    }
+    texture_2d_set_sampler(tex, GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+    matrix_3x3_multiply_m_f_f_f_f(GET_MODEL_VIEW_MATRIX(ctx), x1, y1, &x1, &y1);
+    matrix_3x3_multiply_m_f_f_f_f(GET_MODEL_VIEW_MATRIX(ctx), x2, y2, &x2, &y2);
 
-    GLTRACE(glActiveTexture(GL_TEXTURE0));
-    GLTRACE(glBindTexture(GL_TEXTURE_2D, tex->name));
-    GLTRACE(glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA));
-    GLTRACE(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
-    GLTRACE(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-    GLTRACE(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
-    GLTRACE(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
-    // Render the vertex array
-    GLTRACE(glUniform1f(global_shaders[DRAWING_SHADER].point_size, point_size));
-    GLTRACE(glVertexAttribPointer(global_shaders[DRAWING_SHADER].vertex_coords, 2, GL_FLOAT, GL_FALSE, 0, (float *) vertex_buffer));
-    float alpha = color->a * ctx->globalAlpha[ctx->mvp];
-    GLTRACE(glUniform4f(global_shaders[DRAWING_SHADER].draw_color, alpha * color->r, alpha * color->g, alpha * color->b, alpha));
-    GLTRACE(glDrawArrays(GL_POINTS, 0, vertex_count));
-    tealeaf_shaders_bind(PRIMARY_SHADER);
+    // segments of the same stroke are drawn together on the next flush
+    draw_textures_point_sprites(tex->name, point_size, step_size, color, ctx->globalAlpha[ctx->mvp], x1, y1, x2, y2, ctx->width, ctx->height);
 }
 
 /**
@@ -765,6 +1490,9 @@ void context_2d_draw_point_sprites(context_2d *ctx, const char *url, float point
  * @retval	NONE
  */
 void context_2d_scale(context_2d *ctx, float x, float y) {
+    if (ctx->recording) {
+        display_list_record_scale(ctx->recording, x, y);
+    }
     matrix_3x3_scale(GET_MODEL_VIEW_MATRIX(ctx), x, y);
 }
 
@@ -796,6 +1524,11 @@ void tealeaf_context_update_shader(context_2d *ctx, unsigned int shader_type, bo
     matrix_4x4 m;
     matrix_3x3 *proj;
 
+    // not built yet, binding it sets its projection once it is
+    if (!shader->program) {
+        return;
+    }
+
     if (shader->last_width != width || shader->last_height != height || force) {
         //Need to copy the 3x3 projection matrix into a 4x4 matrix since that
         //is the form used in the shader. Note that in the future the shaders
@@ -817,11 +1550,11 @@ void tealeaf_context_update_shader(context_2d *ctx, unsigned int shader_type, bo
         m.m31 = proj->m21;
         m.m32 = 0;
         m.m33 = proj->m22;
-        GLTRACE(glUseProgram(shader->program));
+        gl_state_use_program(shader->program);
         GLTRACE(glUniformMatrix4fv(shader->proj_matrix, 1, false, (float *) &m));
         shader->last_width = width;
         shader->last_height = height;
-        GLTRACE(glUseProgram(global_shaders[current_shader].program));
+        gl_state_use_program(global_shaders[current_shader].program);
     }
 }
 
@@ -836,23 +1569,42 @@ void tealeaf_context_update_shader(context_2d *ctx, unsigned int shader_type, bo
  * @retval	NONE
  */
 void context_2d_fillRect(context_2d *ctx, const rect_2d *rect, const rgba *color) {
+    if (ctx->recording) {
+        display_list_record_fill_rect(ctx->recording, rect, color);
+    }
     if (use_single_shader) {
         return;
     }
 
-    draw_textures_flush();
     context_2d_bind(ctx);
-    tealeaf_shaders_bind(FILL_RECT_SHADER);
-    apply_composite_operation(ctx->globalCompositeOperation[ctx->mvp]);
-    rect_2d_vertices in, out;
-    rect_2d_to_rect_2d_vertices(rect, &in);
-    matrix_3x3_multiply_m_r_r(GET_MODEL_VIEW_MATRIX(ctx), &in, &out);
-    float alpha = color->a * ctx->globalAlpha[ctx->mvp];
-    // TODO: will pre-multiplied alpha cause a loss-of-precision in color for filling rectangles?
-    GLTRACE(glUniform4f(global_shaders[FILL_RECT_SHADER].draw_color, alpha * color->r, alpha * color->g, alpha * color->b, alpha));
-    GLTRACE(glVertexAttribPointer(global_shaders[FILL_RECT_SHADER].vertex_coords, 2, GL_FLOAT, GL_FALSE, 0, &out));
-    GLTRACE(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
-    tealeaf_shaders_bind(PRIMARY_SHADER);
+    draw_textures_fill_rect(ctx, GET_MODEL_VIEW_MATRIX(ctx), *rect, *GET_CLIPPING_BOUNDS(ctx), color, ctx->globalAlpha[ctx->mvp], ctx->globalCompositeOperation[ctx->mvp]);
+}
+
+/**
+ * @name	draw_texture_rect
+ * @brief	queues part of a texture, moving the source rect onto the
+ *			atlas page when the image was packed into one
+ * @param	ctx - (context_2d *) context to draw to
+ * @param	tex - (texture_2d *) loaded texture to draw from
+ * @param	src - (rect_2d) source rect, in image pixels
+ * @param	dest - (const rect_2d *) destination rect
+ * @param	alpha - (float) alpha to draw with, on top of the global alpha
+ * @retval	NONE
+ */
+static void draw_texture_rect(context_2d *ctx, texture_2d *tex, rect_2d src, const rect_2d *dest, float alpha) {
+    int width = tex->width;
+    int height = tex->height;
+
+    if (tex->atlas_page) {
+        src.x += tex->atlas_x;
+        src.y += tex->atlas_y;
+        width = tex->atlas_width;
+        height = tex->atlas_height;
+    }
+
+    // atlas neighbours may bleed into the edges of an opaque image
+    bool opaque = tex->num_channels == 3 && !tex->atlas_page;
+    draw_textures_item(ctx, GET_MODEL_VIEW_MATRIX(ctx), tex->name, width, height, tex->originalWidth, tex->originalHeight, src, *dest, *GET_CLIPPING_BOUNDS(ctx), ctx->globalAlpha[ctx->mvp] * alpha, ctx->globalCompositeOperation[ctx->mvp], &ctx->filter_color, ctx->filter_type, opaque);
 }
 
 /**
@@ -867,10 +1619,40 @@ void context_2d_fillRect(context_2d *ctx, const rect_2d *rect, const rgba *color
  * @retval	NONE
  */
 void context_2d_fillText(context_2d *ctx, texture_2d *img, const rect_2d *srcRect, const rect_2d *destRect, float alpha) {
+    if (ctx->recording) {
+        display_list_record_unsupported(ctx->recording, "fillText");
+    }
     context_2d_bind(ctx);
 
     if (img && img->loaded) {
-        draw_textures_item(ctx, GET_MODEL_VIEW_MATRIX(ctx), img->name, img->width, img->height, img->originalWidth, img->originalHeight, *srcRect, *destRect, *GET_CLIPPING_BOUNDS(ctx), ctx->globalAlpha[ctx->mvp] * alpha, ctx->globalCompositeOperation[ctx->mvp], &ctx->filter_color, ctx->filter_type);
+        texture_2d_set_sampler(img, GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+        draw_texture_rect(ctx, img, *srcRect, destRect, alpha);
+    }
+}
+
+/**
+ * @name	context_2d_fillTextSDF
+ * @brief	fills text from a distance field texture, see draw_textures_sdf_item.
+ *			filters don't apply, the colors are given
+ * @param	ctx - (context_2d *) ctx to fill text on
+ * @param	img - (texture_2d *) distance field texture to use
+ * @param	srcRect - (const rect_2d *) source rectangle on the texture
+ * @param	destRect - (const rect_2d *) destination rect to draw to
+ * @param	fill - (const rgba *) text color
+ * @param	outline - (const rgba *) outline color
+ * @param	outline_width - (float) outline width as a distance, 0 to 0.5
+ * @param	alpha - (float) alpha to draw with, on top of the global alpha
+ * @retval	NONE
+ */
+void context_2d_fillTextSDF(context_2d *ctx, texture_2d *img, const rect_2d *srcRect, const rect_2d *destRect, const rgba *fill, const rgba *outline, float outline_width, float alpha) {
+    if (ctx->recording) {
+        display_list_record_unsupported(ctx->recording, "fillTextSDF");
+    }
+    context_2d_bind(ctx);
+
+    if (img && img->loaded) {
+        texture_2d_set_sampler(img, GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+        draw_textures_sdf_item(ctx, GET_MODEL_VIEW_MATRIX(ctx), img->name, img->width, img->height, *srcRect, *destRect, *GET_CLIPPING_BOUNDS(ctx), ctx->globalAlpha[ctx->mvp] * alpha, ctx->globalCompositeOperation[ctx->mvp], fill, outline, outline_width);
     }
 }
 
@@ -896,15 +1678,154 @@ void context_2d_flush(context_2d *ctx) {
  * @retval	NONE
  */
 void context_2d_drawImage(context_2d *ctx, int srcTex, const char *url, const rect_2d *srcRect, const rect_2d *destRect) {
+    if (ctx->recording) {
+        display_list_record_image(ctx->recording, url, srcRect, destRect, 1);
+    }
+    context_2d_bind(ctx);
+    texture_2d *tex = texture_manager_load_texture(texture_manager_get(), url);
+
+    if (tex && tex->loaded) {
+        texture_2d_set_sampler(tex, GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+        draw_texture_rect(ctx, tex, *srcRect, destRect, 1);
+    }
+}
+
+/**
+ * @name	context_2d_drawImageHandle
+ * @brief	context_2d_drawImage for an image interned with
+ *          texture_manager_intern_url, which skips hashing the url
+ * @param	ctx - (context_2d *) context to draw to
+ * @param	handle - (int) handle of the texture to draw from
+ * @param	srcRect - (const rect_2d *) source rectangle on the texture to draw from
+ * @param	destRect - (const rect_2d *) destination rect to draw to
+ * @retval	NONE
+ */
+void context_2d_drawImageHandle(context_2d *ctx, int handle, const rect_2d *srcRect, const rect_2d *destRect) {
+    if (ctx->recording) {
+        display_list_record_image_handle(ctx->recording, handle, srcRect, destRect, 1);
+    }
+    context_2d_bind(ctx);
+    texture_2d *tex = texture_manager_load_texture_by_handle(texture_manager_get(), handle);
+
+    if (tex && tex->loaded) {
+        texture_2d_set_sampler(tex, GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+        draw_texture_rect(ctx, tex, *srcRect, destRect, 1);
+    }
+}
+
+/**
+ * @name	context_2d_drawImageRects
+ * @brief	draws several parts of one image, binding the context and looking
+ *          up the texture only once
+ * @param	ctx - (context_2d *) context to draw to
+ * @param	url - (const char *) name of the texture to draw from
+ * @param	srcRects - (const rect_2d *) source rects, in image pixels
+ * @param	destRects - (const rect_2d *) destination rects
+ * @param	count - (int) number of rects
+ * @retval	NONE
+ */
+void context_2d_drawImageRects(context_2d *ctx, const char *url, const rect_2d *srcRects, const rect_2d *destRects, int count) {
+    if (ctx->recording) {
+        display_list_record_image(ctx->recording, url, srcRects, destRects, count);
+    }
     context_2d_bind(ctx);
     texture_2d *tex = texture_manager_load_texture(texture_manager_get(), url);
 
     if (tex && tex->loaded) {
-        draw_textures_item(ctx, GET_MODEL_VIEW_MATRIX(ctx), tex->name, tex->width, tex->height, tex->originalWidth, tex->originalHeight, *srcRect, *destRect, * GET_CLIPPING_BOUNDS(ctx), ctx->globalAlpha[ctx->mvp], ctx->globalCompositeOperation[ctx->mvp], &ctx->filter_color, ctx->filter_type);
+        texture_2d_set_sampler(tex, GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+
+        for (int i = 0; i < count; i++) {
+            draw_texture_rect(ctx, tex, srcRects[i], &destRects[i], 1);
+        }
+    }
+}
+
+/**
+ * @name	context_2d_drawImageRectsHandle
+ * @brief	context_2d_drawImageRects for an image interned with
+ *          texture_manager_intern_url
+ * @param	ctx - (context_2d *) context to draw to
+ * @param	handle - (int) handle of the texture to draw from
+ * @param	srcRects - (const rect_2d *) source rects, in image pixels
+ * @param	destRects - (const rect_2d *) destination rects
+ * @param	count - (int) number of rects
+ * @retval	NONE
+ */
+void context_2d_drawImageRectsHandle(context_2d *ctx, int handle, const rect_2d *srcRects, const rect_2d *destRects, int count) {
+    if (ctx->recording) {
+        display_list_record_image_handle(ctx->recording, handle, srcRects, destRects, count);
+    }
+    context_2d_bind(ctx);
+    texture_2d *tex = texture_manager_load_texture_by_handle(texture_manager_get(), handle);
+
+    if (tex && tex->loaded) {
+        texture_2d_set_sampler(tex, GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+
+        for (int i = 0; i < count; i++) {
+            draw_texture_rect(ctx, tex, srcRects[i], &destRects[i], 1);
+        }
+    }
+}
+
+/**
+ * @name	context_2d_drawImageTransformsHandle
+ * @brief	draws one part of an image many times, each under its own
+ *          transform and color, without touching the context's state
+ * @param	ctx - (context_2d *) context to draw to
+ * @param	handle - (int) handle of the texture to draw from
+ * @param	srcRect - (const rect_2d *) source rect, in image pixels
+ * @param	destRect - (const rect_2d *) destination rect, before each transform
+ * @param	transforms - (const matrix_3x3 *) one per draw, applied after the
+ *          current transform
+ * @param	colors - (const rgba *) one per draw, multiplied into the image,
+ *          or NULL. Only their alpha is used when the context has a filter
+ * @param	count - (int) number of draws
+ * @retval	NONE
+ */
+void context_2d_drawImageTransformsHandle(context_2d *ctx, int handle, const rect_2d *srcRect, const rect_2d *destRect, const matrix_3x3 *transforms, const rgba *colors, int count) {
+    if (ctx->recording) {
+        display_list_record_unsupported(ctx->recording, "drawImageTransforms");
+    }
+    context_2d_bind(ctx);
+    texture_2d *tex = texture_manager_load_texture_by_handle(texture_manager_get(), handle);
+    if (!tex || !tex->loaded) {
+        return;
+    }
+    texture_2d_set_sampler(tex, GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+
+    rect_2d src = *srcRect;
+    int width = tex->width;
+    int height = tex->height;
+    if (tex->atlas_page) {
+        src.x += tex->atlas_x;
+        src.y += tex->atlas_y;
+        width = tex->atlas_width;
+        height = tex->atlas_height;
+    }
+
+    bool opaque = tex->num_channels == 3 && !tex->atlas_page;
+    const matrix_3x3 *model_view = GET_MODEL_VIEW_MATRIX(ctx);
+    rect_2d clip = *GET_CLIPPING_BOUNDS(ctx);
+    float alpha = ctx->globalAlpha[ctx->mvp];
+    int composite_op = ctx->globalCompositeOperation[ctx->mvp];
+    bool tint = colors && ctx->filter_type == FILTER_NONE;
+    for (int i = 0; i < count; i++) {
+        matrix_3x3 m;
+        matrix_3x3_multiply(model_view, &transforms[i], &m);
+        float opacity = colors ? alpha * colors[i].a : alpha;
+        if (tint) {
+            rgba color = {colors[i].r, colors[i].g, colors[i].b, 1};
+            draw_textures_item(ctx, &m, tex->name, width, height, tex->originalWidth, tex->originalHeight, src, *destRect, clip, opacity, composite_op, &color, FILTER_MULTIPLY, opaque);
+        } else {
+            draw_textures_item(ctx, &m, tex->name, width, height, tex->originalWidth, tex->originalHeight, src, *destRect, clip, opacity, composite_op, &ctx->filter_color, ctx->filter_type, opaque);
+        }
     }
 }
 
 void context_2d_setTransform(context_2d *ctx, double m11, double m12, double m21, double m22, double dx, double dy) {
+    if (ctx->recording) {
+        display_list_record_unsupported(ctx->recording, "setTransform");
+    }
     context_2d_bind(ctx);
     matrix_3x3 *m = GET_MODEL_VIEW_MATRIX(ctx);
     m->m00 = m11;
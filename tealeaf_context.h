@@ -25,10 +25,21 @@
 extern "C" {
 #endif
 
+// initial depth of the save / restore stacks, they grow as needed
 #define MODEL_VIEW_STACK_SIZE 64
 
 extern matrix_3x3 tealeaf_context_projection_matrix;
 
+// A clip under a rotated or skewed matrix. The scissor box only holds its
+// bounds, so the clip is also counted into the stencil buffer, each nested
+// one adding 1 where it overlaps its parent, and drawing tests for depth
+typedef struct stencil_clip_t {
+	int depth; // 0 without a stencil clip
+	// what was drawn into the stencil buffer, to take it out again
+	rect_2d rect;
+	matrix_3x3 model_view;
+} stencil_clip;
+
 typedef struct context_2d_t {
 	tealeaf_canvas *canvas;
 	int destTex;
@@ -41,13 +52,16 @@ typedef struct context_2d_t {
 
 	bool on_screen;
 	matrix_3x3 proj_matrix;
-	float globalAlpha[MODEL_VIEW_STACK_SIZE];
-	int globalCompositeOperation[MODEL_VIEW_STACK_SIZE];
-	matrix_3x3 modelView[MODEL_VIEW_STACK_SIZE];
+	float *globalAlpha;
+	int *globalCompositeOperation;
+	matrix_3x3 *modelView;
 	int mvp; // model view pointer
-	rect_2d clipStack[MODEL_VIEW_STACK_SIZE];
+	int stack_size; // allocated entries in each stack
+	rect_2d *clipStack;
+	stencil_clip *stencilStack;
 	rgba filter_color;
 	int filter_type;
+	struct display_list_t *recording; // calls are recorded here too, see display_list_begin
 } context_2d;
 
 enum filter_mode {
@@ -80,19 +94,32 @@ context_2d *context_2d_new(tealeaf_canvas *canvas, const char *url, int destTex)
 context_2d *context_2d_init(tealeaf_canvas *canvas, const char *url, int dest_tex, bool on_screen);
 
 unsigned char *context_2d_read_pixels(context_2d *ctx);
+// Rects are in framebuffer pixels and come back bottom row first, like
+// context_2d_read_pixels. The async read hands its pixels, valid only during
+// the call, to the callback on a later tick without waiting on the gpu
+typedef void (*context_2d_pixels_cb)(const unsigned char *pixels, int width, int height, void *data);
+bool context_2d_read_pixels_rect(context_2d *ctx, int x, int y, int width, int height, unsigned char *pixels);
+bool context_2d_read_pixels_async(context_2d *ctx, int x, int y, int width, int height, context_2d_pixels_cb callback, void *data);
 char *context_2d_save_buffer_to_base64(context_2d *ctx, const char *image_type);
+int context_2d_save_buffer_to_base64_async(context_2d *ctx, const char *image_type);
+void context_2d_poll_saves();
 
 void context_2d_delete(context_2d *ctx);
+context_2d *context_2d_acquire_scratch(tealeaf_canvas *canvas, int width, int height);
+void context_2d_release_scratch(context_2d *ctx);
 void context_2d_resize(context_2d *ctx, int w, int h);
 void context_2d_setGlobalAlpha(context_2d *ctx, float alpha);
 float context_2d_getGlobalAlpha(context_2d *ctx);
 void context_2d_setGlobalCompositeOperation(context_2d *ctx, int composite_mode);
 int context_2d_getGlobalCompositeOperation(context_2d *ctx);
 void context_2d_bind(context_2d *ctx);
-void context_2d_setClip(context_2d *ctx, rect_2d clip);
+bool context_2d_setClip(context_2d *ctx, rect_2d clip);
 void context_2d_save(context_2d *ctx);
+void context_2d_save_transform(context_2d *ctx, const matrix_3x3 *model_view);
 void context_2d_restore(context_2d *ctx);
 void context_2d_clear(context_2d *ctx);
+void context_2d_clear_clip(context_2d *ctx);
+void context_2d_clear_outside(context_2d *ctx, const rect_2d *keep);
 void context_2d_loadIdentity(context_2d *ctx);
 void context_2d_rotate(context_2d *ctx, float angle);
 void context_2d_translate(context_2d *ctx, float x, float y);
@@ -100,8 +127,13 @@ void context_2d_scale(context_2d *ctx, float x, float y);
 void context_2d_clearRect(context_2d *ctx, const rect_2d *rect);
 void context_2d_fillRect(context_2d *ctx, const rect_2d *rect, const rgba *color);
 void context_2d_fillText(context_2d *ctx, texture_2d *img, const rect_2d *srcRect, const rect_2d *destRect, float alpha);
+void context_2d_fillTextSDF(context_2d *ctx, texture_2d *img, const rect_2d *srcRect, const rect_2d *destRect, const rgba *fill, const rgba *outline, float outline_width, float alpha);
 void context_2d_flush(context_2d *ctx);
 void context_2d_drawImage(context_2d *ctx, int srcTex, const char *url, const rect_2d *srcRect, const rect_2d *destRect);
+void context_2d_drawImageRects(context_2d *ctx, const char *url, const rect_2d *srcRects, const rect_2d *destRects, int count);
+void context_2d_drawImageHandle(context_2d *ctx, int handle, const rect_2d *srcRect, const rect_2d *destRect);
+void context_2d_drawImageRectsHandle(context_2d *ctx, int handle, const rect_2d *srcRects, const rect_2d *destRects, int count);
+void context_2d_drawImageTransformsHandle(context_2d *ctx, int handle, const rect_2d *srcRect, const rect_2d *destRect, const matrix_3x3 *transforms, const rgba *colors, int count);
 void context_2d_draw_point_sprites(context_2d *ctx, const char *url, float point_size, float step_size, rgba *color, float x1, float y1, float x2, float y2);
 
 
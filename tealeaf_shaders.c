@@ -21,22 +21,58 @@
 #include "tealeaf_context.h"
 #include "platform/gl.h"
 #include "core/log.h"
+#include "core/gl_state.h"
+#include "core/code_cache.h"
 #include <stdlib.h>
-
-static char *linear_add_vertex_shader_code = "														\
-																						\
-  attribute vec2 attr_vertex_coord;														\
-  attribute vec2 attr_tex_coord;														\
-  																						\
-  uniform mat4 proj_matrix;																\
-																						\
-  varying vec2 v_tex_coord;																\
-																						\
-  void main(void) {																		\
-    gl_Position = proj_matrix * vec4(attr_vertex_coord, 0.0, 1.0);						\
-    v_tex_coord = attr_tex_coord;														\
-  }																						\
-";
+#include <stdio.h>
+#include <string.h>
+
+#define MAX_SHADER_CODE_LEN 4096
+
+// The batching programs are variants of one template, built with a
+// #define per feature in their batch_features. Directives need real line
+// breaks, so unlike the other shaders these are written with them.
+#define BATCH_FEATURE_ADD_COLOR 0x1
+// one instance per quad, placed by an affine transform of the unit square
+#define BATCH_FEATURE_INSTANCED 0x2
+// the texture's alpha is a distance to the glyph edge, see draw_textures_sdf_item
+#define BATCH_FEATURE_SDF 0x4
+
+static const char *batch_vertex_shader_code =
+    "#ifdef INSTANCED\n"
+    "attribute vec2 attr_corner;\n"
+    "attribute vec2 attr_dest_origin;\n"
+    "attribute vec4 attr_dest_axes;\n"
+    "attribute vec4 attr_tex_rect;\n"
+    "#else\n"
+    "attribute vec2 attr_vertex_coord;\n"
+    "attribute vec2 attr_tex_coord;\n"
+    "#endif\n"
+    "attribute vec4 attr_color;\n"
+    "attribute float attr_tex_index;\n"
+    "uniform mat4 proj_matrix;\n"
+    "varying vec2 v_tex_coord;\n"
+    "varying lowp vec4 v_color;\n"
+    "varying float v_tex_index;\n"
+    "#ifdef ADD_COLOR\n"
+    "attribute vec4 attr_add_color;\n"
+    "varying lowp vec4 v_add_color;\n"
+    "#endif\n"
+    "void main(void) {\n"
+    "#ifdef INSTANCED\n"
+    "  vec2 coord = attr_dest_origin + attr_corner.x * attr_dest_axes.xy + attr_corner.y * attr_dest_axes.zw;\n"
+    "  gl_Position = proj_matrix * vec4(coord, 0.0, 1.0);\n"
+    "  v_tex_coord = mix(attr_tex_rect.xy, attr_tex_rect.zw, attr_corner);\n"
+    "#else\n"
+    "  gl_Position = proj_matrix * vec4(attr_vertex_coord, 0.0, 1.0);\n"
+    "  v_tex_coord = attr_tex_coord;\n"
+    "#endif\n"
+    "  v_color = attr_color;\n"
+    "  v_tex_index = attr_tex_index;\n"
+    "#ifdef ADD_COLOR\n"
+    "  v_add_color = attr_add_color;\n"
+    "#endif\n"
+    "}\n";
 
 /* 'float a = base.a' was added because of what seems
  * to be a shader compilation bug on the LG Nexus 4
@@ -45,20 +81,33 @@ static char *linear_add_vertex_shader_code = "														\
  * a full white fragment, but maintained the proper
  * alpha value.
  */
-static char *linear_add_fragment_shader_code = "													\
-	precision mediump float;															\
-																						\
-	varying vec2 v_tex_coord;															\
-	uniform lowp vec4 draw_color;														\
-	uniform lowp vec4 add_color;														\
-																						\
-	uniform sampler2D tex_sampler;														\
-																						\
-	void main(void) {	\
-		vec4 base = draw_color*texture2D(tex_sampler, v_tex_coord.st) ;	\
-		float a = base.a;\
-		gl_FragColor = base + add_color * a;\
-	}";
+static const char *batch_fragment_shader_code =
+    "varying lowp vec4 v_color;\n"
+    "#ifdef ADD_COLOR\n"
+    "varying lowp vec4 v_add_color;\n"
+    "#endif\n"
+    "void main(void) {\n"
+    "#ifdef SDF\n"
+    "  float dist = sample_texture(v_tex_coord.st).a;\n"
+    "#ifdef SDF_DERIVATIVES\n"
+    "  float smoothing = fwidth(dist) * 0.75;\n"
+    "#else\n"
+    "  float smoothing = 0.0625;\n"
+    "#endif\n"
+    "  float fill = smoothstep(0.5 - smoothing, 0.5 + smoothing, dist);\n"
+    "  float edge = 0.5 - v_add_color.a;\n"
+    "  float outline = smoothstep(edge - smoothing, edge + smoothing, dist);\n"
+    "  gl_FragColor = mix(vec4(v_add_color.rgb * v_color.a, v_color.a), v_color, fill) * outline;\n"
+    "#else\n"
+    "  vec4 base = v_color * sample_texture(v_tex_coord.st);\n"
+    "#ifdef ADD_COLOR\n"
+    "  float a = base.a;\n"
+    "  gl_FragColor = base + v_add_color * a;\n"
+    "#else\n"
+    "  gl_FragColor = base;\n"
+    "#endif\n"
+    "#endif\n"
+    "}\n";
 
 static char *vertex_shader_code = "														\
 																						\
@@ -75,19 +124,6 @@ static char *vertex_shader_code = "														\
   }																						\
 ";
 
-static char *fragment_shader_code = "													\
-	precision mediump float;															\
-																						\
-	varying vec2 v_tex_coord;															\
-	uniform lowp vec4 draw_color;														\
-	uniform lowp vec4 add_color;														\
-																						\
-	uniform sampler2D tex_sampler;														\
-																						\
-	void main(void) {	\
-		gl_FragColor= draw_color*texture2D(tex_sampler, v_tex_coord.st) ;                 \
-	}";
-
 static char *fill_rect_fragment_shader_code = "											\
 	precision mediump float;															\
 																						\
@@ -128,6 +164,73 @@ tealeaf_shader global_shaders[NUM_SHADERS];
 
 unsigned int current_shader;
 
+static unsigned int m_texture_units = 1;
+// the batching programs draw instances, see tealeaf_shaders_instanced
+static bool m_instanced = false;
+// fwidth is available to fragment shaders, for antialiasing sdf edges
+static bool m_derivatives = false;
+
+/**
+ * @name	build_multi_texture_fragment_shader
+ * @brief	prefixes the given fragment shader code with a sample_texture
+ *			function picking one of m_texture_units samplers by the
+ *			per-vertex texture index. ES2 only allows constant sampler
+ *			indices, hence the if-chain.
+ * @param	buf - (char *) buffer to write the shader code to
+ * @param	size - (size_t) size of the buffer
+ * @param	defines - (const char *) preprocessor lines to put first
+ * @param	code - (const char *) fragment shader code using sample_texture
+ * @retval	char * - buf
+ */
+static char *build_multi_texture_fragment_shader(char *buf, size_t size, const char *defines, const char *code) {
+    int len = snprintf(buf, size,
+                       "%s"
+                       "precision mediump float;\n"
+                       "varying vec2 v_tex_coord;\n"
+                       "varying float v_tex_index;\n"
+                       "uniform sampler2D tex_sampler[%u];\n"
+                       "vec4 sample_texture(vec2 coord) {\n", defines, m_texture_units);
+
+    for (unsigned int i = 0; i + 1 < m_texture_units && len < (int)size; i++) {
+        len += snprintf(buf + len, size - len,
+                        "  if (v_tex_index < %u.5) return texture2D(tex_sampler[%u], coord);\n", i, i);
+    }
+
+    if (len < (int)size) {
+        snprintf(buf + len, size - len,
+                 "  return texture2D(tex_sampler[%u], coord);\n"
+                 "}\n%s", m_texture_units - 1, code);
+    }
+
+    return buf;
+}
+
+/**
+ * @name	bind_texture_samplers
+ * @brief	points each sampler of the bound multi texture shader at its unit
+ * @param	shader - (tealeaf_shader *) shader to bind samplers for
+ * @retval	NONE
+ */
+static void bind_texture_samplers(tealeaf_shader *shader) {
+    int units[MAX_BATCH_TEXTURE_UNITS];
+
+    for (unsigned int i = 0; i < m_texture_units; i++) {
+        units[i] = i;
+    }
+
+    shader->tex_sampler = glGetUniformLocation(shader->program, "tex_sampler");
+    GLTRACE(glUniform1iv(shader->tex_sampler, m_texture_units, units));
+}
+
+/**
+ * @name	tealeaf_shaders_get_texture_units
+ * @brief	gets the number of texture units the batching shaders sample from
+ * @retval	unsigned int - number of texture units
+ */
+unsigned int tealeaf_shaders_get_texture_units() {
+    return m_texture_units;
+}
+
 /**
  * @name	load_shader
  * @brief	creates and compiles a shader
@@ -163,6 +266,162 @@ int load_shader(int type, const char *code, const char *description) {
     return shader;
 }
 
+// linked programs are kept on disk between launches where the driver can
+// hand them out, through the GLES3 calls or OES_get_program_binary
+#if defined(GL_ES_VERSION_3_0)
+#define PROGRAM_BINARY_LENGTH GL_PROGRAM_BINARY_LENGTH
+#define NUM_PROGRAM_BINARY_FORMATS GL_NUM_PROGRAM_BINARY_FORMATS
+#define get_program_binary glGetProgramBinary
+#define program_binary glProgramBinary
+#elif defined(GL_ES) && defined(GL_OES_get_program_binary)
+#define PROGRAM_BINARY_LENGTH GL_PROGRAM_BINARY_LENGTH_OES
+#define NUM_PROGRAM_BINARY_FORMATS GL_NUM_PROGRAM_BINARY_FORMATS_OES
+#define get_program_binary glGetProgramBinaryOES
+#define program_binary glProgramBinaryOES
+#endif
+
+static bool m_program_binaries = false;
+// binaries only load on the driver that made them
+static char m_driver_key[512];
+
+/**
+ * @name	detect_program_binaries
+ * @brief	checks whether the current gl context can save and load linked
+ *			programs. must be called on the gl thread.
+ * @retval	NONE
+ */
+static void detect_program_binaries() {
+    m_program_binaries = false;
+#ifdef PROGRAM_BINARY_LENGTH
+    const char *vendor = (const char *) glGetString(GL_VENDOR);
+    const char *renderer = (const char *) glGetString(GL_RENDERER);
+    const char *version = (const char *) glGetString(GL_VERSION);
+    const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+
+#if defined(GL_ES_VERSION_3_0)
+    bool supported = version && strstr(version, "OpenGL ES 3");
+#else
+    bool supported = extensions && strstr(extensions, "GL_OES_get_program_binary");
+#endif
+    int formats = 0;
+    if (supported) {
+        GLTRACE(glGetIntegerv(NUM_PROGRAM_BINARY_FORMATS, &formats));
+    }
+
+    snprintf(m_driver_key, sizeof(m_driver_key), "%s|%s|%s|%u", vendor ? vendor : "",
+             renderer ? renderer : "", version ? version : "", m_texture_units);
+    m_program_binaries = formats > 0;
+#endif
+    LOG("{shaders} Program binary cache %s", m_program_binaries ? "enabled" : "disabled");
+}
+
+/**
+ * @name	program_cache_name
+ * @brief	names the cache entry of a program after its description
+ * @param	description - (const char *) debug description of the program
+ * @param	name - (char *) receives the name
+ * @param	size - (size_t) size of name
+ * @retval	NONE
+ */
+static void program_cache_name(const char *description, char *name, size_t size) {
+    snprintf(name, size, "shader_%s", description);
+    for (char *c = name; *c; c++) {
+        if (*c == ' ') {
+            *c = '_';
+        }
+    }
+}
+
+/**
+ * @name	load_program_binary
+ * @brief	creates a program from the binary cached for its source
+ * @param	description - (const char *) debug description of the program
+ * @param	source - (const char *) vertex and fragment code of the program
+ * @retval	int - gl int of the linked program, or 0 if there was none to load
+ */
+static int load_program_binary(const char *description, const char *source) {
+#ifdef PROGRAM_BINARY_LENGTH
+    if (!m_program_binaries) {
+        return 0;
+    }
+
+    char name[64];
+    program_cache_name(description, name, sizeof(name));
+    unsigned long size;
+    unsigned char *data = (unsigned char *) code_cache_read(name, m_driver_key, source, &size);
+    if (!data) {
+        return 0;
+    }
+
+    // the binary format comes first
+    int program = 0;
+    if (size > sizeof(GLenum)) {
+        GLenum format;
+        memcpy(&format, data, sizeof(format));
+        program = glCreateProgram();
+        GLTRACE(program_binary(program, format, data + sizeof(format), (GLsizei) (size - sizeof(format))));
+
+        int linked;
+        GLTRACE(glGetProgramiv(program, GL_LINK_STATUS, &linked));
+        if (!linked) {
+            // drivers reject binaries after an update that kept the version
+            GLTRACE(glDeleteProgram(program));
+            program = 0;
+        }
+    }
+    free(data);
+
+    if (program) {
+        LOG("{shaders} Loaded shader program '%s' from its binary", description);
+    } else {
+        LOG("{shaders} The driver rejected the binary of shader program '%s'", description);
+        code_cache_remove(name);
+    }
+    return program;
+#else
+    return 0;
+#endif
+}
+
+/**
+ * @name	save_program_binary
+ * @brief	writes a linked program's binary so later starts can skip compiling it
+ * @param	program - (int) gl int of the linked program
+ * @param	description - (const char *) debug description of the program
+ * @param	source - (const char *) vertex and fragment code of the program
+ * @retval	NONE
+ */
+static void save_program_binary(int program, const char *description, const char *source) {
+#ifdef PROGRAM_BINARY_LENGTH
+    if (!m_program_binaries) {
+        return;
+    }
+
+    int length = 0;
+    GLTRACE(glGetProgramiv(program, PROGRAM_BINARY_LENGTH, &length));
+    if (length <= 0) {
+        return;
+    }
+
+    unsigned char *data = (unsigned char *) malloc(sizeof(GLenum) + length);
+    if (!data) {
+        LOG("{shaders} WARNING: Unable to allocate %d bytes for the binary of shader program '%s'", length, description);
+        return;
+    }
+
+    GLenum format = 0;
+    GLsizei written = 0;
+    GLTRACE(get_program_binary(program, length, &written, &format, data + sizeof(format)));
+    if (written > 0) {
+        memcpy(data, &format, sizeof(format));
+        char name[64];
+        program_cache_name(description, name, sizeof(name));
+        code_cache_write(name, m_driver_key, source, data, sizeof(format) + written);
+    }
+    free(data);
+#endif
+}
+
 /**
  * @name	tealeaf_shaders_load
  * @brief	creates the fragment / vertex shader with the given shader code, returning a shader program
@@ -172,11 +431,28 @@ int load_shader(int type, const char *code, const char *description) {
  * @retval	int - gl int of the shader program
  */
 int tealeaf_shaders_load(char *vertex_shader_code, char *fragment_shader_code, const char *description) {
+    // the cache entry is only valid for this exact pair of sources
+    size_t source_size = strlen(vertex_shader_code) + strlen(fragment_shader_code) + 2;
+    char *source = (char *) malloc(source_size);
+    if (source) {
+        snprintf(source, source_size, "%s\n%s", vertex_shader_code, fragment_shader_code);
+        int cached = load_program_binary(description, source);
+        if (cached) {
+            free(source);
+            return cached;
+        }
+    }
+
     int vertex_shader = load_shader(GL_VERTEX_SHADER, vertex_shader_code, description);
     int fragment_shader = load_shader(GL_FRAGMENT_SHADER, fragment_shader_code, description);
     int program = glCreateProgram();             // create empty OpenGL Program
     GLTRACE(glAttachShader(program, vertex_shader));   // add the vertex shader to program
     GLTRACE(glAttachShader(program, fragment_shader)); // add the fragment shader to program
+#if defined(GL_ES_VERSION_3_0)
+    if (m_program_binaries) {
+        GLTRACE(glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+    }
+#endif
     GLTRACE(glLinkProgram(program));                  // creates OpenGL program executables
     int linked;
     GLTRACE(glGetProgramiv(program, GL_LINK_STATUS, &linked));
@@ -194,29 +470,92 @@ int tealeaf_shaders_load(char *vertex_shader_code, char *fragment_shader_code, c
         exit(1);
     } else {
         LOG("{shaders} Compiled and linked shader program '%s'", description);
+        if (source) {
+            save_program_binary(program, description, source);
+        }
     }
 
+    free(source);
     return program;
 }
 
+/**
+ * @name	batch_defines
+ * @brief	writes the #defines that select a batching program's features
+ * @param	buf - (char *) buffer to write the defines to
+ * @param	size - (size_t) size of the buffer
+ * @param	features - (unsigned int) BATCH_FEATURE_* bits of the variant
+ * @retval	char * - buf
+ */
+static char *batch_defines(char *buf, size_t size, unsigned int features) {
+    snprintf(buf, size, "%s%s%s",
+             (features & BATCH_FEATURE_ADD_COLOR) ? "#define ADD_COLOR 1\n" : "",
+             (features & BATCH_FEATURE_INSTANCED) ? "#define INSTANCED 1\n" : "",
+             (features & BATCH_FEATURE_SDF) ? "#define SDF 1\n" : "");
+    return buf;
+}
+
+/**
+ * @name	batch_shader_init
+ * @brief	builds one variant of the texture batching program from the
+ *			shared template, and looks up its variables
+ * @param	shader_type - (unsigned int) shader the variant is drawn as
+ * @param	features - (unsigned int) BATCH_FEATURE_* bits of the variant
+ * @param	description - (const char *) debug description of the variant
+ * @retval	NONE
+ */
+static void batch_shader_init(unsigned int shader_type, unsigned int features, const char *description) {
+    tealeaf_shader *shader = &global_shaders[shader_type];
+    char defines[128];
+    char fragment_defines[256];
+    char vertex_code[MAX_SHADER_CODE_LEN];
+    char fragment_code[MAX_SHADER_CODE_LEN];
+    char variant[64];
+    if (m_instanced) {
+        features |= BATCH_FEATURE_INSTANCED;
+    }
+    batch_defines(defines, sizeof(defines), features);
+    snprintf(vertex_code, sizeof(vertex_code), "%s%s", defines, batch_vertex_shader_code);
+    // the extension directive has to come first, and only fragment
+    // shaders may ask for it
+    snprintf(fragment_defines, sizeof(fragment_defines), "%s%s",
+             (features & BATCH_FEATURE_SDF) && m_derivatives ?
+             "#extension GL_OES_standard_derivatives : enable\n#define SDF_DERIVATIVES 1\n" : "", defines);
+    build_multi_texture_fragment_shader(fragment_code, sizeof(fragment_code), fragment_defines, batch_fragment_shader_code);
+    snprintf(variant, sizeof(variant), "%s%s", description, m_instanced ? " instanced" : "");
+
+    shader->program = tealeaf_shaders_load(vertex_code, fragment_code, variant);
+    gl_state_use_program(shader->program);
+    // texture binding -- one sampler per batched texture unit
+    bind_texture_samplers(shader);
+    // shader binding for projection matrix
+    shader->proj_matrix = glGetUniformLocation(shader->program, "proj_matrix");
+    // shader binding for vertex/texture coordinates. instances carry their
+    // placement and source rect, the vertices only which corner they are
+    if (m_instanced) {
+        shader->tex_coords = glGetAttribLocation(shader->program, "attr_tex_rect");
+        shader->vertex_coords = glGetAttribLocation(shader->program, "attr_corner");
+        shader->dest_origin = glGetAttribLocation(shader->program, "attr_dest_origin");
+        shader->dest_axes = glGetAttribLocation(shader->program, "attr_dest_axes");
+    } else {
+        shader->tex_coords = glGetAttribLocation(shader->program, "attr_tex_coord");
+        shader->vertex_coords = glGetAttribLocation(shader->program, "attr_vertex_coord");
+        shader->dest_origin = shader->dest_axes = -1;
+    }
+    // opacity / filter colors are sent per vertex
+    shader->vertex_color = glGetAttribLocation(shader->program, "attr_color");
+    shader->tex_index = glGetAttribLocation(shader->program, "attr_tex_index");
+    shader->vertex_add_color = (features & BATCH_FEATURE_ADD_COLOR) ?
+        glGetAttribLocation(shader->program, "attr_add_color") : -1;
+}
+
 /**
  * @name	tealeaf_shaders_primary_init
  * @brief	initilizes the primary texture drawing shader code and variables
  * @retval	NONE
  */
 void tealeaf_shaders_primary_init() {
-    tealeaf_shader *shader = &global_shaders[PRIMARY_SHADER];
-    shader->program = tealeaf_shaders_load(vertex_shader_code, fragment_shader_code, "primary");
-    GLTRACE(glUseProgram(shader->program));
-    // texture binding -- always use texture 0
-    shader->tex_sampler = glGetUniformLocation(shader->program, "tex_sampler");
-    GLTRACE(glUniform1i(shader->tex_sampler, 0));
-    // shader binding for projection matrix
-    shader->proj_matrix = glGetUniformLocation(shader->program, "proj_matrix");
-    // shader binding for vertex/texture coordinates
-    shader->tex_coords = glGetAttribLocation(shader->program, "attr_tex_coord");
-    shader->vertex_coords = glGetAttribLocation(shader->program, "attr_vertex_coord");
-    shader->draw_color = glGetUniformLocation(shader->program, "draw_color");
+    batch_shader_init(PRIMARY_SHADER, 0, "primary");
 }
 
 /**
@@ -225,19 +564,16 @@ void tealeaf_shaders_primary_init() {
  * @retval	NONE
  */
 void tealeaf_shaders_linear_add_init() {
-    tealeaf_shader *shader = &global_shaders[LINEAR_ADD_SHADER];
-    shader->program = tealeaf_shaders_load(linear_add_vertex_shader_code, linear_add_fragment_shader_code, "linear add");
-    GLTRACE(glUseProgram(shader->program));
-    // texture binding -- always use texture 0
-    shader->tex_sampler = glGetUniformLocation(shader->program, "tex_sampler");
-    GLTRACE(glUniform1i(shader->tex_sampler, 0));
-    // shader binding for projection matrix
-    shader->proj_matrix = glGetUniformLocation(shader->program, "proj_matrix");
-    // shader binding for vertex/texture coordinates
-    shader->tex_coords = glGetAttribLocation(shader->program, "attr_tex_coord");
-    shader->vertex_coords = glGetAttribLocation(shader->program, "attr_vertex_coord");
-    shader->draw_color = glGetUniformLocation(shader->program, "draw_color");
-    shader->add_color = glGetUniformLocation(shader->program, "add_color");
+    batch_shader_init(LINEAR_ADD_SHADER, BATCH_FEATURE_ADD_COLOR, "linear add");
+}
+
+/**
+ * @name	tealeaf_shaders_sdf_init
+ * @brief	initilizes the distance field text shader code and variables
+ * @retval	NONE
+ */
+void tealeaf_shaders_sdf_init() {
+    batch_shader_init(SDF_SHADER, BATCH_FEATURE_ADD_COLOR | BATCH_FEATURE_SDF, "sdf");
 }
 
 /**
@@ -248,7 +584,7 @@ void tealeaf_shaders_linear_add_init() {
 void tealeaf_shaders_drawing_init() {
     tealeaf_shader *shader = &global_shaders[DRAWING_SHADER];
     shader->program = tealeaf_shaders_load(drawing_vertex_shader_code, drawing_fragment_shader_code, "drawing");
-    GLTRACE(glUseProgram(shader->program));
+    gl_state_use_program(shader->program);
     shader->tex_sampler = glGetUniformLocation(shader->program, "tex_sampler");
     GLTRACE(glUniform1i(shader->tex_sampler, 0));
     // shader binding for projection matrix
@@ -267,7 +603,7 @@ void tealeaf_shaders_drawing_init() {
 void tealeaf_shaders_fill_rect_init() {
     tealeaf_shader *shader = &global_shaders[FILL_RECT_SHADER];
     shader->program = tealeaf_shaders_load(vertex_shader_code, fill_rect_fragment_shader_code, "fill rect");
-    GLTRACE(glUseProgram(shader->program));
+    gl_state_use_program(shader->program);
     // shader binding for projection matrix
     shader->proj_matrix = glGetUniformLocation(shader->program, "proj_matrix");
     // shader binding for vertex/texture coordinates
@@ -275,27 +611,51 @@ void tealeaf_shaders_fill_rect_init() {
     shader->draw_color = glGetUniformLocation(shader->program, "draw_color");
 }
 
+static inline bool is_batch_shader(unsigned int shader_type) {
+    return shader_type == PRIMARY_SHADER || shader_type == LINEAR_ADD_SHADER || shader_type == SDF_SHADER;
+}
+
 /**
- * @name	tealeaf_shaders_primary_bind
- * @brief	binds the primary shader's program / attributes
+ * @name	batch_shader_bind
+ * @brief	binds a texture batching variant's program / attributes
+ * @param	shader_type - (unsigned int) variant to bind
  * @retval	NONE
  */
-static void inline tealeaf_shaders_primary_bind() {
-    tealeaf_shader *shader = &global_shaders[PRIMARY_SHADER];
-    GLTRACE(glUseProgram(shader->program));
+static void inline batch_shader_bind(unsigned int shader_type) {
+    tealeaf_shader *shader = &global_shaders[shader_type];
+    gl_state_use_program(shader->program);
     GLTRACE(glEnableVertexAttribArray(shader->vertex_coords));
     GLTRACE(glEnableVertexAttribArray(shader->tex_coords));
+    GLTRACE(glEnableVertexAttribArray(shader->vertex_color));
+    GLTRACE(glEnableVertexAttribArray(shader->tex_index));
+    if (shader->vertex_add_color >= 0) {
+        GLTRACE(glEnableVertexAttribArray(shader->vertex_add_color));
+    }
+    if (shader->dest_origin >= 0) {
+        GLTRACE(glEnableVertexAttribArray(shader->dest_origin));
+        GLTRACE(glEnableVertexAttribArray(shader->dest_axes));
+    }
 }
 
 /**
- * @name	tealeaf_shaders_primary_unbind
- * @brief	unbinds the primary shader's program / attributes
+ * @name	batch_shader_unbind
+ * @brief	unbinds a texture batching variant's program / attributes
+ * @param	shader_type - (unsigned int) variant to unbind
  * @retval	NONE
  */
-static void inline tealeaf_shaders_primary_unbind() {
-    tealeaf_shader *shader = &global_shaders[PRIMARY_SHADER];
+static void inline batch_shader_unbind(unsigned int shader_type) {
+    tealeaf_shader *shader = &global_shaders[shader_type];
     GLTRACE(glDisableVertexAttribArray(shader->vertex_coords));
     GLTRACE(glDisableVertexAttribArray(shader->tex_coords));
+    GLTRACE(glDisableVertexAttribArray(shader->vertex_color));
+    GLTRACE(glDisableVertexAttribArray(shader->tex_index));
+    if (shader->vertex_add_color >= 0) {
+        GLTRACE(glDisableVertexAttribArray(shader->vertex_add_color));
+    }
+    if (shader->dest_origin >= 0) {
+        GLTRACE(glDisableVertexAttribArray(shader->dest_origin));
+        GLTRACE(glDisableVertexAttribArray(shader->dest_axes));
+    }
 }
 
 /**
@@ -305,7 +665,7 @@ static void inline tealeaf_shaders_primary_unbind() {
  */
 static void inline tealeaf_shaders_fill_rect_bind() {
     tealeaf_shader *shader = &global_shaders[FILL_RECT_SHADER];
-    GLTRACE(glUseProgram(shader->program));
+    gl_state_use_program(shader->program);
     GLTRACE(glEnableVertexAttribArray(shader->vertex_coords));
 }
 
@@ -326,7 +686,7 @@ static void inline tealeaf_shaders_fill_rect_unbind() {
  */
 static void inline tealeaf_shaders_drawing_bind() {
     tealeaf_shader *shader = &global_shaders[DRAWING_SHADER];
-    GLTRACE(glUseProgram(shader->program));
+    gl_state_use_program(shader->program);
     GLTRACE(glEnableVertexAttribArray(shader->vertex_coords));
 }
 
@@ -340,29 +700,6 @@ static void inline tealeaf_shaders_drawing_unbind() {
     GLTRACE(glDisableVertexAttribArray(shader->vertex_coords));
 }
 
-/**
- * @name	tealeaf_shaders_linear_add_bind
- * @brief	binds the linear add shader's program / attributes
- * @retval	NONE
- */
-static void inline tealeaf_shaders_linear_add_bind() {
-    tealeaf_shader *shader = &global_shaders[LINEAR_ADD_SHADER];
-    GLTRACE(glUseProgram(shader->program));
-    GLTRACE(glEnableVertexAttribArray(shader->tex_coords));
-    GLTRACE(glEnableVertexAttribArray(shader->vertex_coords));
-}
-
-/**
- * @name	tealeaf_shaders_linear_add_unbind
- * @brief	unbinds the linear add shader's program / attributes
- * @retval	NONE
- */
-static void inline tealeaf_shaders_linear_add_unbind() {
-    tealeaf_shader *shader = &global_shaders[LINEAR_ADD_SHADER];
-    GLTRACE(glDisableVertexAttribArray(shader->vertex_coords));
-    GLTRACE(glDisableVertexAttribArray(shader->tex_coords));
-}
-
 /**
  * @name	tealeaf_shaders_bind
  * @brief	unbinds the current shader and binds the given shader
@@ -374,26 +711,33 @@ void tealeaf_shaders_bind(unsigned int shader_type) {
         return;
     }
 
+    // rarely used programs are only built when first drawn with
+    if (!global_shaders[shader_type].program) {
+        if (shader_type == DRAWING_SHADER) {
+            tealeaf_shaders_drawing_init();
+        } else if (shader_type == LINEAR_ADD_SHADER) {
+            tealeaf_shaders_linear_add_init();
+        } else if (shader_type == SDF_SHADER) {
+            tealeaf_shaders_sdf_init();
+        }
+    }
+
     // unbind old shader
-    if (current_shader == PRIMARY_SHADER) {
-        tealeaf_shaders_primary_unbind();
+    if (is_batch_shader(current_shader)) {
+        batch_shader_unbind(current_shader);
     } else if (current_shader == DRAWING_SHADER) {
         tealeaf_shaders_drawing_unbind();
     } else if (current_shader == FILL_RECT_SHADER) {
         tealeaf_shaders_fill_rect_unbind();
-    } else if (current_shader == LINEAR_ADD_SHADER) {
-        tealeaf_shaders_linear_add_unbind();
     }
 
     // bind new shader
-    if (shader_type == PRIMARY_SHADER) {
-        tealeaf_shaders_primary_bind();
+    if (is_batch_shader(shader_type)) {
+        batch_shader_bind(shader_type);
     } else if (shader_type == DRAWING_SHADER) {
         tealeaf_shaders_drawing_bind();
     } else if (shader_type == FILL_RECT_SHADER) {
         tealeaf_shaders_fill_rect_bind();
-    } else if (shader_type == LINEAR_ADD_SHADER) {
-        tealeaf_shaders_linear_add_bind();
     }
 
     current_shader = shader_type;
@@ -407,10 +751,43 @@ void tealeaf_shaders_bind(unsigned int shader_type) {
  * @retval	NONE
  */
 void tealeaf_shaders_init() {
+    int max_units = 1;
+    GLTRACE(glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &max_units));
+    m_texture_units = max_units < 1 ? 1 : max_units;
+    if (m_texture_units > MAX_BATCH_TEXTURE_UNITS) {
+        m_texture_units = MAX_BATCH_TEXTURE_UNITS;
+    }
+    LOG("{shaders} Batching textures over %u texture units", m_texture_units);
+
+    detect_program_binaries();
+
+    // instanced drawing is core in GLES3
+#if defined(GL_ES_VERSION_3_0)
+    const char *version = (const char *) glGetString(GL_VERSION);
+    m_instanced = version && strstr(version, "OpenGL ES 3");
+#else
+    m_instanced = false;
+#endif
+    LOG("{shaders} Instanced batching %s", m_instanced ? "enabled" : "disabled");
+
+    const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+    m_derivatives = extensions && strstr(extensions, "GL_OES_standard_derivatives");
+
+    // a new context has none of the old programs
+    memset(global_shaders, 0, sizeof(global_shaders));
+
     use_single_shader = false;
     tealeaf_shaders_primary_init();
-    tealeaf_shaders_drawing_init();
     tealeaf_shaders_fill_rect_init();
-    tealeaf_shaders_linear_add_init();
-    tealeaf_shaders_primary_bind();
+    batch_shader_bind(PRIMARY_SHADER);
+}
+
+/**
+ * @name	tealeaf_shaders_instanced
+ * @brief	tells whether the batching programs take one instance per quad,
+ *			decided by tealeaf_shaders_init from the gl context
+ * @retval	bool - true if quads are drawn as instances
+ */
+bool tealeaf_shaders_instanced() {
+    return m_instanced;
 }
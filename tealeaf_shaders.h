@@ -17,15 +17,24 @@
 #define TEALEAF_SHADER_H
 #include "core/types.h"
 
-enum SHADERS { PRIMARY_SHADER, DRAWING_SHADER, FILL_RECT_SHADER, LINEAR_ADD_SHADER, NUM_SHADERS };
+// upper bound on textures sampled by a single batched draw
+#define MAX_BATCH_TEXTURE_UNITS 8
+
+enum SHADERS { PRIMARY_SHADER, DRAWING_SHADER, FILL_RECT_SHADER, LINEAR_ADD_SHADER, SDF_SHADER, NUM_SHADERS };
 bool use_single_shader;
 typedef struct shader_t {
 	int program;
 
 	union {
-		// primary shader
+		// primary / linear add / sdf shaders
 		struct {
 			int tex_coords;
+			int vertex_color;
+			int vertex_add_color;
+			int tex_index;
+			// instanced variants only, -1 otherwise
+			int dest_origin;
+			int dest_axes;
 		};
 
 		// drawing shader
@@ -53,5 +62,7 @@ unsigned int current_shader;
 
 void tealeaf_shaders_init();
 void tealeaf_shaders_bind(unsigned int shader_type);
+unsigned int tealeaf_shaders_get_texture_units();
+bool tealeaf_shaders_instanced();
 
 #endif // TEALEAF_SHADER_H
@@ -0,0 +1,259 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 text_cache.c
+ * @brief	remembers what text_manager rasterized and measured so repeated
+ *			calls don't reach the platform
+ */
+#include "core/text_cache.h"
+#include "core/texture_manager.h"
+#include "core/draw_textures.h"
+#include "core/list.h"
+#include "core/log.h"
+#include "core/deps/uthash/uthash.h"
+#include "platform/text_manager.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_TEXT_CACHE_BYTES (8 * 1024 * 1024)
+#define MAX_CACHED_MEASUREMENTS 512
+
+// the fixed arguments of a call, the key is this followed by the font name
+// and the text, each nul terminated
+typedef struct text_key_header_t {
+    int size;
+    int max_width;
+    int text_style;
+    float stroke_width;
+    rgba color;
+} text_key_header;
+
+// a cached call, on an lru list whose head is the least recently used
+typedef struct text_entry_t {
+    char *key;
+    size_t key_length;
+    char *url; // of the texture, which the texture manager may evict
+    long bytes;
+    int width; // measurements only
+    UT_hash_handle hh;
+    struct text_entry_t *prev;
+    struct text_entry_t *next;
+} text_entry;
+
+static text_entry *m_texts = NULL;
+static text_entry *m_texts_lru = NULL;
+static long m_text_bytes = 0;
+static long m_max_text_bytes = DEFAULT_TEXT_CACHE_BYTES;
+
+static text_entry *m_measures = NULL;
+static text_entry *m_measures_lru = NULL;
+static unsigned int m_measure_count = 0;
+
+/**
+ * @name	make_key
+ * @brief	packs a call's arguments into one allocation to hash on
+ * @param	header - (const text_key_header *) fixed arguments, zeroed padding
+ * @param	font_name - (const char *) font
+ * @param	text - (const char *) text
+ * @param	length - (size_t *) out, bytes in the key
+ * @retval	char* - the key, or NULL if it could not be allocated
+ */
+static char *make_key(const text_key_header *header, const char *font_name, const char *text, size_t *length) {
+    size_t font_length = strlen(font_name) + 1;
+    size_t text_length = strlen(text) + 1;
+    *length = sizeof(*header) + font_length + text_length;
+    char *key = (char *) malloc(*length);
+    if (key) {
+        memcpy(key, header, sizeof(*header));
+        memcpy(key + sizeof(*header), font_name, font_length);
+        memcpy(key + sizeof(*header) + font_length, text, text_length);
+    }
+    return key;
+}
+
+static void free_entry(text_entry **table, text_entry **lru, text_entry *entry) {
+    HASH_DEL(*table, entry);
+    LIST_REMOVE(lru, entry);
+    free(entry->key);
+    free(entry);
+}
+
+static void touch_entry(text_entry **lru, text_entry *entry) {
+    LIST_REMOVE(lru, entry);
+    LIST_ADD(lru, entry);
+}
+
+static void free_text_entry(text_entry *entry, bool free_texture) {
+    texture_manager *manager = texture_manager_get();
+    texture_2d *tex = free_texture ? texture_manager_get_texture(manager, entry->url) : NULL;
+    if (tex) {
+        // it may still be queued in the batch
+        draw_textures_flush();
+        texture_manager_free_texture(manager, tex);
+    }
+    m_text_bytes -= entry->bytes;
+    free(entry->url);
+    free_entry(&m_texts, &m_texts_lru, entry);
+}
+
+static long text_budget() {
+    long budget = m_max_text_bytes;
+    long category = (long) texture_manager_get()->category_max_bytes[TEXTURE_CATEGORY_TEXT];
+    return category && category < budget ? category : budget;
+}
+
+/**
+ * @name	text_cache_get_text
+ * @brief	text_manager_get_text, reusing the texture of an earlier call with
+ *			the same arguments while the texture manager still has it
+ * @retval	texture_2d* - the text's texture, or NULL if it could not be made
+ */
+texture_2d *text_cache_get_text(const char *font_name, int size, const char *text, rgba *color, int max_width, int text_style, float stroke_width) {
+    text_key_header header;
+    memset(&header, 0, sizeof(header));
+    header.size = size;
+    header.max_width = max_width;
+    header.text_style = text_style;
+    header.stroke_width = text_style == TEXT_STYLE_STROKE ? stroke_width : 0;
+    header.color = *color;
+
+    size_t length;
+    char *key = make_key(&header, font_name, text, &length);
+    if (!key) {
+        return text_manager_get_text(font_name, size, text, color, max_width, text_style, stroke_width);
+    }
+
+    texture_manager *manager = texture_manager_get();
+    text_entry *entry;
+    HASH_FIND(hh, m_texts, key, length, entry);
+    if (entry) {
+        texture_2d *tex = texture_manager_get_texture(manager, entry->url);
+        if (tex) {
+            free(key);
+            touch_entry(&m_texts_lru, entry);
+            return tex;
+        }
+
+        // evicted by the texture manager, rasterize it again
+        free_text_entry(entry, false);
+    }
+
+    texture_2d *tex = text_manager_get_text(font_name, size, text, color, max_width, text_style, stroke_width);
+    entry = tex && tex->url ? (text_entry *) malloc(sizeof(text_entry)) : NULL;
+    char *url = entry ? strdup(tex->url) : NULL;
+    if (!url) {
+        free(entry);
+        free(key);
+        return tex;
+    }
+
+    entry->key = key;
+    entry->key_length = length;
+    entry->url = url;
+    entry->bytes = tex->used_texture_bytes ? tex->used_texture_bytes : (long) tex->width * tex->height * 4;
+    entry->width = 0;
+    HASH_ADD_KEYPTR(hh, m_texts, entry->key, entry->key_length, entry);
+    LIST_ADD(&m_texts_lru, entry);
+    m_text_bytes += entry->bytes;
+
+    // the newest entry is the lru list's tail, so tex is never the one freed
+    long budget = text_budget();
+    while (m_text_bytes > budget && m_texts_lru != entry) {
+        free_text_entry(m_texts_lru, true);
+    }
+    return tex;
+}
+
+/**
+ * @name	text_cache_measure_text
+ * @brief	text_manager_measure_text, remembering the most recent
+ *			MAX_CACHED_MEASUREMENTS answers
+ * @retval	int - width of the text
+ */
+int text_cache_measure_text(const char *font_name, int size, const char *text) {
+    text_key_header header;
+    memset(&header, 0, sizeof(header));
+    header.size = size;
+
+    size_t length;
+    char *key = make_key(&header, font_name, text, &length);
+    if (!key) {
+        return text_manager_measure_text(font_name, size, text);
+    }
+
+    text_entry *entry;
+    HASH_FIND(hh, m_measures, key, length, entry);
+    if (entry) {
+        free(key);
+        touch_entry(&m_measures_lru, entry);
+        return entry->width;
+    }
+
+    int width = text_manager_measure_text(font_name, size, text);
+    entry = (text_entry *) malloc(sizeof(text_entry));
+    if (!entry) {
+        free(key);
+        return width;
+    }
+
+    entry->key = key;
+    entry->key_length = length;
+    entry->url = NULL;
+    entry->bytes = 0;
+    entry->width = width;
+    HASH_ADD_KEYPTR(hh, m_measures, entry->key, entry->key_length, entry);
+    LIST_ADD(&m_measures_lru, entry);
+    if (++m_measure_count > MAX_CACHED_MEASUREMENTS) {
+        free_entry(&m_measures, &m_measures_lru, m_measures_lru);
+        m_measure_count--;
+    }
+    return width;
+}
+
+void text_cache_set_max_bytes(long bytes) {
+    m_max_text_bytes = bytes;
+    while (m_texts_lru && m_text_bytes > text_budget()) {
+        free_text_entry(m_texts_lru, true);
+    }
+}
+
+long text_cache_bytes() {
+    return m_text_bytes;
+}
+
+long text_cache_trim(long bytes) {
+    long start = m_text_bytes;
+    while (m_texts_lru && start - m_text_bytes < bytes) {
+        free_text_entry(m_texts_lru, true);
+    }
+    return start - m_text_bytes;
+}
+
+/**
+ * @name	text_cache_clear
+ * @brief	forgets every cached call. Textures are left to the texture
+ *			manager, whose callers may still be drawing them
+ * @retval	NONE
+ */
+void text_cache_clear() {
+    while (m_texts_lru) {
+        free_text_entry(m_texts_lru, false);
+    }
+    while (m_measures_lru) {
+        free_entry(&m_measures, &m_measures_lru, m_measures_lru);
+    }
+    m_measure_count = 0;
+}
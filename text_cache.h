@@ -0,0 +1,45 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef TEXT_CACHE_H
+#define TEXT_CACHE_H
+
+#include "core/texture_2d.h"
+#include "core/rgba.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// text_manager_get_text and text_manager_measure_text, answered from a cache
+// of earlier calls with the same arguments. Text textures stay in the
+// texture manager, which may still evict them, and the least recently used
+// are freed once they take more than the cache's byte budget
+texture_2d *text_cache_get_text(const char *font_name, int size, const char *text, rgba *color, int max_width, int text_style, float stroke_width);
+int text_cache_measure_text(const char *font_name, int size, const char *text);
+// the smaller of this and the texture manager's TEXTURE_CATEGORY_TEXT budget
+// bounds the cached textures
+void text_cache_set_max_bytes(long bytes);
+// bytes of cached text textures, and frees the least recently used textures
+// until at least bytes are freed, returning how many were
+long text_cache_bytes();
+long text_cache_trim(long bytes);
+void text_cache_clear();
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
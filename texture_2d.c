@@ -21,17 +21,98 @@
 #include "platform/gl.h"
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <limits.h>
+#include "core/gl_state.h"
 #include "core/tealeaf_canvas.h"
 #include "core/tealeaf_context.h"
 #include "core/log.h"
 #include "core/image_loader.h"
+#include "core/util/detect.h"
 #include "core/core.h"
+#include "platform/resource_loader.h"
+#include "core/asset_pack.h"
+#include "core/memory_tags.h"
+#include "core/load_stats.h"
+#include "core/profiler.h"
 
 // Enable this to print out the texture loader scaling and resizing operations
 //#define VERBOSE_LOAD_TEX
 
 static int offscreen_canvas_count = 0;
 
+// set once the gl context is known to take non power of two textures, read
+// by the image loader thread
+static bool m_npot_supported = false;
+
+/**
+ * @name	texture_2d_detect_npot
+ * @brief	checks whether the current gl context can use non power of two
+ *			textures, so decoded images no longer need padding. must be
+ *			called on the gl thread.
+ * @retval	NONE
+ */
+void texture_2d_detect_npot() {
+    const char *version = (const char *) glGetString(GL_VERSION);
+    const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+
+    m_npot_supported = (version && strstr(version, "OpenGL ES 3")) ||
+        (extensions && strstr(extensions, "GL_OES_texture_npot"));
+    LOG("{tex} Non power of two textures %s", m_npot_supported ? "supported" : "not supported");
+}
+
+/**
+ * @name	texture_2d_npot_supported
+ * @brief	gets whether non power of two textures are fully supported
+ * @retval	bool - true once texture_2d_detect_npot found support
+ */
+bool texture_2d_npot_supported() {
+    return m_npot_supported;
+}
+
+/**
+ * @name	texture_2d_set_npot_supported
+ * @brief	sets what an earlier launch detected, until texture_2d_detect_npot
+ *			runs for the current gl context
+ * @param	supported - (bool) whether npot textures can be used
+ * @retval	NONE
+ */
+void texture_2d_set_npot_supported(bool supported) {
+    m_npot_supported = supported;
+}
+
+/**
+ * @name	texture_2d_detect_compression
+ * @brief	tells the image loader which compressed texture formats the
+ *			current gl context can sample from. must be called on the gl
+ *			thread.
+ * @retval	NONE
+ */
+void texture_2d_detect_compression() {
+    const char *version = (const char *) glGetString(GL_VERSION);
+    const char *extensions = (const char *) glGetString(GL_EXTENSIONS);
+    unsigned int families = IMAGE_COMPRESSION_ETC1;
+
+    // ETC2 / EAC are core in GLES3
+    if ((version && strstr(version, "OpenGL ES 3")) ||
+        (extensions && (strstr(extensions, "GL_OES_compressed_ETC2_RGB8_texture") ||
+                        strstr(extensions, "GL_ARB_ES3_compatibility")))) {
+        families |= IMAGE_COMPRESSION_ETC2;
+    }
+    if (extensions && strstr(extensions, "GL_KHR_texture_compression_astc_ldr")) {
+        families |= IMAGE_COMPRESSION_ASTC;
+    }
+    if (extensions && strstr(extensions, "GL_IMG_texture_compression_pvrtc")) {
+        families |= IMAGE_COMPRESSION_PVRTC;
+    }
+
+    image_loader_set_compression_support(families);
+    LOG("{tex} Compressed texture support ETC2 %d ASTC %d PVRTC %d",
+        !!(families & IMAGE_COMPRESSION_ETC2), !!(families & IMAGE_COMPRESSION_ASTC), !!(families & IMAGE_COMPRESSION_PVRTC));
+}
+
 /**
  * @name	texture_2d_new_from_image
  * @brief	creates a new texture from an already created image
@@ -44,7 +125,7 @@ static int offscreen_canvas_count = 0;
  * @retval	texture_2d* - pointer to the newly created texture
  */
 texture_2d *texture_2d_new_from_image(char *url, int name, int width, int height, int original_width, int original_height) {
-    texture_2d *tex = (texture_2d *) malloc(sizeof(texture_2d));
+    texture_2d *tex = (texture_2d *) TAG_MALLOC(MEMORY_TAG_TEXTURES, sizeof(texture_2d));
     tex->url = url;
     tex->originalWidth = original_width;
     tex->originalHeight = original_height;
@@ -57,15 +138,48 @@ texture_2d *texture_2d_new_from_image(char *url, int name, int width, int height
     tex->is_canvas = false;
     tex->ctx = NULL;
     tex->saved_data = NULL;
+    tex->saved_size = 0;
+    tex->saved_encoded = false;
+    tex->canvas_dirty = false;
+    tex->regenerable = false;
     tex->pixel_data = NULL;
+    tex->pixel_data_bytes = 0;
+    tex->alpha_mask = NULL;
+    tex->mask_columns = 0;
+    tex->mask_rows = 0;
     tex->loaded = false;
+    tex->decoding = false;
+    tex->preloaded = false;
+    tex->preview = false;
+    tex->load_requested = 0;
+    tex->load_ms = 0;
+    tex->id = 0;
+    tex->handle = 0;
+    tex->url_key = 0;
     tex->prev = tex->next = NULL;
+    tex->lru_prev = tex->lru_next = NULL;
     tex->num_channels = 4;
     tex->failed = false;
     tex->assumed_texture_bytes = width * height * 4;
     tex->used_texture_bytes = 0;
     tex->compression_type = 0;
+    tex->pixel_type = GL_UNSIGNED_BYTE;
+    tex->mip_levels = 1;
+    tex->category = TEXTURE_CATEGORY_WORLD;
+    tex->priority = TEXTURE_PRIORITY_NORMAL;
+    memset(&tex->sampler, 0, sizeof(tex->sampler));
     tex->frame_epoch = 0;
+    tex->atlas_page = NULL;
+    tex->atlas_x = tex->atlas_y = 0;
+    tex->atlas_width = tex->atlas_height = 0;
+    tex->content_key = 0;
+    tex->share_next = NULL;
+    tex->upload_state = 0;
+    tex->upload_buffer = tex->upload_name = 0;
+    tex->upload_mapping = tex->upload_fence = NULL;
+    tex->spare_name = 0;
+    memset(&tex->spare_sampler, 0, sizeof(tex->spare_sampler));
+    tex->spare_dirty[2] = 0;
     return tex;
 }
 
@@ -87,7 +201,7 @@ texture_2d *texture_2d_new_from_dimensions(int width, int height) {
  * @retval	texture_2d* - pointer to the new texture
  */
 texture_2d *texture_2d_new_from_url(char *url) {
-    texture_2d *tex = (texture_2d *) malloc(sizeof(texture_2d));
+    texture_2d *tex = (texture_2d *) TAG_MALLOC(MEMORY_TAG_TEXTURES, sizeof(texture_2d));
     tex->url = url;
     tex->width = 0;
     tex->height = 0;
@@ -100,34 +214,128 @@ texture_2d *texture_2d_new_from_url(char *url) {
     tex->is_canvas = false;
     tex->ctx = NULL;
     tex->saved_data = NULL;
+    tex->saved_size = 0;
+    tex->saved_encoded = false;
+    tex->canvas_dirty = false;
+    tex->regenerable = false;
     tex->pixel_data = NULL;
+    tex->pixel_data_bytes = 0;
+    tex->alpha_mask = NULL;
+    tex->mask_columns = 0;
+    tex->mask_rows = 0;
     tex->loaded = false;
+    tex->decoding = false;
+    tex->preloaded = false;
+    tex->preview = false;
+    tex->load_requested = 0;
+    tex->load_ms = 0;
+    tex->id = 0;
+    tex->handle = 0;
+    tex->url_key = 0;
     tex->prev = tex->next = NULL;
+    tex->lru_prev = tex->lru_next = NULL;
     tex->num_channels = 4;
     tex->failed = false;
     tex->assumed_texture_bytes = 0;
     tex->used_texture_bytes = 0;
     tex->compression_type = 0;
+    tex->pixel_type = GL_UNSIGNED_BYTE;
+    tex->mip_levels = 1;
+    tex->category = TEXTURE_CATEGORY_WORLD;
+    tex->priority = TEXTURE_PRIORITY_NORMAL;
+    memset(&tex->sampler, 0, sizeof(tex->sampler));
     tex->frame_epoch = 0;
+    tex->atlas_page = NULL;
+    tex->atlas_x = tex->atlas_y = 0;
+    tex->atlas_width = tex->atlas_height = 0;
+    tex->content_key = 0;
+    tex->share_next = NULL;
+    tex->upload_state = 0;
+    tex->upload_buffer = tex->upload_name = 0;
+    tex->upload_mapping = tex->upload_fence = NULL;
+    tex->spare_name = 0;
+    memset(&tex->spare_sampler, 0, sizeof(tex->spare_sampler));
+    tex->spare_dirty[2] = 0;
     return tex;
 }
 
+/*
+ * Canvas backups
+ *
+ * Canvas pixels are read back before the gl context goes away and kept
+ * run-length encoded as (count, pixel) pairs of 32 bit words when that is
+ * smaller, which it usually is for canvases with large clear or flat areas.
+ * A small encoded backup is kept after the reload, so a canvas that is not
+ * drawn into again can be saved next time without reading it back.
+ */
+
+// encoded backups at most this fraction of the raw pixels are kept after a reload
+#define CANVAS_BACKUP_KEEP_DIVISOR 4
+
+// run-length encodes pixels, NULL when that would not save anything
+static uint32_t *encode_canvas_pixels(const uint32_t *pixels, long count, long *out_size) {
+    // stop once the encoding reaches the raw size
+    const long max_words = count;
+    uint32_t *runs = (uint32_t *) TAG_MALLOC(MEMORY_TAG_TEXTURES, max_words * sizeof(uint32_t));
+    if (!runs) {
+        return NULL;
+    }
+
+    long words = 0;
+    long i = 0;
+    while (i < count) {
+        uint32_t pixel = pixels[i];
+        long run = 1;
+        while (i + run < count && pixels[i + run] == pixel && run < 0xFFFFFFFF) {
+            run++;
+        }
+        if (words + 2 > max_words) {
+            TAG_FREE(runs);
+            return NULL;
+        }
+        runs[words++] = (uint32_t) run;
+        runs[words++] = pixel;
+        i += run;
+    }
+
+    *out_size = words * sizeof(uint32_t);
+    return runs;
+}
+
+static uint32_t *decode_canvas_pixels(const uint32_t *runs, long size, long count) {
+    uint32_t *pixels = (uint32_t *) malloc(count * sizeof(uint32_t));
+    if (!pixels) {
+        return NULL;
+    }
+
+    long i = 0;
+    long words = size / sizeof(uint32_t);
+    long w;
+    for (w = 0; w + 1 < words && i < count; w += 2) {
+        uint32_t run = runs[w];
+        uint32_t pixel = runs[w + 1];
+        while (run-- && i < count) {
+            pixels[i++] = pixel;
+        }
+    }
+    return pixels;
+}
+
 /**
  * @name	get_tex_from_data
  * @brief	gets a gl id for a texture with given data
  * @param	w - (int) width of the given image
  * @param	h - (int) height of the given image
  * @param	data - (void *) bytes of the image to create a texture from
+ * @param	sampler - (texture_2d_sampler *) records the sampler state set on the texture
  * @retval	int - the gl id representing the created texture
  */
-static inline int get_tex_from_data(int w, int h, const void *data) {
+static inline int get_tex_from_data(int w, int h, const void *data, texture_2d_sampler *sampler) {
     GLuint name;
     GLTRACE(glGenTextures(1, &name));
-    GLTRACE(glBindTexture(GL_TEXTURE_2D, name));
-    GLTRACE(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
-    GLTRACE(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-    GLTRACE(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
-    GLTRACE(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    gl_state_bind_texture(0, name);
+    memset(sampler, 0, sizeof(*sampler));
+    texture_2d_apply_sampler(sampler, GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
     GLTRACE(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data));
     return name;
 }
@@ -177,8 +385,8 @@ texture_2d *texture_2d_new_from_data(int width, int height, const void *data) {
         ++h;
     }
 
-    name = get_tex_from_data(w, h, data);
-    texture_2d *tex = (texture_2d *) malloc(sizeof(texture_2d));
+    texture_2d *tex = (texture_2d *) TAG_MALLOC(MEMORY_TAG_TEXTURES, sizeof(texture_2d));
+    name = get_tex_from_data(w, h, data, &tex->sampler);
     tex->name = name;
     tex->original_name = name;
     tex->originalWidth = width;
@@ -191,15 +399,45 @@ texture_2d *texture_2d_new_from_data(int width, int height, const void *data) {
     tex->is_text = false;
     tex->is_canvas = true;
     tex->saved_data = NULL;
+    tex->saved_size = 0;
+    tex->saved_encoded = false;
+    tex->canvas_dirty = false;
+    tex->regenerable = false;
     tex->pixel_data = NULL;
+    tex->pixel_data_bytes = 0;
+    tex->alpha_mask = NULL;
+    tex->mask_columns = 0;
+    tex->mask_rows = 0;
     tex->loaded = true;
+    tex->decoding = false;
+    tex->preloaded = false;
+    tex->preview = false;
+    tex->id = 0;
+    tex->handle = 0;
+    tex->url_key = 0;
     tex->prev = tex->next = NULL;
+    tex->lru_prev = tex->lru_next = NULL;
     tex->num_channels = 4;
     tex->failed = core_check_gl_error();
     tex->assumed_texture_bytes = width * height * 4;
     tex->used_texture_bytes = 0;
     tex->compression_type = 0;
+    tex->pixel_type = GL_UNSIGNED_BYTE;
+    tex->mip_levels = 1;
+    tex->category = TEXTURE_CATEGORY_WORLD;
+    tex->priority = TEXTURE_PRIORITY_NORMAL;
     tex->frame_epoch = 0;
+    tex->atlas_page = NULL;
+    tex->atlas_x = tex->atlas_y = 0;
+    tex->atlas_width = tex->atlas_height = 0;
+    tex->content_key = 0;
+    tex->share_next = NULL;
+    tex->upload_state = 0;
+    tex->upload_buffer = tex->upload_name = 0;
+    tex->upload_mapping = tex->upload_fence = NULL;
+    tex->spare_name = 0;
+    memset(&tex->spare_sampler, 0, sizeof(tex->spare_sampler));
+    tex->spare_dirty[2] = 0;
     return tex;
 }
 
@@ -220,31 +458,267 @@ void texture_2d_resize_unsafe(texture_2d *tex, int width, int height) {
     tex->originalHeight = height;
 }
 
+/**
+ * @name	texture_2d_apply_sampler
+ * @brief	sets filter / wrap parameters on the currently bound texture,
+ *			skipping the ones the given record says are already set
+ * @param	sampler - (texture_2d_sampler *) sampler state of the bound texture
+ * @param	min_filter - (int) gl minification filter
+ * @param	mag_filter - (int) gl magnification filter
+ * @param	wrap_s - (int) gl wrap mode along s
+ * @param	wrap_t - (int) gl wrap mode along t
+ * @retval	NONE
+ */
+void texture_2d_apply_sampler(texture_2d_sampler *sampler, int min_filter, int mag_filter, int wrap_s, int wrap_t) {
+    if (sampler->min_filter != min_filter) {
+        GLTRACE(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, min_filter));
+        sampler->min_filter = min_filter;
+    }
+    if (sampler->mag_filter != mag_filter) {
+        GLTRACE(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, mag_filter));
+        sampler->mag_filter = mag_filter;
+    }
+    if (sampler->wrap_s != wrap_s) {
+        GLTRACE(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap_s));
+        sampler->wrap_s = wrap_s;
+    }
+    if (sampler->wrap_t != wrap_t) {
+        GLTRACE(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap_t));
+        sampler->wrap_t = wrap_t;
+    }
+}
+
+/**
+ * @name	texture_2d_set_sampler
+ * @brief	sets filter / wrap parameters on the given texture, only touching
+ *			gl when they actually change. may bind the texture to unit 0.
+ * @param	tex - (texture_2d *) texture to set the sampler state of
+ * @param	min_filter - (int) gl minification filter
+ * @param	mag_filter - (int) gl magnification filter
+ * @param	wrap_s - (int) gl wrap mode along s
+ * @param	wrap_t - (int) gl wrap mode along t
+ * @retval	NONE
+ */
+void texture_2d_set_sampler(texture_2d *tex, int min_filter, int mag_filter, int wrap_s, int wrap_t) {
+    texture_2d_sampler *sampler = &tex->sampler;
+
+    // textures shipped with a full mip chain keep sampling it
+    if (tex->mip_levels > 1 && min_filter == GL_LINEAR) {
+        min_filter = GL_LINEAR_MIPMAP_LINEAR;
+    }
+
+    if (sampler->min_filter == min_filter && sampler->mag_filter == mag_filter &&
+        sampler->wrap_s == wrap_s && sampler->wrap_t == wrap_t) {
+        return;
+    }
+
+    gl_state_bind_texture(0, tex->name);
+    texture_2d_apply_sampler(sampler, min_filter, mag_filter, wrap_s, wrap_t);
+}
+
+/**
+ * @name	clamp_region
+ * @brief	rounds a rect out to whole texels inside the texture's image
+ * @param	tex - (const texture_2d *) texture being updated
+ * @param	rect - (const rect_2d *) rect in texels
+ * @param	box - (int *) receives x, y, width and height
+ * @retval	bool - false if nothing of the rect is inside the image
+ */
+static bool clamp_region(const texture_2d *tex, const rect_2d *rect, int *box) {
+    int x0 = (int) floorf(rect->x), y0 = (int) floorf(rect->y);
+    int x1 = (int) ceilf(rect->x + rect->width), y1 = (int) ceilf(rect->y + rect->height);
+    x0 = x0 < 0 ? 0 : x0;
+    y0 = y0 < 0 ? 0 : y0;
+    x1 = x1 > tex->originalWidth ? tex->originalWidth : x1;
+    y1 = y1 > tex->originalHeight ? tex->originalHeight : y1;
+    box[0] = x0;
+    box[1] = y0;
+    box[2] = x1 - x0;
+    box[3] = y1 - y0;
+    return box[2] > 0 && box[3] > 0;
+}
+
+// grows into to cover box, a width of zero is empty
+static void union_region(int *into, const int *box) {
+    if (into[2] <= 0) {
+        memcpy(into, box, sizeof(int) * 4);
+        return;
+    }
+    int x1 = into[0] + into[2] > box[0] + box[2] ? into[0] + into[2] : box[0] + box[2];
+    int y1 = into[1] + into[3] > box[1] + box[3] ? into[1] + into[3] : box[1] + box[3];
+    into[0] = into[0] < box[0] ? into[0] : box[0];
+    into[1] = into[1] < box[1] ? into[1] : box[1];
+    into[2] = x1 - into[0];
+    into[3] = y1 - into[1];
+}
+
+/**
+ * @name	upload_region
+ * @brief	copies a box of the image into the bound texture
+ * @param	pixels - (const unsigned char *) RGBA image
+ * @param	image_width - (int) width of the image in pixels
+ * @param	box - (const int *) x, y, width and height to copy
+ * @retval	bool - false if out of memory
+ */
+static bool upload_region(const unsigned char *pixels, int image_width, const int *box) {
+    const unsigned char *src = pixels + ((size_t) box[1] * image_width + box[0]) * 4;
+    unsigned char *rows = NULL;
+    if (box[2] != image_width) {
+        // gles 2 has no unpack row length, so the rows go up packed together
+        rows = (unsigned char *) malloc((size_t) box[2] * box[3] * 4);
+        if (!rows) {
+            return false;
+        }
+        for (int y = 0; y < box[3]; y++) {
+            memcpy(rows + (size_t) y * box[2] * 4, src + (size_t) y * image_width * 4, (size_t) box[2] * 4);
+        }
+        src = rows;
+    }
+    GLTRACE(glTexSubImage2D(GL_TEXTURE_2D, 0, box[0], box[1], box[2], box[3], GL_RGBA, GL_UNSIGNED_BYTE, src));
+    free(rows);
+    return true;
+}
+
+/**
+ * @name	texture_2d_update_regions
+ * @brief	uploads parts of a new image into the texture, rather than
+ *			making a new texture for it
+ * @param	tex - (texture_2d *) uncompressed RGBA texture with a gl name
+ * @param	pixels - (const void *) RGBA image of the texture's original size
+ * @param	rects - (const rect_2d *) parts that changed, NULL for all of it
+ * @param	count - (int) number of rects
+ * @param	double_buffered - (bool) upload into a second texture and swap
+ *			it in, making the second texture the first time
+ * @retval	bool - false if the texture can't be updated in place
+ */
+bool texture_2d_update_regions(texture_2d *tex, const void *pixels, const rect_2d *rects, int count, bool double_buffered) {
+    if (!pixels || !tex->name || tex->atlas_page || tex->compression_type ||
+        tex->num_channels != 4 || tex->pixel_type != GL_UNSIGNED_BYTE) {
+        return false;
+    }
+
+    const unsigned char *image = (const unsigned char *) pixels;
+    if (double_buffered) {
+        if (!tex->spare_name) {
+            tex->spare_name = get_tex_from_data(tex->width, tex->height, NULL, &tex->spare_sampler);
+            tex->spare_dirty[0] = tex->spare_dirty[1] = 0;
+            tex->spare_dirty[2] = tex->originalWidth;
+            tex->spare_dirty[3] = tex->originalHeight;
+        }
+        gl_state_bind_texture(0, tex->spare_name);
+
+        // the spare first catches up on what went into name since it was swapped out
+        if (tex->spare_dirty[2] > 0 && !upload_region(image, tex->originalWidth, tex->spare_dirty)) {
+            return false;
+        }
+        tex->spare_dirty[2] = 0;
+    } else {
+        gl_state_bind_texture(0, tex->name);
+    }
+
+    int dirty[4] = {0, 0, 0, 0};
+    rect_2d all = {0, 0, (float) tex->originalWidth, (float) tex->originalHeight};
+    for (int i = 0; i < (rects ? count : 1); i++) {
+        int box[4];
+        if (!clamp_region(tex, rects ? &rects[i] : &all, box)) {
+            continue;
+        }
+        if (!upload_region(image, tex->originalWidth, box)) {
+            return false;
+        }
+        union_region(dirty, box);
+    }
+
+    if (double_buffered) {
+        int name = tex->name;
+        texture_2d_sampler sampler = tex->sampler;
+        tex->name = tex->spare_name;
+        tex->sampler = tex->spare_sampler;
+        tex->spare_name = name;
+        tex->spare_sampler = sampler;
+        memcpy(tex->spare_dirty, dirty, sizeof(dirty));
+    } else if (tex->spare_name && dirty[2] > 0) {
+        union_region(tex->spare_dirty, dirty);
+    }
+
+    // a canvas backup taken before is out of date
+    tex->canvas_dirty = true;
+    return true;
+}
+
 /**
  * @name	texture_2d_save
- * @brief	saves a texture's byte data from gl to a buffer held by the texture
+ * @brief	backs up a canvas texture's pixels from gl so texture_2d_reload
+ *			can restore them, reusing the last backup when the canvas was
+ *			not drawn into since
  * @param	tex - (texture_2d *) texture to save data from
  * @retval	NONE
  */
 void texture_2d_save(texture_2d *tex) {
-    free(tex->saved_data);
-    tex->saved_data = (char *)malloc(sizeof(char) * tex->width * tex->height * 4);
+    if (tex->saved_data && !tex->canvas_dirty) {
+        return;
+    }
+
+    TAG_FREE(tex->saved_data);
+    tex->saved_data = NULL;
+    tex->saved_encoded = false;
+
+    long count = (long) tex->width * tex->height;
+    char *pixels = (char *) TAG_MALLOC(MEMORY_TAG_TEXTURES, sizeof(char) * count * 4);
+    if (!pixels) {
+        LOG("{tex} WARNING: Unable to back up canvas %dx%d", tex->width, tex->height);
+        return;
+    }
     tealeaf_canvas_context_2d_bind(tex->ctx);
-    GLTRACE(glReadPixels(0, 0, tex->width, tex->height, GL_RGBA, GL_UNSIGNED_BYTE, tex->saved_data));
-    context_2d *ctx = context_2d_get_onscreen();
-    tealeaf_canvas_bind_render_buffer(ctx);
+    GLTRACE(glReadPixels(0, 0, tex->width, tex->height, GL_RGBA, GL_UNSIGNED_BYTE, pixels));
+    // bind through the context so drawing into the canvas again binds it and marks it dirty
+    tealeaf_canvas_context_2d_bind(context_2d_get_onscreen());
+
+    long encoded_size = 0;
+    uint32_t *encoded = encode_canvas_pixels((const uint32_t *) pixels, count, &encoded_size);
+    if (encoded) {
+        TAG_FREE(pixels);
+        tex->saved_data = (char *) encoded;
+        tex->saved_size = encoded_size;
+        tex->saved_encoded = true;
+    } else {
+        tex->saved_data = pixels;
+        tex->saved_size = count * 4;
+    }
+    tex->canvas_dirty = false;
 }
 
 /**
  * @name	texture_2d_reload
- * @brief	reloads a texture from it's saved texture byte data
+ * @brief	reloads a texture from it's saved texture byte data, or blank
+ *			without a backup
  * @param	tex - (texture_2d *) texture to reload
  * @retval	NONE
  */
 void texture_2d_reload(texture_2d *tex) {
-    tex->name = get_tex_from_data(tex->width, tex->height, tex->saved_data);
-    free(tex->saved_data);
-    tex->saved_data = NULL;
+    long count = (long) tex->width * tex->height;
+    uint32_t *pixels = NULL;
+    if (tex->saved_data && tex->saved_encoded) {
+        pixels = decode_canvas_pixels((const uint32_t *) tex->saved_data, tex->saved_size, count);
+    }
+
+    tex->name = get_tex_from_data(tex->width, tex->height, pixels ? (const void *) pixels : tex->saved_data, &tex->sampler);
+    tex->canvas_dirty = false;
+    if (tex->spare_name) {
+        // blank, so the next double buffered update fills all of it
+        tex->spare_name = get_tex_from_data(tex->width, tex->height, NULL, &tex->spare_sampler);
+        tex->spare_dirty[0] = tex->spare_dirty[1] = 0;
+        tex->spare_dirty[2] = tex->originalWidth;
+        tex->spare_dirty[3] = tex->originalHeight;
+    }
+    free(pixels);
+
+    // small encoded backups stay valid until the canvas is drawn into again
+    if (!tex->saved_encoded || tex->saved_size > count * 4 / CANVAS_BACKUP_KEEP_DIVISOR) {
+        TAG_FREE(tex->saved_data);
+        tex->saved_data = NULL;
+        tex->saved_encoded = false;
+    }
 }
 
 /**
@@ -254,11 +728,202 @@ void texture_2d_reload(texture_2d *tex) {
  * @retval	NONE
  */
 void texture_2d_destroy(texture_2d *tex) {
+    gl_state_texture_deleted(tex->name);
     GLTRACE(glDeleteTextures(1, (const GLuint *)&tex->name));
+    if (tex->spare_name) {
+        gl_state_texture_deleted(tex->spare_name);
+        GLTRACE(glDeleteTextures(1, (const GLuint *)&tex->spare_name));
+    }
     free(tex->url);
+    texture_2d_free_pixel_data(tex);
+    TAG_FREE(tex->alpha_mask);
+    TAG_FREE(tex->saved_data);
+    TAG_FREE(tex);
+}
+
+/**
+ * @name	texture_2d_free_pixel_data
+ * @brief	frees the decoded pixels a texture holds and stops counting them
+ * @param	tex - (texture_2d *) texture holding pixel_data, or none
+ * @retval	NONE
+ */
+void texture_2d_free_pixel_data(texture_2d *tex) {
+    MEMORY_ACCOUNT(MEMORY_TAG_DECODE, -(long long) tex->pixel_data_bytes);
     free(tex->pixel_data);
-    free(tex->saved_data);
-    free(tex);
+    tex->pixel_data = NULL;
+    tex->pixel_data_bytes = 0;
+}
+
+static inline bool mask_cell(const texture_2d *tex, int column, int row) {
+    int stride = (tex->mask_columns + 7) >> 3;
+    return tex->alpha_mask[row * stride + (column >> 3)] & (1 << (column & 7));
+}
+
+/**
+ * @name	texture_2d_build_alpha_mask
+ * @brief	records which TEXTURE_ALPHA_MASK_CELL square cells of the decoded
+ *			pixels have any alpha, so draws can skip their transparent
+ *			parts. Only 8 bit RGBA pixels get a mask
+ * @param	tex - (texture_2d *) texture holding its decoded pixel_data
+ * @retval	NONE
+ */
+void texture_2d_build_alpha_mask(texture_2d *tex) {
+    TAG_FREE(tex->alpha_mask);
+    tex->alpha_mask = NULL;
+    tex->mask_columns = 0;
+    tex->mask_rows = 0;
+    if (!tex->pixel_data || tex->num_channels != 4 || tex->pixel_type != GL_UNSIGNED_BYTE ||
+        tex->compression_type || tex->scale < 1 || tex->scale > 2) {
+        return;
+    }
+
+    // half-sized pixels cover twice the texels
+    int shift = tex->scale - 1;
+    int width = tex->width >> shift;
+    int height = tex->height >> shift;
+    int cell = TEXTURE_ALPHA_MASK_CELL >> shift;
+    int columns = (width + cell - 1) / cell;
+    int rows = (height + cell - 1) / cell;
+    int stride = (columns + 7) >> 3;
+    size_t size = (size_t) stride * rows;
+    unsigned char *mask = (unsigned char *) TAG_CALLOC(MEMORY_TAG_TEXTURES, size ? size : 1, 1);
+    if (!mask) {
+        LOG("{texture} WARNING: Unable to allocate an alpha mask for %s", tex->url);
+        return;
+    }
+
+    for (int y = 0; y < height; y++) {
+        const unsigned char *row = tex->pixel_data + (size_t) y * width * 4;
+        unsigned char *bits = mask + (y / cell) * stride;
+        for (int column = 0; column < columns; column++) {
+            if (bits[column >> 3] & (1 << (column & 7))) {
+                continue;
+            }
+            int end = (column + 1) * cell < width ? (column + 1) * cell : width;
+            for (int x = column * cell; x < end; x++) {
+                if (row[x * 4 + 3]) {
+                    bits[column >> 3] |= 1 << (column & 7);
+                    break;
+                }
+            }
+        }
+    }
+
+    tex->alpha_mask = mask;
+    tex->mask_columns = columns;
+    tex->mask_rows = rows;
+}
+
+/**
+ * @name	texture_2d_trim_rect
+ * @brief	covers the visible part of a source rect with up to max_rects
+ *			horizontal bands, each trimmed to the cells with alpha in it
+ * @param	tex - (const texture_2d *) texture with an alpha mask
+ * @param	src - (const rect_2d *) source rect, in texels of the full size
+ * @param	out - (rect_2d *) receives the bands, inside src
+ * @param	max_rects - (int) room in out
+ * @retval	int - bands written, 0 when src is fully transparent, or -1 when
+ *			the texture has no alpha mask
+ */
+int texture_2d_trim_rect(const texture_2d *tex, const rect_2d *src, rect_2d *out, int max_rects) {
+    if (!tex->alpha_mask || max_rects < 1) {
+        return -1;
+    }
+
+    int c0 = (int) (src->x / TEXTURE_ALPHA_MASK_CELL);
+    int r0 = (int) (src->y / TEXTURE_ALPHA_MASK_CELL);
+    int c1 = (int) ceilf((src->x + src->width) / TEXTURE_ALPHA_MASK_CELL);
+    int r1 = (int) ceilf((src->y + src->height) / TEXTURE_ALPHA_MASK_CELL);
+    c0 = c0 < 0 ? 0 : c0;
+    r0 = r0 < 0 ? 0 : r0;
+    c1 = c1 > tex->mask_columns ? tex->mask_columns : c1;
+    r1 = r1 > tex->mask_rows ? tex->mask_rows : r1;
+
+    // drop the fully transparent rows at either end
+    int first = -1, last = -1;
+    for (int r = r0; r < r1; r++) {
+        for (int c = c0; c < c1; c++) {
+            if (mask_cell(tex, c, r)) {
+                first = first < 0 ? r : first;
+                last = r;
+                break;
+            }
+        }
+    }
+    if (first < 0) {
+        return 0;
+    }
+
+    // each row's columns with alpha, lo > hi for an empty row
+    int rows = last - first + 1;
+    int *lo = (int *) malloc(sizeof(int) * rows * 2);
+    if (!lo) {
+        return -1;
+    }
+    int *hi = lo + rows;
+    for (int r = 0; r < rows; r++) {
+        lo[r] = c1;
+        hi[r] = -1;
+        for (int c = c0; c < c1; c++) {
+            if (mask_cell(tex, c, first + r)) {
+                lo[r] = lo[r] < c1 ? lo[r] : c;
+                hi[r] = c;
+            }
+        }
+    }
+
+    // split the rows into the bands that cover the fewest cells: best[b][r]
+    // is the least area covering rows [0, r) with b + 1 bands, and split
+    // where the last of them starts
+    int bands = rows < max_rects ? rows : max_rects;
+    int *best = (int *) malloc(sizeof(int) * (rows + 1) * bands * 2);
+    if (!best) {
+        free(lo);
+        return -1;
+    }
+    int *split = best + (rows + 1) * bands;
+    for (int b = 0; b < bands; b++) {
+        for (int r = 1; r <= rows; r++) {
+            int *cell = &best[b * (rows + 1) + r];
+            *cell = INT_MAX;
+            int min_c = c1, max_c = -1;
+            // grow the last band up from row r - 1
+            for (int start = r - 1; start >= b; start--) {
+                min_c = lo[start] < min_c ? lo[start] : min_c;
+                max_c = hi[start] > max_c ? hi[start] : max_c;
+                int area = max_c < min_c ? 0 : (r - start) * (max_c - min_c + 1);
+                int before = b ? best[(b - 1) * (rows + 1) + start] : (start ? INT_MAX : 0);
+                if (before != INT_MAX && before + area < *cell) {
+                    *cell = before + area;
+                    split[b * (rows + 1) + r] = start;
+                }
+            }
+        }
+    }
+
+    // walk the splits back from the last row, writing bands bottom up
+    int count = 0;
+    int end = rows;
+    for (int b = bands - 1; b >= 0 && end > 0; b--) {
+        int start = split[b * (rows + 1) + end];
+        int min_c = c1, max_c = -1;
+        for (int r = start; r < end; r++) {
+            min_c = lo[r] < min_c ? lo[r] : min_c;
+            max_c = hi[r] > max_c ? hi[r] : max_c;
+        }
+        if (max_c >= min_c) {
+            float x0 = fmaxf(src->x, (float) (min_c * TEXTURE_ALPHA_MASK_CELL));
+            float y0 = fmaxf(src->y, (float) ((first + start) * TEXTURE_ALPHA_MASK_CELL));
+            float x1 = fminf(src->x + src->width, (float) ((max_c + 1) * TEXTURE_ALPHA_MASK_CELL));
+            float y1 = fminf(src->y + src->height, (float) ((first + end) * TEXTURE_ALPHA_MASK_CELL));
+            rect_2d band = {x0, y0, x1 - x0, y1 - y0};
+            out[count++] = band;
+        }
+        end = start;
+    }
+    free(best);
+    free(lo);
+    return count;
 }
 
 
@@ -270,10 +935,13 @@ void texture_2d_destroy(texture_2d *tex) {
  * it can be used as a texture in the game.  Furthermore, if half-sizing has
  * been requested then the resulting texture will be half of the original size.
  *
- * IF use_halfsized_textures flagged AND
+ * IF use_halfsized_textures (or the texture category's half-size) flagged AND
  *    original width AND height > 64 pixels
  *    THEN perform half-sizing.
  *
+ * IF use_16bit_textures flagged (texture_2d_load_texture_packed only)
+ *    THEN dither RGB down to 565 and RGBA down to 4444 or 5551.
+ *
  * The URL is only provided for use in debug output prints.
  * The input image data and size is raw compressed PNG/JPEG file data.
  *
@@ -292,11 +960,542 @@ void texture_2d_destroy(texture_2d *tex) {
 // Premultiply alpha value
 #define MULT_ALPHA(c, a) (unsigned char)(((unsigned short)( c ) * (unsigned short)( a ) + 128) >> 8)
 
+/*
+ * SIMD kernels for the RGBA loops below.  Each handles as many whole
+ * vectors as fit and returns how many output pixels it wrote; the scalar
+ * loops finish the rest, and both produce identical bytes.
+ */
+
+#if defined(GC_HAS_NEON)
+#include <arm_neon.h>
+
+// Premultiplies count RGBA pixels from in to out, which may be the same
+static int premultiply_rgba_simd(const unsigned char *in, unsigned char *out, int count) {
+    int done = 0;
+    for (; done + 8 <= count; done += 8, in += 32, out += 32) {
+        uint8x8x4_t p = vld4_u8(in);
+        // vrshrn rounds with +128 before the shift, same as MULT_ALPHA
+        p.val[0] = vrshrn_n_u16(vmull_u8(p.val[0], p.val[3]), 8);
+        p.val[1] = vrshrn_n_u16(vmull_u8(p.val[1], p.val[3]), 8);
+        p.val[2] = vrshrn_n_u16(vmull_u8(p.val[2], p.val[3]), 8);
+        vst4_u8(out, p);
+    }
+    return done;
+}
+
+// Sums one channel over 2x2 blocks of two rows, skipping clear pixels
+static inline uint16x8_t sum_2x2(uint8x16_t c0, uint8x16_t c1, uint8x16_t m0, uint8x16_t m1) {
+    return vpadalq_u8(vpaddlq_u8(vandq_u8(c0, m0)), vandq_u8(c1, m1));
+}
+
+// Averages a channel sum over cnt contributing pixels the way the scalar loop does
+static inline uint16x8_t average_2x2(uint16x8_t s, uint16x8_t cnt) {
+    const uint16x8_t one = vdupq_n_u16(1);
+    uint16x8_t t = vaddq_u16(s, one);
+    uint16x8_t d2 = vshrq_n_u16(t, 1);
+    // (t * 0xAAAB) >> 17 is t / 3 for every t a sum can reach
+    uint32x4_t lo = vshrq_n_u32(vmull_u16(vget_low_u16(t), vdup_n_u16(0xAAAB)), 17);
+    uint32x4_t hi = vshrq_n_u32(vmull_u16(vget_high_u16(t), vdup_n_u16(0xAAAB)), 17);
+    uint16x8_t d3 = vcombine_u16(vmovn_u32(lo), vmovn_u32(hi));
+    uint16x8_t d4 = vshrq_n_u16(vaddq_u16(t, one), 2);
+
+    uint16x8_t r = s;
+    r = vbslq_u16(vceqq_u16(cnt, vdupq_n_u16(2)), d2, r);
+    r = vbslq_u16(vceqq_u16(cnt, vdupq_n_u16(3)), d3, r);
+    r = vbslq_u16(vceqq_u16(cnt, vdupq_n_u16(4)), d4, r);
+    return r;
+}
+
+// Averages and premultiplies 2x2 RGBA blocks from row0 / row1 into count output pixels
+static int halfsize_rgba_simd(const unsigned char *row0, const unsigned char *row1, unsigned char *out, int count) {
+    int done = 0;
+    for (; done + 8 <= count; done += 8, row0 += 64, row1 += 64, out += 32) {
+        uint8x16x4_t p0 = vld4q_u8(row0);
+        uint8x16x4_t p1 = vld4q_u8(row1);
+        uint8x16_t m0 = vtstq_u8(p0.val[3], p0.val[3]);
+        uint8x16_t m1 = vtstq_u8(p1.val[3], p1.val[3]);
+        uint16x8_t cnt = vpadalq_u8(vpaddlq_u8(vshrq_n_u8(m0, 7)), vshrq_n_u8(m1, 7));
+
+        uint16x8_t a = average_2x2(sum_2x2(p0.val[3], p1.val[3], m0, m1), cnt);
+        uint16x8_t r = average_2x2(sum_2x2(p0.val[0], p1.val[0], m0, m1), cnt);
+        uint16x8_t g = average_2x2(sum_2x2(p0.val[1], p1.val[1], m0, m1), cnt);
+        uint16x8_t b = average_2x2(sum_2x2(p0.val[2], p1.val[2], m0, m1), cnt);
+
+        uint8x8x4_t o;
+        o.val[0] = vrshrn_n_u16(vmulq_u16(r, a), 8);
+        o.val[1] = vrshrn_n_u16(vmulq_u16(g, a), 8);
+        o.val[2] = vrshrn_n_u16(vmulq_u16(b, a), 8);
+        o.val[3] = vmovn_u16(a);
+        vst4_u8(out, o);
+    }
+    return done;
+}
+
+#elif defined(GC_HAS_SSE)
+#include <emmintrin.h>
+
+// Multiplies the color lanes of two unpacked RGBA pixels by their alpha
+static inline __m128i premultiply_pair(__m128i p, __m128i alpha_lanes) {
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(p, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    __m128i c = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(p, a), _mm_set1_epi16(128)), 8);
+    return _mm_or_si128(_mm_andnot_si128(alpha_lanes, c), _mm_and_si128(alpha_lanes, p));
+}
+
+// Premultiplies count RGBA pixels from in to out, which may be the same
+static int premultiply_rgba_simd(const unsigned char *in, unsigned char *out, int count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha_lanes = _mm_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1);
+    int done = 0;
+    for (; done + 4 <= count; done += 4, in += 16, out += 16) {
+        __m128i p = _mm_loadu_si128((const __m128i *) in);
+        __m128i lo = premultiply_pair(_mm_unpacklo_epi8(p, zero), alpha_lanes);
+        __m128i hi = premultiply_pair(_mm_unpackhi_epi8(p, zero), alpha_lanes);
+        _mm_storeu_si128((__m128i *) out, _mm_packus_epi16(lo, hi));
+    }
+    return done;
+}
+
+// Zeroes the lanes of unpacked RGBA pixels that are clear, returns the lanes kept as 1s in *cnt
+static inline __m128i mask_clear(__m128i p, __m128i *cnt) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(p, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+    __m128i clear = _mm_cmpeq_epi16(a, zero);
+    *cnt = _mm_andnot_si128(clear, _mm_set1_epi16(1));
+    return _mm_andnot_si128(clear, p);
+}
+
+// Averages and premultiplies 2x2 RGBA blocks from row0 / row1 into count output pixels
+static int halfsize_rgba_simd(const unsigned char *row0, const unsigned char *row1, unsigned char *out, int count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i alpha_lanes = _mm_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1);
+    int done = 0;
+    for (; done + 2 <= count; done += 2, row0 += 16, row1 += 16, out += 8) {
+        __m128i p0 = _mm_loadu_si128((const __m128i *) row0);
+        __m128i p1 = _mm_loadu_si128((const __m128i *) row1);
+        __m128i c00, c01, c10, c11;
+        __m128i s0 = _mm_add_epi16(mask_clear(_mm_unpacklo_epi8(p0, zero), &c00), mask_clear(_mm_unpacklo_epi8(p1, zero), &c10));
+        __m128i s1 = _mm_add_epi16(mask_clear(_mm_unpackhi_epi8(p0, zero), &c01), mask_clear(_mm_unpackhi_epi8(p1, zero), &c11));
+        __m128i n0 = _mm_add_epi16(c00, c10);
+        __m128i n1 = _mm_add_epi16(c01, c11);
+
+        // fold the left and right pixel of each block together, one block per half
+        __m128i s = _mm_unpacklo_epi64(_mm_add_epi16(s0, _mm_srli_si128(s0, 8)), _mm_add_epi16(s1, _mm_srli_si128(s1, 8)));
+        __m128i cnt = _mm_unpacklo_epi64(_mm_add_epi16(n0, _mm_srli_si128(n0, 8)), _mm_add_epi16(n1, _mm_srli_si128(n1, 8)));
+
+        // average the way the scalar loop does, (t * 0xAAAB) >> 17 is t / 3 for every t a sum can reach
+        __m128i t = _mm_add_epi16(s, one);
+        __m128i d2 = _mm_srli_epi16(t, 1);
+        __m128i d3 = _mm_srli_epi16(_mm_mulhi_epu16(t, _mm_set1_epi16((short) 0xAAAB)), 1);
+        __m128i d4 = _mm_srli_epi16(_mm_add_epi16(t, one), 2);
+        __m128i m2 = _mm_cmpeq_epi16(cnt, _mm_set1_epi16(2));
+        __m128i m3 = _mm_cmpeq_epi16(cnt, _mm_set1_epi16(3));
+        __m128i m4 = _mm_cmpeq_epi16(cnt, _mm_set1_epi16(4));
+        __m128i avg = _mm_andnot_si128(_mm_or_si128(m2, _mm_or_si128(m3, m4)), s);
+        avg = _mm_or_si128(avg, _mm_and_si128(m2, d2));
+        avg = _mm_or_si128(avg, _mm_and_si128(m3, d3));
+        avg = _mm_or_si128(avg, _mm_and_si128(m4, d4));
+
+        _mm_storel_epi64((__m128i *) out, _mm_packus_epi16(premultiply_pair(avg, alpha_lanes), zero));
+    }
+    return done;
+}
+
+#else
+
+static int premultiply_rgba_simd(const unsigned char *in, unsigned char *out, int count) {
+    return 0;
+}
+
+static int halfsize_rgba_simd(const unsigned char *row0, const unsigned char *row1, unsigned char *out, int count) {
+    return 0;
+}
+
+#endif
+
+// 4x4 ordered dither thresholds
+static const unsigned char BAYER_4X4[4][4] = {
+    { 0, 8, 2, 10 },
+    { 12, 4, 14, 6 },
+    { 3, 11, 1, 9 },
+    { 15, 7, 13, 5 }
+};
+
+// Quantize an 8 bit value down to the given maximum with a dither threshold of 8..248
+#define DITHER(v, max, t) (unsigned short)(((unsigned int)( v ) * ( max ) + ( t )) / 255)
+
+/**
+ * @name	pack_16bit
+ * @brief	converts rasterized RGB / premultiplied RGBA pixels to 16 bit with
+ *			ordered dithering, RGB565 for RGB and RGBA4444 or RGBA5551 for RGBA
+ * @param	pixels - (const unsigned char *) pixels to convert
+ * @param	w - (int) width of the pixels
+ * @param	h - (int) height of the pixels
+ * @param	ch - (int) 3 or 4 channels
+ * @param	mode - (int) TEXTURE_16BIT_* mode
+ * @param	out_pixel_type - (int *) gl pixel type of the result
+ * @retval	unsigned short* - the packed pixels, NULL if allocation failed
+ */
+static unsigned short *pack_16bit(const unsigned char *pixels, int w, int h, int ch, int mode, int *out_pixel_type) {
+    unsigned short *output = (unsigned short *) malloc((size_t) w * h * sizeof(unsigned short));
+    if (!output) {
+        return NULL;
+    }
+
+    unsigned short *out = output;
+    int x, y;
+    if (ch == 3) {
+        *out_pixel_type = GL_UNSIGNED_SHORT_5_6_5;
+        for (y = 0; y < h; ++y) {
+            for (x = 0; x < w; ++x, pixels += 3) {
+                unsigned int t = BAYER_4X4[y & 3][x & 3] * 16 + 8;
+                *out++ = (DITHER(pixels[0], 31, t) << 11) | (DITHER(pixels[1], 63, t) << 5) | DITHER(pixels[2], 31, t);
+            }
+        }
+    } else if (mode == TEXTURE_16BIT_PUNCHTHROUGH) {
+        // one bit alpha is thresholded, not dithered, so edges stay clean
+        *out_pixel_type = GL_UNSIGNED_SHORT_5_5_5_1;
+        for (y = 0; y < h; ++y) {
+            for (x = 0; x < w; ++x, pixels += 4) {
+                unsigned int t = BAYER_4X4[y & 3][x & 3] * 16 + 8;
+                if (pixels[3] < 128) {
+                    *out++ = 0;
+                } else {
+                    *out++ = (DITHER(pixels[0], 31, t) << 11) | (DITHER(pixels[1], 31, t) << 6) | (DITHER(pixels[2], 31, t) << 1) | 1;
+                }
+            }
+        }
+    } else {
+        // the same threshold on every channel keeps premultiplied color within alpha
+        *out_pixel_type = GL_UNSIGNED_SHORT_4_4_4_4;
+        for (y = 0; y < h; ++y) {
+            for (x = 0; x < w; ++x, pixels += 4) {
+                unsigned int t = BAYER_4X4[y & 3][x & 3] * 16 + 8;
+                *out++ = (DITHER(pixels[0], 15, t) << 12) | (DITHER(pixels[1], 15, t) << 8) | (DITHER(pixels[2], 15, t) << 4) | DITHER(pixels[3], 15, t);
+            }
+        }
+    }
+
+    return output;
+}
+
+/**
+ * @name	halfsize_row
+ * @brief	averages two source rows into one row of a half-sized texture,
+ *			premultiplying RGBA and zeroing the padding on the right
+ * @param	row0 - (const unsigned char *) upper source row
+ * @param	row1 - (const unsigned char *) lower source row, row0 again for a final odd row
+ * @param	rowo - (unsigned char *) output row
+ * @param	w_old - (int) source width
+ * @param	w - (int) output width, padding included
+ * @param	ch - (int) 1, 3 or 4 channels
+ * @retval	NONE
+ */
+static void halfsize_row(const unsigned char *row0, const unsigned char *row1, unsigned char *rowo, int w_old, int w, int ch) {
+    const int ROUND_W_OLD = w_old & ~1;
+    const int RIGHT_GAP = (w - ((w_old+1)>>1)) * ch;
+    int x;
+
+    // If RGBA,
+    if (ch == 4) {
+        // Average 2x2 blocks, vectors first
+        const int simd_done = halfsize_rgba_simd(row0, row1, rowo, ROUND_W_OLD >> 1);
+        row0 += simd_done << 3;
+        row1 += simd_done << 3;
+        rowo += simd_done << 2;
+        for (x = simd_done << 1; x < ROUND_W_OLD; x += 2) {
+            // Accumulate pixels with color data, ignore the clear ones
+            unsigned short a0 = row0[3], a1 = row0[7], a2 = row1[3], a3 = row1[7];
+            unsigned short a = 0, r = 0, g = 0, b = 0, acnt = 0;
+            if (a0) {
+                a += a0;
+                ++acnt;
+                r += row0[0];
+                g += row0[1];
+                b += row0[2];
+            }
+            if (a1) {
+                a += a1;
+                ++acnt;
+                r += row0[4];
+                g += row0[5];
+                b += row0[6];
+            }
+            if (a2) {
+                a += a2;
+                ++acnt;
+                r += row1[0];
+                g += row1[1];
+                b += row1[2];
+            }
+            if (a3) {
+                a += a3;
+                ++acnt;
+                r += row1[4];
+                g += row1[5];
+                b += row1[6];
+            }
+
+            // Average the resulting colors
+            switch (acnt) {
+            case 2:
+                a = (a + 1) >> 1;
+                r = (r + 1) >> 1;
+                g = (g + 1) >> 1;
+                b = (b + 1) >> 1;
+                break;
+            case 3:
+                a = (a + 1) / 3;
+                r = (r + 1) / 3;
+                g = (g + 1) / 3;
+                b = (b + 1) / 3;
+                break;
+            case 4:
+                a = (a + 2) >> 2;
+                r = (r + 2) >> 2;
+                g = (g + 2) >> 2;
+                b = (b + 2) >> 2;
+                break;
+            default:
+            case 0:
+            case 1:
+                break;
+            }
+
+            // Premultiply alpha
+            rowo[0] = MULT_ALPHA(r, a);
+            rowo[1] = MULT_ALPHA(g, a);
+            rowo[2] = MULT_ALPHA(b, a);
+            rowo[3] = (unsigned char)a;
+
+            row0 += 8;
+            row1 += 8;
+            rowo += 4;
+        }
+
+        // Average final odd column with row below it
+        if (w_old & 1) {
+            // Accumulate pixels with color data, ignore the clear ones
+            unsigned short a0 = row0[3], a2 = row1[3];
+            unsigned short a = 0, r = 0, g = 0, b = 0, acnt = 0;
+            if (a0) {
+                a += a0;
+                ++acnt;
+                r += row0[0];
+                g += row0[1];
+                b += row0[2];
+            }
+            if (a2) {
+                a += a2;
+                ++acnt;
+                r += row1[0];
+                g += row1[1];
+                b += row1[2];
+            }
+
+            // Average the resulting colors
+            if (acnt == 2) {
+                a = (a + 1) >> 1;
+                r = (r + 1) >> 1;
+                g = (g + 1) >> 1;
+                b = (b + 1) >> 1;
+            }
+
+            // Premultiply alpha
+            rowo[0] = MULT_ALPHA(r, a);
+            rowo[1] = MULT_ALPHA(g, a);
+            rowo[2] = MULT_ALPHA(b, a);
+            rowo[3] = (unsigned char)a;
+
+            rowo += 4;
+        }
+    } else if (ch == 3) { // RGB
+        // Average 2x2 blocks
+        for (x = 0; x < ROUND_W_OLD; x += 2) {
+            rowo[0] = COLOR_AVG4(row0[0], row0[3], row1[0], row1[3]);
+            rowo[1] = COLOR_AVG4(row0[1], row0[4], row1[1], row1[4]);
+            rowo[2] = COLOR_AVG4(row0[2], row0[5], row1[2], row1[5]);
+
+            row0 += 6;
+            row1 += 6;
+            rowo += 3;
+        }
+
+        // Average final odd column with row below it
+        if (w_old & 1) {
+            rowo[0] = COLOR_AVG2(row0[0], row1[0]);
+            rowo[1] = COLOR_AVG2(row0[1], row1[1]);
+            rowo[2] = COLOR_AVG2(row0[2], row1[2]);
+
+            rowo += 3;
+        }
+    } else { // ch == 1
+        // Monochrome: 1 byte/pixel color
+        // Natively compatible with GL_LUMINANCE
+        for (x = 0; x < ROUND_W_OLD; x += 2) {
+            rowo[0] = COLOR_AVG4(row0[0], row0[1], row1[0], row1[1]);
+
+            row0 += 2;
+            row1 += 2;
+            rowo += 1;
+        }
+
+        // Average final odd column with row below it
+        if (w_old & 1) {
+            rowo[0] = COLOR_AVG2(row0[0], row1[0]);
+
+            rowo += 1;
+        }
+    }
+
+    // Zero out the right gap
+    memset(rowo, 0, RIGHT_GAP);
+}
+
+/**
+ * @name	copy_row
+ * @brief	copies a source row into a full-sized texture row, premultiplying
+ *			RGBA and zeroing the padding on the right
+ * @param	rowi - (const unsigned char *) source row, may be rowo
+ * @param	rowo - (unsigned char *) output row
+ * @param	w_old - (int) source width
+ * @param	w - (int) output width, padding included
+ * @param	ch - (int) 1, 3 or 4 channels
+ * @retval	NONE
+ */
+static void copy_row(const unsigned char *rowi, unsigned char *rowo, int w_old, int w, int ch) {
+    const int RIGHT_GAP = (w - w_old) * ch;
+
+    // If RGBA,
+    if (ch == 4) {
+        const int simd_done = premultiply_rgba_simd(rowi, rowo, w_old);
+        rowi += simd_done << 2;
+        rowo += simd_done << 2;
+        int x;
+        for (x = simd_done; x < w_old; ++x) {
+            // Copy and pre-multiply alpha
+            unsigned short a = rowi[3];
+            rowo[0] = MULT_ALPHA(rowi[0], a);
+            rowo[1] = MULT_ALPHA(rowi[1], a);
+            rowo[2] = MULT_ALPHA(rowi[2], a);
+            rowo[3] = a;
+
+            rowi += 4;
+            rowo += 4;
+        }
+    } else {
+        // 1 and 3 -channel rows are copied without changes
+        const int W_OLD_BYTES = w_old * ch;
+        if (rowi != rowo) {
+            memcpy(rowo, rowi, W_OLD_BYTES);
+        }
+        rowo += W_OLD_BYTES;
+    }
+
+    // Zero out the right gap
+    memset(rowo, 0, RIGHT_GAP);
+}
+
+/**
+ * @name	fill_texture_rows
+ * @brief	writes the rows of a texture from either an image decoded up front
+ *			or one still being decoded, so a streamed image goes straight
+ *			into the texture without a full-size copy in between
+ * @param	decoder - (image_decoder *) decoder to read rows from, or NULL
+ * @param	bits - (unsigned char *) decoded image when decoder is NULL, reused
+ *			as the output when no padding or scaling is needed
+ * @param	w_old - (int) width of the decoded rows
+ * @param	h_old - (int) number of decoded rows
+ * @param	ch - (int) 1, 3 or 4 channels
+ * @param	w - (int) texture width
+ * @param	h - (int) texture height
+ * @param	scale - (int) 2 to half-size the image, 1 otherwise
+ * @retval	unsigned char* - texture pixels, NULL on failure
+ */
+static unsigned char *fill_texture_rows(image_decoder *decoder, unsigned char *bits, int w_old, int h_old, int ch, int w, int h, int scale) {
+    const int OLD_STRIDE = w_old * ch;
+    const int STRIDE = w * ch;
+
+    unsigned char *output;
+    if (bits && w == w_old && h == h_old) {
+        // Re-use image data already at the right size and scale
+        output = bits;
+    } else {
+#ifdef __ANDROID__
+        output = memalign(8, (size_t) STRIDE * h);
+        if (!output) {
+#else
+        if (0 != posix_memalign((void**)&output, 8, (size_t) STRIDE * h)) {
+#endif
+            LOG("{resources} WARNING: Unable to allocate reformatted image w=%d, h=%d", w, h);
+            return NULL;
+        }
+    }
+
+    // Half-sizing a streamed image only ever holds two of its rows
+    unsigned char *rows = NULL;
+    if (decoder && scale == 2) {
+        rows = (unsigned char *) malloc((size_t) OLD_STRIDE * 2);
+        if (!rows) {
+            LOG("{resources} WARNING: Unable to allocate image rows w=%d", w_old);
+            free(output);
+            return NULL;
+        }
+    }
+
+    unsigned char *rowo = output;
+    int y, rows_out;
+    if (scale == 2) {
+        for (y = 0; y < h_old; y += 2, rowo += STRIDE) {
+            const int pair = y + 1 < h_old ? 2 : 1;
+            const unsigned char *row0;
+            if (decoder) {
+                if (!image_decoder_read_rows(decoder, rows, OLD_STRIDE, pair)) {
+                    free(rows);
+                    free(output);
+                    return NULL;
+                }
+                row0 = rows;
+            } else {
+                row0 = bits + (size_t) y * OLD_STRIDE;
+            }
+
+            // Final odd row is averaged with itself
+            halfsize_row(row0, pair == 2 ? row0 + OLD_STRIDE : row0, rowo, w_old, w, ch);
+        }
+        rows_out = (h_old + 1) >> 1;
+    } else {
+        for (y = 0; y < h_old; ++y, rowo += STRIDE) {
+            const unsigned char *rowi;
+            if (decoder) {
+                // Decode in place, premultiplying and padding fix it up after
+                if (!image_decoder_read_rows(decoder, rowo, STRIDE, 1)) {
+                    free(output);
+                    return NULL;
+                }
+                rowi = rowo;
+            } else {
+                rowi = bits + (size_t) y * OLD_STRIDE;
+            }
+            copy_row(rowi, rowo, w_old, w, ch);
+        }
+        rows_out = h_old;
+    }
+
+    // Zero out the bottom gap
+    memset(rowo, 0, (size_t) (h - rows_out) * STRIDE);
+
+    free(rows);
+    return output;
+}
+
 // Load texture from raw image data, returning null on failure to load
-unsigned char *texture_2d_load_texture_raw(const char *url, const void *data, unsigned long sz, int *out_channels, int *out_width, int *out_height, int *out_originalWidth, int *out_originalHeight, int *out_scale, long *out_size, int *out_compression_type) {
+static unsigned char *load_texture_raw(const char *url, const void *data, unsigned long sz, int *out_channels, int *out_width, int *out_height, int *out_originalWidth, int *out_originalHeight, int *out_scale, long *out_size, int *out_compression_type, bool halfsize, int packed_mode, int *out_pixel_type) {
 
     // Initially null pixel data
     unsigned char *pixel_data = NULL;
+    *out_pixel_type = GL_UNSIGNED_BYTE;
+    long long start = profiler_now();
 
     //if we don't get data back from this, we need to load from java
     if (!data) {
@@ -304,11 +1503,18 @@ unsigned char *texture_2d_load_texture_raw(const char *url, const void *data, un
         return NULL;
     }
 
-    // Process file data (PNG/JPEG) into rasterized image data in file format
+    // PNG and JPEG rows are decoded straight into the texture pixels, other
+    // files (and interlaced PNG) are decoded whole first
     int w_old = 0, h_old = 0, ch = 0;
-    unsigned char *bits = load_image_from_memory((unsigned char*)data, (long)sz, &w_old, &h_old, &ch, out_size, out_compression_type);
-    if (bits == NULL) {
-        return NULL;
+    unsigned char *bits = NULL;
+    image_decoder *decoder = image_decoder_open((const unsigned char*)data, (long)sz, &w_old, &h_old, &ch);
+    if (decoder) {
+        *out_compression_type = 0;
+    } else {
+        bits = load_image_from_memory((unsigned char*)data, (long)sz, &w_old, &h_old, &ch, out_size, out_compression_type);
+        if (bits == NULL) {
+            return NULL;
+        }
     }
     *out_channels = ch;
     *out_originalWidth = w_old;
@@ -318,6 +1524,7 @@ unsigned char *texture_2d_load_texture_raw(const char *url, const void *data, un
         *out_width = w_old;
         *out_height = h_old;
         *out_scale = 1;
+        load_stats_since(LOAD_STAGE_DECODE, start);
         return bits;
     } else {
         switch (ch) {
@@ -330,6 +1537,9 @@ unsigned char *texture_2d_load_texture_raw(const char *url, const void *data, un
             // Monochrome: 2 byte/pixel: first for color, second for alpha
             // TODO: Needs to be converted up to RGBA to work with OpenGL
             LOG("{resources} WARNING: Unable to work with %d-channel image. Please convert this file to another format: %s", ch, url);
+            if (decoder) {
+                image_decoder_close(decoder);
+            }
             free(bits);
             return NULL;
         }
@@ -338,6 +1548,9 @@ unsigned char *texture_2d_load_texture_raw(const char *url, const void *data, un
     // Catch invalid image dimensions
     if (w_old <= 0 || h_old <= 0) {
         LOG("{resources} WARNING: Invalid image dimensions w=%d, h=%d", w_old, h_old);
+        if (decoder) {
+            image_decoder_close(decoder);
+        }
         free(bits);
         return NULL;
     }
@@ -345,15 +1558,13 @@ unsigned char *texture_2d_load_texture_raw(const char *url, const void *data, un
     // Now we post-process the image data into our internal memory format:
 
     int w = w_old, h = h_old;
-    bool reformatted = false;
 #ifdef VERBOSE_LOAD_TEX
     bool debug_is_half = false, debug_is_po2_w = false, debug_is_po2_h = false;
 #endif
 
     // If texture should be half-sized,
     int scale = 1;
-    if (use_halfsized_textures && (h > 64 && w > 64)) {
-        reformatted = true;
+    if (halfsize && (h > 64 && w > 64)) {
         scale = 2;
 
         // Scale width and height if needed, rounding up (must happen)
@@ -368,7 +1579,7 @@ unsigned char *texture_2d_load_texture_raw(const char *url, const void *data, un
 
     // Width: If at least 2 bits are set (is not power-of-2),
     // NOTE: This is unlikely so the if-statement is worthwhile
-    if ((w & (w-1))) {
+    if (!m_npot_supported && (w & (w-1))) {
         // Bump it up to the next power of 2 (stays the same if already po2)
         // NOTE: Result of w == 0 is 0
         --w;
@@ -378,7 +1589,6 @@ unsigned char *texture_2d_load_texture_raw(const char *url, const void *data, un
         w |= w >> 8;
         w |= w >> 16;
         ++w;
-        reformatted = true;
 
 #ifdef VERBOSE_LOAD_TEX
         debug_is_po2_w = true;
@@ -386,7 +1596,7 @@ unsigned char *texture_2d_load_texture_raw(const char *url, const void *data, un
     }
 
     // Height: If at least 2 bits are set (is not power-of-2),
-    if ((h & (h-1))) {
+    if (!m_npot_supported && (h & (h-1))) {
         // Bump it up to the next power of 2 (stays the same if already po2)
         --h;
         h |= h >> 1;
@@ -395,7 +1605,6 @@ unsigned char *texture_2d_load_texture_raw(const char *url, const void *data, un
         h |= h >> 8;
         h |= h >> 16;
         ++h;
-        reformatted = true;
 
 #ifdef VERBOSE_LOAD_TEX
         debug_is_po2_h = true;
@@ -410,434 +1619,112 @@ unsigned char *texture_2d_load_texture_raw(const char *url, const void *data, un
     *out_width = w << (scale - 1);
     *out_height = h << (scale - 1);
 
-    // If the image was reformatted,
-    if (reformatted) {
-#ifdef __ANDROID__
-        unsigned char *output = memalign(8, w * h * ch);
-        if (!output) {
-#else
-        unsigned char *output;
-        if (0 != posix_memalign((void**)&output, 8, w * h * ch)) {
-#endif
-            LOG("{resources} WARNING: Unable to allocate reformatted image w=%d, h=%d", w, h);
-            free(bits);
+    // Report what the gl texture will hold, padding and half-sizing included
+    *out_size = (long)w * h * ch;
+
+    // A JPEG decoder can half-size in the DCT, leaving only padding to do
+    int src_w = w_old, src_h = h_old, fill_scale = scale;
+    if (decoder) {
+        if (!image_decoder_start(decoder, scale, &src_w, &src_h)) {
+            image_decoder_close(decoder);
             return NULL;
         }
-        const unsigned char *rowi = bits;
-        unsigned char *rowo = output;
-        int x, y;
-
-        // If scaling,
-        if (scale == 2) {
-            // If RGBA,
-            if (ch == 4) {
-                const int OLD_STRIDE = w_old << 2;
-                const int RIGHT_GAP = (w - ((w_old+1)>>1)) << 2;
-                const int ROUND_W_OLD = w_old & ~1;
-                const int ROUND_H_OLD = h_old & ~1;
-#ifdef VERBOSE_LOAD_TEX
-                LOG("{resources} Processing: Scaling RGBA oddWidth=%d, oddHeight=%d, oldStride=%d, rightGap=%d, roundWOld=%d, roundHOld=%d", (int)(w_old&1), (int)(h_old&1), OLD_STRIDE, RIGHT_GAP, ROUND_W_OLD, ROUND_H_OLD);
-#endif
-
-                for (y = 0; y < ROUND_H_OLD; y += 2, rowi += OLD_STRIDE) {
-                    // Average 2x2 blocks
-                    for (x = 0; x < ROUND_W_OLD; x += 2) {
-                        // Accumulate pixels with color data, ignore the clear ones
-                        unsigned short a0 = rowi[3], a1 = rowi[7], a2 = rowi[OLD_STRIDE+3], a3 = rowi[OLD_STRIDE+7];
-                        unsigned short a = 0, r = 0, g = 0, b = 0, acnt = 0;
-                        if (a0) {
-                            a += a0;
-                            ++acnt;
-                            r += rowi[0];
-                            g += rowi[1];
-                            b += rowi[2];
-                        }
-                        if (a1) {
-                            a += a1;
-                            ++acnt;
-                            r += rowi[4];
-                            g += rowi[5];
-                            b += rowi[6];
-                        }
-                        if (a2) {
-                            a += a2;
-                            ++acnt;
-                            r += rowi[OLD_STRIDE];
-                            g += rowi[OLD_STRIDE+1];
-                            b += rowi[OLD_STRIDE+2];
-                        }
-                        if (a3) {
-                            a += a3;
-                            ++acnt;
-                            r += rowi[OLD_STRIDE+4];
-                            g += rowi[OLD_STRIDE+5];
-                            b += rowi[OLD_STRIDE+6];
-                        }
-
-                        // Average the resulting colors
-                        switch (acnt) {
-                        case 2:
-                            a = (a + 1) >> 1;
-                            r = (r + 1) >> 1;
-                            g = (g + 1) >> 1;
-                            b = (b + 1) >> 1;
-                            break;
-                        case 3:
-                            a = (a + 1) / 3;
-                            r = (r + 1) / 3;
-                            g = (g + 1) / 3;
-                            b = (b + 1) / 3;
-                            break;
-                        case 4:
-                            a = (a + 2) >> 2;
-                            r = (r + 2) >> 2;
-                            g = (g + 2) >> 2;
-                            b = (b + 2) >> 2;
-                            break;
-                        default:
-                        case 0:
-                        case 1:
-                            break;
-                        }
-
-                        // Premultiply alpha
-                        rowo[0] = MULT_ALPHA(r, a);
-                        rowo[1] = MULT_ALPHA(g, a);
-                        rowo[2] = MULT_ALPHA(b, a);
-                        rowo[3] = (unsigned char)a;
-
-                        rowi += 8;
-                        rowo += 4;
-                    }
-
-                    // Average final odd column with row below it
-                    if (w_old & 1) {
-                        // Accumulate pixels with color data, ignore the clear ones
-                        unsigned short a0 = rowi[3], a2 = rowi[OLD_STRIDE+3];
-                        unsigned short a = 0, r = 0, g = 0, b = 0, acnt = 0;
-                        if (a0) {
-                            a += a0;
-                            ++acnt;
-                            r += rowi[0];
-                            g += rowi[1];
-                            b += rowi[2];
-                        }
-                        if (a2) {
-                            a += a2;
-                            ++acnt;
-                            r += rowi[OLD_STRIDE];
-                            g += rowi[OLD_STRIDE+1];
-                            b += rowi[OLD_STRIDE+2];
-                        }
-
-                        // Average the resulting colors
-                        if (acnt == 2) {
-                            a = (a + 1) >> 1;
-                            r = (r + 1) >> 1;
-                            g = (g + 1) >> 1;
-                            b = (b + 1) >> 1;
-                        }
-
-                        // Premultiply alpha
-                        rowo[0] = MULT_ALPHA(r, a);
-                        rowo[1] = MULT_ALPHA(g, a);
-                        rowo[2] = MULT_ALPHA(b, a);
-                        rowo[3] = (unsigned char)a;
-
-                        rowi += 4;
-                        rowo += 4;
-                    }
-
-                    // Zero out the right gap
-                    memset(rowo, 0, RIGHT_GAP);
-                    rowo += RIGHT_GAP;
-                }
-
-                // Average final odd row with itself
-                if (h_old & 1) {
-                    // Average 1x2 blocks
-                    for (x = 0; x < ROUND_W_OLD; x += 2) {
-                        // Accumulate pixels with color data, ignore the clear ones
-                        unsigned short a0 = rowi[3], a1 = rowi[7];
-                        unsigned short a = 0, r = 0, g = 0, b = 0, acnt = 0;
-                        if (a0) {
-                            a += a0;
-                            ++acnt;
-                            r += rowi[0];
-                            g += rowi[1];
-                            b += rowi[2];
-                        }
-                        if (a1) {
-                            a += a1;
-                            ++acnt;
-                            r += rowi[4];
-                            g += rowi[5];
-                            b += rowi[6];
-                        }
-
-                        // Average the resulting colors
-                        if (acnt == 2) {
-                            a = (a + 1) >> 1;
-                            r = (r + 1) >> 1;
-                            g = (g + 1) >> 1;
-                            b = (b + 1) >> 1;
-                        }
-
-                        // Premultiply alpha
-                        rowo[0] = MULT_ALPHA(r, a);
-                        rowo[1] = MULT_ALPHA(g, a);
-                        rowo[2] = MULT_ALPHA(b, a);
-                        rowo[3] = (unsigned char)a;
-
-                        rowi += 8;
-                        rowo += 4;
-                    }
-
-                    // Direct copy final pixel
-                    if (w_old & 1) {
-                        // Premultiply alpha
-                        unsigned short a = rowi[3];
-                        rowo[0] = MULT_ALPHA(rowi[0], a);
-                        rowo[1] = MULT_ALPHA(rowi[1], a);
-                        rowo[2] = MULT_ALPHA(rowi[2], a);
-                        rowo[3] = (unsigned char)a;
-
-                        //rowi += 4;
-                        rowo += 4;
-                    }
-
-                    // Zero out the right gap
-                    memset(rowo, 0, RIGHT_GAP);
-                    rowo += RIGHT_GAP;
-                }
-
-                // Zero out the bottom gap
-                const int BOTTOM_GAP = (h - ((h_old+1)>>1)) * (w << 2);
-                memset(rowo, 0, BOTTOM_GAP);
-            } else if (ch == 3) { // RGB
-                const int OLD_STRIDE = w_old * 3;
-                const int RIGHT_GAP = (w - ((w_old+1)>>1)) * 3;
-                const int ROUND_W_OLD = w_old & ~1;
-                const int ROUND_H_OLD = h_old & ~1;
-#ifdef VERBOSE_LOAD_TEX
-                LOG("{resources} Processing: Scaling RGB oddWidth=%d, oddHeight=%d, oldStride=%d, rightGap=%d, roundWOld=%d, roundHOld=%d", (int)(w_old&1), (int)(h_old&1), OLD_STRIDE, RIGHT_GAP, ROUND_W_OLD, ROUND_H_OLD);
-#endif
-
-                for (y = 0; y < ROUND_H_OLD; y += 2, rowi += OLD_STRIDE) {
-                    // Average 2x2 blocks
-                    for (x = 0; x < ROUND_W_OLD; x += 2) {
-                        rowo[0] = COLOR_AVG4(rowi[0], rowi[3], rowi[OLD_STRIDE], rowi[OLD_STRIDE+3]);
-                        rowo[1] = COLOR_AVG4(rowi[1], rowi[4], rowi[OLD_STRIDE+1], rowi[OLD_STRIDE+4]);
-                        rowo[2] = COLOR_AVG4(rowi[2], rowi[5], rowi[OLD_STRIDE+2], rowi[OLD_STRIDE+5]);
-
-                        rowi += 6;
-                        rowo += 3;
-                    }
-
-                    // Average final odd column with row below it
-                    if (w_old & 1) {
-                        rowo[0] = COLOR_AVG2(rowi[0], rowi[OLD_STRIDE]);
-                        rowo[1] = COLOR_AVG2(rowi[1], rowi[OLD_STRIDE+1]);
-                        rowo[2] = COLOR_AVG2(rowi[2], rowi[OLD_STRIDE+2]);
-
-                        rowi += 3;
-                        rowo += 3;
-                    }
-
-                    // Zero out the right gap
-                    memset(rowo, 0, RIGHT_GAP);
-                    rowo += RIGHT_GAP;
-                }
-
-                // Average final odd row with itself
-                if (h_old & 1) {
-                    // Average 1x2 blocks
-                    for (x = 0; x < ROUND_W_OLD; x += 2) {
-                        rowo[0] = COLOR_AVG2(rowi[0], rowi[3]);
-                        rowo[1] = COLOR_AVG2(rowi[1], rowi[4]);
-                        rowo[2] = COLOR_AVG2(rowi[2], rowi[5]);
-
-                        rowi += 6;
-                        rowo += 3;
-                    }
-
-                    // Direct copy final pixel
-                    if (w_old & 1) {
-                        rowo[0] = rowi[0];
-                        rowo[1] = rowi[1];
-                        rowo[2] = rowi[2];
-
-                        //rowi += 3;
-                        rowo += 3;
-                    }
-
-                    // Zero out the right gap
-                    memset(rowo, 0, RIGHT_GAP);
-                    rowo += RIGHT_GAP;
-                }
-
-                // Zero out the bottom gap
-                const int BOTTOM_GAP = (h - ((h_old+1)>>1)) * w * 3;
-                memset(rowo, 0, BOTTOM_GAP);
-            } else { // ch == 1
-                // Monochrome: 1 byte/pixel color
-                // Natively compatible with GL_LUMINANCE
-                const int OLD_STRIDE = w_old;
-                const int RIGHT_GAP = (w - ((w_old+1)>>1));
-                const int ROUND_W_OLD = w_old & ~1;
-                const int ROUND_H_OLD = h_old & ~1;
-#ifdef VERBOSE_LOAD_TEX
-                LOG("{resources} Processing: Scaling Monochrome oddWidth=%d, oddHeight=%d, oldStride=%d, rightGap=%d, roundWOld=%d, roundHOld=%d", (int)(w_old&1), (int)(h_old&1), OLD_STRIDE, RIGHT_GAP, ROUND_W_OLD, ROUND_H_OLD);
-#endif
-
-                for (y = 0; y < ROUND_H_OLD; y += 2, rowi += OLD_STRIDE) {
-                    // Average 2x2 blocks
-                    for (x = 0; x < ROUND_W_OLD; x += 2) {
-                        rowo[0] = COLOR_AVG4(rowi[0], rowi[1], rowi[OLD_STRIDE], rowi[OLD_STRIDE+1]);
-
-                        rowi += 2;
-                        rowo += 1;
-                    }
-
-                    // Average final odd column with row below it
-                    if (w_old & 1) {
-                        rowo[0] = COLOR_AVG2(rowi[0], rowi[OLD_STRIDE]);
-
-                        rowi += 1;
-                        rowo += 1;
-                    }
-
-                    // Zero out the right gap
-                    memset(rowo, 0, RIGHT_GAP);
-                    rowo += RIGHT_GAP;
-                }
-
-                // Average final odd row with itself
-                if (h_old & 1) {
-                    // Average 1x2 blocks
-                    for (x = 0; x < ROUND_W_OLD; x += 2) {
-                        rowo[0] = COLOR_AVG2(rowi[0], rowi[1]);
-
-                        rowi += 2;
-                        rowo += 1;
-                    }
 
-                    // Direct copy final pixel
-                    if (w_old & 1) {
-                        rowo[0] = rowi[0];
-
-                        //rowi += 1;
-                        rowo += 1;
-                    }
-
-                    // Zero out the right gap
-                    memset(rowo, 0, RIGHT_GAP);
-                    rowo += RIGHT_GAP;
-                }
-
-                // Zero out the bottom gap
-                const int BOTTOM_GAP = (h - ((h_old+1)>>1)) * w;
-                memset(rowo, 0, BOTTOM_GAP);
-            }
-        } else { // Unscaled: Made a power of 2
-            // If RGBA,
-            if (ch == 4) {
-#ifdef VERBOSE_LOAD_TEX
-                LOG("{resources} Processing: Unscaled RGBA");
-#endif
-                const int RIGHT_GAP = (w - w_old) << 2;
-
-                for (y = 0; y < h_old; ++y) {
-                    for (x = 0; x < w_old; ++x) {
-                        // Copy and pre-multiply alpha
-                        unsigned short a = rowi[3];
-                        rowo[0] = MULT_ALPHA(rowi[0], a);
-                        rowo[1] = MULT_ALPHA(rowi[1], a);
-                        rowo[2] = MULT_ALPHA(rowi[2], a);
-                        rowo[3] = a;
-
-                        rowi += 4;
-                        rowo += 4;
-                    }
-
-                    // Zero out the right gap
-                    memset(rowo, 0, RIGHT_GAP);
-                    rowo += RIGHT_GAP;
-                }
-
-                // Zero out the bottom gap
-                memset(rowo, 0, (h - h_old) * (w << 2));
-            } else if (ch == 3) { // RGB
-#ifdef VERBOSE_LOAD_TEX
-                LOG("{resources} Processing: Unscaled RGB");
-#endif
-                const int W_OLD_BYTES = w_old * 3;
-                const int W_BYTES = w * 3;
-                const int RIGHT_GAP = W_BYTES - W_OLD_BYTES;
-
-                for (y = 0; y < h_old; ++y, rowi += W_OLD_BYTES) {
-                    // Copy full row without changes
-                    memcpy(rowo, rowi, W_OLD_BYTES);
-                    rowo += W_OLD_BYTES;
-
-                    // Zero out the right gap
-                    memset(rowo, 0, RIGHT_GAP);
-                    rowo += RIGHT_GAP;
-                }
-
-                // Zero out the bottom gap
-                memset(rowo, 0, (h - h_old) * W_BYTES);
-            } else { // ch == 1
-#ifdef VERBOSE_LOAD_TEX
-                LOG("{resources} Processing: Unscaled Monochrome");
-#endif
-                const int W_OLD_BYTES = w_old;
-                const int W_BYTES = w;
-                const int RIGHT_GAP = W_BYTES - W_OLD_BYTES;
-
-                for (y = 0; y < h_old; ++y, rowi += W_OLD_BYTES) {
-                    // Copy full row without changes
-                    memcpy(rowo, rowi, W_OLD_BYTES);
-                    rowo += W_OLD_BYTES;
-
-                    // Zero out the right gap
-                    memset(rowo, 0, RIGHT_GAP);
-                    rowo += RIGHT_GAP;
-                }
-
-                // Zero out the bottom gap
-                memset(rowo, 0, (h - h_old) * W_BYTES);
+        if (src_w != w_old || src_h != h_old) {
+            if (scale != 2 || src_w != (w_old + 1) >> 1 || src_h != (h_old + 1) >> 1) {
+                LOG("{resources} WARNING: Unexpected decoded size w=%d, h=%d: %s", src_w, src_h, url);
+                image_decoder_close(decoder);
+                return NULL;
             }
+            fill_scale = 1;
         }
+    }
 
+    pixel_data = fill_texture_rows(decoder, bits, src_w, src_h, ch, w, h, fill_scale);
+    if (decoder) {
+        image_decoder_close(decoder);
+    }
+    if (pixel_data != bits) {
         free(bits);
+    }
+    if (!pixel_data) {
+        LOG("{resources} WARNING: Unable to decode image: %s", url);
+        return NULL;
+    }
 
-        pixel_data = output;
-    } else {
-        // Re-use image data already at the right size and scale:
+    load_stats_since(LOAD_STAGE_DECODE, start);
+
+    // Optionally trade color depth for half the texture memory
+    if (packed_mode != TEXTURE_16BIT_OFF && ch != 1) {
+        start = profiler_now();
+        unsigned short *packed = pack_16bit(pixel_data, w, h, ch, packed_mode, out_pixel_type);
+        if (packed) {
+            free(pixel_data);
+            pixel_data = (unsigned char *) packed;
+            *out_size = (long)w * h * 2;
+        } else {
+            LOG("{resources} WARNING: Unable to allocate 16 bit image w=%d, h=%d", w, h);
+        }
+        load_stats_since(LOAD_STAGE_REFORMAT, start);
+    }
 
-        if (ch == 4) {
-#ifdef VERBOSE_LOAD_TEX
-            LOG("{resources} Processing: Unformatted RGBA");
-#endif
-            unsigned char *row = bits;
-            unsigned int bytes = w * h;
+    return pixel_data;
+}
 
-            while (bytes--) {
-                // Premultiply alpha
-                unsigned short a = row[3];
-                row[0] = MULT_ALPHA(row[0], a);
-                row[1] = MULT_ALPHA(row[1], a);
-                row[2] = MULT_ALPHA(row[2], a);
+unsigned char *texture_2d_load_texture_raw(const char *url, const void *data, unsigned long sz, int *out_channels, int *out_width, int *out_height, int *out_originalWidth, int *out_originalHeight, int *out_scale, long *out_size, int *out_compression_type) {
+    int pixel_type;
+    return load_texture_raw(url, data, sz, out_channels, out_width, out_height, out_originalWidth, out_originalHeight, out_scale, out_size, out_compression_type, use_halfsized_textures, TEXTURE_16BIT_OFF, &pixel_type);
+}
 
-                row += 4;
-            }
-        }
-        // 1 and 3 -channel images do not need any modification here
+/**
+ * @name	texture_2d_load_texture_packed
+ * @brief	loads texture pixels like texture_2d_load_texture_raw, converting
+ *			them to 16 bits per pixel when use_16bit_textures is set
+ * @param	halfsize - (bool) whether to half-size the image
+ * @param	out_pixel_type - (int *) gl pixel type of the returned pixels
+ * @retval	unsigned char* - rasterized pixel data, NULL on failure to load
+ */
+unsigned char *texture_2d_load_texture_packed(const char *url, const void *data, unsigned long sz, int *out_channels, int *out_width, int *out_height, int *out_originalWidth, int *out_originalHeight, int *out_scale, long *out_size, int *out_compression_type, bool halfsize, int *out_pixel_type) {
+    return load_texture_raw(url, data, sz, out_channels, out_width, out_height, out_originalWidth, out_originalHeight, out_scale, out_size, out_compression_type, halfsize, use_16bit_textures, out_pixel_type);
+}
 
-        pixel_data = bits;
+/**
+ * @name	texture_2d_load_texture_from_file
+ * @brief	loads texture pixels like texture_2d_load_texture_packed from a
+ *			bundled file. the decoders read the asset pack or the
+ *			platform's mapping of the file directly, it is only copied into
+ *			memory when it is compressed in the pack or can't be mapped.
+ *			for resource_loader_load_image_with_c implementations
+ * @param	url - (const char *) url of the bundled image
+ * @param	out_pixel_type - (int *) gl pixel type of the returned pixels
+ * @retval	unsigned char* - rasterized pixel data, NULL on failure to load
+ */
+unsigned char *texture_2d_load_texture_from_file(const char *url, int *out_channels, int *out_width, int *out_height, int *out_originalWidth, int *out_originalHeight, int *out_scale, long *out_size, int *out_compression_type, int *out_pixel_type) {
+    asset_pack_blob blob;
+    unsigned long size = 0;
+    unsigned char *data;
+    long long start = profiler_now();
+    if (asset_pack_find(url, &blob)) {
+        if (!blob.compressed) {
+            return texture_2d_load_texture_packed(url, blob.data, blob.size, out_channels, out_width, out_height, out_originalWidth, out_originalHeight, out_scale, out_size, out_compression_type, use_halfsized_textures, out_pixel_type);
+        }
+        data = (unsigned char *) asset_pack_read(url, &size);
+    } else {
+        resource_view view;
+        if (resource_loader_map_file(url, &view)) {
+            load_stats_since(LOAD_STAGE_DISK_READ, start);
+            unsigned char *pixels = texture_2d_load_texture_packed(url, view.data, view.size, out_channels, out_width, out_height, out_originalWidth, out_originalHeight, out_scale, out_size, out_compression_type, use_halfsized_textures, out_pixel_type);
+            resource_loader_unmap_file(&view);
+            return pixels;
+        }
+        data = resource_loader_read_file(url, &size);
     }
+    load_stats_since(LOAD_STAGE_DISK_READ, start);
 
-    return pixel_data;
+    if (!data) {
+        return NULL;
+    }
+    unsigned char *pixels = texture_2d_load_texture_packed(url, data, size, out_channels, out_width, out_height, out_originalWidth, out_originalHeight, out_scale, out_size, out_compression_type, use_halfsized_textures, out_pixel_type);
+    free(data);
+    return pixels;
 }
-
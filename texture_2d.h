@@ -17,13 +17,52 @@
 #define TEXTURE_2D_H
 
 #include "core/types.h"
+#include "core/geometry.h"
 #include "core/deps/uthash/uthash.h"
 
+#include <stdint.h>
 #include <time.h> // for last_accessed
 
 struct context_2d_t;
 
+// 16 bit texture modes, RGB images always pack to RGB565
+enum texture_16bit_modes {
+	TEXTURE_16BIT_OFF,
+	TEXTURE_16BIT_ON,			// RGBA packs to RGBA4444
+	TEXTURE_16BIT_PUNCHTHROUGH	// RGBA packs to RGBA5551
+};
+
+// texture memory budget categories
+enum texture_categories {
+	TEXTURE_CATEGORY_WORLD,
+	TEXTURE_CATEGORY_UI,
+	TEXTURE_CATEGORY_TEXT,
+	TEXTURE_CATEGORY_CANVAS,
+	TEXTURE_CATEGORY_COUNT
+};
+
+// eviction order, lowest first. pinned textures are never evicted
+enum texture_priorities {
+	TEXTURE_PRIORITY_LOW,
+	TEXTURE_PRIORITY_NORMAL,
+	TEXTURE_PRIORITY_HIGH,
+	TEXTURE_PRIORITY_PINNED
+};
+
+// texels, in the texture's full size, covered by each bit of an alpha mask
+#define TEXTURE_ALPHA_MASK_CELL 8
+
+// filter / wrap parameters last set on a gl texture, all zero when unknown
+typedef struct texture_2d_sampler_t {
+	int min_filter;
+	int mag_filter;
+	int wrap_s;
+	int wrap_t;
+} texture_2d_sampler;
+
 typedef struct texture_2d_t {
+	unsigned int id; // unique while in the texture manager, zero before
+	int handle; // texture_manager_intern_url handle resolving to this texture, zero if none
 	int name;
 	int original_name;
 	int originalWidth;
@@ -31,25 +70,73 @@ typedef struct texture_2d_t {
 	int width;
 	int height;
 	char *url;
+	uint64_t url_key; // texture_table_key of url, set when added to the manager
 	bool failed;
-	UT_hash_handle name_hash;
-	UT_hash_handle url_hash;
 	bool is_text;
 	bool is_canvas;
 	struct context_2d_t *ctx;
 	time_t last_accessed;
-	char *saved_data;
+	char *saved_data; // canvas backup, run-length encoded when saved_encoded
+	long saved_size;
+	bool saved_encoded;
+	bool canvas_dirty; // drawn into since saved_data was taken
+	bool regenerable; // canvas JavaScript redraws after a context loss, no backup needed
 	bool loaded;
+	bool decoding; // claimed by a texture manager decode worker
+	bool preloaded; // only requested by texture_manager_preload, no load event of its own
+	bool preview; // drawing a half sized preview until the full image is uploaded
+	long long load_requested; // profiler_now() when loading began, zero once it is reported
+	float load_ms; // from texture_manager_load_texture to loaded, zero if not loaded through it
 	unsigned char *pixel_data;
+	size_t pixel_data_bytes; // of pixel_data counted as MEMORY_TAG_DECODE, see texture_2d_free_pixel_data
+	unsigned char *alpha_mask; // a bit per cell that isn't fully transparent, see texture_2d_build_alpha_mask
+	int mask_columns;
+	int mask_rows;
 	int num_channels;
 	int scale;
 	long assumed_texture_bytes;
 	long used_texture_bytes; // Bytes actually used, zero until loaded
 	int frame_epoch; // Frame ID to avoid double-counting usage
 	int compression_type;
+	int pixel_type; // gl type of pixel_data, GL_UNSIGNED_BYTE unless packed to 16 bit
+	int mip_levels; // levels uploaded, more than one only for complete chains
+	int category; // TEXTURE_CATEGORY_*, budget the texture counts against
+	int priority; // TEXTURE_PRIORITY_*
+	texture_2d_sampler sampler;
+
+	// the second texture of a double buffered texture_2d_update_regions,
+	// swapped with name by each update, zero until the first
+	int spare_name;
+	texture_2d_sampler spare_sampler;
+	int spare_dirty[4]; // x, y, width and height the spare is out of date in
+
+	// set when the image was packed into a shared atlas page, name is then
+	// the page texture and the image sits at atlas_x, atlas_y on it
+	struct texture_atlas_page_t *atlas_page;
+	int atlas_x;
+	int atlas_y;
+	int atlas_width;
+	int atlas_height;
+
+	// set when the image was decoded from the same bytes as other loaded
+	// textures, which then all draw from one gl name. share_next rings them,
+	// only one of them counts the bytes and the last deletes the name
+	uint64_t content_key; // of the encoded image, zero if unknown
+	struct texture_2d_t *share_next; // NULL when not sharing
+
+	// pixel buffer upload in flight, see texture_manager.c
+	int upload_state;
+	unsigned int upload_buffer;
+	unsigned int upload_name;
+	void *upload_mapping;
+	void *upload_fence;
 
 	struct texture_2d_t *next;
 	struct texture_2d_t *prev;
+
+	// texture manager lru list, most recently used first
+	struct texture_2d_t *lru_next;
+	struct texture_2d_t *lru_prev;
 } texture_2d;
 
 
@@ -62,14 +149,33 @@ texture_2d *texture_2d_new_from_dimensions(int width, int height);
 texture_2d *texture_2d_new_from_data(int width, int height, const void *data);
 texture_2d *texture_2d_new_from_image(char *url, int name, int width, int height, int original_width, int original_height);
 void texture_2d_destroy(texture_2d *tex);
+// frees pixel_data, once it is uploaded or no longer wanted
+void texture_2d_free_pixel_data(texture_2d *tex);
 bool texture_2d_can_resize(texture_2d *tex, int width, int height);
 void texture_2d_resize_unsafe(texture_2d *tex, int width, int height);
+void texture_2d_set_sampler(texture_2d *tex, int min_filter, int mag_filter, int wrap_s, int wrap_t);
+void texture_2d_build_alpha_mask(texture_2d *tex);
+int texture_2d_trim_rect(const texture_2d *tex, const rect_2d *src, rect_2d *out, int max_rects);
+void texture_2d_apply_sampler(texture_2d_sampler *sampler, int min_filter, int mag_filter, int wrap_s, int wrap_t);
+void texture_2d_detect_npot();
+bool texture_2d_npot_supported();
+void texture_2d_set_npot_supported(bool supported);
+void texture_2d_detect_compression();
+
+// Uploads the rects of pixels, an RGBA image of the texture's original size,
+// into the texture it has with glTexSubImage2D. Double buffered, the rects
+// go into a second texture that is swapped in, so the driver needn't wait
+// for draws of the first; that second texture costs the memory again
+bool texture_2d_update_regions(texture_2d *tex, const void *pixels, const rect_2d *rects, int count, bool double_buffered);
 
 void texture_2d_save(texture_2d *tex);
 void texture_2d_reload(texture_2d *tex);
 
 // Load texture from raw image data, returning null on failure to load
 unsigned char *texture_2d_load_texture_raw(const char *url, const void *data, unsigned long sz, int *out_channels, int *out_width, int *out_height, int *out_originalWidth, int *out_originalHeight, int *out_scale, long *out_size, int *out_compression_type);
+unsigned char *texture_2d_load_texture_packed(const char *url, const void *data, unsigned long sz, int *out_channels, int *out_width, int *out_height, int *out_originalWidth, int *out_originalHeight, int *out_scale, long *out_size, int *out_compression_type, bool halfsize, int *out_pixel_type);
+// Load texture from a bundled file, decoding straight from a mapping when the platform can map it
+unsigned char *texture_2d_load_texture_from_file(const char *url, int *out_channels, int *out_width, int *out_height, int *out_originalWidth, int *out_originalHeight, int *out_scale, long *out_size, int *out_compression_type, int *out_pixel_type);
 
 #ifdef __cplusplus
 }
@@ -18,13 +18,22 @@
 #include "core/deps/uthash/uthash.h"
 #include "core/core.h"
 #include "core/log.h"
+#include "core/frame_arena.h"
+#include "core/draw_textures.h"
+#include "core/profiler.h"
+#include "core/memory_tags.h"
+#include "core/load_stats.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <time.h>
+#include <stdint.h>
 #include "core/image-cache/include/image_cache.h"
+#include "core/image-cache/include/murmur.h"
 #include "core/config.h"
 #include "platform/resource_loader.h"
 #include "core/list.h"
+#include "core/gl_state.h"
+#include "core/image_loader.h"
 #include "platform/gl.h"
 #include "core/events.h"
 #include "platform/native.h"
@@ -48,18 +57,98 @@
 
 // Global halfsized textures flags
 int use_halfsized_textures = false;
-bool should_use_halfsized = false;
+int use_16bit_textures = TEXTURE_16BIT_OFF;
 
-static bool m_running = false; // Flag indicating that the background texture loader thread should continue
+static bool m_running = false; // Flag indicating that the background decode workers should continue
 static texture_manager *m_instance = NULL;
 static bool m_instance_ready = false; // Flag indicating that the instance is ready
 static bool m_memory_warning = false; // Flag indicating that a memory warning occurred
 static bool m_memory_critical = false; // We should not increase max memory after this flag is set
 
-static ThreadsThread m_load_thread = THREADS_INVALID_THREAD;
+#define DEFAULT_DECODE_WORKERS 2
+#define MAX_DECODE_WORKERS 8
+// seeds the hash of encoded images, see find_shareable
+#define CONTENT_KEY_SEED 0x5a4e
+
+static ThreadsThread m_decode_threads[MAX_DECODE_WORKERS];
+static int m_decode_threads_started = 0;
+static int m_decode_worker_count = DEFAULT_DECODE_WORKERS; // workers allowed to take jobs
 static pthread_mutex_t mutex     = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t cond_var   = PTHREAD_COND_INITIALIZER;
 
+// encoded images handed over by the image cache, waiting for a decode worker
+typedef struct decode_job_t {
+    char *url;
+    char *bytes;
+    size_t size;
+    bool halfsize; // decided when the job was queued
+    bool progressive; // decode a half sized preview before the full image
+    bool preview; // holds the preview, not the full image
+    long long queued; // profiler_now() when handed over, for load_stats
+
+    // what the worker decoded, for the render thread
+    unsigned char *pixels;
+    int num_channels;
+    int width;
+    int height;
+    int originalWidth;
+    int originalHeight;
+    int scale;
+    int compression_type;
+    int pixel_type;
+    long used_bytes;
+    uint64_t content_key; // of bytes, zero if the decode failed
+
+    struct decode_job_t *next;
+    struct decode_job_t *prev;
+} decode_job;
+
+static decode_job *m_decode_jobs = NULL;
+/*
+ * Progressive loading
+ *
+ * With progressive loading on, a JPEG from the image cache is first decoded
+ * half sized through the decoder's scaled path and uploaded as a preview.
+ * The full image follows through the same queue, and when it is uploaded
+ * it takes the preview's place in the texture, which keeps its url, id and
+ * handle, so drawers see only the gl name change between two frames. Only
+ * the preview sends a load event.
+ */
+static bool m_progressive = false;
+// decoded jobs pushed by the workers without the lock, newest first.
+// texture_manager_tick takes them all at once and looks their textures up
+static decode_job *m_decoded_jobs = NULL;
+
+// ids handed to textures as they are added, zero is never used
+static unsigned int m_next_texture_id = 0;
+
+/*
+ * Pixel buffer uploads
+ *
+ * On GLES3 a decoded texture is uploaded in steps spread over ticks: the
+ * render thread maps a pixel unpack buffer, a decode worker copies the pixels
+ * into it, and the render thread starts the upload from the buffer, which the
+ * driver carries out while frames are drawn. The texture is only reported
+ * loaded once a fence says the upload is done.
+ */
+enum upload_states {
+    UPLOAD_NONE,    // pixels decoded, upload not started
+    UPLOAD_MAPPED,  // buffer mapped, waiting for a worker to fill it
+    UPLOAD_FILLED,  // buffer holds the pixels
+    UPLOAD_PENDING  // gl upload started, waiting on its fence
+};
+
+// buffers mapped at once, each holds a whole texture
+#define MAX_MAPPED_UPLOADS 8
+
+static bool m_async_upload = false;
+static int m_mapped_uploads = 0;
+
+#define DEFAULT_UPLOAD_BUDGET_MS 8
+
+// gl upload allowed per tick, zero for no limit
+static double m_upload_budget_ms = DEFAULT_UPLOAD_BUDGET_MS;
+static long m_upload_budget_bytes = 0;
 static texture_2d *tex_load_list = NULL;
 static json_t *spritesheet_map_root = NULL;
 static int m_frame_epoch = 1;
@@ -68,14 +157,368 @@ static long m_frame_used_bytes = 0;
 #define EPOCH_USED_BINS 64 /* must be power of two */
 #define EPOCH_USED_MASK (EPOCH_USED_BINS - 1)
 static long m_epoch_used[EPOCH_USED_BINS] = {0};
+// bytes of the textures drawn in each of the last frames, by epoch
+static long m_working_set[EPOCH_USED_BINS] = {0};
 
 // TODO: Optimize the mutex lock holding times
 
-#if defined(TEXMAN_VERBOSE)
-#define TEXLOG(fmt, ...) LOG("{tex} " fmt, ##__VA_ARGS__)
-#else
-#define TEXLOG(fmt, ...)
-#endif
+// per texture detail, built in when LOG_MIN_LEVEL is LOG_LEVEL_DEBUG
+#define TEXLOG(fmt, ...) LOG_DEBUG(LOG_CAT_TEXTURES, "{tex} " fmt, ##__VA_ARGS__)
+
+/*
+ * Mipmapped textures
+ *
+ * Images whose url matches one of the mipmap patterns get a full mip chain
+ * generated on upload and are sampled trilinearly, so sprites drawn well
+ * below their size do not alias.  Patterns are urls where '*' matches any
+ * run of characters, e.g. "resources/images/world*".
+ */
+
+#define MAX_MIPMAP_PATTERNS 16
+
+static char *m_mipmap_patterns[MAX_MIPMAP_PATTERNS];
+static int m_mipmap_pattern_count = 0;
+
+static bool url_matches(const char *pattern, const char *url) {
+    const char *star = NULL;
+    const char *resume = NULL;
+
+    while (*url) {
+        if (*pattern == '*') {
+            star = pattern++;
+            resume = url;
+        } else if (*pattern == *url) {
+            pattern++;
+            url++;
+        } else if (star) {
+            pattern = star + 1;
+            url = ++resume;
+        } else {
+            return false;
+        }
+    }
+
+    while (*pattern == '*') {
+        pattern++;
+    }
+    return *pattern == '\0';
+}
+
+// called with the lock held
+static bool wants_mipmaps(texture_2d *tex) {
+    int i;
+    if (!tex->url || tex->is_text || tex->compression_type) {
+        return false;
+    }
+    for (i = 0; i < m_mipmap_pattern_count; i++) {
+        if (url_matches(m_mipmap_patterns[i], tex->url)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @name	texture_manager_add_mipmap_pattern
+ * @brief	generates mipmaps for images loaded from now on whose url
+ *			matches the pattern
+ * @param	pattern - (const char *) url pattern, '*' matches anything
+ * @retval	bool - false if the pattern table is full
+ */
+bool texture_manager_add_mipmap_pattern(const char *pattern) {
+    bool added = false;
+    pthread_mutex_lock(&mutex);
+    if (m_mipmap_pattern_count < MAX_MIPMAP_PATTERNS) {
+        m_mipmap_patterns[m_mipmap_pattern_count++] = strdup(pattern);
+        added = true;
+    }
+    pthread_mutex_unlock(&mutex);
+
+    if (!added) {
+        LOG("{tex} WARNING: Too many mipmap patterns, ignoring %s", pattern);
+    }
+    return added;
+}
+
+/**
+ * @name	texture_manager_clear_mipmap_patterns
+ * @brief	stops generating mipmaps for images loaded from now on
+ * @retval	NONE
+ */
+void texture_manager_clear_mipmap_patterns() {
+    int i;
+    pthread_mutex_lock(&mutex);
+    for (i = 0; i < m_mipmap_pattern_count; i++) {
+        free(m_mipmap_patterns[i]);
+    }
+    m_mipmap_pattern_count = 0;
+    pthread_mutex_unlock(&mutex);
+}
+
+/*
+ * Texture atlas
+ *
+ * When atlasing is on, small images are packed into shared atlas pages
+ * instead of each getting a power-of-two texture of its own, so sprites
+ * drawn together share a texture and stay in one batch.  Pages are packed
+ * with a skyline: the top edge of the used area is kept as a row of
+ * horizontal segments and each image goes where its bottom ends up lowest.
+ *
+ * Space is not reclaimed when an image is freed; a page is deleted once
+ * none of its images are left.
+ */
+
+// transparent texels kept right of and below each image so filtering does
+// not pick up its neighbours
+#define ATLAS_PADDING 1
+
+typedef struct atlas_skyline_node_t {
+    int x;
+    int y;
+    int width;
+} atlas_skyline_node;
+
+typedef struct texture_atlas_page_t {
+    GLuint name;
+    int width;
+    int height;
+    int image_count;
+    texture_2d_sampler sampler;
+    atlas_skyline_node *nodes;
+    int node_count;
+
+    struct texture_atlas_page_t *next;
+    struct texture_atlas_page_t *prev;
+} texture_atlas_page;
+
+static int m_atlas_page_size = 0; // zero while atlasing is off
+static int m_atlas_max_image_size = 0;
+static texture_atlas_page *m_atlas_pages = NULL;
+
+static texture_atlas_page *atlas_page_new(int size) {
+    texture_atlas_page *page = (texture_atlas_page *) malloc(sizeof(texture_atlas_page));
+    // every node is at least a texel wide, so there are never more than size
+    page->nodes = (atlas_skyline_node *) malloc(sizeof(atlas_skyline_node) * (size + 1));
+    unsigned char *blank = (unsigned char *) calloc((size_t) size * size, 4);
+    if (!page->nodes || !blank) {
+        LOG("{tex} WARNING: Unable to allocate a %ix%i atlas page", size, size);
+        free(page->nodes);
+        free(blank);
+        free(page);
+        return NULL;
+    }
+
+    memset(&page->sampler, 0, sizeof(page->sampler));
+    GLTRACE(glGenTextures(1, &page->name));
+    gl_state_bind_texture(0, page->name);
+    texture_2d_apply_sampler(&page->sampler, GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+    GLTRACE(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, blank));
+    free(blank);
+
+    page->width = size;
+    page->height = size;
+    page->image_count = 0;
+    page->nodes[0].x = 0;
+    page->nodes[0].y = 0;
+    page->nodes[0].width = size;
+    page->node_count = 1;
+    page->next = page->prev = NULL;
+    LIST_ADD(&m_atlas_pages, page);
+    return page;
+}
+
+static void atlas_page_release(texture_atlas_page *page) {
+    if (--page->image_count > 0) {
+        return;
+    }
+
+    LIST_REMOVE(&m_atlas_pages, page);
+    gl_state_texture_deleted(page->name);
+    GLTRACE(glDeleteTextures(1, &page->name));
+    free(page->nodes);
+    free(page);
+}
+
+// lowest y a width x height rect can sit at with its left edge on node i,
+// or -1 if it does not fit there
+static int atlas_skyline_fit(texture_atlas_page *page, int i, int width, int height) {
+    if (page->nodes[i].x + width > page->width) {
+        return -1;
+    }
+
+    int y = 0;
+    int width_left = width;
+    while (width_left > 0) {
+        if (i == page->node_count) {
+            return -1;
+        }
+        if (page->nodes[i].y > y) {
+            y = page->nodes[i].y;
+        }
+        if (y + height > page->height) {
+            return -1;
+        }
+        width_left -= page->nodes[i].width;
+        i++;
+    }
+
+    return y;
+}
+
+static bool atlas_page_insert(texture_atlas_page *page, int width, int height, int *out_x, int *out_y) {
+    int best = -1, best_y = 0, best_width = 0;
+    int i;
+    for (i = 0; i < page->node_count; i++) {
+        int y = atlas_skyline_fit(page, i, width, height);
+        if (y >= 0 && (best < 0 || y < best_y ||
+                       (y == best_y && page->nodes[i].width < best_width))) {
+            best = i;
+            best_y = y;
+            best_width = page->nodes[i].width;
+        }
+    }
+
+    if (best < 0) {
+        return false;
+    }
+
+    // raise the skyline over the new rect
+    atlas_skyline_node *nodes = page->nodes;
+    memmove(nodes + best + 1, nodes + best, sizeof(atlas_skyline_node) * (page->node_count - best));
+    page->node_count++;
+    nodes[best].y = best_y + height;
+    nodes[best].width = width;
+
+    // and cut away the segments it now covers
+    int x = nodes[best].x;
+    int right = x + width;
+    i = best + 1;
+    while (i < page->node_count && nodes[i].x < right) {
+        int covered = right - nodes[i].x;
+        if (covered < nodes[i].width) {
+            nodes[i].x += covered;
+            nodes[i].width -= covered;
+            break;
+        }
+        memmove(nodes + i, nodes + i + 1, sizeof(atlas_skyline_node) * (page->node_count - i - 1));
+        page->node_count--;
+    }
+
+    // merge neighbours left at the same height
+    for (i = 0; i + 1 < page->node_count;) {
+        if (nodes[i].y == nodes[i + 1].y) {
+            nodes[i].width += nodes[i + 1].width;
+            memmove(nodes + i + 1, nodes + i + 2, sizeof(atlas_skyline_node) * (page->node_count - i - 2));
+            page->node_count--;
+        } else {
+            i++;
+        }
+    }
+
+    *out_x = x;
+    *out_y = best_y;
+    return true;
+}
+
+static bool atlas_can_pack(texture_2d *tex) {
+    return m_atlas_page_size && !tex->compression_type && !tex->is_text &&
+        tex->pixel_type == GL_UNSIGNED_BYTE && !wants_mipmaps(tex) &&
+        tex->num_channels == 4 && tex->scale == 1 &&
+        tex->originalWidth > 0 && tex->originalHeight > 0 &&
+        tex->originalWidth <= m_atlas_max_image_size &&
+        tex->originalHeight <= m_atlas_max_image_size &&
+        tex->originalWidth <= tex->width && tex->originalHeight <= tex->height;
+}
+
+/**
+ * @name	atlas_pack
+ * @brief	finds room for a decoded image on an atlas page, opening a new
+ *			page if none has any, and uploads the image there
+ * @param	tex - (texture_2d *) texture with pixel data waiting to be uploaded
+ * @param	out_x - (int *) where the image was placed on the page
+ * @param	out_y - (int *) where the image was placed on the page
+ * @retval	texture_atlas_page* - page holding a reference for the image, or
+ *			NULL if the image should get a texture of its own
+ */
+static texture_atlas_page *atlas_pack(texture_2d *tex, int *out_x, int *out_y) {
+    if (!atlas_can_pack(tex)) {
+        return NULL;
+    }
+
+    int width = tex->originalWidth;
+    int height = tex->originalHeight;
+    texture_atlas_page *page = m_atlas_pages;
+    while (page) {
+        if (atlas_page_insert(page, width + ATLAS_PADDING, height + ATLAS_PADDING, out_x, out_y)) {
+            break;
+        }
+        LIST_ITERATE(&m_atlas_pages, page);
+    }
+
+    if (!page) {
+        page = atlas_page_new(m_atlas_page_size);
+        if (!page || !atlas_page_insert(page, width + ATLAS_PADDING, height + ATLAS_PADDING, out_x, out_y)) {
+            if (page && !page->image_count) {
+                atlas_page_release(page);
+            }
+            return NULL;
+        }
+    }
+
+    // decoded images are padded out to a power of two, gles has no unpack
+    // row length so copy the image rows out when the padding is in the way
+    const unsigned char *pixels = tex->pixel_data;
+    unsigned char *rows = NULL;
+    if (width != tex->width) {
+        rows = (unsigned char *) malloc((size_t) width * height * 4);
+        if (!rows) {
+            if (!page->image_count) {
+                atlas_page_release(page);
+            }
+            return NULL;
+        }
+        int y;
+        for (y = 0; y < height; y++) {
+            memcpy(rows + (size_t) y * width * 4, tex->pixel_data + (size_t) y * tex->width * 4, (size_t) width * 4);
+        }
+        pixels = rows;
+    }
+
+    gl_state_bind_texture(0, page->name);
+    GLTRACE(glTexSubImage2D(GL_TEXTURE_2D, 0, *out_x, *out_y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels));
+    free(rows);
+
+    page->image_count++;
+    return page;
+}
+
+// drops the texture's hold on its atlas page, leaving it without a gl name
+static void atlas_release_texture(texture_2d *tex) {
+    if (tex->atlas_page) {
+        atlas_page_release(tex->atlas_page);
+        tex->atlas_page = NULL;
+        tex->name = 0;
+        tex->original_name = 0;
+    }
+}
+
+/**
+ * @name	texture_manager_set_atlas
+ * @brief	packs images loaded from now on into shared atlas pages when
+ *			both their sides are at most max_image_size texels
+ * @param	page_size - (int) side of each atlas page, 0 to turn atlasing off
+ * @param	max_image_size - (int) largest image side that gets packed
+ * @retval	NONE
+ */
+void texture_manager_set_atlas(int page_size, int max_image_size) {
+    pthread_mutex_lock(&mutex);
+    if (page_size < 0 || max_image_size <= 0 || max_image_size + ATLAS_PADDING > page_size) {
+        page_size = 0;
+    }
+    m_atlas_page_size = page_size;
+    m_atlas_max_image_size = page_size ? max_image_size : 0;
+    pthread_mutex_unlock(&mutex);
+}
 
 bool is_remote_resource(const char *url) {
     //TODO: until ios implements simulate and stores images from http
@@ -96,12 +539,292 @@ bool is_remote_resource(const char *url) {
     return is_remote;
 }
 
+// whether the url is fetched through the image cache rather than the platform
+static bool is_image_cache_url(const char *url) {
+    return !strncmp("http", url, 4) || !strncmp("//", url, 2);
+}
+
+static int get_image_cache_priority(int priority) {
+    if (priority == TEXTURE_PRIORITY_LOW) {
+        return IMAGE_CACHE_PRIORITY_LOW;
+    }
+    return priority == TEXTURE_PRIORITY_NORMAL ? IMAGE_CACHE_PRIORITY_NORMAL : IMAGE_CACHE_PRIORITY_HIGH;
+}
+
+/*
+ * Textures are kept in an intrusive list ordered by use, most recent first.
+ * A texture moves to the front the first time it is used in a frame, so
+ * eviction can take from the tail without sorting anything.
+ */
+
+static void lru_remove(texture_manager *manager, texture_2d *tex) {
+    if (tex->lru_prev) {
+        tex->lru_prev->lru_next = tex->lru_next;
+    } else if (manager->lru_head == tex) {
+        manager->lru_head = tex->lru_next;
+    } else {
+        return; // not in the list
+    }
+
+    if (tex->lru_next) {
+        tex->lru_next->lru_prev = tex->lru_prev;
+    } else {
+        manager->lru_tail = tex->lru_prev;
+    }
+
+    tex->lru_prev = tex->lru_next = NULL;
+}
+
+static void lru_push_front(texture_manager *manager, texture_2d *tex) {
+    tex->lru_prev = NULL;
+    tex->lru_next = manager->lru_head;
+    if (manager->lru_head) {
+        manager->lru_head->lru_prev = tex;
+    } else {
+        manager->lru_tail = tex;
+    }
+    manager->lru_head = tex;
+}
+
+static void lru_push_back(texture_manager *manager, texture_2d *tex) {
+    tex->lru_next = NULL;
+    tex->lru_prev = manager->lru_tail;
+    if (manager->lru_tail) {
+        manager->lru_tail->lru_next = tex;
+    } else {
+        manager->lru_head = tex;
+    }
+    manager->lru_tail = tex;
+}
+
+/**
+ * @name	touch_texture
+ * @brief	marks a texture used this frame, counting its bytes toward the
+ *			frame's usage and moving it to the front of the lru list. failed
+ *			textures go to the back instead so the next clear retries them.
+ *			render thread only, the lru list is not locked.
+ * @param	manager - (texture_manager *) manager owning the texture
+ * @param	tex - (texture_2d *) texture being used
+ * @retval	NONE
+ */
+static void touch_texture(texture_manager *manager, texture_2d *tex) {
+    if (tex->failed) {
+        if (tex->loaded && manager->lru_tail != tex) {
+            lru_remove(manager, tex);
+            lru_push_back(manager, tex);
+        }
+    } else {
+        time(&tex->last_accessed);
+    }
+
+    // If we haven't accumulated this texture yet,
+    if (tex->frame_epoch != m_frame_epoch) {
+        tex->frame_epoch = m_frame_epoch;
+        m_frame_used_bytes += tex->used_texture_bytes;
+
+        if (!tex->failed && manager->lru_head != tex) {
+            lru_remove(manager, tex);
+            lru_push_front(manager, tex);
+        }
+    }
+}
+
+// looks a texture up without touching it, for threads other than the renderer
+static texture_2d *find_texture(texture_manager *manager, const char *url) {
+    return texture_table_find(&manager->textures, texture_table_key(url), url);
+}
+
+/*
+ * Texture categories
+ *
+ * Every texture counts against a category budget as well as the overall
+ * limit: canvases and text get their own, images are world textures unless
+ * a rule puts them in the UI category.  Rules also give images a priority,
+ * and eviction takes lower priorities first, least recently used first
+ * within a priority.  Pinned textures are only freed by a full clear.
+ *
+ * When a category has to evict something drawn this frame only that
+ * category falls back to half-sized images.
+ */
+
+#define MAX_TEXTURE_RULES 32
+
+typedef struct texture_rule_t {
+    char *pattern;
+    int category;
+    int priority;
+} texture_rule;
+
+static texture_rule m_texture_rules[MAX_TEXTURE_RULES];
+static int m_texture_rule_count = 0;
+
+// categories using half-sized images, and ones that should start to
+static bool m_category_halfsized[TEXTURE_CATEGORY_COUNT] = {false};
+static bool m_category_should_halfsize[TEXTURE_CATEGORY_COUNT] = {false};
+
+// sets the category and priority of a new texture from the rules, called with the lock held
+static void apply_texture_rules(texture_2d *tex, bool is_canvas) {
+    int i;
+    tex->category = is_canvas ? TEXTURE_CATEGORY_CANVAS : TEXTURE_CATEGORY_WORLD;
+    tex->priority = TEXTURE_PRIORITY_NORMAL;
+    if (is_canvas || !tex->url) {
+        return;
+    }
+
+    // the first matching rule wins
+    for (i = 0; i < m_texture_rule_count; i++) {
+        if (url_matches(m_texture_rules[i].pattern, tex->url)) {
+            tex->category = m_texture_rules[i].category;
+            tex->priority = m_texture_rules[i].priority;
+            return;
+        }
+    }
+}
+
+// bytes of a category over its budget, zero without one
+static long category_excess(texture_manager *manager, int category) {
+    size_t max_bytes = manager->category_max_bytes[category];
+    size_t used = manager->category_bytes_used[category];
+    return max_bytes && used > max_bytes ? (long)(used - max_bytes) : 0;
+}
+
+// adds (or with a negative count removes) texture bytes to the totals
+static void account_texture_bytes(texture_manager *manager, texture_2d *tex, long bytes) {
+    manager->texture_bytes_used += bytes;
+    manager->category_bytes_used[tex->category] += bytes;
+}
+
+/**
+ * @name	texture_manager_add_texture_rule
+ * @brief	puts images loaded from now on whose url matches the pattern in
+ *			the given category with the given priority
+ * @param	pattern - (const char *) url pattern, '*' matches anything
+ * @param	category - (int) TEXTURE_CATEGORY_WORLD or TEXTURE_CATEGORY_UI
+ * @param	priority - (int) TEXTURE_PRIORITY_*
+ * @retval	bool - false if the rule was not added
+ */
+bool texture_manager_add_texture_rule(const char *pattern, int category, int priority) {
+    if ((category != TEXTURE_CATEGORY_WORLD && category != TEXTURE_CATEGORY_UI) ||
+        priority < TEXTURE_PRIORITY_LOW || priority > TEXTURE_PRIORITY_PINNED) {
+        LOG("{tex} WARNING: Ignoring texture rule %s with category %d priority %d", pattern, category, priority);
+        return false;
+    }
+
+    bool added = false;
+    pthread_mutex_lock(&mutex);
+    if (m_texture_rule_count < MAX_TEXTURE_RULES) {
+        texture_rule *rule = &m_texture_rules[m_texture_rule_count++];
+        rule->pattern = strdup(pattern);
+        rule->category = category;
+        rule->priority = priority;
+        added = true;
+    }
+    pthread_mutex_unlock(&mutex);
+
+    if (!added) {
+        LOG("{tex} WARNING: Too many texture rules, ignoring %s", pattern);
+    }
+    return added;
+}
+
+/**
+ * @name	texture_manager_clear_texture_rules
+ * @brief	puts images loaded from now on back in the world category
+ * @retval	NONE
+ */
+void texture_manager_clear_texture_rules() {
+    int i;
+    pthread_mutex_lock(&mutex);
+    for (i = 0; i < m_texture_rule_count; i++) {
+        free(m_texture_rules[i].pattern);
+    }
+    m_texture_rule_count = 0;
+    pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * @name	texture_manager_set_category_budget
+ * @brief	caps the texture bytes a category may use, on top of the overall
+ *			limit
+ * @param	manager - (texture_manager *) manager to set the budget on
+ * @param	category - (int) TEXTURE_CATEGORY_*
+ * @param	bytes - (long) budget, 0 for none
+ * @retval	NONE
+ */
+void texture_manager_set_category_budget(texture_manager *manager, int category, long bytes) {
+    if (category < 0 || category >= TEXTURE_CATEGORY_COUNT) {
+        LOG("{tex} WARNING: Ignoring budget for unknown texture category %d", category);
+        return;
+    }
+    pthread_mutex_lock(&mutex);
+    manager->category_max_bytes[category] = bytes > 0 ? bytes : 0;
+    pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * @name	texture_manager_set_texture_priority
+ * @brief	changes the priority of an already added texture, e.g. to pin
+ *			it. the priority from the rules applies again once it is freed.
+ * @param	manager - (texture_manager *) manager holding the texture
+ * @param	url - (const char *) url of the texture
+ * @param	priority - (int) TEXTURE_PRIORITY_*
+ * @retval	bool - false if there is no such texture
+ */
+bool texture_manager_set_texture_priority(texture_manager *manager, const char *url, int priority) {
+    if (priority < TEXTURE_PRIORITY_LOW || priority > TEXTURE_PRIORITY_PINNED) {
+        return false;
+    }
+    pthread_mutex_lock(&mutex);
+    texture_2d *tex = find_texture(manager, url);
+    if (tex) {
+        tex->priority = priority;
+
+        // an avatar scrolled into view should not wait behind the rest
+        if (!tex->loaded && is_image_cache_url(tex->url)) {
+            image_cache_set_priority(tex->url, get_image_cache_priority(priority));
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+    return tex != NULL;
+}
+
 texture_2d *texture_manager_new_texture_from_data(texture_manager *manager, int width, int height, const void *data) {
     texture_2d *tex = texture_2d_new_from_data(width, height, data);
     texture_manager_add_texture(manager, tex, false);
     return tex;
 }
 
+/**
+ * @name	texture_manager_update_texture_regions
+ * @brief	uploads the changed parts of a new image for a texture made from
+ *			data, see texture_2d_update_regions, counting the second
+ *			texture of a double buffered one against the budget
+ * @param	manager - (texture_manager *) manager holding tex
+ * @param	tex - (texture_2d *) texture to update
+ * @param	pixels - (const void *) RGBA image of the texture's original size
+ * @param	rects - (const rect_2d *) parts that changed, NULL for all of it
+ * @param	count - (int) number of rects
+ * @param	double_buffered - (bool) upload into a second texture and swap it in
+ * @retval	bool - false if the texture can't be updated in place
+ */
+bool texture_manager_update_texture_regions(texture_manager *manager, texture_2d *tex, const void *pixels, const rect_2d *rects, int count, bool double_buffered) {
+    // draws already queued sample what the texture held when they were made
+    draw_textures_flush();
+
+    bool had_spare = tex->spare_name != 0;
+    if (!texture_2d_update_regions(tex, pixels, rects, count, double_buffered)) {
+        LOG("{tex} WARNING: Unable to update %s in place", tex->url);
+        return false;
+    }
+
+    if (!had_spare && tex->spare_name) {
+        long bytes = (long) tex->width * tex->height * 4;
+        account_texture_bytes(manager, tex, bytes);
+        tex->used_texture_bytes += bytes;
+    }
+    return true;
+}
+
 texture_2d *texture_manager_new_texture(texture_manager *manager, int width, int height) {
     LOGFN("texture_manager_new_texture");
     texture_2d *tex = texture_2d_new_from_dimensions(width, height);
@@ -113,13 +836,14 @@ static void notify_canvas_death(const char *url) {
     // generate event string
     char *event_str;
     int event_len;
-    char *dynamic_str = 0;
     char stack_str[512];
     int url_len = (int)strlen(url);
     if (url_len > 300) {
         event_len = url_len + 212;
-        dynamic_str = (char*)malloc(event_len);
-        event_str = dynamic_str;
+        event_str = (char*)frame_arena_alloc(event_len);
+        if (!event_str) {
+            return;
+        }
     } else {
         event_len = 512;
         event_str = stack_str;
@@ -128,28 +852,14 @@ static void notify_canvas_death(const char *url) {
     event_len = snprintf(event_str, event_len, "{\"url\":\"%s\",\"name\":\"canvasFreed\",\"priority\":0}", url);
     event_str[event_len] = '\0';
     core_dispatch_event(event_str);
-
-    if (dynamic_str) {
-        free(dynamic_str);
-    }
 }
 
-texture_2d *texture_manager_get_texture(texture_manager *manager, const char *url) {
-    LOGFN("texture_manager_get_texture");
-    size_t len = strlen(url);
-    texture_2d *tex = NULL;
-    HASH_FIND(url_hash, manager->url_to_tex, url, len, tex);
+// texture_manager_get_texture for callers that already have the url's key
+static texture_2d *get_texture_by_key(texture_manager *manager, const char *url, uint64_t key) {
+    texture_2d *tex = texture_table_find(&manager->textures, key, url);
 
     if (tex) {
-        if (!tex->failed) {
-            time(&tex->last_accessed);
-        }
-
-        // If we haven't accumulated this texture yet,
-        if (tex->frame_epoch != m_frame_epoch) {
-            tex->frame_epoch = m_frame_epoch;
-            m_frame_used_bytes += tex->used_texture_bytes;
-        }
+        touch_texture(manager, tex);
     } else {
         // if it was a canvas
         if (url[0] == '_' && url[1] == '_'
@@ -165,6 +875,11 @@ texture_2d *texture_manager_get_texture(texture_manager *manager, const char *ur
     return tex;
 }
 
+texture_2d *texture_manager_get_texture(texture_manager *manager, const char *url) {
+    LOGFN("texture_manager_get_texture");
+    return get_texture_by_key(manager, url, texture_table_key(url));
+}
+
 void texture_manager_get_sheet_size(char *url, int *width, int *height) {
     LOGFN("texture_manager_get_sheet_size");
 
@@ -198,11 +913,16 @@ texture_2d *texture_manager_load_texture(texture_manager *manager, const char *u
     texture_2d *tex = texture_manager_get_texture(manager, url);
 
     if (tex) {
+        // asked for directly, so it now wants its own load event
+        tex->preloaded = false;
+        load_stats_add(LOAD_COUNT_RESIDENT, 1);
         return tex;
     }
 
     char *permanent_url = strdup(url);
     tex = texture_2d_new_from_url(permanent_url);
+    tex->load_requested = profiler_now();
+    load_stats_add(LOAD_COUNT_REQUESTED, 1);
 
     bool remote_resource = is_remote_resource(permanent_url);
     bool is_contact_photo = (strncmp(url, CONTACTPHOTO_URL_PREFIX, CONTACTPHOTO_URL_PREFIX_LEN) == 0);
@@ -226,8 +946,8 @@ texture_2d *texture_manager_load_texture(texture_manager *manager, const char *u
 
     // If URL represents a remote resource, or is a special resource
     if (remote_resource) {
-        if (!strncmp("http", url, 4) || !strncmp("//", url, 2)) {
-            image_cache_load(url);
+        if (is_image_cache_url(url)) {
+            image_cache_load_with_priority(url, get_image_cache_priority(tex->priority));
         } else {
             launch_remote_texture_load(permanent_url);
         }
@@ -235,60 +955,334 @@ texture_2d *texture_manager_load_texture(texture_manager *manager, const char *u
         //lock, add to the pool and signal something has been added
         pthread_mutex_lock(&mutex);
         LIST_ADD(&tex_load_list, tex);
-        pthread_cond_signal(&cond_var); //signal there is a texture to load
+        pthread_cond_broadcast(&cond_var); //signal there is a texture to load
         pthread_mutex_unlock(&mutex);
     }
 
     return tex;
 }
 
-bool texture_manager_on_texture_loaded(texture_manager *manager,
-                                       const char *url,
-                                       int name,
-                                       int width,
-                                       int height,
-                                       int original_width,
-                                       int original_height,
-                                       int num_channels,
-                                       int scale,
-                                       bool is_text,
-                                       long size,
-                                       int compression_type) {
-    //add the amount of bytes being used by this texture to the amount of texture bytes being used
-    //scale = 1, texture stays at its regular size
-    //scale = 2, texture is being halfsized as is needed for lower memory footprint
-    //scale > 2, not currently used
-    long used = size;
-    // If no texture size was given then compute the number of bytes using the number of channels
-    // and the dimensions of the image
-    if (!used) {
-        used = width * height * num_channels;
-    }
-    if (scale > 1) {
-        used /= 4;
+/*
+ * Texture handles
+ *
+ * Drawing by url hashes the url on every draw.  A handle interns the url
+ * once and remembers the texture it resolved to, so drawing by handle is an
+ * array lookup until the texture is freed, after which the next draw loads
+ * it again by url.  Handles are never reused and zero is never a handle.
+ * Render thread only, like the lru list.
+ */
+
+typedef struct texture_handle_t {
+    int handle;
+    char *url;
+    uint64_t url_key; // texture_table_key of url
+    texture_2d *tex; // NULL until drawn, and again once freed
+    UT_hash_handle hh;
+} texture_handle;
+
+static texture_handle **m_handles = NULL; // indexed by handle, 0 unused
+static int m_handle_count = 1;
+static int m_handle_capacity = 0;
+static texture_handle *m_handles_by_url = NULL;
+
+/**
+ * @name	texture_manager_intern_url
+ * @brief	returns the handle for a url, creating it the first time
+ * @param	url - (const char *) url of the image
+ * @retval	int - handle to draw the image by, zero when out of memory
+ */
+int texture_manager_intern_url(const char *url) {
+    LOGFN("texture_manager_intern_url");
+    size_t len = strlen(url);
+    texture_handle *entry = NULL;
+    HASH_FIND(hh, m_handles_by_url, url, len, entry);
+    if (entry) {
+        return entry->handle;
     }
 
-    manager->texture_bytes_used += used;
-    const int epoch = (unsigned)m_frame_epoch & EPOCH_USED_MASK;
-    if (m_epoch_used[epoch] < manager->texture_bytes_used) {
-        m_epoch_used[epoch] = manager->texture_bytes_used;
+    if (m_handle_count == m_handle_capacity) {
+        int capacity = m_handle_capacity ? m_handle_capacity * 2 : 256;
+        texture_handle **handles = (texture_handle **) realloc(m_handles, capacity * sizeof(texture_handle *));
+        if (!handles) {
+            LOG("{tex} WARNING: Out of memory interning %s", url);
+            return 0;
+        }
+        m_handles = handles;
+        m_handle_capacity = capacity;
     }
 
-    TEXLOG("Texture loaded: %s!  TOLOAD=%d USED=%d", url, (int)manager->textures_to_load, (int)manager->texture_bytes_used);
+    entry = (texture_handle *) malloc(sizeof(texture_handle));
+    char *permanent_url = strdup(url);
+    if (!entry || !permanent_url) {
+        LOG("{tex} WARNING: Out of memory interning %s", url);
+        free(entry);
+        free(permanent_url);
+        return 0;
+    }
+
+    entry->handle = m_handle_count++;
+    entry->url = permanent_url;
+    entry->url_key = texture_table_key(permanent_url);
+    entry->tex = NULL;
+    m_handles[entry->handle] = entry;
+    HASH_ADD_KEYPTR(hh, m_handles_by_url, entry->url, len, entry);
+    return entry->handle;
+}
+
+/**
+ * @name	texture_manager_get_handle_url
+ * @brief	returns the url a handle was interned from
+ * @param	handle - (int) handle from texture_manager_intern_url
+ * @retval	const char * - the url, NULL for an unknown handle
+ */
+const char *texture_manager_get_handle_url(int handle) {
+    if (handle <= 0 || handle >= m_handle_count) {
+        return NULL;
+    }
+    return m_handles[handle]->url;
+}
+
+/**
+ * @name	texture_manager_get_texture_by_handle
+ * @brief	texture_manager_get_texture without hashing the url while the
+ *			texture stays in the manager
+ * @param	manager - (texture_manager *) manager to look in
+ * @param	handle - (int) handle from texture_manager_intern_url
+ * @retval	texture_2d * - the texture, NULL when it is not in the manager
+ */
+texture_2d *texture_manager_get_texture_by_handle(texture_manager *manager, int handle) {
+    LOGFN("texture_manager_get_texture_by_handle");
+    if (handle <= 0 || handle >= m_handle_count) {
+        return NULL;
+    }
+
+    texture_handle *entry = m_handles[handle];
+    if (entry->tex) {
+        touch_texture(manager, entry->tex);
+        return entry->tex;
+    }
+
+    texture_2d *tex = get_texture_by_key(manager, entry->url, entry->url_key);
+    if (tex) {
+        entry->tex = tex;
+        tex->handle = handle;
+    }
+    return tex;
+}
+
+/**
+ * @name	texture_manager_load_texture_by_handle
+ * @brief	texture_manager_load_texture without hashing the url while the
+ *			texture stays in the manager
+ * @param	manager - (texture_manager *) manager to load into
+ * @param	handle - (int) handle from texture_manager_intern_url
+ * @retval	texture_2d * - the texture, NULL for an unknown handle
+ */
+texture_2d *texture_manager_load_texture_by_handle(texture_manager *manager, int handle) {
+    LOGFN("texture_manager_load_texture_by_handle");
+    if (handle <= 0 || handle >= m_handle_count) {
+        return NULL;
+    }
+
+    texture_handle *entry = m_handles[handle];
+    texture_2d *tex = entry->tex;
+    if (tex) {
+        touch_texture(manager, tex);
+        tex->preloaded = false;
+        return tex;
+    }
+
+    tex = texture_manager_load_texture(manager, entry->url);
+    if (tex) {
+        entry->tex = tex;
+        tex->handle = handle;
+    }
+    return tex;
+}
+
+// forgets the texture a handle resolved to once it leaves the manager
+static void release_texture_handle(texture_2d *tex) {
+    if (tex->handle > 0 && tex->handle < m_handle_count && m_handles[tex->handle]->tex == tex) {
+        m_handles[tex->handle]->tex = NULL;
+    }
+    tex->handle = 0;
+}
+
+/*
+ * Shared textures
+ *
+ * Images from the image cache are hashed as they are decoded, so when
+ * another url turns out to hold the same image, decoded the same way, it
+ * draws from the texture already uploaded instead of uploading its own. Each
+ * url keeps its texture_2d, the ones drawing from one gl name are ringed by
+ * share_next and only one of them counts the bytes, handing them on when it
+ * is freed. The name is deleted with the last of them. Atlas images share
+ * their page reference the same way the page's other images do.
+ */
+
+/**
+ * @name	find_shareable
+ * @brief	finds a loaded texture holding the same image as a decoded one,
+ *			in the same size and format. called with the lock held
+ * @param	manager - (texture_manager *) manager owning the textures
+ * @param	tex - (texture_2d *) decoded texture about to be uploaded
+ * @retval	texture_2d* - texture to draw from instead, NULL to upload
+ */
+static texture_2d *find_shareable(texture_manager *manager, texture_2d *tex) {
+    if (!tex->content_key || tex->failed || tex->preview || tex->is_canvas) {
+        return NULL;
+    }
+
+    texture_2d *other = texture_table_find_content(&manager->contents, tex->content_key);
+    if (!other || other == tex || !other->loaded || other->failed || other->preview || !other->name ||
+        other->width != tex->width || other->height != tex->height || other->scale != tex->scale ||
+        other->num_channels != tex->num_channels || other->compression_type != tex->compression_type ||
+        other->pixel_type != tex->pixel_type || (wants_mipmaps(tex) && other->mip_levels <= 1)) {
+        return NULL;
+    }
+    return other;
+}
+
+/**
+ * @name	share_texture
+ * @brief	makes a decoded texture draw from another's gl texture and marks
+ *			it loaded without counting any bytes for it
+ * @param	manager - (texture_manager *) manager owning the textures
+ * @param	tex - (texture_2d *) decoded texture, not sharing yet
+ * @param	other - (texture_2d *) texture find_shareable returned
+ * @retval	NONE
+ */
+static void share_texture(texture_manager *manager, texture_2d *tex, texture_2d *other) {
+    core_invalidate_frame();
+
+    if (other->atlas_page) {
+        other->atlas_page->image_count++;
+        tex->atlas_page = other->atlas_page;
+        tex->atlas_x = other->atlas_x;
+        tex->atlas_y = other->atlas_y;
+        tex->atlas_width = other->atlas_width;
+        tex->atlas_height = other->atlas_height;
+    }
+    tex->share_next = other->share_next ? other->share_next : other;
+    other->share_next = tex;
+
+    manager->approx_bytes_to_load -= tex->assumed_texture_bytes;
+    tex->used_texture_bytes = 0;
+    tex->name = other->name;
+    tex->original_name = other->name;
+    tex->sampler = other->sampler;
+    tex->mip_levels = other->mip_levels;
+    tex->loaded = true;
+    TEXLOG("Texture shared: %s draws from %s", tex->url, other->url);
+}
+
+/**
+ * @name	leave_shared
+ * @brief	takes a texture off its ring and out of the content table,
+ *			handing its bytes and its place in the table to the next sharer.
+ *			while others still draw from the gl name, the texture is left
+ *			without it so freeing the texture doesn't delete it
+ * @param	manager - (texture_manager *) manager owning the textures
+ * @param	tex - (texture_2d *) texture about to be freed or loaded again
+ * @retval	NONE
+ */
+static void leave_shared(texture_manager *manager, texture_2d *tex) {
+    bool filed = tex->content_key && texture_table_find_content(&manager->contents, tex->content_key) == tex;
+    if (filed) {
+        texture_table_remove_content(&manager->contents, tex);
+    }
+
+    texture_2d *next = tex->share_next;
+    if (!next) {
+        return;
+    }
+
+    texture_2d *prev = next;
+    while (prev->share_next != tex) {
+        prev = prev->share_next;
+    }
+    prev->share_next = prev == next ? NULL : next;
+    tex->share_next = NULL;
+
+    if (tex->used_texture_bytes) {
+        long bytes = tex->used_texture_bytes;
+        account_texture_bytes(manager, tex, -bytes);
+        tex->used_texture_bytes = 0;
+        account_texture_bytes(manager, next, bytes);
+        next->used_texture_bytes = bytes;
+    }
+    if (filed) {
+        texture_table_add_content(&manager->contents, next);
+    }
+
+    // the atlas page is reference counted already
+    if (!tex->atlas_page) {
+        tex->name = 0;
+        tex->original_name = 0;
+    }
+}
+
+bool texture_manager_on_texture_loaded(texture_manager *manager,
+                                       const char *url,
+                                       int name,
+                                       int width,
+                                       int height,
+                                       int original_width,
+                                       int original_height,
+                                       int num_channels,
+                                       int scale,
+                                       bool is_text,
+                                       long size,
+                                       int compression_type) {
+    // views waiting on it can draw now
+    core_invalidate_frame();
+
+    //add the amount of bytes being used by this texture to the amount of texture bytes being used
+    //scale = 1, texture stays at its regular size
+    //scale = 2, texture is being halfsized as is needed for lower memory footprint
+    //scale > 2, not currently used
+    long used = size;
+    // If no texture size was given then compute the number of bytes using the number of channels
+    // and the dimensions of the image, a given size is already what the gl texture holds
+    if (!used) {
+        used = width * height * num_channels;
+        if (scale > 1) {
+            used /= 4;
+        }
+    }
 
     texture_2d *tex = texture_manager_get_texture(manager, (char *)url);
 
     bool add_texture = false;
-    if (!tex) {
+    if (tex) {
+        leave_shared(manager, tex);
+        atlas_release_texture(tex);
+    } else {
         char *permanent_url = strdup(url);
         tex = texture_2d_new_from_url(permanent_url);
+        apply_texture_rules(tex, false);
         add_texture = true;
     }
+    if (is_text && tex->category != TEXTURE_CATEGORY_TEXT) {
+        account_texture_bytes(manager, tex, -tex->used_texture_bytes);
+        tex->category = TEXTURE_CATEGORY_TEXT;
+        account_texture_bytes(manager, tex, tex->used_texture_bytes);
+    }
+
+    account_texture_bytes(manager, tex, used);
+    const int epoch = (unsigned)m_frame_epoch & EPOCH_USED_MASK;
+    if (m_epoch_used[epoch] < manager->texture_bytes_used) {
+        m_epoch_used[epoch] = manager->texture_bytes_used;
+    }
+
+    TEXLOG("Texture loaded: %s!  TOLOAD=%d USED=%d", url, (int)manager->textures_to_load, (int)manager->texture_bytes_used);
 
     tex->used_texture_bytes = used;
     manager->approx_bytes_to_load -= tex->assumed_texture_bytes;
     tex->name = name;
     tex->original_name = name;
+    // the texture was created elsewhere, so its sampler state is unknown
+    memset(&tex->sampler, 0, sizeof(tex->sampler));
     tex->is_text = is_text;
     tex->loaded = true;
     tex->failed = core_check_gl_error();
@@ -307,7 +1301,7 @@ bool texture_manager_on_texture_loaded(texture_manager *manager,
 
 void texture_manager_on_texture_failed_to_load(texture_manager *manager, const char *url) {
     pthread_mutex_lock(&mutex);
-    texture_2d *tex = texture_manager_get_texture(manager, url);
+    texture_2d *tex = find_texture(manager, url);
     if (tex) {
         tex->loaded = true;
         tex->failed = true;
@@ -316,26 +1310,45 @@ void texture_manager_on_texture_failed_to_load(texture_manager *manager, const c
     pthread_mutex_unlock(&mutex);
 }
 
+// bytes an image of the given decoded size is expected to take once loaded
+static long estimate_texture_bytes(texture_2d *tex, long bytes, int channels, int compression_type) {
+    // Approximate because it doesn't round up to the next power-of-two, etc
+    if (compression_type) {
+        return bytes;
+    }
+    if (use_halfsized_textures || m_category_halfsized[tex->category]) {
+        bytes /= 4;
+    }
+    if (use_16bit_textures && channels != 1) {
+        bytes = bytes * 2 / channels;
+    }
+    return bytes;
+}
+
 texture_2d *texture_manager_add_texture(texture_manager *manager, texture_2d *tex, bool is_canvas) {
     LOGFN("texture_manager_add_texture");
 
     time(&tex->last_accessed);
 
     if (tex->url) {
-        HASH_ADD_KEYPTR(url_hash, manager->url_to_tex, tex->url, strlen(tex->url), tex);
+        texture_table_add(&manager->textures, tex);
     }
 
+    lru_push_front(manager, tex);
     manager->tex_count++;
+    if (!tex->id) {
+        tex->id = ++m_next_texture_id;
+    }
+    if (!tex->is_text) {
+        apply_texture_rules(tex, is_canvas);
+    }
 
-    // Approximate because it doesn't round up to the next power-of-two, etc
     long assumed_texture_bytes = tex->width * tex->height * tex->num_channels;
     if (!is_canvas) {
-        if (use_halfsized_textures) {
-            assumed_texture_bytes /= 4;
-        }
+        assumed_texture_bytes = estimate_texture_bytes(tex, assumed_texture_bytes, tex->num_channels, 0);
         manager->approx_bytes_to_load += assumed_texture_bytes;
     } else {
-        manager->texture_bytes_used += assumed_texture_bytes;
+        account_texture_bytes(manager, tex, assumed_texture_bytes);
         const int epoch = (unsigned)m_frame_epoch & EPOCH_USED_MASK;
         if (m_epoch_used[epoch] < manager->texture_bytes_used) {
             m_epoch_used[epoch] = manager->texture_bytes_used;
@@ -359,14 +1372,49 @@ texture_2d *texture_manager_add_texture_from_image(texture_manager *manager, con
 
 texture_2d *texture_manager_add_texture_loaded(texture_manager *manager, texture_2d *tex) {
     tex->loaded = true;
-    HASH_ADD_KEYPTR(url_hash, manager->url_to_tex, tex->url, strlen(tex->url), tex);
+    texture_table_add(&manager->textures, tex);
+    lru_push_front(manager, tex);
     manager->tex_count++;
     //TODO handle the accounting stuff
     return tex;
 }
 
-static time_t last_accessed_compare(texture_2d *a, texture_2d *b) {
-    return a->last_accessed - b->last_accessed;
+// render textures handed back with texture_manager_release_render_texture,
+// kept with their gl storage for the next canvas of the same size class.
+// they are out of the url hash and the lru, and chained through lru_next
+#define MAX_POOLED_RENDER_TEXTURES 8
+#define MAX_POOLED_RENDER_BYTES 16777216 /* 16 MB */
+
+static texture_2d *m_render_pool = NULL;
+static int m_render_pool_count = 0;
+static size_t m_render_pool_bytes = 0;
+
+// textures are power of two sized, which makes that the size class
+static int render_size_class(int n) {
+    int size = 1;
+    while (size < n) {
+        size <<= 1;
+    }
+    return size;
+}
+
+static size_t render_texture_bytes(texture_2d *tex) {
+    return (size_t) tex->width * tex->height * tex->num_channels;
+}
+
+/**
+ * @name	drain_render_pool
+ * @brief	destroys every pooled render texture
+ * @retval	NONE
+ */
+static void drain_render_pool() {
+    while (m_render_pool) {
+        texture_2d *tex = m_render_pool;
+        m_render_pool = tex->lru_next;
+        texture_2d_destroy(tex);
+    }
+    m_render_pool_count = 0;
+    m_render_pool_bytes = 0;
 }
 
 void texture_manager_clear_textures(texture_manager *manager, bool clear_all) {
@@ -377,8 +1425,8 @@ void texture_manager_clear_textures(texture_manager *manager, bool clear_all) {
 
     {
         texture_2d *tex = NULL;
-        texture_2d *tmp = NULL;
-        HASH_ITER(url_hash, manager->url_to_tex, tex, tmp) {
+        unsigned int i = 0;
+        while ((tex = texture_table_next(&manager->textures, &i))) {
             TEXLOG("Before: %s canvas=%d access=%d tex-epoch: %d frame-epoch: %d", tex->url, tex->is_canvas, (int)tex->last_accessed, tex->frame_epoch, m_frame_epoch);
         }
     }
@@ -389,23 +1437,61 @@ void texture_manager_clear_textures(texture_manager *manager, bool clear_all) {
      * 1. the texture must be loaded to be cleared, period
      * 2. throw out all textures if clear_all is true, but respect rule 1
      * 3. throw out failed textures, forcing them to reload if needed
-     * 4. throw out least-recently-used textures if we exceed our estimated memory limit
+     * 4. while over the estimated memory limit or a category budget, throw
+     *    out unpinned textures that count against it, lowest priority
+     *    first and least-recently-used first within a priority
      */
     long adjusted_max_texture_bytes = manager->max_texture_bytes - manager->approx_bytes_to_load;
-    HASH_SRT(url_hash, manager->url_to_tex, last_accessed_compare);
-    texture_2d *tex = NULL;
-    texture_2d *tmp = NULL;
-    HASH_ITER(url_hash, manager->url_to_tex, tex, tmp) {
-        bool overLimit = manager->texture_bytes_used > adjusted_max_texture_bytes;
+    texture_2d *tex = manager->lru_tail;
+    while (tex) {
+        texture_2d *prev = tex->lru_prev;
 
-        // if we reach a recently used image and still need memory, halfsize everything
-        if (!use_halfsized_textures && overLimit && tex->frame_epoch == m_frame_epoch) {
-            should_use_halfsized = true;
+        // failed textures are kept at the tail, past them is everything else
+        if (!clear_all && !tex->failed) {
+            break;
         }
 
-        if (tex->loaded && (clear_all || tex->failed || overLimit)) {
-            texture_2d *to_be_destroyed = tex;
-            texture_manager_free_texture(manager, to_be_destroyed);
+        if (tex->loaded) {
+            texture_manager_free_texture(manager, tex);
+        }
+
+        tex = prev;
+    }
+
+    if (clear_all) {
+        drain_render_pool();
+    }
+
+    int priority;
+    for (priority = TEXTURE_PRIORITY_LOW; priority < TEXTURE_PRIORITY_PINNED; priority++) {
+        bool overLimit = (long)manager->texture_bytes_used > adjusted_max_texture_bytes;
+        bool over_budget = false;
+        int category;
+        for (category = 0; category < TEXTURE_CATEGORY_COUNT; category++) {
+            over_budget = over_budget || category_excess(manager, category) > 0;
+        }
+        if (!overLimit && !over_budget) {
+            break;
+        }
+
+        tex = manager->lru_tail;
+        while (tex) {
+            texture_2d *prev = tex->lru_prev;
+            bool category_over = category_excess(manager, tex->category) > 0;
+            overLimit = (long)manager->texture_bytes_used > adjusted_max_texture_bytes;
+
+            if (tex->priority == priority && tex->loaded && (overLimit || category_over)) {
+                // if we reach a recently used image and still need memory, halfsize its category
+                bool can_halfsize = tex->category == TEXTURE_CATEGORY_WORLD || tex->category == TEXTURE_CATEGORY_UI;
+                if (can_halfsize && !use_halfsized_textures && !m_category_halfsized[tex->category] &&
+                    tex->frame_epoch == m_frame_epoch) {
+                    m_category_should_halfsize[tex->category] = true;
+                }
+
+                texture_manager_free_texture(manager, tex);
+            }
+
+            tex = prev;
         }
     }
 
@@ -414,8 +1500,8 @@ void texture_manager_clear_textures(texture_manager *manager, bool clear_all) {
         LOG("{tex} Unloaded %d stale textures. Now: Texture count = %d. Bytes used = %d -> %d / %d", (int)(old_tex_count - manager->tex_count), (int)manager->tex_count, (int)old_bytes_used, (int)manager->texture_bytes_used, (int)adjusted_max_texture_bytes);
 
         texture_2d *tex = NULL;
-        texture_2d *tmp = NULL;
-        HASH_ITER(url_hash, manager->url_to_tex, tex, tmp) {
+        unsigned int i = 0;
+        while ((tex = texture_table_next(&manager->textures, &i))) {
             TEXLOG("{tex} After: %s canvas=%d access=%d", tex->url, tex->is_canvas, (int)tex->last_accessed);
         }
     }
@@ -425,8 +1511,8 @@ void texture_manager_clear_textures(texture_manager *manager, bool clear_all) {
 
 void texture_manager_reload_canvases(texture_manager *manager) {
     texture_2d *tex = NULL;
-    texture_2d *tmp = NULL;
-    HASH_ITER(url_hash, manager->url_to_tex, tex, tmp) {
+    unsigned int i = 0;
+    while ((tex = texture_table_next(&manager->textures, &i))) {
         if (tex->is_canvas) {
             texture_2d_reload(tex);
         }
@@ -438,302 +1524,1569 @@ void texture_manager_reload(texture_manager *manager) {
     //of just clearing them
     LOG("{tex} Reloading %i textures", manager->tex_count);
 
+    // pooled render textures went with the old context
+    drain_render_pool();
+
     pthread_mutex_lock(&mutex);
     texture_2d *cur_tex = tex_load_list;
 
     //remove anything waiting to be loaded from the hash
     while (cur_tex) {
-        HASH_DELETE(url_hash, manager->url_to_tex, cur_tex);
+        texture_table_remove(&manager->textures, cur_tex);
+
+        // pixel buffers and fences went with the old context, textures whose
+        // pixels were already handed to gl have to be loaded again
+        if (cur_tex->upload_state != UPLOAD_NONE && !cur_tex->decoding) {
+            if (cur_tex->upload_state == UPLOAD_MAPPED) {
+                m_mapped_uploads--;
+            }
+            cur_tex->upload_state = UPLOAD_NONE;
+            cur_tex->upload_buffer = cur_tex->upload_name = 0;
+            cur_tex->upload_mapping = cur_tex->upload_fence = NULL;
+            cur_tex->failed = cur_tex->pixel_data == NULL;
+        }
+
         LIST_ITERATE(&tex_load_list, cur_tex);
     }
 
     //add offscreen canvases to a canvas list to be reloaded
-    //after all the normal textures have been freed
+    //after all the normal textures have been freed. canvases javascript
+    //can redraw and images drawn in the last frames are remembered so
+    //they can be asked for again once the lock is released
     texture_2d *tex = NULL;
     texture_2d *tmp = NULL;
     texture_2d *canvas_list = NULL;
-    HASH_ITER(url_hash, manager->url_to_tex, tex, tmp) {
-        if (tex->is_canvas) {
+    char **visible_urls = (char **) malloc(manager->tex_count * sizeof(char *));
+    char **redraw_urls = (char **) malloc(manager->tex_count * sizeof(char *));
+    int visible_count = 0, redraw_count = 0;
+    unsigned int slot = 0;
+    while ((tex = texture_table_next(&manager->textures, &slot))) {
+        if (tex->is_canvas && !tex->regenerable) {
             LIST_ADD(&canvas_list, tex);
         } else {
+            if (tex->is_canvas && redraw_urls) {
+                redraw_urls[redraw_count++] = strdup(tex->url);
+            } else if (visible_urls && tex->url && !tex->failed && !tex->is_text && tex->frame_epoch >= m_frame_epoch - 1) {
+                visible_urls[visible_count++] = strdup(tex->url);
+            }
             texture_2d *to_be_destroyed = tex;
             texture_manager_free_texture(manager, to_be_destroyed);
         }
     }
 
-    //reload all the canvases
-    cur_tex = canvas_list;
-    tmp = NULL;
-    while (cur_tex) {
-        texture_2d_reload(cur_tex);
-        tmp = cur_tex;
-        LIST_ITERATE(&canvas_list, cur_tex);
-        LIST_REMOVE(&canvas_list, tmp);
+    //reload all the canvases
+    cur_tex = canvas_list;
+    tmp = NULL;
+    while (cur_tex) {
+        texture_2d_reload(cur_tex);
+        tmp = cur_tex;
+        LIST_ITERATE(&canvas_list, cur_tex);
+        LIST_REMOVE(&canvas_list, tmp);
+    }
+
+    //re-add the previously removed textures awaiting loading
+    cur_tex = tex_load_list;
+    while (cur_tex) {
+        texture_table_add(&manager->textures, cur_tex);
+        LIST_ITERATE(&tex_load_list, cur_tex);
+    }
+
+    pthread_mutex_unlock(&mutex);
+
+    //queue the images that were on screen right away, tagged as drawn this
+    //frame so the tick uploads them first within its budget, everything
+    //else loads when it is next drawn
+    int i;
+    for (i = 0; i < visible_count; i++) {
+        tex = texture_manager_load_texture(manager, visible_urls[i]);
+        if (tex) {
+            tex->frame_epoch = m_frame_epoch;
+        }
+        free(visible_urls[i]);
+    }
+
+    //ask javascript to redraw the canvases it can regenerate
+    for (i = 0; i < redraw_count; i++) {
+        notify_canvas_death(redraw_urls[i]);
+        free(redraw_urls[i]);
+    }
+    free(visible_urls);
+    free(redraw_urls);
+}
+
+/**
+ * @name	texture_manager_set_canvas_regenerable
+ * @brief	marks a canvas as one javascript redraws after a context loss,
+ *			so it is not read back by texture_manager_save and is freed with
+ *			a canvasFreed event on reload instead of being restored
+ * @param	manager - (texture_manager *) manager holding the canvas
+ * @param	url - (const char *) url of the canvas
+ * @param	regenerable - (bool) whether javascript can redraw it
+ * @retval	bool - false if there is no such canvas
+ */
+bool texture_manager_set_canvas_regenerable(texture_manager *manager, const char *url, bool regenerable) {
+    texture_2d *tex = find_texture(manager, url);
+    if (!tex || !tex->is_canvas) {
+        return false;
+    }
+
+    tex->regenerable = regenerable;
+    if (regenerable) {
+        TAG_FREE(tex->saved_data);
+        tex->saved_data = NULL;
+        tex->saved_encoded = false;
+    }
+    return true;
+}
+
+/**
+ * @brief tries to resize texture in place without changing gl texture.  returns pointer to original texture if successful, or returns pointer to new texture if change in gl texture occurs
+ */
+texture_2d *texture_manager_resize_texture(texture_manager *manager, texture_2d *tex, int width, int height) {
+    LOGFN("texture_manager_resize_texture");
+    if (texture_2d_can_resize(tex, width, height)) {
+        texture_2d_resize_unsafe(tex, width, height);
+        return tex;
+    } else {
+        texture_2d *new_tex = texture_2d_new_from_dimensions(width, height);
+        texture_manager_free_texture(manager, tex);
+        texture_manager_add_texture(manager, new_tex, true);
+        return new_tex;
+    }
+}
+
+/**
+ * @name	texture_manager_acquire_render_texture
+ * @brief	gives out a canvas texture to draw into, reusing a pooled one of
+ *			the same size class instead of allocating when it can. what
+ *			the texture held before is left in it
+ * @param	manager - (texture_manager *) manager to add the texture to
+ * @param	width - (int) width of the canvas
+ * @param	height - (int) height of the canvas
+ * @retval	texture_2d* - the texture, added to the manager under its url
+ */
+texture_2d *texture_manager_acquire_render_texture(texture_manager *manager, int width, int height) {
+    LOGFN("texture_manager_acquire_render_texture");
+    int class_width = render_size_class(width);
+    int class_height = render_size_class(height);
+
+    texture_2d **link = &m_render_pool;
+    while (*link) {
+        texture_2d *tex = *link;
+        if (tex->width == class_width && tex->height == class_height) {
+            *link = tex->lru_next;
+            tex->lru_next = NULL;
+            m_render_pool_count--;
+            m_render_pool_bytes -= render_texture_bytes(tex);
+
+            texture_2d_resize_unsafe(tex, width, height);
+            return texture_manager_add_texture(manager, tex, true);
+        }
+        link = &tex->lru_next;
+    }
+
+    return texture_manager_new_texture(manager, width, height);
+}
+
+/**
+ * @name	texture_manager_release_render_texture
+ * @brief	takes a canvas texture out of the manager, keeping its gl
+ *			storage pooled for texture_manager_acquire_render_texture.
+ *			the texture is freed instead when the pool is full
+ * @param	manager - (texture_manager *) manager holding the texture
+ * @param	tex - (texture_2d *) canvas texture to release
+ * @retval	NONE
+ */
+void texture_manager_release_render_texture(texture_manager *manager, texture_2d *tex) {
+    LOGFN("texture_manager_release_render_texture");
+    if (!tex) {
+        return;
+    }
+
+    size_t bytes = render_texture_bytes(tex);
+    if (!tex->is_canvas || m_memory_warning || m_render_pool_count >= MAX_POOLED_RENDER_TEXTURES ||
+        m_render_pool_bytes + bytes > MAX_POOLED_RENDER_BYTES) {
+        texture_manager_free_texture(manager, tex);
+        return;
+    }
+
+    account_texture_bytes(manager, tex, -tex->used_texture_bytes);
+    texture_table_remove(&manager->textures, tex);
+    lru_remove(manager, tex);
+    manager->tex_count--;
+    release_texture_handle(tex);
+
+    // whoever borrows it next starts from a plain canvas
+    TAG_FREE(tex->saved_data);
+    tex->saved_data = NULL;
+    tex->saved_size = 0;
+    tex->saved_encoded = false;
+    tex->regenerable = false;
+    tex->ctx = NULL;
+
+    tex->lru_next = m_render_pool;
+    m_render_pool = tex;
+    m_render_pool_count++;
+    m_render_pool_bytes += bytes;
+}
+
+void texture_manager_save(texture_manager *manager) {
+    LOGFN("texture_manager_save");
+    texture_2d *tex = NULL;
+    unsigned int i = 0;
+    while ((tex = texture_table_next(&manager->textures, &i))) {
+        if (tex->is_canvas && !tex->regenerable) {
+            texture_2d_save(tex);
+        }
+    }
+}
+
+void texture_manager_free_texture(texture_manager *manager, texture_2d *tex) {
+    LOGFN("texture_manager_free_texture");
+
+    if (tex) {
+        leave_shared(manager, tex);
+        //need to subtract off the texture bytes being used as the texture is freed
+        account_texture_bytes(manager, tex, -tex->used_texture_bytes);
+        texture_table_remove(&manager->textures, tex);
+        lru_remove(manager, tex);
+        manager->tex_count--;
+
+        if (!tex->loaded) {
+            manager->approx_bytes_to_load -= tex->assumed_texture_bytes;
+
+            // nobody is left to draw it, stop downloading it
+            if (!tex->decoding && is_image_cache_url(tex->url)) {
+                image_cache_cancel(tex->url);
+            }
+        }
+
+        TEXLOG("Texture freed: %s!  COUNT=%d, USED=%d", tex->url, (int)manager->tex_count, (int)manager->texture_bytes_used);
+        release_texture_handle(tex);
+        atlas_release_texture(tex);
+        texture_2d_destroy(tex);
+    }
+}
+
+// bytes a decoded, uncompressed texture takes in gl
+static int pixel_bytes(texture_2d *tex) {
+    return tex->pixel_type == GL_UNSIGNED_BYTE ? tex->num_channels : 2;
+}
+
+static size_t upload_size(texture_2d *tex) {
+    int width = tex->width >> (tex->scale - 1);
+    int height = tex->height >> (tex->scale - 1);
+    return (size_t) width * height * pixel_bytes(tex);
+}
+
+static bool is_canvas_url(const char *url) {
+    return url[0] == '_' && url[1] == '_'
+        && url[2] == 'c' && url[3] == 'a'
+        && url[4] == 'n' && url[5] == 'v'
+        && url[6] == 'a' && url[7] == 's'
+        && url[8] == '_' && url[9] == '_';
+}
+
+// finds a queued texture no other worker is decoding, with the lock held
+static texture_2d *claim_queued_texture() {
+    texture_2d *cur_tex = tex_load_list;
+
+    while (cur_tex) {
+        const char *url = cur_tex->url;
+        if (!cur_tex->decoding && url != NULL &&
+            (is_canvas_url(url) || cur_tex->upload_state == UPLOAD_MAPPED ||
+             (cur_tex->pixel_data == NULL && !cur_tex->failed))) {
+            cur_tex->decoding = true;
+            return cur_tex;
+        }
+
+        LIST_ITERATE(&tex_load_list, cur_tex);
+    }
+
+    return NULL;
+}
+
+// hands a decoded job to the render thread without taking the lock
+static void push_decoded_job(decode_job *job) {
+    job->next = __atomic_load_n(&m_decoded_jobs, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&m_decoded_jobs, &job->next, job, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        // job->next now holds the current head, try again on top of it
+    }
+}
+
+/**
+ * @name	decode_preview
+ * @brief	decodes a half sized preview of a job's image and hands it to
+ *			the render thread ahead of the full image
+ * @param	job - (decode_job *) encoded image, left for the full decode
+ * @retval	NONE
+ */
+static void decode_preview(decode_job *job) {
+    decode_job *preview = (decode_job *) calloc(1, sizeof(decode_job));
+    char *url = strdup(job->url);
+    if (!preview || !url) {
+        free(preview);
+        free(url);
+        return;
+    }
+    preview->url = url;
+    preview->preview = true;
+    preview->pixels = texture_2d_load_texture_packed(job->url, job->bytes, job->size, &preview->num_channels, &preview->width, &preview->height,
+                                                     &preview->originalWidth, &preview->originalHeight, &preview->scale, &preview->used_bytes,
+                                                     &preview->compression_type, true, &preview->pixel_type);
+
+    // the preview is drawn with the full image's size, which half sizing
+    // rounds odd sides up from unless padding to a power of two hides it
+    if (preview->pixels && preview->scale == 2 &&
+        (!texture_2d_npot_supported() || (preview->width == preview->originalWidth &&
+                                          preview->height == preview->originalHeight))) {
+        push_decoded_job(preview);
+    } else {
+        free(preview->pixels);
+        free(preview->url);
+        free(preview);
+    }
+}
+
+/**
+ * @name	decode_image_data
+ * @brief	decodes an image the image cache handed over and passes the
+ *			pixels to the render thread without taking the lock
+ * @param	job - (decode_job *) encoded image, handed on to the render thread
+ * @retval	NONE
+ */
+static void decode_image_data(decode_job *job) {
+    if (job->progressive) {
+        decode_preview(job);
+    }
+
+    job->used_bytes = 0;
+    job->pixels = texture_2d_load_texture_packed(job->url, job->bytes, job->size, &job->num_channels, &job->width, &job->height,
+                                                 &job->originalWidth, &job->originalHeight, &job->scale, &job->used_bytes,
+                                                 &job->compression_type, job->halfsize, &job->pixel_type);
+
+    TEXLOG("image_cache_background_loader loaded %s, status: %i", job->url, job->pixels == NULL);
+
+    // lets other urls holding the same image share the texture
+    if (job->pixels) {
+        uint64_t hash[2];
+        MurmurHash3_x86_128(job->bytes, (int) job->size, CONTENT_KEY_SEED, hash);
+        job->content_key = hash[0] ? hash[0] : 1;
+    }
+
+    free(job->bytes);
+    job->bytes = NULL;
+    push_decoded_job(job);
+}
+
+/**
+ * @name	collect_decoded_images
+ * @brief	gives the textures the pixels the workers decoded since the last
+ *			tick and queues them for upload, with the lock held
+ * @param	manager - (texture_manager *) manager the textures belong to
+ * @retval	NONE
+ */
+static void collect_decoded_images(texture_manager *manager) {
+    decode_job *job = __atomic_exchange_n(&m_decoded_jobs, NULL, __ATOMIC_ACQUIRE);
+    while (job) {
+        decode_job *next = job->next;
+
+        texture_2d *tex = find_texture(manager, job->url);
+        // a preview is only wanted until the texture has anything better, a
+        // full image that failed leaves the preview in place
+        bool wanted = tex != NULL && !tex->decoding;
+        if (wanted && job->preview) {
+            wanted = !tex->loaded && !tex->pixel_data && tex->upload_state == UPLOAD_NONE;
+        } else if (wanted && tex->preview && !job->pixels) {
+            tex->preview = false;
+            wanted = false;
+        }
+
+        if (wanted) {
+            if (tex->preview && tex->loaded && !job->preview) {
+                // counts the full image from now on, the preview is deleted
+                // when it is uploaded
+                account_texture_bytes(manager, tex, job->used_bytes - tex->used_texture_bytes);
+            } else {
+                tex->preview = job->preview;
+            }
+            texture_2d_free_pixel_data(tex);
+            if (!job->preview && tex->content_key != job->content_key) {
+                leave_shared(manager, tex);
+                tex->content_key = job->content_key;
+            }
+            tex->num_channels = job->num_channels;
+            tex->width = job->width;
+            tex->height = job->height;
+            tex->originalWidth = job->originalWidth;
+            tex->originalHeight = job->originalHeight;
+            tex->scale = job->scale;
+            tex->failed = job->pixels == NULL;
+            tex->pixel_data = job->pixels;
+            tex->compression_type = job->compression_type;
+            tex->pixel_type = job->pixel_type;
+            tex->used_texture_bytes = job->used_bytes;
+            tex->pixel_data_bytes = job->pixels ? upload_size(tex) : 0;
+            MEMORY_ACCOUNT(MEMORY_TAG_DECODE, (long long) tex->pixel_data_bytes);
+            if (!LIST_IN_LIST(&tex_load_list, tex)) {
+                LIST_ADD(&tex_load_list, tex);
+            }
+        } else {
+            free(job->pixels);
+        }
+
+        free(job->url);
+        free(job);
+        job = next;
+    }
+}
+
+/**
+ * @name	texture_manager_background_texture_loader
+ * @brief	decode worker, takes images from the image cache and queued
+ *			textures and decodes them with the lock released, so several
+ *			workers decode at once and the render thread is never blocked
+ *			on a decode
+ * @param	param - (void *) index of the worker
+ * @retval	NONE
+ */
+void texture_manager_background_texture_loader(void *param) {
+    const int index = (int)(intptr_t)param;
+    pthread_mutex_lock(&mutex);
+
+    while (m_running) {
+        // workers past the configured count stay parked
+        if (index >= m_decode_worker_count) {
+            pthread_cond_wait(&cond_var, &mutex);
+            continue;
+        }
+
+        decode_job *job = m_decode_jobs;
+        if (job) {
+            LIST_REMOVE(&m_decode_jobs, job);
+            pthread_mutex_unlock(&mutex);
+            load_stats_since(LOAD_STAGE_QUEUE, job->queued);
+            decode_image_data(job);
+            pthread_mutex_lock(&mutex);
+            continue;
+        }
+
+        texture_2d *cur_tex = claim_queued_texture();
+        if (!cur_tex) {
+            pthread_cond_wait(&cond_var, &mutex);
+            continue;
+        }
+
+        // a claimed texture is still queued but not loaded, so it is not
+        // freed while the lock is released
+        bool remove = true;
+        pthread_mutex_unlock(&mutex);
+        if (cur_tex->upload_state == UPLOAD_MAPPED) {
+            // fill the pixel buffer the render thread mapped, the pixels
+            // are freed before upload_texture sees them
+            texture_2d_build_alpha_mask(cur_tex);
+            memcpy(cur_tex->upload_mapping, cur_tex->pixel_data, upload_size(cur_tex));
+            remove = false;
+        } else if (is_canvas_url(cur_tex->url)) {
+            // reload the canvas from JavaScript
+            notify_canvas_death(cur_tex->url);
+        } else {
+            TEXLOG("Passing to load_image_with_c: %s", cur_tex->url);
+            if (cur_tex->load_requested) {
+                // bundled images are queued as they are asked for
+                load_stats_since(LOAD_STAGE_QUEUE, cur_tex->load_requested);
+            }
+            // platform loaders only produce 8 bit pixels
+            cur_tex->pixel_type = GL_UNSIGNED_BYTE;
+            remove = !resource_loader_load_image_with_c(cur_tex);
+        }
+        pthread_mutex_lock(&mutex);
+
+        cur_tex->decoding = false;
+        if (cur_tex->upload_state == UPLOAD_MAPPED) {
+            texture_2d_free_pixel_data(cur_tex);
+            cur_tex->upload_state = UPLOAD_FILLED;
+        }
+
+        // if not loading from C remove from list
+        if (remove && LIST_IN_LIST(&tex_load_list, cur_tex)) {
+            LIST_REMOVE(&tex_load_list, cur_tex);
+        }
+    }
+
+    pthread_mutex_unlock(&mutex);
+}
+
+// starts decode workers up to the configured count, with the lock held
+static void start_decode_workers() {
+    while (m_decode_threads_started < m_decode_worker_count) {
+        int index = m_decode_threads_started;
+        // bulk decode should not take cores from the render thread
+        m_decode_threads[index] = threads_create_thread_with_priority(texture_manager_background_texture_loader, (void *)(intptr_t)index,
+                                                                      THREADS_PRIORITY_UTILITY, THREADS_AFFINITY_EFFICIENCY);
+        if (m_decode_threads[index] == THREADS_INVALID_THREAD) {
+            LOG("{tex} WARNING: Unable to start texture decode worker %d", index);
+            break;
+        }
+        m_decode_threads_started++;
+    }
+}
+
+/**
+ * @name	texture_manager_set_decode_workers
+ * @brief	sets how many threads decode images in the background
+ * @param	count - (int) number of decode workers, at least one
+ * @retval	NONE
+ */
+void texture_manager_set_decode_workers(int count) {
+    if (count < 1) {
+        count = 1;
+    } else if (count > MAX_DECODE_WORKERS) {
+        count = MAX_DECODE_WORKERS;
+    }
+
+    pthread_mutex_lock(&mutex);
+    m_decode_worker_count = count;
+    if (m_running) {
+        start_decode_workers();
+        pthread_cond_broadcast(&cond_var);
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+CEXPORT void image_cache_load_callback(struct image_data *data) {
+    texture_manager *manager = texture_manager_get();
+
+    // the image cache keeps its buffers, so the decode worker gets a copy
+    decode_job *job = (decode_job *) malloc(sizeof(decode_job));
+    job->url = strdup(data->url);
+    job->bytes = (char *) malloc(data->size ? data->size : 1);
+    job->size = data->size;
+    if (!job->url || !job->bytes) {
+        LOG("{tex} WARNING: Unable to queue %s for decoding", data->url);
+        free(job->url);
+        free(job->bytes);
+        free(job);
+        return;
+    }
+    memcpy(job->bytes, data->bytes, data->size);
+    job->next = job->prev = NULL;
+    job->queued = profiler_now();
+
+    // the header says what the image will take, better than the guess
+    // made for a remote image before anything had arrived
+    image_info info;
+    bool probed = image_loader_probe((const unsigned char *) data->bytes, data->size, &info);
+
+    pthread_mutex_lock(&mutex);
+    texture_2d *tex = find_texture(manager, job->url);
+    // half-size when the whole manager or just this texture's category does
+    job->halfsize = use_halfsized_textures || (tex && m_category_halfsized[tex->category]);
+    job->progressive = m_progressive && !job->halfsize && probed && info.format == IMAGE_FORMAT_JPEG &&
+                       tex && !tex->loaded;
+    job->preview = false;
+    if (probed && tex && !tex->loaded && !tex->decoding) {
+        long bytes = estimate_texture_bytes(tex, info.size, info.channels, info.compression_type);
+        manager->approx_bytes_to_load += bytes - tex->assumed_texture_bytes;
+        tex->assumed_texture_bytes = bytes;
+    }
+    LIST_ADD(&m_decode_jobs, job);
+    pthread_cond_broadcast(&cond_var);
+    pthread_mutex_unlock(&mutex);
+}
+
+/**
+ * @name	texture_manager_set_progressive_loading
+ * @brief	sets whether JPEGs from the image cache show a half sized preview
+ *			while their full image decodes, see Progressive loading above
+ * @param	enabled - (bool) whether to decode previews
+ * @retval	NONE
+ */
+void texture_manager_set_progressive_loading(bool enabled) {
+    m_progressive = enabled;
+}
+
+void texture_manager_set_use_halfsized_textures(bool use_halfsized) {
+    if (!use_halfsized) {
+        memset(m_category_halfsized, 0, sizeof(m_category_halfsized));
+    }
+    if (use_halfsized_textures != use_halfsized) {
+        LOG("{tex} use_halfsized_textures=%d", use_halfsized);
+        use_halfsized_textures = use_halfsized;
+        texture_manager_clear_textures(m_instance, true);
+    }
+}
+
+/**
+ * @name	set_category_halfsized
+ * @brief	switches one category to half-sized images and frees its loaded
+ *			textures so they come back smaller, leaving the rest in place.
+ *			called with the lock held.
+ * @param	manager - (texture_manager *) manager owning the textures
+ * @param	category - (int) TEXTURE_CATEGORY_WORLD or TEXTURE_CATEGORY_UI
+ * @retval	NONE
+ */
+static void set_category_halfsized(texture_manager *manager, int category) {
+    LOG("{tex} Using half-sized textures for category %d", category);
+    m_category_halfsized[category] = true;
+
+    texture_2d *tex = manager->lru_tail;
+    while (tex) {
+        texture_2d *prev = tex->lru_prev;
+        if (tex->category == category && tex->loaded && tex->scale == 1 && tex->priority != TEXTURE_PRIORITY_PINNED) {
+            texture_manager_free_texture(manager, tex);
+        }
+        tex = prev;
+    }
+}
+
+/**
+ * @name	texture_manager_set_use_16bit_textures
+ * @brief	sets whether decoded images are dithered down to 16 bit formats,
+ *			halving their texture memory. reloads every texture on change.
+ * @param	mode - (int) TEXTURE_16BIT_* mode
+ * @retval	NONE
+ */
+void texture_manager_set_use_16bit_textures(int mode) {
+    if (mode < TEXTURE_16BIT_OFF || mode > TEXTURE_16BIT_PUNCHTHROUGH) {
+        LOG("{tex} WARNING: Ignoring unknown 16 bit texture mode %d", mode);
+        return;
+    }
+    if (use_16bit_textures != mode) {
+        LOG("{tex} use_16bit_textures=%d", mode);
+        use_16bit_textures = mode;
+        texture_manager_clear_textures(m_instance, true);
+    }
+}
+
+texture_manager *texture_manager_acquire() {
+    texture_manager *manager = texture_manager_get();
+    pthread_mutex_lock(&mutex);
+    return manager;
+}
+
+void texture_manager_release() {
+    pthread_mutex_unlock(&mutex);
+}
+
+texture_manager *texture_manager_get() {
+    LOGFN("texture_manager_get");
+
+    // If it looks like the instance hasn't been created yet,
+    if (!m_instance_ready) {
+        // Lock mutex while racing to create the instance
+        pthread_mutex_lock(&mutex);
+
+        // If we won the race to create the instance,
+        if (!m_instance_ready) {
+            m_instance = (texture_manager *)malloc(sizeof(texture_manager));
+            texture_table_init(&m_instance->textures);
+            texture_table_init(&m_instance->contents);
+            m_instance->lru_head = NULL;
+            m_instance->lru_tail = NULL;
+            m_instance->tex_count = 0;
+            m_instance->texture_bytes_used = 0;
+            m_instance->textures_to_load = 0;
+            m_instance->approx_bytes_to_load = 0;
+            // default to fullsized textures
+            m_instance->max_texture_bytes = MAX_BYTES_FOR_TEXTURES;
+            memset(m_instance->category_bytes_used, 0, sizeof(m_instance->category_bytes_used));
+            memset(m_instance->category_max_bytes, 0, sizeof(m_instance->category_max_bytes));
+            // Start the background decode workers
+            m_running = true;
+            start_decode_workers();
+
+            // Mark the instance as being ready
+            m_instance_ready = true;
+        }
+
+        pthread_mutex_unlock(&mutex);
+    }
+
+    return m_instance;
+}
+
+// DANGER: This function is not thread-safe.  Make sure nothing else is running
+// texture_manager_get() et al while destroying an instance.
+void texture_manager_destroy(texture_manager *manager) {
+    LOGFN("texture_manager_destroy");
+    pthread_mutex_lock(&mutex);
+    m_running = false;                 // Flag decode workers to stop
+    pthread_cond_broadcast(&cond_var); // Signal them to wake up and terminate
+    pthread_mutex_unlock(&mutex);
+
+    LOG("{tex} Goodnight");
+
+    while (m_decode_threads_started) {
+        threads_join_thread(&m_decode_threads[--m_decode_threads_started]);
+    }
+
+    // Drop images the workers did not get to
+    while (m_decode_jobs) {
+        decode_job *job = m_decode_jobs;
+        LIST_REMOVE(&m_decode_jobs, job);
+        free(job->url);
+        free(job->bytes);
+        free(job);
+    }
+    // and the ones decoded since the last tick
+    decode_job *job = __atomic_exchange_n(&m_decoded_jobs, NULL, __ATOMIC_ACQUIRE);
+    while (job) {
+        decode_job *next = job->next;
+        free(job->url);
+        free(job->pixels);
+        free(job);
+        job = next;
+    }
+
+    texture_2d *tex = NULL;
+    unsigned int i = 0;
+    while ((tex = texture_table_next(&manager->textures, &i))) {
+        leave_shared(manager, tex);
+        release_texture_handle(tex);
+        atlas_release_texture(tex);
+        texture_2d_destroy(tex);
+    }
+    texture_table_clear(&manager->textures);
+    texture_table_clear(&manager->contents);
+    drain_render_pool();
+    free(manager);
+    // Clear the texture load list
+    tex_load_list = NULL;
+
+    // If manager is the singleton instance, clear it also
+    if (manager == m_instance) {
+        m_instance = NULL;
+        m_instance_ready = false;
+    }
+
+    // Clear memory usage profile
+    m_memory_warning = false;
+    m_frame_epoch = 1;
+    m_frame_used_bytes = 0;
+    memset(m_working_set, 0, sizeof(m_working_set));
+}
+
+void texture_manager_touch_texture(texture_manager *manager, const char *url) {
+    LOGFN("texture_manager_touch_texture");
+    texture_2d *tex = find_texture(manager, url);
+
+    if (tex) {
+        touch_texture(manager, tex);
+    } else {
+        // if it was a canvas
+        if (url[0] == '_' && url[1] == '_'
+            && url[2] == 'c' && url[3] == 'a'
+            && url[4] == 'n' && url[5] == 'v'
+            && url[6] == 'a' && url[7] == 's'
+            && url[8] == '_' && url[9] == '_')
+        {
+            notify_canvas_death(url);
+        }
+    }
+}
+
+static long get_epoch_used_max() {
+    long highest = MIN_BYTES_FOR_TEXTURES;
+    int i;
+
+    for (i = 0; i < EPOCH_USED_BINS; i++) {
+        if (highest < m_epoch_used[i]) {
+            highest = m_epoch_used[i];
+        }
+    }
+
+    return highest;
+}
+
+/**
+ * @name	texture_manager_working_set
+ * @brief	gets the bytes of the textures drawn in the last frame and the
+ *			most drawn in any of the last EPOCH_USED_BINS frames
+ * @param	last_frame - (long *) receives the last frame's bytes
+ * @param	peak - (long *) receives the most of the recent frames
+ * @retval	NONE
+ */
+void texture_manager_working_set(long *last_frame, long *peak) {
+    long highest = 0;
+    for (int i = 0; i < EPOCH_USED_BINS; i++) {
+        if (highest < m_working_set[i]) {
+            highest = m_working_set[i];
+        }
+    }
+    *last_frame = m_working_set[(unsigned)(m_frame_epoch - 1) & EPOCH_USED_MASK];
+    *peak = highest;
+}
+
+// the directory of a url, canvases all under one name
+static size_t url_prefix_length(const char *url) {
+    if (is_canvas_url(url)) {
+        return 10; // __canvas__
+    }
+    const char *slash = strrchr(url, '/');
+    return slash ? (size_t)(slash - url) + 1 : 0;
+}
+
+/**
+ * @name	texture_manager_dump
+ * @brief	describes every texture the manager holds as JSON, one array of
+ *			values per texture in the order of "fields", with totals by url
+ *			prefix and the frame working set against the budget
+ * @param	manager - (texture_manager *) manager to describe
+ * @retval	char* - the dump, freed by the caller, or NULL
+ */
+char *texture_manager_dump(texture_manager *manager) {
+    static const char *fields[] = {
+        "url", "glName", "width", "height", "bytes", "channels", "compression", "pixelType",
+        "scale", "lastUsedEpoch", "canvas", "text", "loaded", "category", "loadMs"
+    };
+
+    json_t *dump = json_object();
+    json_t *names = json_array();
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        json_array_append_new(names, json_string(fields[i]));
+    }
+    json_object_set_new(dump, "fields", names);
+
+    json_t *textures = json_array();
+    json_t *prefixes = json_object();
+    char prefix[256];
+
+    pthread_mutex_lock(&mutex);
+    texture_2d *tex = NULL;
+    unsigned int i = 0;
+    while ((tex = texture_table_next(&manager->textures, &i))) {
+        const char *url = tex->url ? tex->url : "";
+        json_t *row = json_array();
+        json_array_append_new(row, json_string(url));
+        json_array_append_new(row, json_integer(tex->name));
+        // what gl holds, less any half sizing
+        json_array_append_new(row, json_integer(tex->width >> (tex->scale - 1)));
+        json_array_append_new(row, json_integer(tex->height >> (tex->scale - 1)));
+        json_array_append_new(row, json_integer(tex->used_texture_bytes));
+        json_array_append_new(row, json_integer(tex->num_channels));
+        json_array_append_new(row, json_integer(tex->compression_type));
+        json_array_append_new(row, json_integer(tex->pixel_type));
+        json_array_append_new(row, json_integer(tex->scale));
+        json_array_append_new(row, json_integer(tex->frame_epoch));
+        json_array_append_new(row, json_boolean(tex->is_canvas));
+        json_array_append_new(row, json_boolean(tex->is_text));
+        json_array_append_new(row, json_boolean(tex->loaded));
+        json_array_append_new(row, json_integer(tex->category));
+        json_array_append_new(row, json_real(tex->load_ms));
+        json_array_append_new(textures, row);
+
+        size_t length = url_prefix_length(url);
+        if (length >= sizeof(prefix)) {
+            length = sizeof(prefix) - 1;
+        }
+        memcpy(prefix, url, length);
+        prefix[length] = '\0';
+
+        json_t *total = json_object_get(prefixes, prefix);
+        if (!total) {
+            total = json_object();
+            json_object_set_new(total, "count", json_integer(0));
+            json_object_set_new(total, "bytes", json_integer(0));
+            json_object_set_new(total, "drawnRecently", json_integer(0));
+            json_object_set_new(prefixes, prefix, total);
+        }
+        json_t *value = json_object_get(total, "count");
+        json_integer_set(value, json_integer_value(value) + 1);
+        value = json_object_get(total, "bytes");
+        json_integer_set(value, json_integer_value(value) + tex->used_texture_bytes);
+        // drawn this frame so far or the last one
+        if (tex->frame_epoch >= m_frame_epoch - 1) {
+            value = json_object_get(total, "drawnRecently");
+            json_integer_set(value, json_integer_value(value) + tex->used_texture_bytes);
+        }
+    }
+
+    json_object_set_new(dump, "frameEpoch", json_integer(m_frame_epoch));
+    json_object_set_new(dump, "textureBytes", json_integer((json_int_t) manager->texture_bytes_used));
+    json_object_set_new(dump, "maxTextureBytes", json_integer((json_int_t) manager->max_texture_bytes));
+    json_object_set_new(dump, "bytesToLoad", json_integer((json_int_t) manager->approx_bytes_to_load));
+    pthread_mutex_unlock(&mutex);
+
+    long last_frame, peak;
+    texture_manager_working_set(&last_frame, &peak);
+    json_object_set_new(dump, "workingSet", json_integer(last_frame));
+    json_object_set_new(dump, "peakWorkingSet", json_integer(peak));
+    json_object_set_new(dump, "textures", textures);
+    json_object_set_new(dump, "prefixes", prefixes);
+
+    char *str = json_dumps(dump, JSON_COMPACT);
+    json_decref(dump);
+    return str;
+}
+
+/**
+ * @name	create_gl_texture
+ * @brief	creates a gl texture in a decoded texture's format and fills it
+ * @param	tex - (texture_2d *) decoded texture to create the gl texture for
+ * @param	sampler - (texture_2d_sampler *) receives the sampler state set
+ * @param	pixels - (const void *) pixel data, or the offset into the bound
+ *			pixel unpack buffer
+ * @retval	GLuint - the new gl texture
+ */
+static GLuint create_gl_texture(texture_2d *tex, texture_2d_sampler *sampler, const void *pixels) {
+    long long start = profiler_now();
+    // create with the sampler state drawing uses so it never changes
+    GLuint texture = 0;
+    GLTRACE(glGenTextures(1, &texture));
+    gl_state_bind_texture(0, texture);
+    texture_2d_apply_sampler(sampler, GL_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+
+    // create the texture
+    int channels = tex->num_channels;
+    int width = tex->width >> (tex->scale - 1);
+    int height = tex->height >> (tex->scale - 1);
+    if (tex->compression_type) {
+        // container images carry their mip levels one after another, largest first
+        const unsigned char *level_bits = (const unsigned char *) pixels;
+        long remaining = tex->used_texture_bytes;
+        int level = 0;
+        while (remaining > 0) {
+            long level_size = image_loader_compressed_level_size(tex->compression_type, width, height);
+            if (level_size <= 0 || level_size > remaining) {
+                level_size = remaining;
+            }
+            GLTRACE(glCompressedTexImage2D(GL_TEXTURE_2D, level, tex->compression_type, width, height, 0, level_size, level_bits));
+            level_bits += level_size;
+            remaining -= level_size;
+            level++;
+            if (width == 1 && height == 1) {
+                break;
+            }
+            width = width > 1 ? width >> 1 : 1;
+            height = height > 1 ? height >> 1 : 1;
+        }
+
+        // only a chain down to 1x1 is complete enough to sample with mipmaps
+        if (level > 1 && width == 1 && height == 1) {
+            tex->mip_levels = level;
+            texture_2d_apply_sampler(sampler, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+        } else {
+            tex->mip_levels = 1;
+        }
+    } else {
+        // select the right internal and input format based on the number of channels
+        GLint format;
+        switch (channels) {
+        case 1:
+            format = GL_LUMINANCE;
+            break;
+        case 3:
+            format = GL_RGB;
+            break;
+        default:
+        case 4:
+            format = GL_RGBA;
+            break;
+        }
+        // rows of non power of two 1, 3 channel and 16 bit images are not 4 byte aligned
+        bool packed_rows = (width * pixel_bytes(tex)) & 3;
+        if (packed_rows) {
+            GLTRACE(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+        }
+        GLTRACE(glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, tex->pixel_type, pixels));
+        if (packed_rows) {
+            GLTRACE(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+        }
+
+        // gles2 can only mipmap non power of two textures with the npot extension
+        tex->mip_levels = 1;
+        bool pot = !(width & (width - 1)) && !(height & (height - 1));
+        if (wants_mipmaps(tex) && (pot || texture_2d_npot_supported())) {
+            GLTRACE(glGenerateMipmap(GL_TEXTURE_2D));
+            int side = width > height ? width : height;
+            while (side > 1) {
+                side >>= 1;
+                tex->mip_levels++;
+            }
+            texture_2d_apply_sampler(sampler, GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR, GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+
+            // the chain adds a third on top of the base level
+            tex->used_texture_bytes += tex->used_texture_bytes / 3;
+        }
+    }
+
+    load_stats_since(LOAD_STAGE_UPLOAD, start);
+    return texture;
+}
+
+/*
+ * Load results
+ *
+ * With a load listener set, each uploaded or failed image is appended to a
+ * batch that the tick hands to the listener once, after the lock is
+ * released, instead of formatting and dispatching an imageLoaded JSON event
+ * per image.  Without one the JSON events are sent as before.
+ */
+
+static texture_load_listener m_load_listener = NULL;
+static texture_load_result *m_load_results = NULL;
+static int m_load_result_count = 0;
+static int m_load_result_capacity = 0;
+
+// urls of the batch back to back, results point in once the batch is sent
+static size_t *m_load_result_url_offsets = NULL;
+static char *m_load_result_urls = NULL;
+static size_t m_load_result_urls_used = 0;
+static size_t m_load_result_urls_capacity = 0;
+
+/**
+ * @name	texture_manager_set_load_listener
+ * @brief	delivers image load results in one batch per tick to the given
+ *			listener instead of as imageLoaded / imageError events
+ * @param	listener - (texture_load_listener) receives the batch on the
+ *			render thread, NULL to go back to events. set it from the
+ *			render thread so it cannot change during a tick
+ * @retval	NONE
+ */
+void texture_manager_set_load_listener(texture_load_listener listener) {
+    pthread_mutex_lock(&mutex);
+    m_load_listener = listener;
+    pthread_mutex_unlock(&mutex);
+}
+
+// appends a texture that finished loading to the batch, false if there was no room
+static bool add_load_result(texture_2d *tex, int gl_name) {
+    size_t url_size = strlen(tex->url) + 1;
+
+    if (m_load_result_count == m_load_result_capacity) {
+        int capacity = m_load_result_capacity ? m_load_result_capacity * 2 : 32;
+        texture_load_result *results = (texture_load_result *) realloc(m_load_results, capacity * sizeof(texture_load_result));
+        if (results) {
+            m_load_results = results;
+        }
+        size_t *offsets = (size_t *) realloc(m_load_result_url_offsets, capacity * sizeof(size_t));
+        if (offsets) {
+            m_load_result_url_offsets = offsets;
+        }
+        if (!results || !offsets) {
+            return false;
+        }
+        m_load_result_capacity = capacity;
+    }
+    if (m_load_result_urls_used + url_size > m_load_result_urls_capacity) {
+        size_t capacity = (m_load_result_urls_used + url_size) * 2;
+        char *urls = (char *) realloc(m_load_result_urls, capacity);
+        if (!urls) {
+            return false;
+        }
+        m_load_result_urls = urls;
+        m_load_result_urls_capacity = capacity;
+    }
+
+    // the url buffer may still move, so keep the offset until the batch is sent
+    m_load_result_url_offsets[m_load_result_count] = m_load_result_urls_used;
+    memcpy(m_load_result_urls + m_load_result_urls_used, tex->url, url_size);
+    m_load_result_urls_used += url_size;
+
+    texture_load_result *result = &m_load_results[m_load_result_count++];
+    result->id = tex->id;
+    result->gl_name = gl_name;
+    result->width = tex->width;
+    result->height = tex->height;
+    result->original_width = tex->originalWidth;
+    result->original_height = tex->originalHeight;
+    result->failed = tex->failed;
+    return true;
+}
+
+// hands the tick's batch to the listener, called without the lock held
+static void send_load_results(texture_load_listener listener) {
+    int i;
+    if (!m_load_result_count) {
+        return;
+    }
+
+    for (i = 0; i < m_load_result_count; i++) {
+        m_load_results[i].url = m_load_result_urls + m_load_result_url_offsets[i];
+    }
+    listener(m_load_results, m_load_result_count);
+
+    m_load_result_count = 0;
+    m_load_result_urls_used = 0;
+}
+
+/**
+ * @name	release_preview
+ * @brief	deletes the preview a texture drew until its full image was
+ *			uploaded, with the lock held
+ * @param	manager - (texture_manager *) manager owning the texture
+ * @param	tex - (texture_2d *) texture about to take its full image
+ * @retval	NONE
+ */
+static void release_preview(texture_manager *manager, texture_2d *tex) {
+    if (tex->atlas_page) {
+        atlas_release_texture(tex);
+    } else if (tex->name) {
+        // draws queued this frame still sample the preview
+        draw_textures_flush();
+        gl_state_texture_deleted(tex->name);
+        GLTRACE(glDeleteTextures(1, (const GLuint *)&tex->name));
+        tex->name = 0;
+        tex->original_name = 0;
+    }
+
+    // texture_manager_on_texture_loaded counts the full image again, and
+    // the bytes to load it was assumed to take were settled by the preview
+    account_texture_bytes(manager, tex, -tex->used_texture_bytes);
+    manager->approx_bytes_to_load += tex->assumed_texture_bytes;
+    tex->preview = false;
+}
+
+/**
+ * @name	upload_texture
+ * @brief	creates the gl texture for a decoded image, or marks a failed one
+ *			loaded, and tells javascript. called with the lock held, which
+ *			is released while the event is dispatched. a full image taking
+ *			the place of its preview is not announced again
+ * @param	manager - (texture_manager *) manager owning the texture
+ * @param	cur_tex - (texture_2d *) queued texture that is ready
+ * @retval	bool - true if gl reported an error
+ */
+static bool upload_texture(texture_manager *manager, texture_2d *cur_tex) {
+    bool glErrorFound = false;
+    GLuint texture = 0;
+    int atlas_x = 0, atlas_y = 0;
+    texture_atlas_page *page = NULL;
+    texture_2d *shared = NULL;
+    bool swap = cur_tex->preview && cur_tex->loaded && !cur_tex->failed;
+    if (swap) {
+        release_preview(manager, cur_tex);
+    }
+    if (!cur_tex->failed && !cur_tex->upload_name) {
+        shared = find_shareable(manager, cur_tex);
+    }
+    if (!cur_tex->failed && !cur_tex->upload_name && !shared) {
+        long long start = profiler_now();
+        page = atlas_pack(cur_tex, &atlas_x, &atlas_y);
+        if (page) {
+            load_stats_since(LOAD_STAGE_UPLOAD, start);
+        }
+    }
+    if (cur_tex->pixel_data) {
+        texture_2d_build_alpha_mask(cur_tex);
+    }
+
+    if (shared) {
+        share_texture(manager, cur_tex, shared);
+        texture = cur_tex->name;
+    } else if (page) {
+        // only count the part of the page the image took up
+        long used = (long)(cur_tex->originalWidth + ATLAS_PADDING) * (cur_tex->originalHeight + ATLAS_PADDING) * 4;
+        texture = page->name;
+        glErrorFound = texture_manager_on_texture_loaded(manager, cur_tex->url, texture, cur_tex->width, cur_tex->height,
+            cur_tex->originalWidth, cur_tex->originalHeight, cur_tex->num_channels, cur_tex->scale, cur_tex->is_text,
+            used, cur_tex->compression_type);
+        if (cur_tex->name == (int)texture) {
+            cur_tex->sampler = page->sampler;
+            cur_tex->atlas_page = page;
+            cur_tex->atlas_x = atlas_x;
+            cur_tex->atlas_y = atlas_y;
+            cur_tex->atlas_width = page->width;
+            cur_tex->atlas_height = page->height;
+        } else {
+            atlas_page_release(page);
+        }
+    } else if (!cur_tex->failed) {
+        texture_2d_sampler sampler = {0, 0, 0, 0};
+        if (cur_tex->upload_name) {
+            // already uploaded through a pixel buffer
+            texture = cur_tex->upload_name;
+            cur_tex->upload_name = 0;
+            sampler.min_filter = cur_tex->mip_levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR;
+            sampler.mag_filter = GL_LINEAR;
+            sampler.wrap_s = sampler.wrap_t = GL_CLAMP_TO_EDGE;
+        } else {
+            texture = create_gl_texture(cur_tex, &sampler, cur_tex->pixel_data);
+        }
+
+        glErrorFound = texture_manager_on_texture_loaded(manager, cur_tex->url, texture, cur_tex->width, cur_tex->height,
+            cur_tex->originalWidth, cur_tex->originalHeight, cur_tex->num_channels, cur_tex->scale, cur_tex->is_text,
+            cur_tex->used_texture_bytes, cur_tex->compression_type);
+        if (cur_tex->name == (int)texture) {
+            cur_tex->sampler = sampler;
+        }
+    } else {
+        cur_tex->loaded = true;
+    }
+
+    // the first to load an image is the one later urls share
+    if (!shared && !cur_tex->failed && !cur_tex->preview && cur_tex->content_key &&
+        !texture_table_find_content(&manager->contents, cur_tex->content_key)) {
+        texture_table_add_content(&manager->contents, cur_tex);
+    }
+
+    // a preview is the first thing drawn, so it ends the load
+    if (cur_tex->load_requested && !swap) {
+        long long ns = profiler_now() - cur_tex->load_requested;
+        load_stats_record(LOAD_STAGE_TOTAL, ns);
+        cur_tex->load_ms = ns / 1000000.0f;
+        if (cur_tex->failed) {
+            load_stats_add(LOAD_COUNT_FAILED, 1);
+        }
+        cur_tex->load_requested = 0;
+    }
+
+    // preloads are reported together by preload_pump, and with a listener
+    // the tick sends the whole batch at once
+    if (swap || cur_tex->preloaded || (m_load_listener && add_load_result(cur_tex, texture))) {
+        texture_2d_free_pixel_data(cur_tex);
+        return glErrorFound;
+    }
+
+    // generate event string
+    char *event_str;
+    int event_len;
+    char stack_str[512];
+    int url_len = (int)strlen(cur_tex->url);
+    if (url_len > 300) {
+        event_len = url_len + 212;
+        event_str = (char*)frame_arena_alloc(event_len);
+        if (!event_str) {
+            texture_2d_free_pixel_data(cur_tex);
+            return glErrorFound;
+        }
+    } else {
+        event_len = 512;
+        event_str = stack_str;
+    }
+
+    if (cur_tex->failed) {
+        event_len = snprintf(event_str, event_len, "{\"url\":\"%s\",\"name\":\"imageError\",\"priority\":0}", cur_tex->url);
+    } else {
+        // create json event string
+        event_len = snprintf(event_str, event_len, "{\"url\":\"%s\",\"height\":%d,\"originalHeight\":%d,\"originalWidth\":%d" \
+            ",\"glName\":%d,\"width\":%d,\"name\":\"imageLoaded\",\"priority\":0}", cur_tex->url, (int)cur_tex->height,
+            (int)cur_tex->originalHeight, (int)cur_tex->originalWidth, (int)texture, (int)cur_tex->width);
     }
 
-    //re-add the previously removed textures awaiting loading
-    cur_tex = tex_load_list;
-    while (cur_tex) {
-        HASH_ADD_KEYPTR(url_hash, manager->url_to_tex, cur_tex->url, strlen(cur_tex->url), cur_tex);
-        LIST_ITERATE(&tex_load_list, cur_tex);
-    }
+    event_str[event_len] = '\0';
 
+    // dispatch the event
     pthread_mutex_unlock(&mutex);
-}
+    core_dispatch_event(event_str);
 
-/**
- * @brief tries to resize texture in place without changing gl texture.  returns pointer to original texture if successful, or returns pointer to new texture if change in gl texture occurs
- */
-texture_2d *texture_manager_resize_texture(texture_manager *manager, texture_2d *tex, int width, int height) {
-    LOGFN("texture_manager_resize_texture");
-    if (texture_2d_can_resize(tex, width, height)) {
-        texture_2d_resize_unsafe(tex, width, height);
-        return tex;
-    } else {
-        texture_2d *new_tex = texture_2d_new_from_dimensions(width, height);
-        texture_manager_free_texture(manager, tex);
-        texture_manager_add_texture(manager, new_tex, true);
-        return new_tex;
-    }
-}
+    pthread_mutex_lock(&mutex);
 
-void texture_manager_save(texture_manager *manager) {
-    LOGFN("texture_manager_save");
-    texture_2d *tex = NULL;
-    texture_2d *tmp = NULL;
-    HASH_ITER(url_hash, manager->url_to_tex, tex, tmp) {
-        if (tex->is_canvas) {
-            texture_2d_save(tex);
-        }
-    }
+    texture_2d_free_pixel_data(cur_tex);
+
+    return glErrorFound;
 }
 
-void texture_manager_free_texture(texture_manager *manager, texture_2d *tex) {
-    LOGFN("texture_manager_free_texture");
+static bool async_upload_eligible(texture_manager *manager, texture_2d *tex) {
+    return tex->upload_state != UPLOAD_NONE ||
+        (m_async_upload && !tex->failed && !tex->compression_type && !atlas_can_pack(tex) &&
+         !find_shareable(manager, tex));
+}
 
-    if (tex) {
-        //need to subtract off the texture bytes being used as the texture is freed
-        manager->texture_bytes_used -= tex->used_texture_bytes;
-        HASH_DELETE(url_hash, manager->url_to_tex, tex);
-        manager->tex_count--;
+/**
+ * @name	async_upload_step
+ * @brief	moves a pixel buffer upload on by one step, starting it, handing
+ *			the buffer to the decode workers, uploading from it and finally
+ *			checking its fence. called with the lock held.
+ * @param	tex - (texture_2d *) decoded texture being uploaded
+ * @retval	bool - true once upload_texture can finish the texture
+ */
+static bool async_upload_step(texture_2d *tex) {
+#if defined(GL_ES_VERSION_3_0)
+    switch (tex->upload_state) {
+    case UPLOAD_NONE: {
+        if (m_mapped_uploads >= MAX_MAPPED_UPLOADS) {
+            return false;
+        }
 
-        if (!tex->loaded) {
-            manager->approx_bytes_to_load -= tex->assumed_texture_bytes;
+        size_t size = upload_size(tex);
+        GLuint buffer = 0;
+        GLTRACE(glGenBuffers(1, &buffer));
+        GLTRACE(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer));
+        GLTRACE(glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW));
+        void *mapping = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        GLTRACE(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+
+        if (!mapping) {
+            LOG("{tex} WARNING: Unable to map a pixel buffer, uploading textures directly");
+            GLTRACE(glDeleteBuffers(1, &buffer));
+            m_async_upload = false;
+            return false;
         }
 
-        TEXLOG("Texture freed: %s!  COUNT=%d, USED=%d", tex->url, (int)manager->tex_count, (int)manager->texture_bytes_used);
-        texture_2d_destroy(tex);
+        tex->upload_buffer = buffer;
+        tex->upload_mapping = mapping;
+        tex->upload_state = UPLOAD_MAPPED;
+        m_mapped_uploads++;
+        pthread_cond_broadcast(&cond_var);
+        return false;
     }
-}
-
-void texture_manager_background_texture_loader(void *dummy) {
-    pthread_mutex_lock(&mutex);
 
-    while (m_running) {
-        texture_2d *cur_tex = tex_load_list;
+    case UPLOAD_FILLED: {
+        texture_2d_sampler sampler = {0, 0, 0, 0};
+        GLTRACE(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, tex->upload_buffer));
+        GLboolean intact = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        m_mapped_uploads--;
+        tex->upload_mapping = NULL;
 
-        while (cur_tex) {
-            texture_2d *old_cur = NULL;
-            const char *url = cur_tex->url;
-
-            if (url != NULL) {
-                if (url[0] == '_' && url[1] == '_'
-                    && url[2] == 'c' && url[3] == 'a'
-                    && url[4] == 'n' && url[5] == 'v'
-                    && url[6] == 'a' && url[7] == 's'
-                    && url[8] == '_' && url[9] == '_')
-                {
-                    // reload the canvas from JavaScript
-                    pthread_mutex_unlock(&mutex);
-                    notify_canvas_death(url);
-                    pthread_mutex_lock(&mutex);
-                    old_cur = cur_tex;
-                } else if (cur_tex->pixel_data == NULL && !cur_tex->failed) {
-                    LOG("Passing to load_image_with_c: %s", url);
-                    if (!resource_loader_load_image_with_c(cur_tex)) {
-                        old_cur = cur_tex;
-                    }
-                }
-            }
+        if (intact) {
+            tex->upload_name = create_gl_texture(tex, &sampler, (const void *) 0);
+        }
 
-            LIST_ITERATE(&tex_load_list, cur_tex);
+        // the buffer lives on until the upload from it is done
+        GLTRACE(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+        GLTRACE(glDeleteBuffers(1, &tex->upload_buffer));
+        tex->upload_buffer = 0;
 
-            // if not loading from C remove from list
-            if (old_cur) {
-                LIST_REMOVE(&tex_load_list, old_cur);
-                old_cur = NULL;
-            }
+        if (!intact) {
+            // the buffer contents were lost, report the load as failed
+            tex->upload_state = UPLOAD_NONE;
+            tex->failed = true;
+            return true;
         }
 
-        pthread_cond_wait(&cond_var, &mutex);
+        tex->upload_fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        tex->upload_state = UPLOAD_PENDING;
+        return false;
     }
 
-    pthread_mutex_unlock(&mutex);
-}
-
-CEXPORT void image_cache_load_callback(struct image_data *data) {
-    int num_channels, width, height, originalWidth, originalHeight, scale, compression_type;
-    long size = 0;
-    unsigned char *bytes  = texture_2d_load_texture_raw(data->url, data->bytes, data->size, &num_channels, &width, &height, &originalWidth, &originalHeight, &scale, &size, &compression_type);
-    bool failed = (bytes == NULL);
-
-    TEXLOG("image_cache_background_loader loaded %s, status: %i", data->url, failed);
+    case UPLOAD_PENDING: {
+        GLenum status = glClientWaitSync((GLsync) tex->upload_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            return false;
+        }
 
-    texture_manager *manager = texture_manager_get();
+        glDeleteSync((GLsync) tex->upload_fence);
+        tex->upload_fence = NULL;
+        tex->upload_state = UPLOAD_NONE;
+        return true;
+    }
 
-    pthread_mutex_lock(&mutex);
-    texture_2d *tex = texture_manager_get_texture(manager, data->url);
-    if (tex != NULL) {
-        tex->num_channels = num_channels;
-        tex->width = width;
-        tex->height = height;
-        tex->originalWidth = originalWidth;
-        tex->originalHeight = originalHeight;
-        tex->scale = scale;
-        tex->failed = failed;
-        tex->pixel_data = bytes;
-        tex->compression_type = compression_type;
-        tex->used_texture_bytes = size;
-        LIST_ADD(&tex_load_list, tex);
+    default:
+        // a decode worker is filling the buffer
+        return false;
     }
+#else
+    return true;
+#endif
+}
 
-    pthread_mutex_unlock(&mutex);
+/**
+ * @name	texture_manager_detect_async_upload
+ * @brief	turns pixel buffer uploads on when built with the GLES3 headers
+ *			and running on a GLES3 context. must be called on the gl thread.
+ * @retval	NONE
+ */
+void texture_manager_detect_async_upload() {
+#if defined(GL_ES_VERSION_3_0)
+    const char *version = (const char *) glGetString(GL_VERSION);
+    m_async_upload = version && strstr(version, "OpenGL ES 3");
+#else
+    m_async_upload = false;
+#endif
+    LOG("{tex} Pixel buffer texture uploads %s", m_async_upload ? "enabled" : "disabled");
 }
 
-void texture_manager_set_use_halfsized_textures(bool use_halfsized) {
-    if (use_halfsized_textures != use_halfsized) {
-        LOG("{tex} use_halfsized_textures=%d", use_halfsized);
-        use_halfsized_textures = use_halfsized;
-        texture_manager_clear_textures(m_instance, true);
-    }
+static double upload_clock_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
 }
 
-texture_manager *texture_manager_acquire() {
-    texture_manager *manager = texture_manager_get();
-    pthread_mutex_lock(&mutex);
-    return manager;
+static bool upload_budget_spent(double start, long bytes) {
+    return (m_upload_budget_bytes > 0 && bytes >= m_upload_budget_bytes) ||
+        (m_upload_budget_ms > 0 && upload_clock_ms() - start >= m_upload_budget_ms);
 }
 
-void texture_manager_release() {
+/**
+ * @name	texture_manager_set_upload_budget
+ * @brief	limits how much texture data each tick uploads to gl, so a burst
+ *			of loads is spread over several frames. at least one texture is
+ *			uploaded per tick whatever the budget.
+ * @param	ms - (double) milliseconds per tick to spend uploading, 0 for no limit
+ * @param	bytes - (long) bytes per tick to upload, 0 for no limit
+ * @retval	NONE
+ */
+void texture_manager_set_upload_budget(double ms, long bytes) {
+    pthread_mutex_lock(&mutex);
+    m_upload_budget_ms = ms > 0 ? ms : 0;
+    m_upload_budget_bytes = bytes > 0 ? bytes : 0;
     pthread_mutex_unlock(&mutex);
 }
 
-texture_manager *texture_manager_get() {
-    LOGFN("texture_manager_get");
-
-    // If it looks like the instance hasn't been created yet,
-    if (!m_instance_ready) {
-        // Lock mutex while racing to create the instance
-        pthread_mutex_lock(&mutex);
+/*
+ * Preloading
+ *
+ * texture_manager_preload queues urls to load ahead of being drawn.  Only a
+ * bounded window of them is handed to the loaders at once, highest priority
+ * first, so a large manifest does not flood the decode workers ahead of
+ * textures that are actually on screen.  Instead of an imageLoaded event per
+ * texture, one preloadProgress event per tick reports how many of the
+ * queued urls have finished.  All of this runs on the render thread.
+ */
 
-        // If we won the race to create the instance,
-        if (!m_instance_ready) {
-            m_instance = (texture_manager *)malloc(sizeof(texture_manager));
-            m_instance->url_to_tex = NULL;
-            m_instance->tex_count = 0;
-            m_instance->texture_bytes_used = 0;
-            m_instance->textures_to_load = 0;
-            m_instance->approx_bytes_to_load = 0;
-            // default to fullsized textures
-            m_instance->max_texture_bytes = MAX_BYTES_FOR_TEXTURES;
-            // Start the background texture loader thread
-            m_running = true;
+#define DEFAULT_PRELOAD_WINDOW 8
+#define MAX_PRELOAD_WINDOW 64
+
+typedef struct preload_entry_t {
+    char *url;
+    int priority;
+    int order; // keeps urls of equal priority in the order given
+} preload_entry;
+
+static preload_entry *m_preload_queue = NULL;
+static int m_preload_count = 0;
+static int m_preload_capacity = 0;
+static int m_preload_order = 0;
+
+static char *m_preload_in_flight[MAX_PRELOAD_WINDOW];
+static int m_preload_in_flight_count = 0;
+static int m_preload_window = DEFAULT_PRELOAD_WINDOW;
+
+static int m_preload_total = 0;
+static int m_preload_loaded = 0;
+static int m_preload_failed = 0;
+
+static int preload_entry_compare(const void *a, const void *b) {
+    const preload_entry *pa = (const preload_entry *) a;
+    const preload_entry *pb = (const preload_entry *) b;
+    if (pa->priority != pb->priority) {
+        return pb->priority - pa->priority;
+    }
+    return pa->order - pb->order;
+}
 
-            // Launch the loader thread
-            m_load_thread = threads_create_thread(texture_manager_background_texture_loader, m_instance);
+/**
+ * @name	texture_manager_preload
+ * @brief	queues images to be loaded before they are first drawn
+ * @param	urls - (const char **) urls of the images
+ * @param	priorities - (const int *) priority of each url, higher loads
+ *			first. may be NULL to load in the order given
+ * @param	count - (int) number of urls
+ * @retval	NONE
+ */
+void texture_manager_preload(const char **urls, const int *priorities, int count) {
+    int i;
+    if (count <= 0) {
+        return;
+    }
 
-            // Mark the instance as being ready
-            m_instance_ready = true;
+    if (m_preload_count + count > m_preload_capacity) {
+        int capacity = (m_preload_count + count) * 2;
+        preload_entry *queue = (preload_entry *) realloc(m_preload_queue, capacity * sizeof(preload_entry));
+        if (!queue) {
+            LOG("{tex} WARNING: Unable to queue %d preloads", count);
+            return;
         }
+        m_preload_queue = queue;
+        m_preload_capacity = capacity;
+    }
 
-        pthread_mutex_unlock(&mutex);
+    for (i = 0; i < count; i++) {
+        preload_entry *entry = &m_preload_queue[m_preload_count++];
+        entry->url = strdup(urls[i]);
+        entry->priority = priorities ? priorities[i] : 0;
+        entry->order = m_preload_order++;
     }
+    m_preload_total += count;
 
-    return m_instance;
+    qsort(m_preload_queue, m_preload_count, sizeof(preload_entry), preload_entry_compare);
 }
 
-// DANGER: This function is not thread-safe.  Make sure nothing else is running
-// texture_manager_get() et al while destroying an instance.
-void texture_manager_destroy(texture_manager *manager) {
-    LOGFN("texture_manager_destroy");
-    pthread_mutex_lock(&mutex);
-    m_running = false;              // Flag texture loading thread to stop
-    pthread_cond_signal(&cond_var); // Signal thread to wake up and terminate
-    pthread_mutex_unlock(&mutex);
-
-    LOG("{tex} Goodnight");
-
-    threads_join_thread(&m_load_thread);
-
-    texture_2d *tex = NULL;
-    texture_2d *tmp = NULL;
-    HASH_ITER(url_hash, manager->url_to_tex, tex, tmp) {
-        texture_2d_destroy(tex);
-    }
-    HASH_CLEAR(url_hash, manager->url_to_tex);
-    free(manager);
-    // Clear the texture load list
-    tex_load_list = NULL;
-
-    // If manager is the singleton instance, clear it also
-    if (manager == m_instance) {
-        m_instance = NULL;
-        m_instance_ready = false;
+/**
+ * @name	texture_manager_set_preload_window
+ * @brief	sets how many preloads may be loading at once
+ * @param	count - (int) preloads in flight, clamped to 1..MAX_PRELOAD_WINDOW
+ * @retval	NONE
+ */
+void texture_manager_set_preload_window(int count) {
+    if (count < 1) {
+        count = 1;
+    } else if (count > MAX_PRELOAD_WINDOW) {
+        count = MAX_PRELOAD_WINDOW;
     }
-
-    // Clear memory usage profile
-    m_memory_warning = false;
-    m_frame_epoch = 1;
-    m_frame_used_bytes = 0;
+    m_preload_window = count;
 }
 
-void texture_manager_touch_texture(texture_manager *manager, const char *url) {
-    LOGFN("texture_manager_touch_texture");
-    size_t len = strlen(url);
-    texture_2d *tex = NULL;
-    HASH_FIND(url_hash, manager->url_to_tex, url, len, tex);
+/**
+ * @name	preload_pump
+ * @brief	retires finished preloads, starts queued ones while the window
+ *			has room and reports progress. called by the tick without the
+ *			lock held.
+ * @param	manager - (texture_manager *) manager loading the textures
+ * @retval	NONE
+ */
+static void preload_pump(texture_manager *manager) {
+    if (!m_preload_total) {
+        return;
+    }
+    int finished = m_preload_loaded + m_preload_failed;
+    int i;
 
-    if (tex) {
-        time(&tex->last_accessed);
+    // retire the preloads that finished since last tick
+    pthread_mutex_lock(&mutex);
+    for (i = 0; i < m_preload_in_flight_count; i++) {
+        texture_2d *tex = find_texture(manager, m_preload_in_flight[i]);
+        if (tex && !tex->loaded) {
+            continue;
+        }
 
-        // If we haven't accumulated this texture yet,
-        if (tex->frame_epoch != m_frame_epoch) {
-            tex->frame_epoch = m_frame_epoch;
-            m_frame_used_bytes += tex->used_texture_bytes;
+        // a texture evicted before we saw it load counts as loaded
+        if (tex && tex->failed) {
+            m_preload_failed++;
+        } else {
+            m_preload_loaded++;
         }
-    } else {
-        // if it was a canvas
-        if (url[0] == '_' && url[1] == '_'
-            && url[2] == 'c' && url[3] == 'a'
-            && url[4] == 'n' && url[5] == 'v'
-            && url[6] == 'a' && url[7] == 's'
-            && url[8] == '_' && url[9] == '_')
-        {
-            notify_canvas_death(url);
+        free(m_preload_in_flight[i]);
+        m_preload_in_flight[i--] = m_preload_in_flight[--m_preload_in_flight_count];
+    }
+    pthread_mutex_unlock(&mutex);
+
+    // start the next ones, highest priority first
+    int started = 0;
+    while (m_preload_in_flight_count < m_preload_window && started < m_preload_count) {
+        char *url = m_preload_queue[started++].url;
+        bool existed = texture_manager_get_texture(manager, url) != NULL;
+        texture_2d *tex = texture_manager_load_texture(manager, url);
+        if (!existed && tex) {
+            tex->preloaded = true;
         }
+        m_preload_in_flight[m_preload_in_flight_count++] = url;
+    }
+    if (started) {
+        m_preload_count -= started;
+        memmove(m_preload_queue, m_preload_queue + started, m_preload_count * sizeof(preload_entry));
     }
-}
 
-static long get_epoch_used_max() {
-    long highest = MIN_BYTES_FOR_TEXTURES;
-    int i;
+    if (finished != m_preload_loaded + m_preload_failed) {
+        char event_str[160];
+        int event_len = snprintf(event_str, sizeof(event_str),
+            "{\"loaded\":%d,\"failed\":%d,\"total\":%d,\"name\":\"preloadProgress\",\"priority\":0}",
+            m_preload_loaded, m_preload_failed, m_preload_total);
+        event_str[event_len] = '\0';
+        core_dispatch_event(event_str);
 
-    for (i = 0; i < EPOCH_USED_BINS; i++) {
-        if (highest < m_epoch_used[i]) {
-            highest = m_epoch_used[i];
+        // everything queued so far is done, start counting afresh
+        if (m_preload_loaded + m_preload_failed == m_preload_total) {
+            m_preload_total = m_preload_loaded = m_preload_failed = 0;
         }
     }
-
-    return highest;
 }
 
 void texture_manager_tick(texture_manager *manager) {
     LOGFN("texture_manager_tick");
+    PROFILE_ZONE("texture_manager_tick");
+    preload_pump(manager);
     pthread_mutex_lock(&mutex);
 
-    if (should_use_halfsized) {
-        should_use_halfsized = false;
-        set_halfsized_textures(true);
+    int category;
+    for (category = 0; category < TEXTURE_CATEGORY_COUNT; category++) {
+        if (m_category_should_halfsize[category]) {
+            m_category_should_halfsize[category] = false;
+            set_category_halfsized(manager, category);
+        }
     }
 
     // move our estimated max memory limit up or down if necessary
@@ -741,6 +3094,7 @@ void texture_manager_tick(texture_manager *manager) {
     bool overLimit = manager->texture_bytes_used > manager->max_texture_bytes - manager->approx_bytes_to_load;
     if (m_memory_warning) {
         m_memory_warning = false;
+        drain_render_pool();
 
         if (highest > manager->max_texture_bytes) {
             highest = manager->max_texture_bytes;
@@ -767,6 +3121,7 @@ void texture_manager_tick(texture_manager *manager) {
     texture_manager_clear_textures(manager, false);
 
     // invalidate earlier frame epochs tagged on textures
+    m_working_set[(unsigned)m_frame_epoch & EPOCH_USED_MASK] = m_frame_used_bytes;
     m_frame_epoch++;
     m_frame_used_bytes = 0;
 
@@ -774,101 +3129,59 @@ void texture_manager_tick(texture_manager *manager) {
     const int epoch = (unsigned)m_frame_epoch & EPOCH_USED_MASK;
     m_epoch_used[epoch] = manager->texture_bytes_used;
 
-    // load new textures
-    texture_2d *cur_tex = tex_load_list;
+    collect_decoded_images(manager);
+
+    // upload decoded textures, the ones drawn last frame first, until this
+    // tick's budget is spent. whatever is left waits for the next tick.
+    double upload_start = upload_clock_ms();
+    long upload_bytes = 0;
+    bool uploaded = false;
+    bool budget_left = true;
     bool glErrorFound = false;
-    while (cur_tex && !glErrorFound) {
-        // skip this if texture is not ready to load
-        if (!cur_tex->failed && (cur_tex->pixel_data == NULL || cur_tex->url == NULL)) {
-            LIST_ITERATE(&tex_load_list, cur_tex);
-            continue;
-        }
+    int pass;
+    for (pass = 0; pass < 2 && budget_left && !glErrorFound; pass++) {
+        texture_2d *cur_tex = tex_load_list;
+        while (cur_tex && !glErrorFound) {
+            // skip this if texture is not ready to load, or not in this pass
+            bool wanted = cur_tex->frame_epoch >= m_frame_epoch - 1;
+            if (cur_tex->decoding || (!cur_tex->failed && cur_tex->upload_state == UPLOAD_NONE &&
+                                      (cur_tex->pixel_data == NULL || cur_tex->url == NULL)) ||
+                wanted != (pass == 0)) {
+                LIST_ITERATE(&tex_load_list, cur_tex);
+                continue;
+            }
 
-        GLuint texture = 0;
-        if (!cur_tex->failed) {
-            GLTRACE(glGenTextures(1, &texture));
-            GLTRACE(glBindTexture(GL_TEXTURE_2D, texture));
-            GLTRACE(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
-            GLTRACE(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
-            GLTRACE(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT));
-            GLTRACE(glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT));
-
-            // create the texture
-            int channels = cur_tex->num_channels;
-            int width = cur_tex->width >> (cur_tex->scale - 1);
-            int height = cur_tex->height >> (cur_tex->scale - 1);
-            if (cur_tex->compression_type) {
-                glCompressedTexImage2D(GL_TEXTURE_2D, 0, cur_tex->compression_type, width, height, 0, cur_tex->used_texture_bytes, cur_tex->pixel_data);
-            } else {
-                // select the right internal and input format based on the number of channels
-                GLint format;
-                switch (channels) {
-                case 1:
-                    format = GL_LUMINANCE;
-                    break;
-                case 3:
-                    format = GL_RGB;
-                    break;
-                default:
-                case 4:
-                    format = GL_RGBA;
+            // only starting a gl upload is charged, failed textures and the
+            // other pixel buffer steps cost nothing
+            bool async = async_upload_eligible(manager, cur_tex);
+            if (!cur_tex->failed && (!async || cur_tex->upload_state == UPLOAD_FILLED)) {
+                if (uploaded && upload_budget_spent(upload_start, upload_bytes)) {
+                    budget_left = false;
                     break;
                 }
-                GLTRACE(glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, cur_tex->pixel_data));
+                uploaded = true;
+                upload_bytes += cur_tex->used_texture_bytes;
             }
 
-            glErrorFound = texture_manager_on_texture_loaded(manager, cur_tex->url, texture, cur_tex->width, cur_tex->height,
-                cur_tex->originalWidth, cur_tex->originalHeight, cur_tex->num_channels, cur_tex->scale, cur_tex->is_text,
-                cur_tex->used_texture_bytes, cur_tex->compression_type);
-        } else {
-            cur_tex->loaded = true;
-        }
-
-        // generate event string
-        char *event_str;
-        int event_len;
-        char *dynamic_str = 0;
-        char stack_str[512];
-        int url_len = (int)strlen(cur_tex->url);
-        if (url_len > 300) {
-            event_len = url_len + 212;
-            dynamic_str = (char*)malloc(event_len);
-            event_str = dynamic_str;
-        } else {
-            event_len = 512;
-            event_str = stack_str;
-        }
-
-        if (cur_tex->failed) {
-            event_len = snprintf(event_str, event_len, "{\"url\":\"%s\",\"name\":\"imageError\",\"priority\":0}", cur_tex->url);
-        } else {
-            // create json event string
-            event_len = snprintf(event_str, event_len, "{\"url\":\"%s\",\"height\":%d,\"originalHeight\":%d,\"originalWidth\":%d" \
-                ",\"glName\":%d,\"width\":%d,\"name\":\"imageLoaded\",\"priority\":0}", cur_tex->url, (int)cur_tex->height,
-                (int)cur_tex->originalHeight, (int)cur_tex->originalWidth, (int)texture, (int)cur_tex->width);
-        }
-
-        event_str[event_len] = '\0';
+            if (async && !async_upload_step(cur_tex)) {
+                LIST_ITERATE(&tex_load_list, cur_tex);
+                continue;
+            }
 
-        // dispatch the event
-        pthread_mutex_unlock(&mutex);
-        core_dispatch_event(event_str);
+            glErrorFound = upload_texture(manager, cur_tex);
 
-        if (dynamic_str) {
-            free(dynamic_str);
+            texture_2d *old_cur = cur_tex;
+            LIST_ITERATE(&tex_load_list, cur_tex);
+            LIST_REMOVE(&tex_load_list, old_cur);
         }
-
-        pthread_mutex_lock(&mutex);
-
-        free(cur_tex->pixel_data);
-        cur_tex->pixel_data = NULL;
-
-        texture_2d *old_cur = cur_tex;
-        LIST_ITERATE(&tex_load_list, cur_tex);
-        LIST_REMOVE(&tex_load_list, old_cur);
     }
 
+    texture_load_listener listener = m_load_listener;
     pthread_mutex_unlock(&mutex);
+
+    if (listener) {
+        send_load_results(listener);
+    }
 }
 
 /*
@@ -917,3 +3230,82 @@ void texture_manager_set_max_memory(texture_manager *manager, long bytes) {
         manager->max_texture_bytes = bytes;
     }
 }
+
+/**
+ * @name	texture_manager_canvas_backup_bytes
+ * @brief	gets how much memory the copies kept of canvases to restore them
+ *			after a context loss take
+ * @param	manager - (texture_manager *) manager holding the canvases
+ * @retval	long - bytes
+ */
+long texture_manager_canvas_backup_bytes(texture_manager *manager) {
+    long bytes = 0;
+    texture_2d *tex = NULL;
+    unsigned int i = 0;
+    pthread_mutex_lock(&mutex);
+    while ((tex = texture_table_next(&manager->textures, &i))) {
+        if (tex->is_canvas && tex->saved_data) {
+            bytes += tex->saved_size;
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+    return bytes;
+}
+
+/**
+ * @name	texture_manager_drop_canvas_backups
+ * @brief	frees the copies of canvases that are still in gl, they are read
+ *			back again by the next texture_manager_save
+ * @param	manager - (texture_manager *) manager holding the canvases
+ * @retval	long - bytes freed
+ */
+long texture_manager_drop_canvas_backups(texture_manager *manager) {
+    long bytes = 0;
+    texture_2d *tex = NULL;
+    unsigned int i = 0;
+    pthread_mutex_lock(&mutex);
+    while ((tex = texture_table_next(&manager->textures, &i))) {
+        if (tex->is_canvas && tex->loaded && tex->saved_data) {
+            bytes += tex->saved_size;
+            TAG_FREE(tex->saved_data);
+            tex->saved_data = NULL;
+            tex->saved_size = 0;
+            tex->saved_encoded = false;
+        }
+    }
+    pthread_mutex_unlock(&mutex);
+    return bytes;
+}
+
+/**
+ * @name	texture_manager_reclaim
+ * @brief	drops the pooled render textures and lowers the texture limit so
+ *			the next tick evicts least recently used textures
+ * @param	manager - (texture_manager *) manager to shrink
+ * @param	bytes - (long) bytes wanted
+ * @retval	long - bytes freed now or by the next tick
+ */
+long texture_manager_reclaim(texture_manager *manager, long bytes) {
+    LOGFN("texture_manager_reclaim");
+    pthread_mutex_lock(&mutex);
+    long freed = (long) m_render_pool_bytes;
+    drain_render_pool();
+
+    long used = (long) manager->texture_bytes_used;
+    long wanted = bytes - freed;
+    if (wanted > used) {
+        wanted = used;
+    }
+    if (wanted > 0) {
+        long new_max_bytes = used - wanted;
+        if ((long) manager->max_texture_bytes > new_max_bytes) {
+            TEXLOG("WARNING: Reclaiming! Texture limit was %zu, now %li", manager->max_texture_bytes, new_max_bytes);
+            manager->max_texture_bytes = new_max_bytes;
+            // keep the limit from growing straight back
+            memset(m_epoch_used, 0, sizeof(m_epoch_used));
+        }
+        freed += wanted;
+    }
+    pthread_mutex_unlock(&mutex);
+    return freed;
+}
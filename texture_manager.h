@@ -17,6 +17,7 @@
 #define TEXTURE_MANAGER_H
 
 #include "core/texture_2d.h"
+#include "core/texture_table.h"
 #include "core/image-cache/include/image_cache.h"
 
 #include <pthread.h>
@@ -24,14 +25,34 @@
 
 
 typedef struct texture_manager_t {
-	texture_2d *url_to_tex;
+	texture_table textures; // by url
+	texture_table contents; // loaded textures by content_key, one per image
+	// every texture by last use, eviction takes from the tail
+	texture_2d *lru_head;
+	texture_2d *lru_tail;
 	int textures_to_load;
 	size_t texture_bytes_used;
 	size_t approx_bytes_to_load;
 	size_t max_texture_bytes;
+	// per TEXTURE_CATEGORY_*, a zero budget means only max_texture_bytes applies
+	size_t category_bytes_used[TEXTURE_CATEGORY_COUNT];
+	size_t category_max_bytes[TEXTURE_CATEGORY_COUNT];
 	int tex_count;
 } texture_manager;
 
+// an image that finished loading, see texture_manager_set_load_listener
+typedef struct texture_load_result_t {
+	const char *url; // only valid during the listener call
+	unsigned int id; // texture_2d id
+	int gl_name;
+	int width;
+	int height;
+	int original_width;
+	int original_height;
+	bool failed;
+} texture_load_result;
+
+typedef void (*texture_load_listener)(const texture_load_result *results, int count);
 
 #ifdef __cplusplus
 extern "C" {
@@ -39,7 +60,11 @@ extern "C" {
 
 void texture_manager_tick(texture_manager *manager);
 texture_2d *texture_manager_new_texture_from_data(texture_manager *manager, int width, int height, const void *data);
+// uploads only the rects of data that changed into a texture made from data
+bool texture_manager_update_texture_regions(texture_manager *manager, texture_2d *tex, const void *pixels, const rect_2d *rects, int count, bool double_buffered);
 texture_2d *texture_manager_new_texture(texture_manager *manager, int width, int height);
+texture_2d *texture_manager_acquire_render_texture(texture_manager *manager, int width, int height);
+void texture_manager_release_render_texture(texture_manager *manager, texture_2d *tex);
 texture_2d *texture_manager_get_texture(texture_manager *manager, const char *url);
 texture_2d *texture_manager_add_texture(texture_manager *manager, texture_2d *tex, bool is_canvas);
 texture_2d *texture_manager_add_texture_from_image(texture_manager *manager, const char *url, int name, int width, int height, int original_width, int original_height);
@@ -50,12 +75,18 @@ void texture_manager_reload_canvases(texture_manager *manager);
 void texture_manager_reload(texture_manager *manager);
 texture_2d *texture_manager_resize_texture(texture_manager *manager, texture_2d *tex, int width, int height);
 void texture_manager_save(texture_manager *manager);
+bool texture_manager_set_canvas_regenerable(texture_manager *manager, const char *url, bool regenerable);
 texture_manager *texture_manager_get();
 void texture_manager_destroy(texture_manager *manager);
 void texture_manager_clear_textures(texture_manager *manager, bool clear_all);
 void texture_manager_free_texture(texture_manager *manager, texture_2d *tex);
 void texture_manager_touch_texture(texture_manager *manager, const char *url);
+int texture_manager_intern_url(const char *url);
+const char *texture_manager_get_handle_url(int handle);
+texture_2d *texture_manager_get_texture_by_handle(texture_manager *manager, int handle);
+texture_2d *texture_manager_load_texture_by_handle(texture_manager *manager, int handle);
 void texture_manager_set_use_halfsized_textures(bool use_halfsized);
+void texture_manager_set_use_16bit_textures(int mode);
 texture_2d *texture_manager_update_texture(texture_manager *manager, const char *url, int name,
 											int width, int height, int original_width, int original_height,
 											int num_channels, int scale, bool is_text, long used);
@@ -77,6 +108,27 @@ void texture_manager_memory_warning();
 void texture_manager_memory_critical();
 void texture_manager_reset_memory_critical();
 void texture_manager_set_max_memory(texture_manager *manager, long bytes); // Will only ratchet down
+long texture_manager_canvas_backup_bytes(texture_manager *manager);
+long texture_manager_drop_canvas_backups(texture_manager *manager);
+long texture_manager_reclaim(texture_manager *manager, long bytes);
+void texture_manager_set_atlas(int page_size, int max_image_size);
+bool texture_manager_add_mipmap_pattern(const char *pattern);
+void texture_manager_clear_mipmap_patterns();
+bool texture_manager_add_texture_rule(const char *pattern, int category, int priority);
+void texture_manager_clear_texture_rules();
+void texture_manager_set_category_budget(texture_manager *manager, int category, long bytes);
+bool texture_manager_set_texture_priority(texture_manager *manager, const char *url, int priority);
+void texture_manager_set_decode_workers(int count);
+void texture_manager_set_progressive_loading(bool enabled);
+void texture_manager_set_upload_budget(double ms, long bytes);
+void texture_manager_detect_async_upload();
+void texture_manager_preload(const char **urls, const int *priorities, int count);
+void texture_manager_set_preload_window(int count);
+void texture_manager_set_load_listener(texture_load_listener listener);
+// bytes of the textures drawn in the last frame, and the most in any recent one
+void texture_manager_working_set(long *last_frame, long *peak);
+// every texture, totals by url prefix and the working set as JSON. Caller frees
+char *texture_manager_dump(texture_manager *manager);
 void image_cache_load_callback(struct image_data *data);
 texture_manager *texture_manager_acquire();
 void texture_manager_release();
@@ -0,0 +1,252 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 texture_table.c
+ * @brief	open addressed table of textures by url
+ */
+#include "core/texture_table.h"
+#include "core/texture_2d.h"
+#include "core/image-cache/include/murmur.h"
+#include "core/log.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define TEXTURE_TABLE_MIN_CAPACITY 64
+#define TEXTURE_TABLE_SEED 0x7e7
+
+/**
+ * @name	texture_table_key
+ * @brief	hashes a url to the key the table files it under
+ * @param	url - (const char *) url to hash
+ * @retval	uint64_t - the key, never zero
+ */
+uint64_t texture_table_key(const char *url) {
+    uint64_t hash[2];
+    MurmurHash3_x86_128(url, (int) strlen(url), TEXTURE_TABLE_SEED, hash);
+    return hash[0] ? hash[0] : 1;
+}
+
+/**
+ * @name	texture_table_init
+ * @brief	sets up an empty table, slots are allocated by the first add
+ * @param	table - (texture_table *) table to set up
+ * @retval	NONE
+ */
+void texture_table_init(texture_table *table) {
+    table->slots = NULL;
+    table->capacity = 0;
+    table->count = 0;
+    table->used = 0;
+}
+
+// the first empty slot for key, the table must have one
+static texture_table_slot *empty_slot(texture_table_slot *slots, unsigned int capacity, uint64_t key) {
+    unsigned int mask = capacity - 1;
+    unsigned int i = (unsigned int) key & mask;
+    while (slots[i].key) {
+        i = (i + 1) & mask;
+    }
+    return &slots[i];
+}
+
+// rebuilds the table without its removed entries, growing it if needed
+static bool rehash(texture_table *table, unsigned int capacity) {
+    texture_table_slot *slots = (texture_table_slot *) calloc(capacity, sizeof(texture_table_slot));
+    if (!slots) {
+        LOG("{tex} WARNING: Unable to grow the texture table to %u slots", capacity);
+        return false;
+    }
+
+    unsigned int i;
+    for (i = 0; i < table->capacity; i++) {
+        if (table->slots[i].tex) {
+            *empty_slot(slots, capacity, table->slots[i].key) = table->slots[i];
+        }
+    }
+
+    free(table->slots);
+    table->slots = slots;
+    table->capacity = capacity;
+    table->used = table->count;
+    return true;
+}
+
+/**
+ * @name	texture_table_find
+ * @brief	finds the texture for a url
+ * @param	table - (texture_table *) table to look in
+ * @param	key - (uint64_t) texture_table_key of the url
+ * @param	url - (const char *) url of the texture
+ * @retval	texture_2d* - the texture, NULL if it is not in the table
+ */
+texture_2d *texture_table_find(texture_table *table, uint64_t key, const char *url) {
+    if (!table->capacity) {
+        return NULL;
+    }
+
+    unsigned int mask = table->capacity - 1;
+    unsigned int i = (unsigned int) key & mask;
+    while (table->slots[i].key) {
+        texture_2d *tex = table->slots[i].tex;
+        if (tex && table->slots[i].key == key && !strcmp(tex->url, url)) {
+            return tex;
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+// files tex under key, growing the table first if it is getting full
+static bool insert(texture_table *table, uint64_t key, texture_2d *tex) {
+    // keep at least a quarter of the slots empty so probes stay short
+    if ((table->used + 1) * 4 > table->capacity * 3) {
+        unsigned int capacity = TEXTURE_TABLE_MIN_CAPACITY;
+        while (capacity < (table->count + 1) * 2) {
+            capacity *= 2;
+        }
+        if (!rehash(table, capacity)) {
+            return false;
+        }
+    }
+
+    texture_table_slot *slot = empty_slot(table->slots, table->capacity, key);
+    slot->key = key;
+    slot->tex = tex;
+    table->count++;
+    table->used++;
+    return true;
+}
+
+// leaves a removed entry where tex was filed under key
+static void remove_under(texture_table *table, uint64_t key, texture_2d *tex) {
+    if (!table->capacity) {
+        return;
+    }
+
+    unsigned int mask = table->capacity - 1;
+    unsigned int i = (unsigned int) key & mask;
+    while (table->slots[i].key) {
+        if (table->slots[i].tex == tex) {
+            table->slots[i].tex = NULL;
+            table->count--;
+            return;
+        }
+        i = (i + 1) & mask;
+    }
+}
+
+/**
+ * @name	texture_table_add
+ * @brief	files a texture under its url, which must not be in the table
+ * @param	table - (texture_table *) table to add to
+ * @param	tex - (texture_2d *) texture with a url
+ * @retval	bool - (true | false) depending on whether the texture was added
+ */
+bool texture_table_add(texture_table *table, texture_2d *tex) {
+    tex->url_key = texture_table_key(tex->url);
+    return insert(table, tex->url_key, tex);
+}
+
+/**
+ * @name	texture_table_remove
+ * @brief	takes a texture out of the table, leaving a removed entry so
+ *			probes for other urls still pass its slot
+ * @param	table - (texture_table *) table to remove from
+ * @param	tex - (texture_2d *) texture to remove
+ * @retval	NONE
+ */
+void texture_table_remove(texture_table *table, texture_2d *tex) {
+    if (tex->url) {
+        remove_under(table, tex->url_key, tex);
+    }
+}
+
+/**
+ * @name	texture_table_find_content
+ * @brief	finds a texture filed under a content key
+ * @param	table - (texture_table *) table of textures by content_key
+ * @param	key - (uint64_t) content key to look for
+ * @retval	texture_2d* - the texture, NULL if none has the key
+ */
+texture_2d *texture_table_find_content(texture_table *table, uint64_t key) {
+    if (!table->capacity || !key) {
+        return NULL;
+    }
+
+    unsigned int mask = table->capacity - 1;
+    unsigned int i = (unsigned int) key & mask;
+    while (table->slots[i].key) {
+        if (table->slots[i].tex && table->slots[i].key == key) {
+            return table->slots[i].tex;
+        }
+        i = (i + 1) & mask;
+    }
+    return NULL;
+}
+
+/**
+ * @name	texture_table_add_content
+ * @brief	files a texture under its content_key instead of its url
+ * @param	table - (texture_table *) table of textures by content_key
+ * @param	tex - (texture_2d *) texture with a content_key
+ * @retval	bool - (true | false) depending on whether the texture was added
+ */
+bool texture_table_add_content(texture_table *table, texture_2d *tex) {
+    return tex->content_key && insert(table, tex->content_key, tex);
+}
+
+/**
+ * @name	texture_table_remove_content
+ * @brief	takes a texture filed by texture_table_add_content out
+ * @param	table - (texture_table *) table of textures by content_key
+ * @param	tex - (texture_2d *) texture to remove
+ * @retval	NONE
+ */
+void texture_table_remove_content(texture_table *table, texture_2d *tex) {
+    if (tex->content_key) {
+        remove_under(table, tex->content_key, tex);
+    }
+}
+
+/**
+ * @name	texture_table_next
+ * @brief	iterates the table, the slots are walked in order so textures
+ *			sit next to each other in memory
+ * @param	table - (texture_table *) table to iterate
+ * @param	index - (unsigned int *) slot to start from, moved past the
+ *			texture returned
+ * @retval	texture_2d* - the next texture, NULL when there are no more
+ */
+texture_2d *texture_table_next(texture_table *table, unsigned int *index) {
+    while (*index < table->capacity) {
+        texture_2d *tex = table->slots[(*index)++].tex;
+        if (tex) {
+            return tex;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @name	texture_table_clear
+ * @brief	empties the table and frees its slots, not the textures
+ * @param	table - (texture_table *) table to clear
+ * @retval	NONE
+ */
+void texture_table_clear(texture_table *table) {
+    free(table->slots);
+    texture_table_init(table);
+}
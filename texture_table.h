@@ -0,0 +1,66 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+ 
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+ 
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef TEXTURE_TABLE_H
+#define TEXTURE_TABLE_H
+
+#include <stdint.h>
+#include "core/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct texture_2d_t;
+
+// a slot is empty when key is zero, and a removed entry when tex is NULL
+typedef struct texture_table_slot_t {
+	uint64_t key;
+	struct texture_2d_t *tex;
+} texture_table_slot;
+
+// Textures by url, open addressed with linear probing. Keys are 64 bit url
+// hashes, kept on the texture and on interned handles so they are only
+// computed once, and urls are only compared when the keys match.
+// Removing while iterating is fine, adding may rehash so it is not.
+typedef struct texture_table_t {
+	texture_table_slot *slots;
+	unsigned int capacity; // power of two, zero before the first add
+	unsigned int count;
+	unsigned int used; // count plus removed entries
+} texture_table;
+
+// never zero
+uint64_t texture_table_key(const char *url);
+void texture_table_init(texture_table *table);
+struct texture_2d_t *texture_table_find(texture_table *table, uint64_t key, const char *url);
+// sets tex->url_key, false when out of memory
+bool texture_table_add(texture_table *table, struct texture_2d_t *tex);
+// does nothing for textures that are not in the table
+void texture_table_remove(texture_table *table, struct texture_2d_t *tex);
+// the same table can file textures by content_key instead, see
+// texture_manager.c, where only the keys are compared
+struct texture_2d_t *texture_table_find_content(texture_table *table, uint64_t key);
+bool texture_table_add_content(texture_table *table, struct texture_2d_t *tex);
+void texture_table_remove_content(texture_table *table, struct texture_2d_t *tex);
+// the next texture from *index on, NULL past the last. start *index at 0
+struct texture_2d_t *texture_table_next(texture_table *table, unsigned int *index);
+void texture_table_clear(texture_table *table);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TEXTURE_TABLE_H
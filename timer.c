@@ -19,18 +19,45 @@
  */
 #include "core/timer.h"
 #include <stdlib.h>
+#include <time.h>
 #include "core/log.h"
+#include "core/object_pool.h"
+#include "core/memory_tags.h"
 #include "util/detect.h"
 
-static core_timer *timer_head = NULL;
+/*
+ * Active timers live in a binary min-heap ordered by absolute deadline on a
+ * clock that advances by dt each tick, so a tick only touches the timers that
+ * fire and scheduling one is O(log n).
+ */
+static core_timer **m_heap = NULL;
+static int m_heap_count = 0;
+static int m_heap_capacity = 0;
+static long long m_timer_clock = 0;
+
 static core_timer *m_insert_head = NULL;
+static core_timer *m_cleared_head = NULL; // taken out of the heap, unlinked next tick
+static core_timer *m_timers_by_id = NULL; // every scheduled timer not yet unlinked
+
+// Timers due this tick, in deadline order, while they are being fired
+static core_timer **m_batch = NULL;
+static int m_batch_count = 0;
+static int m_batch_capacity = 0;
+
+static object_pool *m_timer_pool = NULL;
 
 static int timer_id = 0;
 
-#define MAX_TIMERS_PER_TICK 400
+#define DEFAULT_TIMER_BUDGET_US 8000 /* time a tick may spend in timer callbacks */
+#define TIMER_BATCH_SIZE 32 /* timers handed to js between budget checks */
+#define INITIAL_HEAP_CAPACITY 64
+#define TIMER_POOL_SLAB 64 /* timers allocated at a time */
+
+static long m_timer_budget_us = DEFAULT_TIMER_BUDGET_US;
+static core_timer_handlers m_handlers = {js_timer_fire_batch, js_timer_unlink};
 
 core_timer* core_get_timers() {
-  return timer_head;
+  return m_heap_count ? m_heap[0] : NULL;
 }
 
 core_timer* core_get_queued_timers() {
@@ -38,62 +65,128 @@ core_timer* core_get_queued_timers() {
 }
 
 static void queue_insert(core_timer *timer) {
+    HASH_ADD_INT(m_timers_by_id, id, timer);
+
     timer->prev = 0;
     timer->next = m_insert_head;
     m_insert_head = timer;
 }
 
-static void insert_timer(core_timer *timer) {
-    if (!timer_head) {
-        timer_head = timer;
-        timer->prev = 0;
-        timer->next = 0;
-    } else {
-        core_timer *current = timer_head;
+// Earlier deadline first, ties go to the timer created first
+static inline bool heap_before(core_timer *a, core_timer *b) {
+    return a->deadline < b->deadline || (a->deadline == b->deadline && a->id < b->id);
+}
+
+static inline void heap_set(int i, core_timer *timer) {
+    m_heap[i] = timer;
+    timer->heap_index = i;
+}
+
+static void heap_sift_up(int i) {
+    core_timer *timer = m_heap[i];
 
-        while (current->next && current->time_left <= timer->time_left) {
-            current = current->next;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!heap_before(timer, m_heap[parent])) {
+            break;
         }
+        heap_set(i, m_heap[parent]);
+        i = parent;
+    }
+    heap_set(i, timer);
+}
 
-        if (current->prev) {
-            current->prev->next = timer;
-        } else {
-            timer_head = timer; //it must be the head
+static void heap_sift_down(int i) {
+    core_timer *timer = m_heap[i];
+
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= m_heap_count) {
+            break;
+        }
+        if (child + 1 < m_heap_count && heap_before(m_heap[child + 1], m_heap[child])) {
+            child++;
+        }
+        if (!heap_before(m_heap[child], timer)) {
+            break;
         }
+        heap_set(i, m_heap[child]);
+        i = child;
+    }
+    heap_set(i, timer);
+}
 
-        timer->prev = current->prev;
-        current->prev = timer;
-        timer->next = current;
+static bool heap_push(core_timer *timer) {
+    if (m_heap_count == m_heap_capacity) {
+        int capacity = m_heap_capacity ? m_heap_capacity * 2 : INITIAL_HEAP_CAPACITY;
+        core_timer **heap = (core_timer **)TAG_REALLOC(MEMORY_TAG_TIMERS, m_heap, capacity * sizeof(core_timer *));
+        if (!heap) {
+            LOG("{timer} WARNING: Unable to grow the timer heap to %d timers", capacity);
+            return false;
+        }
+        m_heap = heap;
+        m_heap_capacity = capacity;
     }
+
+    heap_set(m_heap_count++, timer);
+    heap_sift_up(timer->heap_index);
+    return true;
 }
 
-static void insert_queued_timers() {
-    core_timer *timer = m_insert_head;
-    core_timer *next;
+static void heap_remove(core_timer *timer) {
+    int i = timer->heap_index;
+    core_timer *last = m_heap[--m_heap_count];
 
-    for (; timer; timer = next) {
-        next = timer->next;
-        insert_timer(timer);
+    timer->heap_index = -1;
+    if (last != timer) {
+        heap_set(i, last);
+        heap_sift_down(i);
+        heap_sift_up(last->heap_index);
     }
+}
 
-    m_insert_head = NULL;
+/**
+ * @name	timer_unlink
+ * @brief	releases the timer, which must no longer be in the heap or queue
+ * @param	timer - (core_timer *) timer to remove
+ * @retval	NONE
+ */
+CEXPORT void timer_unlink(core_timer *timer) {
+    HASH_DEL(m_timers_by_id, timer);
+
+    m_handlers.unlink(timer);
+    if (timer->js_data != (void *) timer->inline_data) {
+        free(timer->js_data);
+    }
+    OBJECT_POOL_RELEASE(timer);
 }
 
-// Return non-zero if timer was cleared
-static int unschedule_queued_timer(int id) {
+static void insert_timer(core_timer *timer) {
+    timer->deadline = m_timer_clock + timer->time_left;
+    timer->next = 0;
+    timer->prev = 0;
+
+    if (!heap_push(timer)) {
+        timer_unlink(timer);
+    }
+}
+
+static void insert_queued_timers() {
     core_timer *timer = m_insert_head;
     core_timer *next;
 
+    // Clear the queue first, timers are not queued again until the next tick
+    m_insert_head = NULL;
+
     for (; timer; timer = next) {
         next = timer->next;
 
-        if (timer->id == id) {
-            timer->cleared = true;
-            return 1;
+        if (timer->cleared) {
+            timer_unlink(timer);
+        } else {
+            insert_timer(timer);
         }
     }
-
-    return 0;
 }
 
 /**
@@ -117,60 +210,63 @@ CEXPORT static void timer_unschedule(core_timer *timer) {
 }
 
 /**
- * @name	timer_unlink
- * @brief	removes the timer from the timer list
- * @param	timer - (core_timer *) timer to remove
+ * @name	timer_fired
+ * @brief	updates a timer after js ran its callback
+ * @param	timer - (core_timer *) timer that fired
  * @retval	NONE
  */
-CEXPORT void timer_unlink(core_timer *timer) {
-    if (timer->prev) {
-        timer->prev->next = timer->next;
+static void timer_fired(core_timer *timer) {
+    if (!timer->repeat) {
+        timer_unschedule(timer);
     } else {
-        timer_head = timer->next;
-    }
-
-    if (timer->next) {
-        timer->next->prev = timer->prev;
+        timer->time_left = timer->duration;
     }
+}
 
-    if (timer == timer_head) {
-        timer_head = NULL;
+static bool batch_push(core_timer *timer) {
+    if (m_batch_count == m_batch_capacity) {
+        int capacity = m_batch_capacity ? m_batch_capacity * 2 : INITIAL_HEAP_CAPACITY;
+        core_timer **batch = (core_timer **)TAG_REALLOC(MEMORY_TAG_TIMERS, m_batch, capacity * sizeof(core_timer *));
+        if (!batch) {
+            return false;
+        }
+        m_batch = batch;
+        m_batch_capacity = capacity;
     }
 
-    js_timer_unlink(timer);
-    free(timer->js_data);
-    free(timer);
+    m_batch[m_batch_count++] = timer;
+    return true;
 }
 
-/**
- * @name	timer_fire
- * @brief	fire's the given timer to js
- * @param	timer - (core_timer *) timer to fire
- * @retval	NONE
- */
-CEXPORT static void timer_fire(core_timer *timer) {
-    js_timer_fire(timer);
-
-    if (!timer->repeat) {
-        timer_unschedule(timer);
-    } else {
-        timer->time_left = timer->duration;
-    }
+static long long timer_clock_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
 }
 
 /**
  * @name	core_get_timer
  * @brief	creates and returns a timer using the given params
- * @param	js_data - (void *) javascript data to attach to the timer
+ * @param	js_data - (void *) javascript data to attach to the timer, the
+ *			binding may instead point js_data at the timer's inline_data
  * @param	time - (int) how long the timer should be fore
  * @param	repeat - (bool) whether the timer should be repeating or not
- * @retval	core_timer* - pointer to the created timer
+ * @retval	core_timer* - pointer to the created timer, NULL if out of memory
  */
 CEXPORT core_timer *core_get_timer(void *js_data, int time, bool repeat) {
-    core_timer *timer = (core_timer *)malloc(sizeof(core_timer));
+    if (!m_timer_pool) {
+        m_timer_pool = OBJECT_POOL_INIT_TAGGED(core_timer, TIMER_POOL_SLAB, MEMORY_TAG_TIMERS);
+    }
+
+    core_timer *timer = OBJECT_POOL_GET(core_timer, m_timer_pool);
+    if (!timer) {
+        return NULL;
+    }
     timer->time_left = time;
     timer->duration = time;
     timer->id = timer_id++;
+    timer->deadline = 0;
+    timer->heap_index = -1;
     timer->next = NULL;
     timer->prev = NULL;
     timer->repeat = repeat;
@@ -186,47 +282,103 @@ CEXPORT core_timer *core_get_timer(void *js_data, int time, bool repeat) {
  * @retval	NONE
  */
 CEXPORT void core_timer_clear(int id) {
-    core_timer *timer = timer_head;
-
-    while (timer) {
-        if (timer->id == id) {
-            timer_unschedule(timer);
-            return;
+    core_timer *timer;
+
+    HASH_FIND_INT(m_timers_by_id, &id, timer);
+    if (timer) {
+        if (!timer->cleared && timer->heap_index >= 0) {
+            // out of the heap now, unlinked on the next tick
+            heap_remove(timer);
+            timer->next = m_cleared_head;
+            m_cleared_head = timer;
         }
 
-        timer = timer->next;
+        // Queued or in the batch being fired, the tick unlinks it
+        timer_unschedule(timer);
+        return;
     }
 
-    // It may be in the queue still
-    if (unschedule_queued_timer(id)) {
-        return;
+    // Clearing a timer that already finished is routine, only an id that
+    // was never handed out is worth mentioning
+    if (id < 0 || id >= timer_id) {
+        LOG("{timer} Tried to clear timer %i when it didn't exist", id);
     }
+}
 
-    LOG("{timer} Tried to clear timer %i when it didn't exist", id);
+static void unlink_timer_list(core_timer *timer) {
+    while (timer) {
+        core_timer *next = timer->next;
+        timer_unlink(timer);
+        timer = next;
+    }
 }
 
 /**
  * @name	core_timer_clear_all
- * @brief	unlinks (removes) all timers in the timer list
+ * @brief	unlinks (removes) all timers in the timer heap and queue
  * @retval	NONE
  */
 CEXPORT void core_timer_clear_all() {
-    core_timer *timer = timer_head;
+    int i;
 
     LOG("{CAT} CLEARING ALL TIMERS");
 
-    while (timer) {
-        core_timer *next = timer->next;
-        timer_unlink(timer);
-        timer = next;
+    for (i = 0; i < m_heap_count; i++) {
+        timer_unlink(m_heap[i]);
     }
+    m_heap_count = 0;
+
+    unlink_timer_list(m_insert_head);
+    unlink_timer_list(m_cleared_head);
+    m_insert_head = NULL;
+    m_cleared_head = NULL;
 
-    timer_head = NULL;
+    // a callback clearing everything leaves the batch to the tick to unlink
+    for (i = 0; i < m_batch_count; i++) {
+        timer_unschedule(m_batch[i]);
+    }
+}
+
+/**
+ * @name	core_timer_set_handlers
+ * @brief	sets what fires and releases timers
+ * @param	handlers - (const core_timer_handlers *) copied, NULL for the JS
+ *			bindings
+ * @retval	NONE
+ */
+CEXPORT void core_timer_set_handlers(const core_timer_handlers *handlers) {
+    if (handlers) {
+        m_handlers = *handlers;
+    } else {
+        m_handlers.fire_batch = js_timer_fire_batch;
+        m_handlers.unlink = js_timer_unlink;
+    }
+}
+
+/**
+ * @name	core_timer_count
+ * @brief	counts the scheduled timers, including any cleared this tick and
+ *			not yet unlinked
+ * @retval	int - number of timers
+ */
+CEXPORT int core_timer_count() {
+    return (int) HASH_COUNT(m_timers_by_id);
+}
+
+/**
+ * @name	core_timer_set_budget
+ * @brief	limits the time a tick spends firing timers, timers still due when
+ *			it runs out fire first on the next tick
+ * @param	budget_us - (long) microseconds per tick, 0 for no limit
+ * @retval	NONE
+ */
+CEXPORT void core_timer_set_budget(long budget_us) {
+    m_timer_budget_us = budget_us > 0 ? budget_us : 0;
 }
 
 /**
  * @name	core_timer_tick
- * @brief	ticks all of the timers, decrementing time, firing and unlinking as needed
+ * @brief	advances the timer clock, firing due timers and unlinking as needed
  * @param	dt - (int) elapsed time since last tick
  * @retval	NONE
  */
@@ -237,36 +389,59 @@ CEXPORT void core_timer_tick(long dt) {
         return;
     }
 
-    core_timer *timer = timer_head;
-    core_timer *last;
-    int max_ticks = MAX_TIMERS_PER_TICK;
+    unlink_timer_list(m_cleared_head);
+    m_cleared_head = NULL;
 
-    while (timer) {
-        last = timer;
+    m_timer_clock += dt;
 
-        if (--max_ticks <= 0) {
-            LOG("{timer} WARNING: More than %d timer callbacks in one tick.  Waiting for next tick", MAX_TIMERS_PER_TICK);
+    // Collect everything due first, so timers scheduled or repeating from a
+    // callback wait for the next tick and a zero length interval fires once
+    while (m_heap_count && m_heap[0]->deadline <= m_timer_clock) {
+        core_timer *timer = m_heap[0];
+        if (!batch_push(timer)) {
             break;
         }
+        heap_remove(timer);
+    }
 
-        core_timer *next = timer->next;
-
-        if (!timer->cleared) {
-            timer->time_left -= dt;
+    // Fire in slices, checking the budget in between
+    long long start = timer_clock_us();
+    int fired = 0;
+    int i;
 
-            if (timer->time_left <= 0) {
-                timer_fire(timer);
-            }
-        } else {
-            timer_unlink(timer);
+    while (fired < m_batch_count) {
+        int count = m_batch_count - fired;
+        if (count > TIMER_BATCH_SIZE) {
+            count = TIMER_BATCH_SIZE;
         }
 
-        timer = next;
-        if (timer == last) {
-            LOG("{timer} WARNING: Infinite loop detected.  Dumping all timers!");
-            core_timer_clear_all();
+        m_handlers.fire_batch(m_batch + fired, count);
+        fired += count;
+
+        if (m_timer_budget_us > 0 && fired < m_batch_count &&
+                timer_clock_us() - start >= m_timer_budget_us) {
+            LOG("{timer} WARNING: Timer callbacks took over %ld us, %d timers wait for next tick",
+                m_timer_budget_us, m_batch_count - fired);
             break;
         }
     }
-}
 
+    for (i = 0; i < m_batch_count; i++) {
+        core_timer *timer = m_batch[i];
+
+        if (i < fired && !timer->cleared) {
+            timer_fired(timer);
+        }
+
+        if (timer->cleared) {
+            timer_unlink(timer);
+        } else if (i < fired) {
+            insert_timer(timer);
+        } else if (!heap_push(timer)) {
+            // not reached this tick, its deadline keeps it first in line
+            timer_unlink(timer);
+        }
+    }
+
+    m_batch_count = 0;
+}
@@ -18,16 +18,24 @@
 
 #include "core/types.h"
 #include "util/detect.h"
+#include "core/deps/uthash/uthash.h"
+
+// room in each timer for the js binding to keep its data without allocating
+#define CORE_TIMER_INLINE_DATA_SIZE 32
 
 typedef struct core_timer_t {
     int time_left;
     int duration;
     int id;
+    long long deadline; // timer clock time it fires at, once scheduled
+    int heap_index; // position in the timer heap, -1 when not in it
     struct core_timer_t *next;
     struct core_timer_t *prev;
     bool repeat;
     bool cleared;
-    void *js_data;
+    void *js_data; // freed on unlink, unless it points at inline_data
+    UT_hash_handle hh; // scheduled timers by id
+    double inline_data[CORE_TIMER_INLINE_DATA_SIZE / sizeof(double)];
 } core_timer;
 
 
@@ -35,9 +43,9 @@ typedef struct core_timer_t {
 extern "C" {
 #endif
 
-// Get reference to timer linked lists. A timer is said to be queued if it was
-// added during the currenct tick. On a subsequent tick, it moves from queue to
-// active.
+// Get the next active timer to fire and the queued timer list. A timer is said
+// to be queued if it was added during the currenct tick. On a subsequent tick,
+// it moves from queue to the active timer heap.
 core_timer* core_get_timers();
 core_timer* core_get_queued_timers();
 
@@ -45,11 +53,25 @@ void core_timer_tick(long dt);
 void core_timer_clear_all();
 void core_timer_clear(int timerId);
 void core_timer_schedule(core_timer *timer);
+void core_timer_set_budget(long budget_us);
+int core_timer_count();
 core_timer *core_get_timer(void *js_data, int time, bool repeat);
 
 void js_timer_fire(core_timer *timer);
+// Runs the callbacks of count due timers in order with one entry into js,
+// skipping any whose cleared flag an earlier callback set
+void js_timer_fire_batch(core_timer **timers, int count);
 void js_timer_unlink(core_timer *t);
 
+// What fires and releases timers, the js_timer functions above unless set,
+// so benchmarks and tests can run timers without a JS engine. Set it while
+// no timers are scheduled
+typedef struct core_timer_handlers_t {
+    void (*fire_batch)(core_timer **timers, int count);
+    void (*unlink)(core_timer *timer);
+} core_timer_handlers;
+void core_timer_set_handlers(const core_timer_handlers *handlers);
+
 #ifdef __cplusplus
 }
 #endif
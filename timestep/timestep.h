@@ -23,6 +23,7 @@
 #include "core/util/detect.h"
 #include "js/js.h"
 #include "core/rgba.h"
+#include "core/timestep/timestep_easing.h"
 #include "core/tealeaf_context.h"
 
 
@@ -32,58 +33,142 @@ struct view_animation_t;
 //// View
 
 #define UNDEFINED_DIMENSION DBL_MIN
-
-enum view_types { DEFAULT_RENDER, IMAGE_VIEW };
+// most views are leaves or have a couple of children, which are stored in
+// the view itself
+#define TIMESTEP_VIEW_INLINE_SUBVIEWS 2
+
+enum view_types { DEFAULT_RENDER, IMAGE_VIEW, SPRITE_VIEW, NINE_SLICE_VIEW, TILEMAP_VIEW, PARTICLE_VIEW, TEXT_VIEW, SKELETON_VIEW, SCROLL_VIEW };
+
+// define TIMESTEP_VIEW_FLOAT_TRANSFORMS to store the hot transform fields in
+// single precision, which packs them into one cache line
+#ifdef TIMESTEP_VIEW_FLOAT_TRANSFORMS
+typedef float timestep_view_scalar;
+#else
+typedef double timestep_view_scalar;
+#endif
+
+// the inputs a view's local transform was last built from
+typedef struct timestep_view_transform_key_t {
+	timestep_view_scalar x;
+	timestep_view_scalar y;
+	timestep_view_scalar r;
+	timestep_view_scalar anchor_x;
+	timestep_view_scalar anchor_y;
+	timestep_view_scalar offset_x;
+	timestep_view_scalar offset_y;
+	timestep_view_scalar scale;
+	timestep_view_scalar scale_x;
+	timestep_view_scalar scale_y;
+} timestep_view_transform_key;
 
 typedef struct timestep_view_t {
-	unsigned int uid;
+	// everything the render and tick walks read for every view comes first,
+	// so each visit touches as few cache lines as possible
+	timestep_view_scalar x;
+	timestep_view_scalar y;
+	timestep_view_scalar r;
+	timestep_view_scalar anchor_x;
+	timestep_view_scalar anchor_y;
+	timestep_view_scalar offset_x;
+	timestep_view_scalar offset_y;
+	timestep_view_scalar scale;
+	timestep_view_scalar scale_x;
+	timestep_view_scalar scale_y;
+	timestep_view_scalar opacity;
+	bool visible;
+	bool clip;
+	bool flip_x;
+	bool flip_y;
+	bool has_jsrender;
+	bool has_jstick;
+	unsigned int subview_count;
 	struct timestep_view_t **subviews;
+
+	unsigned int uid;
 	struct timestep_view_t *superview;
 	unsigned int subview_array_size;
-	unsigned int subview_count;
+	// subviews points here until a view has more children than fit
+	struct timestep_view_t *inline_subviews[TIMESTEP_VIEW_INLINE_SUBVIEWS];
 	unsigned int subview_index;
 
 	int added_at;
 
   JS_OBJECT_WRAPPER js_view;
-	bool has_jsrender;
-	bool has_jstick;
 
-	double x;
-	double y;
 	double width;
 	double height;
-	double r;
-	double anchor_x;
-	double anchor_y;
-	double offset_x;
-	double offset_y;
-	double scale;
-	double scale_x;
-	double scale_y;
 	double abs_scale;
-	double opacity;
 	bool needs_reflow;
-	bool clip;
-	bool visible;
-	bool flip_x;
-	bool flip_y;
+	bool order_independent; // subviews may be reordered by draw state
+	// subviews don't overlap, so those of equal z are sorted by texture and
+	// blend state instead of the order they were added in
+	bool sort_by_draw_state;
+	bool draw_state_sorted; // sort_by_draw_state as of the last sort
+	bool cache_as_bitmap; // render the subtree once into an offscreen texture
+	bool cache_dirty;
+	unsigned int cache_signature;
+	context_2d *cache_ctx;
+	bool draws_outside_bounds; // never cull this subtree against the viewport
+	bool static_render; // the JS render draws the same every frame
+	struct display_list_t *render_list; // recording of a static JS render
+	rect_2d world_bounds; // axis-aligned bounds from the last render
+	bool culled; // outside the clip on the last render that reached it
+	bool damage_queued; // waiting for the next render to damage its new bounds
+
+	// cached transforms: world = parent world * local. world_version changes
+	// whenever world_transform does, and parent_version records the parent
+	// version the world was built against
+	timestep_view_transform_key transform_key;
+	matrix_3x3 local_transform;
+	matrix_3x3 world_transform;
+	unsigned int world_version;
+	unsigned int parent_version;
+	bool transform_dirty;
+	bool local_translation_only;
+
+	// number of views in this subtree, itself included, that have a JS or
+	// native tick; the tick walk skips subtrees where it is 0
+	unsigned int tick_count;
+	bool tick_registered;
+
+	// opt-in grid over a container's subviews, and where this view is filed
+	// in its superview's grid
+	struct view_spatial_index_t *spatial_index;
+	int index_cells[4]; // min x, min y, max x, max y of the cells it is in
+	unsigned int index_slot; // position in the overflow list
+	unsigned int index_stamp; // last query that returned it
+	unsigned char index_state;
+	bool index_dirty; // moved since it was filed
+
+	// NINE_SLICE_VIEW insets into its image, in source pixels
+	double slice_top;
+	double slice_right;
+	double slice_bottom;
+	double slice_left;
 
 	int composite_operation;
 
 	struct rgba_t background_color;
 	int z_index;
 	bool dirty_z_index;
+	unsigned int draw_key; // its blend state and texture, while sort_by_draw_state is on above it
 
 	struct view_animation_t **anims;
 	unsigned int anim_count;
 	unsigned int max_anims;
+	unsigned int anim_stage; // 1 + slot of this tick's animated writes, 0 if none
+	unsigned int anim_interp; // 1 + slot of its fixed step interpolation, 0 if none
 
 	void (*timestep_view_render)(struct timestep_view_t*, context_2d*);
 	void (*timestep_view_tick)(struct timestep_view_t*, double);
 
 	PERSISTENT_JS_OBJECT_WRAPPER map_ref;
 	void *view_data;
+	// image map made natively for an IMAGE_VIEW or NINE_SLICE_VIEW, freed
+	// with the view; JS may still point view_data at a map of its own
+	struct timestep_image_map_t *owned_map;
+	// made by a prefab and not yet wrapped by JS, deleted with its superview
+	bool prefab_owned;
 
 	rgba filter_color;
 	int filter_type;
@@ -108,7 +193,20 @@ enum style_props {
   OPACITY,
   SCALE,
   SCALE_X,
-  SCALE_Y
+  SCALE_Y,
+  OFFSET_X,
+  OFFSET_Y,
+  Z_INDEX,            // rounded, and re-sorts the view among its siblings
+  BACKGROUND_R,       // color channels, 0 to 1, eased one by one
+  BACKGROUND_G,
+  BACKGROUND_B,
+  BACKGROUND_A,
+  FILTER_R,
+  FILTER_G,
+  FILTER_B,
+  FILTER_A,
+  SPRITE_FRAME,       // rounded frame of a SPRITE_VIEW, best stopped first
+  STYLE_PROP_COUNT
 };
 enum transitions {
   NO_TRANSITION,
@@ -145,7 +243,8 @@ enum transitions {
   EASE_IN_OUT_BACK,
   EASE_IN_BOUNCE,
   EASE_OUT_BOUNCE,
-  EASE_IN_OUT_BOUNCE
+  EASE_IN_OUT_BOUNCE,
+  TRANSITION_COUNT
 };
 
 /*
@@ -164,17 +263,14 @@ typedef struct style_prop_t {
 		double delta;
 	};
 	bool is_delta;
-
-	struct style_prop_t *prev;
-	struct style_prop_t *next;
 } style_prop;
 
 /*
  * a frame is a unit of the animation.  Each frame is a specific
  * type of animation - style modification, wait, or function calling
  * resolved ?? TODO what?
- * If it's a style, frame, prop_head is the head of a linked list of
- * style properties and duration is the length.  Transition is the function
+ * If it's a style, frame, props holds its prop_count style properties
+ * in the order they were added and duration is the length.  Transition is the function
  * to use for easing.  TODO hook transition up to js
  * If it's a function call, cb is a wrapper of the function to call
  * A wait frame simply waits the duration.
@@ -188,28 +284,74 @@ typedef struct frame_t {
 	unsigned int /* enum transitions */ transition;
 	PERSISTENT_JS_OBJECT_WRAPPER cb;
 	JS_OBJECT_WRAPPER onTick;
-	style_prop *prop_head;
+	unsigned int prop_count;
+	style_prop props[STYLE_PROP_COUNT];
 
 	struct frame_t *prev;
 	struct frame_t *next;
 } anim_frame;
 
+/*
+ * A timeline is an immutable, compiled chain of wait and style frames
+ * (see view_animation_compile) that any number of animations can play.
+ * Each style frame's props keep their targets, the tween start values
+ * live on the animation playing it. Timelines are reference counted.
+ */
+typedef struct anim_timeline_frame_t {
+	enum frame_type type;
+	unsigned int duration;
+	unsigned int /* enum transitions */ transition;
+	unsigned int prop_count;
+	style_prop props[STYLE_PROP_COUNT];
+} anim_timeline_frame;
+
+typedef struct anim_timeline_t {
+	unsigned int ref_count;
+	unsigned int duration;
+	unsigned int frame_count;
+	anim_timeline_frame frames[1];
+} anim_timeline;
+
 /*
  * A view animation is the backing of a javascript animation.
  * It has a series of frames, stored in a linked list starting with
  * frame_head. The first frame in the list is the active one.
  * Status can be one of ?? TODO ?
  * elapsed is the length of time the animation has been running
+ * schedule_index is the animation's slot in the scheduler's active array,
+ * or in its pending array if schedule_pending is set
+ * easing_mode overrides the global easing_modes setting for this animation
+ * in_group is the animation's group membership as last told to JS;
+ * group_wanted is the membership it should have once the queued change at
+ * group_index is delivered
+ * view_index is the animation's slot in view->anims
+ * timeline, when set, is played instead of frame_head: timeline_frame is
+ * the running frame and timeline_initial the values its style props
+ * tween from, captured when it started (timeline_resolved)
+ * parallel_done is set when a worker already ticked it this step
  */
 typedef struct view_animation_t {
 	anim_frame *frame_head;
 	struct timestep_view_t *view;
-	unsigned int elapsed;
+	double elapsed;
 	bool is_scheduled;
 	bool is_paused;
 
-	struct view_animation_t *next;
-	struct view_animation_t *prev;
+	unsigned int schedule_index;
+	bool schedule_pending;
+	unsigned int /* enum easing_modes */ easing_mode;
+	bool in_group;
+	bool group_wanted;
+	bool group_queued;
+	unsigned int group_index;
+	unsigned int view_index;
+
+	anim_timeline *timeline;
+	unsigned int timeline_frame;
+	bool timeline_resolved;
+	double timeline_initial[STYLE_PROP_COUNT];
+
+	bool parallel_done;
 
 	JS_OBJECT_WRAPPER js_anim;
 } view_animation;
@@ -16,39 +16,71 @@
  */
 
 #include <math.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "core/timestep/timestep_animate.h"
 #include "core/timestep/timestep_view.h"
+#include "core/timestep/timestep_stats.h"
 #include "js/js.h"
 #include "js/js_animate.h"
 #include "core/log.h"
+#include "core/profiler.h"
+#include "core/memory_tags.h"
+#include "core/core.h"
+#include "core/platform/threads.h"
+#include <pthread.h>
 
 /*
  * make some object pools for our different objects
  */
-static object_pool *view_animation_pool = OBJECT_POOL_INIT(view_animation, 64);
-static object_pool *style_prop_pool = OBJECT_POOL_INIT(style_prop, 64);
-static object_pool *frame_pool = OBJECT_POOL_INIT(anim_frame, 32);
-
-// Every animation goes on this global list so we can tick them all
-static view_animation *global_head = NULL;
+static object_pool *view_animation_pool = OBJECT_POOL_INIT_TAGGED(view_animation, 64, MEMORY_TAG_ANIMATIONS);
+static object_pool *frame_pool = OBJECT_POOL_INIT_TAGGED(anim_frame, 32, MEMORY_TAG_ANIMATIONS);
+
+// Every scheduled animation is in this dense array so we can tick them all.
+// Animations scheduled since the last tick wait in the pending array and
+// are merged in when the next tick starts
+static view_animation **active_anims = NULL;
+static unsigned int active_count = 0;
+static unsigned int active_size = 0;
+static view_animation **pending_anims = NULL;
+static unsigned int pending_count = 0;
+static unsigned int pending_size = 0;
+
+// while ticking, animations before this index have already been ticked
+static unsigned int tick_next = 0;
+// while ticking, animated style writes are staged, see commit_staged_props
+static bool staging = false;
+// while taking the last fixed step, committed writes are recorded to interpolate
+static bool recording_interp = false;
+
+// see view_animation_set_hidden_mode. Steps are counted so throttled
+// animations take turns rather than all applying on the same step
+static unsigned int hidden_mode = HIDDEN_ANIMATIONS_APPLY;
+static unsigned int hidden_interval = 1;
+static unsigned int hidden_step = 0;
+
+// animations whose JS group membership changed during the current tick
+static view_animation **group_changes = NULL;
+static unsigned int group_change_count = 0;
+static unsigned int group_change_size = 0;
 
 static void init_frame(anim_frame *frame, struct timestep_view_t *v);
 static void apply_frame(anim_frame *frame, struct timestep_view_t *view, double tt);
-static void view_animation_tick(view_animation *anim, long dt);
-
-/*
- * if we are currently in the middle of a tick, this is true and therefore
- * we shouldn't tick any animation that was added until the next tick
- *
- */
-static view_animation **global_list_buffer = NULL;
-static unsigned int global_list_buffer_size = 0;
+static void view_animation_tick(view_animation *anim, double dt);
+static void commit_staged_props();
+static void tick_parallel(double dt);
+static void stop_workers();
+static void record_interp(timestep_view *v, unsigned int name, double value);
+static void deliver_group_change(view_animation *anim);
+void view_animation_schedule(view_animation *anim);
+void view_animation_unschedule(view_animation *anim);
 
 static int global_frame_uid = 0;
 anim_frame *anim_frame_get() {
     anim_frame *frame = OBJECT_POOL_GET(anim_frame, frame_pool);
-    frame->prop_head = NULL;
+    frame->prop_count = 0;
     frame->resolved = false;
     frame->id = global_frame_uid++;
 
@@ -58,23 +90,23 @@ anim_frame *anim_frame_get() {
 }
 
 void anim_frame_release(anim_frame *frame) {
-    style_prop **prop_head = &frame->prop_head;
-    style_prop *curr;
-    while (*prop_head) {
-        curr = *prop_head;
-        LIST_REMOVE(prop_head, curr);
-        OBJECT_POOL_RELEASE(curr);
-    }
-
     js_object_wrapper_delete(&frame->cb);
 
     OBJECT_POOL_RELEASE(frame);
 }
 
 style_prop *anim_frame_add_style_prop(anim_frame *frame) {
-    style_prop *prop = OBJECT_POOL_GET(style_prop, style_prop_pool);
+    // a frame can animate each property once, so this only fills up when
+    // the same property is given twice. hand out a slot that is never applied
+    if (frame->prop_count >= STYLE_PROP_COUNT) {
+        static style_prop ignored;
+        LOG("{animate} WARNING: Too many style properties on animation frame %u", frame->id);
+        ignored.is_delta = false;
+        return &ignored;
+    }
+
+    style_prop *prop = &frame->props[frame->prop_count++];
     prop->is_delta = false;
-    LIST_ADD(&frame->prop_head, prop);
     return prop;
 }
 
@@ -86,6 +118,12 @@ view_animation *view_animation_init(timestep_view *view) {
     anim->elapsed = 0;
     anim->is_scheduled = false;
     anim->is_paused = false;
+    anim->easing_mode = EASING_DEFAULT;
+    anim->in_group = false;
+    anim->group_wanted = false;
+    anim->group_queued = false;
+    anim->timeline = NULL;
+    anim->parallel_done = false;
 
     timestep_view_add_animation(view, anim);
 
@@ -97,9 +135,18 @@ void view_animation_release(view_animation *anim) {
     LOGFN("view_animation_release");
 
     view_animation_clear(anim);
-    if (anim->is_scheduled) {
-        anim->is_scheduled = false;
-        LIST_REMOVE(&global_head, anim);
+    view_animation_unschedule(anim);
+
+    // the view must not keep a pointer to the pooled animation
+    if (anim->view) {
+        timestep_view_remove_animation(anim->view, anim);
+        anim->view = NULL;
+    }
+
+    // the pooled animation may be reused, so settle its group now
+    if (anim->group_queued) {
+        group_changes[anim->group_index] = NULL;
+        deliver_group_change(anim);
     }
 
     OBJECT_POOL_RELEASE(anim);
@@ -107,17 +154,142 @@ void view_animation_release(view_animation *anim) {
     LOGFN("end view_animation_release");
 }
 
+/**
+ * @name	grow_anim_array
+ * @brief	makes room for one more animation in the given array
+ * @param	list - (view_animation ***) array to grow
+ * @param	count - (unsigned int) animations in the array
+ * @param	size - (unsigned int *) allocated size of the array
+ * @retval	bool - false if the array is full and could not be grown
+ */
+static bool grow_anim_array(view_animation ***list, unsigned int count, unsigned int *size) {
+    if (count < *size) {
+        return true;
+    }
+
+    unsigned int new_size = *size ? *size * 2 : 32;
+    view_animation **new_list = (view_animation **) TAG_REALLOC(MEMORY_TAG_ANIMATIONS, *list, sizeof(view_animation *) * new_size);
+    if (!new_list) {
+        LOG("{animate} WARNING: Unable to grow the animation list to %u", new_size);
+        return false;
+    }
+
+    *list = new_list;
+    *size = new_size;
+    return true;
+}
+
+/**
+ * @name	deliver_group_change
+ * @brief	tells JS about the animation's group membership if it changed
+ * @param	anim - (view_animation *) animation to deliver the change for
+ * @retval	NONE
+ */
+static void deliver_group_change(view_animation *anim) {
+    anim->group_queued = false;
+    if (anim->group_wanted == anim->in_group) {
+        return;
+    }
+
+    anim->in_group = anim->group_wanted;
+    if (anim->in_group) {
+        def_animate_add_to_group(anim->js_anim);
+    } else {
+        def_animate_remove_from_group(anim->js_anim);
+    }
+}
+
+/**
+ * @name	set_in_group
+ * @brief	adds the animation to or removes it from its JS group. mid tick
+ *			the change is queued and only the net change is delivered once
+ *			every animation has ticked, so an animation that finishes and
+ *			is restarted by a callback does not cross into JS twice
+ * @param	anim - (view_animation *) animation to change
+ * @param	in_group - (bool) whether the animation should be in its group
+ * @retval	NONE
+ */
+static void set_in_group(view_animation *anim, bool in_group) {
+    anim->group_wanted = in_group;
+
+    if (!staging) {
+        deliver_group_change(anim);
+        return;
+    }
+
+    if (!anim->group_queued) {
+        if (!grow_anim_array(&group_changes, group_change_count, &group_change_size)) {
+            deliver_group_change(anim);
+            return;
+        }
+
+        anim->group_queued = true;
+        anim->group_index = group_change_count;
+        group_changes[group_change_count++] = anim;
+    }
+}
+
+/**
+ * @name	deliver_group_changes
+ * @brief	delivers the group changes queued during the tick
+ * @retval	NONE
+ */
+static void deliver_group_changes() {
+    // a callback may queue more changes, which are delivered in this loop
+    for (unsigned int i = 0; i < group_change_count; i++) {
+        view_animation *anim = group_changes[i];
+        if (anim) {
+            deliver_group_change(anim);
+        }
+    }
+
+    group_change_count = 0;
+}
+
 void view_animation_schedule(view_animation *anim) {
     if (!anim->is_scheduled) {
+        // new animations are not ticked until the next tick starts
+        if (!grow_anim_array(&pending_anims, pending_count, &pending_size)) {
+            return;
+        }
+
         anim->is_scheduled = true;
-        LIST_ADD(&global_head, anim);
+        anim->schedule_pending = true;
+        anim->schedule_index = pending_count;
+        pending_anims[pending_count++] = anim;
     }
 }
 
 void view_animation_unschedule(view_animation *anim) {
-    if (anim->is_scheduled) {
-        anim->is_scheduled = false;
-        LIST_REMOVE(&global_head, anim);
+    if (!anim->is_scheduled) {
+        return;
+    }
+
+    anim->is_scheduled = false;
+    anim->parallel_done = false;
+    unsigned int i = anim->schedule_index;
+
+    if (anim->schedule_pending) {
+        view_animation *last = pending_anims[--pending_count];
+        pending_anims[i] = last;
+        last->schedule_index = i;
+        return;
+    }
+
+    // swap remove. if the hole is among the animations already ticked this
+    // tick, fill it with the most recently ticked one and move the boundary
+    // back, so the animation moved from the end is still ticked exactly once
+    if (i < tick_next) {
+        view_animation *ticked = active_anims[--tick_next];
+        active_anims[i] = ticked;
+        ticked->schedule_index = i;
+        i = tick_next;
+    }
+
+    view_animation *last = active_anims[--active_count];
+    if (i < active_count) {
+        active_anims[i] = last;
+        last->schedule_index = i;
     }
 }
 
@@ -147,9 +319,14 @@ void view_animation_clear(view_animation *anim) {
         anim_frame_release(curr);
     }
 
+    if (anim->timeline) {
+        anim_timeline_release(anim->timeline);
+        anim->timeline = NULL;
+    }
+
     view_animation_unschedule(anim);
     anim->elapsed = 0;
-    def_animate_remove_from_group(anim->js_anim);
+    set_in_group(anim, false);
     LOGFN("end view_animation_clear");
 }
 
@@ -157,7 +334,7 @@ void view_animation_commit(view_animation *anim) {
     LOGFN("view_animation_commit");
     view_animation_resume(anim);
 
-    unsigned int elapsed = 0;
+    double elapsed = 0;
     anim->elapsed = 0;
     anim_frame **head = &anim->frame_head;
     anim_frame *curr = *head;
@@ -166,7 +343,15 @@ void view_animation_commit(view_animation *anim) {
         LIST_ITERATE(head, curr);
     }
 
+    if (anim->timeline) {
+        for (unsigned int i = anim->timeline_frame; i < anim->timeline->frame_count; i++) {
+            elapsed += anim->timeline->frames[i].duration;
+        }
+    }
+
     view_animation_tick(anim, elapsed);
+    // committing from a callback mid tick must still land on the view now
+    commit_staged_props();
 
     LOGFN("end view_animation_commit");
 }
@@ -196,7 +381,8 @@ void view_animation_then(view_animation *anim, anim_frame *frame, unsigned int d
     LOGFN("view_animation_then");
 
     anim_frame *frame_head = anim->frame_head;
-    if (!frame_head) {
+    // frames chained onto a playing timeline run once it finishes
+    if (!frame_head && !anim->timeline) {
         anim->elapsed = 0;
     }
 
@@ -211,56 +397,61 @@ void view_animation_then(view_animation *anim, anim_frame *frame, unsigned int d
 
     frame->transition = transition;
     //anim->is_running = true; TODO what should this do?
-    def_animate_add_to_group(anim->js_anim);
+    set_in_group(anim, true);
 
     LOGFN("end view_animation_then");
 }
 
-CEXPORT void view_animation_tick_animations(long dt) {
-    LOGFN("view_animation_tick_animations");
-    // lock the animation queue - kind of hacky, but should handle
-    // *most* situations where we modify the queue while ticking
-    // (currently handles the case of adding new animations during
-    // tick...)
-
-    view_animation *curr;
-    view_animation *next;
+/**
+ * @name	step_animations
+ * @brief	advances every scheduled animation by dt
+ * @param	dt - (double) time to advance by in milliseconds
+ * @retval	NONE
+ */
+static void step_animations(double dt) {
+    hidden_step++;
 
-    // copy the list into the global buffer
-    unsigned int count = 0;
-    next = global_head;
-    while (next) {
-        curr = next;
-        LIST_ITERATE(&global_head, next);
-
-        if (count + 1 > global_list_buffer_size) {
-            if (!global_list_buffer_size) {
-                global_list_buffer_size = 32;
-                global_list_buffer = (view_animation **) malloc(sizeof(view_animation *) * global_list_buffer_size);
-            } else {
-                global_list_buffer_size *= 2;
-                global_list_buffer = (view_animation **) realloc(global_list_buffer, sizeof(view_animation *) * global_list_buffer_size);
-            }
+    // animations scheduled since the last tick join this one; anything
+    // scheduled from a callback below waits in pending until the next
+    unsigned int i;
+    for (i = 0; i < pending_count; ++i) {
+        if (!grow_anim_array(&active_anims, active_count, &active_size)) {
+            break;
         }
 
-        global_list_buffer[count] = curr;
-        ++count;
+        view_animation *anim = pending_anims[i];
+        anim->schedule_pending = false;
+        anim->schedule_index = active_count;
+        active_anims[active_count++] = anim;
     }
 
-    unsigned int i;
-    for (i = 0; i < count; ++i) {
-        view_animation_tick(global_list_buffer[i], dt);
+    // keep whatever could not be merged for the next tick
+    if (i > 0) {
+        pending_count -= i;
+        memmove(pending_anims, pending_anims + i, sizeof(view_animation *) * pending_count);
+        for (unsigned int j = 0; j < pending_count; ++j) {
+            pending_anims[j]->schedule_index = j;
+        }
     }
 
-    //LOG("==== done ticking animations ====");
-    //curr = global_head;
-    //while (curr) {
-    //	LOG(">> view %i", curr->view->uid);
-    //	LIST_ITERATE(&global_head, curr);
-    //}
-    //LOG("==================================");
+    // unscheduling mid tick keeps every remaining animation either before
+    // tick_next (ticked) or after it (not yet ticked), see unschedule
+    tick_next = 0;
+    staging = true;
+    tick_parallel(dt);
+    while (tick_next < active_count) {
+        view_animation *anim = active_anims[tick_next++];
+        if (anim->parallel_done) {
+            anim->parallel_done = false;
+            continue;
+        }
+        view_animation_tick(anim, dt);
+    }
+    commit_staged_props();
+    staging = false;
+    tick_next = 0;
 
-    LOGFN("end view_animation_tick_animations");
+    deliver_group_changes();
 }
 
 // Easing Functions
@@ -397,8 +588,7 @@ static inline double FN_EASE_IN_OUT_ELASTIC (double n) {
     double p = 0.45;	// 0.3 * 1.5
     double s = 0.1125;	// p / (2*PI) * asin(1)
     --n;
-    if (n < 1) return -.5 * (pow(2, 10 * n) * sin((n * 1 - s) * (2 * PI) / p));
-    --n;
+    if (n < 0) return -.5 * (pow(2, 10 * n) * sin((n * 1 - s) * (2 * PI) / p));
     return pow(2, -10 * n) * sin((n * 1 - s) * (2 * PI) / p) * .5 + 1;
 };
 static inline double FN_EASE_IN_BACK (double n) {
@@ -449,8 +639,14 @@ static inline double FN_EASE_IN_OUT_BOUNCE (double n) {
     return FN_EASE_OUT_BOUNCE ((n * 2) - 1) * .5 + .5;
 };
 
-static double apply_transition(anim_frame *frame, double t) {
-    switch (frame->transition) {
+static double apply_custom_transition(unsigned int transition, double t);
+
+static double apply_transition(unsigned int transition, double t) {
+    if (transition >= TRANSITION_COUNT) {
+        return apply_custom_transition(transition, t);
+    }
+
+    switch (transition) {
     case LINEAR:
         return FN_LINEAR(t);
     case EASE_IN:
@@ -520,30 +716,1057 @@ static double apply_transition(anim_frame *frame, double t) {
     }
 }
 
+// Custom curves, numbered from TRANSITION_COUNT in the order they were
+// defined. They are only written between ticks, so the animation workers
+// read them freely
+#define MAX_CUSTOM_TRANSITIONS 256
+#define BEZIER_SAMPLES 11
+#define BEZIER_NEWTON_STEPS 4
+#define BEZIER_EPSILON 1e-7
+
+typedef struct custom_curve_t {
+    bool is_bezier;
+    // cubic-bezier(x1, y1, x2, y2) as polynomial coefficients, and x at
+    // evenly spaced parameters to start the solve from
+    double params[4];
+    double ax, bx, cx;
+    double ay, by, cy;
+    double samples[BEZIER_SAMPLES];
+    // keyframes: time, value and the transition easing into it, per key
+    unsigned int key_count;
+    double *keys;
+} custom_curve;
+
+static custom_curve *custom_curves[MAX_CUSTOM_TRANSITIONS];
+static unsigned int custom_count = 0;
+
+static inline double bezier_x(const custom_curve *c, double u) {
+    return ((c->ax * u + c->bx) * u + c->cx) * u;
+}
+
+static inline double bezier_y(const custom_curve *c, double u) {
+    return ((c->ay * u + c->by) * u + c->cy) * u;
+}
+
+static inline double bezier_slope_x(const custom_curve *c, double u) {
+    return (3 * c->ax * u + 2 * c->bx) * u + c->cx;
+}
+
+/**
+ * @name	solve_bezier
+ * @brief	finds the parameter where the curve reaches x, starting Newton's
+ *          method from the sample table and bisecting if it stalls
+ * @param	c - (const custom_curve *) bezier curve
+ * @param	x - (double) progress, 0 to 1
+ * @retval	double - parameter of the point at x
+ */
+static double solve_bezier(const custom_curve *c, double x) {
+    const double step = 1.0 / (BEZIER_SAMPLES - 1);
+    unsigned int i = 1;
+    while (i < BEZIER_SAMPLES - 1 && c->samples[i] <= x) {
+        i++;
+    }
+    i--;
+
+    double span = c->samples[i + 1] - c->samples[i];
+    double u = (i + (span > 0 ? (x - c->samples[i]) / span : 0)) * step;
+    for (int n = 0; n < BEZIER_NEWTON_STEPS; n++) {
+        double slope = bezier_slope_x(c, u);
+        if (fabs(slope) < BEZIER_EPSILON) {
+            break;
+        }
+        double error = bezier_x(c, u) - x;
+        if (fabs(error) < BEZIER_EPSILON) {
+            return u;
+        }
+        u -= error / slope;
+    }
+
+    double lo = i * step;
+    double hi = lo + step;
+    if (u >= lo && u <= hi && fabs(bezier_x(c, u) - x) < BEZIER_EPSILON) {
+        return u;
+    }
+    u = (lo + hi) / 2;
+    for (int n = 0; n < 32 && hi - lo > BEZIER_EPSILON; n++) {
+        if (bezier_x(c, u) < x) {
+            lo = u;
+        } else {
+            hi = u;
+        }
+        u = (lo + hi) / 2;
+    }
+    return u;
+}
+
+static double apply_keyframes(const custom_curve *c, double t) {
+    const double *keys = c->keys;
+    unsigned int last = c->key_count - 1;
+    if (t <= keys[0]) {
+        return keys[1];
+    }
+    if (t >= keys[last * 3]) {
+        return keys[last * 3 + 1];
+    }
+
+    // the first key after t
+    unsigned int lo = 1;
+    unsigned int hi = last;
+    while (lo < hi) {
+        unsigned int mid = (lo + hi) / 2;
+        if (keys[mid * 3] <= t) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    const double *from = keys + (lo - 1) * 3;
+    const double *to = keys + lo * 3;
+    unsigned int transition = (unsigned int) to[2];
+    double local = (t - from[0]) / (to[0] - from[0]);
+    double eased = transition == NO_TRANSITION ? local : apply_transition(transition, local);
+    return from[1] + (to[1] - from[1]) * eased;
+}
+
+static double apply_custom_transition(unsigned int transition, double t) {
+    unsigned int slot = transition - TRANSITION_COUNT;
+    if (slot >= custom_count) {
+        // a curve cleared since the frame was made
+        return FN_EASE_IN_OUT_CUBIC(t);
+    }
+
+    const custom_curve *c = custom_curves[slot];
+    if (!c->is_bezier) {
+        return apply_keyframes(c, t);
+    }
+    if (t <= 0 || t >= 1) {
+        return t <= 0 ? 0 : 1;
+    }
+    return bezier_y(c, solve_bezier(c, t));
+}
+
+static unsigned int add_custom_curve(custom_curve *c) {
+    if (custom_count >= MAX_CUSTOM_TRANSITIONS) {
+        LOG("{animate} WARNING: No room for more than %d custom transitions", MAX_CUSTOM_TRANSITIONS);
+        TAG_FREE(c->keys);
+        TAG_FREE(c);
+        return NO_TRANSITION;
+    }
+    custom_curves[custom_count] = c;
+    return TRANSITION_COUNT + custom_count++;
+}
+
+CEXPORT unsigned int view_animation_define_bezier(double x1, double y1, double x2, double y2) {
+    if (x1 < 0 || x1 > 1 || x2 < 0 || x2 > 1) {
+        LOG("{animate} WARNING: Bezier control points must have x from 0 to 1");
+        return NO_TRANSITION;
+    }
+
+    double params[4] = {x1, y1, x2, y2};
+    for (unsigned int i = 0; i < custom_count; i++) {
+        if (custom_curves[i]->is_bezier && !memcmp(custom_curves[i]->params, params, sizeof(params))) {
+            return TRANSITION_COUNT + i;
+        }
+    }
+
+    custom_curve *c = (custom_curve *) TAG_MALLOC(MEMORY_TAG_ANIMATIONS, sizeof(custom_curve));
+    if (!c) {
+        return NO_TRANSITION;
+    }
+    c->is_bezier = true;
+    memcpy(c->params, params, sizeof(params));
+    c->cx = 3 * x1;
+    c->bx = 3 * (x2 - x1) - c->cx;
+    c->ax = 1 - c->cx - c->bx;
+    c->cy = 3 * y1;
+    c->by = 3 * (y2 - y1) - c->cy;
+    c->ay = 1 - c->cy - c->by;
+    for (unsigned int i = 0; i < BEZIER_SAMPLES; i++) {
+        c->samples[i] = bezier_x(c, (double) i / (BEZIER_SAMPLES - 1));
+    }
+    c->key_count = 0;
+    c->keys = NULL;
+    return add_custom_curve(c);
+}
+
+CEXPORT unsigned int view_animation_define_keyframes(const double *keys, unsigned int count) {
+    bool valid = keys && count >= 2 && keys[0] == 0 && keys[(count - 1) * 3] == 1;
+    for (unsigned int i = 1; valid && i < count; i++) {
+        unsigned int transition = (unsigned int) keys[i * 3 + 2];
+        valid = keys[i * 3] > keys[(i - 1) * 3] &&
+            // eased by built in curves or beziers, never by other keyframes
+            (transition < TRANSITION_COUNT ||
+             (transition - TRANSITION_COUNT < custom_count && custom_curves[transition - TRANSITION_COUNT]->is_bezier));
+    }
+    if (!valid) {
+        LOG("{animate} WARNING: Keyframes must run from 0 to 1 with rising times and known transitions");
+        return NO_TRANSITION;
+    }
+
+    size_t bytes = sizeof(double) * 3 * count;
+    for (unsigned int i = 0; i < custom_count; i++) {
+        custom_curve *other = custom_curves[i];
+        if (!other->is_bezier && other->key_count == count && !memcmp(other->keys, keys, bytes)) {
+            return TRANSITION_COUNT + i;
+        }
+    }
+
+    custom_curve *c = (custom_curve *) TAG_MALLOC(MEMORY_TAG_ANIMATIONS, sizeof(custom_curve));
+    double *copy = (double *) TAG_MALLOC(MEMORY_TAG_ANIMATIONS, bytes);
+    if (!c || !copy) {
+        TAG_FREE(c);
+        TAG_FREE(copy);
+        return NO_TRANSITION;
+    }
+    memcpy(copy, keys, bytes);
+    c->is_bezier = false;
+    c->key_count = count;
+    c->keys = copy;
+    return add_custom_curve(c);
+}
+
+CEXPORT void view_animation_clear_transitions() {
+    for (unsigned int i = 0; i < custom_count; i++) {
+        TAG_FREE(custom_curves[i]->keys);
+        TAG_FREE(custom_curves[i]);
+        custom_curves[i] = NULL;
+    }
+    custom_count = 0;
+}
+
+// where each style property lives on the view. width, height and the
+// colors are always doubles and floats, the transform properties are
+// timestep_view_scalar, and the rest go through the view's setters
+enum style_prop_kinds {
+    PROP_DOUBLE,
+    PROP_FLOAT,
+    PROP_COLOR,         // a float from 0 to 1
+    PROP_Z_INDEX,
+    PROP_SPRITE_FRAME
+};
+
+typedef struct style_prop_field_t {
+    size_t offset;
+    unsigned char kind;
+} style_prop_field;
+
+#define STYLE_PROP_FIELD(prop) { offsetof(timestep_view, prop), sizeof(((timestep_view *) 0)->prop) == sizeof(double) ? PROP_DOUBLE : PROP_FLOAT }
+#define STYLE_PROP_COLOR(prop) { offsetof(timestep_view, prop), PROP_COLOR }
+static const style_prop_field style_prop_fields[STYLE_PROP_COUNT] = {
+    STYLE_PROP_FIELD(x),		// X
+    STYLE_PROP_FIELD(y),		// Y
+    STYLE_PROP_FIELD(width),	// WIDTH
+    STYLE_PROP_FIELD(height),	// HEIGHT
+    STYLE_PROP_FIELD(r),		// R
+    STYLE_PROP_FIELD(anchor_x),	// ANCHOR_X
+    STYLE_PROP_FIELD(anchor_y),	// ANCHOR_Y
+    STYLE_PROP_FIELD(opacity),	// OPACITY
+    STYLE_PROP_FIELD(scale),	// SCALE
+    STYLE_PROP_FIELD(scale_x),	// SCALE_X
+    STYLE_PROP_FIELD(scale_y),	// SCALE_Y
+    STYLE_PROP_FIELD(offset_x),	// OFFSET_X
+    STYLE_PROP_FIELD(offset_y),	// OFFSET_Y
+    { 0, PROP_Z_INDEX },		// Z_INDEX
+    STYLE_PROP_COLOR(background_color.r),	// BACKGROUND_R
+    STYLE_PROP_COLOR(background_color.g),	// BACKGROUND_G
+    STYLE_PROP_COLOR(background_color.b),	// BACKGROUND_B
+    STYLE_PROP_COLOR(background_color.a),	// BACKGROUND_A
+    STYLE_PROP_COLOR(filter_color.r),	// FILTER_R
+    STYLE_PROP_COLOR(filter_color.g),	// FILTER_G
+    STYLE_PROP_COLOR(filter_color.b),	// FILTER_B
+    STYLE_PROP_COLOR(filter_color.a),	// FILTER_A
+    { 0, PROP_SPRITE_FRAME }	// SPRITE_FRAME
+};
+
+// the properties that move the view's box in its superview
+#define BOX_PROP_MASK ((1 << X) | (1 << Y) | (1 << WIDTH) | (1 << HEIGHT) | (1 << R) | \
+                       (1 << ANCHOR_X) | (1 << ANCHOR_Y) | (1 << SCALE) | (1 << SCALE_X) | \
+                       (1 << SCALE_Y) | (1 << OFFSET_X) | (1 << OFFSET_Y))
+
+static inline double get_style_prop(timestep_view *v, unsigned int name) {
+    const style_prop_field *field = &style_prop_fields[name];
+    char *p = (char *) v + field->offset;
+    switch (field->kind) {
+    case PROP_DOUBLE:
+        return *(double *) p;
+    case PROP_Z_INDEX:
+        return v->z_index;
+    case PROP_SPRITE_FRAME:
+        return timestep_view_get_sprite_frame(v);
+    default:
+        return *(float *) p;
+    }
+}
+
+static inline void set_style_prop(timestep_view *v, unsigned int name, double value) {
+    const style_prop_field *field = &style_prop_fields[name];
+    char *p = (char *) v + field->offset;
+    switch (field->kind) {
+    case PROP_DOUBLE:
+        *(double *) p = value;
+        break;
+    case PROP_FLOAT:
+        *(float *) p = (float) value;
+        break;
+    case PROP_COLOR:
+        // overshooting curves would leave the channel's range
+        *(float *) p = value < 0 ? 0 : value > 1 ? 1 : (float) value;
+        break;
+    case PROP_Z_INDEX:
+        timestep_view_set_z_index(v, (int) lround(value));
+        return;
+    case PROP_SPRITE_FRAME:
+        timestep_view_set_sprite_frame(v, value > 0 ? (unsigned int) lround(value) : 0);
+        return;
+    }
+
+    timestep_view_damage(v);
+
+    if ((BOX_PROP_MASK & (1 << name)) && v->superview && v->superview->spatial_index) {
+        timestep_view_mark_moved(v);
+    }
+}
+
+// Single precision versions of the curves built on sin / cos / pow, the
+// polynomial curves are cheap enough in double precision
+
+#define PI_F 3.14159265f
+static inline float FN_EASE_IN_SINE_F (float n) {
+    return -cosf(n * (PI_F / 2)) + 1;
+}
+static inline float FN_EASE_OUT_SINE_F (float n) {
+    return sinf(n * (PI_F / 2));
+}
+static inline float FN_EASE_IN_OUT_SINE_F (float n) {
+    return -0.5f * (cosf(PI_F * n) - 1);
+}
+static inline float FN_EASE_IN_EXPO_F (float n) {
+    return exp2f(10 * (n - 1));
+}
+static inline float FN_EASE_OUT_EXPO_F (float n) {
+    return -exp2f(-10 * n) + 1;
+}
+static inline float FN_EASE_IN_OUT_EXPO_F (float n) {
+    n *= 2;
+    if (n < 1) return 0.5f * exp2f(10 * (n - 1));
+    --n;
+    return 0.5f * (-exp2f(-10 * n) + 2);
+}
+static inline float FN_EASE_IN_ELASTIC_F (float n) {
+    --n;
+    return -(exp2f(10 * n) * sinf((n - 0.075f) * (2 * PI_F) / 0.3f));
+}
+static inline float FN_EASE_OUT_ELASTIC_F (float n) {
+    return exp2f(-10 * n) * sinf((n - 0.075f) * (2 * PI_F) / 0.3f) + 1;
+}
+static inline float FN_EASE_IN_OUT_ELASTIC_F (float n) {
+    n *= 2;
+    --n;
+    if (n < 0) return -.5f * (exp2f(10 * n) * sinf((n - 0.1125f) * (2 * PI_F) / 0.45f));
+    return exp2f(-10 * n) * sinf((n - 0.1125f) * (2 * PI_F) / 0.45f) * .5f + 1;
+}
+
+static double apply_transition_float(unsigned int transition, double t) {
+    float n = (float) t;
+
+    // same end points as the exact curves
+    if (n <= 0 || n >= 1) {
+        return apply_transition(transition, t);
+    }
+
+    switch (transition) {
+    case EASE_IN_SINE:
+        return FN_EASE_IN_SINE_F(n);
+    case EASE_OUT_SINE:
+        return FN_EASE_OUT_SINE_F(n);
+    case EASE_IN_OUT_SINE:
+        return FN_EASE_IN_OUT_SINE_F(n);
+    case EASE_IN_EXPO:
+        return FN_EASE_IN_EXPO_F(n);
+    case EASE_OUT_EXPO:
+        return FN_EASE_OUT_EXPO_F(n);
+    case EASE_IN_OUT_EXPO:
+        return FN_EASE_IN_OUT_EXPO_F(n);
+    case EASE_IN_ELASTIC:
+        return FN_EASE_IN_ELASTIC_F(n);
+    case EASE_OUT_ELASTIC:
+        return FN_EASE_OUT_ELASTIC_F(n);
+    case EASE_IN_OUT_ELASTIC:
+        return FN_EASE_IN_OUT_ELASTIC_F(n);
+    default:
+        return apply_transition(transition, t);
+    }
+}
+
+// Lookup tables, built the first time a transition is eased with EASING_LUT
+#define DEFAULT_EASING_LUT_RESOLUTION 256
+
+static unsigned int default_easing_mode = EASING_EXACT;
+static unsigned int easing_lut_resolution = DEFAULT_EASING_LUT_RESOLUTION;
+static float *easing_luts[TRANSITION_COUNT];
+
+static void free_easing_luts() {
+    for (unsigned int i = 0; i < TRANSITION_COUNT; i++) {
+        TAG_FREE(easing_luts[i]);
+        easing_luts[i] = NULL;
+    }
+}
+
+/**
+ * @name	get_easing_lut
+ * @brief	gets the lookup table for the given transition, building it
+ * @param	transition - (unsigned int) transition to get the table for
+ * @retval	float* - easing_lut_resolution + 1 samples, or NULL on failure
+ */
+static float *get_easing_lut(unsigned int transition) {
+    float *lut = easing_luts[transition];
+    if (lut) {
+        return lut;
+    }
+
+    lut = (float *) TAG_MALLOC(MEMORY_TAG_ANIMATIONS, sizeof(float) * (easing_lut_resolution + 1));
+    if (!lut) {
+        LOG("{animate} WARNING: Unable to allocate easing table for transition %u", transition);
+        return NULL;
+    }
+
+    for (unsigned int i = 0; i <= easing_lut_resolution; i++) {
+        lut[i] = (float) apply_transition(transition, (double) i / easing_lut_resolution);
+    }
+
+    easing_luts[transition] = lut;
+    return lut;
+}
+
+static double apply_transition_lut(unsigned int transition, double t) {
+    float *lut = transition < TRANSITION_COUNT ? get_easing_lut(transition) : NULL;
+    if (!lut || t <= 0 || t >= 1) {
+        return apply_transition(transition, t);
+    }
+
+    double pos = t * easing_lut_resolution;
+    unsigned int i = (unsigned int) pos;
+    double f = pos - i;
+    return lut[i] + (lut[i + 1] - lut[i]) * f;
+}
+
+static inline double ease_with_mode(unsigned int mode, unsigned int transition, double t) {
+    switch (mode) {
+    case EASING_FLOAT:
+        return apply_transition_float(transition, t);
+    case EASING_LUT:
+        return apply_transition_lut(transition, t);
+    default:
+        return apply_transition(transition, t);
+    }
+}
+
+/**
+ * @name	ease
+ * @brief	evaluates a transition at t using the animation's easing mode
+ * @param	anim - (view_animation *) animation being ticked
+ * @param	transition - (unsigned int) transition to evaluate
+ * @param	t - (double) progress through the frame, 0 to 1
+ * @retval	double - eased progress
+ */
+static inline double ease(view_animation *anim, unsigned int transition, double t) {
+    unsigned int mode = anim->easing_mode == EASING_DEFAULT ? default_easing_mode : anim->easing_mode;
+    return ease_with_mode(mode, transition, t);
+}
+
+CEXPORT double view_animation_ease(unsigned int transition, double t, unsigned int easing_mode) {
+    return ease_with_mode(easing_mode == EASING_DEFAULT ? default_easing_mode : easing_mode, transition, t);
+}
+
+CEXPORT unsigned int view_animation_transition_count() {
+    return TRANSITION_COUNT;
+}
+
+CEXPORT void view_animation_set_default_easing(unsigned int easing_mode, unsigned int lut_resolution) {
+    if (easing_mode == EASING_DEFAULT || easing_mode > EASING_LUT) {
+        easing_mode = EASING_EXACT;
+    }
+    if (lut_resolution < 2) {
+        lut_resolution = DEFAULT_EASING_LUT_RESOLUTION;
+    }
+
+    default_easing_mode = easing_mode;
+    if (lut_resolution != easing_lut_resolution) {
+        free_easing_luts();
+        easing_lut_resolution = lut_resolution;
+    }
+}
+
+CEXPORT unsigned int view_animation_get_default_easing(unsigned int *lut_resolution) {
+    if (lut_resolution) {
+        *lut_resolution = easing_lut_resolution;
+    }
+    return default_easing_mode;
+}
+
+void view_animation_set_easing(view_animation *anim, unsigned int easing_mode) {
+    anim->easing_mode = easing_mode > EASING_LUT ? EASING_DEFAULT : easing_mode;
+}
+
+// While animations tick, style writes are collected per view and applied
+// together once every animation has run, so a view animated by several
+// animations has its properties written and its transform invalidated once
+typedef struct staged_view_t {
+    timestep_view *view;
+    unsigned int mask; // 1 << style prop for each staged value
+    double values[STYLE_PROP_COUNT];
+} staged_view;
+
+#define TRANSFORM_PROP_MASK ((1 << X) | (1 << Y) | (1 << R) | (1 << ANCHOR_X) | (1 << ANCHOR_Y) | \
+                             (1 << SCALE) | (1 << SCALE_X) | (1 << SCALE_Y) | (1 << OFFSET_X) | (1 << OFFSET_Y))
+
+static staged_view *staged_views = NULL;
+static unsigned int staged_count = 0;
+static unsigned int staged_size = 0;
+
+static inline double get_animated_prop(timestep_view *v, unsigned int name) {
+    if (v->anim_stage) {
+        staged_view *staged = &staged_views[v->anim_stage - 1];
+        if (staged->mask & (1 << name)) {
+            return staged->values[name];
+        }
+    }
+
+    return get_style_prop(v, name);
+}
+
+static inline void set_animated_prop(timestep_view *v, unsigned int name, double value) {
+    if (staging && !v->anim_stage) {
+        if (staged_count == staged_size) {
+            unsigned int size = staged_size ? staged_size * 2 : 64;
+            staged_view *new_views = (staged_view *) TAG_REALLOC(MEMORY_TAG_ANIMATIONS, staged_views, sizeof(staged_view) * size);
+            if (new_views) {
+                staged_views = new_views;
+                staged_size = size;
+            }
+        }
+
+        if (staged_count < staged_size) {
+            staged_view *staged = &staged_views[staged_count++];
+            staged->view = v;
+            staged->mask = 0;
+            v->anim_stage = staged_count;
+        }
+    }
+
+    if (!v->anim_stage) {
+        // not ticking, or out of memory
+        set_style_prop(v, name, value);
+        if (TRANSFORM_PROP_MASK & (1 << name)) {
+            v->transform_dirty = true;
+        }
+        return;
+    }
+
+    staged_view *staged = &staged_views[v->anim_stage - 1];
+    staged->mask |= 1 << name;
+    staged->values[name] = value;
+}
+
+/**
+ * @name	commit_staged_props
+ * @brief	writes the animated values collected so far to their views
+ * @retval	NONE
+ */
+static void commit_staged_props() {
+    for (unsigned int i = 0; i < staged_count; i++) {
+        staged_view *staged = &staged_views[i];
+        timestep_view *v = staged->view;
+        unsigned int mask = staged->mask;
+
+        for (unsigned int name = 0; mask >> name; name++) {
+            if (mask & (1 << name)) {
+                if (recording_interp) {
+                    record_interp(v, name, staged->values[name]);
+                }
+                set_style_prop(v, name, staged->values[name]);
+            }
+        }
+
+        if (mask & TRANSFORM_PROP_MASK) {
+            v->transform_dirty = true;
+        }
+        v->anim_stage = 0;
+    }
+
+    staged_count = 0;
+}
+
+// Fixed rate stepping. Without a fixed step every tick is a single step of
+// the tick's time. With one, time accumulates and animations advance in
+// whole steps; interpolation then records each view's values before and
+// after the last step and shows the blend for the time left over
+#define MAX_FIXED_STEPS_PER_TICK 4
+
+typedef struct interp_view_t {
+    timestep_view *view; // NULL once the view is deleted
+    unsigned int mask;
+    bool applied;
+    double prev[STYLE_PROP_COUNT];
+    double next[STYLE_PROP_COUNT];
+    double written[STYLE_PROP_COUNT];
+} interp_view;
+
+static double fixed_step = 0;
+static bool fixed_interpolate = false;
+static double fixed_accumulator = 0;
+static interp_view *interp_views = NULL;
+static unsigned int interp_count = 0;
+static unsigned int interp_size = 0;
+
+/**
+ * @name	record_interp
+ * @brief	records a committed animated value for interpolation
+ * @param	v - (timestep_view *) view the value is written to
+ * @param	name - (unsigned int) style prop being written
+ * @param	value - (double) value being written
+ * @retval	NONE
+ */
+static void record_interp(timestep_view *v, unsigned int name, double value) {
+    if (!v->anim_interp) {
+        if (interp_count == interp_size) {
+            unsigned int size = interp_size ? interp_size * 2 : 64;
+            interp_view *new_views = (interp_view *) TAG_REALLOC(MEMORY_TAG_ANIMATIONS, interp_views, sizeof(interp_view) * size);
+            if (!new_views) {
+                return;
+            }
+            interp_views = new_views;
+            interp_size = size;
+        }
+
+        interp_view *interp = &interp_views[interp_count++];
+        interp->view = v;
+        interp->mask = 0;
+        interp->applied = false;
+        v->anim_interp = interp_count;
+    }
+
+    interp_view *interp = &interp_views[v->anim_interp - 1];
+    // keep the value from before the step if the prop was already written
+    if (!(interp->mask & (1 << name))) {
+        interp->mask |= 1 << name;
+        interp->prev[name] = get_style_prop(v, name);
+    }
+    interp->next[name] = value;
+}
+
+static void clear_interp() {
+    for (unsigned int i = 0; i < interp_count; i++) {
+        if (interp_views[i].view) {
+            interp_views[i].view->anim_interp = 0;
+        }
+    }
+    interp_count = 0;
+}
+
+/**
+ * @name	restore_interp
+ * @brief	puts the stepped values back on the views, except where
+ *			something else wrote the property since it was interpolated
+ * @retval	NONE
+ */
+static void restore_interp() {
+    for (unsigned int i = 0; i < interp_count; i++) {
+        interp_view *interp = &interp_views[i];
+        timestep_view *v = interp->view;
+        if (!v || !interp->applied) {
+            continue;
+        }
+
+        for (unsigned int name = 0; interp->mask >> name; name++) {
+            if ((interp->mask & (1 << name)) && get_style_prop(v, name) == interp->written[name]) {
+                set_style_prop(v, name, interp->next[name]);
+            }
+        }
+        if (interp->mask & TRANSFORM_PROP_MASK) {
+            v->transform_dirty = true;
+        }
+        interp->applied = false;
+    }
+}
+
+static void apply_interp(double alpha) {
+    for (unsigned int i = 0; i < interp_count; i++) {
+        interp_view *interp = &interp_views[i];
+        timestep_view *v = interp->view;
+        if (!v) {
+            continue;
+        }
+
+        for (unsigned int name = 0; interp->mask >> name; name++) {
+            if (interp->mask & (1 << name)) {
+                set_style_prop(v, name, interp->prev[name] + (interp->next[name] - interp->prev[name]) * alpha);
+                // read back, the field may be a float
+                interp->written[name] = get_style_prop(v, name);
+            }
+        }
+        if (interp->mask & TRANSFORM_PROP_MASK) {
+            v->transform_dirty = true;
+        }
+        interp->applied = true;
+    }
+}
+
+void view_animation_forget_view(timestep_view *view) {
+    if (view->anim_interp) {
+        interp_views[view->anim_interp - 1].view = NULL;
+        view->anim_interp = 0;
+    }
+}
+
+CEXPORT void view_animation_set_fixed_step(double step, bool interpolate) {
+    restore_interp();
+    clear_interp();
+    fixed_step = step > 0 ? step : 0;
+    fixed_interpolate = fixed_step > 0 && interpolate;
+    fixed_accumulator = 0;
+}
+
+CEXPORT void view_animation_tick_animations_precise(double dt) {
+    LOGFN("view_animation_tick_animations_precise");
+
+    // animations and callbacks always see the stepped values
+    restore_interp();
+
+    if (fixed_step <= 0) {
+        step_animations(dt);
+        LOGFN("end view_animation_tick_animations_precise");
+        return;
+    }
+
+    fixed_accumulator += dt;
+    for (unsigned int steps = 0; fixed_accumulator >= fixed_step; steps++) {
+        // drop what a slow frame left over rather than fall further behind
+        if (steps == MAX_FIXED_STEPS_PER_TICK) {
+            fixed_accumulator = fmod(fixed_accumulator, fixed_step);
+            break;
+        }
+
+        // only the last step's changes are blended
+        if (fixed_interpolate) {
+            clear_interp();
+            recording_interp = true;
+        }
+        step_animations(fixed_step);
+        recording_interp = false;
+        fixed_accumulator -= fixed_step;
+    }
+
+    if (fixed_interpolate) {
+        apply_interp(fixed_accumulator / fixed_step);
+    }
+
+    LOGFN("end view_animation_tick_animations_precise");
+}
+
+CEXPORT void view_animation_tick_animations(long dt) {
+    PROFILE_ZONE("view_animation_tick_animations");
+    // the bindings only pass whole milliseconds. when that is this core
+    // tick's time, use the precise time so fractions are not lost each tick
+    double precise = core_get_tick_dt();
+    view_animation_tick_animations_precise(fabs(precise - dt) < 1 ? precise : dt);
+}
+
+// Parallel evaluation. Before the serial tick, style frames that only do
+// arithmetic this step are evaluated on worker threads: the animation must
+// be the only one on its view, and its current frame must be a style frame
+// that does not finish, so nothing is freed, unscheduled or called back.
+// Workers write their results into jobs, which the calling thread stages
+// once they are done; everything else ticks serially as usual
+#define PARALLEL_MIN_ANIMATIONS 256
+#define PARALLEL_CHUNK 64
+#define MAX_ANIMATION_WORKERS 8
+
+typedef struct parallel_job_t {
+    view_animation *anim;
+    double values[STYLE_PROP_COUNT];
+} parallel_job;
+
+static ThreadsThread workers[MAX_ANIMATION_WORKERS];
+static unsigned int worker_count = 0;
+static bool workers_running = false;
+static pthread_mutex_t worker_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t worker_wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t worker_done = PTHREAD_COND_INITIALIZER;
+static unsigned int worker_generation = 0;
+static unsigned int workers_busy = 0;
+
+static parallel_job *jobs = NULL;
+static unsigned int job_count = 0;
+static unsigned int job_size = 0;
+static unsigned int job_next = 0;
+static unsigned int job_total = 0; // jobs posted to the workers
+static double job_dt = 0;
+
+static void eval_job(parallel_job *job) {
+    view_animation *anim = job->anim;
+    anim_frame *frame = anim->frame_head;
+
+    anim->elapsed += job_dt;
+    double t = anim->elapsed / frame->duration;
+    double tt = ease(anim, frame->transition, t);
+
+    if (!frame->resolved) {
+        frame->resolved = true;
+        init_frame(frame, anim->view);
+    }
+
+    for (unsigned int i = 0; i < frame->prop_count; i++) {
+        const style_prop *prop = &frame->props[i];
+        if (prop->name < STYLE_PROP_COUNT) {
+            job->values[prop->name] = prop->delta * tt + prop->initial;
+        }
+    }
+}
+
+/**
+ * @name	run_jobs
+ * @brief	evaluates chunks of the posted jobs until none are left
+ * @retval	NONE
+ */
+static void run_jobs() {
+    for (;;) {
+        pthread_mutex_lock(&worker_mutex);
+        unsigned int start = job_next;
+        job_next = start + PARALLEL_CHUNK < job_total ? start + PARALLEL_CHUNK : job_total;
+        unsigned int end = job_next;
+        pthread_mutex_unlock(&worker_mutex);
+
+        if (start >= end) {
+            return;
+        }
+        for (unsigned int i = start; i < end; i++) {
+            eval_job(&jobs[i]);
+        }
+    }
+}
+
+static void animation_worker(void *param) {
+    unsigned int seen = 0;
+
+    pthread_mutex_lock(&worker_mutex);
+    for (;;) {
+        while (workers_running && seen == worker_generation) {
+            pthread_cond_wait(&worker_wake, &worker_mutex);
+        }
+        if (!workers_running) {
+            break;
+        }
+
+        seen = worker_generation;
+        workers_busy++;
+        pthread_mutex_unlock(&worker_mutex);
+
+        run_jobs();
+
+        pthread_mutex_lock(&worker_mutex);
+        if (--workers_busy == 0) {
+            pthread_cond_signal(&worker_done);
+        }
+    }
+    pthread_mutex_unlock(&worker_mutex);
+}
+
+static void stop_workers() {
+    if (!worker_count) {
+        return;
+    }
+
+    pthread_mutex_lock(&worker_mutex);
+    workers_running = false;
+    pthread_cond_broadcast(&worker_wake);
+    pthread_mutex_unlock(&worker_mutex);
+
+    for (unsigned int i = 0; i < worker_count; i++) {
+        threads_join_thread(&workers[i]);
+    }
+    worker_count = 0;
+
+    TAG_FREE(jobs);
+    jobs = NULL;
+    job_size = 0;
+}
+
+CEXPORT bool view_animation_reserve(unsigned int animations, unsigned int frames) {
+    bool ok = object_pool_reserve(view_animation_pool, animations);
+    ok = object_pool_reserve(frame_pool, frames) && ok;
+    if (!ok) {
+        LOG("{animate} WARNING: Could not reserve %u animations and %u frames", animations, frames);
+    }
+    return ok;
+}
+
+CEXPORT unsigned int view_animation_active_count() {
+    return active_count;
+}
+
+CEXPORT void view_animation_set_workers(unsigned int count) {
+    if (count > MAX_ANIMATION_WORKERS) {
+        count = MAX_ANIMATION_WORKERS;
+    }
+    if (count == worker_count) {
+        return;
+    }
+
+    stop_workers();
+
+    workers_running = true;
+    for (unsigned int i = 0; i < count; i++) {
+        // the tick waits on the workers, so they get the fast cores
+        workers[i] = threads_create_thread_with_priority(animation_worker, NULL,
+                                                         THREADS_PRIORITY_HIGH, THREADS_AFFINITY_PERFORMANCE);
+        if (workers[i] == THREADS_INVALID_THREAD) {
+            LOG("{animate} WARNING: Unable to start animation worker %u", i);
+            break;
+        }
+        worker_count++;
+    }
+
+    LOG("{animate} Evaluating animations on %u workers", worker_count);
+}
+
+CEXPORT void view_animation_set_hidden_mode(unsigned int mode, unsigned int interval) {
+    hidden_mode = mode > HIDDEN_ANIMATIONS_THROTTLE ? HIDDEN_ANIMATIONS_APPLY : mode;
+    hidden_interval = interval > 1 ? interval : 1;
+}
+
+/**
+ * @name	skip_style
+ * @brief	tests whether a style frame that isn't finishing can leave the
+ *			view alone this step, see view_animation_set_hidden_mode
+ * @param	view - (timestep_view *) view being animated
+ * @param	props - (const style_prop *) props the frame animates
+ * @param	count - (unsigned int) number of props
+ * @retval	bool - true to only advance the animation's time
+ */
+static bool skip_style(timestep_view *view, const style_prop *props, unsigned int count) {
+    if (hidden_mode == HIDDEN_ANIMATIONS_APPLY ||
+        (hidden_mode == HIDDEN_ANIMATIONS_THROTTLE && (hidden_step + view->uid) % hidden_interval == 0)) {
+        return false;
+    }
+
+    bool hidden = !view->visible;
+    if (!hidden && !view->opacity) {
+        // fading a view in has to show it
+        hidden = true;
+        for (unsigned int i = 0; i < count; i++) {
+            if (props[i].name == OPACITY) {
+                hidden = false;
+                break;
+            }
+        }
+    }
+
+    // a view's own culling is left out, its frame may be moving it into view
+    for (timestep_view *v = view->superview; v && !hidden; v = v->superview) {
+        hidden = !v->visible || !v->opacity || v->culled;
+    }
+    return hidden;
+}
+
+static inline bool can_tick_parallel(view_animation *anim, double dt) {
+    timestep_view *view = anim->view;
+    anim_frame *frame = anim->frame_head;
+    return view && view->anim_count == 1 && !anim->timeline && !anim->is_paused &&
+           frame && frame->type == STYLE_FRAME && anim->elapsed + dt < frame->duration &&
+           !skip_style(view, frame->props, frame->prop_count);
+}
+
+/**
+ * @name	tick_parallel
+ * @brief	evaluates the animations that can run on the workers and stages
+ *			their results, flagging them so the serial tick skips them
+ * @param	dt - (double) time to advance by in milliseconds
+ * @retval	NONE
+ */
+static void tick_parallel(double dt) {
+    if (!worker_count || active_count < PARALLEL_MIN_ANIMATIONS) {
+        return;
+    }
+
+    // a worker waking late must not see jobs while they are rebuilt
+    pthread_mutex_lock(&worker_mutex);
+    job_total = 0;
+    job_next = 0;
+    pthread_mutex_unlock(&worker_mutex);
+
+    if (job_size < active_count) {
+        parallel_job *new_jobs = (parallel_job *) TAG_REALLOC(MEMORY_TAG_ANIMATIONS, jobs, sizeof(parallel_job) * active_count);
+        if (!new_jobs) {
+            return;
+        }
+        jobs = new_jobs;
+        job_size = active_count;
+    }
+
+    job_count = 0;
+    for (unsigned int i = 0; i < active_count; i++) {
+        view_animation *anim = active_anims[i];
+        if (can_tick_parallel(anim, dt)) {
+            // tables are built lazily, so build them before the workers look
+            unsigned int mode = anim->easing_mode == EASING_DEFAULT ? default_easing_mode : anim->easing_mode;
+            if (mode == EASING_LUT && anim->frame_head->transition < TRANSITION_COUNT) {
+                get_easing_lut(anim->frame_head->transition);
+            }
+            jobs[job_count++].anim = anim;
+        }
+    }
+
+    if (job_count < PARALLEL_MIN_ANIMATIONS) {
+        return;
+    }
+
+    pthread_mutex_lock(&worker_mutex);
+    job_total = job_count;
+    job_dt = dt;
+    worker_generation++;
+    pthread_cond_broadcast(&worker_wake);
+    pthread_mutex_unlock(&worker_mutex);
+
+    // help out, then wait for chunks still being evaluated
+    run_jobs();
+
+    pthread_mutex_lock(&worker_mutex);
+    while (workers_busy > 0) {
+        pthread_cond_wait(&worker_done, &worker_mutex);
+    }
+    pthread_mutex_unlock(&worker_mutex);
+
+    for (unsigned int i = 0; i < job_count; i++) {
+        view_animation *anim = jobs[i].anim;
+        anim_frame *frame = anim->frame_head;
+        for (unsigned int p = 0; p < frame->prop_count; p++) {
+            unsigned int name = frame->props[p].name;
+            if (name < STYLE_PROP_COUNT) {
+                set_animated_prop(anim->view, name, jobs[i].values[name]);
+            }
+        }
+        anim->parallel_done = true;
+    }
+}
+
 // iterate over all the style properties in a frame and set
 // the initial value from the current view style
 static void init_frame(anim_frame *frame, timestep_view *v) {
     LOGFN("init_frame");
 
-    style_prop **head = &frame->prop_head;
-    style_prop *curr = *head;
-    while (curr) {
-        // copy the initial value from the view
-#define SET_INITIAL_PROP(name, prop) case name: curr->initial = v->prop; break;
-        switch (curr->name) {
-            SET_INITIAL_PROP(X, x)
-            SET_INITIAL_PROP(Y, y)
-            SET_INITIAL_PROP(WIDTH, width)
-            SET_INITIAL_PROP(HEIGHT, height)
-            SET_INITIAL_PROP(R, r)
-            SET_INITIAL_PROP(ANCHOR_X, anchor_x)
-            SET_INITIAL_PROP(ANCHOR_Y, anchor_y)
-            SET_INITIAL_PROP(OPACITY, opacity)
-            SET_INITIAL_PROP(SCALE, scale)
-            SET_INITIAL_PROP(SCALE_X, scale_x)
-            SET_INITIAL_PROP(SCALE_Y, scale_y)
+    for (unsigned int i = 0; i < frame->prop_count; i++) {
+        style_prop *curr = &frame->props[i];
+
+        // unknown properties are left alone, as before
+        if (curr->name >= STYLE_PROP_COUNT) {
+            continue;
         }
 
+        // copy the initial value from the view
+        curr->initial = get_animated_prop(v, curr->name);
+
         // if the prop is not a delta, we must compute the delta
         // WARNING: target/delta is a union, so target is not preserved
         if (curr->is_delta) {
@@ -551,8 +1774,6 @@ static void init_frame(anim_frame *frame, timestep_view *v) {
         } else {
             curr->delta = curr->target - curr->initial;
         }
-
-        LIST_ITERATE(head, curr);
     }
 
     LOGFN("end init_frame");
@@ -560,33 +1781,152 @@ static void init_frame(anim_frame *frame, timestep_view *v) {
 
 static void apply_frame(anim_frame *frame, timestep_view *view, double tt) {
     LOGFN("apply_frame");
-    style_prop **head = &frame->prop_head;
-    style_prop *curr = *head;
+
+    for (unsigned int i = 0; i < frame->prop_count; i++) {
+        const style_prop *curr = &frame->props[i];
+        if (curr->name < STYLE_PROP_COUNT) {
+            set_animated_prop(view, curr->name, curr->delta * tt + curr->initial);
+        }
+    }
+
+    LOGFN("end apply_frame");
+}
+
+anim_timeline *view_animation_compile(view_animation *anim) {
+    anim_frame **head = &anim->frame_head;
+    anim_frame *curr = *head;
+    unsigned int count = 0;
+
     while (curr) {
-        // copy the initial value from the view
-        //#define UPDATE_PROP(name, prop) case name: LOG("view prop is %i %f time %f delta %f initial %f", name, view->prop, tt, curr->delta, curr->initial); view->prop = curr->delta * tt + curr->initial; break;
-#define UPDATE_PROP(name, prop) case name: view->prop = curr->delta * tt + curr->initial; break;
-        switch (curr->name) {
-            UPDATE_PROP(X, x)
-            UPDATE_PROP(Y, y)
-            UPDATE_PROP(WIDTH, width)
-            UPDATE_PROP(HEIGHT, height)
-            UPDATE_PROP(R, r)
-            UPDATE_PROP(ANCHOR_X, anchor_x)
-            UPDATE_PROP(ANCHOR_Y, anchor_y)
-            UPDATE_PROP(OPACITY, opacity)
-            UPDATE_PROP(SCALE, scale)
-            UPDATE_PROP(SCALE_X, scale_x)
-            UPDATE_PROP(SCALE_Y, scale_y)
+        if (curr->type == FUNC_FRAME) {
+            LOG("{animate} WARNING: Can not compile an animation with callbacks into a timeline");
+            return NULL;
+        }
+        // a started frame has replaced its targets with deltas
+        if (curr->resolved) {
+            LOG("{animate} WARNING: Can not compile an animation that has already started");
+            return NULL;
+        }
+        count++;
+        LIST_ITERATE(head, curr);
+    }
+
+    anim_timeline *timeline = (anim_timeline *) TAG_MALLOC(MEMORY_TAG_ANIMATIONS, sizeof(anim_timeline) + sizeof(anim_timeline_frame) * (count ? count - 1 : 0));
+    if (!timeline) {
+        LOG("{animate} WARNING: Unable to allocate a timeline of %u frames", count);
+        return NULL;
+    }
+
+    timeline->ref_count = 1;
+    timeline->duration = 0;
+    timeline->frame_count = count;
+
+    unsigned int i = 0;
+    curr = *head;
+    while (curr) {
+        anim_timeline_frame *frame = &timeline->frames[i++];
+        frame->type = curr->type;
+        frame->duration = curr->duration;
+        frame->transition = curr->transition;
+        frame->prop_count = 0;
+
+        if (curr->type == STYLE_FRAME) {
+            for (unsigned int p = 0; p < curr->prop_count; p++) {
+                if (curr->props[p].name < STYLE_PROP_COUNT) {
+                    frame->props[frame->prop_count++] = curr->props[p];
+                }
+            }
         }
 
+        timeline->duration += curr->duration;
         LIST_ITERATE(head, curr);
     }
 
-    LOGFN("end apply_frame");
+    return timeline;
+}
+
+void anim_timeline_release(anim_timeline *timeline) {
+    if (timeline && --timeline->ref_count == 0) {
+        TAG_FREE(timeline);
+    }
+}
+
+void view_animation_play(view_animation *anim, anim_timeline *timeline) {
+    LOGFN("view_animation_play");
+
+    view_animation_clear(anim);
+    if (!timeline || !timeline->frame_count) {
+        return;
+    }
+
+    timeline->ref_count++;
+    anim->timeline = timeline;
+    anim->timeline_frame = 0;
+    anim->timeline_resolved = false;
+
+    view_animation_schedule(anim);
+    set_in_group(anim, true);
+
+    LOGFN("end view_animation_play");
+}
+
+/**
+ * @name	tick_timeline
+ * @brief	plays the animation's timeline up to its elapsed time, dropping
+ *			the timeline once every frame has finished
+ * @param	anim - (view_animation *) animation playing the timeline
+ * @param	view - (timestep_view *) view being animated
+ * @retval	bool - true if the timeline finished, leaving anim->elapsed
+ *			past its end
+ */
+static bool tick_timeline(view_animation *anim, timestep_view *view) {
+    anim_timeline *timeline = anim->timeline;
+
+    while (anim->timeline_frame < timeline->frame_count) {
+        const anim_timeline_frame *frame = &timeline->frames[anim->timeline_frame];
+        bool frame_finished = anim->elapsed >= frame->duration;
+        double t = frame_finished ? 1 : ((double) anim->elapsed) / frame->duration;
+        double tt = frame_finished ? 1 : ease(anim, frame->transition, t);
+
+        if (frame_finished) {
+            anim->elapsed -= frame->duration;
+        }
+
+        if (frame->type == STYLE_FRAME) {
+            // tween from wherever the view is when the frame starts
+            if (!anim->timeline_resolved) {
+                anim->timeline_resolved = true;
+                for (unsigned int i = 0; i < frame->prop_count; i++) {
+                    anim->timeline_initial[i] = get_animated_prop(view, frame->props[i].name);
+                }
+            }
+
+            if (!frame_finished && skip_style(view, frame->props, frame->prop_count)) {
+                return false;
+            }
+
+            for (unsigned int i = 0; i < frame->prop_count; i++) {
+                const style_prop *prop = &frame->props[i];
+                double initial = anim->timeline_initial[i];
+                double delta = prop->is_delta ? prop->target : prop->target - initial;
+                set_animated_prop(view, prop->name, delta * tt + initial);
+            }
+        }
+
+        if (!frame_finished) {
+            return false;
+        }
+
+        anim->timeline_frame++;
+        anim->timeline_resolved = false;
+    }
+
+    anim->timeline = NULL;
+    anim_timeline_release(timeline);
+    return true;
 }
 
-static void view_animation_tick(view_animation *anim, long dt) {
+static void view_animation_tick(view_animation *anim, double dt) {
     LOGFN("view_animation_tick");
 
     if (!anim->is_scheduled) {
@@ -597,7 +1937,7 @@ static void view_animation_tick(view_animation *anim, long dt) {
     if (!view) {
         LOG("WARNING: Animation tick terminated early because view died");
         view_animation_unschedule(anim);
-        def_animate_remove_from_group(anim->js_anim);
+        set_in_group(anim, false);
         return;
     }
 
@@ -605,12 +1945,19 @@ static void view_animation_tick(view_animation *anim, long dt) {
     anim_frame *frame = anim->frame_head;
     anim->elapsed += dt;
 
+    if (anim->timeline) {
+        if (!tick_timeline(anim, view)) {
+            return;
+        }
+        frame = anim->frame_head;
+    }
+
     //LOG("/ticking anim for %i it's a %i", view->uid, frame->type);
     while (frame) {
         unsigned int cur_frame_id = frame->id;
         bool frame_finished = anim->elapsed >= frame->duration;
         double t = frame_finished ? 1 : ((double) anim->elapsed) / frame->duration;
-        double tt = frame_finished ? 1 : apply_transition(frame, t);
+        double tt = frame_finished ? 1 : ease(anim, frame->transition, t);
 
         if (frame_finished) {
             anim->elapsed -= frame->duration;
@@ -631,12 +1978,16 @@ static void view_animation_tick(view_animation *anim, long dt) {
 
             // iterate over all the style properties
             //LOG("applying %p", frame);
-            apply_frame(frame, view, tt);
+            if (frame_finished || !skip_style(view, frame->props, frame->prop_count)) {
+                apply_frame(frame, view, tt);
+            }
             break;
         case FUNC_FRAME:
             //LOG("calling func frame %i %i", dt);
             //WARN: If the callback calls clear then you can potentially get the
             //same frame pointer back if any animate's are called thereafter.
+            //JS sees every write made so far this tick.
+            commit_staged_props();
             def_animate_cb(view->js_view, frame->cb, tt, t);
             break;
         default:
@@ -665,13 +2016,86 @@ static void view_animation_tick(view_animation *anim, long dt) {
     }
 
     view_animation_unschedule(anim);
-    def_animate_remove_from_group(anim->js_anim);
+    set_in_group(anim, false);
     LOGFN("end view_animation_tick");
 }
 
+CEXPORT void view_animation_stress(timestep_view *view, unsigned int anims_per_frame, unsigned int frames) {
+    if (!view || !anims_per_frame) {
+        return;
+    }
+
+    view_animation **anims = (view_animation **) malloc(sizeof(view_animation *) * anims_per_frame);
+    if (!anims) {
+        LOG("{animate} WARNING: Unable to allocate %u animations for the stress test", anims_per_frame);
+        return;
+    }
+
+    unsigned int start_count = view->anim_count;
+    PROFILE_ZONE("view_animation_stress");
+    long long start = profiler_now();
+
+    for (unsigned int f = 0; f < frames; f++) {
+        for (unsigned int i = 0; i < anims_per_frame; i++) {
+            view_animation *anim = view_animation_init(view);
+            anim_frame *frame = anim_frame_get();
+            frame->type = STYLE_FRAME;
+            frame->duration = 1000;
+            frame->transition = EASE_IN_OUT;
+
+            style_prop *prop = anim_frame_add_style_prop(frame);
+            prop->name = X;
+            prop->target = view->x;
+
+            // schedule directly rather than through then, which would
+            // hand the animation's missing JS object to its group
+            LIST_ADD(&anim->frame_head, frame);
+            view_animation_schedule(anim);
+            anims[i] = anim;
+        }
+
+        view_animation_tick_animations_precise(16);
+
+        // release from the middle out, so most removals are not the last slot
+        for (unsigned int i = 0; i < anims_per_frame; i++) {
+            unsigned int j = (i & 1) ? anims_per_frame / 2 + i / 2 : anims_per_frame / 2 - 1 - i / 2;
+            view_animation_release(anims[j < anims_per_frame ? j : i]);
+        }
+    }
+
+    LOG("{animate} Stress test churned %u animations a frame for %u frames in %.2fms",
+        anims_per_frame, frames, (profiler_now() - start) / 1000000.0);
+    free(anims);
+
+    if (view->anim_count != start_count) {
+        LOG("{animate} WARNING: Stress test left %u animations on view %i", view->anim_count - start_count, view->uid);
+    }
+}
+
 CEXPORT void view_animation_shutdown() {
     // Remove all animations
-    while (global_head) {
-        view_animation_release(global_head);
+    while (active_count) {
+        view_animation_release(active_anims[active_count - 1]);
+    }
+    while (pending_count) {
+        view_animation_release(pending_anims[pending_count - 1]);
     }
+
+    stop_workers();
+    free_easing_luts();
+    view_animation_clear_transitions();
+    clear_interp();
+    TAG_FREE(interp_views);
+    interp_views = NULL;
+    interp_size = 0;
+    TAG_FREE(group_changes);
+    group_changes = NULL;
+    group_change_size = 0;
+    TAG_FREE(staged_views);
+    staged_views = NULL;
+    staged_size = 0;
+    TAG_FREE(active_anims);
+    TAG_FREE(pending_anims);
+    active_anims = pending_anims = NULL;
+    active_size = pending_size = 0;
 }
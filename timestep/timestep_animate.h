@@ -47,7 +47,49 @@ void view_animation_then(view_animation *anim, anim_frame *frame, unsigned int d
 //put a 'wait' duration milliseconds  on the queue
 void view_animation_wait(view_animation *anim, unsigned int duration);
 
+//compile the frames queued on an animation into a timeline, leaving the
+//animation untouched. Release the returned timeline when done with it
+anim_timeline *view_animation_compile(view_animation *anim);
+//release a reference to a timeline
+void anim_timeline_release(anim_timeline *timeline);
+//clear the animation and start playing the timeline on it now
+void view_animation_play(view_animation *anim, anim_timeline *timeline);
+
+//choose how easing curves are evaluated for a single animation
+void view_animation_set_easing(view_animation *anim, unsigned int easing_mode);
+
 CEXPORT void view_animation_tick_animations(long dt);
+//tick animations by a precise time in milliseconds. view_animation_tick_animations
+//uses core_get_tick_dt when dt is the current core tick's time
+CEXPORT void view_animation_tick_animations_precise(double dt);
+//step animations at a fixed rate of one step every step milliseconds, 0 to
+//step by whatever time each tick is given. With interpolate, views show
+//their animated values blended between the last two steps
+CEXPORT void view_animation_set_fixed_step(double step, bool interpolate);
+//what style frames of animations on hidden views do: a view is hidden when
+//it or a superview is invisible, a superview is transparent or was culled
+//on the last render, or it is transparent itself and the frame leaves its
+//opacity alone. Finished frames always apply their end values, and func
+//frames fire on schedule whatever the mode
+enum hidden_animation_modes {
+  HIDDEN_ANIMATIONS_APPLY,    // apply every tick, as for visible views
+  HIDDEN_ANIMATIONS_SKIP,     // only advance time until the view shows again
+  HIDDEN_ANIMATIONS_THROTTLE  // apply every interval ticks
+};
+CEXPORT void view_animation_set_hidden_mode(unsigned int mode, unsigned int interval);
+//evaluate style frames on this many worker threads when enough animations
+//are running, 0 to always tick on the calling thread
+CEXPORT void view_animation_set_workers(unsigned int count);
+//pre-allocate room for this many animations and frames so a scene can be
+//built without the pools growing mid-game
+CEXPORT bool view_animation_reserve(unsigned int animations, unsigned int frames);
+//drop any reference the animation system holds to a view being deleted
+void view_animation_forget_view(struct timestep_view_t *view);
+
+//stress test: every frame, start anims_per_frame animations on the view,
+//tick once and release them all again in a scattered order. Ticks every
+//scheduled animation, so run it without other animations in flight
+CEXPORT void view_animation_stress(struct timestep_view_t *view, unsigned int anims_per_frame, unsigned int frames);
 
 // Shutdown subsystem
 CEXPORT void view_animation_shutdown();
@@ -0,0 +1,456 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+ 
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+ 
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 timestep_bench.cpp
+ * @brief	times renders of synthetic view trees
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "core/timestep/timestep_bench.h"
+#include "core/timestep/timestep_view.h"
+#include "core/timestep/timestep_image_map.h"
+#include "core/tealeaf_canvas.h"
+#include "core/tealeaf_context.h"
+#include "core/texture_manager.h"
+#include "core/draw_textures.h"
+#include "core/log.h"
+#include "core/deps/jansson/jansson.h"
+#include "platform/gl.h"
+
+#define IMAGE_SIZE 32
+#define NESTED_IMAGE_SIZE 16
+#define ROW_HEIGHT 40
+#define SCROLL_SPEED 3 // points a frame
+
+static const char *m_scene_names[BENCH_SCENE_COUNT] = {
+    "sprites", "nested", "scroll", "textures"
+};
+
+typedef struct bench_scene_t {
+    timestep_view *root;
+    timestep_view *scroller; // content the scroll scene moves
+    timestep_view **views; // every view but the root, to move and delete
+    unsigned int view_count;
+    timestep_image_map **maps;
+    unsigned int map_count;
+    texture_2d **textures;
+    unsigned int texture_count;
+    unsigned int random;
+} bench_scene;
+
+static double now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static unsigned int next_random(bench_scene *scene) {
+    unsigned int r = scene->random;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    scene->random = r;
+    return r;
+}
+
+/**
+ * @name	make_textures
+ * @brief	creates the scene's textures from generated pixels, each a
+ *			different color with a transparent border so blending is real
+ * @param	scene - (bench_scene *) scene to add them to
+ * @param	count - (unsigned int) textures to create
+ * @retval	bool - false if they couldn't all be made
+ */
+static bool make_textures(bench_scene *scene, unsigned int count) {
+    scene->textures = (texture_2d **) calloc(count, sizeof(texture_2d *));
+    unsigned char *pixels = (unsigned char *) malloc(IMAGE_SIZE * IMAGE_SIZE * 4);
+    if (!scene->textures || !pixels) {
+        free(pixels);
+        return false;
+    }
+
+    texture_manager *manager = texture_manager_get();
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned int color = next_random(scene);
+        for (int y = 0; y < IMAGE_SIZE; y++) {
+            for (int x = 0; x < IMAGE_SIZE; x++) {
+                unsigned char *p = &pixels[(y * IMAGE_SIZE + x) * 4];
+                bool edge = x < 2 || y < 2 || x >= IMAGE_SIZE - 2 || y >= IMAGE_SIZE - 2;
+                unsigned char a = edge ? 0 : 255;
+                // premultiplied, like decoded images
+                p[0] = (unsigned char) (((color & 0xff) * a) / 255);
+                p[1] = (unsigned char) ((((color >> 8) & 0xff) * a) / 255);
+                p[2] = (unsigned char) ((((color >> 16) & 0xff) * a) / 255);
+                p[3] = a;
+            }
+        }
+        texture_2d *tex = texture_manager_new_texture_from_data(manager, IMAGE_SIZE, IMAGE_SIZE, pixels);
+        if (!tex) {
+            break;
+        }
+        scene->textures[scene->texture_count++] = tex;
+    }
+    free(pixels);
+    return scene->texture_count == count;
+}
+
+/**
+ * @name	add_view
+ * @brief	creates a view under superview, drawing the next texture if
+ *			there is room for an image map
+ * @param	scene - (bench_scene *) scene the view belongs to
+ * @param	superview - (timestep_view *) parent of the view
+ * @param	image - (bool) make it an image view
+ * @param	x - (double) position in the superview
+ * @param	y - (double) position in the superview
+ * @param	width - (double) size of the view
+ * @param	height - (double) size of the view
+ * @retval	timestep_view* - the view, or NULL if it couldn't be made
+ */
+static timestep_view *add_view(bench_scene *scene, timestep_view *superview, bool image, double x, double y, double width, double height) {
+    timestep_view *v = timestep_view_init();
+    if (!v) {
+        return NULL;
+    }
+    scene->views[scene->view_count++] = v;
+    v->x = x;
+    v->y = y;
+    v->width = width;
+    v->height = height;
+    timestep_view_add_subview(superview, v);
+
+    if (image && scene->texture_count) {
+        timestep_image_map *map = timestep_image_map_init();
+        texture_2d *tex = scene->textures[scene->map_count % scene->texture_count];
+        timestep_image_map_set_url(map, tex->url);
+        map->x = 0;
+        map->y = 0;
+        map->width = IMAGE_SIZE;
+        map->height = IMAGE_SIZE;
+        map->margin_top = map->margin_right = map->margin_bottom = map->margin_left = 0;
+        map->sheet_width = IMAGE_SIZE;
+        map->sheet_height = IMAGE_SIZE;
+        scene->maps[scene->map_count++] = map;
+        v->view_data = map;
+        timestep_view_set_type(v, IMAGE_VIEW);
+    }
+    return v;
+}
+
+/**
+ * @name	build_scene
+ * @brief	makes the views and textures of the chosen scene
+ * @param	scene - (bench_scene *) cleared scene to fill
+ * @param	opts - (const timestep_bench_options *) what to build
+ * @retval	bool - false if something couldn't be allocated
+ */
+static bool build_scene(bench_scene *scene, const timestep_bench_options *opts) {
+    unsigned int count = opts->count;
+    unsigned int textures = opts->scene == BENCH_SCENE_TEXTURES ? count : opts->textures;
+    // the scroll list's rows have a background, a content view and an icon
+    unsigned int views = opts->scene == BENCH_SCENE_SCROLL ? count * 2 + 2 : count;
+
+    scene->random = opts->seed ? opts->seed : 1;
+    scene->root = timestep_view_init();
+    scene->views = (timestep_view **) calloc(views, sizeof(timestep_view *));
+    scene->maps = (timestep_image_map **) calloc(count, sizeof(timestep_image_map *));
+    if (!scene->root || !scene->views || !scene->maps || !make_textures(scene, textures ? textures : 1)) {
+        return false;
+    }
+    scene->root->width = opts->width;
+    scene->root->height = opts->height;
+
+    float w = opts->width, h = opts->height;
+    switch (opts->scene) {
+    case BENCH_SCENE_SPRITES:
+    case BENCH_SCENE_TEXTURES:
+        for (unsigned int i = 0; i < count; i++) {
+            double x = next_random(scene) % (unsigned int) (w - IMAGE_SIZE);
+            double y = next_random(scene) % (unsigned int) (h - IMAGE_SIZE);
+            if (!add_view(scene, scene->root, true, x, y, IMAGE_SIZE, IMAGE_SIZE)) {
+                return false;
+            }
+        }
+        break;
+
+    case BENCH_SCENE_NESTED: {
+        // each level sits a little inside its parent and turns a little
+        timestep_view *parent = scene->root;
+        for (unsigned int i = 0; i < count; i++) {
+            timestep_view *v = add_view(scene, parent, true, i ? 1 : w / 2, i ? 1 : h / 2, NESTED_IMAGE_SIZE, NESTED_IMAGE_SIZE);
+            if (!v) {
+                return false;
+            }
+            v->r = 0.01;
+            parent = v;
+        }
+        break;
+    }
+
+    case BENCH_SCENE_SCROLL: {
+        timestep_view *list = add_view(scene, scene->root, false, 0, 0, w, h);
+        scene->scroller = list ? add_view(scene, list, false, 0, 0, w, (double) count * ROW_HEIGHT) : NULL;
+        if (!scene->scroller) {
+            return false;
+        }
+        list->clip = true;
+
+        for (unsigned int i = 0; i < count; i++) {
+            timestep_view *row = add_view(scene, scene->scroller, false, 0, (double) i * ROW_HEIGHT, w, ROW_HEIGHT - 2);
+            if (!row || !add_view(scene, row, true, 4, 4, ROW_HEIGHT - 10, ROW_HEIGHT - 10)) {
+                return false;
+            }
+            rgba background = {0.2f, 0.2f, 0.25f, 1};
+            row->background_color = background;
+        }
+        break;
+    }
+    }
+    return true;
+}
+
+/**
+ * @name	animate_scene
+ * @brief	moves the scene's views the way its kind of game would
+ * @param	scene - (bench_scene *) scene to move
+ * @param	opts - (const timestep_bench_options *) what was built
+ * @param	frame - (unsigned int) frame about to be drawn
+ * @retval	NONE
+ */
+static void animate_scene(bench_scene *scene, const timestep_bench_options *opts, unsigned int frame) {
+    switch (opts->scene) {
+    case BENCH_SCENE_SPRITES:
+    case BENCH_SCENE_TEXTURES:
+        for (unsigned int i = 0; i < scene->view_count; i++) {
+            timestep_view *v = scene->views[i];
+            v->x += (i + frame) & 1 ? 1 : -1;
+        }
+        break;
+
+    case BENCH_SCENE_NESTED:
+        // turning the top turns the whole chain
+        scene->views[0]->r += 0.01;
+        break;
+
+    case BENCH_SCENE_SCROLL: {
+        double range = scene->scroller->height - opts->height;
+        double y = range > 0 ? fmod((double) frame * SCROLL_SPEED, range) : 0;
+        scene->scroller->y = -y;
+        break;
+    }
+    }
+}
+
+static void free_scene(bench_scene *scene) {
+    // leaves before parents, so nothing is detached twice
+    for (unsigned int i = scene->view_count; i > 0; i--) {
+        timestep_view_delete(scene->views[i - 1]);
+    }
+    if (scene->root) {
+        timestep_view_delete(scene->root);
+    }
+    for (unsigned int i = 0; i < scene->map_count; i++) {
+        timestep_image_delete(scene->maps[i]);
+    }
+    texture_manager *manager = texture_manager_get();
+    for (unsigned int i = 0; i < scene->texture_count; i++) {
+        texture_manager_free_texture(manager, scene->textures[i]);
+    }
+    free(scene->views);
+    free(scene->maps);
+    free(scene->textures);
+}
+
+/**
+ * @name	timestep_bench_subviews
+ * @brief	times adding count views to a parent in z order and sorting them
+ *			again after their z indexes change
+ * @param	count - (unsigned int) subviews to add
+ * @param	seed - (unsigned int) for the z indexes
+ * @param	add_ms - (double *) receives the time the adds took
+ * @param	sort_ms - (double *) receives the time the sort took
+ * @retval	bool - false if the views couldn't be made
+ */
+CEXPORT bool timestep_bench_subviews(unsigned int count, unsigned int seed, double *add_ms, double *sort_ms) {
+    bench_scene scene;
+    memset(&scene, 0, sizeof(scene));
+    scene.random = seed ? seed : 1;
+    scene.root = timestep_view_init();
+    scene.views = (timestep_view **) calloc(count, sizeof(timestep_view *));
+    bool ok = scene.root && scene.views;
+    for (unsigned int i = 0; ok && i < count; i++) {
+        timestep_view *v = timestep_view_init();
+        ok = v != NULL;
+        if (ok) {
+            v->z_index = (int) (next_random(&scene) % 1000);
+            scene.views[scene.view_count++] = v;
+        }
+    }
+    if (!ok) {
+        free_scene(&scene);
+        return false;
+    }
+
+    double start = now_ms();
+    for (unsigned int i = 0; i < count; i++) {
+        timestep_view_add_subview(scene.root, scene.views[i]);
+    }
+    *add_ms = now_ms() - start;
+
+    for (unsigned int i = 0; i < count; i++) {
+        scene.views[i]->z_index = (int) (next_random(&scene) % 1000);
+    }
+    scene.root->dirty_z_index = true;
+    start = now_ms();
+    timestep_view_sort_subviews(scene.root);
+    *sort_ms = now_ms() - start;
+
+    free_scene(&scene);
+    return true;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+/**
+ * @name	timestep_bench_default_options
+ * @brief	fills in options for a sprite flood of 1000 views on a 1280x720
+ *			target, drawn 300 times after 30 frames of warm up
+ * @param	opts - (timestep_bench_options *) options to fill
+ * @retval	NONE
+ */
+CEXPORT void timestep_bench_default_options(timestep_bench_options *opts) {
+    memset(opts, 0, sizeof(*opts));
+    opts->scene = BENCH_SCENE_SPRITES;
+    opts->count = 1000;
+    opts->textures = 1;
+    opts->frames = 300;
+    opts->warmup = 30;
+    opts->width = 1280;
+    opts->height = 720;
+    opts->animate = true;
+    opts->seed = 1;
+}
+
+CEXPORT const char *timestep_bench_scene_name(int scene) {
+    return scene >= 0 && scene < BENCH_SCENE_COUNT ? m_scene_names[scene] : NULL;
+}
+
+CEXPORT int timestep_bench_find_scene(const char *name) {
+    for (int i = 0; i < BENCH_SCENE_COUNT; i++) {
+        if (!strcmp(name, m_scene_names[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @name	timestep_bench_run
+ * @brief	builds the scene, draws the warm up and timed frames into an
+ *			offscreen context, waiting for the gpu after each, and reports
+ *			the frame times, draw calls, quads and allocations per frame
+ * @param	opts - (const timestep_bench_options *) what to draw
+ * @retval	char* - JSON report, freed by the caller, or NULL on failure
+ */
+CEXPORT char *timestep_bench_run(const timestep_bench_options *opts) {
+    if (opts->scene < 0 || opts->scene >= BENCH_SCENE_COUNT || !opts->count || !opts->frames ||
+        opts->width <= IMAGE_SIZE || opts->height <= IMAGE_SIZE) {
+        LOG("{bench} WARNING: Invalid options");
+        return NULL;
+    }
+
+    bench_scene scene;
+    memset(&scene, 0, sizeof(scene));
+    double *times = (double *) malloc(sizeof(double) * opts->frames);
+    context_2d *ctx = context_2d_acquire_scratch(tealeaf_canvas_get(), opts->width, opts->height);
+    if (!times || !ctx || !build_scene(&scene, opts)) {
+        LOG("{bench} WARNING: Unable to build the %s scene", m_scene_names[opts->scene]);
+        free_scene(&scene);
+        free(times);
+        if (ctx) {
+            context_2d_release_scratch(ctx);
+        }
+        return NULL;
+    }
+
+    // views with a JS render would need these, the scenes have none
+    JS_OBJECT_WRAPPER none = JS_OBJECT_WRAPPER();
+    unsigned long long flushes = 0, quads = 0, allocs = 0;
+
+    // whatever was drawn before belongs to no frame of ours
+    context_2d_flush(ctx);
+    draw_textures_end_frame();
+    for (unsigned int frame = 0; frame < opts->warmup + opts->frames; frame++) {
+        if (opts->animate) {
+            animate_scene(&scene, opts, frame);
+        }
+
+        unsigned long long alloc_start = opts->alloc_count ? opts->alloc_count() : 0;
+        double start = now_ms();
+        context_2d_clear(ctx);
+        timestep_view_start_render();
+        timestep_view_wrap_render(scene.root, ctx, none, none);
+        context_2d_flush(ctx);
+        glFinish();
+        double elapsed = now_ms() - start;
+        unsigned long long alloc_end = opts->alloc_count ? opts->alloc_count() : 0;
+
+        draw_textures_end_frame();
+        if (frame >= opts->warmup) {
+            const draw_textures_stats *stats = draw_textures_get_stats();
+            times[frame - opts->warmup] = elapsed;
+            flushes += stats->flushes;
+            quads += stats->quads;
+            allocs += alloc_end - alloc_start;
+        }
+    }
+
+    double total = 0;
+    for (unsigned int i = 0; i < opts->frames; i++) {
+        total += times[i];
+    }
+    qsort(times, opts->frames, sizeof(double), compare_doubles);
+
+    json_t *report = json_object();
+    json_object_set_new(report, "scene", json_string(m_scene_names[opts->scene]));
+    json_object_set_new(report, "count", json_integer(opts->count));
+    json_object_set_new(report, "views", json_integer(scene.view_count + 1));
+    json_object_set_new(report, "textures", json_integer(scene.texture_count));
+    json_object_set_new(report, "width", json_integer(opts->width));
+    json_object_set_new(report, "height", json_integer(opts->height));
+    json_object_set_new(report, "frames", json_integer(opts->frames));
+    json_object_set_new(report, "mean", json_real(total / opts->frames));
+    json_object_set_new(report, "p50", json_real(times[opts->frames / 2]));
+    json_object_set_new(report, "p95", json_real(times[(opts->frames - 1) * 95 / 100]));
+    json_object_set_new(report, "max", json_real(times[opts->frames - 1]));
+    json_object_set_new(report, "drawCalls", json_real((double) flushes / opts->frames));
+    json_object_set_new(report, "quads", json_real((double) quads / opts->frames));
+    json_object_set_new(report, "allocations", opts->alloc_count ? json_real((double) allocs / opts->frames) : json_null());
+
+    char *str = json_dumps(report, JSON_COMPACT);
+    json_decref(report);
+
+    free_scene(&scene);
+    free(times);
+    context_2d_release_scratch(ctx);
+    return str;
+}
@@ -0,0 +1,67 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+ 
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+ 
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef TIMESTEP_BENCH_H
+#define TIMESTEP_BENCH_H
+
+#include "core/util/detect.h"
+#include "core/types.h"
+
+// Renders synthetic view trees built through the timestep_view API into an
+// offscreen context and times each frame, for tracking renderer performance
+// across builds. Needs a current gl context with core_init_gl done, and uses
+// the draw_textures frame statistics, so it runs between ticks or from
+// bench/render_bench.c, which makes a headless context for it. Scenes use
+// textures generated in memory, so no assets are needed.
+
+enum timestep_bench_scenes {
+	BENCH_SCENE_SPRITES,    // count image views scattered over the target
+	BENCH_SCENE_NESTED,     // a chain count views deep, each drawing an image
+	BENCH_SCENE_SCROLL,     // a clipped list of count rows scrolling by
+	BENCH_SCENE_TEXTURES,   // count image views, each with its own texture
+	BENCH_SCENE_COUNT
+};
+
+typedef struct timestep_bench_options_t {
+	int scene;
+	unsigned int count;
+	unsigned int textures;  // textures the views share, scenes other than textures
+	unsigned int frames;    // frames timed
+	unsigned int warmup;    // frames drawn before timing starts
+	int width;              // size of the render target
+	int height;
+	bool animate;           // move views between frames, as a game would
+	unsigned int seed;      // for the scattered positions
+	// allocations made so far by the process, NULL to leave them out
+	unsigned long long (*alloc_count)();
+} timestep_bench_options;
+
+// defaults for everything, a sprite flood of 1000 views
+CEXPORT void timestep_bench_default_options(timestep_bench_options *opts);
+// name of a scene for the report, or NULL
+CEXPORT const char *timestep_bench_scene_name(int scene);
+// scene named by name, or -1
+CEXPORT int timestep_bench_find_scene(const char *name);
+// builds the scene, draws it and tears it down again. The report is JSON,
+// with times in milliseconds, freed by the caller, or NULL if the scene
+// couldn't be built
+CEXPORT char *timestep_bench_run(const timestep_bench_options *opts);
+
+// for bench/micro_bench.c: adds count views with scattered z indexes to a
+// new parent one at a time, then scatters the z indexes again in place, as
+// the bindings write them, and sorts. Gives the milliseconds each step took
+CEXPORT bool timestep_bench_subviews(unsigned int count, unsigned int seed, double *add_ms, double *sort_ms);
+
+#endif // TIMESTEP_BENCH_H
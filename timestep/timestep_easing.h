@@ -0,0 +1,51 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+ 
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+ 
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef TIMESTEP_EASING_H
+#define TIMESTEP_EASING_H
+
+#include "core/util/detect.h"
+
+// how transitions are evaluated, see view_animation_set_default_easing
+enum easing_modes {
+  EASING_DEFAULT,	// per animation only: use the global mode
+  EASING_EXACT,		// double precision easing functions
+  EASING_FLOAT,		// single precision transcendental curves
+  EASING_LUT		// interpolated lookup table per transition
+};
+
+//choose how easing curves are evaluated for animations left on EASING_DEFAULT.
+//lut_resolution is the number of steps in each EASING_LUT table
+CEXPORT void view_animation_set_default_easing(unsigned int easing_mode, unsigned int lut_resolution);
+//get the global easing mode, and the lut resolution when lut_resolution isn't NULL
+CEXPORT unsigned int view_animation_get_default_easing(unsigned int *lut_resolution);
+//evaluate a transition at t, 0 to 1, as an animation in easing_mode would,
+//for benchmarks and tools. Transitions are numbered from 0, no transition,
+//to view_animation_transition_count() - 1
+CEXPORT double view_animation_ease(unsigned int transition, double t, unsigned int easing_mode);
+CEXPORT unsigned int view_animation_transition_count();
+
+//custom curves are numbered from view_animation_transition_count() and
+//used like any other transition. Defining a curve again returns the same
+//number, and NO_TRANSITION is returned for curves that are malformed or
+//don't fit. cubic-bezier(x1, y1, x2, y2) as in CSS, control point x from 0 to 1
+CEXPORT unsigned int view_animation_define_bezier(double x1, double y1, double x2, double y2);
+//count keys of (time, value, transition into this key), from time 0 to time
+//1. The transition is a built in one or a bezier, NO_TRANSITION is linear
+CEXPORT unsigned int view_animation_define_keyframes(const double *keys, unsigned int count);
+//forgets every custom curve; frames still using one fall back to ease in out
+CEXPORT void view_animation_clear_transitions();
+
+#endif // TIMESTEP_EASING_H
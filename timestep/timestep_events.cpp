@@ -16,62 +16,357 @@
  */
 
 #include "timestep_events.h"
+#include "core/timestep/timestep_gestures.h"
+#include "core/timestep/timestep_view.h"
 #include "core/log.h"
+#include "core/input_replay.h"
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #define OPT_MERGE_EVENTS
 
-static const int BUFFER_SIZE = 32;
-static input_event m_events[BUFFER_SIZE];
-static int m_count = 0;
+/*
+ * Events travel from the input thread to the js thread through a single
+ * producer / single consumer ring without locks. When a ring fills, the
+ * producer moves on to one twice the size and links it from the old ring;
+ * the consumer drains the old ring, follows the link and frees it.
+ */
 
-CEXPORT void timestep_events_push(int id, int type, int x, int y) {
-    int ii;
+#define INITIAL_BUFFER_SIZE 32
+#define MAX_BUFFER_SIZE 4096
+#define MERGE_SLOTS 64 /* distinct pointer id and type pairs merged per get, a power of two */
 
-    LOGFN("timestep_events_push");
+typedef struct event_ring_t {
+    input_event *events;
+    unsigned int capacity; // a power of two
+    unsigned int head; // next event to read, written by the consumer
+    unsigned int tail; // next event to write, written by the producer
+    struct event_ring_t *next; // larger ring the producer moved on to
+} event_ring;
+
+static input_event m_initial_events[INITIAL_BUFFER_SIZE];
+static event_ring m_initial_ring = { m_initial_events, INITIAL_BUFFER_SIZE, 0, 0, NULL };
+static event_ring *m_write_ring = &m_initial_ring; // producer only
+static bool m_dropping = false; // producer only
+static event_ring *m_read_ring = &m_initial_ring; // consumer only
+
+// Two snapshots so the list handed out survives the next get
+typedef struct event_snapshot_t {
+    input_event *events;
+    unsigned int count;
+    unsigned int capacity;
+    input_event *coalesced;
+    unsigned int coalesced_count;
+    unsigned int coalesced_capacity;
+} event_snapshot;
+
+static event_snapshot m_snapshots[2];
+static int m_snapshot = 0;
+
+static timestep_view *m_hit_test_root = NULL;
 
 #ifdef OPT_MERGE_EVENTS
-    for (ii = 0; ii < m_count; ++ii) {
-        input_event *t = &m_events[ii];
+// Which snapshot event each pointer id and type merges into. Slots from an
+// earlier get have an older generation, so nothing is cleared between gets.
+typedef struct merge_slot_t {
+    int id;
+    int type;
+    unsigned int index;
+    unsigned int generation;
+} merge_slot;
+
+static merge_slot m_merge_slots[MERGE_SLOTS];
+static unsigned int m_merge_generation = 0;
+
+// Merged samples in arrival order, coalesced_index holds the event they
+// belong to until they are grouped per event
+static bool m_keep_coalesced = false;
+static input_event *m_samples = NULL;
+static unsigned int m_sample_count = 0;
+static unsigned int m_sample_capacity = 0;
+#endif
+
+static double events_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static event_ring *ring_new(unsigned int capacity) {
+    event_ring *ring = (event_ring *)malloc(sizeof(event_ring));
+    input_event *events = (input_event *)malloc(sizeof(input_event) * capacity);
+    if (!ring || !events) {
+        free(ring);
+        free(events);
+        return NULL;
+    }
+
+    ring->events = events;
+    ring->capacity = capacity;
+    ring->head = 0;
+    ring->tail = 0;
+    ring->next = NULL;
+    return ring;
+}
+
+static void push_event(int id, int type, int x, int y, double timestamp) {
+    event_ring *ring = m_write_ring;
+    unsigned int tail = ring->tail;
+    unsigned int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
 
-        if (t->id == id && t->type == type) {
-            t->x = x;
-            t->y = y;
+    if (tail - head == ring->capacity) {
+        event_ring *larger = ring->capacity < MAX_BUFFER_SIZE ? ring_new(ring->capacity * 2) : NULL;
+        if (!larger) {
+            if (!m_dropping) {
+                LOG("{events} WARNING: Dropping input events, %u events are waiting", ring->capacity);
+                m_dropping = true;
+            }
             return;
         }
+
+        // the consumer frees the old ring once it has drained it
+        __atomic_store_n(&ring->next, larger, __ATOMIC_RELEASE);
+        m_write_ring = ring = larger;
+        tail = 0;
+    }
+
+    input_event *t = &ring->events[tail & (ring->capacity - 1)];
+    t->id = id;
+    t->type = type;
+    t->x = x;
+    t->y = y;
+    t->timestamp = timestamp;
+
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    m_dropping = false;
+}
+
+CEXPORT void timestep_events_push(int id, int type, int x, int y) {
+    LOGFN("timestep_events_push");
+    // a recording plays in place of the player
+    if (input_replay_state() != INPUT_REPLAY_PLAYING) {
+        push_event(id, type, x, y, events_now());
+    }
+    LOGFN("end timestep_events_push");
+}
+
+CEXPORT void timestep_events_push_replayed(int id, int type, int x, int y, double timestamp) {
+    push_event(id, type, x, y, timestamp);
+}
+
+static bool grow_events(input_event **events, unsigned int *capacity, unsigned int count) {
+    if (count < *capacity) {
+        return true;
+    }
+
+    unsigned int larger = *capacity ? *capacity * 2 : INITIAL_BUFFER_SIZE;
+    while (larger <= count) {
+        larger *= 2;
+    }
+
+    input_event *grown = (input_event *)realloc(*events, sizeof(input_event) * larger);
+    if (!grown) {
+        LOG("{events} WARNING: Dropping input event, unable to grow the event list");
+        return false;
+    }
+    *events = grown;
+    *capacity = larger;
+    return true;
+}
+
+#ifdef OPT_MERGE_EVENTS
+static merge_slot *merge_slot_find(int id, int type) {
+    unsigned int hash = (unsigned int)id * 31 + (unsigned int)type;
+    unsigned int ii;
+
+    for (ii = 0; ii < MERGE_SLOTS; ++ii) {
+        merge_slot *slot = &m_merge_slots[(hash + ii) & (MERGE_SLOTS - 1)];
+
+        if (slot->generation != m_merge_generation) {
+            // free this get, claim it
+            slot->id = id;
+            slot->type = type;
+            slot->index = (unsigned int)-1;
+            slot->generation = m_merge_generation;
+            return slot;
+        }
+        if (slot->id == id && slot->type == type) {
+            return slot;
+        }
     }
+
+    // more pointers than slots, the rest are not merged
+    return NULL;
+}
 #endif
 
-    if (m_count < BUFFER_SIZE) {
-        input_event *t = &m_events[m_count++];
+static void snapshot_add(event_snapshot *snapshot, const input_event *event) {
+#ifdef OPT_MERGE_EVENTS
+    merge_slot *slot = merge_slot_find(event->id, event->type);
 
-        t->id = id;
-        t->type = type;
-        t->x = x;
-        t->y = y;
+    if (slot && slot->index != (unsigned int)-1) {
+        input_event *t = &snapshot->events[slot->index];
+
+        if (m_keep_coalesced && grow_events(&m_samples, &m_sample_capacity, m_sample_count)) {
+            input_event *sample = &m_samples[m_sample_count++];
+            *sample = *t;
+            sample->coalesced_index = slot->index;
+            t->coalesced_count++;
+        }
+
+        t->x = event->x;
+        t->y = event->y;
+        t->timestamp = event->timestamp;
+        return;
     }
+#endif
 
-    LOGFN("end timestep_events_push");
+    if (!grow_events(&snapshot->events, &snapshot->capacity, snapshot->count)) {
+        return;
+    }
+
+#ifdef OPT_MERGE_EVENTS
+    if (slot) {
+        slot->index = snapshot->count;
+    }
+#endif
+
+    input_event *t = &snapshot->events[snapshot->count++];
+    *t = *event;
+    t->coalesced_index = 0;
+    t->coalesced_count = 0;
+    t->target = 0;
 }
 
-// WARNING: caller must immediately make a copy since the data
-// will be destroyed
-// TODO that seems like a bad api
-CEXPORT input_event_list timestep_events_get() {
-    unsigned current_count = m_count;
+#ifdef OPT_MERGE_EVENTS
+// Groups the merged samples by the event they belong to, oldest first
+static void snapshot_group_samples(event_snapshot *snapshot) {
+    unsigned int ii;
+    unsigned int start = 0;
+
+    snapshot->coalesced_count = 0;
+    if (!m_sample_count || !grow_events(&snapshot->coalesced, &snapshot->coalesced_capacity, m_sample_count)) {
+        m_sample_count = 0;
+        for (ii = 0; ii < snapshot->count; ++ii) {
+            snapshot->events[ii].coalesced_count = 0;
+        }
+        return;
+    }
+
+    for (ii = 0; ii < snapshot->count; ++ii) {
+        input_event *t = &snapshot->events[ii];
+        t->coalesced_index = start;
+        start += t->coalesced_count;
+        t->coalesced_count = 0; // counts back up as samples land
+    }
+
+    for (ii = 0; ii < m_sample_count; ++ii) {
+        input_event *sample = &m_samples[ii];
+        input_event *t = &snapshot->events[sample->coalesced_index];
 
+        input_event *slot = &snapshot->coalesced[t->coalesced_index + t->coalesced_count++];
+        *slot = *sample;
+        slot->coalesced_index = 0;
+        slot->coalesced_count = 0;
+    }
+
+    snapshot->coalesced_count = m_sample_count;
+    m_sample_count = 0;
+}
+#endif
+
+// Moves every pushed event into the snapshot, or drops them if it is NULL
+static void drain_events(event_snapshot *snapshot) {
+    event_ring *ring = m_read_ring;
+
+    for (;;) {
+        // read the link first: once it is set the tail is final
+        event_ring *next = __atomic_load_n(&ring->next, __ATOMIC_ACQUIRE);
+        unsigned int tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        unsigned int head = ring->head;
+
+        if (snapshot) {
+            for (; head != tail; ++head) {
+                input_event *event = &ring->events[head & (ring->capacity - 1)];
+                input_replay_record_input(event);
+                snapshot_add(snapshot, event);
+            }
+        }
+        __atomic_store_n(&ring->head, tail, __ATOMIC_RELEASE);
+
+        if (!next) {
+            break;
+        }
+
+        if (ring != &m_initial_ring) {
+            free(ring->events);
+            free(ring);
+        }
+        ring = next;
+    }
+
+    m_read_ring = ring;
+}
+
+CEXPORT input_event_list timestep_events_get() {
     LOGFN("timestep_events_get");
 
-    m_count = 0;
+    m_snapshot ^= 1;
+    event_snapshot *snapshot = &m_snapshots[m_snapshot];
+    snapshot->count = 0;
+    snapshot->coalesced_count = 0;
+
+#ifdef OPT_MERGE_EVENTS
+    if (++m_merge_generation == 0) {
+        // wrapped, slots from long ago could look current
+        memset(m_merge_slots, 0, sizeof(m_merge_slots));
+        m_merge_generation = 1;
+    }
+#endif
+
+    drain_events(snapshot);
+
+#ifdef OPT_MERGE_EVENTS
+    snapshot_group_samples(snapshot);
+#endif
+
+    if (m_hit_test_root) {
+        for (unsigned int ii = 0; ii < snapshot->count; ++ii) {
+            input_event *t = &snapshot->events[ii];
+            timestep_view *hit = timestep_view_hit_test(m_hit_test_root, t->x, t->y);
+            t->target = hit ? hit->uid : 0;
+        }
+    }
 
     LOGFN("end timestep_events_get");
 
     return (input_event_list_t) {
-        m_events,
-        current_count
+        snapshot->events,
+        snapshot->count,
+        snapshot->coalesced,
+        snapshot->coalesced_count
     };
 }
 
-CEXPORT void timestep_events_shutdown() {
-    m_count = 0;
+CEXPORT void timestep_events_set_keep_coalesced(bool keep) {
+#ifdef OPT_MERGE_EVENTS
+    m_keep_coalesced = keep;
+#endif
+}
+
+CEXPORT void timestep_events_set_hit_test_root(timestep_view *root) {
+    m_hit_test_root = root;
+}
+
+CEXPORT void timestep_events_forget_view(timestep_view *view) {
+    if (m_hit_test_root == view) {
+        m_hit_test_root = NULL;
+    }
 }
 
+CEXPORT void timestep_events_shutdown() {
+    drain_events(NULL);
+    m_hit_test_root = NULL;
+    timestep_gestures_shutdown();
+}
@@ -17,21 +17,40 @@
 #define TIMESTEP_INPUT_EVENT_H
 
 #include "core/util/detect.h"
+#include "core/types.h"
+
+struct timestep_view_t;
 
 typedef struct input_event_t {
 	int id;
 	int type;
 	int x;
 	int y;
+	double timestamp; // ms on the monotonic clock when the event was pushed
+	unsigned int coalesced_index; // first of the samples merged into this event
+	unsigned int coalesced_count;
+	unsigned int target; // uid of the view under the event, 0 if none or not hit tested
 } input_event;
 
 typedef struct input_event_list_t {
 	input_event *events;
 	unsigned int count;
+	input_event *coalesced; // earlier samples of merged events, oldest first
+	unsigned int coalesced_count;
 } input_event_list;
 
+// Push is called from the input thread and get from the js thread, one each.
+// The list get returns stays valid until the call after next.
 CEXPORT void timestep_events_push(int id, int type, int x, int y);
-CEXPORT input_event_list timestep_events_get(); 
+// Pushes recorded input from the js thread while input_replay plays, when
+// timestep_events_push drops live input
+CEXPORT void timestep_events_push_replayed(int id, int type, int x, int y, double timestamp);
+CEXPORT input_event_list timestep_events_get();
+// Keep the samples merged into each move event, as getCoalescedEvents does
+CEXPORT void timestep_events_set_keep_coalesced(bool keep);
+// Hit test each event against the tree under root as it is handed out, NULL to stop
+CEXPORT void timestep_events_set_hit_test_root(struct timestep_view_t *root);
+CEXPORT void timestep_events_forget_view(struct timestep_view_t *view);
 CEXPORT void timestep_events_shutdown();
 
 #endif // TIMESTEP_INPUT_EVENT_H
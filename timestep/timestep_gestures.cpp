@@ -0,0 +1,393 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 timestep_gestures.cpp
+ * @brief	turns raw touches into tap, long press, pan and pinch gestures
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "core/timestep/timestep_gestures.h"
+#include "core/log.h"
+
+#define MAX_POINTERS 10
+// weight of the newest move in the velocity
+#define VELOCITY_WEIGHT 0.6
+// a finger that stopped this long before lifting has no velocity
+#define VELOCITY_STALE_MS 100
+
+#define DEFAULT_SLOP 10
+#define DEFAULT_TAP_MS 300
+#define DEFAULT_LONG_PRESS_MS 500
+#define DEFAULT_PINCH_SLOP 8
+
+enum recognizer_modes {
+    MODE_NONE,
+    MODE_PAN,
+    MODE_PINCH_ARMED,   // two fingers down, not moved enough yet
+    MODE_PINCH
+};
+
+typedef struct pointer_state_t {
+    int id;
+    bool down;
+    unsigned int target;
+    double start_x;
+    double start_y;
+    double start_time;
+    double x;
+    double y;
+    double time;
+    double vx;
+    double vy;
+    bool moved; // past the slop, or part of a gesture, so never a tap
+    bool long_pressed;
+} pointer_state;
+
+static bool m_enabled = false;
+static gesture_options m_opts;
+static pointer_state m_pointers[MAX_POINTERS];
+static unsigned int m_down = 0;
+static bool m_multi = false; // more than one finger since all were up
+static int m_mode = MODE_NONE;
+static pointer_state *m_pan = NULL;
+static bool m_pan_dirty = false;
+static pointer_state *m_pinch[2];
+static double m_pinch_distance = 0;
+static double m_pinch_angle = 0;
+static double m_pinch_x = 0;
+static double m_pinch_y = 0;
+static bool m_pinch_dirty = false;
+
+static gesture_event *m_gestures = NULL;
+static unsigned int m_gesture_count = 0;
+static unsigned int m_gesture_capacity = 0;
+
+static double gestures_now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void reset_recognizers() {
+    memset(m_pointers, 0, sizeof(m_pointers));
+    m_down = 0;
+    m_multi = false;
+    m_mode = MODE_NONE;
+    m_pan = NULL;
+    m_pan_dirty = false;
+    m_pinch[0] = m_pinch[1] = NULL;
+    m_pinch_dirty = false;
+}
+
+CEXPORT void timestep_gestures_enable(bool enabled, const gesture_options *opts) {
+    m_enabled = enabled;
+    if (opts) {
+        m_opts = *opts;
+    } else {
+        m_opts.slop = DEFAULT_SLOP;
+        m_opts.tap_ms = DEFAULT_TAP_MS;
+        m_opts.long_press_ms = DEFAULT_LONG_PRESS_MS;
+        m_opts.pinch_slop = DEFAULT_PINCH_SLOP;
+        m_opts.consume_moves = false;
+    }
+    reset_recognizers();
+}
+
+CEXPORT bool timestep_gestures_enabled() {
+    return m_enabled;
+}
+
+static gesture_event *emit(int type, int state, const pointer_state *p, double timestamp) {
+    if (m_gesture_count == m_gesture_capacity) {
+        unsigned int capacity = m_gesture_capacity ? m_gesture_capacity * 2 : 16;
+        gesture_event *gestures = (gesture_event *) realloc(m_gestures, sizeof(gesture_event) * capacity);
+        if (!gestures) {
+            LOG("{gestures} WARNING: Dropping a gesture, %u are waiting", m_gesture_count);
+            return NULL;
+        }
+        m_gestures = gestures;
+        m_gesture_capacity = capacity;
+    }
+
+    gesture_event *g = &m_gestures[m_gesture_count++];
+    g->type = type;
+    g->state = state;
+    g->id = p->id;
+    g->x = p->x;
+    g->y = p->y;
+    g->dx = p->x - p->start_x;
+    g->dy = p->y - p->start_y;
+    g->vx = p->vx;
+    g->vy = p->vy;
+    g->scale = 1;
+    g->rotation = 0;
+    g->timestamp = timestamp;
+    g->target = p->target;
+    return g;
+}
+
+static void emit_pan(int state, double timestamp) {
+    gesture_event *g = emit(GESTURE_PAN, state, m_pan, timestamp);
+    if (g && state == GESTURE_END && timestamp - m_pan->time > VELOCITY_STALE_MS) {
+        g->vx = g->vy = 0;
+    }
+    m_pan_dirty = false;
+}
+
+static void emit_pinch(int state, double timestamp) {
+    pointer_state *a = m_pinch[0];
+    pointer_state *b = m_pinch[1];
+    gesture_event *g = emit(GESTURE_PINCH, state, a, timestamp);
+    if (g) {
+        double dx = b->x - a->x;
+        double dy = b->y - a->y;
+        g->x = (a->x + b->x) / 2;
+        g->y = (a->y + b->y) / 2;
+        g->dx = g->x - m_pinch_x;
+        g->dy = g->y - m_pinch_y;
+        g->vx = (a->vx + b->vx) / 2;
+        g->vy = (a->vy + b->vy) / 2;
+        g->scale = m_pinch_distance > 0 ? sqrt(dx * dx + dy * dy) / m_pinch_distance : 1;
+        g->rotation = remainder(atan2(dy, dx) - m_pinch_angle, 2 * M_PI);
+    }
+    m_pinch_dirty = false;
+}
+
+static pointer_state *find_pointer(int id) {
+    for (int i = 0; i < MAX_POINTERS; i++) {
+        if (m_pointers[i].down && m_pointers[i].id == id) {
+            return &m_pointers[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @name	arm_pinch
+ * @brief	starts watching the first two fingers down for a pinch
+ * @retval	NONE
+ */
+static void arm_pinch() {
+    unsigned int n = 0;
+    for (int i = 0; i < MAX_POINTERS && n < 2; i++) {
+        if (m_pointers[i].down) {
+            m_pinch[n++] = &m_pointers[i];
+        }
+    }
+
+    double dx = m_pinch[1]->x - m_pinch[0]->x;
+    double dy = m_pinch[1]->y - m_pinch[0]->y;
+    m_pinch_distance = sqrt(dx * dx + dy * dy);
+    m_pinch_angle = atan2(dy, dx);
+    m_pinch_x = (m_pinch[0]->x + m_pinch[1]->x) / 2;
+    m_pinch_y = (m_pinch[0]->y + m_pinch[1]->y) / 2;
+    m_pinch[0]->moved = m_pinch[1]->moved = true;
+    m_mode = MODE_PINCH_ARMED;
+}
+
+static void on_start(const input_event *e) {
+    pointer_state *p = find_pointer(e->id);
+    for (int i = 0; !p && i < MAX_POINTERS; i++) {
+        if (!m_pointers[i].down) {
+            p = &m_pointers[i];
+            m_down++;
+        }
+    }
+    if (!p) {
+        return;
+    }
+
+    memset(p, 0, sizeof(pointer_state));
+    p->id = e->id;
+    p->down = true;
+    p->target = e->target;
+    p->start_x = p->x = e->x;
+    p->start_y = p->y = e->y;
+    p->start_time = p->time = e->timestamp;
+
+    if (m_down > 1) {
+        m_multi = true;
+    }
+    if (m_down == 2) {
+        if (m_mode == MODE_PAN) {
+            emit_pan(GESTURE_END, e->timestamp);
+            m_pan = NULL;
+        }
+        if (m_mode == MODE_NONE || m_mode == MODE_PAN) {
+            arm_pinch();
+        }
+    }
+}
+
+/**
+ * @name	on_move
+ * @brief	follows a finger, starting a pan or pinch once it has moved far
+ *          enough
+ * @param	e - (const input_event *) move event or coalesced sample
+ * @retval	bool - true if a recognized gesture used the move
+ */
+static bool on_move(const input_event *e) {
+    pointer_state *p = find_pointer(e->id);
+    if (!p) {
+        return false;
+    }
+
+    double dt = e->timestamp - p->time;
+    if (dt > 0) {
+        p->vx += ((e->x - p->x) / dt - p->vx) * VELOCITY_WEIGHT;
+        p->vy += ((e->y - p->y) / dt - p->vy) * VELOCITY_WEIGHT;
+    }
+    p->x = e->x;
+    p->y = e->y;
+    p->time = e->timestamp;
+
+    if (m_mode == MODE_PAN) {
+        m_pan_dirty |= p == m_pan;
+        return p == m_pan;
+    }
+
+    if (m_mode == MODE_PINCH_ARMED || m_mode == MODE_PINCH) {
+        if (p != m_pinch[0] && p != m_pinch[1]) {
+            return false;
+        }
+        if (m_mode == MODE_PINCH) {
+            m_pinch_dirty = true;
+            return true;
+        }
+
+        double dx = m_pinch[1]->x - m_pinch[0]->x;
+        double dy = m_pinch[1]->y - m_pinch[0]->y;
+        double distance = sqrt(dx * dx + dy * dy);
+        // turning counts by the arc the fingers travel
+        double arc = fabs(remainder(atan2(dy, dx) - m_pinch_angle, 2 * M_PI)) * m_pinch_distance / 2;
+        if (fabs(distance - m_pinch_distance) > m_opts.pinch_slop || arc > m_opts.pinch_slop) {
+            m_mode = MODE_PINCH;
+            emit_pinch(GESTURE_BEGIN, e->timestamp);
+            return true;
+        }
+        return false;
+    }
+
+    if (!p->moved && hypot(p->x - p->start_x, p->y - p->start_y) > m_opts.slop) {
+        p->moved = true;
+        if (m_down == 1 && !p->long_pressed) {
+            m_mode = MODE_PAN;
+            m_pan = p;
+            emit_pan(GESTURE_BEGIN, e->timestamp);
+            return true;
+        }
+    }
+    return false;
+}
+
+static void on_select(const input_event *e) {
+    pointer_state *p = find_pointer(e->id);
+    if (!p) {
+        return;
+    }
+    p->x = e->x;
+    p->y = e->y;
+
+    if (m_mode == MODE_PAN && p == m_pan) {
+        emit_pan(GESTURE_END, e->timestamp);
+        m_pan = NULL;
+        m_mode = MODE_NONE;
+    } else if ((m_mode == MODE_PINCH_ARMED || m_mode == MODE_PINCH) && (p == m_pinch[0] || p == m_pinch[1])) {
+        if (m_mode == MODE_PINCH) {
+            emit_pinch(GESTURE_END, e->timestamp);
+        }
+        m_mode = MODE_NONE;
+    } else if (m_mode == MODE_NONE && m_down == 1 && !m_multi && !p->moved && !p->long_pressed &&
+               e->timestamp - p->start_time <= m_opts.tap_ms) {
+        emit(GESTURE_TAP, GESTURE_END, p, e->timestamp);
+    }
+
+    p->down = false;
+    if (--m_down == 0) {
+        m_multi = false;
+    }
+}
+
+/**
+ * @name	timestep_gestures_process
+ * @brief	runs the frame's raw input through the recognizers, then checks
+ *          for long presses and reports each pan and pinch that moved once
+ * @param	raw - (input_event_list *) the list timestep_events_get gave
+ * @retval	gesture_event_list - gestures recognized this frame
+ */
+CEXPORT gesture_event_list timestep_gestures_process(input_event_list *raw) {
+    m_gesture_count = 0;
+    if (!m_enabled) {
+        return (gesture_event_list) { m_gestures, 0 };
+    }
+
+    unsigned int kept = 0;
+    for (unsigned int i = 0; i < raw->count; i++) {
+        const input_event *e = &raw->events[i];
+        bool used = false;
+        switch (e->type) {
+        case INPUT_EVENT_START:
+            on_start(e);
+            break;
+        case INPUT_EVENT_MOVE:
+            // the samples merged into the move came before it
+            for (unsigned int s = 0; s < e->coalesced_count; s++) {
+                on_move(&raw->coalesced[e->coalesced_index + s]);
+            }
+            used = on_move(e);
+            break;
+        case INPUT_EVENT_SELECT:
+            on_select(e);
+            break;
+        }
+
+        if (!(used && m_opts.consume_moves)) {
+            raw->events[kept++] = *e;
+        }
+    }
+    raw->count = kept;
+
+    double now = gestures_now();
+    if (m_mode == MODE_NONE && m_down == 1 && !m_multi) {
+        for (int i = 0; i < MAX_POINTERS; i++) {
+            pointer_state *p = &m_pointers[i];
+            if (p->down && !p->moved && !p->long_pressed && now - p->start_time >= m_opts.long_press_ms) {
+                p->long_pressed = true;
+                emit(GESTURE_LONG_PRESS, GESTURE_END, p, now);
+            }
+        }
+    }
+
+    if (m_mode == MODE_PAN && m_pan_dirty) {
+        emit_pan(GESTURE_CHANGE, m_pan->time);
+    } else if (m_mode == MODE_PINCH && m_pinch_dirty) {
+        emit_pinch(GESTURE_CHANGE, now);
+    }
+
+    return (gesture_event_list) { m_gestures, m_gesture_count };
+}
+
+CEXPORT void timestep_gestures_shutdown() {
+    m_enabled = false;
+    reset_recognizers();
+    free(m_gestures);
+    m_gestures = NULL;
+    m_gesture_count = 0;
+    m_gesture_capacity = 0;
+}
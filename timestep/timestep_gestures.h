@@ -0,0 +1,87 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef TIMESTEP_GESTURES_H
+#define TIMESTEP_GESTURES_H
+
+#include "core/util/detect.h"
+#include "core/types.h"
+#include "core/timestep/timestep_events.h"
+
+// Recognizes taps, long presses, pans and two finger pinches natively from
+// the raw input of timestep_events_get, so JS gets a handful of gesture
+// events per frame instead of every touch move. Pans and pinches report at
+// most one change a frame, with everything that moved since folded in.
+// JS thread only, like timestep_events_get.
+
+// the platform's raw input event types
+enum input_event_types {
+	INPUT_EVENT_START = 1,
+	INPUT_EVENT_MOVE = 2,
+	INPUT_EVENT_SELECT = 3
+};
+
+enum gesture_types {
+	GESTURE_TAP,
+	GESTURE_LONG_PRESS,
+	GESTURE_PAN,
+	GESTURE_PINCH       // two fingers, with scale and rotation
+};
+
+enum gesture_states {
+	GESTURE_BEGIN,
+	GESTURE_CHANGE,
+	GESTURE_END         // taps and long presses only end
+};
+
+typedef struct gesture_event_t {
+	int type;
+	int state;
+	int id;             // pointer id, the first finger's for pinches
+	double x;           // where it is now, the centroid for pinches
+	double y;
+	double dx;          // moved since it began
+	double dy;
+	double vx;          // points per ms, on the last change and at the end
+	double vy;
+	double scale;       // pinch distance over the starting distance
+	double rotation;    // pinch angle since it began, in radians
+	double timestamp;
+	unsigned int target; // uid of the view the gesture began on, 0 if not hit tested
+} gesture_event;
+
+typedef struct gesture_event_list_t {
+	gesture_event *events;
+	unsigned int count;
+} gesture_event_list;
+
+typedef struct gesture_options_t {
+	double slop;            // points a finger moves before it pans
+	double tap_ms;          // longest press that is a tap
+	double long_press_ms;   // shortest press that is a long press
+	double pinch_slop;      // points the fingers' distance changes before it pinches
+	bool consume_moves;     // take the moves of recognized fingers out of the raw list
+} gesture_options;
+
+// off until enabled, which also resets every recognizer
+CEXPORT void timestep_gestures_enable(bool enabled, const gesture_options *opts);
+CEXPORT bool timestep_gestures_enabled();
+// feeds the frame's raw input, and the time, to the recognizers. With
+// consume_moves, moves they used are taken out of raw. The list returned
+// stays valid until the next call
+CEXPORT gesture_event_list timestep_gestures_process(input_event_list *raw);
+CEXPORT void timestep_gestures_shutdown();
+
+#endif // TIMESTEP_GESTURES_H
@@ -17,8 +17,11 @@
 
 #include <stdlib.h>
 
+#include <string.h>
+
 #include "timestep_image_map.h"
 #include "core/log.h"
+#include "core/texture_manager.h"
 
 timestep_image_map *timestep_image_map_init() {
     timestep_image_map *map = (timestep_image_map *) malloc(sizeof(timestep_image_map));
@@ -26,10 +29,107 @@ timestep_image_map *timestep_image_map_init() {
     map->canary = CANARY_GOOD;
 #endif
     map->url = 0;
+    map->texture_handle = 0;
+    map->handle_url = 0;
+    map->trim = false;
+    map->trim_count = -1;
+    map->trim_texture = 0;
+    map->owner_sheet = NULL;
     return map;
 }
 
+/**
+ * @name	timestep_image_map_set_url
+ * @brief	replaces the map's url, dropping the texture handle of the old one
+ * @param	map - (timestep_image_map *) map to change
+ * @param	url - (const char *) new url, copied, or NULL
+ * @retval	NONE
+ */
+void timestep_image_map_set_url(timestep_image_map *map, const char *url) {
+    if (map->owner_sheet) {
+        LOG("{sheet} WARNING: Tried to set the url of a sheet frame to %s", url ? url : "null");
+        return;
+    }
+    if (map->url) {
+        free(map->url);
+    }
+    map->url = url ? strdup(url) : 0;
+    map->texture_handle = 0;
+    map->handle_url = 0;
+}
+
+/**
+ * @name	timestep_image_map_get_handle
+ * @brief	returns the texture handle for the map's url, interning it the
+ *          first time the map is drawn and again whenever url is replaced
+ * @param	map - (timestep_image_map *) map being drawn
+ * @retval	int - texture handle, zero when the map has no url
+ */
+int timestep_image_map_get_handle(timestep_image_map *map) {
+    if (!map->url) {
+        return 0;
+    }
+
+    timestep_sheet *sheet = map->owner_sheet;
+    if (sheet) {
+        if (!sheet->texture_handle) {
+            sheet->texture_handle = texture_manager_intern_url(sheet->url);
+        }
+        return sheet->texture_handle;
+    }
+
+    // the bindings may swap url without timestep_image_map_set_url
+    if (!map->texture_handle || map->handle_url != map->url) {
+        map->texture_handle = texture_manager_intern_url(map->url);
+        map->handle_url = map->url;
+    }
+    return map->texture_handle;
+}
+
+/**
+ * @name	timestep_image_map_get_trim
+ * @brief	finds the bands of the map's rect that aren't fully transparent,
+ *          from its texture's alpha mask. They are found again only when
+ *          the rect or the texture changes
+ * @param	map - (timestep_image_map *) map with trim set, being drawn
+ * @param	rects - (const rect_2d **) receives the bands, in source pixels
+ * @retval	int - number of bands, 0 if nothing is visible, or -1 to draw
+ *          the whole rect, e.g. before the texture loads or when trimming
+ *          saves too little to be worth the extra quads
+ */
+int timestep_image_map_get_trim(timestep_image_map *map, const rect_2d **rects) {
+    texture_2d *tex = texture_manager_get_texture_by_handle(texture_manager_get(), timestep_image_map_get_handle(map));
+    if (!map->trim || !tex || !tex->loaded || !tex->alpha_mask) {
+        return -1;
+    }
+
+    if (map->trim_texture != tex->id || map->trim_key[0] != map->x || map->trim_key[1] != map->y ||
+        map->trim_key[2] != map->width || map->trim_key[3] != map->height) {
+        rect_2d src = {(float) map->x, (float) map->y, (float) map->width, (float) map->height};
+        int count = texture_2d_trim_rect(tex, &src, map->trim_rects, IMAGE_MAP_TRIM_BANDS);
+        float area = 0;
+        for (int i = 0; i < count; i++) {
+            area += map->trim_rects[i].width * map->trim_rects[i].height;
+        }
+
+        // every band costs a quad, keep one unless a tenth of it goes
+        map->trim_count = count > 0 && area > 0.9f * src.width * src.height ? -1 : count;
+        map->trim_texture = tex->id;
+        map->trim_key[0] = map->x;
+        map->trim_key[1] = map->y;
+        map->trim_key[2] = map->width;
+        map->trim_key[3] = map->height;
+    }
+
+    *rects = map->trim_rects;
+    return map->trim_count;
+}
+
 void timestep_image_delete(timestep_image_map *map) {
+    if (map->owner_sheet) {
+        timestep_sheet_release(map->owner_sheet);
+        return;
+    }
     if (map->url) {
         free(map->url);
     }
@@ -40,3 +140,325 @@ void timestep_image_delete(timestep_image_map *map) {
     free(map);
 }
 
+static int32_t read_i32(const unsigned char *p) {
+    return (int32_t) ((uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24));
+}
+
+#define SHEET_HEADER_BYTES 20
+#define SHEET_FRAME_BYTES 36
+
+/**
+ * @name	timestep_sheet_load
+ * @brief	reads a packed sheet description into one shared url and a
+ *          single array of frames, instead of a map and a url copy per frame
+ * @param	data - (const void *) the description, see timestep_image_map.h
+ * @param	size - (unsigned long) bytes in data
+ * @retval	timestep_sheet* - the sheet, with one reference for the caller,
+ *          or NULL if it is malformed
+ */
+timestep_sheet *timestep_sheet_load(const void *data, unsigned long size) {
+    const unsigned char *bytes = (const unsigned char *) data;
+    if (!bytes || size < SHEET_HEADER_BYTES || memcmp(bytes, SHEET_MAGIC, 4)) {
+        LOG("{sheet} WARNING: Not a sheet description");
+        return NULL;
+    }
+
+    unsigned long frame_count = (uint32_t) read_i32(bytes + 4);
+    unsigned long url_bytes = (uint32_t) read_i32(bytes + 8);
+    const unsigned char *url = bytes + SHEET_HEADER_BYTES;
+    const unsigned char *record = url + url_bytes;
+    if (!url_bytes || url[url_bytes - 1] != '\0' ||
+        SHEET_HEADER_BYTES + url_bytes + frame_count * SHEET_FRAME_BYTES != size) {
+        LOG("{sheet} WARNING: Sheet description of %lu bytes doesn't match its header", size);
+        return NULL;
+    }
+
+    timestep_sheet *sheet = (timestep_sheet *) malloc(sizeof(timestep_sheet));
+    timestep_image_map *frames = (timestep_image_map *) malloc(sizeof(timestep_image_map) * (frame_count ? frame_count : 1));
+    char *sheet_url = strdup((const char *) url);
+    if (!sheet || !frames || !sheet_url) {
+        LOG("{sheet} WARNING: Unable to allocate a sheet of %lu frames", frame_count);
+        free(sheet);
+        free(frames);
+        free(sheet_url);
+        return NULL;
+    }
+
+    sheet->url = sheet_url;
+    sheet->texture_handle = 0;
+    sheet->width = read_i32(bytes + 12);
+    sheet->height = read_i32(bytes + 16);
+    sheet->frame_count = frame_count;
+    sheet->frames = frames;
+    sheet->refs = 1;
+
+    for (unsigned int i = 0; i < frame_count; i++, record += SHEET_FRAME_BYTES) {
+        timestep_image_map *map = &frames[i];
+#if defined(DEBUG)
+        map->canary = CANARY_GOOD;
+#endif
+        map->x = read_i32(record);
+        map->y = read_i32(record + 4);
+        map->width = read_i32(record + 8);
+        map->height = read_i32(record + 12);
+        map->margin_top = read_i32(record + 16);
+        map->margin_right = read_i32(record + 20);
+        map->margin_bottom = read_i32(record + 24);
+        map->margin_left = read_i32(record + 28);
+        map->sheet_width = sheet->width;
+        map->sheet_height = sheet->height;
+        map->url = sheet_url;
+        map->texture_handle = 0;
+        map->handle_url = 0;
+        map->trim = read_i32(record + 32) != 0;
+        map->trim_count = -1;
+        map->trim_texture = 0;
+        map->owner_sheet = sheet;
+    }
+    return sheet;
+}
+
+/**
+ * @name	timestep_sheet_get_frame
+ * @brief	hands out a frame of the sheet, to be given back with
+ *          timestep_image_delete, or by the view or sprite owning it
+ * @param	sheet - (timestep_sheet *) sheet to take the frame from
+ * @param	index - (unsigned int) index of the frame
+ * @retval	timestep_image_map* - the frame, or NULL past the last one
+ */
+timestep_image_map *timestep_sheet_get_frame(timestep_sheet *sheet, unsigned int index) {
+    if (index >= sheet->frame_count) {
+        return NULL;
+    }
+    sheet->refs++;
+    return &sheet->frames[index];
+}
+
+void timestep_sheet_release(timestep_sheet *sheet) {
+    if (sheet && --sheet->refs == 0) {
+        free(sheet->frames);
+        free(sheet->url);
+        free(sheet);
+    }
+}
+
+/**
+ * @name	timestep_sprite_init
+ * @brief	creates a sprite with room for the given number of frames, each
+ *          one a fresh image map owned by the sprite
+ * @param	frame_count - (unsigned int) number of frames
+ * @param	fps - (unsigned int) playback rate in frames per second
+ * @retval	timestep_sprite* - the new sprite
+ */
+timestep_sprite *timestep_sprite_init(unsigned int frame_count, unsigned int fps) {
+    timestep_sprite *sprite = (timestep_sprite *) malloc(sizeof(timestep_sprite));
+    sprite->frames = (timestep_image_map **) malloc(sizeof(timestep_image_map *) * frame_count);
+    sprite->frame_count = frame_count;
+    sprite->fps = fps;
+
+    for (unsigned int i = 0; i < frame_count; i++) {
+        sprite->frames[i] = timestep_image_map_init();
+    }
+
+    return sprite;
+}
+
+/**
+ * @name	timestep_sprite_init_from_sheet
+ * @brief	creates a sprite whose frames are a run of a sheet's frames,
+ *          each holding a reference on the sheet until the sprite is freed
+ * @param	sheet - (timestep_sheet *) sheet the frames are in
+ * @param	first - (unsigned int) index of the first frame
+ * @param	count - (unsigned int) number of frames
+ * @param	fps - (unsigned int) playback rate in frames per second
+ * @retval	timestep_sprite* - the new sprite, or NULL if the run doesn't
+ *          fit in the sheet
+ */
+timestep_sprite *timestep_sprite_init_from_sheet(timestep_sheet *sheet, unsigned int first, unsigned int count, unsigned int fps) {
+    if (first > sheet->frame_count || count > sheet->frame_count - first) {
+        LOG("{sheet} WARNING: Frames %u to %u are not all in the sheet of %u", first, first + count, sheet->frame_count);
+        return NULL;
+    }
+
+    timestep_sprite *sprite = (timestep_sprite *) malloc(sizeof(timestep_sprite));
+    sprite->frames = (timestep_image_map **) malloc(sizeof(timestep_image_map *) * (count ? count : 1));
+    sprite->frame_count = count;
+    sprite->fps = fps;
+
+    for (unsigned int i = 0; i < count; i++) {
+        sprite->frames[i] = timestep_sheet_get_frame(sheet, first + i);
+    }
+
+    return sprite;
+}
+
+void timestep_sprite_delete(timestep_sprite *sprite) {
+    for (unsigned int i = 0; i < sprite->frame_count; i++) {
+        timestep_image_delete(sprite->frames[i]);
+    }
+
+    free(sprite->frames);
+    free(sprite);
+}
+
+/**
+ * @name	timestep_tilemap_init
+ * @brief	creates an empty tile grid, with a fresh image map for its sheet
+ * @param	columns - (unsigned int) tiles per row
+ * @param	rows - (unsigned int) rows of tiles
+ * @param	tile_width - (unsigned int) width of a sheet cell, in source pixels
+ * @param	tile_height - (unsigned int) height of a sheet cell, in source pixels
+ * @retval	timestep_tilemap* - the new tilemap, or NULL if it didn't fit in memory
+ */
+timestep_tilemap *timestep_tilemap_init(unsigned int columns, unsigned int rows, unsigned int tile_width, unsigned int tile_height) {
+    unsigned int count = columns * rows;
+    timestep_tilemap *map = (timestep_tilemap *) calloc(1, sizeof(timestep_tilemap));
+    int *tiles = (int *) malloc(sizeof(int) * (count ? count : 1));
+    if (!map || !tiles) {
+        LOG("{tilemap} WARNING: Unable to allocate a %ux%u tilemap", columns, rows);
+        free(map);
+        free(tiles);
+        return NULL;
+    }
+
+    for (unsigned int i = 0; i < count; i++) {
+        tiles[i] = -1;
+    }
+
+    map->sheet = timestep_image_map_init();
+    map->sheet->x = map->sheet->y = map->sheet->width = map->sheet->height = 0;
+    map->tile_width = tile_width;
+    map->tile_height = tile_height;
+    map->columns = columns;
+    map->rows = rows;
+    map->tiles = tiles;
+    map->version = 1;
+    return map;
+}
+
+static void free_chunks(timestep_tilemap *map) {
+    for (unsigned int i = 0; i < map->chunk_columns * map->chunk_rows; i++) {
+        free(map->chunks[i].src_rects);
+    }
+    free(map->chunks);
+    map->chunks = NULL;
+    map->chunk_columns = 0;
+    map->chunk_rows = 0;
+    map->built_version = 0;
+}
+
+void timestep_tilemap_delete(timestep_tilemap *map) {
+    free_chunks(map);
+    timestep_image_delete(map->sheet);
+    free(map->tiles);
+    free(map);
+}
+
+/**
+ * @name	timestep_tilemap_set_tile
+ * @brief	sets one tile of the grid, the chunks are rebuilt when next drawn
+ * @param	map - (timestep_tilemap *) tilemap to change
+ * @param	column - (unsigned int) column of the tile
+ * @param	row - (unsigned int) row of the tile
+ * @param	tile - (int) sheet cell to draw, negative for none
+ * @retval	bool - false if the tile is outside the grid
+ */
+bool timestep_tilemap_set_tile(timestep_tilemap *map, unsigned int column, unsigned int row, int tile) {
+    if (column >= map->columns || row >= map->rows) {
+        return false;
+    }
+
+    int *slot = &map->tiles[row * map->columns + column];
+    if (*slot != tile) {
+        *slot = tile;
+        map->version++;
+    }
+    return true;
+}
+
+/**
+ * @name	timestep_tilemap_build
+ * @brief	builds the source / destination rects of every chunk, unless
+ *			they are already built for the current tiles and tile size
+ * @param	map - (timestep_tilemap *) tilemap to build
+ * @param	tile_width - (float) width of a tile in view space
+ * @param	tile_height - (float) height of a tile in view space
+ * @retval	bool - false if the chunks couldn't be allocated
+ */
+bool timestep_tilemap_build(timestep_tilemap *map, float tile_width, float tile_height) {
+    // the bindings write the sheet's rect straight into the map
+    timestep_image_map *sheet = map->sheet;
+    int32_t sheet_rect[4] = {sheet->x, sheet->y, sheet->width, sheet->height};
+    if (map->chunks && map->built_version == map->version &&
+        map->built_tile_width == tile_width && map->built_tile_height == tile_height &&
+        !memcmp(map->built_sheet, sheet_rect, sizeof(sheet_rect))) {
+        return true;
+    }
+
+    free_chunks(map);
+
+    unsigned int sheet_columns = map->tile_width ? sheet->width / map->tile_width : 0;
+    unsigned int sheet_rows = map->tile_height ? sheet->height / map->tile_height : 0;
+    unsigned int chunk_columns = (map->columns + TILEMAP_CHUNK_TILES - 1) / TILEMAP_CHUNK_TILES;
+    unsigned int chunk_rows = (map->rows + TILEMAP_CHUNK_TILES - 1) / TILEMAP_CHUNK_TILES;
+    unsigned int chunk_count = chunk_columns * chunk_rows;
+    map->chunks = (timestep_tilemap_chunk *) calloc(chunk_count ? chunk_count : 1, sizeof(timestep_tilemap_chunk));
+    if (!map->chunks) {
+        LOG("{tilemap} WARNING: Unable to allocate %u tilemap chunks", chunk_count);
+        return false;
+    }
+    map->chunk_columns = chunk_columns;
+    map->chunk_rows = chunk_rows;
+
+    for (unsigned int cy = 0; cy < chunk_rows; cy++) {
+        for (unsigned int cx = 0; cx < chunk_columns; cx++) {
+            timestep_tilemap_chunk *chunk = &map->chunks[cy * chunk_columns + cx];
+            unsigned int first_column = cx * TILEMAP_CHUNK_TILES;
+            unsigned int first_row = cy * TILEMAP_CHUNK_TILES;
+            unsigned int last_column = first_column + TILEMAP_CHUNK_TILES < map->columns ? first_column + TILEMAP_CHUNK_TILES : map->columns;
+            unsigned int last_row = first_row + TILEMAP_CHUNK_TILES < map->rows ? first_row + TILEMAP_CHUNK_TILES : map->rows;
+
+            chunk->bounds.x = first_column * tile_width;
+            chunk->bounds.y = first_row * tile_height;
+            chunk->bounds.width = (last_column - first_column) * tile_width;
+            chunk->bounds.height = (last_row - first_row) * tile_height;
+
+            // the source and destination rects share one allocation
+            chunk->src_rects = (rect_2d *) malloc(sizeof(rect_2d) * 2 * TILEMAP_CHUNK_TILES * TILEMAP_CHUNK_TILES);
+            if (!chunk->src_rects) {
+                LOG("{tilemap} WARNING: Unable to allocate a tilemap chunk");
+                free_chunks(map);
+                return false;
+            }
+            chunk->dest_rects = chunk->src_rects + TILEMAP_CHUNK_TILES * TILEMAP_CHUNK_TILES;
+
+            for (unsigned int row = first_row; row < last_row; row++) {
+                for (unsigned int column = first_column; column < last_column; column++) {
+                    int tile = map->tiles[row * map->columns + column];
+                    if (tile < 0 || (unsigned int) tile >= sheet_columns * sheet_rows) {
+                        continue;
+                    }
+
+                    rect_2d *src = &chunk->src_rects[chunk->count];
+                    src->x = sheet->x + (tile % sheet_columns) * map->tile_width;
+                    src->y = sheet->y + (tile / sheet_columns) * map->tile_height;
+                    src->width = map->tile_width;
+                    src->height = map->tile_height;
+
+                    rect_2d *dest = &chunk->dest_rects[chunk->count];
+                    dest->x = column * tile_width;
+                    dest->y = row * tile_height;
+                    dest->width = tile_width;
+                    dest->height = tile_height;
+                    chunk->count++;
+                }
+            }
+        }
+    }
+
+    map->built_version = map->version;
+    map->built_tile_width = tile_width;
+    map->built_tile_height = tile_height;
+    memcpy(map->built_sheet, sheet_rect, sizeof(sheet_rect));
+    return true;
+}
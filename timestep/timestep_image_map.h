@@ -16,6 +16,12 @@
 #ifndef TIMESTEP_IMAGE_MAP_H
 #define TIMESTEP_IMAGE_MAP_H
 
+#include "core/geometry.h"
+
+// most bands an image map's visible part is split into, see
+// timestep_image_map_get_trim
+#define IMAGE_MAP_TRIM_BANDS 4
+
 typedef struct timestep_image_map_t {
 	int32_t x;
 	int32_t y;
@@ -31,18 +37,113 @@ typedef struct timestep_image_map_t {
 	unsigned int canary;
 #endif
 	char *url;
+	int texture_handle; // texture handle for url, see timestep_image_map_get_handle
+	const char *handle_url; // url texture_handle was resolved from
+	bool trim; // draw only the parts of the image with alpha in them
+	int trim_count; // bands in trim_rects, -1 to draw the whole rect
+	rect_2d trim_rects[IMAGE_MAP_TRIM_BANDS];
+	int32_t trim_key[4]; // x, y, width, height the bands were found for
+	unsigned int trim_texture; // id of the texture they were found in, 0 for none
+	struct timestep_sheet_t *owner_sheet; // sheet holding the map and its url, or NULL
 } timestep_image_map;
 
+// A packed sprite sheet: one url and texture handle shared by a contiguous
+// array of frames, loaded in one go by timestep_sheet_load from
+//
+//   header   "TSH1", frame count, url bytes, sheet width, sheet height
+//            (32 bit little-endian each)
+//   url      url bytes, ending in a NUL
+//   frames   frame count records of x, y, width, height, margin top,
+//            right, bottom and left, and a trim flag (32 bit each)
+//
+// Frames are ordinary image maps to the renderer. timestep_sheet_get_frame
+// hands one out with a reference on the sheet, and timestep_image_delete
+// on it gives the reference back instead of freeing it, so views and
+// sprites own sheet frames like any other map. Frames must not have their
+// url set.
+#define SHEET_MAGIC "TSH1"
+
+typedef struct timestep_sheet_t {
+	char *url;
+	int texture_handle; // interned on the first draw of any frame
+	int32_t width;
+	int32_t height;
+	unsigned int frame_count;
+	timestep_image_map *frames;
+	unsigned int refs;
+} timestep_sheet;
+
 #if defined(DEBUG)
 #define CANARY_GOOD 0xdeaddeed
 #endif
 
 typedef struct timestep_sprite_t {
 	timestep_image_map **frames;
+	unsigned int frame_count;
 	unsigned int fps;
 } timestep_sprite;
 
+// playback state of a SPRITE_VIEW, kept in its view_data
+typedef struct timestep_sprite_state_t {
+	timestep_sprite *sprite;
+	unsigned int frame;
+	double elapsed; // ms spent on the current frame
+	bool loop;
+	bool playing;
+} timestep_sprite_state;
+
+// a TILEMAP_VIEW's grid, kept in its view_data. each tile is the index of a
+// tile_width x tile_height cell of the sheet, counted row by row, or
+// negative for none. Tiles are drawn from prebuilt rect lists, one per
+// chunk of TILEMAP_CHUNK_TILES x TILEMAP_CHUNK_TILES tiles
+#define TILEMAP_CHUNK_TILES 16
+
+typedef struct timestep_tilemap_chunk_t {
+	rect_2d bounds; // in view space
+	rect_2d *src_rects;
+	rect_2d *dest_rects;
+	int count;
+} timestep_tilemap_chunk;
+
+typedef struct timestep_tilemap_t {
+	timestep_image_map *sheet; // the tileset, its rect holds the cells
+	unsigned int tile_width; // cell size, in source pixels
+	unsigned int tile_height;
+	unsigned int columns;
+	unsigned int rows;
+	int *tiles;
+	unsigned int version; // changes with every tile write
+
+	timestep_tilemap_chunk *chunks;
+	unsigned int chunk_columns;
+	unsigned int chunk_rows;
+	unsigned int built_version; // version the chunks were built from
+	float built_tile_width; // view space tile size they were built for
+	float built_tile_height;
+	int32_t built_sheet[4]; // sheet x, y, width, height they were built for
+} timestep_tilemap;
+
 timestep_image_map *timestep_image_map_init();
 void timestep_image_delete(timestep_image_map *map);
+void timestep_image_map_set_url(timestep_image_map *map, const char *url);
+int timestep_image_map_get_handle(timestep_image_map *map);
+int timestep_image_map_get_trim(timestep_image_map *map, const rect_2d **rects);
+
+// the loader holds the first reference
+timestep_sheet *timestep_sheet_load(const void *data, unsigned long size);
+void timestep_sheet_release(timestep_sheet *sheet);
+// the frame, with a new reference on the sheet, or NULL past the last one
+timestep_image_map *timestep_sheet_get_frame(timestep_sheet *sheet, unsigned int index);
+
+timestep_sprite *timestep_sprite_init(unsigned int frame_count, unsigned int fps);
+// a sprite playing count frames of the sheet from first, NULL if they
+// aren't all in it
+timestep_sprite *timestep_sprite_init_from_sheet(timestep_sheet *sheet, unsigned int first, unsigned int count, unsigned int fps);
+void timestep_sprite_delete(timestep_sprite *sprite);
+
+timestep_tilemap *timestep_tilemap_init(unsigned int columns, unsigned int rows, unsigned int tile_width, unsigned int tile_height);
+void timestep_tilemap_delete(timestep_tilemap *map);
+bool timestep_tilemap_set_tile(timestep_tilemap *map, unsigned int column, unsigned int row, int tile);
+bool timestep_tilemap_build(timestep_tilemap *map, float tile_width, float tile_height);
 
 #endif
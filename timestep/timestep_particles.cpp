@@ -0,0 +1,276 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with the Game Closure SDK.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/timestep/timestep_particles.h"
+#include "core/log.h"
+
+// one float array per particle field, all cut from a single allocation
+#define PARTICLE_FLOAT_FIELDS 8
+
+// share of each emitter's capacity it may fill, see timestep_particles_set_quality
+static float m_quality = 1;
+
+static unsigned int next_random(timestep_particle_emitter *emitter) {
+    unsigned int r = emitter->random;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    emitter->random = r;
+    return r;
+}
+
+static float random_range(timestep_particle_emitter *emitter, float min, float max) {
+    return min + (max - min) * (next_random(emitter) & 0xffffff) * (1.f / 0xffffff);
+}
+
+static float lerp(float a, float b, float t) {
+    return a + (b - a) * t;
+}
+
+/**
+ * @name	timestep_particle_emitter_init
+ * @brief	creates a stopped emitter with room for capacity particles. Its
+ *          config starts out emitting nothing, white and at scale 1
+ * @param	capacity - (unsigned int) most particles alive at once
+ * @retval	timestep_particle_emitter* - the emitter, or NULL if it could not
+ *          be allocated
+ */
+timestep_particle_emitter *timestep_particle_emitter_init(unsigned int capacity) {
+    timestep_particle_emitter *emitter = (timestep_particle_emitter *) calloc(1, sizeof(timestep_particle_emitter));
+    size_t floats_size = sizeof(float) * PARTICLE_FLOAT_FIELDS * capacity;
+    size_t size = floats_size + (sizeof(matrix_3x3) + sizeof(rgba)) * capacity;
+    char *block = emitter && capacity ? (char *) malloc(size) : NULL;
+    if (!block) {
+        LOG("{particles} WARNING: Unable to allocate an emitter of %u particles", capacity);
+        free(emitter);
+        return NULL;
+    }
+
+    float *floats = (float *) block;
+    emitter->x = floats;
+    emitter->y = floats + capacity;
+    emitter->vx = floats + capacity * 2;
+    emitter->vy = floats + capacity * 3;
+    emitter->age = floats + capacity * 4;
+    emitter->life = floats + capacity * 5;
+    emitter->rotation = floats + capacity * 6;
+    emitter->spin = floats + capacity * 7;
+    emitter->transforms = (matrix_3x3 *) (block + floats_size);
+    emitter->colors = (rgba *) (block + floats_size + sizeof(matrix_3x3) * capacity);
+
+    emitter->capacity = capacity;
+    emitter->random = 0x9e3779b9u ^ (unsigned int) (size_t) emitter;
+    if (!emitter->random) {
+        emitter->random = 1;
+    }
+
+    timestep_particle_config *config = &emitter->config;
+    config->life_min = config->life_max = 1000;
+    config->scale_start = config->scale_end = 1;
+    config->color_start.r = config->color_start.g = config->color_start.b = config->color_start.a = 1;
+    config->color_end = config->color_start;
+    return emitter;
+}
+
+void timestep_particle_emitter_delete(timestep_particle_emitter *emitter) {
+    if (emitter) {
+        if (emitter->image) {
+            timestep_image_delete(emitter->image);
+        }
+        // every array lives in the block x starts
+        free(emitter->x);
+        free(emitter);
+    }
+}
+
+void timestep_particle_emitter_start(timestep_particle_emitter *emitter) {
+    emitter->emitting = true;
+    emitter->elapsed = 0;
+    emitter->spawn_debt = 0;
+}
+
+void timestep_particle_emitter_stop(timestep_particle_emitter *emitter, bool clear) {
+    emitter->emitting = false;
+    if (clear && emitter->count) {
+        emitter->count = 0;
+        emitter->version++;
+    }
+}
+
+/**
+ * @name	timestep_particle_emitter_burst
+ * @brief	spawns particles at once, as many as there is room for
+ * @param	emitter - (timestep_particle_emitter *) emitter to spawn from
+ * @param	count - (unsigned int) particles wanted
+ * @retval	unsigned int - particles spawned
+ */
+unsigned int timestep_particle_emitter_burst(timestep_particle_emitter *emitter, unsigned int count) {
+    const timestep_particle_config *config = &emitter->config;
+    unsigned int cap = emitter->capacity;
+    if (m_quality < 1) {
+        cap = (unsigned int) (cap * m_quality);
+        cap = cap ? cap : 1;
+    }
+    unsigned int room = cap > emitter->count ? cap - emitter->count : 0;
+    if (count > room) {
+        count = room;
+    }
+    if (count) {
+        emitter->version++;
+    }
+
+    for (unsigned int n = 0; n < count; n++) {
+        unsigned int i = emitter->count++;
+        float angle = random_range(emitter, config->angle_min, config->angle_max);
+        float speed = random_range(emitter, config->speed_min, config->speed_max);
+        emitter->x[i] = random_range(emitter, -0.5f, 0.5f) * config->spawn_width;
+        emitter->y[i] = random_range(emitter, -0.5f, 0.5f) * config->spawn_height;
+        emitter->vx[i] = cosf(angle) * speed;
+        emitter->vy[i] = sinf(angle) * speed;
+        emitter->age[i] = 0;
+        emitter->life[i] = fmaxf(random_range(emitter, config->life_min, config->life_max), 1);
+        emitter->rotation[i] = 0;
+        emitter->spin[i] = random_range(emitter, config->spin_min, config->spin_max);
+    }
+    return count;
+}
+
+/**
+ * @name	timestep_particle_emitter_update
+ * @brief	ages and moves every particle, drops the dead ones and spawns the
+ *          particles the emission rate owes for the time passed
+ * @param	emitter - (timestep_particle_emitter *) emitter to advance
+ * @param	dt - (float) elapsed time in ms
+ * @retval	bool - true if the last particle just died and the emitter has
+ *          stopped emitting
+ */
+bool timestep_particle_emitter_update(timestep_particle_emitter *emitter, float dt) {
+    const timestep_particle_config *config = &emitter->config;
+    unsigned int count = emitter->count;
+    bool had_particles = count > 0;
+    if (had_particles) {
+        emitter->version++;
+    }
+    float seconds = dt / 1000.f;
+    float ax = config->gravity_x * seconds;
+    float ay = config->gravity_y * seconds;
+    float damping = fmaxf(0.f, 1.f - config->drag * seconds);
+
+    // each field is updated in its own branch free pass so the compiler
+    // can vectorize them
+    float *__restrict__ x = emitter->x;
+    float *__restrict__ y = emitter->y;
+    float *__restrict__ vx = emitter->vx;
+    float *__restrict__ vy = emitter->vy;
+    for (unsigned int i = 0; i < count; i++) {
+        vx[i] = (vx[i] + ax) * damping;
+        vy[i] = (vy[i] + ay) * damping;
+        x[i] += vx[i] * seconds;
+        y[i] += vy[i] * seconds;
+    }
+
+    float *__restrict__ age = emitter->age;
+    float *__restrict__ rotation = emitter->rotation;
+    const float *__restrict__ spin = emitter->spin;
+    for (unsigned int i = 0; i < count; i++) {
+        age[i] += dt;
+        rotation[i] += spin[i] * seconds;
+    }
+
+    // fill each dead particle's slot with the last live one
+    for (unsigned int i = 0; i < count;) {
+        if (age[i] < emitter->life[i]) {
+            i++;
+            continue;
+        }
+        count--;
+        x[i] = x[count];
+        y[i] = y[count];
+        vx[i] = vx[count];
+        vy[i] = vy[count];
+        age[i] = age[count];
+        emitter->life[i] = emitter->life[count];
+        rotation[i] = rotation[count];
+        emitter->spin[i] = emitter->spin[count];
+    }
+    emitter->count = count;
+
+    if (emitter->emitting) {
+        emitter->elapsed += dt;
+        if (config->duration > 0 && emitter->elapsed >= config->duration) {
+            emitter->emitting = false;
+        } else if (config->rate > 0) {
+            float owed = emitter->spawn_debt + config->rate * seconds;
+            unsigned int spawn = (unsigned int) owed;
+            emitter->spawn_debt = owed - spawn;
+            timestep_particle_emitter_burst(emitter, spawn);
+        }
+    }
+
+    return had_particles && !emitter->count && !emitter->emitting;
+}
+
+/**
+ * @name	timestep_particle_emitter_prepare_draw
+ * @brief	builds each live particle's transform, relative to the emitter's
+ *          origin, and its color for its age
+ * @param	emitter - (timestep_particle_emitter *) emitter to draw
+ * @retval	unsigned int - number of transforms and colors filled
+ */
+unsigned int timestep_particle_emitter_prepare_draw(timestep_particle_emitter *emitter) {
+    const timestep_particle_config *config = &emitter->config;
+    const rgba *from = &config->color_start;
+    const rgba *to = &config->color_end;
+    for (unsigned int i = 0; i < emitter->count; i++) {
+        float t = emitter->age[i] / emitter->life[i];
+        float scale = lerp(config->scale_start, config->scale_end, t);
+        float c = cosf(emitter->rotation[i]) * scale;
+        float s = sinf(emitter->rotation[i]) * scale;
+
+        matrix_3x3 *m = &emitter->transforms[i];
+        m->m00 = c;
+        m->m01 = -s;
+        m->m02 = emitter->x[i];
+        m->m10 = s;
+        m->m11 = c;
+        m->m12 = emitter->y[i];
+        m->m20 = 0;
+        m->m21 = 0;
+        m->m22 = 1;
+
+        rgba *color = &emitter->colors[i];
+        color->r = lerp(from->r, to->r, t);
+        color->g = lerp(from->g, to->g, t);
+        color->b = lerp(from->b, to->b, t);
+        color->a = lerp(from->a, to->a, t);
+    }
+    return emitter->count;
+}
+
+/**
+ * @name	timestep_particles_set_quality
+ * @brief	caps how many particles each emitter keeps alive
+ * @param	share - (float) share of each emitter's capacity, 0 to 1
+ * @retval	NONE
+ */
+CEXPORT void timestep_particles_set_quality(float share) {
+    m_quality = share < 0 ? 0 : share > 1 ? 1 : share;
+}
@@ -0,0 +1,95 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with the Game Closure SDK.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef TIMESTEP_PARTICLES_H
+#define TIMESTEP_PARTICLES_H
+
+#include "core/util/detect.h"
+#include "core/geometry.h"
+#include "core/rgba.h"
+#include "core/timestep/timestep_image_map.h"
+
+// how a PARTICLE_VIEW spawns its particles. Ranges are picked from uniformly
+// for each particle, positions are in view space relative to the view's
+// anchor, times in ms, speeds per second and angles in radians
+typedef struct timestep_particle_config_t {
+	float rate; // particles per second, 0 to only emit bursts
+	float duration; // ms to keep emitting for, 0 for ever
+	float life_min;
+	float life_max;
+	float spawn_width; // particles spawn in this box, centered on the anchor
+	float spawn_height;
+	float speed_min;
+	float speed_max;
+	float angle_min; // direction of travel
+	float angle_max;
+	float gravity_x;
+	float gravity_y;
+	float drag; // fraction of velocity lost per second
+	float scale_start;
+	float scale_end;
+	float spin_min; // rotation speed
+	float spin_max;
+	rgba color_start; // multiplied into the image, alpha included
+	rgba color_end;
+} timestep_particle_config;
+
+// a PARTICLE_VIEW's emitter, kept in its view_data. Particles live in one
+// array per field so the update runs down each one in a straight loop, and
+// dead particles are replaced by the last live one to keep them packed
+typedef struct timestep_particle_emitter_t {
+	timestep_image_map *image; // drawn centered on each particle
+	timestep_particle_config config;
+	unsigned int capacity;
+	unsigned int count;
+
+	float *x;
+	float *y;
+	float *vx;
+	float *vy;
+	float *age; // ms lived
+	float *life; // ms to live
+	float *rotation;
+	float *spin;
+
+	// filled by timestep_particle_emitter_prepare_draw
+	matrix_3x3 *transforms;
+	rgba *colors;
+
+	unsigned int version; // changes with every update that had particles
+	double elapsed; // ms spent emitting
+	float spawn_debt; // fraction of a particle owed to the next tick
+	unsigned int random; // xorshift state
+	bool emitting;
+} timestep_particle_emitter;
+
+timestep_particle_emitter *timestep_particle_emitter_init(unsigned int capacity);
+void timestep_particle_emitter_delete(timestep_particle_emitter *emitter);
+void timestep_particle_emitter_start(timestep_particle_emitter *emitter);
+void timestep_particle_emitter_stop(timestep_particle_emitter *emitter, bool clear);
+unsigned int timestep_particle_emitter_burst(timestep_particle_emitter *emitter, unsigned int count);
+// returns true when the emitter just ran out of particles with nothing left
+// to emit
+bool timestep_particle_emitter_update(timestep_particle_emitter *emitter, float dt);
+// fills the emitter's transforms and colors for its live particles, returning
+// how many there are
+unsigned int timestep_particle_emitter_prepare_draw(timestep_particle_emitter *emitter);
+// caps every emitter at this share of its capacity, 1 for all of it. Live
+// particles over the cap are left to die out
+CEXPORT void timestep_particles_set_quality(float share);
+
+#endif
@@ -0,0 +1,275 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 timestep_prefab.cpp
+ * @brief	builds view trees from binary prefabs in one native call
+ */
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/timestep/timestep_prefab.h"
+#include "core/timestep/timestep_view.h"
+#include "core/timestep/timestep_image_map.h"
+#include "core/log.h"
+
+#define PREFAB_HEADER_BYTES 16
+
+static uint32_t read_u32(const unsigned char *p) {
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/**
+ * @name	check_view
+ * @brief	checks a view record against the records before it
+ * @param	prefab - (timestep_prefab *) prefab being loaded, maps filled in
+ * @param	index - (unsigned int) index of the view record
+ * @retval	bool - false if the record is malformed
+ */
+static bool check_view(timestep_prefab *prefab, unsigned int index) {
+    const prefab_view_record *rec = &prefab->views[index];
+    if (rec->parent > index) {
+        LOG("{prefab} WARNING: View %u comes before its parent", index);
+        return false;
+    }
+    if (rec->type != DEFAULT_RENDER && rec->type != IMAGE_VIEW && rec->type != NINE_SLICE_VIEW) {
+        LOG("{prefab} WARNING: View %u has unsupported type %u", index, rec->type);
+        return false;
+    }
+    if (rec->map < -1 || rec->map >= (int32_t) prefab->map_count ||
+        (rec->map >= 0 && rec->type == DEFAULT_RENDER)) {
+        LOG("{prefab} WARNING: View %u has a bad image map %d", index, rec->map);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @name	timestep_prefab_load
+ * @brief	checks a binary prefab and copies it into a form that can be
+ *          instantiated any number of times
+ * @param	data - (const void *) the prefab, see timestep_prefab.h
+ * @param	size - (unsigned long) bytes in data
+ * @retval	timestep_prefab* - the prefab, or NULL if it is malformed
+ */
+timestep_prefab *timestep_prefab_load(const void *data, unsigned long size) {
+    const unsigned char *bytes = (const unsigned char *) data;
+    if (!bytes || size < PREFAB_HEADER_BYTES || memcmp(bytes, PREFAB_MAGIC, 4)) {
+        LOG("{prefab} WARNING: Not a prefab");
+        return NULL;
+    }
+
+    unsigned long view_count = read_u32(bytes + 4);
+    unsigned long map_count = read_u32(bytes + 8);
+    unsigned long string_bytes = read_u32(bytes + 12);
+    unsigned long maps_at = PREFAB_HEADER_BYTES + string_bytes;
+    unsigned long views_at = maps_at + map_count * sizeof(prefab_map_record);
+    if (views_at + view_count * sizeof(prefab_view_record) != size ||
+        (string_bytes && bytes[maps_at - 1] != '\0')) {
+        LOG("{prefab} WARNING: Prefab of %lu bytes doesn't match its header", size);
+        return NULL;
+    }
+
+    timestep_prefab *prefab = (timestep_prefab *) calloc(1, sizeof(timestep_prefab));
+    if (!prefab) {
+        return NULL;
+    }
+    prefab->view_count = view_count;
+    prefab->map_count = map_count;
+    prefab->strings = (char *) malloc(string_bytes ? string_bytes : 1);
+    prefab->maps = (prefab_map_record *) malloc(map_count ? map_count * sizeof(prefab_map_record) : 1);
+    prefab->views = (prefab_view_record *) malloc(view_count ? view_count * sizeof(prefab_view_record) : 1);
+    if (!prefab->strings || !prefab->maps || !prefab->views) {
+        LOG("{prefab} WARNING: Unable to allocate a prefab of %lu views", view_count);
+        timestep_prefab_delete(prefab);
+        return NULL;
+    }
+
+    // the records are read as they lie, which assumes a little-endian host
+    memcpy(prefab->strings, bytes + PREFAB_HEADER_BYTES, string_bytes);
+    memcpy(prefab->maps, bytes + maps_at, map_count * sizeof(prefab_map_record));
+    memcpy(prefab->views, bytes + views_at, view_count * sizeof(prefab_view_record));
+
+    for (unsigned int i = 0; i < prefab->map_count; i++) {
+        if (prefab->maps[i].url >= string_bytes) {
+            LOG("{prefab} WARNING: Image map %u has a bad url", i);
+            timestep_prefab_delete(prefab);
+            return NULL;
+        }
+    }
+    for (unsigned int i = 0; i < prefab->view_count; i++) {
+        if (!check_view(prefab, i)) {
+            timestep_prefab_delete(prefab);
+            return NULL;
+        }
+        if (!prefab->views[i].parent) {
+            prefab->root_count++;
+        }
+    }
+    return prefab;
+}
+
+void timestep_prefab_delete(timestep_prefab *prefab) {
+    if (prefab) {
+        free(prefab->strings);
+        free(prefab->maps);
+        free(prefab->views);
+        free(prefab);
+    }
+}
+
+static timestep_image_map *make_map(timestep_prefab *prefab, const prefab_map_record *rec) {
+    timestep_image_map *map = timestep_image_map_init();
+    timestep_image_map_set_url(map, prefab->strings + rec->url);
+    map->x = rec->x;
+    map->y = rec->y;
+    map->width = rec->width;
+    map->height = rec->height;
+    map->margin_top = rec->margin_top;
+    map->margin_right = rec->margin_right;
+    map->margin_bottom = rec->margin_bottom;
+    map->margin_left = rec->margin_left;
+    map->sheet_width = rec->sheet_width;
+    map->sheet_height = rec->sheet_height;
+    map->trim = rec->trim != 0;
+    return map;
+}
+
+/**
+ * @name	apply_record
+ * @brief	writes a view record onto a new view, before it is added to its
+ *          superview
+ * @param	prefab - (timestep_prefab *) prefab the record is from
+ * @param	rec - (const prefab_view_record *) record to apply
+ * @param	v - (timestep_view *) new view
+ * @retval	NONE
+ */
+static void apply_record(timestep_prefab *prefab, const prefab_view_record *rec, timestep_view *v) {
+    const double *values = rec->values;
+    v->x = values[PREFAB_X];
+    v->y = values[PREFAB_Y];
+    v->r = values[PREFAB_R];
+    v->anchor_x = values[PREFAB_ANCHOR_X];
+    v->anchor_y = values[PREFAB_ANCHOR_Y];
+    v->offset_x = values[PREFAB_OFFSET_X];
+    v->offset_y = values[PREFAB_OFFSET_Y];
+    v->scale = values[PREFAB_SCALE];
+    v->scale_x = values[PREFAB_SCALE_X];
+    v->scale_y = values[PREFAB_SCALE_Y];
+    v->opacity = values[PREFAB_OPACITY];
+    v->width = values[PREFAB_WIDTH] == values[PREFAB_WIDTH] ? values[PREFAB_WIDTH] : UNDEFINED_DIMENSION;
+    v->height = values[PREFAB_HEIGHT] == values[PREFAB_HEIGHT] ? values[PREFAB_HEIGHT] : UNDEFINED_DIMENSION;
+    v->slice_top = values[PREFAB_SLICE_TOP];
+    v->slice_right = values[PREFAB_SLICE_RIGHT];
+    v->slice_bottom = values[PREFAB_SLICE_BOTTOM];
+    v->slice_left = values[PREFAB_SLICE_LEFT];
+
+    v->visible = (rec->flags & PREFAB_VISIBLE) != 0;
+    v->clip = (rec->flags & PREFAB_CLIP) != 0;
+    v->flip_x = (rec->flags & PREFAB_FLIP_X) != 0;
+    v->flip_y = (rec->flags & PREFAB_FLIP_Y) != 0;
+    v->order_independent = (rec->flags & PREFAB_ORDER_INDEPENDENT) != 0;
+    v->cache_as_bitmap = (rec->flags & PREFAB_CACHE_AS_BITMAP) != 0;
+    v->draws_outside_bounds = (rec->flags & PREFAB_DRAWS_OUTSIDE_BOUNDS) != 0;
+    v->sort_by_draw_state = (rec->flags & PREFAB_SORT_BY_DRAW_STATE) != 0;
+    // not added yet, so the sort on adding puts it in place
+    v->z_index = rec->z_index;
+
+    v->background_color.r = rec->background[0];
+    v->background_color.g = rec->background[1];
+    v->background_color.b = rec->background[2];
+    v->background_color.a = rec->background[3];
+
+    if (rec->type != DEFAULT_RENDER) {
+        timestep_view_set_type(v, rec->type);
+        if (rec->map >= 0) {
+            timestep_view_set_image_map(v, make_map(prefab, &prefab->maps[rec->map]));
+        }
+    }
+}
+
+/**
+ * @name	timestep_prefab_instantiate
+ * @brief	builds a new copy of the prefab's tree, making every view first
+ *          and then adding each view's children in one batch
+ * @param	prefab - (timestep_prefab *) prefab to build
+ * @param	parent - (timestep_view *) view to add the roots to, or NULL
+ * @param	root_uids - (unsigned int *) receives the roots' uids
+ * @param	max_roots - (unsigned int) room in root_uids; without a parent it
+ *          must hold every root, as nothing else would own them
+ * @retval	unsigned int - number of roots built, 0 on failure
+ */
+unsigned int timestep_prefab_instantiate(timestep_prefab *prefab, timestep_view *parent, unsigned int *root_uids, unsigned int max_roots) {
+    unsigned int count = prefab->view_count;
+    if (!count || (!parent && prefab->root_count > max_roots)) {
+        LOG("{prefab} WARNING: No room for the %u roots of the prefab", prefab->root_count);
+        return 0;
+    }
+
+    // views, then the views grouped by parent, with a start per parent
+    timestep_view **views = (timestep_view **) malloc(sizeof(timestep_view *) * count * 2);
+    unsigned int *starts = (unsigned int *) calloc(count + 2, sizeof(unsigned int));
+    if (!views || !starts) {
+        free(views);
+        free(starts);
+        return 0;
+    }
+    timestep_view **children = views + count;
+
+    for (unsigned int i = 0; i < count; i++) {
+        timestep_view *v = timestep_view_init();
+        if (!v) {
+            LOG("{prefab} WARNING: Unable to allocate view %u of %u", i, count);
+            while (i--) {
+                timestep_view_delete(views[i]);
+            }
+            free(views);
+            free(starts);
+            return 0;
+        }
+        views[i] = v;
+        apply_record(prefab, &prefab->views[i], v);
+        // the roots of a parentless instance are handed straight to JS
+        v->prefab_owned = prefab->views[i].parent || parent;
+        starts[prefab->views[i].parent + 1]++;
+    }
+
+    for (unsigned int p = 1; p <= count + 1; p++) {
+        starts[p] += starts[p - 1];
+    }
+    unsigned int roots = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        unsigned int p = prefab->views[i].parent;
+        children[starts[p]++] = views[i];
+        if (!p && roots < max_roots && root_uids) {
+            root_uids[roots] = views[i]->uid;
+        }
+        roots += !p;
+    }
+
+    // starts[p] now ends parent p's run, which begins where p - 1's ended
+    for (unsigned int p = 0; p <= count; p++) {
+        unsigned int begin = p ? starts[p - 1] : 0;
+        unsigned int n = starts[p] - begin;
+        timestep_view *v = p ? views[p - 1] : parent;
+        if (n && v) {
+            timestep_view_add_subviews(v, children + begin, n);
+        }
+    }
+
+    free(views);
+    free(starts);
+    return roots;
+}
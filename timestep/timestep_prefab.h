@@ -0,0 +1,115 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef TIMESTEP_PREFAB_H
+#define TIMESTEP_PREFAB_H
+
+#include "core/util/detect.h"
+#include "core/types.h"
+#include "core/timestep/timestep.h"
+
+// A prefab is a view tree flattened into one binary blob, so a screen or an
+// effect can be built natively in one call instead of one bridge call per
+// view and property. Everything is little-endian:
+//
+//   header   "TVP1", view count, map count, string table bytes (uint32 each)
+//   strings  the image urls, each ending in a NUL
+//   maps     map count prefab_map_record
+//   views    view count prefab_view_record, parents before their children
+//
+// A view's parent is 0 for a root or 1 + the index of an earlier view. Its
+// map is the index of an image map record, or -1. Widths and heights that
+// are NaN are left to the layout.
+
+#define PREFAB_MAGIC "TVP1"
+
+enum prefab_view_flags {
+	PREFAB_VISIBLE = 1 << 0,
+	PREFAB_CLIP = 1 << 1,
+	PREFAB_FLIP_X = 1 << 2,
+	PREFAB_FLIP_Y = 1 << 3,
+	PREFAB_ORDER_INDEPENDENT = 1 << 4,
+	PREFAB_CACHE_AS_BITMAP = 1 << 5,
+	PREFAB_DRAWS_OUTSIDE_BOUNDS = 1 << 6,
+	PREFAB_SORT_BY_DRAW_STATE = 1 << 7
+};
+
+// the doubles of a view record, in order
+enum prefab_view_values {
+	PREFAB_X,
+	PREFAB_Y,
+	PREFAB_R,
+	PREFAB_ANCHOR_X,
+	PREFAB_ANCHOR_Y,
+	PREFAB_OFFSET_X,
+	PREFAB_OFFSET_Y,
+	PREFAB_SCALE,
+	PREFAB_SCALE_X,
+	PREFAB_SCALE_Y,
+	PREFAB_OPACITY,
+	PREFAB_WIDTH,
+	PREFAB_HEIGHT,
+	PREFAB_SLICE_TOP,
+	PREFAB_SLICE_RIGHT,
+	PREFAB_SLICE_BOTTOM,
+	PREFAB_SLICE_LEFT,
+	PREFAB_VALUE_COUNT
+};
+
+typedef struct prefab_map_record_t {
+	uint32_t url;           // offset of the url in the string table
+	int32_t x;
+	int32_t y;
+	int32_t width;
+	int32_t height;
+	int32_t margin_top;
+	int32_t margin_right;
+	int32_t margin_bottom;
+	int32_t margin_left;
+	int32_t sheet_width;
+	int32_t sheet_height;
+	uint32_t trim;          // nonzero to draw only the parts with alpha
+} prefab_map_record;
+
+typedef struct prefab_view_record_t {
+	uint32_t parent;
+	uint32_t type;          // DEFAULT_RENDER, IMAGE_VIEW or NINE_SLICE_VIEW
+	int32_t map;
+	uint32_t flags;         // prefab_view_flags
+	int32_t z_index;
+	float background[4];    // r, g, b, a
+	uint32_t reserved;      // 0, keeps the doubles aligned
+	double values[PREFAB_VALUE_COUNT];
+} prefab_view_record;
+
+typedef struct timestep_prefab_t {
+	unsigned int view_count;
+	unsigned int map_count;
+	unsigned int root_count;
+	char *strings;
+	prefab_map_record *maps;
+	prefab_view_record *views;
+} timestep_prefab;
+
+// checks and copies the blob, NULL if it is malformed
+CEXPORT timestep_prefab *timestep_prefab_load(const void *data, unsigned long size);
+CEXPORT void timestep_prefab_delete(timestep_prefab *prefab);
+// builds a new copy of the tree, adding its roots to parent if there is one.
+// The uids of the first max_roots roots go in root_uids for JS to wrap; the
+// views stay owned by their superview until it does. Returns the number of
+// roots built, 0 if the views couldn't be allocated
+CEXPORT unsigned int timestep_prefab_instantiate(timestep_prefab *prefab, timestep_view *parent, unsigned int *root_uids, unsigned int max_roots);
+
+#endif // TIMESTEP_PREFAB_H
@@ -0,0 +1,315 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 timestep_scroll.cpp
+ * @brief	kinetic scrolling and row virtualization for SCROLL_VIEW
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/timestep/timestep_scroll.h"
+#include "core/log.h"
+
+// share of the velocity a fling keeps after each ms
+#define DECELERATION 0.998
+// slower flings and springs are at rest, in points per ms
+#define MIN_VELOCITY 0.01
+#define MAX_VELOCITY 8.0
+// springs back from past the ends and to animated targets, critically
+// damped, per ms
+#define SPRING_STIFFNESS 0.012
+// a spring this close to its rest with no speed has arrived, in points
+#define REST_DISTANCE 0.5
+// how hard dragging past an end gets, smaller is stiffer
+#define RUBBER_BAND 0.55
+
+/**
+ * @name	rubber_band
+ * @brief	shortens a drag past an end so it never reaches size
+ * @param	distance - (double) points dragged past the end, at least 0
+ * @param	size - (double) viewport along the axis
+ * @retval	double - points shown past the end
+ */
+static double rubber_band(double distance, double size) {
+    return (1 - 1 / (distance * RUBBER_BAND / size + 1)) * size;
+}
+
+// the inverse of rubber_band, for drags that begin past an end
+static double undo_rubber_band(double shown, double size) {
+    if (shown >= size) {
+        shown = size * 0.99;
+    }
+    return (1 / (1 - shown / size) - 1) * size / RUBBER_BAND;
+}
+
+static double band_size(timestep_scroll *scroll) {
+    if (scroll->viewport > 0) {
+        return scroll->viewport;
+    }
+    return scroll->row_height > 0 ? scroll->row_height : 1;
+}
+
+CEXPORT timestep_scroll *timestep_scroll_init(bool horizontal) {
+    timestep_scroll *scroll = (timestep_scroll *) calloc(1, sizeof(timestep_scroll));
+    if (scroll) {
+        scroll->horizontal = horizontal;
+        scroll->last_offset = NAN;
+    }
+    return scroll;
+}
+
+CEXPORT void timestep_scroll_delete(timestep_scroll *scroll) {
+    if (scroll) {
+        free(scroll->rows);
+        free(scroll);
+    }
+}
+
+CEXPORT double timestep_scroll_max_offset(timestep_scroll *scroll) {
+    double max = scroll->row_count * scroll->row_height - scroll->viewport;
+    return max > 0 ? max : 0;
+}
+
+static bool out_of_bounds(timestep_scroll *scroll) {
+    return scroll->offset < 0 || scroll->offset > timestep_scroll_max_offset(scroll);
+}
+
+/**
+ * @name	timestep_scroll_set_rows
+ * @brief	sets the list's length and row size, unbinding every row view
+ *          since the data behind each row may have changed
+ * @param	scroll - (timestep_scroll *) scroll state
+ * @param	row_count - (unsigned int) rows in the list
+ * @param	row_height - (double) size of a row along the axis
+ * @param	margin_rows - (unsigned int) rows placed past each edge of the
+ *          viewport, so a fast scroll finds them bound
+ * @retval	NONE
+ */
+CEXPORT void timestep_scroll_set_rows(timestep_scroll *scroll, unsigned int row_count, double row_height, unsigned int margin_rows) {
+    scroll->row_count = row_count;
+    scroll->row_height = row_height > 0 ? row_height : 0;
+    scroll->margin_rows = margin_rows;
+    scroll->wants_more = false;
+    timestep_scroll_unbind_rows(scroll);
+
+    // a shorter list springs back to its new end
+    if (!scroll->dragging && out_of_bounds(scroll)) {
+        scroll->has_target = false;
+        scroll->moving = true;
+    }
+}
+
+/**
+ * @name	timestep_scroll_add_row_view
+ * @brief	adds a view to the pool rows are drawn with. It should already
+ *          be a subview of the SCROLL_VIEW
+ * @param	scroll - (timestep_scroll *) scroll state
+ * @param	uid - (unsigned int) uid of the row view
+ * @retval	bool - false if it was already in the pool or there was no memory
+ */
+CEXPORT bool timestep_scroll_add_row_view(timestep_scroll *scroll, unsigned int uid) {
+    for (unsigned int i = 0; i < scroll->row_view_count; i++) {
+        if (scroll->rows[i].uid == uid) {
+            return false;
+        }
+    }
+
+    if (scroll->row_view_count == scroll->row_view_capacity) {
+        unsigned int capacity = scroll->row_view_capacity ? scroll->row_view_capacity * 2 : 16;
+        timestep_scroll_row *rows = (timestep_scroll_row *) realloc(scroll->rows, sizeof(timestep_scroll_row) * capacity);
+        if (!rows) {
+            LOG("{scroll} WARNING: Unable to add row view %u", uid);
+            return false;
+        }
+        scroll->rows = rows;
+        scroll->row_view_capacity = capacity;
+    }
+
+    timestep_scroll_row *r = &scroll->rows[scroll->row_view_count++];
+    r->uid = uid;
+    r->row = -1;
+    scroll->wants_more = false;
+    scroll->last_offset = NAN;
+    return true;
+}
+
+CEXPORT void timestep_scroll_unbind_rows(timestep_scroll *scroll) {
+    for (unsigned int i = 0; i < scroll->row_view_count; i++) {
+        scroll->rows[i].row = -1;
+    }
+    // forces the rows to be placed again
+    scroll->last_offset = NAN;
+}
+
+/**
+ * @name	timestep_scroll_to
+ * @brief	moves to an offset, kept within the ends, at once or by
+ *          springing there
+ * @param	scroll - (timestep_scroll *) scroll state
+ * @param	offset - (double) points from the first row
+ * @param	animated - (bool) spring there instead of jumping
+ * @retval	NONE
+ */
+CEXPORT void timestep_scroll_to(timestep_scroll *scroll, double offset, bool animated) {
+    double max = timestep_scroll_max_offset(scroll);
+    offset = offset < 0 ? 0 : offset > max ? max : offset;
+    scroll->dragging = false;
+    if (animated) {
+        scroll->has_target = true;
+        scroll->target = offset;
+        scroll->moving = true;
+    } else {
+        scroll->offset = offset;
+        scroll->velocity = 0;
+        scroll->has_target = false;
+        scroll->moving = false;
+    }
+}
+
+void timestep_scroll_begin_drag(timestep_scroll *scroll) {
+    // caught mid-spring past an end, the finger holds the content where it is
+    double max = timestep_scroll_max_offset(scroll);
+    double origin = scroll->offset;
+    if (origin < 0) {
+        origin = -undo_rubber_band(-origin, band_size(scroll));
+    } else if (origin > max) {
+        origin = max + undo_rubber_band(origin - max, band_size(scroll));
+    }
+
+    scroll->dragging = true;
+    scroll->drag_origin = origin;
+    scroll->velocity = 0;
+    scroll->has_target = false;
+    scroll->moving = false;
+}
+
+void timestep_scroll_drag(timestep_scroll *scroll, double distance) {
+    if (!scroll->dragging) {
+        return;
+    }
+
+    double max = timestep_scroll_max_offset(scroll);
+    double offset = scroll->drag_origin - distance;
+    if (offset < 0) {
+        offset = -rubber_band(-offset, band_size(scroll));
+    } else if (offset > max) {
+        offset = max + rubber_band(offset - max, band_size(scroll));
+    }
+    scroll->offset = offset;
+}
+
+void timestep_scroll_end_drag(timestep_scroll *scroll, double velocity) {
+    if (!scroll->dragging) {
+        return;
+    }
+
+    // the content moves against the finger's travel along the offset
+    velocity = -velocity;
+    scroll->velocity = velocity < -MAX_VELOCITY ? -MAX_VELOCITY : velocity > MAX_VELOCITY ? MAX_VELOCITY : velocity;
+    scroll->dragging = false;
+    scroll->moving = true;
+}
+
+CEXPORT bool timestep_scroll_stop(timestep_scroll *scroll) {
+    if (!scroll->moving) {
+        return false;
+    }
+
+    scroll->velocity = 0;
+    scroll->has_target = false;
+    // past an end it still has to spring back
+    scroll->moving = out_of_bounds(scroll);
+    return true;
+}
+
+/**
+ * @name	timestep_scroll_update
+ * @brief	advances a fling or spring. Flings slow down exponentially and
+ *          are integrated exactly, so long frames land where short ones
+ *          would. Past an end, or with a target, a critically damped
+ *          spring takes over, which also turns a fling past an end around
+ * @param	scroll - (timestep_scroll *) scroll state
+ * @param	dt - (double) elapsed time in ms
+ * @param	viewport - (double) points in view along the axis
+ * @retval	unsigned int - scroll_update_results
+ */
+unsigned int timestep_scroll_update(timestep_scroll *scroll, double dt, double viewport) {
+    unsigned int results = 0;
+    scroll->viewport = viewport;
+
+    if (scroll->moving && !scroll->dragging && dt > 0) {
+        double max = timestep_scroll_max_offset(scroll);
+        if (scroll->has_target || scroll->offset < 0 || scroll->offset > max) {
+            double rest = scroll->has_target ? scroll->target : scroll->offset < 0 ? 0 : max;
+            double x0 = scroll->offset - rest;
+            double v0 = scroll->velocity;
+            double w = SPRING_STIFFNESS;
+            double decay = exp(-w * dt);
+            double x = (x0 + (v0 + w * x0) * dt) * decay;
+            double v = (v0 - w * (v0 + w * x0) * dt) * decay;
+
+            if (fabs(x) < REST_DISTANCE && fabs(v) < MIN_VELOCITY) {
+                x = 0;
+                v = 0;
+                scroll->has_target = false;
+                scroll->moving = false;
+                results |= SCROLL_SETTLED;
+            }
+            scroll->offset = rest + x;
+            scroll->velocity = v;
+        } else {
+            double decay = pow(DECELERATION, dt);
+            scroll->offset += scroll->velocity * (decay - 1) / log(DECELERATION);
+            scroll->velocity *= decay;
+
+            // a fling that carried past an end springs back from the next update
+            if (fabs(scroll->velocity) < MIN_VELOCITY && !out_of_bounds(scroll)) {
+                scroll->velocity = 0;
+                scroll->moving = false;
+                results |= SCROLL_SETTLED;
+            }
+        }
+    }
+
+    if (scroll->offset != scroll->last_offset) {
+        scroll->last_offset = scroll->offset;
+        results |= SCROLL_MOVED;
+    }
+    return results;
+}
+
+void timestep_scroll_get_row_range(timestep_scroll *scroll, unsigned int *first, unsigned int *end) {
+    *first = *end = 0;
+    if (scroll->row_height <= 0 || !scroll->row_count) {
+        return;
+    }
+
+    double top = floor(scroll->offset / scroll->row_height) - scroll->margin_rows;
+    double bottom = ceil((scroll->offset + scroll->viewport) / scroll->row_height) + scroll->margin_rows;
+    *first = top < 0 ? 0 : top > scroll->row_count ? scroll->row_count : (unsigned int) top;
+    *end = bottom < *first ? *first : bottom > scroll->row_count ? scroll->row_count : (unsigned int) bottom;
+}
+
+unsigned int timestep_scroll_wanted_row_views(timestep_scroll *scroll) {
+    if (scroll->row_height <= 0) {
+        return 0;
+    }
+
+    // a viewport not lined up with the rows cuts into one more
+    double wanted = ceil(scroll->viewport / scroll->row_height) + 1 + 2.0 * scroll->margin_rows;
+    return wanted < scroll->row_count ? (unsigned int) wanted : scroll->row_count;
+}
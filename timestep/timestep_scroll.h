@@ -0,0 +1,90 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef TIMESTEP_SCROLL_H
+#define TIMESTEP_SCROLL_H
+
+#include "core/util/detect.h"
+#include "core/types.h"
+
+// A SCROLL_VIEW scrolls a list of equally sized rows with its physics run
+// natively: drags follow the finger and rubber band past the ends, releases
+// fling and slow down, and flings past an end spring back. Only the rows in
+// view, and margin_rows more on each side, are placed. They are drawn by a
+// small pool of row views JS hands over once; a row view moving to another
+// row is rebound by JS, so a list of any length costs what its pool does.
+
+// what timestep_scroll_update did
+enum scroll_update_results {
+	SCROLL_MOVED = 1 << 0,
+	SCROLL_SETTLED = 1 << 1     // came to rest after moving on its own
+};
+
+// a row view of the pool and the row it shows
+typedef struct timestep_scroll_row_t {
+	unsigned int uid;
+	int row;                    // -1 while unbound
+} timestep_scroll_row;
+
+// a SCROLL_VIEW's state, kept in its view_data
+typedef struct timestep_scroll_t {
+	bool horizontal;
+	double offset;              // points scrolled from the first row
+	double velocity;            // points per ms
+	double viewport;            // points in view along the axis
+	double last_offset;         // offset as of the last update
+	unsigned int row_count;
+	double row_height;          // along the axis, width when horizontal
+	unsigned int margin_rows;   // placed past each edge of the viewport
+
+	bool dragging;
+	double drag_origin;         // offset when the drag began
+	bool has_target;            // springing to target
+	double target;
+	bool moving;                // flinging or springing
+
+	timestep_scroll_row *rows;
+	unsigned int row_view_count;
+	unsigned int row_view_capacity;
+	bool wants_more;            // the pool was short when rows were last placed
+} timestep_scroll;
+
+CEXPORT timestep_scroll *timestep_scroll_init(bool horizontal);
+CEXPORT void timestep_scroll_delete(timestep_scroll *scroll);
+// offsets past the new end are brought back, every row view is rebound
+CEXPORT void timestep_scroll_set_rows(timestep_scroll *scroll, unsigned int row_count, double row_height, unsigned int margin_rows);
+CEXPORT bool timestep_scroll_add_row_view(timestep_scroll *scroll, unsigned int uid);
+// unbinds every row view, so the rows in view are bound again
+CEXPORT void timestep_scroll_unbind_rows(timestep_scroll *scroll);
+// animated springs to the offset, which is kept within the ends either way
+CEXPORT void timestep_scroll_to(timestep_scroll *scroll, double offset, bool animated);
+CEXPORT double timestep_scroll_max_offset(timestep_scroll *scroll);
+
+// drags move the content by the finger's distance from where it went down
+void timestep_scroll_begin_drag(timestep_scroll *scroll);
+void timestep_scroll_drag(timestep_scroll *scroll, double distance);
+// velocity in points per ms along the finger's movement
+void timestep_scroll_end_drag(timestep_scroll *scroll, double velocity);
+// stops a fling or spring where it is, false if it was at rest
+CEXPORT bool timestep_scroll_stop(timestep_scroll *scroll);
+
+// advances the physics by dt ms, returning scroll_update_results
+unsigned int timestep_scroll_update(timestep_scroll *scroll, double dt, double viewport);
+// rows from first up to end belong in view, margins included
+void timestep_scroll_get_row_range(timestep_scroll *scroll, unsigned int *first, unsigned int *end);
+// row views needed to cover the viewport and the margins
+unsigned int timestep_scroll_wanted_row_views(timestep_scroll *scroll);
+
+#endif // TIMESTEP_SCROLL_H
@@ -0,0 +1,427 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+/**
+ * @file	 timestep_skeleton.cpp
+ * @brief	samples skeletal animations and places their parts natively
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/timestep/timestep_skeleton.h"
+#include "core/timestep/timestep.h"
+#include "core/timestep/timestep_easing.h"
+#include "core/texture_manager.h"
+#include "core/log.h"
+
+#define SKELETON_HEADER_BYTES 28
+
+static uint32_t read_u32(const unsigned char *p) {
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/**
+ * @name	check_skeleton
+ * @brief	checks every index in a copied skeleton against the records it
+ *          points into
+ * @param	skeleton - (timestep_skeleton *) skeleton being loaded
+ * @param	string_bytes - (unsigned long) size of its string table
+ * @retval	bool - false if a record is malformed
+ */
+static bool check_skeleton(timestep_skeleton *skeleton, unsigned long string_bytes) {
+    for (unsigned int i = 0; i < skeleton->bone_count; i++) {
+        int32_t parent = skeleton->bones[i].parent;
+        if (parent < -1 || parent >= (int32_t) i) {
+            LOG("{skeleton} WARNING: Bone %u comes before its parent", i);
+            return false;
+        }
+    }
+    for (unsigned int i = 0; i < skeleton->part_count; i++) {
+        const skeleton_part_record *part = &skeleton->parts[i];
+        if (part->bone >= skeleton->bone_count || part->url >= string_bytes) {
+            LOG("{skeleton} WARNING: Part %u has a bad bone or url", i);
+            return false;
+        }
+    }
+    for (unsigned int i = 0; i < skeleton->animation_count; i++) {
+        const skeleton_animation_record *anim = &skeleton->animations[i];
+        if (anim->name >= string_bytes || anim->first_track > skeleton->track_count ||
+            anim->track_count > skeleton->track_count - anim->first_track || !(anim->duration >= 0)) {
+            LOG("{skeleton} WARNING: Animation %u has bad tracks", i);
+            return false;
+        }
+    }
+    for (unsigned int i = 0; i < skeleton->track_count; i++) {
+        const skeleton_track_record *track = &skeleton->tracks[i];
+        unsigned int targets = track->property == SKELETON_PART_ALPHA ? skeleton->part_count : skeleton->bone_count;
+        if (track->property >= SKELETON_PROPERTY_COUNT || track->target >= targets || !track->key_count ||
+            track->first_key > skeleton->key_count || track->key_count > skeleton->key_count - track->first_key) {
+            LOG("{skeleton} WARNING: Track %u has a bad target or keys", i);
+            return false;
+        }
+        const skeleton_key_record *keys = &skeleton->keys[track->first_key];
+        for (unsigned int k = 1; k < track->key_count; k++) {
+            if (!(keys[k].time >= keys[k - 1].time)) {
+                LOG("{skeleton} WARNING: Track %u has keys out of order", i);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @name	timestep_skeleton_load
+ * @brief	checks a binary skeleton and copies it into a form any number
+ *          of poses can share
+ * @param	data - (const void *) the skeleton, see timestep_skeleton.h
+ * @param	size - (unsigned long) bytes in data
+ * @retval	timestep_skeleton* - the skeleton, with one reference for the
+ *          caller, or NULL if it is malformed
+ */
+timestep_skeleton *timestep_skeleton_load(const void *data, unsigned long size) {
+    const unsigned char *bytes = (const unsigned char *) data;
+    if (!bytes || size < SKELETON_HEADER_BYTES || memcmp(bytes, SKELETON_MAGIC, 4)) {
+        LOG("{skeleton} WARNING: Not a skeleton");
+        return NULL;
+    }
+
+    unsigned long bone_count = read_u32(bytes + 4);
+    unsigned long part_count = read_u32(bytes + 8);
+    unsigned long animation_count = read_u32(bytes + 12);
+    unsigned long track_count = read_u32(bytes + 16);
+    unsigned long key_count = read_u32(bytes + 20);
+    unsigned long string_bytes = read_u32(bytes + 24);
+    unsigned long bones_at = SKELETON_HEADER_BYTES + string_bytes;
+    unsigned long parts_at = bones_at + bone_count * sizeof(skeleton_bone_record);
+    unsigned long animations_at = parts_at + part_count * sizeof(skeleton_part_record);
+    unsigned long tracks_at = animations_at + animation_count * sizeof(skeleton_animation_record);
+    unsigned long keys_at = tracks_at + track_count * sizeof(skeleton_track_record);
+    if (!bone_count || keys_at + key_count * sizeof(skeleton_key_record) != size ||
+        (string_bytes && bytes[bones_at - 1] != '\0')) {
+        LOG("{skeleton} WARNING: Skeleton of %lu bytes doesn't match its header", size);
+        return NULL;
+    }
+
+    timestep_skeleton *skeleton = (timestep_skeleton *) calloc(1, sizeof(timestep_skeleton));
+    if (!skeleton) {
+        return NULL;
+    }
+    skeleton->bone_count = bone_count;
+    skeleton->part_count = part_count;
+    skeleton->animation_count = animation_count;
+    skeleton->track_count = track_count;
+    skeleton->key_count = key_count;
+    skeleton->refs = 1;
+    skeleton->strings = (char *) malloc(string_bytes ? string_bytes : 1);
+    skeleton->bones = (skeleton_bone_record *) malloc(bone_count * sizeof(skeleton_bone_record));
+    skeleton->parts = (skeleton_part_record *) malloc(part_count ? part_count * sizeof(skeleton_part_record) : 1);
+    skeleton->animations = (skeleton_animation_record *) malloc(animation_count ? animation_count * sizeof(skeleton_animation_record) : 1);
+    skeleton->tracks = (skeleton_track_record *) malloc(track_count ? track_count * sizeof(skeleton_track_record) : 1);
+    skeleton->keys = (skeleton_key_record *) malloc(key_count ? key_count * sizeof(skeleton_key_record) : 1);
+    skeleton->part_handles = (int *) calloc(part_count ? part_count : 1, sizeof(int));
+    if (!skeleton->strings || !skeleton->bones || !skeleton->parts || !skeleton->animations ||
+        !skeleton->tracks || !skeleton->keys || !skeleton->part_handles) {
+        LOG("{skeleton} WARNING: Unable to allocate a skeleton of %lu bones", bone_count);
+        timestep_skeleton_release(skeleton);
+        return NULL;
+    }
+
+    // the records are read as they lie, which assumes a little-endian host
+    memcpy(skeleton->strings, bytes + SKELETON_HEADER_BYTES, string_bytes);
+    memcpy(skeleton->bones, bytes + bones_at, bone_count * sizeof(skeleton_bone_record));
+    memcpy(skeleton->parts, bytes + parts_at, part_count * sizeof(skeleton_part_record));
+    memcpy(skeleton->animations, bytes + animations_at, animation_count * sizeof(skeleton_animation_record));
+    memcpy(skeleton->tracks, bytes + tracks_at, track_count * sizeof(skeleton_track_record));
+    memcpy(skeleton->keys, bytes + keys_at, key_count * sizeof(skeleton_key_record));
+
+    if (!check_skeleton(skeleton, string_bytes)) {
+        timestep_skeleton_release(skeleton);
+        return NULL;
+    }
+    return skeleton;
+}
+
+void timestep_skeleton_release(timestep_skeleton *skeleton) {
+    if (skeleton && --skeleton->refs == 0) {
+        free(skeleton->strings);
+        free(skeleton->bones);
+        free(skeleton->parts);
+        free(skeleton->animations);
+        free(skeleton->tracks);
+        free(skeleton->keys);
+        free(skeleton->part_handles);
+        free(skeleton);
+    }
+}
+
+int timestep_skeleton_find_animation(timestep_skeleton *skeleton, const char *name) {
+    for (unsigned int i = 0; i < skeleton->animation_count; i++) {
+        if (!strcmp(skeleton->strings + skeleton->animations[i].name, name)) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @name	timestep_skeleton_get_part_handle
+ * @brief	returns the texture handle of a part's image, interning its url
+ *          the first time any pose of the skeleton draws it
+ * @param	skeleton - (timestep_skeleton *) skeleton holding the part
+ * @param	part - (unsigned int) index of the part
+ * @retval	int - texture handle
+ */
+int timestep_skeleton_get_part_handle(timestep_skeleton *skeleton, unsigned int part) {
+    if (!skeleton->part_handles[part]) {
+        skeleton->part_handles[part] = texture_manager_intern_url(skeleton->strings + skeleton->parts[part].url);
+    }
+    return skeleton->part_handles[part];
+}
+
+/**
+ * @name	timestep_skeleton_pose_init
+ * @brief	creates a pose of the skeleton holding its setup position
+ * @param	skeleton - (timestep_skeleton *) skeleton to pose, which gets a
+ *          reference for the pose
+ * @retval	timestep_skeleton_pose* - the pose, or NULL if it could not be
+ *          allocated
+ */
+timestep_skeleton_pose *timestep_skeleton_pose_init(timestep_skeleton *skeleton) {
+    if (!skeleton) {
+        return NULL;
+    }
+
+    timestep_skeleton_pose *pose = (timestep_skeleton_pose *) calloc(1, sizeof(timestep_skeleton_pose));
+    unsigned int parts = skeleton->part_count ? skeleton->part_count : 1;
+    if (pose) {
+        pose->locals = (float *) malloc(skeleton->bone_count * SKELETON_BONE_VALUES * sizeof(float));
+        pose->world = (matrix_3x3 *) malloc(skeleton->bone_count * sizeof(matrix_3x3));
+        pose->transforms = (matrix_3x3 *) malloc(parts * sizeof(matrix_3x3));
+        pose->colors = (rgba *) malloc(parts * sizeof(rgba));
+    }
+    if (!pose || !pose->locals || !pose->world || !pose->transforms || !pose->colors) {
+        LOG("{skeleton} WARNING: Unable to allocate a pose of %u bones", skeleton->bone_count);
+        if (pose) {
+            free(pose->locals);
+            free(pose->world);
+            free(pose->transforms);
+            free(pose->colors);
+            free(pose);
+        }
+        return NULL;
+    }
+
+    skeleton->refs++;
+    pose->skeleton = skeleton;
+    timestep_skeleton_pose_play(pose, -1, false, 1);
+    return pose;
+}
+
+void timestep_skeleton_pose_delete(timestep_skeleton_pose *pose) {
+    if (pose) {
+        timestep_skeleton_release(pose->skeleton);
+        free(pose->locals);
+        free(pose->world);
+        free(pose->transforms);
+        free(pose->colors);
+        free(pose);
+    }
+}
+
+/**
+ * @name	timestep_skeleton_pose_play
+ * @brief	starts an animation from its beginning
+ * @param	pose - (timestep_skeleton_pose *) pose to animate
+ * @param	animation - (int) index of the animation, -1 for the setup pose
+ * @param	loop - (bool) start over at the end instead of stopping there
+ * @param	speed - (float) multiplies the time passed to updates
+ * @retval	NONE
+ */
+void timestep_skeleton_pose_play(timestep_skeleton_pose *pose, int animation, bool loop, float speed) {
+    if (animation >= (int) pose->skeleton->animation_count) {
+        LOG("{skeleton} WARNING: There is no animation %d", animation);
+        animation = -1;
+    }
+    pose->animation = animation < 0 ? -1 : animation;
+    pose->time = 0;
+    pose->speed = speed;
+    pose->loop = loop;
+    pose->playing = animation >= 0;
+    pose->dirty = true;
+}
+
+/**
+ * @name	timestep_skeleton_pose_update
+ * @brief	moves a playing animation on, looping or stopping it at its end
+ * @param	pose - (timestep_skeleton_pose *) pose to advance
+ * @param	dt - (double) elapsed time in ms
+ * @retval	unsigned int - skeleton_update_results the update ran into
+ */
+unsigned int timestep_skeleton_pose_update(timestep_skeleton_pose *pose, double dt) {
+    if (!pose->playing) {
+        return 0;
+    }
+
+    unsigned int results = 0;
+    double duration = pose->skeleton->animations[pose->animation].duration;
+    pose->time += dt * pose->speed;
+    if (pose->time >= duration || pose->time < 0) {
+        if (pose->loop && duration > 0) {
+            pose->time = fmod(pose->time, duration);
+            if (pose->time < 0) {
+                pose->time += duration;
+            }
+            results |= SKELETON_LOOPED;
+        } else {
+            pose->time = pose->time < 0 ? 0 : duration;
+            pose->playing = false;
+            results |= SKELETON_FINISHED;
+        }
+    }
+    pose->dirty = true;
+    return results;
+}
+
+/**
+ * @name	sample_track
+ * @brief	finds a track's value at a time, easing into each key with the
+ *          key's transition
+ * @param	keys - (const skeleton_key_record *) the track's keys, by time
+ * @param	count - (unsigned int) number of keys, at least one
+ * @param	time - (double) ms into the animation
+ * @retval	float - the value
+ */
+static float sample_track(const skeleton_key_record *keys, unsigned int count, double time) {
+    if (time <= keys[0].time) {
+        return keys[0].value;
+    }
+    if (time >= keys[count - 1].time) {
+        return keys[count - 1].value;
+    }
+
+    // the last key at or before time
+    unsigned int low = 0, high = count - 1;
+    while (high - low > 1) {
+        unsigned int mid = (low + high) / 2;
+        if (keys[mid].time <= time) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+
+    const skeleton_key_record *from = &keys[low];
+    const skeleton_key_record *to = &keys[high];
+    unsigned int transition = to->transition;
+    if (transition == SKELETON_KEY_STEPPED) {
+        return from->value;
+    }
+
+    double t = (time - from->time) / (to->time - from->time);
+    if (transition != NO_TRANSITION && transition != LINEAR) {
+        t = view_animation_ease(transition, t, EASING_DEFAULT);
+    }
+    return (float)(from->value + (to->value - from->value) * t);
+}
+
+/**
+ * @name	timestep_skeleton_pose_prepare_draw
+ * @brief	samples the animation at the pose's time, builds each bone's
+ *          transform from its parent's and then each part's transform and
+ *          color. Does nothing when the pose hasn't changed since
+ * @param	pose - (timestep_skeleton_pose *) pose to draw
+ * @retval	unsigned int - number of parts, each with a transform and color
+ */
+unsigned int timestep_skeleton_pose_prepare_draw(timestep_skeleton_pose *pose) {
+    timestep_skeleton *skeleton = pose->skeleton;
+    if (!pose->dirty) {
+        return skeleton->part_count;
+    }
+    pose->dirty = false;
+
+    for (unsigned int i = 0; i < skeleton->bone_count; i++) {
+        const skeleton_bone_record *bone = &skeleton->bones[i];
+        float *local = &pose->locals[i * SKELETON_BONE_VALUES];
+        local[SKELETON_BONE_X] = bone->x;
+        local[SKELETON_BONE_Y] = bone->y;
+        local[SKELETON_BONE_ROTATION] = bone->rotation;
+        local[SKELETON_BONE_SCALE_X] = bone->scale_x;
+        local[SKELETON_BONE_SCALE_Y] = bone->scale_y;
+    }
+    for (unsigned int i = 0; i < skeleton->part_count; i++) {
+        const float *color = skeleton->parts[i].color;
+        rgba *c = &pose->colors[i];
+        c->r = color[0];
+        c->g = color[1];
+        c->b = color[2];
+        c->a = color[3];
+    }
+
+    if (pose->animation >= 0) {
+        const skeleton_animation_record *anim = &skeleton->animations[pose->animation];
+        for (unsigned int i = 0; i < anim->track_count; i++) {
+            const skeleton_track_record *track = &skeleton->tracks[anim->first_track + i];
+            float value = sample_track(&skeleton->keys[track->first_key], track->key_count, pose->time);
+            if (track->property == SKELETON_PART_ALPHA) {
+                pose->colors[track->target].a = value;
+            } else {
+                pose->locals[track->target * SKELETON_BONE_VALUES + track->property] = value;
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < skeleton->bone_count; i++) {
+        const float *local = &pose->locals[i * SKELETON_BONE_VALUES];
+        float c = cosf(local[SKELETON_BONE_ROTATION]);
+        float s = sinf(local[SKELETON_BONE_ROTATION]);
+        matrix_3x3 m;
+        m.m00 = c * local[SKELETON_BONE_SCALE_X];
+        m.m01 = -s * local[SKELETON_BONE_SCALE_Y];
+        m.m02 = local[SKELETON_BONE_X];
+        m.m10 = s * local[SKELETON_BONE_SCALE_X];
+        m.m11 = c * local[SKELETON_BONE_SCALE_Y];
+        m.m12 = local[SKELETON_BONE_Y];
+        m.m20 = 0;
+        m.m21 = 0;
+        m.m22 = 1;
+
+        int32_t parent = skeleton->bones[i].parent;
+        if (parent < 0) {
+            pose->world[i] = m;
+        } else {
+            matrix_3x3_multiply(&pose->world[parent], &m, &pose->world[i]);
+        }
+    }
+
+    for (unsigned int i = 0; i < skeleton->part_count; i++) {
+        const skeleton_part_record *part = &skeleton->parts[i];
+        float c = cosf(part->rotation);
+        float s = sinf(part->rotation);
+        matrix_3x3 m;
+        m.m00 = c;
+        m.m01 = -s;
+        m.m02 = part->x;
+        m.m10 = s;
+        m.m11 = c;
+        m.m12 = part->y;
+        m.m20 = 0;
+        m.m21 = 0;
+        m.m22 = 1;
+        matrix_3x3_multiply(&pose->world[part->bone], &m, &pose->transforms[i]);
+    }
+    return skeleton->part_count;
+}
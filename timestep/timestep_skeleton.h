@@ -0,0 +1,166 @@
+/* @license
+ * This file is part of the Game Closure SDK.
+ *
+ * The Game Closure SDK is free software: you can redistribute it and/or modify
+ * it under the terms of the Mozilla Public License v. 2.0 as published by Mozilla.
+
+ * The Game Closure SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * Mozilla Public License v. 2.0 for more details.
+
+ * You should have received a copy of the Mozilla Public License v. 2.0
+ * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
+ */
+
+#ifndef TIMESTEP_SKELETON_H
+#define TIMESTEP_SKELETON_H
+
+#include "core/util/detect.h"
+#include "core/types.h"
+#include "core/geometry.h"
+#include "core/rgba.h"
+
+// A skeleton is a bone hierarchy with image parts pinned to its bones and
+// keyframed animations of the bones, loaded from one binary blob and shared
+// by every SKELETON_VIEW that draws it. Each view keeps its own pose, so a
+// character is one view sampled and drawn natively instead of a view and a
+// few tweens per limb. Everything is little-endian:
+//
+//   header      "TSK1", bone, part, animation, track and key counts and
+//               string table bytes (uint32 each)
+//   strings     image urls and animation names, each ending in a NUL
+//   bones       bone count skeleton_bone_record, parents before children
+//   parts       part count skeleton_part_record, in draw order
+//   animations  animation count skeleton_animation_record
+//   tracks      track count skeleton_track_record
+//   keys        key count skeleton_key_record, by time within each track
+//
+// Bones are in the space of their parent, roots in the view's, with the
+// origin at the view's anchor. Angles are in radians and times in ms.
+
+#define SKELETON_MAGIC "TSK1"
+
+// a key with this transition holds the value of the key before it
+#define SKELETON_KEY_STEPPED 0xffffffffu
+
+// what a track animates. Bone tracks target a bone, part tracks a part.
+// Values replace the setup pose's, rotations are not wrapped
+enum skeleton_track_properties {
+	SKELETON_BONE_X,
+	SKELETON_BONE_Y,
+	SKELETON_BONE_ROTATION,
+	SKELETON_BONE_SCALE_X,
+	SKELETON_BONE_SCALE_Y,
+	SKELETON_PART_ALPHA,
+	SKELETON_PROPERTY_COUNT
+};
+
+// what timestep_skeleton_pose_update ran into
+enum skeleton_update_results {
+	SKELETON_LOOPED = 1 << 0,
+	SKELETON_FINISHED = 1 << 1
+};
+
+// setup pose of a bone
+typedef struct skeleton_bone_record_t {
+	int32_t parent;         // -1 for a root, or an earlier bone
+	float x;
+	float y;
+	float rotation;
+	float scale_x;
+	float scale_y;
+} skeleton_bone_record;
+
+// a rect of an image drawn centered on x, y in its bone's space
+typedef struct skeleton_part_record_t {
+	uint32_t bone;
+	uint32_t url;           // offset of the url in the string table
+	int32_t src_x;          // rect of the image, in its pixels
+	int32_t src_y;
+	int32_t src_width;
+	int32_t src_height;
+	float x;
+	float y;
+	float rotation;
+	float width;            // size drawn, before the bone's scale
+	float height;
+	float color[4];         // r, g, b, a multiplied into the image
+} skeleton_part_record;
+
+typedef struct skeleton_animation_record_t {
+	uint32_t name;          // offset of the name in the string table
+	float duration;
+	uint32_t first_track;
+	uint32_t track_count;
+} skeleton_animation_record;
+
+typedef struct skeleton_track_record_t {
+	uint32_t target;        // bone or part index
+	uint32_t property;      // skeleton_track_properties
+	uint32_t first_key;
+	uint32_t key_count;     // at least one
+} skeleton_track_record;
+
+typedef struct skeleton_key_record_t {
+	float time;
+	float value;
+	uint32_t transition;    // into this key, NO_TRANSITION for linear, or SKELETON_KEY_STEPPED
+} skeleton_key_record;
+
+typedef struct timestep_skeleton_t {
+	unsigned int bone_count;
+	unsigned int part_count;
+	unsigned int animation_count;
+	unsigned int track_count;
+	unsigned int key_count;
+	char *strings;
+	skeleton_bone_record *bones;
+	skeleton_part_record *parts;
+	skeleton_animation_record *animations;
+	skeleton_track_record *tracks;
+	skeleton_key_record *keys;
+	int *part_handles; // texture handle of each part, interned when first drawn
+	unsigned int refs;
+} timestep_skeleton;
+
+// the local bone values of a pose, in skeleton_track_properties order
+#define SKELETON_BONE_VALUES 5
+
+// a SKELETON_VIEW's playback state, kept in its view_data
+typedef struct timestep_skeleton_pose_t {
+	timestep_skeleton *skeleton;
+	int animation; // -1 holds the setup pose
+	double time; // ms into the animation
+	float speed;
+	bool loop;
+	bool playing;
+	bool dirty; // sampled since the parts were last placed
+
+	float *locals; // SKELETON_BONE_VALUES per bone
+	matrix_3x3 *world; // per bone, in the view's space
+
+	// filled by timestep_skeleton_pose_prepare_draw, per part
+	matrix_3x3 *transforms;
+	rgba *colors;
+} timestep_skeleton_pose;
+
+// checks and copies the blob, NULL if it is malformed. The skeleton starts
+// with one reference for the caller
+CEXPORT timestep_skeleton *timestep_skeleton_load(const void *data, unsigned long size);
+CEXPORT void timestep_skeleton_release(timestep_skeleton *skeleton);
+// index of the animation called name, -1 if there is none
+CEXPORT int timestep_skeleton_find_animation(timestep_skeleton *skeleton, const char *name);
+int timestep_skeleton_get_part_handle(timestep_skeleton *skeleton, unsigned int part);
+
+// a pose in the setup position, with a new reference on the skeleton
+timestep_skeleton_pose *timestep_skeleton_pose_init(timestep_skeleton *skeleton);
+void timestep_skeleton_pose_delete(timestep_skeleton_pose *pose);
+// starts animation from its first key, -1 for the setup pose
+void timestep_skeleton_pose_play(timestep_skeleton_pose *pose, int animation, bool loop, float speed);
+// advances a playing animation by dt ms, returning skeleton_update_results
+unsigned int timestep_skeleton_pose_update(timestep_skeleton_pose *pose, double dt);
+// places every part for the current time, returning how many there are
+unsigned int timestep_skeleton_pose_prepare_draw(timestep_skeleton_pose *pose);
+
+#endif // TIMESTEP_SKELETON_H
@@ -13,29 +13,16 @@
  * along with the Game Closure SDK.  If not, see <http://mozilla.org/MPL/2.0/>.
  */
 
-#ifndef BENCHMARK_H
-#define BENCHMARK_H
+#ifndef TIMESTEP_STATS_H
+#define TIMESTEP_STATS_H
 
-#include "uthash/uthash.h"
+#include "core/util/detect.h"
 
-typedef struct bench_entry_t {
-	const char *name;
-	double start_time;
-	double end_time;
-	UT_hash_handle hh;
-} bench_entry;
+// Counters for perf_stats, in a header C code can include
 
-typedef struct bench_t {
-	bench_entry *benches;
-	double start_time;
-	const char *name;
-} bench;
-
-bench *get_bench(const char *name);
-void start_bench(bench *b, const char *name);
-void end_bench(bench *b, const char *name);
-void print_benches(bench *b);
-
-
-#endif //BENCHMARK_H
+// views created and not yet deleted
+CEXPORT unsigned int timestep_view_count();
+// animations scheduled to tick, paused ones are not
+CEXPORT unsigned int view_animation_active_count();
 
+#endif // TIMESTEP_STATS_H
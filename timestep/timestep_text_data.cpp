@@ -16,7 +16,11 @@
  */
 
 #include "timestep_text_data.h"
+#include "core/text_cache.h"
+#include "core/log.h"
 #include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
 
 
 timestep_text_data *timestep_text_data_init() {
@@ -50,6 +54,14 @@ timestep_text_data *timestep_text_data_init() {
     text_data->shadow_color.b = 0;
     text_data->shadow_color.a = 0;
 
+    text_data->built_signature = 0;
+    text_data->font_name[0] = '\0';
+    text_data->built_lines = NULL;
+    text_data->built_lines_size = 0;
+    text_data->lines = NULL;
+    text_data->line_count = 0;
+    text_data->line_capacity = 0;
+
     return text_data;
 }
 
@@ -58,5 +70,193 @@ void timestep_text_data_delete(timestep_text_data *text_data) {
     free(text_data->font_weight);
     free(text_data->stroke_style);
     free(text_data->text);
+    free(text_data->built_lines);
+    free(text_data->lines);
     free(text_data);
 }
+
+static unsigned int hash_bytes(unsigned int h, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *) data;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+#define HASH_FIELD(h, field) h = hash_bytes(h, &(field), sizeof(field))
+#define HASH_STRING(h, str) h = hash_bytes(h, (str) ? (str) : "", (str) ? strlen(str) + 1 : 1)
+
+/**
+ * @name	layout_signature
+ * @brief	hashes every field the lines are laid out from
+ * @retval	unsigned int - signature, never 0
+ */
+static unsigned int layout_signature(const timestep_text_data *text_data, double width) {
+    unsigned int h = 2166136261u;
+    HASH_FIELD(h, width);
+    HASH_FIELD(h, text_data->horizontal_padding);
+    HASH_FIELD(h, text_data->multiline);
+    HASH_FIELD(h, text_data->font_size);
+    HASH_STRING(h, text_data->font_family);
+    HASH_STRING(h, text_data->font_weight);
+    HASH_STRING(h, text_data->text);
+    return h ? h : 1;
+}
+
+/**
+ * @name	add_line
+ * @brief	appends a line to the layout
+ * @param	text_data - (timestep_text_data *) text being laid out
+ * @param	text - (const char *) start of the line
+ * @param	length - (unsigned int) bytes in the line
+ * @param	width - (float) measured width of the line
+ * @retval	bool - false if there was no memory for it
+ */
+static bool add_line(timestep_text_data *text_data, const char *text, unsigned int length, float width) {
+    if (text_data->line_count == text_data->line_capacity) {
+        unsigned int capacity = text_data->line_capacity ? text_data->line_capacity * 2 : 4;
+        timestep_text_line *lines = (timestep_text_line *) realloc(text_data->lines, capacity * sizeof(timestep_text_line));
+        if (!lines) {
+            return false;
+        }
+        text_data->lines = lines;
+        text_data->line_capacity = capacity;
+    }
+
+    // built_lines was sized for the whole text, one terminator per byte at worst
+    timestep_text_line *line = &text_data->lines[text_data->line_count++];
+    line->offset = text_data->built_lines_size;
+    line->width = width;
+    memcpy(text_data->built_lines + line->offset, text, length);
+    text_data->built_lines[line->offset + length] = '\0';
+    text_data->built_lines_size += length + 1;
+    return true;
+}
+
+static float measure(timestep_text_data *text_data, const char *text, unsigned int length, char *scratch) {
+    memcpy(scratch, text, length);
+    scratch[length] = '\0';
+    return (float) text_cache_measure_text(text_data->font_name, text_data->font_size, scratch);
+}
+
+/**
+ * @name	wrap_paragraph
+ * @brief	breaks a paragraph into lines at spaces, so each fits max_width
+ *			when it can; words wider than that get a line of their own
+ * @param	text_data - (timestep_text_data *) text being laid out
+ * @param	text - (const char *) the paragraph, without its line break
+ * @param	length - (unsigned int) bytes in the paragraph
+ * @param	max_width - (float) width lines should fit, < 0 for no wrapping
+ * @param	scratch - (char *) room for a copy of the paragraph
+ * @retval	bool - false if there was no memory for the lines
+ */
+static bool wrap_paragraph(timestep_text_data *text_data, const char *text, unsigned int length, float max_width, char *scratch) {
+    if (max_width < 0) {
+        return add_line(text_data, text, length, measure(text_data, text, length, scratch));
+    }
+
+    unsigned int start = 0;
+    while (true) {
+        // take words while the line still fits
+        unsigned int end = start;
+        float width = 0;
+        while (end < length) {
+            unsigned int next = end;
+            while (next < length && text[next] == ' ') {
+                next++;
+            }
+            while (next < length && text[next] != ' ') {
+                next++;
+            }
+
+            float next_width = measure(text_data, text + start, next - start, scratch);
+            if (next_width > max_width && end > start) {
+                break;
+            }
+            end = next;
+            width = next_width;
+        }
+
+        if (!add_line(text_data, text + start, end - start, width)) {
+            return false;
+        }
+
+        // the spaces a line breaks at aren't drawn
+        while (end < length && text[end] == ' ') {
+            end++;
+        }
+        if (end >= length) {
+            return true;
+        }
+        start = end;
+    }
+}
+
+/**
+ * @name	timestep_text_data_layout
+ * @brief	splits the text into lines at line breaks and, for multiline
+ *			text, wraps them to the box. the lines are kept until a field
+ *			they depend on changes, so calling this every frame is cheap
+ * @param	text_data - (timestep_text_data *) text to lay out
+ * @param	width - (double) width of the box, padding included
+ * @retval	unsigned int - number of lines in text_data->lines
+ */
+unsigned int timestep_text_data_layout(timestep_text_data *text_data, double width) {
+    unsigned int signature = layout_signature(text_data, width);
+    if (signature == text_data->built_signature) {
+        return text_data->line_count;
+    }
+
+    text_data->built_signature = signature;
+    text_data->line_count = 0;
+    text_data->built_lines_size = 0;
+    const char *text = text_data->text;
+    if (!text || !*text || text_data->font_size <= 0) {
+        return 0;
+    }
+
+    const char *weight = text_data->font_weight;
+    bool plain = !weight || !*weight || !strcmp(weight, "normal");
+    snprintf(text_data->font_name, sizeof(text_data->font_name), "%s%s%s", plain ? "" : weight,
+             plain ? "" : " ", text_data->font_family ? text_data->font_family : "");
+
+    size_t length = strlen(text);
+    free(text_data->built_lines);
+    text_data->built_lines = (char *) malloc(length * 2 + 1);
+    char *scratch = (char *) malloc(length + 1);
+    if (!text_data->built_lines || !scratch) {
+        LOG("{text} WARNING: Unable to lay out %u bytes of text", (unsigned int) length);
+        free(scratch);
+        return 0;
+    }
+
+    float max_width = text_data->multiline ? (float) (width - text_data->horizontal_padding * 2) : -1;
+    const char *paragraph = text;
+    while (true) {
+        const char *end = strchr(paragraph, '\n');
+        unsigned int count = end ? (unsigned int) (end - paragraph) : (unsigned int) strlen(paragraph);
+        if (!wrap_paragraph(text_data, paragraph, count, max_width, scratch)) {
+            LOG("{text} WARNING: Unable to lay out %u bytes of text", (unsigned int) length);
+            text_data->line_count = 0;
+            break;
+        }
+        if (!end) {
+            break;
+        }
+        paragraph = end + 1;
+    }
+
+    free(scratch);
+    return text_data->line_count;
+}
+
+/**
+ * @name	timestep_text_data_line_spacing
+ * @brief	distance between the tops of two lines, line_height is a multiple
+ *			of the font size
+ * @retval	float - spacing, in view pixels
+ */
+float timestep_text_data_line_spacing(const timestep_text_data *text_data) {
+    float line_height = text_data->line_height > 0 ? (float) text_data->line_height : 1;
+    return text_data->font_size * line_height;
+}
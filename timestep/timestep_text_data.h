@@ -18,6 +18,14 @@
 #include "core/types.h"
 #include "core/rgba.h"
 
+#define TEXT_DATA_FONT_NAME_LENGTH 128
+
+// one laid out line, its text is at offset in the text data's built_lines
+typedef struct timestep_text_line_t {
+	unsigned int offset;
+	float width;
+} timestep_text_line;
+
 typedef struct timestep_text_data_t {
 	rgba color;
 	rgba background_color;
@@ -42,9 +50,21 @@ typedef struct timestep_text_data_t {
 
 	bool shadow;
 	rgba shadow_color;
+
+	// lines laid out by timestep_text_data_layout, rebuilt only when the
+	// fields above or the box they are laid out in change
+	unsigned int built_signature;
+	char font_name[TEXT_DATA_FONT_NAME_LENGTH];
+	char *built_lines; // the text of each line, nul terminated
+	unsigned int built_lines_size;
+	timestep_text_line *lines;
+	unsigned int line_count;
+	unsigned int line_capacity;
 } timestep_text_data;
 
 timestep_text_data *timestep_text_data_init();
 void timestep_text_data_delete(timestep_text_data *text_data);
+unsigned int timestep_text_data_layout(timestep_text_data *text_data, double width);
+float timestep_text_data_line_spacing(const timestep_text_data *text_data);
 
 #endif
@@ -18,24 +18,272 @@
 
 #include "core/timestep/timestep_view.h"
 #include "core/timestep/timestep_image_map.h"
+#include "core/timestep/timestep_animate.h"
 #include "core/list.h"
 #include "js/js_timestep_view.h"
 #include "js/js.h"
 #include "core/log.h"
 #include "core/tealeaf_context.h"
+#include "core/draw_textures.h"
+#include "core/display_list.h"
+#include "core/texture_manager.h"
+#include "core/text_cache.h"
+#include "platform/text_manager.h"
+#include "core/events.h"
+#include "core/core.h"
+#include "core/timestep/timestep_events.h"
+#include "core/timestep/timestep_stats.h"
+#include "core/jobs.h"
+#include "core/memory_tags.h"
+#include "core/profiler.h"
+#include "core/frame_timing.h"
+#include "core/deps/uthash/uthash.h"
+#include <math.h>
+#include <pthread.h>
+#include <limits.h>
+#include <stddef.h>
+#include <string.h>
 
 static unsigned int UID = 0;
 static int add_order = 0;
 
-static void default_view_render(timestep_view *v, context_2d *ctx) {
-    return;
+// views are carved out of contiguous slabs so that views created together,
+// which a scene's render walk visits together, share cache lines and pages
+#define VIEW_SLAB_SIZE 256
+
+typedef struct view_slab_t {
+    timestep_view views[VIEW_SLAB_SIZE];
+} view_slab;
+
+// every slab allocated, in order. slabs are never moved or freed, so JS can
+// keep their memory, see timestep_view_get_shared_slab
+static view_slab **view_slabs = NULL;
+static unsigned int slab_count = 0;
+static unsigned int slab_capacity = 0;
+// free views are chained through their superview pointer
+static timestep_view *free_views = NULL;
+
+static timestep_view *alloc_view() {
+    if (!free_views) {
+        if (slab_count == slab_capacity) {
+            unsigned int capacity = slab_capacity ? slab_capacity * 2 : 8;
+            view_slab **slabs = (view_slab **)TAG_REALLOC(MEMORY_TAG_VIEWS, view_slabs, capacity * sizeof(view_slab *));
+            if (!slabs) {
+                return NULL;
+            }
+            view_slabs = slabs;
+            slab_capacity = capacity;
+        }
+
+        view_slab *slab = (view_slab *)TAG_MALLOC(MEMORY_TAG_VIEWS, sizeof(view_slab));
+        if (!slab) {
+            return NULL;
+        }
+        view_slabs[slab_count++] = slab;
+
+        // chain in reverse so views are handed out in address order
+        for (int i = VIEW_SLAB_SIZE - 1; i >= 0; i--) {
+            slab->views[i].superview = free_views;
+            free_views = &slab->views[i];
+        }
+    }
+
+    timestep_view *v = free_views;
+    free_views = v->superview;
+    return v;
 }
 
-static void image_view_render(timestep_view *v, context_2d *ctx) {
-    LOGFN("image_view_render");
+static void release_view(timestep_view *v) {
+    v->superview = free_views;
+    free_views = v;
+}
 
+// live views by uid, open addressed with linear probing. uid 0 marks an
+// empty slot, and removals shift later entries back so probes need no
+// tombstones
+static timestep_view **views_by_uid = NULL;
+static unsigned int uid_table_size = 0;
+static unsigned int uid_table_count = 0;
 
-    timestep_image_map *map = (timestep_image_map *) v->view_data;
+static inline unsigned int uid_slot(unsigned int uid) {
+    return (uid * 2654435761u) & (uid_table_size - 1);
+}
+
+static bool uid_table_insert(timestep_view *v) {
+    if ((uid_table_count + 1) * 2 > uid_table_size) {
+        unsigned int old_size = uid_table_size;
+        timestep_view **old = views_by_uid;
+        unsigned int size = old_size ? old_size * 2 : 256;
+        timestep_view **table = (timestep_view **) TAG_CALLOC(MEMORY_TAG_VIEWS, size, sizeof(timestep_view *));
+        if (!table) {
+            return false;
+        }
+        views_by_uid = table;
+        uid_table_size = size;
+        for (unsigned int i = 0; i < old_size; i++) {
+            if (old[i]) {
+                unsigned int slot = uid_slot(old[i]->uid);
+                while (views_by_uid[slot]) {
+                    slot = (slot + 1) & (size - 1);
+                }
+                views_by_uid[slot] = old[i];
+            }
+        }
+        TAG_FREE(old);
+    }
+
+    unsigned int slot = uid_slot(v->uid);
+    while (views_by_uid[slot]) {
+        slot = (slot + 1) & (uid_table_size - 1);
+    }
+    views_by_uid[slot] = v;
+    uid_table_count++;
+    return true;
+}
+
+static void uid_table_remove(timestep_view *v) {
+    if (!uid_table_size) {
+        return;
+    }
+
+    unsigned int mask = uid_table_size - 1;
+    unsigned int slot = uid_slot(v->uid);
+    while (views_by_uid[slot] && views_by_uid[slot] != v) {
+        slot = (slot + 1) & mask;
+    }
+    if (!views_by_uid[slot]) {
+        return;
+    }
+
+    views_by_uid[slot] = NULL;
+    uid_table_count--;
+    // move back entries that probed past the freed slot
+    for (unsigned int next = (slot + 1) & mask; views_by_uid[next]; next = (next + 1) & mask) {
+        unsigned int home = uid_slot(views_by_uid[next]->uid);
+        bool reachable = slot <= next ? (home <= slot || home > next) : (home <= slot && home > next);
+        if (reachable) {
+            views_by_uid[slot] = views_by_uid[next];
+            views_by_uid[next] = NULL;
+            slot = next;
+        }
+    }
+}
+
+#ifdef TIMESTEP_VIEW_FLOAT_TRANSFORMS
+#define VIEW_FIELD_SCALAR VIEW_FIELD_FLOAT32
+#else
+#define VIEW_FIELD_SCALAR VIEW_FIELD_FLOAT64
+#endif
+
+#define SHARED_FIELD(name, field, type) {name, (unsigned int) offsetof(timestep_view, field), type}
+
+// in the order of sharedProperties in templates/view.json
+static const timestep_view_shared_field shared_fields[] = {
+    SHARED_FIELD("x", x, VIEW_FIELD_SCALAR),
+    SHARED_FIELD("y", y, VIEW_FIELD_SCALAR),
+    SHARED_FIELD("r", r, VIEW_FIELD_SCALAR),
+    SHARED_FIELD("anchorX", anchor_x, VIEW_FIELD_SCALAR),
+    SHARED_FIELD("anchorY", anchor_y, VIEW_FIELD_SCALAR),
+    SHARED_FIELD("offsetX", offset_x, VIEW_FIELD_SCALAR),
+    SHARED_FIELD("offsetY", offset_y, VIEW_FIELD_SCALAR),
+    SHARED_FIELD("scale", scale, VIEW_FIELD_SCALAR),
+    SHARED_FIELD("scaleX", scale_x, VIEW_FIELD_SCALAR),
+    SHARED_FIELD("scaleY", scale_y, VIEW_FIELD_SCALAR),
+    SHARED_FIELD("opacity", opacity, VIEW_FIELD_SCALAR),
+    SHARED_FIELD("visible", visible, VIEW_FIELD_BOOL),
+    SHARED_FIELD("clip", clip, VIEW_FIELD_BOOL),
+    SHARED_FIELD("flipX", flip_x, VIEW_FIELD_BOOL),
+    SHARED_FIELD("flipY", flip_y, VIEW_FIELD_BOOL),
+    SHARED_FIELD("width", width, VIEW_FIELD_FLOAT64),
+    SHARED_FIELD("height", height, VIEW_FIELD_FLOAT64)
+};
+
+/**
+ * @name	timestep_view_get_shared_fields
+ * @brief	describes the view fields JS may read and write in place, in
+ *          the slabs from timestep_view_get_shared_slab
+ * @param	count - (unsigned int *) out, number of fields
+ * @param	stride - (unsigned int *) out, bytes from one view to the next
+ * @retval	const timestep_view_shared_field* - the fields
+ */
+const timestep_view_shared_field *timestep_view_get_shared_fields(unsigned int *count, unsigned int *stride) {
+    *count = sizeof(shared_fields) / sizeof(shared_fields[0]);
+    *stride = sizeof(timestep_view);
+    return shared_fields;
+}
+
+/**
+ * @name	timestep_view_get_shared_slab
+ * @brief	memory of one slab of views, to be wrapped in an ArrayBuffer.
+ *          it stays valid until timestep_view_shutdown
+ * @param	slab - (unsigned int) slab number, from timestep_view_get_shared_location
+ * @param	bytes - (unsigned int *) out, size of the slab
+ * @retval	void* - start of the slab, NULL if there is no such slab
+ */
+void *timestep_view_get_shared_slab(unsigned int slab, unsigned int *bytes) {
+    if (slab >= slab_count) {
+        return NULL;
+    }
+    *bytes = sizeof(view_slab);
+    return view_slabs[slab];
+}
+
+/**
+ * @name	timestep_view_get_shared_location
+ * @brief	finds where a view's fields are in the shared slabs
+ * @param	v - (timestep_view *) view to find
+ * @param	slab - (unsigned int *) out, slab the view is in
+ * @param	index - (unsigned int *) out, position in the slab, its fields
+ *          start index * stride bytes in
+ * @retval	bool - false if the view isn't from a slab
+ */
+bool timestep_view_get_shared_location(timestep_view *v, unsigned int *slab, unsigned int *index) {
+    for (unsigned int i = 0; i < slab_count; i++) {
+        timestep_view *views = view_slabs[i]->views;
+        if (v >= views && v < views + VIEW_SLAB_SIZE) {
+            *slab = i;
+            *index = (unsigned int) (v - views);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @name	timestep_view_get_by_uid
+ * @brief	finds a live view from its uid
+ * @param	uid - (unsigned int) uid of the view
+ * @retval	timestep_view* - the view, or NULL if it was deleted or never
+ *          existed
+ */
+timestep_view *timestep_view_get_by_uid(unsigned int uid) {
+    if (!uid || !uid_table_size) {
+        return NULL;
+    }
+
+    unsigned int mask = uid_table_size - 1;
+    for (unsigned int slot = uid_slot(uid); views_by_uid[slot]; slot = (slot + 1) & mask) {
+        if (views_by_uid[slot]->uid == uid) {
+            return views_by_uid[slot];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @name	timestep_view_count
+ * @brief	counts the live views
+ * @retval	unsigned int - views created and not yet deleted
+ */
+CEXPORT unsigned int timestep_view_count() {
+    return uid_table_count;
+}
+
+static void default_view_render(timestep_view *v, context_2d *ctx) {
+    return;
+}
+
+static void draw_image_map(timestep_view *v, context_2d *ctx, timestep_image_map *map) {
     if (map && map->url) {
         float scale_x = (float)v->width / (map->margin_left + map->width + map->margin_right);
         float scale_y = (float)v->height / (map->margin_top + map->height + map->margin_bottom);
@@ -53,32 +301,573 @@ static void image_view_render(timestep_view *v, context_2d *ctx) {
         };
 #if defined(DEBUG)
         if (map->canary != CANARY_GOOD) {
-            LOG("ERROR: !! The map canary is dead !! %x", map->canary);
-        } else {
+            LOG_ERROR(LOG_CAT_VIEWS, "{view} ERROR: !! The map canary is dead !! %x", map->canary);
+            return;
+        }
 #endif
-            context_2d_drawImage(ctx, 0, map->url, &src_rect, &dest_rect);
-#if defined(DEBUG)
+        const rect_2d *bands;
+        int band_count = map->trim ? timestep_image_map_get_trim(map, &bands) : -1;
+        if (band_count < 0) {
+            context_2d_drawImageHandle(ctx, timestep_image_map_get_handle(map), &src_rect, &dest_rect);
+            return;
+        }
+
+        // each band keeps the scale the whole rect is drawn at
+        rect_2d dest_rects[IMAGE_MAP_TRIM_BANDS];
+        for (int i = 0; i < band_count; i++) {
+            dest_rects[i].x = dest_rect.x + (bands[i].x - map->x) * scale_x;
+            dest_rects[i].y = dest_rect.y + (bands[i].y - map->y) * scale_y;
+            dest_rects[i].width = bands[i].width * scale_x;
+            dest_rects[i].height = bands[i].height * scale_y;
         }
+        context_2d_drawImageRectsHandle(ctx, timestep_image_map_get_handle(map), bands, dest_rects, band_count);
+    }
+}
+
+static void image_view_render(timestep_view *v, context_2d *ctx) {
+    LOGFN("image_view_render");
+    draw_image_map(v, ctx, (timestep_image_map *) v->view_data);
+    LOGFN("end image_view_render");
+}
+
+// shrinks a pair of insets proportionally so they fit in the given length
+static void fit_insets(float *a, float *b, float length) {
+    if (*a + *b > length) {
+        float scale = *a + *b > 0 ? length / (*a + *b) : 0;
+        *a *= scale;
+        *b *= scale;
+    }
+}
+
+/**
+ * @name	nine_slice_view_render
+ * @brief	draws the view's image map as a nine-slice: the corners keep their
+ *          source size, the edges stretch along one axis and the center
+ *          stretches along both, all as one batch of quads
+ * @param	v - (timestep_view *) view to draw
+ * @param	ctx - (context_2d *) context to draw into
+ * @retval	NONE
+ */
+static void nine_slice_view_render(timestep_view *v, context_2d *ctx) {
+    LOGFN("nine_slice_view_render");
+    timestep_image_map *map = (timestep_image_map *) v->view_data;
+    if (!map || !map->url) {
+        return;
+    }
+
+#if defined(DEBUG)
+    if (map->canary != CANARY_GOOD) {
+        LOG_ERROR(LOG_CAT_VIEWS, "{view} ERROR: !! The map canary is dead !! %x", map->canary);
+        return;
+    }
 #endif
+
+    // place the image inside the view exactly as image_view_render does
+    float scale_x = (float)v->width / (map->margin_left + map->width + map->margin_right);
+    float scale_y = (float)v->height / (map->margin_top + map->height + map->margin_bottom);
+    float dest_x = scale_x * map->margin_left;
+    float dest_y = scale_y * map->margin_top;
+    float dest_w = scale_x * map->width;
+    float dest_h = scale_y * map->height;
+
+    float src_left = v->slice_left, src_right = v->slice_right;
+    float src_top = v->slice_top, src_bottom = v->slice_bottom;
+    fit_insets(&src_left, &src_right, map->width);
+    fit_insets(&src_top, &src_bottom, map->height);
+
+    float dest_left = src_left, dest_right = src_right;
+    float dest_top = src_top, dest_bottom = src_bottom;
+    fit_insets(&dest_left, &dest_right, dest_w);
+    fit_insets(&dest_top, &dest_bottom, dest_h);
+
+    float sx[4] = { static_cast<float>(map->x), map->x + src_left, map->x + map->width - src_right, static_cast<float>(map->x + map->width) };
+    float sy[4] = { static_cast<float>(map->y), map->y + src_top, map->y + map->height - src_bottom, static_cast<float>(map->y + map->height) };
+    float dx[4] = { dest_x, dest_x + dest_left, dest_x + dest_w - dest_right, dest_x + dest_w };
+    float dy[4] = { dest_y, dest_y + dest_top, dest_y + dest_h - dest_bottom, dest_y + dest_h };
+
+    rect_2d src_rects[9];
+    rect_2d dest_rects[9];
+    int count = 0;
+    for (int row = 0; row < 3; row++) {
+        for (int col = 0; col < 3; col++) {
+            rect_2d src = { sx[col], sy[row], sx[col + 1] - sx[col], sy[row + 1] - sy[row] };
+            rect_2d dest = { dx[col], dy[row], dx[col + 1] - dx[col], dy[row + 1] - dy[row] };
+
+            // zero insets collapse their slices
+            if (src.width > 0 && src.height > 0 && dest.width > 0 && dest.height > 0) {
+                src_rects[count] = src;
+                dest_rects[count] = dest;
+                count++;
+            }
+        }
     }
 
+    context_2d_drawImageRectsHandle(ctx, timestep_image_map_get_handle(map), src_rects, dest_rects, count);
+    LOGFN("end nine_slice_view_render");
+}
 
-    LOGFN("end image_view_render");
+static void sprite_view_render(timestep_view *v, context_2d *ctx) {
+    LOGFN("sprite_view_render");
+    timestep_sprite_state *state = (timestep_sprite_state *) v->view_data;
+    if (state && state->sprite && state->frame < state->sprite->frame_count) {
+        draw_image_map(v, ctx, state->sprite->frames[state->frame]);
+    }
+    LOGFN("end sprite_view_render");
+}
+
+static void dispatch_view_event(timestep_view *v, const char *name) {
+    char event_str[128];
+    snprintf(event_str, sizeof(event_str), "{\"name\":\"%s\",\"uid\":%u,\"priority\":0}", name, v->uid);
+    core_dispatch_event(event_str);
+}
+
+/**
+ * @name	sprite_view_tick
+ * @brief	advances the sprite's frame natively, only calling out to JS
+ *          (through spriteLoop / spriteFinish events) at the ends of the
+ *          animation
+ * @param	v - (timestep_view *) sprite view to advance
+ * @param	dt - (double) elapsed time in ms
+ * @retval	NONE
+ */
+static void sprite_view_tick(timestep_view *v, double dt) {
+    timestep_sprite_state *state = (timestep_sprite_state *) v->view_data;
+    if (!state || !state->playing || !state->sprite || !state->sprite->fps || !state->sprite->frame_count) {
+        return;
+    }
+
+    timestep_sprite *sprite = state->sprite;
+    double frame_time = 1000.0 / sprite->fps;
+    unsigned int frame = state->frame;
+    state->elapsed += dt;
+
+    while (state->elapsed >= frame_time) {
+        state->elapsed -= frame_time;
+
+        if (++frame < sprite->frame_count) {
+            continue;
+        }
+
+        if (state->loop) {
+            frame = 0;
+            dispatch_view_event(v, "spriteLoop");
+        } else {
+            frame = sprite->frame_count - 1;
+            state->playing = false;
+            state->elapsed = 0;
+            dispatch_view_event(v, "spriteFinish");
+            break;
+        }
+    }
+
+    if (state->frame != frame) {
+        state->frame = frame;
+        timestep_view_damage(v);
+    }
+}
+
+static void free_sprite_state(timestep_view *v) {
+    timestep_sprite_state *state = (timestep_sprite_state *) v->view_data;
+    if (state) {
+        if (state->sprite) {
+            timestep_sprite_delete(state->sprite);
+        }
+        free(state);
+    }
+    v->view_data = NULL;
 }
 
 static void default_view_tick(timestep_view *v, double dt) {
 }
 
+// drawn further down, it culls its chunks like views are culled
+static void tilemap_view_render(timestep_view *v, context_2d *ctx);
+
+static void free_tilemap_state(timestep_view *v) {
+    if (v->view_data) {
+        timestep_tilemap_delete((timestep_tilemap *) v->view_data);
+    }
+    v->view_data = NULL;
+}
+
+/**
+ * @name	particle_view_render
+ * @brief	draws every live particle of the view's emitter around the view's
+ *          anchor, all as one batch of quads
+ * @param	v - (timestep_view *) PARTICLE_VIEW to draw
+ * @param	ctx - (context_2d *) context to draw to
+ * @retval	NONE
+ */
+static void particle_view_render(timestep_view *v, context_2d *ctx) {
+    LOGFN("particle_view_render");
+    timestep_particle_emitter *emitter = (timestep_particle_emitter *) v->view_data;
+    if (!emitter || !emitter->count || !emitter->image || !emitter->image->url) {
+        return;
+    }
+
+    timestep_image_map *map = emitter->image;
+    rect_2d src = {(float) map->x, (float) map->y, (float) map->width, (float) map->height};
+    float full_width = map->margin_left + map->width + map->margin_right;
+    float full_height = map->margin_top + map->height + map->margin_bottom;
+    rect_2d dest = {map->margin_left - full_width / 2, map->margin_top - full_height / 2, (float) map->width, (float) map->height};
+
+    unsigned int count = timestep_particle_emitter_prepare_draw(emitter);
+    context_2d_save(ctx);
+    context_2d_translate(ctx, v->anchor_x, v->anchor_y);
+    context_2d_drawImageTransformsHandle(ctx, timestep_image_map_get_handle(map), &src, &dest, emitter->transforms, emitter->colors, count);
+    context_2d_restore(ctx);
+    LOGFN("end particle_view_render");
+}
+
+/**
+ * @name	particle_view_tick
+ * @brief	advances the view's particles natively, only calling out to JS
+ *          (through a particlesFinish event) once the emitter has stopped
+ *          and its last particle died
+ * @param	v - (timestep_view *) particle view to advance
+ * @param	dt - (double) elapsed time in ms
+ * @retval	NONE
+ */
+static void particle_view_tick(timestep_view *v, double dt) {
+    timestep_particle_emitter *emitter = (timestep_particle_emitter *) v->view_data;
+    if (!emitter || (!emitter->count && !emitter->emitting)) {
+        return;
+    }
+
+    bool finished = timestep_particle_emitter_update(emitter, (float) dt);
+    timestep_view_damage(v);
+    if (finished) {
+        dispatch_view_event(v, "particlesFinish");
+    }
+}
+
+static void free_particle_state(timestep_view *v) {
+    timestep_particle_emitter_delete((timestep_particle_emitter *) v->view_data);
+    v->view_data = NULL;
+}
+
+/**
+ * @name	skeleton_view_render
+ * @brief	draws the parts of the view's skeleton, posed around the view's
+ *          anchor, straight into the batch
+ * @param	v - (timestep_view *) SKELETON_VIEW to draw
+ * @param	ctx - (context_2d *) context to draw to
+ * @retval	NONE
+ */
+static void skeleton_view_render(timestep_view *v, context_2d *ctx) {
+    LOGFN("skeleton_view_render");
+    timestep_skeleton_pose *pose = (timestep_skeleton_pose *) v->view_data;
+    if (!pose) {
+        return;
+    }
+
+    timestep_skeleton *skeleton = pose->skeleton;
+    unsigned int count = timestep_skeleton_pose_prepare_draw(pose);
+    context_2d_save(ctx);
+    context_2d_translate(ctx, v->anchor_x, v->anchor_y);
+    for (unsigned int i = 0; i < count; i++) {
+        if (pose->colors[i].a <= 0) {
+            continue;
+        }
+        const skeleton_part_record *part = &skeleton->parts[i];
+        rect_2d src = {(float) part->src_x, (float) part->src_y, (float) part->src_width, (float) part->src_height};
+        rect_2d dest = {-part->width / 2, -part->height / 2, part->width, part->height};
+        context_2d_drawImageTransformsHandle(ctx, timestep_skeleton_get_part_handle(skeleton, i), &src, &dest,
+                                             &pose->transforms[i], &pose->colors[i], 1);
+    }
+    context_2d_restore(ctx);
+    LOGFN("end skeleton_view_render");
+}
+
+/**
+ * @name	skeleton_view_tick
+ * @brief	advances the view's skeletal animation natively, calling out to
+ *          JS only when it loops or finishes
+ * @param	v - (timestep_view *) skeleton view to advance
+ * @param	dt - (double) elapsed time in ms
+ * @retval	NONE
+ */
+static void skeleton_view_tick(timestep_view *v, double dt) {
+    timestep_skeleton_pose *pose = (timestep_skeleton_pose *) v->view_data;
+    if (!pose || !pose->playing) {
+        return;
+    }
+
+    unsigned int results = timestep_skeleton_pose_update(pose, dt);
+    timestep_view_damage(v);
+    if (results & SKELETON_LOOPED) {
+        dispatch_view_event(v, "skeletonLoop");
+    }
+    if (results & SKELETON_FINISHED) {
+        dispatch_view_event(v, "skeletonFinish");
+    }
+}
+
+static void free_skeleton_state(timestep_view *v) {
+    timestep_skeleton_pose_delete((timestep_skeleton_pose *) v->view_data);
+    v->view_data = NULL;
+}
+
+// the rows are subviews, drawn by the usual walk
+static void scroll_view_render(timestep_view *v, context_2d *ctx) {
+}
+
+// binds of one tick go out in as few events as fit
+#define SCROLL_BIND_EVENT_BYTES 1024
+#define SCROLL_BIND_ENTRY_BYTES 32
+
+typedef struct scroll_bind_event_t {
+    char str[SCROLL_BIND_EVENT_BYTES];
+    int length;
+    int header;
+} scroll_bind_event;
+
+static void scroll_bind_flush(scroll_bind_event *e) {
+    if (e->length > e->header) {
+        // replaces the last comma
+        snprintf(e->str + e->length - 1, sizeof(e->str) - e->length + 1, "]}");
+        core_dispatch_event(e->str);
+    }
+    e->length = e->header;
+}
+
+static void scroll_bind_add(scroll_bind_event *e, unsigned int uid, int row) {
+    if (e->length + SCROLL_BIND_ENTRY_BYTES > (int) sizeof(e->str)) {
+        scroll_bind_flush(e);
+    }
+    e->length += snprintf(e->str + e->length, sizeof(e->str) - e->length, "[%u,%d],", uid, row);
+}
+
+// rows from the first in range already shown by a row view, reused per tick
+static bool *scroll_covered = NULL;
+static unsigned int scroll_covered_size = 0;
+
+/**
+ * @name	place_scroll_rows
+ * @brief	frees the row views that scrolled out of range, binds free ones
+ *          to the rows that came into it, and moves the bound ones into
+ *          place. Binds reach JS as scrollBind events listing the row view
+ *          uid and row of each, and a pool too small for the rows in range
+ *          sends scrollNeedRows with the number of row views wanted
+ * @param	v - (timestep_view *) SCROLL_VIEW
+ * @param	scroll - (timestep_scroll *) its state
+ * @retval	NONE
+ */
+static void place_scroll_rows(timestep_view *v, timestep_scroll *scroll) {
+    unsigned int first, end;
+    timestep_scroll_get_row_range(scroll, &first, &end);
+    unsigned int range = end - first;
+    if (range > scroll_covered_size) {
+        bool *covered = (bool *) TAG_REALLOC(MEMORY_TAG_VIEWS, scroll_covered, sizeof(bool) * range);
+        if (!covered) {
+            return;
+        }
+        scroll_covered = covered;
+        scroll_covered_size = range;
+    }
+    memset(scroll_covered, 0, sizeof(bool) * range);
+
+    // row views JS took out of the scroll view leave the pool
+    unsigned int i = 0;
+    while (i < scroll->row_view_count) {
+        timestep_scroll_row *r = &scroll->rows[i];
+        timestep_view *row_view = timestep_view_get_by_uid(r->uid);
+        if (!row_view || row_view->superview != v) {
+            *r = scroll->rows[--scroll->row_view_count];
+            continue;
+        }
+        if (r->row >= (int) first && r->row < (int) end) {
+            scroll_covered[r->row - first] = true;
+        } else {
+            r->row = -1;
+        }
+        i++;
+    }
+
+    scroll_bind_event e;
+    e.header = e.length = snprintf(e.str, sizeof(e.str), "{\"name\":\"scrollBind\",\"uid\":%u,\"priority\":0,\"rows\":[", v->uid);
+    unsigned int next_free = 0;
+    for (unsigned int row = first; row < end; row++) {
+        if (scroll_covered[row - first]) {
+            continue;
+        }
+        while (next_free < scroll->row_view_count && scroll->rows[next_free].row >= 0) {
+            next_free++;
+        }
+        if (next_free == scroll->row_view_count) {
+            if (!scroll->wants_more) {
+                char event_str[128];
+                snprintf(event_str, sizeof(event_str), "{\"name\":\"scrollNeedRows\",\"uid\":%u,\"count\":%u,\"priority\":0}",
+                         v->uid, timestep_scroll_wanted_row_views(scroll));
+                core_dispatch_event(event_str);
+                scroll->wants_more = true;
+            }
+            break;
+        }
+        scroll->rows[next_free].row = row;
+        scroll_bind_add(&e, scroll->rows[next_free].uid, row);
+    }
+    scroll_bind_flush(&e);
+
+    for (i = 0; i < scroll->row_view_count; i++) {
+        timestep_scroll_row *r = &scroll->rows[i];
+        timestep_view *row_view = timestep_view_get_by_uid(r->uid);
+        bool visible = r->row >= 0;
+        timestep_view_scalar *position = scroll->horizontal ? &row_view->x : &row_view->y;
+        timestep_view_scalar at = visible ? (timestep_view_scalar) (r->row * scroll->row_height - scroll->offset) : *position;
+        if (row_view->visible != visible || *position != at) {
+            row_view->visible = visible;
+            *position = at;
+            timestep_view_mark_moved(row_view);
+        }
+    }
+}
+
+/**
+ * @name	scroll_view_tick
+ * @brief	advances the view's fling or spring natively and places its rows
+ *          when they moved, calling out to JS only to bind rows and with a
+ *          scrollEnd event when a fling or spring comes to rest
+ * @param	v - (timestep_view *) scroll view to advance
+ * @param	dt - (double) elapsed time in ms
+ * @retval	NONE
+ */
+static void scroll_view_tick(timestep_view *v, double dt) {
+    timestep_scroll *scroll = (timestep_scroll *) v->view_data;
+    if (!scroll) {
+        return;
+    }
+
+    unsigned int results = timestep_scroll_update(scroll, dt, scroll->horizontal ? v->width : v->height);
+    if (results & SCROLL_MOVED) {
+        place_scroll_rows(v, scroll);
+        timestep_view_damage(v);
+    }
+    if (results & SCROLL_SETTLED) {
+        dispatch_view_event(v, "scrollEnd");
+    }
+}
+
+static void free_scroll_state(timestep_view *v) {
+    timestep_scroll_delete((timestep_scroll *) v->view_data);
+    v->view_data = NULL;
+}
+
+// how far down and right a text shadow is drawn
+#define TEXT_SHADOW_OFFSET 2
+
+static void draw_text_line(context_2d *ctx, timestep_text_data *text_data, const char *line, rgba *color, int text_style, float stroke_width, float center_x, float center_y) {
+    texture_2d *tex = text_cache_get_text(text_data->font_name, text_data->font_size, line, color, 0, text_style, stroke_width);
+    if (!tex || !tex->loaded) {
+        return;
+    }
+
+    // strokes grow the texture on every side, centering keeps them aligned
+    float width = (float) tex->originalWidth;
+    float height = (float) tex->originalHeight;
+    rect_2d src = {0, 0, width, height};
+    rect_2d dest = {center_x - width / 2, center_y - height / 2, width, height};
+    context_2d_fillText(ctx, tex, &src, &dest, 1);
+}
+
+/**
+ * @name	text_view_render
+ * @brief	draws the view's text data natively: lines are laid out and
+ *          wrapped once per change to the text, and their textures come
+ *          from the text cache
+ * @param	v - (timestep_view *) TEXT_VIEW to draw
+ * @param	ctx - (context_2d *) context to draw to
+ * @retval	NONE
+ */
+static void text_view_render(timestep_view *v, context_2d *ctx) {
+    LOGFN("text_view_render");
+    timestep_text_data *text_data = (timestep_text_data *) v->view_data;
+    if (!text_data) {
+        return;
+    }
+
+    if (text_data->background_color.a > 0) {
+        rect_2d rect = {0, 0, (float) v->width, (float) v->height};
+        context_2d_fillRect(ctx, &rect, &text_data->background_color);
+    }
+
+    unsigned int count = timestep_text_data_layout(text_data, v->width);
+    if (!count) {
+        return;
+    }
+
+    float spacing = timestep_text_data_line_spacing(text_data);
+    float total = spacing * count;
+    float padding_x = (float) text_data->horizontal_padding;
+    float padding_y = (float) text_data->vertical_padding;
+    const char *vertical_align = text_data->vertical_align ? text_data->vertical_align : "";
+    const char *text_align = text_data->text_align ? text_data->text_align : "";
+    float top = (float) (v->height - total) / 2;
+    if (!strcmp(vertical_align, "top")) {
+        top = padding_y;
+    } else if (!strcmp(vertical_align, "bottom")) {
+        top = (float) v->height - padding_y - total;
+    }
+
+    rgba stroke_color;
+    bool stroke = text_data->stroke_style && *text_data->stroke_style && text_data->line_width > 0;
+    if (stroke) {
+        rgba_parse(&stroke_color, text_data->stroke_style);
+    }
+    bool shadow = text_data->shadow && text_data->shadow_color.a > 0;
+
+    for (unsigned int i = 0; i < count; i++) {
+        const timestep_text_line *line = &text_data->lines[i];
+        const char *text = text_data->built_lines + line->offset;
+        if (!*text) {
+            continue;
+        }
+
+        float left = (float) (v->width - line->width) / 2;
+        if (!strcmp(text_align, "left")) {
+            left = padding_x;
+        } else if (!strcmp(text_align, "right")) {
+            left = (float) v->width - padding_x - line->width;
+        }
+
+        float center_x = left + line->width / 2;
+        float center_y = top + spacing * (i + 0.5f);
+        if (shadow) {
+            draw_text_line(ctx, text_data, text, &text_data->shadow_color, TEXT_STYLE_FILL, 0,
+                           center_x + TEXT_SHADOW_OFFSET, center_y + TEXT_SHADOW_OFFSET);
+        }
+        if (stroke) {
+            draw_text_line(ctx, text_data, text, &stroke_color, TEXT_STYLE_STROKE, (float) text_data->line_width, center_x, center_y);
+        }
+        draw_text_line(ctx, text_data, text, &text_data->color, TEXT_STYLE_FILL, 0, center_x, center_y);
+    }
+    LOGFN("end text_view_render");
+}
+
+static void free_text_state(timestep_view *v) {
+    if (v->view_data) {
+        timestep_text_data_delete((timestep_text_data *) v->view_data);
+    }
+    v->view_data = NULL;
+}
+
 timestep_view *timestep_view_init() {
     LOGFN("timestep_view_init");
-    timestep_view *v = (timestep_view*)malloc(sizeof(timestep_view));
+    timestep_view *v = alloc_view();
+    if (!v) {
+        LOG("{view} WARNING: Unable to allocate a view");
+        return NULL;
+    }
     v->uid = ++UID;
+    if (!uid_table_insert(v)) {
+        LOG("{view} WARNING: Unable to index view %u by uid", v->uid);
+    }
     v->has_jsrender = false;
     v->has_jstick = false;
 
     v->superview = NULL;
-    v->subview_array_size = 4;
-    v->subviews = (timestep_view**)malloc(sizeof(timestep_view*) * v->subview_array_size);
+    v->subview_array_size = TIMESTEP_VIEW_INLINE_SUBVIEWS;
+    v->subviews = v->inline_subviews;
 
     v->subview_count = 0;
     v->subview_index = 0;
@@ -93,6 +882,39 @@ timestep_view *timestep_view_init() {
     v->offset_y = 0;
     v->flip_x = false;
     v->flip_y = false;
+    v->order_independent = false;
+    v->sort_by_draw_state = false;
+    v->draw_state_sorted = false;
+    v->cache_as_bitmap = false;
+    v->cache_dirty = true;
+    v->cache_signature = 0;
+    v->cache_ctx = NULL;
+    v->draws_outside_bounds = false;
+    v->static_render = false;
+    v->render_list = NULL;
+    v->world_bounds.x = 0;
+    v->world_bounds.y = 0;
+    v->world_bounds.width = 0;
+    v->world_bounds.height = 0;
+    v->culled = false;
+    v->damage_queued = false;
+    matrix_3x3_identity(&v->local_transform);
+    matrix_3x3_identity(&v->world_transform);
+    v->world_version = 0;
+    v->parent_version = 0;
+    v->transform_dirty = true;
+    v->local_translation_only = true;
+    v->tick_count = 0;
+    v->tick_registered = false;
+    v->spatial_index = NULL;
+    v->index_slot = 0;
+    v->index_stamp = 0;
+    v->index_state = 0;
+    v->index_dirty = false;
+    v->slice_top = 0;
+    v->slice_right = 0;
+    v->slice_bottom = 0;
+    v->slice_left = 0;
     v->scale = 1;
     v->scale_x = 1;
     v->scale_y = 1;
@@ -101,6 +923,7 @@ timestep_view *timestep_view_init() {
     v->visible = true;
     v->z_index = 0;
     v->dirty_z_index = false;
+    v->draw_key = 0;
     v->opacity = 1;
     v->timestep_view_render = default_view_render;
     v->timestep_view_tick = default_view_tick;
@@ -117,7 +940,11 @@ timestep_view *timestep_view_init() {
     v->anim_count = 0;
     v->max_anims = 0;
     v->anims = NULL;
+    v->anim_stage = 0;
+    v->anim_interp = 0;
     v->view_data = NULL;
+    v->owned_map = NULL;
+    v->prefab_owned = false;
     js_object_wrapper_init(&v->map_ref);
 
     v->filter_color.r = 0;
@@ -126,209 +953,2691 @@ timestep_view *timestep_view_init() {
     v->filter_color.a = 0;
     v->filter_type = 0;
 
-    LOGFN("end timestep_view_init");
+    LOGFN("end timestep_view_init");
+
+    return v;
+}
+
+/**
+ * @name	free_owned_map
+ * @brief	frees the image map the view made natively, leaving view_data
+ *          alone if JS has pointed it at another map since
+ * @param	v - (timestep_view *) view to update
+ * @retval	NONE
+ */
+static void free_owned_map(timestep_view *v) {
+    if (v->owned_map) {
+        if (v->view_data == v->owned_map) {
+            v->view_data = NULL;
+        }
+        timestep_image_delete(v->owned_map);
+        v->owned_map = NULL;
+    }
+}
+
+static void add_tick_count(timestep_view *v, int delta) {
+    while (v) {
+        v->tick_count += delta;
+        v = v->superview;
+    }
+}
+
+/**
+ * @name	refresh_tick
+ * @brief	registers or unregisters the view's own tick with its ancestors'
+ *          tick counts when it gains or loses a JS or native tick
+ * @param	v - (timestep_view *) view to check
+ * @retval	NONE
+ */
+static void refresh_tick(timestep_view *v) {
+    bool ticks = v->has_jstick || v->timestep_view_tick != default_view_tick;
+    if (ticks != v->tick_registered) {
+        v->tick_registered = ticks;
+        add_tick_count(v, ticks ? 1 : -1);
+    }
+}
+
+/**
+ * @name	timestep_view_set_sprite
+ * @brief	hands the sprite to a SPRITE_VIEW and starts playing it from the
+ *          first frame, freeing any sprite it had before
+ * @param	v - (timestep_view *) view, already set to SPRITE_VIEW
+ * @param	sprite - (timestep_sprite *) sprite the view takes ownership of
+ * @param	loop - (bool) whether to loop or stop on the last frame
+ * @retval	NONE
+ */
+void timestep_view_set_sprite(timestep_view *v, timestep_sprite *sprite, bool loop) {
+    if (v->timestep_view_render != sprite_view_render) {
+        LOG("{view} WARNING: Tried to set a sprite on view %u, which is not a sprite view", v->uid);
+        return;
+    }
+
+    timestep_sprite_state *state = (timestep_sprite_state *) v->view_data;
+    if (state->sprite && state->sprite != sprite) {
+        timestep_sprite_delete(state->sprite);
+    }
+
+    state->sprite = sprite;
+    state->frame = 0;
+    state->elapsed = 0;
+    state->loop = loop;
+    state->playing = true;
+    timestep_view_damage(v);
+}
+
+/**
+ * @name	timestep_view_set_image_map
+ * @brief	hands the image map to an IMAGE_VIEW or NINE_SLICE_VIEW, freeing
+ *          any map it was handed before. For views built natively, whose
+ *          map has no JS object to own it
+ * @param	v - (timestep_view *) view, already set to IMAGE_VIEW or
+ *          NINE_SLICE_VIEW
+ * @param	map - (timestep_image_map *) map the view takes ownership of
+ * @retval	NONE
+ */
+void timestep_view_set_image_map(timestep_view *v, timestep_image_map *map) {
+    if (v->timestep_view_render != image_view_render && v->timestep_view_render != nine_slice_view_render) {
+        LOG("{view} WARNING: Tried to set an image map on view %u, which is not an image view", v->uid);
+        return;
+    }
+
+    if (v->owned_map != map) {
+        free_owned_map(v);
+        v->owned_map = map;
+    }
+    v->view_data = map;
+    timestep_view_damage(v);
+}
+
+/**
+ * @name	timestep_view_set_sheet_frame
+ * @brief	shows a frame of a packed sheet in an IMAGE_VIEW or
+ *          NINE_SLICE_VIEW, holding a reference on the sheet
+ * @param	v - (timestep_view *) view, already set to IMAGE_VIEW or
+ *          NINE_SLICE_VIEW
+ * @param	sheet - (timestep_sheet *) sheet the frame is in
+ * @param	index - (unsigned int) index of the frame
+ * @retval	bool - false if the sheet has no such frame
+ */
+bool timestep_view_set_sheet_frame(timestep_view *v, timestep_sheet *sheet, unsigned int index) {
+    if (index < sheet->frame_count && v->owned_map == &sheet->frames[index]) {
+        v->view_data = v->owned_map;
+        return true;
+    }
+    timestep_image_map *map = timestep_sheet_get_frame(sheet, index);
+    if (!map) {
+        LOG("{view} WARNING: Sheet has no frame %u for view %u", index, v->uid);
+        return false;
+    }
+    timestep_view_set_image_map(v, map);
+    // a view that can't take the map leaves the reference with us
+    if (v->owned_map != map) {
+        timestep_image_delete(map);
+        return false;
+    }
+    return true;
+}
+
+void timestep_view_stop_sprite(timestep_view *v) {
+    if (v->timestep_view_render == sprite_view_render) {
+        ((timestep_sprite_state *) v->view_data)->playing = false;
+    }
+}
+
+unsigned int timestep_view_get_sprite_frame(timestep_view *v) {
+    if (v->timestep_view_render != sprite_view_render) {
+        return 0;
+    }
+    return ((timestep_sprite_state *) v->view_data)->frame;
+}
+
+/**
+ * @name	timestep_view_set_sprite_frame
+ * @brief	shows the given frame of a SPRITE_VIEW's sprite, clamped to its
+ *          frames. A playing sprite carries on from there
+ * @param	v - (timestep_view *) sprite view
+ * @param	frame - (unsigned int) frame to show
+ * @retval	NONE
+ */
+void timestep_view_set_sprite_frame(timestep_view *v, unsigned int frame) {
+    if (v->timestep_view_render != sprite_view_render) {
+        return;
+    }
+
+    timestep_sprite_state *state = (timestep_sprite_state *) v->view_data;
+    if (state->sprite && frame >= state->sprite->frame_count) {
+        frame = state->sprite->frame_count ? state->sprite->frame_count - 1 : 0;
+    }
+    if (state->frame != frame) {
+        state->frame = frame;
+        state->elapsed = 0;
+        timestep_view_damage(v);
+    }
+}
+
+/**
+ * @name	timestep_view_set_has_jstick
+ * @brief	sets whether the view has a JS tick, keeping the tick counts that
+ *          let the tick walk skip idle subtrees up to date
+ * @param	v - (timestep_view *) view to update
+ * @param	has_jstick - (bool) whether the view has a JS tick
+ * @retval	NONE
+ */
+/**
+ * @name	timestep_view_set_tilemap
+ * @brief	hands the tile grid to a TILEMAP_VIEW, freeing any it had before.
+ *          the view's size is split evenly between the tiles
+ * @param	v - (timestep_view *) view, already set to TILEMAP_VIEW
+ * @param	tilemap - (timestep_tilemap *) tilemap the view takes ownership of
+ * @retval	NONE
+ */
+void timestep_view_set_tilemap(timestep_view *v, timestep_tilemap *tilemap) {
+    if (v->timestep_view_render != tilemap_view_render) {
+        LOG("{view} WARNING: Tried to set a tilemap on view %u, which is not a tilemap view", v->uid);
+        return;
+    }
+
+    if (v->view_data != tilemap) {
+        free_tilemap_state(v);
+        v->view_data = tilemap;
+    }
+    timestep_view_damage(v);
+}
+
+bool timestep_view_set_tile(timestep_view *v, unsigned int column, unsigned int row, int tile) {
+    if (v->timestep_view_render != tilemap_view_render || !v->view_data) {
+        return false;
+    }
+
+    timestep_tilemap *tilemap = (timestep_tilemap *) v->view_data;
+    unsigned int version = tilemap->version;
+    if (!timestep_tilemap_set_tile(tilemap, column, row, tile)) {
+        return false;
+    }
+    if (tilemap->version != version) {
+        timestep_view_damage(v);
+    }
+    return true;
+}
+
+/**
+ * @name	timestep_view_set_particle_emitter
+ * @brief	hands the emitter to a PARTICLE_VIEW, freeing any it had before.
+ *          Particles are drawn wherever they travel, so views whose
+ *          particles leave their bounds should set draws_outside_bounds
+ * @param	v - (timestep_view *) view, already set to PARTICLE_VIEW
+ * @param	emitter - (timestep_particle_emitter *) emitter the view takes
+ *          ownership of
+ * @retval	NONE
+ */
+void timestep_view_set_particle_emitter(timestep_view *v, timestep_particle_emitter *emitter) {
+    if (v->timestep_view_render != particle_view_render) {
+        LOG("{view} WARNING: Tried to set a particle emitter on view %u, which is not a particle view", v->uid);
+        return;
+    }
+
+    if (v->view_data != emitter) {
+        free_particle_state(v);
+        v->view_data = emitter;
+    }
+    timestep_view_damage(v);
+}
+
+/**
+ * @name	timestep_view_set_skeleton_pose
+ * @brief	hands the pose to a SKELETON_VIEW, freeing any it had before.
+ *          Parts are drawn wherever the bones put them, so views whose
+ *          parts leave their bounds should set draws_outside_bounds
+ * @param	v - (timestep_view *) view, already set to SKELETON_VIEW
+ * @param	pose - (timestep_skeleton_pose *) pose the view takes ownership of
+ * @retval	NONE
+ */
+void timestep_view_set_skeleton_pose(timestep_view *v, timestep_skeleton_pose *pose) {
+    if (v->timestep_view_render != skeleton_view_render) {
+        LOG("{view} WARNING: Tried to set a skeleton pose on view %u, which is not a skeleton view", v->uid);
+        return;
+    }
+
+    if (v->view_data != pose) {
+        free_skeleton_state(v);
+        v->view_data = pose;
+    }
+    timestep_view_damage(v);
+}
+
+/**
+ * @name	timestep_view_play_skeleton
+ * @brief	starts one of the skeleton's animations on the view's pose
+ * @param	v - (timestep_view *) SKELETON_VIEW with a pose
+ * @param	animation - (const char *) name of the animation, NULL for the
+ *          setup pose
+ * @param	loop - (bool) start over at the end instead of stopping there
+ * @param	speed - (float) playback rate, 1 for as authored
+ * @retval	bool - false if there is no pose or no such animation
+ */
+bool timestep_view_play_skeleton(timestep_view *v, const char *animation, bool loop, float speed) {
+    if (v->timestep_view_render != skeleton_view_render || !v->view_data) {
+        return false;
+    }
+
+    timestep_skeleton_pose *pose = (timestep_skeleton_pose *) v->view_data;
+    int index = animation ? timestep_skeleton_find_animation(pose->skeleton, animation) : -1;
+    if (animation && index < 0) {
+        return false;
+    }
+    timestep_skeleton_pose_play(pose, index, loop, speed);
+    timestep_view_damage(v);
+    return true;
+}
+
+/**
+ * @name	timestep_view_get_scroll
+ * @brief	gets a SCROLL_VIEW's state, for setting its rows and offset
+ *          through the timestep_scroll functions. Changes are seen on its
+ *          next tick
+ * @param	v - (timestep_view *) view
+ * @retval	timestep_scroll * - NULL if the view is not a SCROLL_VIEW
+ */
+timestep_scroll *timestep_view_get_scroll(timestep_view *v) {
+    if (v->timestep_view_render != scroll_view_render) {
+        return NULL;
+    }
+    return (timestep_scroll *) v->view_data;
+}
+
+/**
+ * @name	timestep_view_add_scroll_row_view
+ * @brief	adds a view to the pool a SCROLL_VIEW draws its rows with, as a
+ *          subview of it. It stays hidden until a scrollBind event binds it
+ *          to a row. Removing it from the scroll view takes it out of the
+ *          pool
+ * @param	v - (timestep_view *) SCROLL_VIEW
+ * @param	row_view - (timestep_view *) view to draw rows with
+ * @retval	bool - false if v is not a SCROLL_VIEW or the view is already in
+ *          the pool
+ */
+bool timestep_view_add_scroll_row_view(timestep_view *v, timestep_view *row_view) {
+    timestep_scroll *scroll = timestep_view_get_scroll(v);
+    if (!scroll || !row_view || row_view == v) {
+        return false;
+    }
+    if (row_view->superview != v && !timestep_view_add_subview(v, row_view)) {
+        return false;
+    }
+
+    row_view->visible = false;
+    timestep_view_mark_moved(row_view);
+    return timestep_scroll_add_row_view(scroll, row_view->uid);
+}
+
+// uid of the SCROLL_VIEW the pan in progress drags, 0 for none
+static unsigned int scroll_pan_uid = 0;
+
+static timestep_scroll *find_scroll_view(timestep_view *v, int axis, timestep_view **found) {
+    for (; v; v = v->superview) {
+        timestep_scroll *scroll = timestep_view_get_scroll(v);
+        if (scroll && (axis < 0 || scroll->horizontal == (axis == 1))) {
+            *found = v;
+            return scroll;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * @name	timestep_view_route_scroll_gestures
+ * @brief	lets SCROLL_VIEWs take the gestures meant for them out of the
+ *          list timestep_gestures_process returned. A pan that begins
+ *          in a scroll view drags the closest one scrolling along the pan's
+ *          main direction, and every change and its end go to that view. A
+ *          tap on a scroll view still moving only stops it
+ * @param	gestures - (gesture_event_list *) the frame's gestures, with the
+ *          ones taken removed
+ * @retval	unsigned int - number of gestures taken
+ */
+unsigned int timestep_view_route_scroll_gestures(gesture_event_list *gestures) {
+    unsigned int kept = 0;
+    for (unsigned int i = 0; i < gestures->count; i++) {
+        gesture_event *g = &gestures->events[i];
+        bool taken = false;
+
+        if (g->type == GESTURE_PAN) {
+            timestep_view *v = NULL;
+            timestep_scroll *scroll = NULL;
+            if (g->state == GESTURE_BEGIN) {
+                timestep_view *target = g->target ? timestep_view_get_by_uid(g->target) : NULL;
+                scroll = find_scroll_view(target, fabs(g->dx) > fabs(g->dy) ? 1 : 0, &v);
+                scroll_pan_uid = scroll ? v->uid : 0;
+                if (scroll) {
+                    timestep_scroll_begin_drag(scroll);
+                }
+            } else if (scroll_pan_uid) {
+                v = timestep_view_get_by_uid(scroll_pan_uid);
+                scroll = v ? timestep_view_get_scroll(v) : NULL;
+                // the rest of a pan JS never saw the start of is dropped too
+                taken = true;
+            }
+
+            if (scroll) {
+                timestep_scroll_drag(scroll, scroll->horizontal ? g->dx : g->dy);
+                if (g->state == GESTURE_END) {
+                    timestep_scroll_end_drag(scroll, scroll->horizontal ? g->vx : g->vy);
+                }
+                taken = true;
+            }
+            if (g->state == GESTURE_END) {
+                scroll_pan_uid = 0;
+            }
+        } else if (g->type == GESTURE_TAP && g->target) {
+            timestep_view *v = NULL;
+            timestep_scroll *scroll = find_scroll_view(timestep_view_get_by_uid(g->target), -1, &v);
+            taken = scroll && timestep_scroll_stop(scroll);
+        }
+
+        if (!taken) {
+            gestures->events[kept++] = *g;
+        }
+    }
+
+    unsigned int taken_count = gestures->count - kept;
+    gestures->count = kept;
+    return taken_count;
+}
+
+/**
+ * @name	timestep_view_set_text_data
+ * @brief	hands the text data to a TEXT_VIEW, freeing any it had before.
+ *          its fields may be written afterwards, the layout is rebuilt when
+ *          they change, but like other draw changes they need a
+ *          timestep_view_damage for partial redraws
+ * @param	v - (timestep_view *) view, already set to TEXT_VIEW
+ * @param	text_data - (timestep_text_data *) text the view takes ownership of
+ * @retval	NONE
+ */
+void timestep_view_set_text_data(timestep_view *v, timestep_text_data *text_data) {
+    if (v->timestep_view_render != text_view_render) {
+        LOG("{view} WARNING: Tried to set text data on view %u, which is not a text view", v->uid);
+        return;
+    }
+
+    if (v->view_data != text_data) {
+        free_text_state(v);
+        v->view_data = text_data;
+    }
+    timestep_view_damage(v);
+}
+
+/**
+ * @name	timestep_view_sync_properties
+ * @brief	writes the values of packed property records onto their views,
+ *          as the generated per property setters would. records of views
+ *          that were deleted are skipped
+ * @param	records - (const double *) uid, mask and values of each record
+ * @param	length - (unsigned int) number of doubles in records
+ * @retval	unsigned int - number of doubles consumed
+ */
+unsigned int timestep_view_sync_properties(const double *records, unsigned int length) {
+    unsigned int i = 0;
+    while (i + 2 <= length) {
+        timestep_view *v = timestep_view_get_by_uid((unsigned int) records[i]);
+        unsigned int mask = (unsigned int) records[i + 1];
+        unsigned int values = 0;
+        for (unsigned int bits = mask; bits; bits &= bits - 1) {
+            values++;
+        }
+        if (mask >= (1u << SYNC_PROP_COUNT) || i + 2 + values > length) {
+            LOG("{view} WARNING: Malformed view sync record at %u", i);
+            return i;
+        }
+
+        const double *value = records + i + 2;
+        i += 2 + values;
+        if (!v) {
+            continue;
+        }
+
+        bool moved = false;
+        for (unsigned int prop = 0; prop < SYNC_PROP_COUNT; prop++) {
+            if (!(mask & (1u << prop))) {
+                continue;
+            }
+
+            double d = *value++;
+            switch (prop) {
+            case SYNC_X: v->x = d; moved = true; break;
+            case SYNC_Y: v->y = d; moved = true; break;
+            case SYNC_OFFSET_X: v->offset_x = d; moved = true; break;
+            case SYNC_OFFSET_Y: v->offset_y = d; moved = true; break;
+            case SYNC_R: v->r = d; moved = true; break;
+            case SYNC_ANCHOR_X: v->anchor_x = d; moved = true; break;
+            case SYNC_ANCHOR_Y: v->anchor_y = d; moved = true; break;
+            case SYNC_OPACITY: v->opacity = d; break;
+            case SYNC_SCALE: v->scale = d; moved = true; break;
+            case SYNC_SCALE_X: v->scale_x = d; moved = true; break;
+            case SYNC_SCALE_Y: v->scale_y = d; moved = true; break;
+            case SYNC_WIDTH: v->width = d; moved = true; break;
+            case SYNC_HEIGHT: v->height = d; moved = true; break;
+            case SYNC_VISIBLE: v->visible = d != 0; moved = true; break;
+            case SYNC_Z_INDEX: timestep_view_set_z_index(v, (int) d); break;
+            }
+        }
+
+        // like any direct write, grids filing the view have to hear of it
+        if (moved) {
+            timestep_view_mark_moved(v);
+        }
+    }
+    return i;
+}
+
+void timestep_view_set_has_jstick(timestep_view *v, bool has_jstick) {
+    v->has_jstick = has_jstick;
+    refresh_tick(v);
+}
+
+void timestep_view_set_type(timestep_view *v, unsigned int type) {
+    LOGFN("timestep_view_set_type");
+    if (type != IMAGE_VIEW && type != NINE_SLICE_VIEW) {
+        free_owned_map(v);
+    }
+    if (v->timestep_view_render == sprite_view_render && type != SPRITE_VIEW) {
+        free_sprite_state(v);
+        v->timestep_view_render = default_view_render;
+        v->timestep_view_tick = default_view_tick;
+    } else if (v->timestep_view_render == tilemap_view_render && type != TILEMAP_VIEW) {
+        free_tilemap_state(v);
+        v->timestep_view_render = default_view_render;
+    } else if (v->timestep_view_render == particle_view_render && type != PARTICLE_VIEW) {
+        free_particle_state(v);
+        v->timestep_view_render = default_view_render;
+        v->timestep_view_tick = default_view_tick;
+    } else if (v->timestep_view_render == text_view_render && type != TEXT_VIEW) {
+        free_text_state(v);
+        v->timestep_view_render = default_view_render;
+    } else if (v->timestep_view_render == skeleton_view_render && type != SKELETON_VIEW) {
+        free_skeleton_state(v);
+        v->timestep_view_render = default_view_render;
+        v->timestep_view_tick = default_view_tick;
+    } else if (v->timestep_view_render == scroll_view_render && type != SCROLL_VIEW) {
+        free_scroll_state(v);
+        v->timestep_view_render = default_view_render;
+        v->timestep_view_tick = default_view_tick;
+    }
+
+    switch (type) {
+    default:
+    case DEFAULT_RENDER:
+        break;
+    case IMAGE_VIEW:
+        v->timestep_view_render = image_view_render;
+        break;
+    case NINE_SLICE_VIEW:
+        v->timestep_view_render = nine_slice_view_render;
+        break;
+    case SPRITE_VIEW:
+        if (v->timestep_view_render != sprite_view_render) {
+            v->view_data = calloc(1, sizeof(timestep_sprite_state));
+            v->timestep_view_render = sprite_view_render;
+            v->timestep_view_tick = sprite_view_tick;
+        }
+        break;
+    case TILEMAP_VIEW:
+        if (v->timestep_view_render != tilemap_view_render) {
+            v->view_data = NULL;
+            v->timestep_view_render = tilemap_view_render;
+        }
+        break;
+    case PARTICLE_VIEW:
+        if (v->timestep_view_render != particle_view_render) {
+            v->view_data = NULL;
+            v->timestep_view_render = particle_view_render;
+            v->timestep_view_tick = particle_view_tick;
+        }
+        break;
+    case TEXT_VIEW:
+        if (v->timestep_view_render != text_view_render) {
+            v->view_data = NULL;
+            v->timestep_view_render = text_view_render;
+        }
+        break;
+    case SKELETON_VIEW:
+        if (v->timestep_view_render != skeleton_view_render) {
+            v->view_data = NULL;
+            v->timestep_view_render = skeleton_view_render;
+            v->timestep_view_tick = skeleton_view_tick;
+        }
+        break;
+    case SCROLL_VIEW:
+        if (v->timestep_view_render != scroll_view_render) {
+            v->view_data = timestep_scroll_init(false);
+            v->timestep_view_render = scroll_view_render;
+            v->timestep_view_tick = scroll_view_tick;
+        }
+        break;
+    }
+    refresh_tick(v);
+    timestep_view_damage(v);
+    LOGFN("end timestep_view_set_type");
+}
+
+static double abs_scale = 1;
+
+void timestep_view_start_render() {
+    abs_scale = 1;
+}
+
+static unsigned int transform_version = 0;
+
+static unsigned int next_transform_version() {
+    // 0 is reserved for views whose world has never been built
+    if (++transform_version == 0) {
+        ++transform_version;
+    }
+    return transform_version;
+}
+
+static bool transform_key_changed(const timestep_view *v) {
+    const timestep_view_transform_key *key = &v->transform_key;
+    return key->x != v->x || key->y != v->y || key->r != v->r ||
+           key->anchor_x != v->anchor_x || key->anchor_y != v->anchor_y ||
+           key->offset_x != v->offset_x || key->offset_y != v->offset_y ||
+           key->scale != v->scale || key->scale_x != v->scale_x || key->scale_y != v->scale_y;
+}
+
+/**
+ * @name	update_transform
+ * @brief	brings the view's world matrix up to date, rebuilding the local
+ *          matrix only when a transform property changed and the world
+ *          matrix only when the local or parent matrix changed
+ * @param	v - (timestep_view *) view being entered
+ * @param	parent - (const matrix_3x3 *) the parent's matrix
+ * @param	parent_version - (unsigned int) transform version of that matrix
+ * @retval	NONE
+ */
+static void build_local_transform(const timestep_view *v, matrix_3x3 *local) {
+    matrix_3x3_identity(local);
+    matrix_3x3_translate(local, v->x + v->anchor_x + v->offset_x, v->y + v->anchor_y + v->offset_y);
+
+    if (v->r) {
+        matrix_3x3_rotate(local, v->r);
+    }
+    if (v->scale != 1 || v->scale_x != 1 || v->scale_y != 1) {
+        matrix_3x3_scale(local, v->scale * v->scale_x, v->scale * v->scale_y);
+    }
+
+    matrix_3x3_translate(local, -v->anchor_x, -v->anchor_y);
+}
+
+static void update_transform(timestep_view *v, const matrix_3x3 *parent, unsigned int parent_version) {
+    bool local_changed = v->transform_dirty || transform_key_changed(v);
+
+    if (local_changed) {
+        build_local_transform(v, &v->local_transform);
+        v->local_translation_only = !v->r && v->scale == 1 && v->scale_x == 1 && v->scale_y == 1;
+
+        v->transform_key.x = v->x;
+        v->transform_key.y = v->y;
+        v->transform_key.r = v->r;
+        v->transform_key.anchor_x = v->anchor_x;
+        v->transform_key.anchor_y = v->anchor_y;
+        v->transform_key.offset_x = v->offset_x;
+        v->transform_key.offset_y = v->offset_y;
+        v->transform_key.scale = v->scale;
+        v->transform_key.scale_x = v->scale_x;
+        v->transform_key.scale_y = v->scale_y;
+        v->transform_dirty = false;
+    }
+
+    if (local_changed || v->parent_version != parent_version) {
+        if (v->local_translation_only) {
+            // most views only move, which needs no full matrix product
+            v->world_transform = *parent;
+            matrix_3x3_translate(&v->world_transform, v->local_transform.m02, v->local_transform.m12);
+        } else {
+            matrix_3x3_multiply(parent, &v->local_transform, &v->world_transform);
+        }
+        v->parent_version = parent_version;
+        v->world_version = next_transform_version();
+    }
+}
+
+typedef struct render_frame_t {
+    timestep_view *view;
+    context_2d *ctx;
+    unsigned int next_subview;
+    unsigned int version; // transform version subviews are built against
+    bool queued;
+    bool restore_viewport;
+    bool indexed; // walks the subviews the spatial index found, not all
+    bool pass_through; // the view left the context alone, see is_pass_through
+    JS_OBJECT_WRAPPER js_viewport;
+} render_frame;
+
+static timestep_view **spatial_query(timestep_view *v, const double *bounds, unsigned int *count);
+static timestep_view **spatial_results(timestep_view *v, unsigned int *count);
+static bool visible_rect(context_2d *ctx, rect_2d *visible);
+
+// explicit traversal stack shared by every render walk, including the
+// nested walks that fill bitmap caches
+static render_frame *render_stack = NULL;
+static unsigned int render_depth = 0;
+static unsigned int render_stack_size = 0;
+
+static render_frame *push_render_frame() {
+    if (render_depth == render_stack_size) {
+        unsigned int size = render_stack_size ? render_stack_size * 2 : 64;
+        render_frame *stack = (render_frame *)TAG_REALLOC(MEMORY_TAG_VIEWS, render_stack, sizeof(render_frame) * size);
+        if (!stack) {
+            LOG("{view} WARNING: Unable to grow the render stack past %u views", render_stack_size);
+            return NULL;
+        }
+        render_stack = stack;
+        render_stack_size = size;
+    }
+    return &render_stack[render_depth++];
+}
+
+/**
+ * @name	is_pass_through
+ * @brief	tests whether the view is a container that draws nothing and
+ *          changes nothing on the context but the matrix, which its
+ *          subviews' cached world matrices already include
+ * @param	v - (const timestep_view *) view being entered
+ * @retval	bool - true to walk its subviews without a save and restore
+ */
+static bool is_pass_through(const timestep_view *v) {
+    return v->timestep_view_render == default_view_render && !v->has_jsrender &&
+           v->background_color.a <= 0 && !v->clip && v->opacity == 1 &&
+           v->filter_type == FILTER_NONE && !v->flip_x && !v->flip_y &&
+           !v->composite_operation && !v->order_independent && !v->cache_as_bitmap;
+}
+
+// the matrix a frame's subviews are built against
+static inline const matrix_3x3 *frame_matrix(const render_frame *frame) {
+    return frame->pass_through ? &frame->view->world_transform : &frame->ctx->modelView[frame->ctx->mvp];
+}
+
+/**
+ * @name	index_visible
+ * @brief	queries an indexed container for the subviews inside the visible
+ *          area, for the walk to visit only those
+ * @param	v - (timestep_view *) container with a spatial index
+ * @param	ctx - (context_2d *) context being rendered into
+ * @param	m - (const matrix_3x3 *) the container's matrix
+ * @retval	bool - true if the walk can use the query's results
+ */
+static bool index_visible(timestep_view *v, context_2d *ctx, const matrix_3x3 *m) {
+    rect_2d visible;
+    if (!visible_rect(ctx, &visible)) {
+        return false;
+    }
+
+    double det = (double) m->m00 * m->m11 - (double) m->m01 * m->m10;
+    if (!det) {
+        return false;
+    }
+
+    double corners[4][2] = {
+        {visible.x, visible.y},
+        {visible.x + visible.width, visible.y},
+        {visible.x, visible.y + visible.height},
+        {visible.x + visible.width, visible.y + visible.height}
+    };
+    double bounds[4];
+    for (int i = 0; i < 4; i++) {
+        double dx = corners[i][0] - m->m02;
+        double dy = corners[i][1] - m->m12;
+        double x = (m->m11 * dx - m->m01 * dy) / det;
+        double y = (m->m00 * dy - m->m10 * dx) / det;
+        if (i == 0 || x < bounds[0]) bounds[0] = x;
+        if (i == 0 || y < bounds[1]) bounds[1] = y;
+        if (i == 0 || x > bounds[2]) bounds[2] = x;
+        if (i == 0 || y > bounds[3]) bounds[3] = y;
+    }
+    unsigned int count;
+    return spatial_query(v, bounds, &count) != NULL;
+}
+
+// applies the view's filters and fills its background color
+static void draw_background(timestep_view *v, context_2d *ctx) {
+    //apply filters
+    rgba f = v->filter_color;
+    ctx->filter_color.r = f.r;
+    ctx->filter_color.g = f.g;
+    ctx->filter_color.b = f.b;
+    ctx->filter_color.a = f.a;
+    if (v->filter_type != FILTER_NONE) {
+        context_2d_set_filter_type(ctx, v->filter_type);
+    }
+
+    if (v->background_color.a > 0) {
+        //LOG("render %i with background %f %f %f %f", v->uid, v->background_color.r, v->background_color.g, v->background_color.b, v->background_color.a);
+
+        rect_2d r = {0, 0, static_cast<float>(v->width), static_cast<float>(v->height)};
+        context_2d_fillRect(ctx, &r, &v->background_color);
+    }
+}
+
+static void apply_flip(timestep_view *v, context_2d *ctx) {
+    if (v->flip_x || v->flip_y) {
+        context_2d_translate(ctx,
+                             v->flip_x ? v->width / 2 : 0,
+                             v->flip_y ? v->height / 2 : 0);
+
+        context_2d_scale(ctx,
+                         v->flip_x ? -1 : 1,
+                         v->flip_y ? -1 : 1);
+
+        context_2d_translate(ctx,
+                             v->flip_x ? -v->width / 2 : 0,
+                             v->flip_y ? -v->height / 2 : 0);
+    }
+}
+
+static void clear_filters(timestep_view *v, context_2d *ctx) {
+    //restore filters
+    if (v->filter_type != FILTER_NONE) {
+        context_2d_set_filter_type(ctx, FILTER_NONE);
+    }
+    ctx->filter_color.r = 0;
+    ctx->filter_color.g = 0;
+    ctx->filter_color.b = 0;
+    ctx->filter_color.a = 0;
+}
+
+/**
+ * @name	enter_content
+ * @brief	draws the view's filters, background and own render, then pushes
+ *          a frame so its subviews are drawn inside the same state
+ * @param	v - (timestep_view *) view whose transform is on top of ctx's stack
+ * @param	ctx - (context_2d *) context to draw into
+ * @param	apply_composite - (bool) whether to set the view's composite
+ *          operation on ctx (cached views apply it when drawing the bitmap)
+ * @param	version - (unsigned int) transform version of ctx's current matrix
+ * @retval	NONE
+ */
+static void enter_content(timestep_view *v, context_2d *ctx, JS_OBJECT_WRAPPER js_ctx, JS_OBJECT_WRAPPER js_opts, bool apply_composite, unsigned int version) {
+    draw_background(v, ctx);
+    apply_flip(v, ctx);
+
+    // Set Global Composite Operation
+    if (apply_composite && 0 != v->composite_operation) {
+        context_2d_setGlobalCompositeOperation(ctx, v->composite_operation);
+    }
+
+    // let the whole subtree be sorted by texture / blend state
+    bool queued = v->order_independent;
+    if (queued) {
+        draw_textures_queue_begin();
+    }
+
+    JS_OBJECT_WRAPPER js_viewport;
+    bool should_restore_viewport = false;
+    if (v->has_jsrender && !(v->static_render && v->render_list && display_list_replay(v->render_list, ctx))) {
+        // a static render is recorded the first time, and replayed natively
+        // until it's invalidated
+        bool record = v->static_render && !ctx->recording && !(v->render_list && v->render_list->recorded);
+        if (record && !v->render_list) {
+            v->render_list = display_list_new();
+        }
+        record = record && v->render_list;
+        if (record) {
+            display_list_begin(v->render_list, ctx);
+        }
+
+        should_restore_viewport = true;
+        js_viewport = def_get_viewport(js_opts);
+        def_timestep_view_render(v->js_view, js_ctx, js_opts);
+        // nothing tells us when a JS render would draw something else
+        if (!record) {
+            core_invalidate_frame();
+        }
+
+        if (record) {
+            display_list_end(ctx);
+        }
+    } else if (!v->has_jsrender) {
+        v->timestep_view_render(v, ctx);
+    }
+
+    clear_filters(v, ctx);
+
+    render_frame *frame = push_render_frame();
+    if (!frame) {
+        if (should_restore_viewport) {
+            def_restore_viewport(js_opts, js_viewport);
+        }
+        if (queued) {
+            draw_textures_queue_end();
+        }
+        context_2d_restore(ctx);
+        return;
+    }
+    frame->view = v;
+    frame->ctx = ctx;
+    frame->next_subview = 0;
+    // flips and JS renderers change the matrix after the view's own
+    // transform, so subviews can't trust their cached world matrices
+    frame->version = (v->flip_x || v->flip_y || v->has_jsrender) ? next_transform_version() : version;
+    frame->queued = queued;
+    frame->restore_viewport = should_restore_viewport;
+    frame->js_viewport = js_viewport;
+    frame->pass_through = false;
+
+    // JS renderers may leave anything on the matrix, so only indexed
+    // containers drawn natively narrow the walk
+    frame->indexed = v->spatial_index && !v->has_jsrender && index_visible(v, ctx, &ctx->modelView[ctx->mvp]);
+}
+
+/**
+ * @name	enter_pass_through
+ * @brief	pushes a frame for a pass-through view's subviews, which build
+ *          their matrices from its world matrix rather than the context's
+ * @param	v - (timestep_view *) view is_pass_through accepted
+ * @param	ctx - (context_2d *) context to draw into
+ * @retval	bool - true if a frame was pushed
+ */
+static bool enter_pass_through(timestep_view *v, context_2d *ctx) {
+    render_frame *frame = push_render_frame();
+    if (!frame) {
+        return false;
+    }
+    frame->view = v;
+    frame->ctx = ctx;
+    frame->next_subview = 0;
+    frame->version = v->world_version;
+    frame->queued = false;
+    frame->restore_viewport = false;
+    frame->pass_through = true;
+    frame->indexed = v->spatial_index && index_visible(v, ctx, &v->world_transform);
+    return true;
+}
+
+// undoes enter_content and the context_2d_save made when entering the view
+static void leave_frame(render_frame *frame, JS_OBJECT_WRAPPER js_opts) {
+    if (frame->pass_through) {
+        return;
+    }
+
+    if (frame->restore_viewport) {
+        def_restore_viewport(js_opts, frame->js_viewport);
+    }
+
+    if (frame->queued) {
+        draw_textures_queue_end();
+    }
+
+    context_2d_restore(frame->ctx);
+}
+
+static bool enter_view(timestep_view *v, context_2d *ctx, const matrix_3x3 *parent, unsigned int parent_version, JS_OBJECT_WRAPPER js_ctx, JS_OBJECT_WRAPPER js_opts);
+
+/**
+ * @name	render_frames
+ * @brief	walks the subviews of every frame above base, in order, without
+ *          recursing
+ * @param	base - (unsigned int) stack depth to unwind to
+ * @retval	NONE
+ */
+static void render_frames(unsigned int base, JS_OBJECT_WRAPPER js_ctx, JS_OBJECT_WRAPPER js_opts) {
+    while (render_depth > base) {
+        // entering a subview may grow the stack, so never hold the frame
+        render_frame *frame = &render_stack[render_depth - 1];
+        timestep_view *v = frame->view;
+
+        unsigned int count = v->subview_count;
+        timestep_view **subviews = frame->indexed ? spatial_results(v, &count) : v->subviews;
+        if (!subviews) {
+            // the index went away while drawing, so finish with every subview
+            frame->indexed = false;
+            frame->next_subview = 0;
+            subviews = v->subviews;
+        }
+
+        if (frame->next_subview < count) {
+            timestep_view *subview = subviews[frame->next_subview++];
+            // query results can outlive a subview removed while drawing
+            if (subview->superview == v) {
+                enter_view(subview, frame->ctx, frame_matrix(frame), frame->version, js_ctx, js_opts);
+            }
+        } else {
+            render_frame done = *frame;
+            render_depth--;
+            leave_frame(&done, js_opts);
+        }
+    }
+}
+
+#define CACHE_HASH_INIT 2166136261u
+
+static unsigned int cache_hash(unsigned int h, const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+#define CACHE_HASH_FIELD(h, field) h = cache_hash(h, &(field), sizeof(field))
+
+static unsigned int cache_hash_string(unsigned int h, const char *str) {
+    return str ? cache_hash(h, str, strlen(str) + 1) : cache_hash(h, "", 1);
+}
+
+static unsigned int cache_hash_map(unsigned int h, timestep_image_map *map) {
+    CACHE_HASH_FIELD(h, map->x);
+    CACHE_HASH_FIELD(h, map->y);
+    CACHE_HASH_FIELD(h, map->width);
+    CACHE_HASH_FIELD(h, map->height);
+    CACHE_HASH_FIELD(h, map->margin_top);
+    CACHE_HASH_FIELD(h, map->margin_right);
+    CACHE_HASH_FIELD(h, map->margin_bottom);
+    CACHE_HASH_FIELD(h, map->margin_left);
+
+    if (map->url) {
+        h = cache_hash(h, map->url, strlen(map->url));
+
+        // an image that finishes loading after the cache was drawn
+        // must trigger a redraw
+        texture_2d *tex = texture_manager_get_texture_by_handle(texture_manager_get(), timestep_image_map_get_handle(map));
+        bool loaded = tex && tex->loaded;
+        CACHE_HASH_FIELD(h, loaded);
+    }
+
+    return h;
+}
+
+// hashes what a view draws inside its own transform
+static unsigned int cache_hash_content(unsigned int h, timestep_view *v) {
+    CACHE_HASH_FIELD(h, v->width);
+    CACHE_HASH_FIELD(h, v->height);
+    CACHE_HASH_FIELD(h, v->flip_x);
+    CACHE_HASH_FIELD(h, v->flip_y);
+    CACHE_HASH_FIELD(h, v->background_color);
+    CACHE_HASH_FIELD(h, v->filter_color);
+    CACHE_HASH_FIELD(h, v->filter_type);
+    CACHE_HASH_FIELD(h, v->subview_count);
+
+    if ((v->timestep_view_render == image_view_render || v->timestep_view_render == nine_slice_view_render) && v->view_data) {
+        h = cache_hash_map(h, (timestep_image_map *) v->view_data);
+        CACHE_HASH_FIELD(h, v->slice_top);
+        CACHE_HASH_FIELD(h, v->slice_right);
+        CACHE_HASH_FIELD(h, v->slice_bottom);
+        CACHE_HASH_FIELD(h, v->slice_left);
+    } else if (v->timestep_view_render == sprite_view_render && v->view_data) {
+        timestep_sprite_state *state = (timestep_sprite_state *) v->view_data;
+        CACHE_HASH_FIELD(h, state->sprite);
+        CACHE_HASH_FIELD(h, state->frame);
+        if (state->sprite && state->frame < state->sprite->frame_count) {
+            h = cache_hash_map(h, state->sprite->frames[state->frame]);
+        }
+    } else if (v->timestep_view_render == tilemap_view_render && v->view_data) {
+        timestep_tilemap *tilemap = (timestep_tilemap *) v->view_data;
+        CACHE_HASH_FIELD(h, tilemap);
+        CACHE_HASH_FIELD(h, tilemap->version);
+        h = cache_hash_map(h, tilemap->sheet);
+    } else if (v->timestep_view_render == particle_view_render && v->view_data) {
+        timestep_particle_emitter *emitter = (timestep_particle_emitter *) v->view_data;
+        CACHE_HASH_FIELD(h, emitter);
+        CACHE_HASH_FIELD(h, emitter->version);
+        if (emitter->image) {
+            h = cache_hash_map(h, emitter->image);
+        }
+    } else if (v->timestep_view_render == text_view_render && v->view_data) {
+        timestep_text_data *text_data = (timestep_text_data *) v->view_data;
+        // the layout signature covers the text, font and wrapping
+        timestep_text_data_layout(text_data, v->width);
+        CACHE_HASH_FIELD(h, text_data->built_signature);
+        CACHE_HASH_FIELD(h, text_data->color);
+        CACHE_HASH_FIELD(h, text_data->background_color);
+        CACHE_HASH_FIELD(h, text_data->vertical_padding);
+        CACHE_HASH_FIELD(h, text_data->line_height);
+        CACHE_HASH_FIELD(h, text_data->line_width);
+        CACHE_HASH_FIELD(h, text_data->shadow);
+        CACHE_HASH_FIELD(h, text_data->shadow_color);
+        h = cache_hash_string(h, text_data->text_align);
+        h = cache_hash_string(h, text_data->vertical_align);
+        h = cache_hash_string(h, text_data->stroke_style);
+    } else if (v->timestep_view_render == skeleton_view_render && v->view_data) {
+        timestep_skeleton_pose *pose = (timestep_skeleton_pose *) v->view_data;
+        CACHE_HASH_FIELD(h, pose);
+        CACHE_HASH_FIELD(h, pose->animation);
+        CACHE_HASH_FIELD(h, pose->time);
+    }
+
+    return h;
+}
+
+/**
+ * @name	cache_signature
+ * @brief	hashes every property that affects how a cached subtree looks
+ * @param	v - (timestep_view *) root of the cached subtree
+ * @param	h - (unsigned int *) running hash
+ * @retval	bool - false if the subtree can't be cached (it has JS renderers,
+ *          which draw through the onscreen JS context)
+ */
+static bool cache_signature(timestep_view *v, unsigned int *h) {
+    if (v->has_jsrender) {
+        return false;
+    }
+
+    *h = cache_hash_content(*h, v);
+
+    for (unsigned int i = 0; i < v->subview_count; i++) {
+        timestep_view *subview = v->subviews[i];
+        CACHE_HASH_FIELD(*h, subview->uid);
+        CACHE_HASH_FIELD(*h, subview->visible);
+        CACHE_HASH_FIELD(*h, subview->opacity);
+
+        if (!subview->visible || !subview->opacity) {
+            continue;
+        }
+
+        CACHE_HASH_FIELD(*h, subview->x);
+        CACHE_HASH_FIELD(*h, subview->y);
+        CACHE_HASH_FIELD(*h, subview->offset_x);
+        CACHE_HASH_FIELD(*h, subview->offset_y);
+        CACHE_HASH_FIELD(*h, subview->anchor_x);
+        CACHE_HASH_FIELD(*h, subview->anchor_y);
+        CACHE_HASH_FIELD(*h, subview->r);
+        CACHE_HASH_FIELD(*h, subview->scale);
+        CACHE_HASH_FIELD(*h, subview->scale_x);
+        CACHE_HASH_FIELD(*h, subview->scale_y);
+        CACHE_HASH_FIELD(*h, subview->clip);
+        CACHE_HASH_FIELD(*h, subview->z_index);
+        CACHE_HASH_FIELD(*h, subview->composite_operation);
+
+        if (!cache_signature(subview, h)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void free_cache(timestep_view *v) {
+    if (v->cache_ctx) {
+        context_2d_release_scratch(v->cache_ctx);
+        v->cache_ctx = NULL;
+    }
+    v->cache_dirty = true;
+}
+
+/**
+ * @name	render_cached
+ * @brief	draws the view's content from its offscreen cache, re-rendering the
+ *          cache first if the subtree changed
+ * @param	v - (timestep_view *) view to draw
+ * @param	ctx - (context_2d *) context to draw the cached bitmap into
+ * @retval	bool - false if the view can't be cached and must be drawn directly
+ */
+static bool render_cached(timestep_view *v, context_2d *ctx, JS_OBJECT_WRAPPER js_ctx, JS_OBJECT_WRAPPER js_opts) {
+    unsigned int signature = CACHE_HASH_INIT;
+    if (!cache_signature(v, &signature)) {
+        free_cache(v);
+        return false;
+    }
+
+    int width = (int) ceil(v->width);
+    int height = (int) ceil(v->height);
+    if (width <= 0 || height <= 0) {
+        free_cache(v);
+        return false;
+    }
+
+    texture_manager *manager = texture_manager_get();
+    texture_2d *tex = NULL;
+    if (v->cache_ctx) {
+        // the texture manager may have dropped the canvas (e.g. on context loss)
+        tex = texture_manager_get_texture(manager, v->cache_ctx->url);
+        if (!tex) {
+            context_2d_delete(v->cache_ctx);
+            v->cache_ctx = NULL;
+        } else if (v->cache_ctx->width != width || v->cache_ctx->height != height) {
+            if (texture_2d_can_resize(tex, width, height)) {
+                context_2d_resize(v->cache_ctx, width, height);
+            } else {
+                // a bigger texture may be waiting in the pool
+                free_cache(v);
+            }
+            v->cache_dirty = true;
+        }
+    }
+
+    if (!v->cache_ctx) {
+        v->cache_ctx = context_2d_acquire_scratch(ctx->canvas, width, height);
+        if (!v->cache_ctx) {
+            return false;
+        }
+        v->cache_dirty = true;
+    }
+
+    if (v->cache_dirty || signature != v->cache_signature) {
+        context_2d *cache_ctx = v->cache_ctx;
+        double saved_abs_scale = abs_scale;
+
+        // context_2d_clear binds the cache, flushing anything pending
+        // for the current target first
+        context_2d_clear(cache_ctx);
+        context_2d_save(cache_ctx);
+        context_2d_loadIdentity(cache_ctx);
+        unsigned int base = render_depth;
+        enter_content(v, cache_ctx, js_ctx, js_opts, false, next_transform_version());
+        render_frames(base, js_ctx, js_opts);
+        draw_textures_flush();
+
+        abs_scale = saved_abs_scale;
+        v->cache_signature = signature;
+        v->cache_dirty = false;
+    }
+
+    if (0 != v->composite_operation) {
+        context_2d_setGlobalCompositeOperation(ctx, v->composite_operation);
+    }
+
+    rect_2d r = {0, 0, static_cast<float>(width), static_cast<float>(height)};
+    context_2d_drawImage(ctx, 0, v->cache_ctx->url, &r, &r);
+    return true;
+}
+
+/**
+ * @name	visible_rect
+ * @brief	finds the part of the context that can be drawn to, in the same
+ *          space as the model view matrices
+ * @param	ctx - (context_2d *) context being rendered into
+ * @param	visible - (rect_2d *) receives the visible area
+ * @retval	bool - false if the context has no known size or clip
+ */
+static bool visible_rect(context_2d *ctx, rect_2d *visible) {
+    rect_2d *clip = &ctx->clipStack[ctx->mvp];
+    if (clip->width >= 0) {
+        *visible = *clip;
+        if (ctx->on_screen) {
+            // the clip stack is kept in frame buffer sense on screen
+            visible->y = -visible->y + ctx->canvas->framebuffer_height + ctx->canvas->framebuffer_offset_bottom - visible->height;
+        }
+    } else if (ctx->width > 0 && ctx->height > 0) {
+        visible->x = 0;
+        visible->y = 0;
+        visible->width = ctx->width;
+        visible->height = ctx->height;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @name	rect_bounds
+ * @brief	finds the axis-aligned bounds of a rect under a matrix
+ * @param	m - (const matrix_3x3 *) the rect's matrix
+ * @param	r - (const rect_2d *) rect to transform
+ * @retval	rect_2d - the bounds, in the matrix's target space
+ */
+static rect_2d rect_bounds(const matrix_3x3 *m, const rect_2d *r) {
+    float x1, y1, x2, y2, x3, y3, x4, y4;
+    matrix_3x3_multiply(m, r, &x1, &y1, &x2, &y2, &x3, &y3, &x4, &y4);
+
+    float min_x = fminf(fminf(x1, x2), fminf(x3, x4));
+    float min_y = fminf(fminf(y1, y2), fminf(y3, y4));
+    rect_2d bounds = {min_x, min_y,
+                      fmaxf(fmaxf(x1, x2), fmaxf(x3, x4)) - min_x,
+                      fmaxf(fmaxf(y1, y2), fmaxf(y3, y4)) - min_y};
+    return bounds;
+}
+
+/**
+ * @name	box_bounds
+ * @brief	finds the axis-aligned bounds of a view's box under a matrix
+ * @param	m - (const matrix_3x3 *) the view's matrix
+ * @param	v - (const timestep_view *) sized view
+ * @retval	rect_2d - the bounds, in the matrix's target space
+ */
+static rect_2d box_bounds(const matrix_3x3 *m, const timestep_view *v) {
+    rect_2d r = {0, 0, static_cast<float>(v->width), static_cast<float>(v->height)};
+    return rect_bounds(m, &r);
+}
+
+/**
+ * @name	tilemap_view_render
+ * @brief	draws the chunks of the view's tile grid that touch the visible
+ *          area, each from its prebuilt rect list
+ * @param	v - (timestep_view *) TILEMAP_VIEW to draw
+ * @param	ctx - (context_2d *) context to draw to
+ * @retval	NONE
+ */
+static void tilemap_view_render(timestep_view *v, context_2d *ctx) {
+    LOGFN("tilemap_view_render");
+    timestep_tilemap *tilemap = (timestep_tilemap *) v->view_data;
+    if (!tilemap || !tilemap->sheet->url || !tilemap->columns || !tilemap->rows) {
+        return;
+    }
+
+    float tile_width = (float) v->width / tilemap->columns;
+    float tile_height = (float) v->height / tilemap->rows;
+    if (!timestep_tilemap_build(tilemap, tile_width, tile_height)) {
+        return;
+    }
+
+    rect_2d visible;
+    bool cull = visible_rect(ctx, &visible);
+    const matrix_3x3 *m = &ctx->modelView[ctx->mvp];
+    int handle = timestep_image_map_get_handle(tilemap->sheet);
+    for (unsigned int i = 0; i < tilemap->chunk_columns * tilemap->chunk_rows; i++) {
+        timestep_tilemap_chunk *chunk = &tilemap->chunks[i];
+        if (!chunk->count) {
+            continue;
+        }
+
+        if (cull) {
+            rect_2d b = rect_bounds(m, &chunk->bounds);
+            if (b.x + b.width < visible.x || b.y + b.height < visible.y ||
+                b.x > visible.x + visible.width || b.y > visible.y + visible.height) {
+                continue;
+            }
+        }
+
+        context_2d_drawImageRectsHandle(ctx, handle, chunk->src_rects, chunk->dest_rects, chunk->count);
+    }
+    LOGFN("end tilemap_view_render");
+}
+
+static bool is_outside(const rect_2d *b, const rect_2d *visible) {
+    return b->x + b->width < visible->x || b->y + b->height < visible->y ||
+           b->x > visible->x + visible->width || b->y > visible->y + visible->height;
+}
+
+/**
+ * @name	is_culled
+ * @brief	updates the view's cached world bounds and tests them against the
+ *          current clip, or the whole context when nothing is clipped
+ * @param	v - (timestep_view *) view whose world matrix is up to date
+ * @param	ctx - (context_2d *) context being rendered into
+ * @retval	bool - true if the view's box is entirely outside the visible area
+ */
+static bool is_culled(timestep_view *v, context_2d *ctx) {
+    // views without a size act as plain containers for their subviews
+    if (v->draws_outside_bounds || v->width <= UNDEFINED_DIMENSION || v->height <= UNDEFINED_DIMENSION) {
+        return false;
+    }
+
+    v->world_bounds = box_bounds(&v->world_transform, v);
+
+    rect_2d visible;
+    if (!visible_rect(ctx, &visible)) {
+        return false;
+    }
+
+    return is_outside(&v->world_bounds, &visible);
+}
+
+/**
+ * @name	view_draw_key
+ * @brief	packs what decides whether the view's quads batch with its
+ *          neighbours': composite operation, then filter, then the gl
+ *          texture, which atlas pages and shared images have in common
+ *          across urls
+ * @param	v - (timestep_view *) view to key
+ * @retval	unsigned int - key, equal for views that batch together
+ */
+static unsigned int view_draw_key(timestep_view *v) {
+    timestep_image_map *map = NULL;
+    if (v->timestep_view_render == image_view_render || v->timestep_view_render == nine_slice_view_render) {
+        map = (timestep_image_map *) v->view_data;
+    } else if (v->timestep_view_render == sprite_view_render && v->view_data) {
+        timestep_sprite_state *state = (timestep_sprite_state *) v->view_data;
+        if (state->sprite && state->frame < state->sprite->frame_count) {
+            map = state->sprite->frames[state->frame];
+        }
+    } else if (v->timestep_view_render == particle_view_render && v->view_data) {
+        map = ((timestep_particle_emitter *) v->view_data)->image;
+    }
+
+    unsigned int texture = 0;
+    if (map && map->url) {
+        int handle = timestep_image_map_get_handle(map);
+        texture_2d *tex = texture_manager_get_texture_by_handle(texture_manager_get(), handle);
+        // until it loads, views of the same url still go together
+        texture = tex && tex->loaded ? (unsigned int) tex->name : 0x800000u | (unsigned int) handle;
+    }
+    return ((unsigned int) v->composite_operation & 0xf) << 28 |
+           ((unsigned int) v->filter_type & 0xf) << 24 |
+           (texture & 0xffffff);
+}
+
+/**
+ * @name	refresh_draw_key
+ * @brief	keys a subview of a container sorted by draw state as it is
+ *          drawn, having the container sorted again before the next frame
+ *          when the key changed. The order is free in such containers, so
+ *          one frame in the old order is harmless
+ * @param	v - (timestep_view *) view being entered
+ * @retval	NONE
+ */
+static void refresh_draw_key(timestep_view *v) {
+    unsigned int key = view_draw_key(v);
+    if (key != v->draw_key) {
+        v->draw_key = key;
+        v->superview->dirty_z_index = true;
+    }
+}
+
+/**
+ * @name	enter_view
+ * @brief	applies the view's transform and draws its own content
+ * @param	v - (timestep_view *) view to enter
+ * @param	ctx - (context_2d *) context to draw into
+ * @param	parent - (const matrix_3x3 *) the superview's matrix, ctx's
+ *          current one unless the superview was a pass-through
+ * @param	parent_version - (unsigned int) transform version of parent
+ * @retval	bool - true if a frame was pushed for the view's subviews
+ */
+static bool enter_view(timestep_view *v, context_2d *ctx, const matrix_3x3 *parent, unsigned int parent_version, JS_OBJECT_WRAPPER js_ctx, JS_OBJECT_WRAPPER js_opts) {
+    if (!v->visible || !v->opacity) {
+        return false;
+    }
+
+    // hasJSTick is written straight into the struct by the bindings, so
+    // pick up changes on views the tick walk might be skipping
+    refresh_tick(v);
+
+    if (v->superview && v->superview->sort_by_draw_state) {
+        refresh_draw_key(v);
+    }
+    // sortByDrawState is written straight into the struct too
+    if (v->sort_by_draw_state != v->draw_state_sorted) {
+        v->dirty_z_index = true;
+    }
+    if (v->dirty_z_index) {
+        v->dirty_z_index = false;
+        timestep_view_sort_subviews(v);
+    }
+    if (v->width < 0 || v->height < 0) {
+        return false;
+    }
+
+    update_transform(v, parent, parent_version);
+
+    if (v->scale != 1 || v->scale_x != 1 || v->scale_y != 1) {
+        abs_scale *= v->scale;
+    }
+
+    v->abs_scale = abs_scale;
+
+    // animations below a culled view don't need to be applied
+    v->culled = is_culled(v, ctx);
+    if (v->culled) {
+        return false;
+    }
+
+    // a container that draws nothing only passes its matrix down, and the
+    // subviews' world matrices already hold it
+    if (is_pass_through(v)) {
+        if (v->cache_ctx) {
+            free_cache(v);
+        }
+        return enter_pass_through(v, ctx);
+    }
+
+    // the new stack slot gets the cached world matrix directly, rather than
+    // a copy of the parent's that would be overwritten straight away
+    context_2d_save_transform(ctx, &v->world_transform);
+
+    if (v->opacity != 1) {
+        double alpha = context_2d_getGlobalAlpha(ctx);
+        context_2d_setGlobalAlpha(ctx, alpha * v->opacity);
+    }
+
+    if (v->clip) {
+        rect_2d r = {0, 0, static_cast<float>(v->width), static_cast<float>(v->height)};
+        if (!context_2d_setClip(ctx, r)) {
+            // nothing of this view or its subviews can reach the screen
+            context_2d_restore(ctx);
+            return false;
+        }
+    }
+
+    if (!v->cache_as_bitmap) {
+        if (v->cache_ctx) {
+            free_cache(v);
+        }
+    } else if (render_cached(v, ctx, js_ctx, js_opts)) {
+        context_2d_restore(ctx);
+        return false;
+    }
+
+    unsigned int depth = render_depth;
+    enter_content(v, ctx, js_ctx, js_opts, true, v->world_version);
+    return render_depth > depth;
+}
+
+//// Damage
+
+// views damaged since the last on screen render, whose new bounds are
+// damaged when it starts
+static timestep_view **damaged_views = NULL;
+static unsigned int damaged_count = 0;
+static unsigned int damaged_size = 0;
+
+/**
+ * @name	damage_is_local
+ * @brief	tests whether everything the view draws stays inside its box
+ * @param	v - (const timestep_view *) view that changed
+ * @retval	bool - false if a change to it has to redraw the whole screen
+ */
+static bool damage_is_local(const timestep_view *v) {
+    return !v->draws_outside_bounds && !v->has_jsrender &&
+           v->width > UNDEFINED_DIMENSION && v->height > UNDEFINED_DIMENSION &&
+           (v->clip || !v->subview_count);
+}
+
+/**
+ * @name	timestep_view_damage
+ * @brief	notes that the view draws differently, so that with partial
+ *          redraw only where it was and where it is get redrawn, and
+ *          without it the next frame is drawn
+ * @param	v - (timestep_view *) view that changed
+ * @retval	NONE
+ */
+void timestep_view_damage(timestep_view *v) {
+    if (!core_partial_redraw()) {
+        core_invalidate_frame();
+        return;
+    }
+
+    // bitmap caches are drawn whole, and their subviews' bounds are kept
+    // in cache space
+    for (timestep_view *a = v->superview; a; a = a->superview) {
+        if (a->cache_as_bitmap) {
+            v = a;
+        }
+    }
+
+    if (!damage_is_local(v)) {
+        core_invalidate_frame();
+        return;
+    }
+    if (v->damage_queued) {
+        return;
+    }
+
+    if (damaged_count == damaged_size) {
+        unsigned int size = damaged_size ? damaged_size * 2 : 64;
+        timestep_view **views = (timestep_view **) TAG_REALLOC(MEMORY_TAG_VIEWS, damaged_views, sizeof(timestep_view *) * size);
+        if (!views) {
+            LOG("{view} WARNING: Unable to grow the damage list past %u views", damaged_size);
+            core_invalidate_frame();
+            return;
+        }
+        damaged_views = views;
+        damaged_size = size;
+    }
+
+    core_damage_rect(v->world_bounds);
+    v->damage_queued = true;
+    damaged_views[damaged_count++] = v;
+}
+
+static void forget_damage(timestep_view *v) {
+    if (!v->damage_queued) {
+        return;
+    }
+    for (unsigned int i = 0; i < damaged_count; i++) {
+        if (damaged_views[i] == v) {
+            damaged_views[i] = damaged_views[--damaged_count];
+            break;
+        }
+    }
+    v->damage_queued = false;
+}
+
+/**
+ * @name	damage_new_bounds
+ * @brief	damages where a damaged view will be drawn, building its matrix
+ *          down from the root the way the render will
+ * @param	v - (timestep_view *) damaged view
+ * @param	root - (timestep_view *) view about to be rendered
+ * @param	ctx - (context_2d *) context it is rendered into
+ * @retval	NONE
+ */
+static void damage_new_bounds(timestep_view *v, timestep_view *root, context_2d *ctx) {
+    if (!v->superview && v != root) {
+        // detached, its old bounds were all it had to damage
+        return;
+    }
+
+    timestep_view *top = v;
+    while (top != root && top->superview) {
+        if (top->superview->has_jsrender) {
+            // a JS render can leave any matrix for its subviews
+            core_invalidate_frame();
+            return;
+        }
+        top = top->superview;
+    }
+    if (top != root) {
+        // drawn by another render, which can't be told apart from a tree
+        // that isn't drawn at all
+        core_invalidate_frame();
+        return;
+    }
+
+    if (!damage_is_local(v)) {
+        // it changed after it was queued
+        core_invalidate_frame();
+        return;
+    }
+
+    // render_frames only ever sees the world matrices, so build the chain
+    // into a scratch matrix, down from the root
+    matrix_3x3 m = ctx->modelView[ctx->mvp];
+    timestep_view *chain[64];
+    unsigned int depth = 0;
+    for (timestep_view *a = v; a; a = a == root ? NULL : a->superview) {
+        if (depth == sizeof(chain) / sizeof(chain[0])) {
+            core_invalidate_frame();
+            return;
+        }
+        chain[depth++] = a;
+    }
+
+    while (depth--) {
+        timestep_view *a = chain[depth];
+        matrix_3x3 local, world;
+        build_local_transform(a, &local);
+        matrix_3x3_multiply(&m, &local, &world);
+        m = world;
+
+        if (a != v && (a->flip_x || a->flip_y)) {
+            matrix_3x3_translate(&m, a->flip_x ? a->width / 2 : 0, a->flip_y ? a->height / 2 : 0);
+            matrix_3x3_scale(&m, a->flip_x ? -1 : 1, a->flip_y ? -1 : 1);
+            matrix_3x3_translate(&m, a->flip_x ? -a->width / 2 : 0, a->flip_y ? -a->height / 2 : 0);
+        }
+    }
+
+    core_damage_rect(box_bounds(&m, v));
+}
+
+/**
+ * @name	render_damage
+ * @brief	redraws the view tree inside one damaged rect of the screen
+ * @param	v - (timestep_view *) root view
+ * @param	ctx - (context_2d *) on screen context
+ * @param	rect - (const rect_2d *) damaged rect, in screen points
+ * @param	clear - (bool) whether to clear the rect first
+ * @retval	NONE
+ */
+static void render_damage(timestep_view *v, context_2d *ctx, const rect_2d *rect, bool clear, JS_OBJECT_WRAPPER js_ctx, JS_OBJECT_WRAPPER js_opts) {
+    context_2d_save(ctx);
+
+    // the rect is in screen space, the clip is set through the matrix
+    matrix_3x3 *model_view = &ctx->modelView[ctx->mvp];
+    matrix_3x3 m = *model_view;
+    matrix_3x3_identity(model_view);
+    bool visible = context_2d_setClip(ctx, *rect);
+    *model_view = m;
+
+    if (visible) {
+        if (clear) {
+            context_2d_clear_clip(ctx);
+        }
+
+        // is_culled prunes everything outside the clip
+        unsigned int base = render_depth;
+        if (enter_view(v, ctx, &ctx->modelView[ctx->mvp], next_transform_version(), js_ctx, js_opts)) {
+            render_frames(base, js_ctx, js_opts);
+        }
+    }
+
+    context_2d_restore(ctx);
+}
+
+//// Parallel recording
+
+// With enough workers, the root's subviews are split into runs, and the
+// workers walk the runs drawn entirely natively, working out each view's
+// matrix, alpha, composite operation and culling into a list of draws. The
+// main thread helps, waits for every run, then draws the lists and walks the
+// other runs as usual, in subview order. Drawing stays on the main thread,
+// as texture lookups and draw batching aren't thread safe. A run holding
+// anything the walk can't do off the main thread, a JS render, clip, bitmap
+// cache, queued subtree, unsorted subviews or a tick to register, is walked
+// normally. Once a run walked normally changes the tree, the rest is too.
+#define MIN_RECORD_WORKERS 3
+#define MAX_RECORD_TASKS 16
+
+enum record_states { RECORD_QUEUED, RECORD_RUNNING, RECORD_DONE };
+enum record_results { RECORD_SKIP, RECORD_ENTERED, RECORD_ABORT };
+
+typedef struct record_item_t {
+    timestep_view *view;
+    matrix_3x3 matrix; // before the view's flip
+    float alpha;
+    int composite_op;
+} record_item;
+
+typedef struct record_walk_t {
+    timestep_view *view;
+    matrix_3x3 matrix; // what the subviews are drawn in
+    float alpha;
+    int composite_op;
+    double abs_scale;
+    unsigned int next_subview;
+} record_walk;
+
+typedef struct record_task_t {
+    timestep_view *root;
+    unsigned int first; // the run of root's subviews recorded
+    unsigned int last;
+    int state;
+    bool recorded;
+    record_item *items;
+    unsigned int item_count;
+    unsigned int item_size;
+    record_walk *stack;
+    unsigned int depth;
+    unsigned int stack_size;
+} record_task;
+
+// what the root leaves on the context, where every run starts from
+typedef struct record_base_t {
+    matrix_3x3 matrix;
+    float alpha;
+    int composite_op;
+    double abs_scale;
+    rect_2d visible;
+    bool has_visible;
+} record_base;
+
+static bool parallel_record = false;
+static unsigned int tree_generation = 0;
+static record_task record_tasks[MAX_RECORD_TASKS];
+static record_base record_start;
+static pthread_mutex_t record_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t record_done = PTHREAD_COND_INITIALIZER;
+
+/**
+ * @name	timestep_view_set_parallel_record
+ * @brief	sets whether full renders record the root's native subtrees on
+ *          the job workers, when there are enough of them
+ * @param	enabled - (bool) true to record in parallel
+ * @retval	NONE
+ */
+void timestep_view_set_parallel_record(bool enabled) {
+    parallel_record = enabled;
+}
+
+// makes room for one more item and walk frame, never moving them otherwise
+static bool record_reserve(record_task *task) {
+    if (task->item_count == task->item_size) {
+        unsigned int size = task->item_size ? task->item_size * 2 : 256;
+        record_item *items = (record_item *)realloc(task->items, sizeof(record_item) * size);
+        if (!items) {
+            return false;
+        }
+        task->items = items;
+        task->item_size = size;
+    }
+    if (task->depth == task->stack_size) {
+        unsigned int size = task->stack_size ? task->stack_size * 2 : 32;
+        record_walk *stack = (record_walk *)realloc(task->stack, sizeof(record_walk) * size);
+        if (!stack) {
+            return false;
+        }
+        task->stack = stack;
+        task->stack_size = size;
+    }
+    return true;
+}
+
+/**
+ * @name	record_view
+ * @brief	does what enter_view does for a view, into the task's lists
+ *          instead of a context, on any thread. Room must be reserved
+ * @param	task - (record_task *) task recording the view
+ * @param	v - (timestep_view *) view to enter
+ * @param	parent - (const record_walk *) the superview's state
+ * @retval	int - RECORD_ENTERED if an item and a walk frame were added,
+ *          RECORD_ABORT if the run must be walked on the main thread
+ */
+static int record_view(record_task *task, timestep_view *v, const record_walk *parent) {
+    if (!v->visible || !v->opacity) {
+        return RECORD_SKIP;
+    }
+
+    bool ticks = v->has_jstick || v->timestep_view_tick != default_view_tick;
+    if (v->has_jsrender || v->clip || v->cache_as_bitmap || v->cache_ctx ||
+        v->order_independent || v->sort_by_draw_state || v->dirty_z_index || ticks != v->tick_registered) {
+        return RECORD_ABORT;
+    }
+    if (v->width < 0 || v->height < 0) {
+        return RECORD_SKIP;
+    }
+
+    record_item *item = &task->items[task->item_count];
+    matrix_3x3 local;
+    build_local_transform(v, &local);
+    matrix_3x3_multiply(&parent->matrix, &local, &item->matrix);
+
+    double scale = parent->abs_scale;
+    if (v->scale != 1 || v->scale_x != 1 || v->scale_y != 1) {
+        scale *= v->scale;
+    }
+    v->abs_scale = scale;
+
+    v->culled = false;
+    if (!v->draws_outside_bounds && v->width > UNDEFINED_DIMENSION && v->height > UNDEFINED_DIMENSION) {
+        v->world_bounds = box_bounds(&item->matrix, v);
+        v->culled = record_start.has_visible && is_outside(&v->world_bounds, &record_start.visible);
+    }
+    if (v->culled) {
+        return RECORD_SKIP;
+    }
+
+    item->view = v;
+    item->alpha = parent->alpha * v->opacity;
+    item->composite_op = v->composite_operation ? v->composite_operation : parent->composite_op;
+    // the item only carries the matrix down to the walk frame
+    if (!is_pass_through(v)) {
+        task->item_count++;
+    }
+
+    record_walk *walk = &task->stack[task->depth++];
+    walk->view = v;
+    walk->matrix = item->matrix;
+    if (v->flip_x || v->flip_y) {
+        matrix_3x3_translate(&walk->matrix, v->flip_x ? v->width / 2 : 0, v->flip_y ? v->height / 2 : 0);
+        matrix_3x3_scale(&walk->matrix, v->flip_x ? -1 : 1, v->flip_y ? -1 : 1);
+        matrix_3x3_translate(&walk->matrix, v->flip_x ? -v->width / 2 : 0, v->flip_y ? -v->height / 2 : 0);
+    }
+    walk->alpha = item->alpha;
+    walk->composite_op = item->composite_op;
+    walk->abs_scale = scale;
+    walk->next_subview = 0;
+    return RECORD_ENTERED;
+}
+
+/**
+ * @name	record_run
+ * @brief	walks the task's run of subviews depth first, without recursing,
+ *          recording a draw for each view that isn't culled
+ * @param	task - (record_task *) claimed task
+ * @retval	bool - false if the run must be walked on the main thread
+ */
+static bool record_run(record_task *task) {
+    record_walk start;
+    start.view = task->root;
+    start.matrix = record_start.matrix;
+    start.alpha = record_start.alpha;
+    start.composite_op = record_start.composite_op;
+    start.abs_scale = record_start.abs_scale;
+
+    task->item_count = 0;
+    for (unsigned int i = task->first; i < task->last; i++) {
+        task->depth = 0;
+        if (!record_reserve(task) || record_view(task, task->root->subviews[i], &start) == RECORD_ABORT) {
+            return false;
+        }
+
+        while (task->depth > 0) {
+            if (!record_reserve(task)) {
+                return false;
+            }
+            record_walk *walk = &task->stack[task->depth - 1];
+            if (walk->next_subview < walk->view->subview_count) {
+                timestep_view *subview = walk->view->subviews[walk->next_subview++];
+                if (record_view(task, subview, walk) == RECORD_ABORT) {
+                    return false;
+                }
+            } else {
+                task->depth--;
+            }
+        }
+    }
+    return true;
+}
+
+// takes a queued task, so it is recorded by exactly one thread
+static bool record_claim(record_task *task) {
+    int expected = RECORD_QUEUED;
+    return __atomic_compare_exchange_n(&task->state, &expected, RECORD_RUNNING, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static void record_task_run(record_task *task) {
+    bool recorded = record_run(task);
+    pthread_mutex_lock(&record_mutex);
+    task->recorded = recorded;
+    __atomic_store_n(&task->state, RECORD_DONE, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&record_done);
+    pthread_mutex_unlock(&record_mutex);
+}
+
+// a job the main thread got to first, possibly frames ago, finds nothing
+static void record_job(void *data) {
+    record_task *task = (record_task *) data;
+    if (record_claim(task)) {
+        record_task_run(task);
+    }
+}
+
+/**
+ * @name	draw_recorded
+ * @brief	draws a recorded run as the walk would have
+ * @param	task - (record_task *) recorded task
+ * @param	ctx - (context_2d *) context the root was entered into
+ * @retval	NONE
+ */
+static void draw_recorded(record_task *task, context_2d *ctx) {
+    for (unsigned int i = 0; i < task->item_count; i++) {
+        record_item *item = &task->items[i];
+        timestep_view *v = item->view;
+
+        context_2d_save_transform(ctx, &item->matrix);
+        context_2d_setGlobalAlpha(ctx, item->alpha);
+        context_2d_setGlobalCompositeOperation(ctx, item->composite_op);
+        draw_background(v, ctx);
+        apply_flip(v, ctx);
+        v->timestep_view_render(v, ctx);
+        clear_filters(v, ctx);
+        context_2d_restore(ctx);
+    }
+}
+
+/**
+ * @name	render_parallel
+ * @brief	renders the subviews of the root frame, recording what it can
+ *          on the workers, then unwinds the frame
+ * @param	base - (unsigned int) stack depth below the root's frame
+ * @param	ctx - (context_2d *) context the root was entered into
+ * @retval	bool - false if nothing was done, to walk as usual
+ */
+static bool render_parallel(unsigned int base, context_2d *ctx, JS_OBJECT_WRAPPER js_ctx, JS_OBJECT_WRAPPER js_opts) {
+    timestep_view *root = render_stack[base].view;
+    unsigned int count = root->subview_count;
+    if (!parallel_record || render_stack[base].indexed || count < 2 || ctx->recording ||
+        jobs_worker_count() < MIN_RECORD_WORKERS) {
+        return false;
+    }
+
+    record_start.matrix = *frame_matrix(&render_stack[base]);
+    record_start.alpha = context_2d_getGlobalAlpha(ctx);
+    record_start.composite_op = context_2d_getGlobalCompositeOperation(ctx);
+    record_start.abs_scale = abs_scale;
+    record_start.has_visible = visible_rect(ctx, &record_start.visible);
+
+    unsigned int task_count = count < MAX_RECORD_TASKS ? count : MAX_RECORD_TASKS;
+    for (unsigned int i = 0; i < task_count; i++) {
+        record_task *task = &record_tasks[i];
+        task->root = root;
+        task->first = count * i / task_count;
+        task->last = count * (i + 1) / task_count;
+        task->recorded = false;
+        __atomic_store_n(&task->state, RECORD_QUEUED, __ATOMIC_RELEASE);
+    }
+    for (unsigned int i = 0; i < task_count; i++) {
+        jobs_submit(record_job, NULL, &record_tasks[i], JOB_PRIORITY_HIGH);
+    }
+
+    // record what the workers haven't started, then wait for the rest, as a
+    // JS render could change the tree under them
+    for (unsigned int i = 0; i < task_count; i++) {
+        if (record_claim(&record_tasks[i])) {
+            record_task_run(&record_tasks[i]);
+        }
+    }
+    pthread_mutex_lock(&record_mutex);
+    for (unsigned int i = 0; i < task_count; i++) {
+        while (__atomic_load_n(&record_tasks[i].state, __ATOMIC_ACQUIRE) != RECORD_DONE) {
+            pthread_cond_wait(&record_done, &record_mutex);
+        }
+    }
+    pthread_mutex_unlock(&record_mutex);
+
+    unsigned int generation = tree_generation;
+    for (unsigned int i = 0; i < task_count && generation == tree_generation; i++) {
+        record_task *task = &record_tasks[i];
+        if (task->recorded) {
+            draw_recorded(task, ctx);
+            render_stack[base].next_subview = task->last;
+            continue;
+        }
+
+        // the walk of render_frames, bounded to the run
+        while (generation == tree_generation && render_stack[base].next_subview < task->last &&
+               render_stack[base].next_subview < root->subview_count) {
+            timestep_view *subview = root->subviews[render_stack[base].next_subview++];
+            if (subview->superview == root &&
+                enter_view(subview, ctx, frame_matrix(&render_stack[base]), render_stack[base].version, js_ctx, js_opts)) {
+                render_frames(base + 1, js_ctx, js_opts);
+            }
+        }
+    }
+
+    // the rest of the subviews, if the tree changed, and the root's frame
+    render_frames(base, js_ctx, js_opts);
+    return true;
+}
+
+static void wrap_render(timestep_view *v, context_2d *ctx, JS_OBJECT_WRAPPER js_ctx, JS_OBJECT_WRAPPER js_opts) {
+    bool clear = false;
+    if (ctx->on_screen) {
+        if (core_partial_redraw()) {
+            for (unsigned int i = 0; i < damaged_count; i++) {
+                damaged_views[i]->damage_queued = false;
+                damage_new_bounds(damaged_views[i], v, ctx);
+            }
+            damaged_count = 0;
+        }
+
+        if (!core_frame_should_draw()) {
+            // nothing changed since the screen was last drawn
+            return;
+        }
+
+        // context_2d_clear leaves the screen alone with partial redraw
+        clear = core_partial_redraw() && core_frame_take_clear();
+
+        const rect_2d *damage;
+        int damage_count;
+        if (core_get_frame_damage(&damage, &damage_count)) {
+            for (int i = 0; i < damage_count; i++) {
+                render_damage(v, ctx, &damage[i], clear, js_ctx, js_opts);
+            }
+            return;
+        }
+    }
+
+    if (clear) {
+        context_2d_clear_clip(ctx);
+    }
+
+    unsigned int base = render_depth;
+    // nothing is known about the caller's matrix
+    if (enter_view(v, ctx, &ctx->modelView[ctx->mvp], next_transform_version(), js_ctx, js_opts) &&
+        !render_parallel(base, ctx, js_ctx, js_opts)) {
+        render_frames(base, js_ctx, js_opts);
+    }
+}
+
+void timestep_view_wrap_render(timestep_view *v, context_2d *ctx, JS_OBJECT_WRAPPER js_ctx, JS_OBJECT_WRAPPER js_opts) {
+    LOGFN("timestep_view_wrap_render");
+    PROFILE_ZONE("timestep_view_wrap_render");
+    frame_timing_render_begin();
+    wrap_render(v, ctx, js_ctx, js_opts);
+    frame_timing_render_end();
+    LOGFN("end timestep_view_wrap_render");
+}
+
+void timestep_view_render(timestep_view *v) {
+    // do background color???
+}
+
+
+
+typedef struct tick_frame_t {
+    timestep_view *view;
+    unsigned int next_subview;
+} tick_frame;
+
+static tick_frame *tick_stack = NULL;
+static unsigned int tick_depth = 0;
+static unsigned int tick_stack_size = 0;
+
+static void tick_view(timestep_view *v, double dt) {
+    if (v->has_jstick) {
+        def_timestep_view_tick(v->js_view, dt);
+    } else {
+        v->timestep_view_tick(v, dt);
+    }
+}
+
+static bool push_tick_frame(timestep_view *v) {
+    if (tick_depth == tick_stack_size) {
+        unsigned int size = tick_stack_size ? tick_stack_size * 2 : 64;
+        tick_frame *stack = (tick_frame *)TAG_REALLOC(MEMORY_TAG_VIEWS, tick_stack, sizeof(tick_frame) * size);
+        if (!stack) {
+            LOG("{view} WARNING: Unable to grow the tick stack past %u views", tick_stack_size);
+            return false;
+        }
+        tick_stack = stack;
+        tick_stack_size = size;
+    }
+    tick_stack[tick_depth].view = v;
+    tick_stack[tick_depth].next_subview = 0;
+    tick_depth++;
+    return true;
+}
+
+void timestep_view_wrap_tick(timestep_view *v, double dt) {
+    LOGFN("timestep_view_wrap_tick");
+    unsigned int base = tick_depth;
+    refresh_tick(v);
+    tick_view(v, dt);
+    push_tick_frame(v);
+
+    // subviews are read live, as JS ticks may add or remove siblings
+    while (tick_depth > base) {
+        tick_frame *frame = &tick_stack[tick_depth - 1];
+        timestep_view *parent = frame->view;
+
+        if (frame->next_subview < parent->subview_count) {
+            timestep_view *subview = parent->subviews[frame->next_subview++];
+            if (subview && subview->tick_count) {
+                refresh_tick(subview);
+                if (subview->tick_registered) {
+                    tick_view(subview, dt);
+                }
+                // the tick may have detached it or emptied its subtree
+                if (subview->tick_count > (subview->tick_registered ? 1u : 0u)) {
+                    push_tick_frame(subview);
+                }
+            }
+        } else {
+            tick_depth--;
+        }
+    }
+
+    // TODO: needs repaint?
+    LOGFN("end timestep_view_wrap_tick");
+}
+
+void timestep_view_tick(timestep_view *v, double dt) {
+
+}
+
+void timestep_view_add_animation(timestep_view *view, view_animation *anim) {
+    LOGFN("timestep_view_add_animation");
+
+    if (view->anim_count == view->max_anims) {
+        view->max_anims = view->max_anims ? view->max_anims * 2 : 1;
+        view->anims = (view_animation**)TAG_REALLOC(MEMORY_TAG_VIEWS, view->anims, sizeof(view_animation *) * view->max_anims);
+    }
+    anim->view_index = view->anim_count;
+    view->anims[view->anim_count++] = anim;
+    LOGFN("end timestep_view_add_animation");
+}
+
+void timestep_view_remove_animation(timestep_view *view, view_animation *anim) {
+    LOGFN("timestep_view_remove_animation");
+
+    unsigned int i = anim->view_index;
+    if (i >= view->anim_count || view->anims[i] != anim) {
+        LOG("{view} WARNING: Tried to remove an animation that is not on view %i", view->uid);
+        return;
+    }
+
+    // order does not matter, so fill the hole with the last animation
+    view_animation *last = view->anims[--view->anim_count];
+    view->anims[i] = last;
+    last->view_index = i;
+    LOGFN("end timestep_view_remove_animation");
+}
+
+static int timestep_view_comparator(const void *a, const void *b) {
+    timestep_view *va = *(timestep_view**)a;
+    timestep_view *vb = *(timestep_view**)b;
+    int diff = va->z_index - vb->z_index;
+    if (diff == 0) {
+        // siblings, so either superview tells whether they batch first
+        if (va->draw_key != vb->draw_key && va->superview && va->superview->sort_by_draw_state) {
+            return va->draw_key < vb->draw_key ? -1 : 1;
+        }
+        return va->added_at - vb->added_at;
+    } else {
+        return diff;
+    }
+}
+
+// an insertion sort that moves more than this many views per subview gives
+// up and falls back to qsort
+#define SORT_MOVE_BUDGET 8
+
+/**
+ * @name	insertion_sort_subviews
+ * @brief	sorts the subviews in place, which is linear when only a few of
+ *          them are out of order (the usual case after a z change)
+ * @param	v - (timestep_view *) view whose subviews to sort
+ * @retval	bool - false if the subviews turned out to be too far out of
+ *          order, leaving them partially sorted
+ */
+static bool insertion_sort_subviews(timestep_view *v) {
+    timestep_view **subviews = v->subviews;
+    unsigned int count = v->subview_count;
+    unsigned int budget = count * SORT_MOVE_BUDGET;
+
+    for (unsigned int i = 1; i < count; i++) {
+        timestep_view *subview = subviews[i];
+        unsigned int j = i;
+        while (j > 0 && timestep_view_comparator(&subviews[j - 1], &subview) > 0) {
+            subviews[j] = subviews[j - 1];
+            subviews[j]->subview_index = j;
+            j--;
+            if (--budget == 0) {
+                subviews[j] = subview;
+                subview->subview_index = j;
+                return false;
+            }
+        }
+        if (j != i) {
+            subviews[j] = subview;
+            subview->subview_index = j;
+        }
+    }
+
+    return true;
+}
 
-    return v;
+void timestep_view_sort_subviews(timestep_view *v) {
+    LOGFN("timestep_view_sort_subviews");
+    v->draw_state_sorted = v->sort_by_draw_state;
+    if (!insertion_sort_subviews(v)) {
+        qsort(v->subviews, v->subview_count, sizeof(timestep_view*), timestep_view_comparator);
+        for (unsigned int i = 0; i < v->subview_count; i++) {
+            v->subviews[i]->subview_index = i;
+        }
+    }
+    LOGFN("end timestep_view_sort_subviews");
 }
 
-void timestep_view_set_type(timestep_view *v, unsigned int type) {
-    LOGFN("timestep_view_set_type");
-    switch (type) {
-    default:
-    case DEFAULT_RENDER:
-        break;
-    case IMAGE_VIEW:
-        v->timestep_view_render = image_view_render;
-        break;
+//// Spatial index
+
+/*
+ * A container with many subviews can file them in a uniform grid over its
+ * own space, so culling and hit testing only visit the subviews near the
+ * viewport or the touch. Subviews drawing outside their bounds, or too big
+ * for a handful of cells, sit in an overflow list every query returns.
+ * Moves are queued and the grid catches up before the next query.
+ */
+
+#define SPATIAL_MAX_VIEW_CELLS 64 /* subviews spanning more cells overflow */
+#define SPATIAL_MAX_QUERY_CELLS 4096 /* larger queries visit every subview */
+
+enum spatial_states { SPATIAL_NONE, SPATIAL_GRID, SPATIAL_OVERFLOW };
+
+typedef struct spatial_cell_t {
+    long long key;
+    timestep_view **views;
+    unsigned int count;
+    unsigned int capacity;
+    UT_hash_handle hh;
+} spatial_cell;
+
+typedef struct view_spatial_index_t {
+    double cell_size;
+    spatial_cell *cells;
+    timestep_view **overflow;
+    unsigned int overflow_count;
+    unsigned int overflow_capacity;
+    timestep_view **dirty;
+    unsigned int dirty_count;
+    unsigned int dirty_capacity;
+    timestep_view **results;
+    unsigned int result_count;
+    unsigned int result_capacity;
+    unsigned int stamp;
+} view_spatial_index;
+
+static bool view_array_push(timestep_view ***array, unsigned int *count, unsigned int *capacity, timestep_view *v) {
+    if (*count == *capacity) {
+        unsigned int size = *capacity ? *capacity * 2 : 16;
+        timestep_view **grown = (timestep_view **)TAG_REALLOC(MEMORY_TAG_VIEWS, *array, sizeof(timestep_view *) * size);
+        if (!grown) {
+            return false;
+        }
+        *array = grown;
+        *capacity = size;
     }
-    LOGFN("end timestep_view_set_type");
+    (*array)[(*count)++] = v;
+    return true;
 }
 
-static double abs_scale = 1;
+static inline long long spatial_key(int cx, int cy) {
+    return ((long long) cx << 32) | (unsigned int) cy;
+}
 
-void timestep_view_start_render() {
-    abs_scale = 1;
+static inline int spatial_coord(view_spatial_index *index, double value) {
+    double cell = floor(value / index->cell_size);
+    return cell < INT_MIN ? INT_MIN : cell > INT_MAX ? INT_MAX : (int) cell;
 }
 
-void timestep_view_wrap_render(timestep_view *v, context_2d *ctx, JS_OBJECT_WRAPPER js_ctx, JS_OBJECT_WRAPPER js_opts) {
-    LOGFN("timestep_view_wrap_render");
-    if (!v->visible || !v->opacity) {
-        return;
+/**
+ * @name	spatial_view_bounds
+ * @brief	finds the box around a subview in its superview's space
+ * @param	v - (timestep_view *) subview to measure
+ * @param	bounds - (double *) min x, min y, max x, max y
+ * @retval	bool - false if the subview can not be filed by its bounds
+ */
+static bool spatial_view_bounds(timestep_view *v, double *bounds) {
+    if (v->width <= UNDEFINED_DIMENSION || v->height <= UNDEFINED_DIMENSION ||
+            v->draws_outside_bounds || (v->subview_count && !v->clip)) {
+        return false;
     }
 
-    if (v->dirty_z_index) {
-        v->dirty_z_index = false;
-        timestep_view_sort_subviews(v);
+    double sx = v->scale * v->scale_x;
+    double sy = v->scale * v->scale_y;
+    double c = v->r ? cos(v->r) : 1;
+    double s = v->r ? sin(v->r) : 0;
+    double tx = v->x + v->anchor_x + v->offset_x;
+    double ty = v->y + v->anchor_y + v->offset_y;
+    double corners[4][2] = {{0, 0}, {v->width, 0}, {0, v->height}, {v->width, v->height}};
+
+    for (int i = 0; i < 4; i++) {
+        double px = (corners[i][0] - v->anchor_x) * sx;
+        double py = (corners[i][1] - v->anchor_y) * sy;
+        double x = tx + c * px - s * py;
+        double y = ty + s * px + c * py;
+        if (i == 0 || x < bounds[0]) bounds[0] = x;
+        if (i == 0 || y < bounds[1]) bounds[1] = y;
+        if (i == 0 || x > bounds[2]) bounds[2] = x;
+        if (i == 0 || y > bounds[3]) bounds[3] = y;
     }
-    if (v->width < 0 || v->height < 0) {
-        return;
+    return true;
+}
+
+static void spatial_unfile(view_spatial_index *index, timestep_view *v) {
+    if (v->index_state == SPATIAL_GRID) {
+        for (int cx = v->index_cells[0]; cx <= v->index_cells[2]; cx++) {
+            for (int cy = v->index_cells[1]; cy <= v->index_cells[3]; cy++) {
+                long long key = spatial_key(cx, cy);
+                spatial_cell *cell;
+                HASH_FIND(hh, index->cells, &key, sizeof(key), cell);
+                if (!cell) {
+                    continue;
+                }
+                for (unsigned int i = 0; i < cell->count; i++) {
+                    if (cell->views[i] == v) {
+                        cell->views[i] = cell->views[--cell->count];
+                        break;
+                    }
+                }
+                if (!cell->count) {
+                    HASH_DEL(index->cells, cell);
+                    TAG_FREE(cell->views);
+                    TAG_FREE(cell);
+                }
+            }
+        }
+    } else if (v->index_state == SPATIAL_OVERFLOW) {
+        timestep_view *last = index->overflow[--index->overflow_count];
+        index->overflow[v->index_slot] = last;
+        last->index_slot = v->index_slot;
     }
+    v->index_state = SPATIAL_NONE;
+}
 
-    context_2d_save(ctx);
-    context_2d_translate(ctx, v->x + v->anchor_x + v->offset_x, v->y + v->anchor_y + v->offset_y);
+static void spatial_file(view_spatial_index *index, timestep_view *v) {
+    double bounds[4];
+    if (spatial_view_bounds(v, bounds)) {
+        int min_cx = spatial_coord(index, bounds[0]);
+        int min_cy = spatial_coord(index, bounds[1]);
+        int max_cx = spatial_coord(index, bounds[2]);
+        int max_cy = spatial_coord(index, bounds[3]);
+
+        if ((long long) (max_cx - min_cx + 1) * (max_cy - min_cy + 1) <= SPATIAL_MAX_VIEW_CELLS) {
+            bool filed = true;
+            for (int cx = min_cx; cx <= max_cx && filed; cx++) {
+                for (int cy = min_cy; cy <= max_cy && filed; cy++) {
+                    long long key = spatial_key(cx, cy);
+                    spatial_cell *cell;
+                    HASH_FIND(hh, index->cells, &key, sizeof(key), cell);
+                    if (!cell) {
+                        cell = (spatial_cell *)TAG_CALLOC(MEMORY_TAG_VIEWS, 1, sizeof(spatial_cell));
+                        if (!cell) {
+                            filed = false;
+                            break;
+                        }
+                        cell->key = key;
+                        HASH_ADD(hh, index->cells, key, sizeof(cell->key), cell);
+                    }
+                    filed = view_array_push(&cell->views, &cell->count, &cell->capacity, v);
+                }
+            }
+
+            v->index_cells[0] = min_cx;
+            v->index_cells[1] = min_cy;
+            v->index_cells[2] = max_cx;
+            v->index_cells[3] = max_cy;
+            v->index_state = SPATIAL_GRID;
+            if (filed) {
+                return;
+            }
+            // unfiling skips the cells it never reached
+            spatial_unfile(index, v);
+        }
+    }
 
-    if (v->r) {
-        context_2d_rotate(ctx, v->r);
+    v->index_slot = index->overflow_count;
+    if (view_array_push(&index->overflow, &index->overflow_count, &index->overflow_capacity, v)) {
+        v->index_state = SPATIAL_OVERFLOW;
+    } else {
+        LOG("{view} WARNING: Unable to file view %u in its superview's spatial index", v->uid);
+        v->index_state = SPATIAL_NONE;
     }
-    if (v->scale != 1 || v->scale_x != 1 || v->scale_y != 1) {
-        context_2d_scale(ctx, v->scale * v->scale_x, v->scale * v->scale_y);
-        abs_scale *= v->scale;
+}
+
+static void spatial_forget(view_spatial_index *index, timestep_view *v) {
+    spatial_unfile(index, v);
+    if (v->index_dirty) {
+        v->index_dirty = false;
+        for (unsigned int i = 0; i < index->dirty_count; i++) {
+            if (index->dirty[i] == v) {
+                index->dirty[i] = index->dirty[--index->dirty_count];
+                break;
+            }
+        }
     }
+}
 
-    v->abs_scale = abs_scale;
+static void spatial_flush(view_spatial_index *index) {
+    for (unsigned int i = 0; i < index->dirty_count; i++) {
+        timestep_view *v = index->dirty[i];
+        v->index_dirty = false;
+        spatial_unfile(index, v);
+        spatial_file(index, v);
+    }
+    index->dirty_count = 0;
+}
 
-    if (v->opacity != 1) {
-        double alpha = context_2d_getGlobalAlpha(ctx);
-        context_2d_setGlobalAlpha(ctx, alpha * v->opacity);
+static void spatial_free(timestep_view *v) {
+    view_spatial_index *index = v->spatial_index;
+    spatial_cell *cell, *tmp;
+
+    HASH_ITER(hh, index->cells, cell, tmp) {
+        HASH_DEL(index->cells, cell);
+        TAG_FREE(cell->views);
+        TAG_FREE(cell);
+    }
+    for (unsigned int i = 0; i < v->subview_count; i++) {
+        v->subviews[i]->index_state = SPATIAL_NONE;
+        v->subviews[i]->index_dirty = false;
     }
 
-    context_2d_translate(ctx, -v->anchor_x, -v->anchor_y);
+    TAG_FREE(index->overflow);
+    TAG_FREE(index->dirty);
+    TAG_FREE(index->results);
+    TAG_FREE(index);
+    v->spatial_index = NULL;
+}
 
-    if (v->clip) {
-        rect_2d r = {0, 0, static_cast<float>(v->width), static_cast<float>(v->height)};
-        context_2d_setClip(ctx, r);
+/**
+ * @name	spatial_query
+ * @brief	collects the subviews that may overlap a box in the container's
+ *          space, in drawing order
+ * @param	v - (timestep_view *) container with a spatial index
+ * @param	bounds - (const double *) min x, min y, max x, max y
+ * @param	count - (unsigned int *) receives the number of subviews found
+ * @retval	timestep_view** - the subviews, or NULL to visit all of them
+ */
+static timestep_view **spatial_query(timestep_view *v, const double *bounds, unsigned int *count) {
+    view_spatial_index *index = v->spatial_index;
+    spatial_flush(index);
+
+    int min_cx = spatial_coord(index, bounds[0]);
+    int min_cy = spatial_coord(index, bounds[1]);
+    int max_cx = spatial_coord(index, bounds[2]);
+    int max_cy = spatial_coord(index, bounds[3]);
+    if ((long long) (max_cx - min_cx + 1) * (max_cy - min_cy + 1) > SPATIAL_MAX_QUERY_CELLS) {
+        return NULL;
     }
 
-    //apply filters
-    rgba f = v->filter_color;
-    ctx->filter_color.r = f.r;
-    ctx->filter_color.g = f.g;
-    ctx->filter_color.b = f.b;
-    ctx->filter_color.a = f.a;
-    if (v->filter_type != FILTER_NONE) {
-        context_2d_set_filter_type(ctx, v->filter_type);
+    if (++index->stamp == 0) {
+        index->stamp = 1;
+    }
+    index->result_count = 0;
+
+    for (int cx = min_cx; cx <= max_cx; cx++) {
+        for (int cy = min_cy; cy <= max_cy; cy++) {
+            long long key = spatial_key(cx, cy);
+            spatial_cell *cell;
+            HASH_FIND(hh, index->cells, &key, sizeof(key), cell);
+            if (!cell) {
+                continue;
+            }
+            for (unsigned int i = 0; i < cell->count; i++) {
+                timestep_view *subview = cell->views[i];
+                if (subview->index_stamp != index->stamp) {
+                    subview->index_stamp = index->stamp;
+                    if (!view_array_push(&index->results, &index->result_count, &index->result_capacity, subview)) {
+                        return NULL;
+                    }
+                }
+            }
+        }
+    }
+    for (unsigned int i = 0; i < index->overflow_count; i++) {
+        if (!view_array_push(&index->results, &index->result_count, &index->result_capacity, index->overflow[i])) {
+            return NULL;
+        }
     }
 
-    if (v->background_color.a > 0) {
-        //LOG("render %i with background %f %f %f %f", v->uid, v->background_color.r, v->background_color.g, v->background_color.b, v->background_color.a);
+    // the comparator the subviews are kept sorted by gives drawing order
+    qsort(index->results, index->result_count, sizeof(timestep_view *), timestep_view_comparator);
+    *count = index->result_count;
+    return index->results;
+}
 
-        rect_2d r = {0, 0, static_cast<float>(v->width), static_cast<float>(v->height)};
-        context_2d_fillRect(ctx, &r, &v->background_color);
+static timestep_view **spatial_results(timestep_view *v, unsigned int *count) {
+    if (!v->spatial_index) {
+        return NULL;
     }
+    *count = v->spatial_index->result_count;
+    return v->spatial_index->results;
+}
 
+void timestep_view_set_spatial_index(timestep_view *v, double cell_size) {
+    if (v->spatial_index) {
+        spatial_free(v);
+    }
+    if (cell_size <= 0) {
+        return;
+    }
 
-    if (v->flip_x || v->flip_y) {
-        context_2d_translate(ctx,
-                             v->flip_x ? v->width / 2 : 0,
-                             v->flip_y ? v->height / 2 : 0);
-
-        context_2d_scale(ctx,
-                         v->flip_x ? -1 : 1,
-                         v->flip_y ? -1 : 1);
+    view_spatial_index *index = (view_spatial_index *)TAG_CALLOC(MEMORY_TAG_VIEWS, 1, sizeof(view_spatial_index));
+    if (!index) {
+        LOG("{view} WARNING: Unable to allocate a spatial index for view %u", v->uid);
+        return;
+    }
+    index->cell_size = cell_size;
+    v->spatial_index = index;
 
-        context_2d_translate(ctx,
-                             v->flip_x ? -v->width / 2 : 0,
-                             v->flip_y ? -v->height / 2 : 0);
+    for (unsigned int i = 0; i < v->subview_count; i++) {
+        v->subviews[i]->index_dirty = false;
+        spatial_file(index, v->subviews[i]);
     }
+}
 
-    // Set Global Composite Operation
-    if (0 != v->composite_operation) {
-        context_2d_setGlobalCompositeOperation(ctx, v->composite_operation);
+void timestep_view_mark_moved(timestep_view *v) {
+    view_spatial_index *index = v->superview ? v->superview->spatial_index : NULL;
+    if (!index || v->index_dirty) {
+        return;
     }
 
-  JS_OBJECT_WRAPPER js_viewport;
-  bool should_restore_viewport = false;
-    if (v->has_jsrender) {
-        should_restore_viewport = true;
-        js_viewport = def_get_viewport(js_opts);
-        def_timestep_view_render(v->js_view, js_ctx, js_opts);
+    if (view_array_push(&index->dirty, &index->dirty_count, &index->dirty_capacity, v)) {
+        v->index_dirty = true;
     } else {
-        v->timestep_view_render(v, ctx);
+        spatial_unfile(index, v);
+        spatial_file(index, v);
     }
+}
 
-    //restore filters
-    if (v->filter_type != FILTER_NONE) {
-        context_2d_set_filter_type(ctx, FILTER_NONE);
+static void mark_caches_dirty(timestep_view *v) {
+    // anything that moves subviews around passes through here
+    tree_generation++;
+    while (v) {
+        v->cache_dirty = true;
+        v = v->superview;
     }
-    ctx->filter_color.r = 0;
-    ctx->filter_color.g = 0;
-    ctx->filter_color.b = 0;
-    ctx->filter_color.a = 0;
+}
 
-    for (unsigned int i = 0; i < v->subview_count; i++) {
-        timestep_view *subview = v->subviews[i];
-        timestep_view_wrap_render(subview, ctx, js_ctx, js_opts);
+/**
+ * @name	find_subview
+ * @brief	finds the subview's position in v's subview array
+ * @param	v - (timestep_view *) parent view
+ * @param	subview - (timestep_view *) subview to find
+ * @retval	int - the index of the subview, or -1 if it isn't a subview of v
+ */
+static int find_subview(timestep_view *v, timestep_view *subview) {
+    // subview_index is only a hint; adds and removes shift their neighbours
+    // without rewriting them, so search outwards from it
+    int count = (int) v->subview_count;
+    int hint = (int) subview->subview_index;
+    if (hint >= count) {
+        hint = count - 1;
     }
 
-    if (should_restore_viewport) {
-        def_restore_viewport(js_opts, js_viewport);
+    for (int lo = hint, hi = hint + 1; lo >= 0 || hi < count; lo--, hi++) {
+        if (lo >= 0 && v->subviews[lo] == subview) {
+            subview->subview_index = lo;
+            return lo;
+        }
+        if (hi < count && v->subviews[hi] == subview) {
+            subview->subview_index = hi;
+            return hi;
+        }
     }
 
-    context_2d_restore(ctx);
-
-    LOGFN("end timestep_view_wrap_render");
+    return -1;
 }
 
-void timestep_view_render(timestep_view *v) {
-    // do background color???
+/**
+ * @name	insert_subview
+ * @brief	inserts the subview after every sibling that sorts before it
+ * @param	v - (timestep_view *) parent view with room for one more subview
+ * @param	subview - (timestep_view *) subview to insert
+ * @retval	NONE
+ */
+static void insert_subview(timestep_view *v, timestep_view *subview) {
+    timestep_view **subviews = v->subviews;
+    unsigned int count = v->subview_count;
+    unsigned int pos = count;
+
+    // the common case: nothing sorts after the new subview
+    if (count && timestep_view_comparator(&subviews[count - 1], &subview) > 0) {
+        unsigned int lo = 0, hi = count;
+        while (lo < hi) {
+            unsigned int mid = (lo + hi) / 2;
+            if (timestep_view_comparator(&subviews[mid], &subview) > 0) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        pos = lo;
+        memmove(&subviews[pos + 1], &subviews[pos], sizeof(timestep_view*) * (count - pos));
+    }
+
+    subviews[pos] = subview;
+    subview->subview_index = pos;
+    v->subview_count++;
 }
 
+/**
+ * @name	timestep_view_set_z_index
+ * @brief	sets the view's z index and moves it to its new place among its
+ *          siblings, without re-sorting them
+ * @param	v - (timestep_view *) view to update
+ * @param	z_index - (int) new z index
+ * @retval	NONE
+ */
+void timestep_view_set_z_index(timestep_view *v, int z_index) {
+    if (v->z_index == z_index) {
+        return;
+    }
 
+    v->z_index = z_index;
 
-void timestep_view_wrap_tick(timestep_view *v, double dt) {
-    LOGFN("timestep_view_wrap_tick");
-    if (v->has_jstick) {
-        def_timestep_view_tick(v->js_view, dt);
-    } else {
-        v->timestep_view_tick(v, dt);
+    timestep_view *superview = v->superview;
+    if (!superview) {
+        return;
     }
 
-    for (unsigned int i = 0; i < v->subview_count; i++) {
-        timestep_view *subview = v->subviews[i];
-        if (subview) {
-            timestep_view_wrap_tick(subview, dt);
-        }
+    int index = find_subview(superview, v);
+    if (index < 0) {
+        superview->dirty_z_index = true;
+        return;
     }
 
-    // TODO: needs repaint?
-    LOGFN("end timestep_view_wrap_tick");
+    // pull it out and binary search it back in; if the siblings are
+    // already waiting on a full sort this still leaves them consistent
+    memmove(&superview->subviews[index], &superview->subviews[index + 1], sizeof(timestep_view*) * (superview->subview_count - index - 1));
+    superview->subview_count--;
+    insert_subview(superview, v);
+    mark_caches_dirty(superview);
+    timestep_view_damage(v);
 }
 
-void timestep_view_tick(timestep_view *v, double dt) {
-
+/**
+ * @name	timestep_view_invalidate_render
+ * @brief	drops the recording of a static JS render, so the next frame
+ *          calls the JS render again and records what it draws
+ * @param	v - (timestep_view *) view whose render changed
+ * @retval	NONE
+ */
+void timestep_view_invalidate_render(timestep_view *v) {
+    if (v->render_list) {
+        display_list_reset(v->render_list);
+    }
 }
 
-void timestep_view_add_animation(timestep_view *view, view_animation *anim) {
-    LOGFN("timestep_view_add_animation");
-
-    if (view->anim_count == view->max_anims) {
-        view->max_anims = view->max_anims ? view->max_anims * 2 : 1;
-        view->anims = (view_animation**)realloc(view->anims, sizeof(view_animation *) * view->max_anims);
-    }
-    view->anims[view->anim_count++] = anim;
-    LOGFN("end timestep_view_add_animation");
+/**
+ * @name	timestep_view_invalidate_cache
+ * @brief	marks the bitmap caches of the view and all its ancestors as dirty
+ * @param	v - (timestep_view *) view whose drawing changed
+ * @retval	NONE
+ */
+void timestep_view_invalidate_cache(timestep_view *v) {
+    core_invalidate_frame();
+    mark_caches_dirty(v);
 }
 
-void timestep_view_remove_animation(timestep_view *view, view_animation *anim) {
-    LOGFN("timestep_view_remove_animation");
+/**
+ * @name	reserve_subviews
+ * @brief	grows the subview array, doubling, until it holds count views
+ * @param	v - (timestep_view *) parent view
+ * @param	count - (unsigned int) subviews it needs room for
+ * @retval	bool - false if there was no memory
+ */
+static bool reserve_subviews(timestep_view *v, unsigned int count) {
+    if (count <= v->subview_array_size) {
+        return true;
+    }
 
-    //TODO this shouldn't be linear
-    unsigned int i;
-    view->anim_count--; //decrement now because if it's the last one we don't have to do anything
-    for (i = 0; i < view->anim_count; i++) {
-        if (view->anims[i] == anim) {
-            memcpy(view->anims[i+1], view->anims[i], sizeof(view_animation *) * view->anim_count - i );
-        }
+    unsigned int size = v->subview_array_size;
+    while (size < count) {
+        size *= 2;
     }
-    LOGFN("end timestep_view_remove_animation");
-}
 
-static int timestep_view_comparator(const void *a, const void *b) {
-    int diff = (*(timestep_view**)a)->z_index - (*(timestep_view**)b)->z_index;
-    if (diff == 0) {
-        return (*(timestep_view**)a)->added_at - (*(timestep_view**)b)->added_at;
-    } else {
-        return diff;
+    // the inline slots are copied out the first time they overflow
+    bool inline_storage = v->subviews == v->inline_subviews;
+    timestep_view **subviews = (timestep_view**)TAG_REALLOC(MEMORY_TAG_VIEWS, inline_storage ? NULL : v->subviews, sizeof(timestep_view*) * size);
+    if (!subviews) {
+        LOG("{view} WARNING: Unable to grow the subviews of view %u to %u", v->uid, size);
+        return false;
+    }
+    if (inline_storage) {
+        memcpy(subviews, v->inline_subviews, sizeof(v->inline_subviews));
     }
+    v->subviews = subviews;
+    v->subview_array_size = size;
+    return true;
 }
 
-void timestep_view_sort_subviews(timestep_view *v) {
-    LOGFN("timestep_view_sort_subviews");
-    qsort(v->subviews, v->subview_count, sizeof(timestep_view*), timestep_view_comparator);
-    for (unsigned int i = 0; i < v->subview_count; i++) {
-        v->subviews[i]->subview_index = i;
+/**
+ * @name	attach_subview
+ * @brief	the per subview part of adding it to v, once it is in v's array
+ * @param	v - (timestep_view *) new superview
+ * @param	subview - (timestep_view *) subview that was added
+ * @retval	NONE
+ */
+static void attach_subview(timestep_view *v, timestep_view *subview) {
+    refresh_tick(subview);
+    subview->superview = v;
+    subview->needs_reflow = true;
+    subview->transform_dirty = true;
+    timestep_view_damage(subview);
+    if (v->spatial_index) {
+        spatial_file(v->spatial_index, subview);
     }
-    LOGFN("end timestep_view_sort_subviews");
 }
 
 bool timestep_view_add_subview(timestep_view *v, timestep_view *subview) {
@@ -339,41 +3648,91 @@ bool timestep_view_add_subview(timestep_view *v, timestep_view *subview) {
     if (subview->superview) {
         timestep_view_remove_subview(subview->superview, subview);
     }
-    if (v->subview_array_size <= v->subview_count) {
-        v->subview_array_size *= 2;
-        v->subviews = (timestep_view**)realloc(v->subviews, sizeof(timestep_view*) * v->subview_array_size);
+    if (!reserve_subviews(v, v->subview_count + 1)) {
+        return false;
     }
 
     //LOG(">>> adding to view %i subview %i; current size %i", v->uid, subview->uid, v->subview_count);
-    subview->subview_index = v->subview_count;
-    v->subviews[v->subview_count++] = subview;
-    subview->superview = v;
     subview->added_at = ++add_order;
-    subview->needs_reflow = true;
-    v->dirty_z_index = true;
+    insert_subview(v, subview);
+    attach_subview(v, subview);
+    add_tick_count(v, subview->tick_count);
+    mark_caches_dirty(v);
+    // gaining a subview can stop an unclipped view being filed by its box
+    timestep_view_mark_moved(v);
 
     LOGFN("end timestep_view_add_subview");
     return true;
 }
 
+/**
+ * @name	timestep_view_add_subviews
+ * @brief	adds many subviews at once, as if added one by one in order,
+ *          growing the array once, sorting once and updating the
+ *          ancestors' tick counts once
+ * @param	v - (timestep_view *) parent view
+ * @param	subviews - (timestep_view **) views to add; views already under v
+ *          are skipped
+ * @param	count - (unsigned int) number of views
+ * @retval	unsigned int - number of views added
+ */
+unsigned int timestep_view_add_subviews(timestep_view *v, timestep_view **subviews, unsigned int count) {
+    LOGFN("timestep_view_add_subviews");
+    if (!reserve_subviews(v, v->subview_count + count)) {
+        return 0;
+    }
+
+    // appended in order, then sorted together: with equal z indexes the
+    // appended tail is already in place and the sort is a single pass
+    unsigned int added = 0;
+    int ticks = 0;
+    for (unsigned int i = 0; i < count; i++) {
+        timestep_view *subview = subviews[i];
+        if (subview->superview == v || subview == v) {
+            continue;
+        }
+        if (subview->superview) {
+            timestep_view_remove_subview(subview->superview, subview);
+        }
+
+        subview->added_at = ++add_order;
+        v->subviews[v->subview_count++] = subview;
+        attach_subview(v, subview);
+        ticks += subview->tick_count;
+        added++;
+    }
+
+    if (added) {
+        timestep_view_sort_subviews(v);
+        add_tick_count(v, ticks);
+        mark_caches_dirty(v);
+        timestep_view_mark_moved(v);
+    }
+    LOGFN("end timestep_view_add_subviews");
+    return added;
+}
+
 bool timestep_view_remove_subview(timestep_view *v, timestep_view *subview) {
     LOGFN("timestep_view_remove_subview");
-    unsigned int index = subview->subview_index;
-    unsigned int count = v->subview_count;
+    int index = subview->superview == v ? find_subview(v, subview) : -1;
 
-    timestep_view **pos = &v->subviews[index];
     //LOG("removing %i from %i", subview->uid, v->uid);
-    //LOG("count %i index %i", count, index);
-    if (index < count && *pos == subview) {
-        timestep_view **to = pos;
+    if (index >= 0) {
+        // shifted siblings keep stale subview_index hints, find_subview
+        // corrects them lazily
+        timestep_view **to = &v->subviews[index];
         timestep_view **from = to + 1;
-        int bytes = sizeof(timestep_view*) * (count - index - 1);
+        int bytes = sizeof(timestep_view*) * (v->subview_count - index - 1);
         memmove(to, from, bytes);
         v->subview_count--;
-        for (unsigned int i = index; i < count - 1; ++i) {
-            v->subviews[i]->subview_index = i;
+        if (v->spatial_index) {
+            spatial_forget(v->spatial_index, subview);
         }
+        // where it was drawn, while its cached ancestors can still be found
+        timestep_view_damage(subview);
         subview->superview = NULL;
+        add_tick_count(v, -(int) subview->tick_count);
+        mark_caches_dirty(v);
         LOGFN("end timestep_view_remove_subview");
         return true;
     } else {
@@ -382,6 +3741,54 @@ bool timestep_view_remove_subview(timestep_view *v, timestep_view *subview) {
         return false;
     }
 }
+
+/**
+ * @name	timestep_view_remove_subviews
+ * @brief	removes a run of subviews in their draw order with one move of
+ *          the array, and one update of the ancestors' tick counts
+ * @param	v - (timestep_view *) parent view
+ * @param	start - (unsigned int) position of the first subview to remove
+ * @param	count - (unsigned int) subviews to remove, clamped to the end
+ * @retval	unsigned int - number of subviews removed
+ */
+unsigned int timestep_view_remove_subviews(timestep_view *v, unsigned int start, unsigned int count) {
+    LOGFN("timestep_view_remove_subviews");
+    if (start >= v->subview_count) {
+        return 0;
+    }
+    if (count > v->subview_count - start) {
+        count = v->subview_count - start;
+    }
+
+    int ticks = 0;
+    for (unsigned int i = start; i < start + count; i++) {
+        timestep_view *subview = v->subviews[i];
+        if (v->spatial_index) {
+            spatial_forget(v->spatial_index, subview);
+        }
+        // where it was drawn, while its cached ancestors can still be found
+        timestep_view_damage(subview);
+        subview->superview = NULL;
+        ticks += subview->tick_count;
+    }
+
+    unsigned int tail = v->subview_count - start - count;
+    memmove(&v->subviews[start], &v->subviews[start + count], sizeof(timestep_view*) * tail);
+    v->subview_count -= count;
+    for (unsigned int i = start; i < v->subview_count; i++) {
+        v->subviews[i]->subview_index = i;
+    }
+
+    add_tick_count(v, -ticks);
+    mark_caches_dirty(v);
+    LOGFN("end timestep_view_remove_subviews");
+    return count;
+}
+
+unsigned int timestep_view_remove_all_subviews(timestep_view *v) {
+    return timestep_view_remove_subviews(v, 0, v->subview_count);
+}
+
 void timestep_view_add_filter(timestep_view *v, rgba *color) {
     v->filter_color.r = color->r;
     v->filter_color.g = color->g;
@@ -401,6 +3808,75 @@ timestep_view *timestep_view_get_superview(timestep_view *v) {
     return v->superview;
 }
 
+/**
+ * @name	hit_test_view
+ * @brief	finds the frontmost view under a point, undoing the view's local
+ *          transform rather than relying on matrices from the last render
+ * @param	v - (timestep_view *) view to test
+ * @param	x - (double) point in the superview's space
+ * @param	y - (double) point in the superview's space
+ * @retval	timestep_view* - the view hit, or NULL
+ */
+static timestep_view *hit_test_view(timestep_view *v, double x, double y) {
+    if (!v->visible) {
+        return NULL;
+    }
+
+    double sx = v->scale * v->scale_x;
+    double sy = v->scale * v->scale_y;
+    if (!sx || !sy) {
+        return NULL;
+    }
+
+    // local = T(x + anchor + offset) R(r) S(scale) T(-anchor), inverted
+    double dx = x - (v->x + v->anchor_x + v->offset_x);
+    double dy = y - (v->y + v->anchor_y + v->offset_y);
+    if (v->r) {
+        double c = cos(v->r);
+        double s = sin(v->r);
+        double rx = c * dx + s * dy;
+        dy = c * dy - s * dx;
+        dx = rx;
+    }
+    double lx = dx / sx + v->anchor_x;
+    double ly = dy / sy + v->anchor_y;
+
+    // views without a size act as plain containers for their subviews
+    bool sized = v->width > UNDEFINED_DIMENSION && v->height > UNDEFINED_DIMENSION;
+    bool inside = sized && lx >= 0 && ly >= 0 && lx < v->width && ly < v->height;
+    if (v->clip && sized && !inside) {
+        return NULL;
+    }
+
+    if (v->dirty_z_index) {
+        v->dirty_z_index = false;
+        timestep_view_sort_subviews(v);
+    }
+
+    // subviews are drawn in order, so the last one is in front
+    unsigned int count = v->subview_count;
+    timestep_view **subviews = v->subviews;
+    if (v->spatial_index) {
+        double point[4] = {lx, ly, lx, ly};
+        timestep_view **found = spatial_query(v, point, &count);
+        subviews = found ? found : v->subviews;
+        count = found ? count : v->subview_count;
+    }
+    for (unsigned int i = count; i > 0; --i) {
+        timestep_view *hit = hit_test_view(subviews[i - 1], lx, ly);
+        if (hit) {
+            return hit;
+        }
+    }
+
+    return inside ? v : NULL;
+}
+
+timestep_view *timestep_view_hit_test(timestep_view *root, double x, double y) {
+    LOGFN("timestep_view_hit_test");
+    return root ? hit_test_view(root, x, y) : NULL;
+}
+
 void timestep_view_delete(timestep_view *v) {
     LOGFN("timestep_view_delete");
 
@@ -408,9 +3884,11 @@ void timestep_view_delete(timestep_view *v) {
         // Unlink from the animation
         v->anims[i]->view = NULL;
     }
+    view_animation_forget_view(v);
+    timestep_events_forget_view(v);
 
     // Free memory for animation array
-    free(v->anims);
+    TAG_FREE(v->anims);
 
     // If view is still connected,
     if (v->superview) {
@@ -418,20 +3896,76 @@ void timestep_view_delete(timestep_view *v) {
         timestep_view_remove_subview(v->superview, v);
     }
 
+    if (v->spatial_index) {
+        spatial_free(v);
+    }
+    display_list_delete(v->render_list);
+    forget_damage(v);
+
     // Disconnect all subviews
     for (unsigned int i = 0, count = v->subview_count; i < count; ++i) {
         timestep_view *subview = v->subviews[i];
 
         // Stomp.
         subview->superview = NULL;
+
+        // nothing else holds a prefab's views until JS wraps them
+        if (subview->prefab_owned) {
+            timestep_view_delete(subview);
+        }
     }
 
-    free(v->subviews);
+    if (v->subviews != v->inline_subviews) {
+        TAG_FREE(v->subviews);
+    }
+    if (v->timestep_view_render == sprite_view_render) {
+        free_sprite_state(v);
+    } else if (v->timestep_view_render == tilemap_view_render) {
+        free_tilemap_state(v);
+    } else if (v->timestep_view_render == particle_view_render) {
+        free_particle_state(v);
+    } else if (v->timestep_view_render == text_view_render) {
+        free_text_state(v);
+    } else if (v->timestep_view_render == skeleton_view_render) {
+        free_skeleton_state(v);
+    } else if (v->timestep_view_render == scroll_view_render) {
+        free_scroll_state(v);
+    }
+    free_owned_map(v);
+    if (v->cache_ctx) {
+        context_2d_release_scratch(v->cache_ctx);
+    }
     js_object_wrapper_delete(&v->map_ref);
-    free(v);
+    uid_table_remove(v);
+    release_view(v);
 }
 
 CEXPORT void timestep_view_shutdown() {
     UID = 0;
     add_order = 0;
+
+    TAG_FREE(render_stack);
+    render_stack = NULL;
+    render_depth = 0;
+    render_stack_size = 0;
+
+    TAG_FREE(tick_stack);
+    tick_stack = NULL;
+    tick_depth = 0;
+    tick_stack_size = 0;
+
+    TAG_FREE(damaged_views);
+    damaged_views = NULL;
+    damaged_count = 0;
+    damaged_size = 0;
+
+    TAG_FREE(scroll_covered);
+    scroll_covered = NULL;
+    scroll_covered_size = 0;
+    scroll_pan_uid = 0;
+
+    TAG_FREE(views_by_uid);
+    views_by_uid = NULL;
+    uid_table_size = 0;
+    uid_table_count = 0;
 }
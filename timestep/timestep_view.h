@@ -17,6 +17,12 @@
 #define TIMESTEP_VIEW_H
 
 #include "core/timestep/timestep.h"
+#include "core/timestep/timestep_image_map.h"
+#include "core/timestep/timestep_gestures.h"
+#include "core/timestep/timestep_particles.h"
+#include "core/timestep/timestep_scroll.h"
+#include "core/timestep/timestep_skeleton.h"
+#include "core/timestep/timestep_text_data.h"
 
 timestep_view *timestep_view_init();
 void timestep_view_delete(timestep_view *v);
@@ -25,18 +31,113 @@ void timestep_view_delete(timestep_view *v);
 // the absScale on each view's style as we render
 void timestep_view_start_render();
 void timestep_view_wrap_render(timestep_view *v, context_2d *ctx, JS_OBJECT_WRAPPER js_ctx, JS_OBJECT_WRAPPER js_opts);
+// Lets full renders work out the transforms and culling of the root's
+// natively drawn subtrees on the job workers, when there are at least three.
+// Off by default. A JS render that changes another subtree without adding
+// or removing views shows the change a frame late
+void timestep_view_set_parallel_record(bool enabled);
 
 void timestep_view_set_type(timestep_view *v, unsigned int type);
+void timestep_view_set_sprite(timestep_view *v, timestep_sprite *sprite, bool loop);
+void timestep_view_stop_sprite(timestep_view *v);
+// 0 for views other than SPRITE_VIEW
+unsigned int timestep_view_get_sprite_frame(timestep_view *v);
+void timestep_view_set_sprite_frame(timestep_view *v, unsigned int frame);
+void timestep_view_set_image_map(timestep_view *v, timestep_image_map *map);
+bool timestep_view_set_sheet_frame(timestep_view *v, timestep_sheet *sheet, unsigned int index);
+void timestep_view_set_tilemap(timestep_view *v, timestep_tilemap *tilemap);
+bool timestep_view_set_tile(timestep_view *v, unsigned int column, unsigned int row, int tile);
+void timestep_view_set_particle_emitter(timestep_view *v, timestep_particle_emitter *emitter);
+void timestep_view_set_text_data(timestep_view *v, timestep_text_data *text_data);
+void timestep_view_set_skeleton_pose(timestep_view *v, timestep_skeleton_pose *pose);
+// false if the view is not a SKELETON_VIEW with a pose, or has no such animation
+bool timestep_view_play_skeleton(timestep_view *v, const char *animation, bool loop, float speed);
+// NULL for views other than SCROLL_VIEW
+timestep_scroll *timestep_view_get_scroll(timestep_view *v);
+bool timestep_view_add_scroll_row_view(timestep_view *v, timestep_view *row_view);
+// feeds pans and taps on scroll views to them, taking those out of the list
+unsigned int timestep_view_route_scroll_gestures(gesture_event_list *gestures);
+
+timestep_view *timestep_view_get_by_uid(unsigned int uid);
+
+// Views live in slabs that never move, so JS can wrap their memory in
+// ArrayBuffers and read and write the fields below in place, without
+// crossing the bridge. Writes made that way are seen by the next render
+// and tick like any other; moving a view whose superview has a spatial
+// index still needs timestep_view_mark_moved. The fields are listed in
+// sharedProperties of templates/view.json
+enum view_field_types { VIEW_FIELD_FLOAT64, VIEW_FIELD_FLOAT32, VIEW_FIELD_BOOL };
+
+typedef struct timestep_view_shared_field_t {
+	const char *name;
+	unsigned int offset; // bytes from the start of a view
+	unsigned int type; // view_field_types, bools take one byte
+} timestep_view_shared_field;
+
+const timestep_view_shared_field *timestep_view_get_shared_fields(unsigned int *count, unsigned int *stride);
+void *timestep_view_get_shared_slab(unsigned int slab, unsigned int *bytes);
+bool timestep_view_get_shared_location(timestep_view *v, unsigned int *slab, unsigned int *index);
+
+// properties a sync record can carry, bit i of a record's mask is property
+// i. Keep in the order of syncProperties in templates/view.json
+enum view_sync_props {
+	SYNC_X,
+	SYNC_Y,
+	SYNC_OFFSET_X,
+	SYNC_OFFSET_Y,
+	SYNC_R,
+	SYNC_ANCHOR_X,
+	SYNC_ANCHOR_Y,
+	SYNC_OPACITY,
+	SYNC_SCALE,
+	SYNC_SCALE_X,
+	SYNC_SCALE_Y,
+	SYNC_WIDTH,
+	SYNC_HEIGHT,
+	SYNC_VISIBLE,
+	SYNC_Z_INDEX,
+	SYNC_PROP_COUNT
+};
+
+// Applies packed records of (uid, mask, one value per mask bit in bit
+// order), all doubles, so JS can move many views with one call instead of
+// one per property. Returns the number of values read, less than length
+// if a record was malformed
+unsigned int timestep_view_sync_properties(const double *records, unsigned int length);
 
 void timestep_view_wrap_tick(timestep_view *v, double dt);
+void timestep_view_set_has_jstick(timestep_view *v, bool has_jstick);
 void timestep_view_sort_subviews(timestep_view *v);
+void timestep_view_set_z_index(timestep_view *v, int z_index);
+void timestep_view_invalidate_cache(timestep_view *v);
+// With core_set_partial_redraw, code that changes how a view draws calls
+// this so the next frame redraws where it was and where it will be; it
+// draws the next frame otherwise
+void timestep_view_damage(timestep_view *v);
+// views with static_render set replay the context_2d calls of their first JS
+// render until this is called
+void timestep_view_invalidate_render(timestep_view *v);
 bool timestep_view_add_subview(timestep_view *v, timestep_view *subview);
 bool timestep_view_remove_subview(timestep_view *v, timestep_view *subview);
+// batch versions for populating and clearing lists; the range is in draw order
+unsigned int timestep_view_add_subviews(timestep_view *v, timestep_view **subviews, unsigned int count);
+unsigned int timestep_view_remove_subviews(timestep_view *v, unsigned int start, unsigned int count);
+unsigned int timestep_view_remove_all_subviews(timestep_view *v);
 timestep_view *timestep_view_get_superview(timestep_view *v);
+// frontmost visible view under a point given in root's superview space
+timestep_view *timestep_view_hit_test(timestep_view *root, double x, double y);
+
+// Files the view's subviews in a grid of cell_size cells that culling and hit
+// testing query instead of visiting every subview, 0 to stop. Code that
+// writes a subview's position, size, transform, clip or draws outside bounds
+// flags straight into the struct must call timestep_view_mark_moved on it.
+void timestep_view_set_spatial_index(timestep_view *v, double cell_size);
+void timestep_view_mark_moved(timestep_view *v);
 void timestep_view_add_filter(timestep_view *v, rgba *color);
 void timestep_view_clear_filters(timestep_view *v);
 
 void timestep_view_add_animation(timestep_view *view, struct view_animation_t *anim);
+void timestep_view_remove_animation(timestep_view *view, struct view_animation_t *anim);
 
 // Shutdown timestep view subsystem
 CEXPORT void timestep_view_shutdown();
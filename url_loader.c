@@ -18,13 +18,188 @@
  * @brief
  */
 #include "platform/resource_loader.h"
+#include "core/url_loader.h"
+#include "core/asset_pack.h"
+#include "core/jobs.h"
+#include "core/events.h"
+#include "core/log.h"
+#include "core/deps/jansson/jansson.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+// how much of the file a chunk callback is handed at a time
+#define URL_LOAD_CHUNK_SIZE (64 * 1024)
+
+typedef struct url_load_t {
+    char *url;
+    url_chunk_cb on_chunk;
+    url_loaded_cb on_loaded;
+    void *data;
+    char *contents;
+    unsigned long size;
+    bool failed;
+} url_load;
+
+static int m_next_load_id = 0;
 
 /**
  * @name	core_load_url
- * @brief	loads and returns a string from a given url / filename
+ * @brief	loads and returns a string from a given url / filename, from the
+ *			asset pack when the bundle has one with the file in it
  * @param	url - (const char *) url / filename to load from
  * @retval	char* - contents found in the file
  */
 char *core_load_url(const char *url) {
+    char *contents = asset_pack_read(url, NULL);
+    if (contents) {
+        return contents;
+    }
     return resource_loader_string_from_url(url);
 }
+
+static void feed_chunks(url_load *load, const char *bytes, unsigned long size) {
+    unsigned long offset = 0;
+    while (offset < size) {
+        unsigned long len = size - offset;
+        if (len > URL_LOAD_CHUNK_SIZE) {
+            len = URL_LOAD_CHUNK_SIZE;
+        }
+        load->on_chunk(bytes + offset, len, load->data);
+        offset += len;
+    }
+    load->size = size;
+}
+
+// hands bytes that stay owned by a mapping to the chunk callback, or copies
+// them for the loaded callback
+static void deliver_view(url_load *load, const unsigned char *bytes, unsigned long size) {
+    if (load->on_chunk) {
+        feed_chunks(load, (const char *) bytes, size);
+        return;
+    }
+
+    load->contents = (char *) malloc(size + 1);
+    if (!load->contents) {
+        load->failed = true;
+        return;
+    }
+    memcpy(load->contents, bytes, size);
+    load->contents[size] = '\0';
+    load->size = size;
+}
+
+static void load_url_run(void *data) {
+    url_load *load = (url_load *) data;
+    asset_pack_blob blob;
+    resource_view view;
+
+    bool packed = asset_pack_find(load->url, &blob);
+    if (packed && !blob.compressed) {
+        deliver_view(load, blob.data, blob.size);
+        return;
+    }
+    if (!packed && resource_loader_map_file(load->url, &view)) {
+        deliver_view(load, view.data, view.size);
+        resource_loader_unmap_file(&view);
+        return;
+    }
+
+    // compressed in the pack, or the platform can not map it
+    char *contents = core_load_url(load->url);
+    if (!contents) {
+        load->failed = true;
+        return;
+    }
+    if (load->on_chunk) {
+        feed_chunks(load, contents, strlen(contents));
+        free(contents);
+    } else {
+        load->contents = contents;
+        load->size = strlen(contents);
+    }
+}
+
+static void load_url_complete(void *data) {
+    url_load *load = (url_load *) data;
+    if (load->on_loaded) {
+        load->on_loaded(load->url, load->contents, load->size, load->failed, load->data);
+    } else {
+        free(load->contents);
+    }
+    free(load->url);
+    free(load);
+}
+
+/**
+ * @name	core_load_url_async
+ * @brief	loads a url / filename on a job worker without blocking the caller
+ * @param	url - (const char *) url / filename to load from
+ * @param	on_chunk - (url_chunk_cb) called on the worker with each chunk
+ * @param	on_loaded - (url_loaded_cb) called on the main thread when done
+ * @param	data - (void *) passed to both callbacks
+ * @retval	NONE
+ */
+void core_load_url_async(const char *url, url_chunk_cb on_chunk, url_loaded_cb on_loaded, void *data) {
+    url_load *load = (url_load *) calloc(1, sizeof(url_load));
+    if (load) {
+        load->url = strdup(url);
+    }
+    if (!load || !load->url) {
+        LOG("{url} WARNING: Unable to queue a load of %s", url);
+        free(load);
+        if (on_loaded) {
+            on_loaded(url, NULL, 0, true, data);
+        }
+        return;
+    }
+
+    load->on_chunk = on_chunk;
+    load->on_loaded = on_loaded;
+    load->data = data;
+    jobs_submit(load_url_run, load_url_complete, load, JOB_PRIORITY_NORMAL);
+}
+
+static void dispatch_loaded_event(const char *url, char *contents, unsigned long size, bool failed, void *data) {
+    int id = (int) (intptr_t) data;
+    json_t *event = json_object();
+    json_t *text = contents ? json_string(contents) : NULL;
+    free(contents);
+    if (!event) {
+        json_decref(text);
+        LOG("{url} WARNING: Unable to report load %d", id);
+        return;
+    }
+
+    // json_string refuses contents that are not utf-8
+    json_object_set_new(event, "id", json_integer(id));
+    json_object_set_new(event, "url", json_string(url));
+    json_object_set_new(event, "failed", json_boolean(failed || !text));
+    if (text) {
+        json_object_set_new(event, "data", text);
+    }
+    json_object_set_new(event, "name", json_string("urlLoaded"));
+    json_object_set_new(event, "priority", json_integer(0));
+
+    char *event_str = json_dumps(event, JSON_COMPACT);
+    json_decref(event);
+    if (!event_str) {
+        LOG("{url} WARNING: Unable to report load %d", id);
+        return;
+    }
+    core_dispatch_event(event_str);
+    free(event_str);
+}
+
+/**
+ * @name	core_load_url_event
+ * @brief	loads a url / filename on a job worker and dispatches a urlLoaded
+ *			event with its contents
+ * @param	url - (const char *) url / filename to load from
+ * @retval	int - id the event will carry
+ */
+int core_load_url_event(const char *url) {
+    int id = ++m_next_load_id;
+    core_load_url_async(url, NULL, dispatch_loaded_event, (void *) (intptr_t) id);
+    return id;
+}
@@ -16,6 +16,29 @@
 #ifndef URL_LOADER_H
 #define URL_LOADER_H
 
+#include "core/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// runs on the loading worker with each piece of the file in order, so a
+// parser can consume it without waiting for the whole file
+typedef void (*url_chunk_cb)(const char *chunk, unsigned long size, void *data);
+// runs on the main thread once the load is over. contents is NUL terminated
+// and owned by the callback, it is NULL when a chunk callback took the data
+// or when the load failed
+typedef void (*url_loaded_cb)(const char *url, char *contents, unsigned long size, bool failed, void *data);
+
 char *core_load_url(const char *url);
+// loads url on a job worker, on_chunk and on_loaded may be NULL
+void core_load_url_async(const char *url, url_chunk_cb on_chunk, url_loaded_cb on_loaded, void *data);
+// loads url on a job worker and reports it to js as a urlLoaded event
+// carrying the returned id
+int core_load_url_event(const char *url);
+
+#ifdef __cplusplus
+}
+#endif
 
 #endif
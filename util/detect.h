@@ -24,6 +24,13 @@
 
 #define GC_COMPILER_FENCE __asm__ __volatile__ ("" ::: "memory");
 
+// SIMD instruction sets available to the build, code must keep a scalar path
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define GC_HAS_NEON 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GC_HAS_SSE 1
+#endif
+
 #ifndef likely
 #define likely(x)       __builtin_expect((x),1)
 #endif